@@ -0,0 +1,256 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[BarIndex]"
+
+#include "BarIndex.h"
+
+#include <algorithm>
+
+
+namespace Rosegarden
+{
+
+
+BarIndex::BarIndex(timeT startMarker) :
+    m_changes(),
+    m_startMarker(startMarker)
+{
+}
+
+int
+BarIndex::findChangeForTime(timeT t, int hint) const
+{
+    const int count = int(m_changes.size());
+
+    // Is Change i (-1 for before the first) the last one at or before t?
+    auto contains = [this, count, t](int i) {
+        if (i < -1  ||  i >= count)
+            return false;
+        if (i >= 0  &&  m_changes[i].time > t)
+            return false;
+        return (i + 1 == count  ||  t < m_changes[i + 1].time);
+    };
+
+    int index;
+
+    // Same one as last time, or the next one?
+    if (contains(hint)) {
+        index = hint;
+    } else if (contains(hint + 1)) {
+        index = hint + 1;
+    } else {
+        auto i = std::upper_bound(
+                m_changes.begin(), m_changes.end(), t,
+                [](timeT t, const Change &change)
+                    { return t < change.time; });
+        index = int(i - m_changes.begin()) - 1;
+    }
+
+    if (index >= 0)
+        return index;
+
+    // In negative time, if there's no time signature actually defined
+    // prior to the point of interest then we use the next time
+    // signature after it, so long as it's no later than time zero.
+    // This is the only rational way to deal with count-in bars where
+    // the correct time signature otherwise won't appear until we hit
+    // bar zero.
+    if (t >= 0  ||  count == 0  ||  m_changes[0].time > 0)
+        return -1;
+
+    return 0;
+}
+
+int
+BarIndex::findChangeForBar(int n, int hint) const
+{
+    const int count = int(m_changes.size());
+
+    // Is Change i the first one at or after bar n?  (count if none.)
+    auto isFirst = [this, count, n](int i) {
+        if (i < 0  ||  i > count)
+            return false;
+        if (i < count  &&  m_changes[i].barNumber < n)
+            return false;
+        return (i == 0  ||  m_changes[i - 1].barNumber < n);
+    };
+
+    if (isFirst(hint))
+        return hint;
+    if (isFirst(hint + 1))
+        return hint + 1;
+
+    auto i = std::lower_bound(
+            m_changes.begin(), m_changes.end(), n,
+            [](const Change &change, int n)
+                { return change.barNumber < n; });
+    return int(i - m_changes.begin());
+}
+
+timeT
+BarIndex::getDefaultBarDuration(bool negative) const
+{
+    // In negative time (count-in bars) use the first time signature if
+    // it's no later than time zero.
+    if (negative  &&  !m_changes.empty()  &&  m_changes[0].time <= 0)
+        return m_changes[0].timeSig.getBarDuration();
+
+    return TimeSignature().getBarDuration();
+}
+
+int
+BarIndex::getBarNumber(timeT t) const
+{
+    // Not findChangeForTime(), which would apply the count-in rule.
+    auto i = std::upper_bound(
+            m_changes.begin(), m_changes.end(), t,
+            [](timeT t, const Change &change)
+                { return t < change.time; });
+
+    if (i == m_changes.begin()) {  // precedes any time signatures
+        const timeT barDuration = getDefaultBarDuration(t < 0);
+
+        int n = t / barDuration;
+        // Negative bars should be rounded down, except where the time
+        // is on a barline (i.e. time -1920 is bar -1, but time -3840 is
+        // also bar -1, in 4/4).
+        if (t < 0  &&  n * barDuration != t)
+            --n;
+
+        return n;
+    }
+
+    const Change &change = *(i - 1);
+    return change.barNumber +
+            (t - change.time) / change.timeSig.getBarDuration();
+}
+
+std::pair<timeT, timeT>
+BarIndex::getBarRange(int n, int next) const
+{
+    // next is the first Change at or after bar n.  The one in effect is
+    // either that one, if it starts bar n, or the one before it.
+    int current = next;
+    if (current == int(m_changes.size())  ||
+        m_changes[current].barNumber > n) {
+        --current;
+    } else {
+        ++next;
+    }
+
+    timeT start;
+    timeT barDuration;
+
+    if (current < 0) {  // precedes any time signature changes
+        barDuration = getDefaultBarDuration(n < 0);
+        start = n * barDuration;
+    } else {
+        const Change &change = m_changes[current];
+        barDuration = change.timeSig.getBarDuration();
+        start = change.time + (n - change.barNumber) * barDuration;
+    }
+
+    timeT finish = start + barDuration;
+
+    // partial bar
+    if (next < int(m_changes.size())  &&  finish > m_changes[next].time)
+        finish = m_changes[next].time;
+
+    return std::pair<timeT, timeT>(start, finish);
+}
+
+std::pair<timeT, timeT>
+BarIndex::getBarRange(int n) const
+{
+    return getBarRange(n, findChangeForBar(n, -2));
+}
+
+timeT
+BarIndex::getTimeSignatureAt(timeT t, TimeSignature &timeSig) const
+{
+    const int index = findChangeForTime(t, -2);
+
+    if (index < 0) {
+        timeSig = TimeSignature();
+        return 0;
+    }
+
+    timeSig = m_changes[index].timeSig;
+    return m_changes[index].time;
+}
+
+int
+BarIndex::getTimeSignatureNumberAt(timeT t) const
+{
+    return findChangeForTime(t, -2);
+}
+
+TimeSignature
+BarIndex::getTimeSignatureInBar(int n, bool &isNew) const
+{
+    isNew = false;
+
+    const timeT t = getBarRange(n).first;
+    const int index = findChangeForTime(t, -2);
+
+    if (index < 0)
+        return TimeSignature();
+
+    if (t == m_changes[index].time)
+        isNew = true;
+
+    return m_changes[index].timeSig;
+}
+
+std::vector<BarIndex::Bar>
+BarIndex::getBars(int firstBar, int lastBar) const
+{
+    std::vector<Bar> bars;
+    if (lastBar < firstBar)
+        return bars;
+
+    bars.reserve(lastBar - firstBar + 1);
+
+    // Bar numbers and times only go up, so each lookup starts from
+    // where the previous one ended up.
+    int barHint = -2;
+    int timeHint = -2;
+
+    for (int n = firstBar; n <= lastBar; ++n) {
+        barHint = findChangeForBar(n, barHint);
+        const std::pair<timeT, timeT> range = getBarRange(n, barHint);
+
+        timeHint = findChangeForTime(range.first, timeHint);
+
+        Bar bar;
+        bar.number = n;
+        bar.start = range.first;
+        bar.end = range.second;
+        if (timeHint < 0) {
+            bar.newTimeSig = false;
+        } else {
+            bar.timeSig = m_changes[timeHint].timeSig;
+            bar.newTimeSig = (range.first == m_changes[timeHint].time);
+        }
+
+        bars.push_back(bar);
+    }
+
+    return bars;
+}
+
+
+}
@@ -0,0 +1,144 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_BAR_INDEX_H
+#define RG_BAR_INDEX_H
+
+#include "TimeSignature.h"
+#include "TimeT.h"
+
+#include <rosegardenprivate_export.h>
+
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+namespace Rosegarden
+{
+
+
+/// Bar number <-> time lookups for a Composition.
+/**
+ * A snapshot of the Composition's time signature changes with the bar
+ * number of each change worked out in advance, kept in a plain sorted
+ * array.  Looking up a bar by time or a time by bar is a binary search,
+ * with no property lookups and no TimeSignature construction.
+ *
+ * Get one from Composition::getBarIndex().  Like TempoMap, a BarIndex
+ * never changes once built; the Composition builds a new one after the
+ * time signatures or the start marker change.
+ *
+ * The results are identical to what Composition::getBarNumber() and
+ * Composition::getBarRange() have always returned.  Those now use this.
+ */
+class ROSEGARDENPRIVATE_EXPORT BarIndex
+{
+public:
+    /// Number of the bar that starts at or contains time t.
+    /**
+     * @see Composition::getBarNumber()
+     */
+    int getBarNumber(timeT t) const;
+
+    /// Start and end time of bar n.
+    /**
+     * @see Composition::getBarRange()
+     */
+    std::pair<timeT, timeT> getBarRange(int n) const;
+
+    /// Time signature in effect at t and the time it came into effect.
+    /**
+     * @see Composition::getTimeSignatureAt()
+     */
+    timeT getTimeSignatureAt(timeT t, TimeSignature &timeSig) const;
+
+    /// Index of the time signature change in effect at t.  -1 if none.
+    /**
+     * @see Composition::getTimeSignatureNumberAt()
+     */
+    int getTimeSignatureNumberAt(timeT t) const;
+
+    /// Time signature in effect in bar n.
+    /**
+     * @see Composition::getTimeSignatureInBar()
+     */
+    TimeSignature getTimeSignatureInBar(int n, bool &isNew) const;
+
+    struct Bar
+    {
+        int number;
+        timeT start;
+        timeT end;
+        TimeSignature timeSig;
+        /// The time signature changes at the start of this bar.
+        bool newTimeSig;
+    };
+
+    /// Bars firstBar through lastBar inclusive.
+    /**
+     * Much faster than calling getBarRange() and getTimeSignatureInBar()
+     * for each bar, which is what rulers and grids drawing a bar at a
+     * time would otherwise do.
+     */
+    std::vector<Bar> getBars(int firstBar, int lastBar) const;
+
+    /// Number of time signature changes.
+    size_t size() const  { return m_changes.size(); }
+
+private:
+    // Only Composition can make these.
+    friend class Composition;
+
+    explicit BarIndex(timeT startMarker);
+
+    struct Change
+    {
+        timeT time;
+        int barNumber;
+        TimeSignature timeSig;
+    };
+
+    // The composition's time signature changes in time order.
+    std::vector<Change> m_changes;
+
+    // What the index was built for.  See Composition::getBarIndex().
+    timeT m_startMarker;
+
+    /// Index of the Change in effect at t.  -1 if none.
+    /**
+     * In negative time before any Change, the first one counts if it is
+     * no later than time zero.  For count-in bars.
+     *
+     * hint is where to start looking.  See getBars().
+     */
+    int findChangeForTime(timeT t, int hint) const;
+
+    /// Index of the first Change at or after bar n.
+    /**
+     * hint is where to start looking.  See getBars().
+     */
+    int findChangeForBar(int n, int hint) const;
+
+    /// Bar duration before the first Change.
+    timeT getDefaultBarDuration(bool negative) const;
+
+    /// getBarRange() given the result of findChangeForBar().
+    std::pair<timeT, timeT> getBarRange(int n, int next) const;
+};
+
+
+}
+
+#endif
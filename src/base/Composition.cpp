@@ -26,6 +26,8 @@
 #include "BasicQuantizer.h"
 #include "NotationQuantizer.h"
 #include "base/AudioLevel.h"
+#include "base/BarIndex.h"
+#include "base/TempoMap.h"
 
 #include <algorithm>
 #include <cmath>
@@ -48,9 +50,8 @@ namespace Rosegarden
 
 
 const PropertyName Composition::NoAbsoluteTimeProperty("NoAbsoluteTime");
-const PropertyName Composition::BarNumberProperty("BarNumber");
 
-const std::string Composition::TempoEventType("tempo");
+const EventTypeName Composition::TempoEventType("tempo");
 const PropertyName Composition::TempoProperty("Tempo");
 const PropertyName Composition::TargetTempoProperty("TargetTempo");
 const PropertyName Composition::TempoTimestampProperty("TimestampSec");
@@ -245,8 +246,9 @@ Composition::Composition() :
     m_selectedTrackId(0),
     m_timeSigSegment(TimeSignature::EventType),
     m_tempoSegment(TempoEventType),
-    m_barPositionsNeedCalculating(true),
+    m_barIndex(),
     m_tempoTimestampsNeedCalculating(true),
+    m_tempoMap(),
     m_basicQuantizer(new BasicQuantizer()),
     m_notationQuantizer(new NotationQuantizer()),
     m_position(0),
@@ -744,7 +746,9 @@ Composition::clear()
     clearTriggerSegments();
 
     m_timeSigSegment.clear();
+    m_barIndex.reset();
     m_tempoSegment.clear();
+    m_tempoMap.reset();
     m_defaultTempo = getTempoForQpm(120.0);
     m_minTempo = 0;
     m_maxTempo = 0;
@@ -758,67 +762,9 @@ Composition::clear()
     updateRefreshStatuses();
 }
 
-void
-Composition::calculateBarPositions() const
-{
-    if (!m_barPositionsNeedCalculating) return;
-
-#ifdef DEBUG_BAR_STUFF
-    RG_DEBUG << "calculateBarPositions()";
-#endif
-
-    ReferenceSegment &t = m_timeSigSegment;
-    ReferenceSegment::iterator i;
-
-    timeT lastBarNo = 0;
-    timeT lastSigTime = 0;
-    timeT barDuration = TimeSignature().getBarDuration();
-
-    if (getStartMarker() < 0) {
-        if (!t.empty() && (*t.begin())->getAbsoluteTime() <= 0) {
-            barDuration = TimeSignature(**t.begin()).getBarDuration();
-        }
-        lastBarNo = getStartMarker() / barDuration;
-        lastSigTime = getStartMarker();
-#ifdef DEBUG_BAR_STUFF
-        RG_DEBUG << "calculateBarPositions(): start marker = " << getStartMarker() << ", so initial bar number = " << lastBarNo;
-#endif
-    }
-
-    for (i = t.begin(); i != t.end(); ++i) {
-
-        timeT myTime = (*i)->getAbsoluteTime();
-        int n = (myTime - lastSigTime) / barDuration;
-
-        // should only happen for first time sig, when it's at time < 0:
-        if (myTime < lastSigTime) --n;
-
-        // would there be a new bar here anyway?
-        if (barDuration * n + lastSigTime == myTime) { // yes
-            n += lastBarNo;
-        } else { // no
-            n += lastBarNo + 1;
-        }
-
-#ifdef DEBUG_BAR_STUFF
-        RG_DEBUG << "calculateBarPositions(): bar " << n << " at " << myTime;
-#endif
-
-        (*i)->set<Int>(BarNumberProperty, n);
-
-        lastBarNo = n;
-        lastSigTime = myTime;
-        barDuration = TimeSignature(**i).getBarDuration();
-    }
-
-    m_barPositionsNeedCalculating = false;
-}
-
 int
 Composition::getNbBars() const
 {
-    calculateBarPositions();
-
     // the "-1" is a small kludge to deal with the case where the
     // composition has a duration that's an exact number of bars
     int bars = getBarNumber(getDuration() - 1) + 1;
@@ -832,35 +778,8 @@ Composition::getNbBars() const
 int
 Composition::getBarNumber(timeT t) const
 {
-    calculateBarPositions();
-    ReferenceSegment::iterator i = m_timeSigSegment.findAtOrBefore(t);
-    int n;
-
-    if (i == m_timeSigSegment.end()) { // precedes any time signatures
-
-        timeT bd = TimeSignature().getBarDuration();
-        if (t < 0) { // see comment in getTimeSignatureAtAux
-            i = m_timeSigSegment.begin();
-            if (i != m_timeSigSegment.end() && (*i)->getAbsoluteTime() <= 0) {
-                bd = TimeSignature(**i).getBarDuration();
-            }
-        }
-
-        n = t / bd;
-        if (t < 0) {
-            // negative bars should be rounded down, except where
-            // the time is on a barline in which case we already
-            // have the right value (i.e. time -1920 is bar -1,
-            // but time -3840 is also bar -1, in 4/4)
-            if (n * bd != t) --n;
-        }
-
-    } else {
-
-        n = (*i)->get<Int>(BarNumberProperty);
-        timeT offset = t - (*i)->getAbsoluteTime();
-        n += offset / TimeSignature(**i).getBarDuration();
-    }
+    updateBarIndex();
+    const int n = m_barIndex->getBarNumber(t);
 
 #ifdef DEBUG_BAR_STUFF
     RG_DEBUG << "getBarNumber(" << t << "): returning " << n;
@@ -879,61 +798,87 @@ Composition::getBarRangeForTime(timeT t) const
 std::pair<timeT, timeT>
 Composition::getBarRange(int n) const
 {
-    calculateBarPositions();
-
-    Event dummy("dummy", 0);
-    dummy.set<Int>(BarNumberProperty, n);
+    updateBarIndex();
+    const std::pair<timeT, timeT> range = m_barIndex->getBarRange(n);
 
-    ReferenceSegment::iterator j = std::lower_bound
-        (m_timeSigSegment.begin(), m_timeSigSegment.end(),
-         &dummy, BarNumberComparator());
-    ReferenceSegment::iterator i = j;
-
-    if (i == m_timeSigSegment.end() || (*i)->get<Int>(BarNumberProperty) > n) {
-        if (i == m_timeSigSegment.begin()) i = m_timeSigSegment.end();
-        else --i;
-    } else ++j; // j needs to point to following barline
-
-    timeT start, finish;
+#ifdef DEBUG_BAR_STUFF
+    RG_DEBUG << "getBarRange(): bar " << n << ": (" << range.first << " -> " << range.second << ")";
+#endif
+    return range;
+}
 
-    if (i == m_timeSigSegment.end()) { // precedes any time sig changes
+std::shared_ptr<const BarIndex>
+Composition::getBarIndex() const
+{
+    updateBarIndex();
+    return m_barIndex;
+}
 
-        timeT barDuration = TimeSignature().getBarDuration();
-        if (n < 0) { // see comment in getTimeSignatureAtAux
-            i = m_timeSigSegment.begin();
-            if (i != m_timeSigSegment.end() && (*i)->getAbsoluteTime() <= 0) {
-                barDuration = TimeSignature(**i).getBarDuration();
-            }
-        }
+void
+Composition::updateBarIndex() const
+{
+    // Bar numbering in negative time starts from the start marker.
+    if (m_barIndex  &&  m_barIndex->m_startMarker == getStartMarker())
+        return;
 
-        start = n * barDuration;
-        finish = start + barDuration;
+    Profiler profiler("Composition::getBarIndex()");
 
 #ifdef DEBUG_BAR_STUFF
-    RG_DEBUG << "getBarRange(): [1] bar " << n << ": (" << start << " -> " << finish << ")";
+    RG_DEBUG << "updateBarIndex()";
 #endif
 
-    } else {
+    std::shared_ptr<BarIndex> barIndex(new BarIndex(getStartMarker()));
+    barIndex->m_changes.reserve(m_timeSigSegment.size());
+
+    const ReferenceSegment &t = m_timeSigSegment;
+    ReferenceSegment::const_iterator i;
 
-        timeT barDuration = TimeSignature(**i).getBarDuration();
-        start = (*i)->getAbsoluteTime() +
-            (n - (*i)->get<Int>(BarNumberProperty)) * barDuration;
-        finish = start + barDuration;
+    timeT lastBarNo = 0;
+    timeT lastSigTime = 0;
+    timeT barDuration = TimeSignature().getBarDuration();
 
+    if (getStartMarker() < 0) {
+        if (!t.empty() && (*t.begin())->getAbsoluteTime() <= 0) {
+            barDuration = TimeSignature(**t.begin()).getBarDuration();
+        }
+        lastBarNo = getStartMarker() / barDuration;
+        lastSigTime = getStartMarker();
 #ifdef DEBUG_BAR_STUFF
-    RG_DEBUG << "getBarRange(): [2] bar " << n << ": (" << start << " -> " << finish << ")";
+        RG_DEBUG << "updateBarIndex(): start marker = " << getStartMarker() << ", so initial bar number = " << lastBarNo;
 #endif
     }
 
-    // partial bar
-    if (j != m_timeSigSegment.end() && finish > (*j)->getAbsoluteTime()) {
-        finish = (*j)->getAbsoluteTime();
+    for (i = t.begin(); i != t.end(); ++i) {
+
+        BarIndex::Change change;
+        change.time = (*i)->getAbsoluteTime();
+        change.timeSig = TimeSignature(**i);
+
+        int n = (change.time - lastSigTime) / barDuration;
+
+        // should only happen for first time sig, when it's at time < 0:
+        if (change.time < lastSigTime) --n;
+
+        // would there be a new bar here anyway?
+        if (barDuration * n + lastSigTime == change.time) { // yes
+            n += lastBarNo;
+        } else { // no
+            n += lastBarNo + 1;
+        }
+
 #ifdef DEBUG_BAR_STUFF
-    RG_DEBUG << "getBarRange(): [3] bar " << n << ": (" << start << " -> " << finish << ")";
+        RG_DEBUG << "updateBarIndex(): bar " << n << " at " << change.time;
 #endif
+
+        change.barNumber = n;
+        barIndex->m_changes.push_back(change);
+
+        lastBarNo = n;
+        lastSigTime = change.time;
+        barDuration = change.timeSig.getBarDuration();
     }
 
-    return std::pair<timeT, timeT>(start, finish);
+    m_barIndex = barIndex;
 }
 
 int
@@ -945,7 +890,7 @@ Composition::addTimeSignature(timeT t, const TimeSignature& timeSig)
 
     ReferenceSegment::iterator i =
         m_timeSigSegment.insertEvent(timeSig.getAsEvent(t));
-    m_barPositionsNeedCalculating = true;
+    m_barIndex.reset();
 
     updateRefreshStatuses();
     notifyTimeSignatureChanged();
@@ -964,51 +909,15 @@ Composition::getTimeSignatureAt(timeT t) const
 timeT
 Composition::getTimeSignatureAt(timeT t, TimeSignature &timeSig) const
 {
-    ReferenceSegment::iterator i = getTimeSignatureAtAux(t);
-
-    if (i == m_timeSigSegment.end()) {
-        timeSig = TimeSignature();
-        return 0;
-    } else {
-        timeSig = TimeSignature(**i);
-        return (*i)->getAbsoluteTime();
-    }
+    updateBarIndex();
+    return m_barIndex->getTimeSignatureAt(t, timeSig);
 }
 
 TimeSignature
 Composition::getTimeSignatureInBar(int barNo, bool &isNew) const
 {
-    isNew = false;
-    timeT t = getBarRange(barNo).first;
-
-    ReferenceSegment::iterator i = getTimeSignatureAtAux(t);
-
-    if (i == m_timeSigSegment.end()) return TimeSignature();
-    if (t == (*i)->getAbsoluteTime()) isNew = true;
-
-    return TimeSignature(**i);
-}
-
-Composition::ReferenceSegment::iterator
-Composition::getTimeSignatureAtAux(timeT t) const
-{
-    ReferenceSegment::iterator i = m_timeSigSegment.findAtOrBefore(t);
-
-    // In negative time, if there's no time signature actually defined
-    // prior to the point of interest then we use the next time
-    // signature after it, so long as it's no later than time zero.
-    // This is the only rational way to deal with count-in bars where
-    // the correct time signature otherwise won't appear until we hit
-    // bar zero.
-
-    if (t < 0 && i == m_timeSigSegment.end()) {
-        i = m_timeSigSegment.begin();
-        if (i != m_timeSigSegment.end() && (*i)->getAbsoluteTime() > 0) {
-            i  = m_timeSigSegment.end();
-        }
-    }
-
-    return i;
+    updateBarIndex();
+    return m_barIndex->getTimeSignatureInBar(barNo, isNew);
 }
 
 int
@@ -1020,9 +929,8 @@ Composition::getTimeSignatureCount() const
 int
 Composition::getTimeSignatureNumberAt(timeT t) const
 {
-    ReferenceSegment::iterator i = getTimeSignatureAtAux(t);
-    if (i == m_timeSigSegment.end()) return -1;
-    else return std::distance(m_timeSigSegment.begin(), i);
+    updateBarIndex();
+    return m_barIndex->getTimeSignatureNumberAt(t);
 }
 
 std::pair<timeT, TimeSignature>
@@ -1037,7 +945,7 @@ void
 Composition::removeTimeSignature(int n)
 {
     m_timeSigSegment.eraseEvent(m_timeSigSegment[n]);
-    m_barPositionsNeedCalculating = true;
+    m_barIndex.reset();
     updateRefreshStatuses();
     notifyTimeSignatureChanged();
 }
@@ -1154,6 +1062,7 @@ Composition::addTempoAtTime(timeT time, tempoT tempo, tempoT targetTempo)
     }
 
     m_tempoTimestampsNeedCalculating = true;
+    m_tempoMap.reset();
     updateRefreshStatuses();
 
 #ifdef DEBUG_TEMPO_STUFF
@@ -1219,6 +1128,7 @@ Composition::removeTempoChange(int n)
 
     m_tempoSegment.eraseEvent(m_tempoSegment[n]);
     m_tempoTimestampsNeedCalculating = true;
+    m_tempoMap.reset();
 
     if (oldTempo == m_minTempo ||
         oldTempo == m_maxTempo ||
@@ -1292,38 +1202,11 @@ Composition::compareSignaturesAndTempos(const Composition &other) const
 RealTime
 Composition::getElapsedRealTime(timeT t) const
 {
-    calculateTempoTimestamps();
-
-    ReferenceSegment::iterator i = m_tempoSegment.findAtOrBefore(t);
-    if (i == m_tempoSegment.end()) {
-        i = m_tempoSegment.begin();
-        if (t >= 0 ||
-            (i == m_tempoSegment.end() || (*i)->getAbsoluteTime() > 0)) {
-            return time2RealTime(t, m_defaultTempo);
-        }
-    }
-
-    RealTime elapsed;
-
-    tempoT target = -1;
-    timeT nextTempoTime = t;
-
-    if (!getTempoTarget(i, target, nextTempoTime)) target = -1;
-
-    if (target > 0) {
-        elapsed = getTempoTimestamp(*i) +
-            time2RealTime(t - (*i)->getAbsoluteTime(),
-                          tempoT((*i)->get<Int>(TempoProperty)),
-                          nextTempoTime - (*i)->getAbsoluteTime(),
-                          target);
-    } else {
-        elapsed = getTempoTimestamp(*i) +
-            time2RealTime(t - (*i)->getAbsoluteTime(),
-                          tempoT((*i)->get<Int>(TempoProperty)));
-    }
+    updateTempoMap();
+    const RealTime elapsed = m_tempoMap->toRealTime(t);
 
 #ifdef DEBUG_TEMPO_STUFF
-    RG_DEBUG << "getElapsedRealTime(): " << t << " -> " << elapsed << " (last tempo change at " << (*i)->getAbsoluteTime() << ")";
+    RG_DEBUG << "getElapsedRealTime(): " << t << " -> " << elapsed;
 #endif
 
     return elapsed;
@@ -1443,34 +1326,8 @@ Composition::getElapsedRealTime(timeT t) const
 timeT
 Composition::getElapsedTimeForRealTime(RealTime t) const
 {
-    calculateTempoTimestamps();
-
-    ReferenceSegment::iterator i = m_tempoSegment.findAtOrBefore(t);
-    if (i == m_tempoSegment.end()) {
-        i = m_tempoSegment.begin();
-        if (t >= RealTime::zero()  ||
-            (i == m_tempoSegment.end() || (*i)->getAbsoluteTime() > 0)) {
-            return realTime2Time(t, m_defaultTempo);
-        }
-    }
-
-    timeT elapsed;
-
-    tempoT target = -1;
-    timeT nextTempoTime = 0;
-    if (!getTempoTarget(i, target, nextTempoTime)) target = -1;
-
-    if (target > 0) {
-        elapsed = (*i)->getAbsoluteTime() +
-            realTime2Time(t - getTempoTimestamp(*i),
-                          (tempoT)((*i)->get<Int>(TempoProperty)),
-                          nextTempoTime - (*i)->getAbsoluteTime(),
-                          target);
-    } else {
-        elapsed = (*i)->getAbsoluteTime() +
-            realTime2Time(t - getTempoTimestamp(*i),
-                          (tempoT)((*i)->get<Int>(TempoProperty)));
-    }
+    updateTempoMap();
+    const timeT elapsed = m_tempoMap->toTime(t);
 
 #ifdef DEBUG_TEMPO_STUFF
     static int doError = true;
@@ -1481,9 +1338,7 @@ Composition::getElapsedTimeForRealTime(RealTime t) const
         doError = true;
         RG_DEBUG << "getElapsedTimeForRealTime(): " << t << " -> "
              << elapsed << " (error " << (cfReal - t)
-             << " or " << (cfTimeT - elapsed) << ", tempo "
-             << (*i)->getAbsoluteTime() << ":"
-             << (tempoT)((*i)->get<Int>(TempoProperty)) << ")";
+             << " or " << (cfTimeT - elapsed) << ")";
     }
 #endif
     return elapsed;
@@ -1547,6 +1402,70 @@ Composition::getElapsedTimeForRealTime(RealTime t) const
 }
 #endif
 
+std::shared_ptr<const TempoMap>
+Composition::getTempoMap() const
+{
+    updateTempoMap();
+    return m_tempoMap;
+}
+
+void
+Composition::updateTempoMap() const
+{
+    // Neither of these is a tempo change as far as the rest of
+    // Composition is concerned, but the map depends on them.
+    if (m_tempoMap  &&
+        m_tempoMap->m_defaultTempo == m_defaultTempo  &&
+        m_tempoMap->m_endMarker == m_endMarker)
+        return;
+
+    Profiler profiler("Composition::getTempoMap()");
+
+    std::shared_ptr<TempoMap> tempoMap(
+            new TempoMap(m_defaultTempo, m_endMarker));
+    tempoMap->m_changes.reserve(m_tempoSegment.size());
+
+    // Same as calculateTempoTimestamps().
+
+    timeT lastTimeT = 0;
+    RealTime lastRealTime;
+
+    tempoT tempo = m_defaultTempo;
+    tempoT target = -1;
+
+    for (ReferenceSegment::iterator i = m_tempoSegment.begin();
+         i != m_tempoSegment.end(); ++i) {
+
+        TempoMap::Change change;
+        change.time = (*i)->getAbsoluteTime();
+
+        if (target > 0) {
+            change.realTime = lastRealTime +
+                time2RealTime(change.time - lastTimeT, tempo,
+                              change.time - lastTimeT, target);
+        } else {
+            change.realTime = lastRealTime +
+                time2RealTime(change.time - lastTimeT, tempo);
+        }
+
+        change.tempo = tempoT((*i)->get<Int>(TempoProperty));
+
+        timeT targetTime = 0;
+        if (!getTempoTarget(i, target, targetTime)) target = -1;
+
+        change.target = target;
+        change.rampDuration = targetTime - change.time;
+
+        tempoMap->m_changes.push_back(change);
+
+        lastRealTime = change.realTime;
+        lastTimeT = change.time;
+        tempo = change.tempo;
+    }
+
+    m_tempoMap = tempoMap;
+}
+
 void
 Composition::calculateTempoTimestamps() const
 {
@@ -33,6 +33,7 @@
 #include <QtCore/QWeakPointer>
 
 // System
+#include <memory>
 #include <set>
 #include <map>
 
@@ -50,7 +51,9 @@ class Quantizer;
 class BasicQuantizer;
 class NotationQuantizer;
 
+class BarIndex;
 class CompositionObserver;
+class TempoMap;
 
 /// Composition contains a complete representation of a piece of music.
 /**
@@ -64,6 +67,7 @@ class ROSEGARDENPRIVATE_EXPORT Composition : public XmlExportable
 {
     friend class Track; // to call notifyTrackChanged()
     friend class Segment; // to call notifySegmentRepeatChanged()
+    friend class TempoMap; // to call time2RealTime() and realTime2Time()
 
 public:
     typedef SegmentMultiSet::iterator iterator;
@@ -506,6 +510,15 @@ public:
      */
     std::pair<timeT, timeT> getBarRangeForTime(timeT t) const;
 
+    /**
+     * Return the bar index for looking up lots of bars, e.g. when
+     * drawing a ruler.  See BarIndex::getBars().
+     *
+     * The BarIndex never changes.  After a time signature change, this
+     * returns a new one.
+     */
+    std::shared_ptr<const BarIndex> getBarIndex() const;
+
 
     //////
     //
@@ -688,6 +701,15 @@ public:
      */
     timeT getElapsedTimeForRealTime(RealTime t) const;
 
+    /**
+     * Return the tempo map for converting lots of times between
+     * musical and real time, e.g. when mapping a Segment for playback.
+     *
+     * The TempoMap never changes.  After a tempo change, this returns a
+     * new one.
+     */
+    std::shared_ptr<const TempoMap> getTempoMap() const;
+
     /**
      * Return the number of microseconds elapsed between
      * the two given timeT indices into the composition, taking
@@ -934,12 +956,11 @@ public:
 
 protected:
 
-    static const std::string TempoEventType;
+    static const EventTypeName TempoEventType;
     static const PropertyName TempoProperty;
     static const PropertyName TargetTempoProperty;
 
     static const PropertyName NoAbsoluteTimeProperty;
-    static const PropertyName BarNumberProperty;
     static const PropertyName TempoTimestampProperty;
 
     // Compares Event times.
@@ -951,17 +972,6 @@ protected:
         }
     };
 
-    struct BarNumberComparator
-    {
-        bool operator()(const Event &e1, const Event &e2) const {
-            return (e1.get<Int>(BarNumberProperty) <
-                    e2.get<Int>(BarNumberProperty));
-        }
-        bool operator()(const Event *e1, const Event *e2) const {
-            return operator()(*e1, *e2);
-        }
-    };
-
     /**
      * Ensure the selected and record trackids still point to something valid
      * Must be called after deletion of detach of a track
@@ -1056,14 +1066,18 @@ protected:
     /// Contains tempo events
     mutable ReferenceSegment m_tempoSegment;
 
-    /// affects m_timeSigSegment
-    void calculateBarPositions() const;
-    mutable bool m_barPositionsNeedCalculating;
-    ReferenceSegment::iterator getTimeSignatureAtAux(timeT t) const;
+    /// See getBarIndex().  Reset whenever m_timeSigSegment changes.
+    mutable std::shared_ptr<const BarIndex> m_barIndex;
+    /// (Re)build m_barIndex if needed.
+    void updateBarIndex() const;
 
     /// affects m_tempoSegment
     void calculateTempoTimestamps() const;
     mutable bool m_tempoTimestampsNeedCalculating;
+    /// See getTempoMap().  Reset whenever m_tempoSegment changes.
+    mutable std::shared_ptr<const TempoMap> m_tempoMap;
+    /// (Re)build m_tempoMap if needed.
+    void updateTempoMap() const;
     static RealTime time2RealTime(timeT t, tempoT tempo);
     static RealTime time2RealTime(timeT time, tempoT tempo,
                                   timeT targetTime, tempoT targetTempo);
@@ -20,6 +20,7 @@
 #include "XmlExportable.h"
 #include "NotationTypes.h"
 #include "BaseProperties.h"
+#include "MemoryPool.h"
 #include "misc/Debug.h"
 
 #include <sstream>
@@ -33,27 +34,94 @@ PropertyName Event::EventData::NotationTime("!notationtime");
 PropertyName Event::EventData::NotationDuration("!notationduration");
 
 
-Event::EventData::EventData(const std::string &type, timeT absoluteTime,
-                            timeT duration, short subOrdering) :
+namespace
+{
+    // Create on first use to avoid static init order fiasco.
+    // Note: This is a deliberate memory leak since Events may be
+    //       deleted very late during shutdown.
+    MemoryPool &eventPool()
+    {
+        static MemoryPool *pool = new MemoryPool("Event", sizeof(Event));
+        return *pool;
+    }
+}
+
+int
+Event::emptyTypeId()
+{
+    // getId() takes the name table's lock, and the segment parsing
+    // threads make a lot of Events with this.
+    static const int id = EventTypeName::getId("");
+    return id;
+}
+
+
+void *
+Event::operator new(size_t size)
+{
+    // A subclass with extra members can't come from the pool.
+    if (size != sizeof(Event))
+        return ::operator new(size);
+
+    return eventPool().allocate();
+}
+
+void
+Event::operator delete(void *p, size_t size)
+{
+    if (size != sizeof(Event)) {
+        ::operator delete(p);
+        return;
+    }
+
+    eventPool().deallocate(p);
+}
+
+MemoryPool &
+Event::EventData::getPool()
+{
+    // See eventPool().
+    static MemoryPool *pool = new MemoryPool("EventData", sizeof(EventData));
+    return *pool;
+}
+
+void *
+Event::EventData::operator new(size_t size)
+{
+    if (size != sizeof(EventData))
+        return ::operator new(size);
+
+    return getPool().allocate();
+}
+
+void
+Event::EventData::operator delete(void *p, size_t size)
+{
+    if (size != sizeof(EventData)) {
+        ::operator delete(p);
+        return;
+    }
+
+    getPool().deallocate(p);
+}
+
+
+
+Event::EventData::EventData(int typeId, timeT duration) :
     m_refCount(1),
-    m_type(type),
-    m_absoluteTime(absoluteTime),
+    m_typeId(typeId),
     m_duration(duration),
-    m_subOrdering(subOrdering),
     m_properties(nullptr)
 {
     // empty
 }
 
-Event::EventData::EventData(const std::string &type, timeT absoluteTime,
-                            timeT duration, short subOrdering,
-                            const PropertyMap *properties) :
+Event::EventData::EventData(int typeId, timeT duration,
+                            const FlatPropertyMap *properties) :
     m_refCount(1),
-    m_type(type),
-    m_absoluteTime(absoluteTime),
+    m_typeId(typeId),
     m_duration(duration),
-    m_subOrdering(subOrdering),
-    m_properties(properties ? new PropertyMap(*properties) : nullptr)
+    m_properties(properties ? new FlatPropertyMap(*properties) : nullptr)
 {
     // empty
 }
@@ -63,7 +131,7 @@ Event::EventData *Event::EventData::unshare()
     --m_refCount;
 
     EventData *newData = new EventData
-        (m_type, m_absoluteTime, m_duration, m_subOrdering, m_properties);
+        (m_typeId, m_duration, m_properties);
 
     return newData;
 }
@@ -77,21 +145,21 @@ Event::EventData::~EventData()
 }
 
 timeT
-Event::EventData::getNotationTime() const
+Event::EventData::getNotationTime(timeT absoluteTime) const
 {
-    if (!m_properties) return m_absoluteTime;
-    PropertyMap::const_iterator i = m_properties->find(NotationTime);
-    if (i == m_properties->end()) return m_absoluteTime;
-    else return static_cast<PropertyStore<Int> *>(i->second)->getData();
+    if (!m_properties) return absoluteTime;
+    FlatPropertyMap::const_iterator i = m_properties->find(NotationTime);
+    if (i == m_properties->end()) return absoluteTime;
+    else return i->getData<Int>();
 }
 
 timeT
 Event::EventData::getNotationDuration() const
 {
     if (!m_properties) return m_duration;
-    PropertyMap::const_iterator i = m_properties->find(NotationDuration);
+    FlatPropertyMap::const_iterator i = m_properties->find(NotationDuration);
     if (i == m_properties->end()) return m_duration;
-    else return static_cast<PropertyStore<Int> *>(i->second)->getData();
+    else return i->getData<Int>();
 }
 
 timeT
@@ -106,25 +174,24 @@ Event::getGreaterDuration() const
 void
 Event::EventData::setTime(const PropertyName &name, timeT t, timeT deft)
 {
-    if (!m_properties) m_properties = new PropertyMap();
-    PropertyMap::iterator i = m_properties->find(name);
+    if (!m_properties) m_properties = new FlatPropertyMap();
+    FlatPropertyMap::iterator i = m_properties->find(name);
 
     if (t != deft) {
         if (i == m_properties->end()) {
-            m_properties->insert(PropertyPair(name, new PropertyStore<Int>(t)));
+            m_properties->insert<Int>(name, t);
         } else {
-            static_cast<PropertyStore<Int> *>(i->second)->setData(t);
+            i->setData<Int>(t);
         }
     } else if (i != m_properties->end()) {
-        delete i->second;
         m_properties->erase(i);
     }
 }
 
-PropertyMap *
-Event::find(const PropertyName &name, PropertyMap::iterator &i)
+FlatPropertyMap *
+Event::find(const PropertyName &name, FlatPropertyMap::iterator &i)
 {
-    PropertyMap *map = m_data->m_properties;
+    FlatPropertyMap *map = m_data->m_properties;
 
     if (!map || ((i = map->find(name)) == map->end())) {
 
@@ -145,8 +212,8 @@ Event::has(const PropertyName &name) const
     ++m_hasCount;
 #endif
 
-    PropertyMap::const_iterator i;
-    const PropertyMap *map = find(name, i);
+    FlatPropertyMap::const_iterator i;
+    const FlatPropertyMap *map = find(name, i);
     if (map) return true;
     else return false;
 }
@@ -159,10 +226,9 @@ Event::unset(const PropertyName &name)
 #endif
 
     unshare();
-    PropertyMap::iterator i;
-    PropertyMap *map = find(name, i);
+    FlatPropertyMap::iterator i;
+    FlatPropertyMap *map = find(name, i);
     if (map) {
-        delete i->second;
         map->erase(i);
     }
 }
@@ -172,10 +238,10 @@ PropertyType
 Event::getPropertyType(const PropertyName &name) const
     // throw (NoData)
 {
-    PropertyMap::const_iterator i;
-    const PropertyMap *map = find(name, i);
+    FlatPropertyMap::const_iterator i;
+    const FlatPropertyMap *map = find(name, i);
     if (map) {
-        return i->second->getType();
+        return i->getType();
     } else {
         throw NoData(name.getName(), __FILE__, __LINE__);
     }
@@ -186,10 +252,10 @@ string
 Event::getPropertyTypeAsString(const PropertyName &name) const
     // throw (NoData)
 {
-    PropertyMap::const_iterator i;
-    const PropertyMap *map = find(name, i);
+    FlatPropertyMap::const_iterator i;
+    const FlatPropertyMap *map = find(name, i);
     if (map) {
-        return i->second->getTypeName();
+        return i->getTypeName();
     } else {
         throw NoData(name.getName(), __FILE__, __LINE__);
     }
@@ -200,10 +266,10 @@ string
 Event::getAsString(const PropertyName &name) const
     // throw (NoData)
 {
-    PropertyMap::const_iterator i;
-    const PropertyMap *map = find(name, i);
+    FlatPropertyMap::const_iterator i;
+    const FlatPropertyMap *map = find(name, i);
     if (map) {
-        return i->second->unparse();
+        return i->unparse();
     } else {
         throw NoData(name.getName(), __FILE__, __LINE__);
     }
@@ -346,9 +412,9 @@ Event::getPersistentPropertyNames() const
 {
     PropertyNames v;
     if (m_data->m_properties) {
-        for (PropertyMap::const_iterator i = m_data->m_properties->begin();
+        for (FlatPropertyMap::const_iterator i = m_data->m_properties->begin();
              i != m_data->m_properties->end(); ++i) {
-            v.push_back(i->first);
+            v.push_back(i->getName());
         }
     }
     return v;
@@ -359,9 +425,9 @@ Event::getNonPersistentPropertyNames() const
 {
     PropertyNames v;
     if (m_nonPersistentProperties) {
-        for (PropertyMap::const_iterator i = m_nonPersistentProperties->begin();
+        for (FlatPropertyMap::const_iterator i = m_nonPersistentProperties->begin();
              i != m_nonPersistentProperties->end(); ++i) {
-            v.push_back(i->first);
+            v.push_back(i->getName());
         }
     }
     return v;
@@ -373,6 +439,20 @@ Event::clearNonPersistentProperties()
     if (m_nonPersistentProperties) m_nonPersistentProperties->clear();
 }
 
+void
+Event::copyNonPersistentProperties(const Event &e)
+{
+    if (&e == this) return;
+
+    delete m_nonPersistentProperties;
+    m_nonPersistentProperties = nullptr;
+
+    if (e.m_nonPersistentProperties) {
+        m_nonPersistentProperties =
+                new FlatPropertyMap(*e.m_nonPersistentProperties);
+    }
+}
+
 void
 Event::unsafeChangeTime(timeT offset)
 {
@@ -387,21 +467,11 @@ Event::unsafeChangeTime(timeT offset)
 size_t
 Event::getStorageSize() const
 {
-    size_t s = sizeof(Event) + sizeof(EventData) + m_data->m_type.size();
-    if (m_data->m_properties) {
-        for (PropertyMap::const_iterator i = m_data->m_properties->begin();
-             i != m_data->m_properties->end(); ++i) {
-            s += sizeof(i->first);
-            s += i->second->getStorageSize();
-        }
-    }
-    if (m_nonPersistentProperties) {
-        for (PropertyMap::const_iterator i = m_nonPersistentProperties->begin();
-             i != m_nonPersistentProperties->end(); ++i) {
-            s += sizeof(i->first);
-            s += i->second->getStorageSize();
-        }
-    }
+    size_t s = sizeof(Event) + sizeof(EventData);
+    if (m_data->m_properties)
+        s += m_data->m_properties->getStorageSize();
+    if (m_nonPersistentProperties)
+        s += m_nonPersistentProperties->getStorageSize();
     return s;
 }
 
@@ -411,46 +481,40 @@ Event::isCopyOf(const Event &e) const
     if (&e == this)
         return true;
 
-    if (e.m_data == m_data)
+    if (e.m_data == m_data  &&
+        e.m_absoluteTime == m_absoluteTime  &&
+        e.m_subOrdering == m_subOrdering)
         return true;
 
     return false;
 }
 
-bool
-// cppcheck-suppress unusedFunction
-operator<(const Event &a, const Event &b)
-{
-    timeT at = a.getAbsoluteTime();
-    timeT bt = b.getAbsoluteTime();
-    if (at != bt) return at < bt;
-    else return a.getSubOrdering() < b.getSubOrdering();
-}
-
 // cppcheck-suppress unusedFunction
 QDebug operator<<(QDebug dbg, const Event &event)
 {
-    dbg << "Event type :" << event.m_data->m_type << "\n";
-    dbg << "  Absolute Time :" << event.m_data->m_absoluteTime << "\n";
+    dbg << "Event type :" << event.getType() << "\n";
+    dbg << "  Absolute Time :" << event.m_absoluteTime << "\n";
     dbg << "  Duration :" << event.m_data->m_duration << "\n";
-    dbg << "  Sub-ordering :" << event.m_data->m_subOrdering << "\n";
+    dbg << "  Sub-ordering :" << event.m_subOrdering << "\n";
     dbg << "  Persistent properties :\n";
 
     if (event.m_data->m_properties) {
-        for (const PropertyMap::value_type &property :
+        for (const FlatPropertyMap::Entry &property :
                  *(event.m_data->m_properties)) {
-            dbg << "    " << property.first.getName() << "[" <<
-                   property.first.getId() << "] :" << *(property.second) <<
+            dbg << "    " << property.getName().getName() << "[" <<
+                   property.getName().getId() << "] :" <<
+                   property.getTypeName() << "-" << property.unparse() <<
                    "\n";
         }
     }
 
     if (event.m_nonPersistentProperties) {
         dbg << "  Non-persistent properties :\n";
-        for (const PropertyMap::value_type &property :
+        for (const FlatPropertyMap::Entry &property :
                  *(event.m_nonPersistentProperties)) {
-            dbg << "    " << property.first.getName() << "[" <<
-                   property.first.getId() << "] :" << *(property.second) <<
+            dbg << "    " << property.getName().getName() << "[" <<
+                   property.getName().getId() << "] :" <<
+                   property.getTypeName() << "-" << property.unparse() <<
                    "\n";
         }
     }
@@ -17,7 +17,8 @@
 #ifndef RG_EVENT_H
 #define RG_EVENT_H
 
-#include "PropertyMap.h"
+#include "EventTypeName.h"
+#include "FlatPropertyMap.h"
 #include "Exception.h"
 #include "TimeT.h"
 #include "misc/Debug.h"
@@ -33,6 +34,9 @@ namespace Rosegarden
 {
 
 
+class MemoryPool;
+
+
 /// A generic Event.
 /**
  * The Event class represents an event of arbitrary type with some basic
@@ -59,7 +63,7 @@ namespace Rosegarden
  * would lead to an easier to understand and faster implementation of
  * Event.  The concrete types like Note would inherit directly from Event
  * and would provide member objects without using properties and a
- * PropertyMap.  One key downside is that older versions of rg would then
+ * FlatPropertyMap.  One key downside is that older versions of rg would then
  * be unable to preserve properties that they do not understand.
  * Not sure that's a very big deal given that the properties have been
  * pretty stable for quite a while.
@@ -104,14 +108,39 @@ public:
 
     Event(const std::string &type,
           timeT absoluteTime, timeT duration = 0, short subOrdering = 0) :
-        m_data(new EventData(type, absoluteTime, duration, subOrdering)),
+        m_data(new EventData(EventTypeName::getId(type), duration)),
+        m_absoluteTime(absoluteTime),
+        m_subOrdering(subOrdering),
+        m_nonPersistentProperties(nullptr)
+    { }
+
+    /// Faster version for the EventType constants.  No lookup required.
+    Event(const EventTypeName &type,
+          timeT absoluteTime, timeT duration = 0, short subOrdering = 0) :
+        m_data(new EventData(type.getId(), duration)),
+        m_absoluteTime(absoluteTime),
+        m_subOrdering(subOrdering),
         m_nonPersistentProperties(nullptr)
     { }
 
     Event(const std::string &type,
           timeT absoluteTime, timeT duration, short subOrdering,
           timeT notationAbsoluteTime, timeT notationDuration) :
-        m_data(new EventData(type, absoluteTime, duration, subOrdering)),
+        m_data(new EventData(EventTypeName::getId(type), duration)),
+        m_absoluteTime(absoluteTime),
+        m_subOrdering(subOrdering),
+        m_nonPersistentProperties(nullptr)
+    {
+        setNotationAbsoluteTime(notationAbsoluteTime);
+        setNotationDuration(notationDuration);
+    }
+
+    Event(const EventTypeName &type,
+          timeT absoluteTime, timeT duration, short subOrdering,
+          timeT notationAbsoluteTime, timeT notationDuration) :
+        m_data(new EventData(type.getId(), duration)),
+        m_absoluteTime(absoluteTime),
+        m_subOrdering(subOrdering),
         m_nonPersistentProperties(nullptr)
     {
         setNotationAbsoluteTime(notationAbsoluteTime);
@@ -121,21 +150,23 @@ public:
     // these ctors can't use default args: default has to be obtained from e
 
     Event(const Event &e, timeT absoluteTime) :
+        m_absoluteTime(absoluteTime),
+        m_subOrdering(e.m_subOrdering),
         m_nonPersistentProperties(nullptr)
     {
         share(e);
         unshare();
-        m_data->m_absoluteTime = absoluteTime;
         setNotationAbsoluteTime(absoluteTime);
         setNotationDuration(m_data->m_duration);
     }
 
     Event(const Event &e, timeT absoluteTime, timeT duration) :
+        m_absoluteTime(absoluteTime),
+        m_subOrdering(e.m_subOrdering),
         m_nonPersistentProperties(nullptr)
     {
         share(e);
         unshare();
-        m_data->m_absoluteTime = absoluteTime;
         m_data->m_duration = duration;
         setNotationAbsoluteTime(absoluteTime);
         setNotationDuration(duration);
@@ -143,39 +174,39 @@ public:
 
     Event(const Event &e, timeT absoluteTime,
           timeT duration, short subOrdering):
+        m_absoluteTime(absoluteTime),
+        m_subOrdering(subOrdering),
         m_nonPersistentProperties(nullptr)
     {
         share(e);
         unshare();
-        m_data->m_absoluteTime = absoluteTime;
         m_data->m_duration = duration;
-        m_data->m_subOrdering = subOrdering;
         setNotationAbsoluteTime(absoluteTime);
         setNotationDuration(duration);
     }
 
     Event(const Event &e, timeT absoluteTime, timeT duration, short subOrdering,
           timeT notationAbsoluteTime) :
+        m_absoluteTime(absoluteTime),
+        m_subOrdering(subOrdering),
         m_nonPersistentProperties(nullptr)
     {
         share(e);
         unshare();
-        m_data->m_absoluteTime = absoluteTime;
         m_data->m_duration = duration;
-        m_data->m_subOrdering = subOrdering;
         setNotationAbsoluteTime(notationAbsoluteTime);
         setNotationDuration(duration);
     }
 
     Event(const Event &e, timeT absoluteTime, timeT duration, short subOrdering,
           timeT notationAbsoluteTime, timeT notationDuration) :
+        m_absoluteTime(absoluteTime),
+        m_subOrdering(subOrdering),
         m_nonPersistentProperties(nullptr)
     {
         share(e);
         unshare();
-        m_data->m_absoluteTime = absoluteTime;
         m_data->m_duration = duration;
-        m_data->m_subOrdering = subOrdering;
         setNotationAbsoluteTime(notationAbsoluteTime);
         setNotationDuration(notationDuration);
     }
@@ -183,6 +214,8 @@ public:
     ~Event()  { lose(); }
 
     Event(const Event &e) :
+        m_absoluteTime(e.m_absoluteTime),
+        m_subOrdering(e.m_subOrdering),
         m_nonPersistentProperties(nullptr)
     {
         share(e);
@@ -194,6 +227,8 @@ public:
         if (&e != this) {
             lose();
             share(e);
+            m_absoluteTime = e.m_absoluteTime;
+            m_subOrdering = e.m_subOrdering;
         }
 
         return *this;
@@ -202,9 +237,9 @@ public:
     Event *copyMoving(timeT offset) const
     {
         return new Event(*this,
-                         m_data->m_absoluteTime + offset,
+                         m_absoluteTime + offset,
                          m_data->m_duration,
-                         m_data->m_subOrdering,
+                         m_subOrdering,
                          getNotationAbsoluteTime() + offset,
                          getNotationDuration());
     }
@@ -217,21 +252,28 @@ public:
     /// Type of the Event (E.g. Note, Accidental, Key, etc...)
     /**
      * See NotationTypes.h and MidiTypes.h for more examples.
+     *
+     * The returned reference is to the interned copy of the type name
+     * (see EventTypeName) and remains valid after this Event is gone.
      */
-    std::string getType() const
+    const std::string &getType() const
     {
         if (!m_data) {
             // cppcheck-suppress ConfigurationNotChecked
             RG_DEBUG << "Event::getType(): FATAL: m_data == nullptr.  Crash likely.";
-            return "";
+            return EventTypeName::getName(-1);
         }
-        return m_data->m_type;
+        return EventTypeName::getName(m_data->m_typeId);
     }
     /// Check Event type.
-    bool isa(const std::string &type) const  { return (m_data->m_type == type); }
-
-    timeT getAbsoluteTime() const  { return m_data->m_absoluteTime; }
-    timeT getNotationAbsoluteTime() const  { return m_data->getNotationTime(); }
+    bool isa(const std::string &type) const  { return (getType() == type); }
+    /// Check Event type.  Fast version for the EventType constants.
+    bool isa(const EventTypeName &type) const
+            { return (m_data->m_typeId == type.getId()); }
+
+    timeT getAbsoluteTime() const  { return m_absoluteTime; }
+    timeT getNotationAbsoluteTime() const
+            { return m_data->getNotationTime(m_absoluteTime); }
     /// Move Event in time without any ancillary coordination.
     /**
      * UNSAFE.  Don't call this unless you know exactly what you're doing.
@@ -248,7 +290,7 @@ public:
      */
     timeT getGreaterDuration() const;
 
-    short getSubOrdering() const  { return m_data->m_subOrdering; }
+    short getSubOrdering() const  { return m_subOrdering; }
 
     /**
      * Return whether this Event's section of a triggered ornament
@@ -337,6 +379,13 @@ public:
      */
     void clearNonPersistentProperties();
 
+    /**
+     * Replace the non persistent properties with copies of \a e's.
+     * The copy constructor leaves them out, but toXmlString() writes
+     * them, so a copy made to be saved needs them.
+     */
+    void copyNonPersistentProperties(const Event &e);
+
     /// Compare Event objects using Event::operator<.
     /**
      * Used when creating sets and multisets of Event objects, like Segment.
@@ -371,6 +420,12 @@ public:
      */
     std::string toXmlString(timeT expectedTime) const;
 
+    // *** Memory
+
+    /// Event objects come from a MemoryPool.
+    static void *operator new(size_t size);
+    static void operator delete(void *p, size_t size);
+
     // *** DEBUG
 
     /// Approximate.  For debugging and inspection purposes.
@@ -384,46 +439,59 @@ protected:
     // Interface for subclasses such as XmlStorableEvent.
 
     Event() :
-        m_data(new EventData("", 0, 0, 0)),
+        m_data(new EventData(emptyTypeId(), 0)),
+        m_absoluteTime(0),
+        m_subOrdering(0),
         m_nonPersistentProperties(nullptr)
     { }
 
-    void setType(const std::string &t) { unshare(); m_data->m_type = t; }
-    void setAbsoluteTime(timeT t)      { unshare(); m_data->m_absoluteTime = t; }
+    void setType(const std::string &t)
+            { unshare(); m_data->m_typeId = EventTypeName::getId(t); }
+    /// Without the name table lookup.
+    void setType(const EventTypeName &t)
+            { unshare(); m_data->m_typeId = t.getId(); }
+    void setAbsoluteTime(timeT t)      { m_absoluteTime = t; }
     void setDuration(timeT d)          { unshare(); m_data->m_duration = d; }
-    void setSubOrdering(short o)       { unshare(); m_data->m_subOrdering = o; }
-    void setNotationAbsoluteTime(timeT t) { unshare(); m_data->setNotationTime(t); }
+    void setSubOrdering(short o)       { m_subOrdering = o; }
+    void setNotationAbsoluteTime(timeT t)
+            { unshare(); m_data->setNotationTime(t, m_absoluteTime); }
     void setNotationDuration(timeT d) { unshare(); m_data->setNotationDuration(d); }
 
 private:
     friend QDebug operator<<(QDebug dbg, const Event &event);
 
+    /// EventTypeName::getId(""), looked up once.
+    static int emptyTypeId();
+
     /// Data that are shared between shallow-copied instances
     struct EventData
     {
-        EventData(const std::string &type,
-                  timeT absoluteTime, timeT duration, short subOrdering);
-        EventData(const std::string &type,
-                  timeT absoluteTime, timeT duration, short subOrdering,
-                  const PropertyMap *properties);
+        EventData(int typeId, timeT duration);
+        EventData(int typeId, timeT duration,
+                  const FlatPropertyMap *properties);
         /// Make a unique copy.  Used for Copy On Write.
         EventData *unshare();
         ~EventData();
+        /// EventData objects come from a MemoryPool.
+        static void *operator new(size_t size);
+        static void operator delete(void *p, size_t size);
+        static MemoryPool &getPool();
         unsigned int m_refCount;
 
-        std::string m_type;
-        timeT m_absoluteTime;
+        /// See EventTypeName.
+        int m_typeId;
         timeT m_duration;
-        short m_subOrdering;
 
-        PropertyMap *m_properties;
+        FlatPropertyMap *m_properties;
 
         // These are properties because we don't care so much about
         // raw speed in get/set, but we do care about storage size for
         // events that don't have them or that have zero values:
-        void setNotationTime(timeT t)
-            { setTime(NotationTime, t, m_absoluteTime); }
-        timeT getNotationTime() const;
+        // The notation time defaults to the Event's absolute time, which
+        // lives in the Event (see m_absoluteTime), so it is passed in.
+        void setNotationTime(timeT t, timeT absoluteTime)
+            { setTime(NotationTime, t, absoluteTime); }
+        timeT getNotationTime(timeT absoluteTime) const;
         void setNotationDuration(timeT d)
             { setTime(NotationDuration, d, m_duration); }
         timeT getNotationDuration() const;
@@ -444,9 +512,17 @@ private:
     //     It would be more interesting to make Copy On Write disable-able
     //     and see if it makes any sort of performance or memory difference.
     EventData *m_data;
+
+    // The sort key (see operator<) is kept here rather than in the
+    // shared EventData so that the comparisons done by every Segment
+    // insert and lookup, and the time checks done while scanning a
+    // Segment, touch one object per Event instead of two.
+    timeT m_absoluteTime;
+    short m_subOrdering;
+
     // ??? This doesn't seem to participate in Copy On Write, so a
     //     QSharedPointer should simplify managing this.
-    PropertyMap *m_nonPersistentProperties; // Unique to an instance
+    FlatPropertyMap *m_nonPersistentProperties; // Unique to an instance
 
     void share(const Event &e)
     {
@@ -487,7 +563,8 @@ private:
      * \return The map in which the property was found.  Returns nullptr
      *         otherwise.
      */
-    PropertyMap *find(const PropertyName &name, PropertyMap::iterator &i);
+    FlatPropertyMap *find(const PropertyName &name,
+                          FlatPropertyMap::iterator &i);
 
     /// Find a property in both the persistent and non-persistent properties.
     /**
@@ -497,26 +574,27 @@ private:
      * \return The map in which the property was found.  Returns nullptr
      *         otherwise.
      */
-    const PropertyMap *find(const PropertyName &name,
-                            PropertyMap::const_iterator &i) const
+    const FlatPropertyMap *find(const PropertyName &name,
+                                FlatPropertyMap::const_iterator &i) const
     {
-        PropertyMap::iterator j;
-        PropertyMap *map = const_cast<Event *>(this)->find(name, j);
+        FlatPropertyMap::iterator j;
+        FlatPropertyMap *map = const_cast<Event *>(this)->find(name, j);
         i = j;
         return map;
     }
 
+    /// Get the persistent or non-persistent map, creating it if needed.
     // cppcheck-suppress functionConst
-    PropertyMap::iterator insert(const PropertyPair &pair, bool persistent)
+    FlatPropertyMap *getMap(bool persistent)
     {
-        PropertyMap **map =
+        FlatPropertyMap **map =
             (persistent ? &m_data->m_properties : &m_nonPersistentProperties);
 
         // If the map hasn't been created yet, create it.
         if (!*map)
-            *map = new PropertyMap();
+            *map = new FlatPropertyMap();
 
-        return (*map)->insert(pair).first;
+        return *map;
     }
 
 #ifndef NDEBUG
@@ -531,6 +609,17 @@ private:
 
 extern ROSEGARDENPRIVATE_EXPORT QDebug operator<<(QDebug dbg, const Event &event);
 
+// Inline since every Segment insert and lookup goes through this
+// (via EventCmp) several times.
+inline bool
+operator<(const Event &a, const Event &b)
+{
+    const timeT at = a.getAbsoluteTime();
+    const timeT bt = b.getAbsoluteTime();
+    if (at != bt) return at < bt;
+    else return a.getSubOrdering() < b.getSubOrdering();
+}
+
 template <PropertyType P>
 bool
 Event::get(const PropertyName &name,
@@ -540,21 +629,20 @@ Event::get(const PropertyName &name,
     ++m_getCount;
 #endif
 
-    PropertyMap::const_iterator i;
-    const PropertyMap *map = find(name, i);
+    FlatPropertyMap::const_iterator i;
+    const FlatPropertyMap *map = find(name, i);
 
     // Not found?  Bail.
     if (!map)
         return false;
 
-    PropertyStoreBase *sb = i->second;
-    if (sb->getType() == P) {
-        val = (static_cast<PropertyStore<P> *>(sb))->getData();
+    if (i->getType() == P) {
+        val = i->getData<P>();
         return true;
     } else {
 #ifndef NDEBUG
         // cppcheck-suppress ConfigurationNotChecked
-        RG_DEBUG << "get() Error: Attempt to get property \"" << name.getName() << "\" as" << PropertyDefn<P>::typeName() <<", actual type is" << sb->getTypeName();
+        RG_DEBUG << "get() Error: Attempt to get property \"" << name.getName() << "\" as" << PropertyDefn<P>::typeName() <<", actual type is" << i->getTypeName();
 #endif
         return false;
     }
@@ -569,17 +657,16 @@ Event::get(const PropertyName &name) const
     ++m_getCount;
 #endif
 
-    PropertyMap::const_iterator i;
-    const PropertyMap *map = find(name, i);
+    FlatPropertyMap::const_iterator i;
+    const FlatPropertyMap *map = find(name, i);
 
     if (map) {
 
-        PropertyStoreBase *sb = i->second;
-        if (sb->getType() == P)
-            return (static_cast<PropertyStore<P> *>(sb))->getData();
+        if (i->getType() == P)
+            return i->getData<P>();
         else {
             throw BadType(name.getName(),
-                          PropertyDefn<P>::typeName(), sb->getTypeName(),
+                          PropertyDefn<P>::typeName(), i->getTypeName(),
                           __FILE__, __LINE__);
         }
 
@@ -601,8 +688,8 @@ bool
 Event::isPersistent(const PropertyName &name) const
     // throw (NoData)
 {
-    PropertyMap::const_iterator i;
-    const PropertyMap *map = find(name, i);
+    FlatPropertyMap::const_iterator i;
+    const FlatPropertyMap *map = find(name, i);
 
     if (!map)
         throw NoData(name.getName(), __FILE__, __LINE__);
@@ -626,29 +713,28 @@ Event::set(const PropertyName &name, typename PropertyDefn<P>::basic_type value,
     // Copy on Write
     unshare();
 
-    PropertyMap::iterator i;
-    PropertyMap *map = find(name, i);
+    FlatPropertyMap::iterator i;
+    FlatPropertyMap *map = find(name, i);
 
     // If found, update.
     if (map) {
         bool persistentBefore = (map == m_data->m_properties);
         if (persistentBefore != persistent) {
-            i = insert(*i, persistent);
-            map->erase(name);
+            FlatPropertyMap::iterator moved = getMap(persistent)->insert(*i);
+            map->erase(i);
+            i = moved;
         }
 
-        PropertyStoreBase *sb = i->second;
-        if (sb->getType() == P) {
-            (static_cast<PropertyStore<P> *>(sb))->setData(value);
+        if (i->getType() == P) {
+            i->setData<P>(value);
         } else {
             throw BadType(name.getName(),
-                          PropertyDefn<P>::typeName(), sb->getTypeName(),
+                          PropertyDefn<P>::typeName(), i->getTypeName(),
                           __FILE__, __LINE__);
         }
 
     } else {  // Create
-        PropertyStoreBase *p = new PropertyStore<P>(value);
-        insert(PropertyPair(name, p), persistent);
+        getMap(persistent)->insert<P>(name, value);
     }
 }
 
@@ -669,8 +755,8 @@ Event::setMaybe(const PropertyName &name, typename PropertyDefn<P>::basic_type v
     // Copy On Write
     unshare();
 
-    PropertyMap::iterator i;
-    PropertyMap *map = find(name, i);
+    FlatPropertyMap::iterator i;
+    FlatPropertyMap *map = find(name, i);
 
     // If found, update only if not persistent
     if (map) {
@@ -678,19 +764,15 @@ Event::setMaybe(const PropertyName &name, typename PropertyDefn<P>::basic_type v
         if (map == m_data->m_properties)
             return;
 
-        PropertyStoreBase *sb = i->second;
-
-        if (sb->getType() == P) {
-            (static_cast<PropertyStore<P> *>(sb))->setData(value);
+        if (i->getType() == P) {
+            i->setData<P>(value);
         } else {
             throw BadType(name.getName(),
-                          PropertyDefn<P>::typeName(), sb->getTypeName(),
+                          PropertyDefn<P>::typeName(), i->getTypeName(),
                           __FILE__, __LINE__);
         }
     } else {  // Create
-        PropertyStoreBase *p = new PropertyStore<P>(value);
-        insert(PropertyPair(name, p),
-               false);  // persistent
+        getMap(false)->insert<P>(name, value);  // non-persistent
     }
 }
 
@@ -0,0 +1,62 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "base/EventTypeName.h"
+#include "base/NameTable.h"
+
+
+namespace Rosegarden
+{
+
+
+namespace
+{
+    // Constant-initialized, so the EventType constants can use it from
+    // their static initializers.
+    NameTable a_names;
+}
+
+
+int EventTypeName::getId(const std::string &name)
+{
+    return a_names.getId(name);
+}
+
+const std::string &EventTypeName::getName(int id)
+{
+    const std::string *name = a_names.getName(id);
+    if (!name) {
+        // Create on first use to avoid static init order fiasco.
+        static const std::string emptyName;
+        return emptyName;
+    }
+
+    return *name;
+}
+
+EventTypeName::EventTypeName(const char *name) :
+    std::string(name),
+    m_id(getId(*this))
+{
+}
+
+EventTypeName::EventTypeName(const std::string &name) :
+    std::string(name),
+    m_id(getId(name))
+{
+}
+
+
+}
@@ -0,0 +1,81 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_EVENT_TYPE_NAME_H
+#define RG_EVENT_TYPE_NAME_H
+
+#include <string>
+
+#include <rosegardenprivate_export.h>
+
+namespace Rosegarden
+{
+
+
+/// Interned Event type name (e.g. Note::EventType).
+/**
+
+  This is the Event type counterpart of PropertyName.  Each distinct
+  type string is mapped to a small serial ID at runtime, and Event
+  stores only that ID.  Event::isa() given an EventTypeName is then a
+  single int compare instead of a string compare, and
+  Event::getType() can return a reference to the one interned copy of
+  the string rather than a fresh std::string.
+
+  Unlike PropertyName, an EventTypeName *is* a std::string.  The
+  EventType constants (Note::EventType, Controller::EventType, etc...)
+  are used all over the place as plain strings (compared against
+  QStrings, concatenated, stored in std::string members) and deriving
+  keeps all of that working unchanged.  Only code that knows it has
+  an EventTypeName (e.g. Event::isa() and the Event ctors) gets the
+  fast path.
+
+  As with PropertyName, the IDs are assigned on demand and must never
+  be persisted.
+
+  Thread-safe, as is PropertyName.  Only constructing from a name
+  takes a lock; getName() doesn't (see NameTable).
+
+*/
+
+class ROSEGARDENPRIVATE_EXPORT EventTypeName : public std::string
+{
+public:
+    explicit EventTypeName(const char *name);
+    explicit EventTypeName(const std::string &name);
+
+    int getId() const  { return m_id; }
+
+    /// Get the existing ID for a type name, creating one if needed.
+    static int getId(const std::string &name);
+
+    /// Get the interned type name for an ID.
+    /**
+     * The reference remains valid for the lifetime of the program.
+     * Returns the empty string for an unknown ID.
+     */
+    static const std::string &getName(int id);
+
+private:
+
+    // The name's ID.
+    int m_id;
+
+};
+
+
+}
+
+#endif
@@ -0,0 +1,221 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "FlatPropertyMap.h"
+#include "MemoryPool.h"
+
+#include <algorithm>
+
+namespace Rosegarden
+{
+
+
+std::string
+FlatPropertyMap::Entry::getTypeName() const
+{
+    switch (m_type) {
+    case Int:
+        return PropertyDefn<Int>::typeName();
+    case String:
+        return PropertyDefn<String>::typeName();
+    case Bool:
+        return PropertyDefn<Bool>::typeName();
+    case RealTimeT:
+        return PropertyDefn<RealTimeT>::typeName();
+    }
+
+    return "Undefined";
+}
+
+std::string
+FlatPropertyMap::Entry::unparse() const
+{
+    switch (m_type) {
+    case Int:
+        return PropertyDefn<Int>::unparse(getData<Int>());
+    case String:
+        return PropertyDefn<String>::unparse(getData<String>());
+    case Bool:
+        return PropertyDefn<Bool>::unparse(getData<Bool>());
+    case RealTimeT:
+        return PropertyDefn<RealTimeT>::unparse(getData<RealTimeT>());
+    }
+
+    return "";
+}
+
+size_t
+FlatPropertyMap::Entry::getStorageSize() const
+{
+    size_t s = sizeof(Entry);
+    if (m_type == String)
+        s += sizeof(std::string) + m_string->size();
+    return s;
+}
+
+FlatPropertyMap::FlatPropertyMap(const FlatPropertyMap &pm) :
+    m_entries(m_inline),
+    m_size(0),
+    m_capacity(InlineCapacity)
+{
+    if (pm.m_size > m_capacity) {
+        m_entries = new Entry[pm.m_size];
+        m_capacity = pm.m_size;
+    }
+
+    // Already in order, so just copy across.
+    for (const Entry &entry : pm) {
+        Entry &copy = m_entries[m_size++];
+        copy = entry;
+        if (entry.m_type == String)
+            copy.m_string = new std::string(*entry.m_string);
+    }
+}
+
+FlatPropertyMap::~FlatPropertyMap()
+{
+    clear();
+    if (m_entries != m_inline)
+        delete[] m_entries;
+}
+
+FlatPropertyMap::iterator
+FlatPropertyMap::find(const PropertyName &name)
+{
+    iterator i = std::lower_bound(
+            begin(), end(), name,
+            [](const Entry &entry, const PropertyName &n) {
+                return entry.m_name < n;
+            });
+
+    if (i != end()  &&  i->m_name == name)
+        return i;
+
+    return end();
+}
+
+FlatPropertyMap::iterator
+FlatPropertyMap::makeSlot(const PropertyName &name)
+{
+    const size_t pos = std::lower_bound(
+            begin(), end(), name,
+            [](const Entry &entry, const PropertyName &n) {
+                return entry.m_name < n;
+            }) - begin();
+
+    if (m_size == m_capacity) {
+        // Grow.  Entries are trivially copyable; the String pointers
+        // simply move across with them.
+        const unsigned newCapacity = m_capacity * 2;
+        Entry *newEntries = new Entry[newCapacity];
+        std::copy(begin(), end(), newEntries);
+        if (m_entries != m_inline)
+            delete[] m_entries;
+        m_entries = newEntries;
+        m_capacity = newCapacity;
+    }
+
+    std::copy_backward(begin() + pos, end(), end() + 1);
+    ++m_size;
+
+    Entry &entry = m_entries[pos];
+    entry.m_name = name;
+    return &entry;
+}
+
+FlatPropertyMap::iterator
+FlatPropertyMap::insert(const Entry &entry)
+{
+    iterator i = makeSlot(entry.m_name);
+    *i = entry;
+    if (entry.m_type == String)
+        i->m_string = new std::string(*entry.m_string);
+    return i;
+}
+
+void
+FlatPropertyMap::destroy(Entry &entry)
+{
+    if (entry.m_type == String) {
+        delete entry.m_string;
+        entry.m_type = Int;
+        entry.m_int = 0;
+    }
+}
+
+void
+FlatPropertyMap::erase(iterator i)
+{
+    destroy(*i);
+    std::copy(i + 1, end(), i);
+    --m_size;
+}
+
+void
+FlatPropertyMap::clear()
+{
+    for (Entry &entry : *this)
+        destroy(entry);
+    m_size = 0;
+}
+
+namespace
+{
+    // Create on first use to avoid static init order fiasco.
+    // Note: This is a deliberate memory leak since Events may be
+    //       deleted very late during shutdown.
+    MemoryPool &pool()
+    {
+        static MemoryPool *pool =
+                new MemoryPool("FlatPropertyMap", sizeof(FlatPropertyMap));
+        return *pool;
+    }
+}
+
+void *
+FlatPropertyMap::operator new(size_t size)
+{
+    if (size != sizeof(FlatPropertyMap))
+        return ::operator new(size);
+
+    return pool().allocate();
+}
+
+void
+FlatPropertyMap::operator delete(void *p, size_t size)
+{
+    if (size != sizeof(FlatPropertyMap)) {
+        ::operator delete(p);
+        return;
+    }
+
+    pool().deallocate(p);
+}
+
+size_t
+FlatPropertyMap::getStorageSize() const
+{
+    size_t s = sizeof(FlatPropertyMap);
+    if (m_entries != m_inline)
+        s += m_capacity * sizeof(Entry);
+    for (const Entry &entry : *this) {
+        if (entry.m_type == String)
+            s += sizeof(std::string) + entry.m_string->size();
+    }
+    return s;
+}
+
+
+}
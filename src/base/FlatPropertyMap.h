@@ -0,0 +1,247 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_FLAT_PROPERTY_MAP_H
+#define RG_FLAT_PROPERTY_MAP_H
+
+#include "Property.h"
+#include "PropertyName.h"
+
+#include <rosegardenprivate_export.h>
+
+#include <string>
+
+namespace Rosegarden
+{
+
+
+/// Event's property container.
+/**
+ * A sorted array of PropertyName/value pairs with the first few entries
+ * stored inline in the object.  Int, Bool and RealTimeT values are
+ * stored directly in the entry; only String values go on the heap.
+ *
+ * This replaces the PropertyMap (a std::map of heap allocated
+ * PropertyStore objects) that Event used to use.  A typical note has
+ * two or three persistent properties (pitch, velocity, maybe a
+ * notation time) and used to cost a tree node plus a PropertyStore
+ * allocation for each.  With this it costs a single allocation for the
+ * map itself.
+ *
+ * Entries are kept sorted by PropertyName (i.e. by its ID) which is the
+ * same order std::map<PropertyName, ...> used, so iteration order (and
+ * therefore the XML written by Event::toXmlString()) is unchanged.
+ *
+ * Iterators are plain pointers and are invalidated by insert() and
+ * erase().
+ */
+class ROSEGARDENPRIVATE_EXPORT FlatPropertyMap
+{
+public:
+
+    /// One PropertyName/value pair.
+    class ROSEGARDENPRIVATE_EXPORT Entry
+    {
+    public:
+        Entry() : m_type(Int), m_int(0)  { }
+
+        const PropertyName &getName() const  { return m_name; }
+        PropertyType getType() const  { return m_type; }
+        std::string getTypeName() const;
+        std::string unparse() const;
+
+        /// The caller must make sure P matches getType().
+        template <PropertyType P>
+        typename PropertyDefn<P>::basic_type getData() const;
+
+        /// The caller must make sure P matches getType().
+        template <PropertyType P>
+        void setData(typename PropertyDefn<P>::basic_type value);
+
+        /// Approximate.  For debugging and inspection purposes.
+        size_t getStorageSize() const;
+
+    private:
+        friend class FlatPropertyMap;
+
+        /// Set type and value of a freshly created Entry.
+        template <PropertyType P>
+        void init(typename PropertyDefn<P>::basic_type value);
+
+        PropertyName m_name;
+        PropertyType m_type;
+
+        union {
+            long m_int;
+            bool m_bool;
+            // RealTime has a ctor, so it can't go in here.
+            struct { int sec; int nsec; } m_realTime;
+            // Owned by the FlatPropertyMap.
+            std::string *m_string;
+        };
+    };
+
+    typedef Entry *iterator;
+    typedef const Entry *const_iterator;
+
+    FlatPropertyMap() :
+        m_entries(m_inline),
+        m_size(0),
+        m_capacity(InlineCapacity)
+    { }
+    FlatPropertyMap(const FlatPropertyMap &);
+    ~FlatPropertyMap();
+
+    iterator begin()  { return m_entries; }
+    iterator end()  { return m_entries + m_size; }
+    const_iterator begin() const  { return m_entries; }
+    const_iterator end() const  { return m_entries + m_size; }
+
+    size_t size() const  { return m_size; }
+    bool empty() const  { return m_size == 0; }
+
+    /// Returns end() if not found.
+    iterator find(const PropertyName &name);
+    /// Returns end() if not found.
+    const_iterator find(const PropertyName &name) const
+        { return const_cast<FlatPropertyMap *>(this)->find(name); }
+
+    /// Add a new property.  The property must not already be present.
+    template <PropertyType P>
+    iterator insert(const PropertyName &name,
+                    typename PropertyDefn<P>::basic_type value)
+    {
+        iterator i = makeSlot(name);
+        i->init<P>(value);
+        return i;
+    }
+
+    /// Add a copy of an Entry from another map.
+    /**
+     * The property must not already be present.
+     */
+    iterator insert(const Entry &entry);
+
+    void erase(iterator i);
+
+    void clear();
+
+    /// Approximate.  For debugging and inspection purposes.
+    size_t getStorageSize() const;
+
+    /// FlatPropertyMap objects come from a MemoryPool.
+    static void *operator new(size_t size);
+    static void operator delete(void *p, size_t size);
+
+private:
+    FlatPropertyMap &operator=(const FlatPropertyMap &); // not provided
+
+    /// Open up a slot for name at its sorted position.
+    /**
+     * Returns the new Entry with only its name set.
+     */
+    iterator makeSlot(const PropertyName &name);
+
+    void destroy(Entry &entry);
+
+    // Enough for the persistent properties of most notes (pitch,
+    // velocity, the occasional notation time) without going to the heap.
+    static constexpr unsigned InlineCapacity = 4;
+
+    Entry *m_entries;
+    unsigned m_size;
+    unsigned m_capacity;
+    Entry m_inline[InlineCapacity];
+};
+
+
+template <>
+inline PropertyDefn<Int>::basic_type
+FlatPropertyMap::Entry::getData<Int>() const
+{
+    return m_int;
+}
+
+template <>
+inline PropertyDefn<Bool>::basic_type
+FlatPropertyMap::Entry::getData<Bool>() const
+{
+    return m_bool;
+}
+
+template <>
+inline PropertyDefn<RealTimeT>::basic_type
+FlatPropertyMap::Entry::getData<RealTimeT>() const
+{
+    return RealTime(m_realTime.sec, m_realTime.nsec);
+}
+
+template <>
+inline PropertyDefn<String>::basic_type
+FlatPropertyMap::Entry::getData<String>() const
+{
+    return *m_string;
+}
+
+template <>
+inline void
+FlatPropertyMap::Entry::setData<Int>(PropertyDefn<Int>::basic_type value)
+{
+    m_int = value;
+}
+
+template <>
+inline void
+FlatPropertyMap::Entry::setData<Bool>(PropertyDefn<Bool>::basic_type value)
+{
+    m_bool = value;
+}
+
+template <>
+inline void
+FlatPropertyMap::Entry::setData<RealTimeT>(
+        PropertyDefn<RealTimeT>::basic_type value)
+{
+    m_realTime.sec = value.sec;
+    m_realTime.nsec = value.nsec;
+}
+
+template <>
+inline void
+FlatPropertyMap::Entry::setData<String>(PropertyDefn<String>::basic_type value)
+{
+    *m_string = value;
+}
+
+template <PropertyType P>
+inline void
+FlatPropertyMap::Entry::init(typename PropertyDefn<P>::basic_type value)
+{
+    m_type = P;
+    setData<P>(value);
+}
+
+template <>
+inline void
+FlatPropertyMap::Entry::init<String>(PropertyDefn<String>::basic_type value)
+{
+    m_type = String;
+    m_string = new std::string(value);
+}
+
+
+}
+
+#endif
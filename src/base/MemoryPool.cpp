@@ -0,0 +1,238 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[MemoryPool]"
+
+#include "MemoryPool.h"
+
+#include "misc/Debug.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+
+namespace Rosegarden
+{
+
+
+namespace
+{
+    constexpr size_t SlabSize = 64 * 1024;
+    constexpr size_t Alignment = alignof(std::max_align_t);
+
+    constexpr size_t roundUp(size_t n)
+    {
+        return (n + Alignment - 1) / Alignment * Alignment;
+    }
+
+    // All pools, for dumpAll().  Pools are never destroyed, so this
+    // never dangles.
+    MemoryPool *a_pools = nullptr;
+    std::mutex a_poolsMutex;
+}
+
+
+struct MemoryPool::Slab
+{
+    Slab *prev;
+    Slab *next;
+    // Objects that have been freed back to this slab.
+    void *freeList;
+    // Objects never handed out yet start here.  This saves us from
+    // touching the whole slab when it is first allocated.
+    unsigned bumpIndex;
+    unsigned used;
+
+    char *objects()
+    {
+        return reinterpret_cast<char *>(this) + roundUp(sizeof(Slab));
+    }
+
+    static Slab *fromObject(void *p)
+    {
+        return reinterpret_cast<Slab *>(
+                reinterpret_cast<uintptr_t>(p) & ~(uintptr_t(SlabSize) - 1));
+    }
+};
+
+
+MemoryPool::MemoryPool(const char *name, size_t objectSize) :
+    m_name(name),
+    m_objectSize(roundUp(objectSize < sizeof(void *) ?
+                         sizeof(void *) : objectSize)),
+    m_capacity(static_cast<unsigned>(
+            (SlabSize - roundUp(sizeof(Slab))) / m_objectSize)),
+    m_partial(nullptr),
+    m_spare(nullptr),
+    m_stats(),
+    m_nextPool(nullptr)
+{
+    m_stats.name = m_name;
+    m_stats.objectSize = m_objectSize;
+
+    std::lock_guard<std::mutex> lock(a_poolsMutex);
+    m_nextPool = a_pools;
+    a_pools = this;
+}
+
+MemoryPool::Slab *
+MemoryPool::newSlab()
+{
+    Slab *slab;
+
+    if (m_spare) {
+        slab = m_spare;
+        m_spare = nullptr;
+    } else {
+        // std::aligned_alloc() is C++17.
+        void *mem = nullptr;
+        if (posix_memalign(&mem, SlabSize, SlabSize) != 0)
+            throw std::bad_alloc();
+        slab = static_cast<Slab *>(mem);
+        ++m_stats.slabs;
+        if (m_stats.slabs > m_stats.peakSlabs)
+            m_stats.peakSlabs = m_stats.slabs;
+    }
+
+    slab->prev = nullptr;
+    slab->next = nullptr;
+    slab->freeList = nullptr;
+    slab->bumpIndex = 0;
+    slab->used = 0;
+
+    return slab;
+}
+
+void
+MemoryPool::releaseSlab(Slab *slab)
+{
+    if (!m_spare) {
+        m_spare = slab;
+        return;
+    }
+
+    std::free(slab);
+    --m_stats.slabs;
+}
+
+void
+MemoryPool::linkPartial(Slab *slab)
+{
+    slab->prev = nullptr;
+    slab->next = m_partial;
+    if (m_partial)
+        m_partial->prev = slab;
+    m_partial = slab;
+}
+
+void
+MemoryPool::unlinkPartial(Slab *slab)
+{
+    if (slab->prev)
+        slab->prev->next = slab->next;
+    else
+        m_partial = slab->next;
+    if (slab->next)
+        slab->next->prev = slab->prev;
+    slab->prev = nullptr;
+    slab->next = nullptr;
+}
+
+void *
+MemoryPool::allocate()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_partial)
+        linkPartial(newSlab());
+
+    Slab *slab = m_partial;
+    void *p;
+
+    if (slab->freeList) {
+        p = slab->freeList;
+        slab->freeList = *static_cast<void **>(p);
+    } else {
+        p = slab->objects() + slab->bumpIndex * m_objectSize;
+        ++slab->bumpIndex;
+    }
+
+    ++slab->used;
+    if (slab->used == m_capacity)
+        unlinkPartial(slab);
+
+    ++m_stats.allocations;
+    ++m_stats.liveObjects;
+    if (m_stats.liveObjects > m_stats.peakObjects)
+        m_stats.peakObjects = m_stats.liveObjects;
+
+    return p;
+}
+
+void
+MemoryPool::deallocate(void *p)
+{
+    if (!p)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    Slab *slab = Slab::fromObject(p);
+
+    // Was full, so it wasn't on the partial list.
+    if (slab->used == m_capacity)
+        linkPartial(slab);
+
+    *static_cast<void **>(p) = slab->freeList;
+    slab->freeList = p;
+    --slab->used;
+
+    ++m_stats.deallocations;
+    --m_stats.liveObjects;
+
+    if (slab->used == 0) {
+        unlinkPartial(slab);
+        releaseSlab(slab);
+    }
+}
+
+MemoryPool::Stats
+MemoryPool::getStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+void
+MemoryPool::dumpAll()
+{
+    std::lock_guard<std::mutex> lock(a_poolsMutex);
+
+    RG_DEBUG << "Memory pools:";
+
+    for (const MemoryPool *pool = a_pools; pool; pool = pool->m_nextPool) {
+        const Stats stats = pool->getStats();
+        RG_DEBUG << "   " << stats.name << "(" << stats.objectSize <<
+                    "bytes ):" << stats.liveObjects << "live," <<
+                    stats.peakObjects << "peak," <<
+                    stats.allocations << "allocations," <<
+                    stats.deallocations << "deallocations," <<
+                    stats.slabs << "slabs (" << stats.peakSlabs << "peak )";
+    }
+}
+
+
+}
@@ -0,0 +1,111 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_MEMORY_POOL_H
+#define RG_MEMORY_POOL_H
+
+#include <rosegardenprivate_export.h>
+
+#include <cstddef>
+#include <mutex>
+
+namespace Rosegarden
+{
+
+
+/// Slab allocator for large numbers of small, same-sized objects.
+/**
+ * Event, its EventData and its FlatPropertyMap are allocated in the
+ * millions when loading, pasting, quantizing or undoing edits on large
+ * compositions.  Routing them through a MemoryPool (via class-specific
+ * operator new/delete) keeps them packed together in 64KiB slabs
+ * instead of scattered across the heap, and turns most allocations
+ * into a free-list pop.
+ *
+ * Slabs are aligned to their size, so finding the slab an object came
+ * from is a mask operation.  A slab whose objects have all been freed
+ * (e.g. after a large Segment is deleted) is handed straight back to
+ * the system, except for one spare that is kept to avoid thrashing at
+ * the boundary.
+ *
+ * Events are not owned by any one Segment (EventData is shared between
+ * copies in different Segments and in the Clipboard), so the pools are
+ * per-type rather than per-Segment or per-Composition.
+ *
+ * Thread-safe.  Statistics are printed by Profiles::dump().
+ */
+class ROSEGARDENPRIVATE_EXPORT MemoryPool
+{
+public:
+    /**
+     * name must be a string literal (or otherwise live forever).
+     *
+     * Pools are intended to be created on first use and never
+     * destroyed.  See the operator new implementations in Event.
+     */
+    MemoryPool(const char *name, size_t objectSize);
+
+    void *allocate();
+    void deallocate(void *p);
+
+    struct Stats
+    {
+        const char *name;
+        size_t objectSize;
+        size_t allocations;
+        size_t deallocations;
+        size_t liveObjects;
+        size_t peakObjects;
+        size_t slabs;
+        size_t peakSlabs;
+    };
+    Stats getStats() const;
+
+    /// Print statistics for every pool.  Called by Profiles::dump().
+    static void dumpAll();
+
+private:
+    MemoryPool(const MemoryPool &);
+    MemoryPool &operator=(const MemoryPool &);
+
+    struct Slab;
+
+    Slab *newSlab();
+    void releaseSlab(Slab *slab);
+    void linkPartial(Slab *slab);
+    void unlinkPartial(Slab *slab);
+
+    const char *m_name;
+    size_t m_objectSize;
+    // Objects per slab.
+    unsigned m_capacity;
+
+    mutable std::mutex m_mutex;
+
+    // Slabs with at least one free object.
+    Slab *m_partial;
+    // One empty slab kept back to avoid allocate/free thrashing.
+    Slab *m_spare;
+
+    Stats m_stats;
+
+    // For dumpAll().
+    MemoryPool *m_nextPool;
+};
+
+
+}
+
+#endif
@@ -16,6 +16,7 @@
 #ifndef RG_MIDITYPES_H
 #define RG_MIDITYPES_H
 
+#include "EventTypeName.h"
 #include "Exception.h"
 #include "MidiProgram.h"  // For MidiByte
 #include "PropertyName.h"
@@ -39,7 +40,7 @@ class Event;
 
 namespace PitchBend
 {
-    extern const std::string EventType;
+    extern const EventTypeName EventType;
     constexpr int EventSubOrdering = -5;
 
     extern const PropertyName MSB;
@@ -53,7 +54,7 @@ namespace PitchBend
 
 namespace Controller
 {
-    extern const std::string EventType;
+    extern const EventTypeName EventType;
     constexpr int EventSubOrdering = -5;
 
     extern const PropertyName NUMBER;
@@ -67,7 +68,7 @@ namespace Controller
 
 namespace KeyPressure
 {
-    extern const std::string EventType;
+    extern const EventTypeName EventType;
     constexpr int EventSubOrdering = -5;
 
     extern const PropertyName PITCH;
@@ -81,7 +82,7 @@ namespace KeyPressure
 
 namespace ChannelPressure
 {
-    extern const std::string EventType;
+    extern const EventTypeName EventType;
     constexpr int EventSubOrdering = -5;
 
     extern const PropertyName PRESSURE;
@@ -94,7 +95,7 @@ namespace ChannelPressure
 
 namespace ProgramChange
 {
-    extern const std::string EventType;
+    extern const EventTypeName EventType;
     constexpr int EventSubOrdering = -5;
 
     extern const PropertyName PROGRAM;
@@ -107,7 +108,7 @@ namespace ProgramChange
 
 namespace SystemExclusive
 {
-    extern const std::string EventType;
+    extern const EventTypeName EventType;
     constexpr int EventSubOrdering = -5;
 
     struct BadEncoding : public Exception {
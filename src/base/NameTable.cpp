@@ -0,0 +1,63 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "base/NameTable.h"
+#include "base/Exception.h"
+
+
+namespace Rosegarden
+{
+
+
+constexpr int NameTable::ChunkSize;
+constexpr int NameTable::MaxChunks;
+
+int
+NameTable::getId(const std::string &name)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (!m_nameToId) {
+        // Create on first use to avoid static init order fiasco.
+        m_nameToId = new NameToIdMap;
+    }
+
+    NameToIdMap::iterator idIter(m_nameToId->find(name));
+    // Found it?  Return it.
+    if (idIter != m_nameToId->end())
+        return idIter->second;
+
+    // Not found.  Create a new ID.
+
+    // Only changed under m_mutex.
+    const int newId = m_size.load(std::memory_order_relaxed);
+    if (newId == ChunkSize * MaxChunks)
+        throw Exception("NameTable::getId(): too many names");
+
+    const std::string **&chunk = m_chunks[newId / ChunkSize];
+    if (!chunk)
+        chunk = new const std::string *[ChunkSize];
+
+    idIter = m_nameToId->insert(NameToIdMap::value_type(name, newId)).first;
+    chunk[newId % ChunkSize] = &idIter->first;
+
+    // Publish to getName().
+    m_size.store(newId + 1, std::memory_order_release);
+
+    return newId;
+}
+
+
+}
@@ -0,0 +1,97 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_NAME_TABLE_H
+#define RG_NAME_TABLE_H
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace Rosegarden
+{
+
+
+/// Interned strings and their serial IDs, for EventTypeName and PropertyName.
+/**
+ * getId() takes a lock.  getName() doesn't, as Event::getType() and
+ * Event::isa(const std::string &) call it for every type check, on the
+ * GUI thread and on the threads that parse segments when loading.
+ *
+ * The table is append-only.  Names are stored in fixed-size chunks that
+ * never move, and a new name is published by storing the new size with
+ * release ordering after it is in place.  So a reader that sees an ID
+ * below the size also sees that ID's name.
+ *
+ * Instances must be static.  The constructor is constexpr, so a
+ * NameTable is ready before any dynamic initializer runs (e.g. those of
+ * the EventType constants, which are statics in many translation
+ * units).  Names are never freed, as we can't be sure who might look
+ * them up as we are going down.
+ */
+class NameTable
+{
+public:
+    constexpr NameTable() :
+        m_mutex(),
+        m_nameToId(nullptr),
+        m_size(0),
+        m_chunks()
+    {
+    }
+
+    /// Get the existing ID for a name, creating one if needed.
+    /**
+     * IDs start at 0 and go up by one.
+     */
+    int getId(const std::string &name);
+
+    /// Get the name for an ID, or nullptr for an unknown ID.
+    /**
+     * Lock-free.  The pointer remains valid for the lifetime of the
+     * program.
+     */
+    const std::string *getName(int id) const
+    {
+        if (id < 0  ||  id >= m_size.load(std::memory_order_acquire))
+            return nullptr;
+
+        return m_chunks[id / ChunkSize][id % ChunkSize];
+    }
+
+private:
+    NameTable(const NameTable &);
+    NameTable &operator=(const NameTable &);
+
+    static constexpr int ChunkSize = 1024;
+    static constexpr int MaxChunks = 1024;
+
+    // For getId() only.
+    std::mutex m_mutex;
+    typedef std::map<std::string, int> NameToIdMap;
+    NameToIdMap *m_nameToId;
+
+    // Number of IDs published to getName().
+    std::atomic<int> m_size;
+    // Index is the ID.  Each chunk has ChunkSize pointers to the keys in
+    // m_nameToId, which never move.
+    const std::string **m_chunks[MaxChunks];
+};
+
+
+}
+
+#endif
@@ -263,7 +263,7 @@ namespace Marks
 class ROSEGARDENPRIVATE_EXPORT Clef
 {
 public:
-    static const std::string EventType;
+    static const EventTypeName EventType;
     static const int EventSubOrdering;
     static const PropertyName ClefPropertyName;
     static const PropertyName OctaveOffsetPropertyName;
@@ -386,7 +386,7 @@ private:
 class ROSEGARDENPRIVATE_EXPORT Key
 {
 public:
-    static const std::string EventType;
+    static const EventTypeName EventType;
     static const int EventSubOrdering;
     static const PropertyName KeyPropertyName;
     static const Key DefaultKey;
@@ -618,7 +618,7 @@ private:
 class Indication
 {
 public:
-    static const std::string EventType;
+    static const EventTypeName EventType;
     static const int EventSubOrdering;
     static const PropertyName IndicationTypePropertyName;
     typedef Exception BadIndicationName;
@@ -686,7 +686,7 @@ private:
 class Text
 {
 public:
-    static const std::string EventType;
+    static const EventTypeName EventType;
     static const int EventSubOrdering;
     static const PropertyName TextPropertyName;
     static const PropertyName TextTypePropertyName;
@@ -1043,8 +1043,8 @@ private:
 class ROSEGARDENPRIVATE_EXPORT Note
 {
 public:
-    static const std::string EventType;
-    static const std::string EventRestType;
+    static const EventTypeName EventType;
+    static const EventTypeName EventRestType;
     static const int EventRestSubOrdering;
 
     typedef int Type; // not an enum, too much arithmetic at stake
@@ -1210,7 +1210,7 @@ private:
 class ROSEGARDENPRIVATE_EXPORT Symbol
 {
 public:
-    static const std::string EventType;
+    static const EventTypeName EventType;
     static const int EventSubOrdering;
     static const PropertyName SymbolTypePropertyName;
 
@@ -20,6 +20,7 @@
 #include "Profiler.h"
 
 // Rosegarden
+#include "MemoryPool.h"
 #include "misc/Debug.h"
 
 // C++
@@ -187,6 +188,9 @@ void Profiles::dump() const
         qDebug("    %-40s  %d", i->second, i->first);
     }
 
+    qDebug(" ");
+    MemoryPool::dumpAll();
+
 #endif
 }
 
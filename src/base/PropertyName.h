@@ -81,6 +81,10 @@ namespace Rosegarden
   store the string representation of a PropertyName in a property;
   but that's slow.)
 
+  Constructing from a string and getName() are thread-safe.  Only
+  constructing takes a lock; getName() doesn't (see NameTable).
+  Copying and comparing are just int operations.
+
 */
 
 class ROSEGARDENPRIVATE_EXPORT PropertyName
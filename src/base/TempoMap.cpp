@@ -0,0 +1,189 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[TempoMap]"
+
+#include "TempoMap.h"
+
+#include <algorithm>
+
+
+namespace Rosegarden
+{
+
+
+TempoMap::TempoMap(tempoT defaultTempo, timeT endMarker) :
+    m_changes(),
+    m_defaultTempo(defaultTempo),
+    m_endMarker(endMarker)
+{
+}
+
+int
+TempoMap::findChange(timeT t, int hint) const
+{
+    const int count = int(m_changes.size());
+
+    // Does the span starting at Change i (-1 for the default tempo
+    // before the first Change) contain t?
+    auto contains = [this, count, t](int i) {
+        if (i < -1  ||  i >= count)
+            return false;
+        if (i >= 0  &&  m_changes[i].time > t)
+            return false;
+        return (i + 1 == count  ||  t < m_changes[i + 1].time);
+    };
+
+    int index;
+
+    // Same span as last time, or the next one?
+    if (contains(hint)) {
+        index = hint;
+    } else if (contains(hint + 1)) {
+        index = hint + 1;
+    } else {
+        auto i = std::upper_bound(
+                m_changes.begin(), m_changes.end(), t,
+                [](timeT t, const Change &change)
+                    { return t < change.time; });
+        index = int(i - m_changes.begin()) - 1;
+    }
+
+    if (index >= 0)
+        return index;
+
+    // Before the first tempo change.  In negative time (count-in bars)
+    // we use the first one if it is at or before time zero.  See
+    // Composition::getTempoAtTime().
+    if (t >= 0  ||  count == 0  ||  m_changes[0].time > 0)
+        return -1;
+
+    return 0;
+}
+
+int
+TempoMap::findChange(RealTime rt, int hint) const
+{
+    const int count = int(m_changes.size());
+
+    auto contains = [this, count, &rt](int i) {
+        if (i < -1  ||  i >= count)
+            return false;
+        if (i >= 0  &&  rt < m_changes[i].realTime)
+            return false;
+        return (i + 1 == count  ||  rt < m_changes[i + 1].realTime);
+    };
+
+    int index;
+
+    if (contains(hint)) {
+        index = hint;
+    } else if (contains(hint + 1)) {
+        index = hint + 1;
+    } else {
+        auto i = std::upper_bound(
+                m_changes.begin(), m_changes.end(), rt,
+                [](const RealTime &rt, const Change &change)
+                    { return rt < change.realTime; });
+        index = int(i - m_changes.begin()) - 1;
+    }
+
+    if (index >= 0)
+        return index;
+
+    if (rt >= RealTime::zero()  ||  count == 0  ||  m_changes[0].time > 0)
+        return -1;
+
+    return 0;
+}
+
+RealTime
+TempoMap::toRealTime(timeT t, int index) const
+{
+    if (index < 0)
+        return Composition::time2RealTime(t, m_defaultTempo);
+
+    const Change &change = m_changes[index];
+
+    if (change.target > 0) {
+        return change.realTime +
+                Composition::time2RealTime(t - change.time,
+                                           change.tempo,
+                                           change.rampDuration,
+                                           change.target);
+    }
+
+    return change.realTime +
+            Composition::time2RealTime(t - change.time, change.tempo);
+}
+
+timeT
+TempoMap::toTime(RealTime rt, int index) const
+{
+    if (index < 0)
+        return Composition::realTime2Time(rt, m_defaultTempo);
+
+    const Change &change = m_changes[index];
+
+    if (change.target > 0) {
+        return change.time +
+                Composition::realTime2Time(rt - change.realTime,
+                                           change.tempo,
+                                           change.rampDuration,
+                                           change.target);
+    }
+
+    return change.time +
+            Composition::realTime2Time(rt - change.realTime, change.tempo);
+}
+
+RealTime
+TempoMap::toRealTime(timeT t) const
+{
+    return toRealTime(t, findChange(t, -2));
+}
+
+timeT
+TempoMap::toTime(RealTime rt) const
+{
+    return toTime(rt, findChange(rt, -2));
+}
+
+void
+TempoMap::toRealTime(const timeT *times, RealTime *realTimes,
+                     size_t count) const
+{
+    int index = -2;
+
+    for (size_t i = 0; i < count; ++i) {
+        index = findChange(times[i], index);
+        realTimes[i] = toRealTime(times[i], index);
+    }
+}
+
+void
+TempoMap::toTime(const RealTime *realTimes, timeT *times,
+                 size_t count) const
+{
+    int index = -2;
+
+    for (size_t i = 0; i < count; ++i) {
+        index = findChange(realTimes[i], index);
+        times[i] = toTime(realTimes[i], index);
+    }
+}
+
+
+}
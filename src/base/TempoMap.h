@@ -0,0 +1,116 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_TEMPO_MAP_H
+#define RG_TEMPO_MAP_H
+
+#include "Composition.h"
+#include "RealTime.h"
+#include "TimeT.h"
+
+#include <rosegardenprivate_export.h>
+
+#include <cstddef>
+#include <vector>
+
+namespace Rosegarden
+{
+
+
+/// Musical time <-> real time conversion for a Composition.
+/**
+ * A snapshot of the Composition's tempo changes with the real time of
+ * each change worked out in advance, kept in a plain sorted array.  A
+ * conversion is a binary search plus the arithmetic for one span (a
+ * ramped tempo change is a span of its own), with no property lookups.
+ *
+ * Get one from Composition::getTempoMap().  A TempoMap never changes
+ * once built.  The Composition builds a new one after the tempo changes,
+ * so anything holding on to one (e.g. a mapper during fillBuffer()) sees
+ * a consistent tempo map throughout.
+ *
+ * The results are identical to what Composition::getElapsedRealTime() and
+ * Composition::getElapsedTimeForRealTime() have always returned.  Those
+ * now use this.
+ */
+class ROSEGARDENPRIVATE_EXPORT TempoMap
+{
+public:
+    /// Real time elapsed from time zero to t.
+    RealTime toRealTime(timeT t) const;
+    /// Musical time at real time rt.
+    timeT toTime(RealTime rt) const;
+
+    /// Convert many times at once.
+    /**
+     * Much faster than calling toRealTime() for each when the times are
+     * sorted or nearly so, as they are when mapping a Segment: each
+     * lookup starts from the span the previous time fell in.  Any order
+     * is correct though.
+     *
+     * times and realTimes may not overlap.
+     */
+    void toRealTime(const timeT *times, RealTime *realTimes,
+                    size_t count) const;
+    /// Convert many real times at once.
+    /**
+     * @see toRealTime(const timeT *, RealTime *, size_t)
+     */
+    void toTime(const RealTime *realTimes, timeT *times,
+                size_t count) const;
+
+    /// Number of tempo changes.
+    size_t size() const  { return m_changes.size(); }
+
+private:
+    // Only Composition can make these.
+    friend class Composition;
+
+    TempoMap(tempoT defaultTempo, timeT endMarker);
+
+    struct Change
+    {
+        timeT time;
+        RealTime realTime;
+        tempoT tempo;
+        /// Tempo at the end of a ramp.  -1 if not ramped.
+        tempoT target;
+        /// From time to the end of the ramp.
+        timeT rampDuration;
+    };
+
+    // The composition's tempo changes in time order.
+    std::vector<Change> m_changes;
+
+    // What the map was built for.  See Composition::getTempoMap().
+    tempoT m_defaultTempo;
+    timeT m_endMarker;
+
+    /// Index of the Change that governs t.  -1 for the default tempo.
+    /**
+     * hint is where to start looking.  See the batch toRealTime().
+     */
+    int findChange(timeT t, int hint) const;
+    /// Index of the Change that governs rt.  -1 for the default tempo.
+    int findChange(RealTime rt, int hint) const;
+
+    RealTime toRealTime(timeT t, int index) const;
+    timeT toTime(RealTime rt, int index) const;
+};
+
+
+}
+
+#endif
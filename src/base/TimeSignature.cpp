@@ -20,7 +20,7 @@ namespace Rosegarden
 {
 
 
-const std::string TimeSignature::EventType = "timesignature";
+const EventTypeName TimeSignature::EventType("timesignature");
 
 const PropertyName TimeSignature::NumeratorPropertyName("numerator");
 const PropertyName TimeSignature::DenominatorPropertyName("denominator");
@@ -155,7 +155,7 @@ public:
     /// Returned event is on heap; caller takes responsibility for ownership
     Event *getAsEvent(timeT absoluteTime) const;
 
-    static const std::string EventType;
+    static const EventTypeName EventType;
 
     static const PropertyName NumeratorPropertyName;
     static const PropertyName DenominatorPropertyName;
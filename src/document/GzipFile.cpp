@@ -16,7 +16,11 @@
 */
 
 #include "GzipFile.h"
+
+#include <QFileInfo>
 #include <QString>
+
+#include <algorithm>
 #include <string>
 #include <zlib.h>
 
@@ -60,6 +64,120 @@ GzipFile::readFromFile(QString file, QString &text)
     return ok;
 }    
 
+GzipFile::GzipFile(const QString &fileName) :
+    m_fileName(fileName),
+    m_file(nullptr),
+    m_compressedSize(0),
+    m_error(false)
+{
+}
+
+GzipFile::~GzipFile()
+{
+    close();
+}
+
+bool
+GzipFile::openForReading()
+{
+    close();
+
+    m_compressedSize = QFileInfo(m_fileName).size();
+    m_error = false;
+
+    m_file = gzopen(m_fileName.toLocal8Bit().data(), "rb");
+    if (!m_file) {
+        m_error = true;
+        return false;
+    }
+
+    // The default 8k means a system call for every few elements.
+    gzbuffer(m_file, 128 * 1024);
+
+    return true;
+}
+
+bool
+GzipFile::openForWriting()
+{
+    close();
+
+    m_compressedSize = 0;
+    m_error = false;
+
+    m_file = gzopen(m_fileName.toLocal8Bit().data(), "wb");
+    if (!m_file) {
+        m_error = true;
+        return false;
+    }
+
+    gzbuffer(m_file, 128 * 1024);
+
+    return true;
+}
+
+bool
+GzipFile::write(const char *data, int size)
+{
+    if (!m_file  ||  m_error)
+        return false;
+
+    if (size == 0)
+        return true;
+
+    if (gzwrite(m_file, data, size) != size)
+        m_error = true;
+
+    return !m_error;
 }
 
+QByteArray
+GzipFile::read(int maxSize)
+{
+    if (!m_file  ||  m_error)
+        return QByteArray();
 
+    QByteArray data(maxSize, Qt::Uninitialized);
+
+    const int got = gzread(m_file, data.data(), maxSize);
+    if (got < 0) {
+        m_error = true;
+        return QByteArray();
+    }
+
+    // A truncated file reads as far as it goes, then ends without
+    // reaching the gzip trailer, which zlib reports as Z_BUF_ERROR.
+    if (got == 0) {
+        int error = Z_OK;
+        gzerror(m_file, &error);
+        if (error != Z_OK)
+            m_error = true;
+    }
+
+    data.truncate(got);
+    return data;
+}
+
+double
+GzipFile::getProgress() const
+{
+    if (!m_file  ||  m_compressedSize <= 0)
+        return 0;
+
+    const double progress = double(gzoffset(m_file)) / m_compressedSize;
+
+    return std::min(progress, 1.0);
+}
+
+bool
+GzipFile::close()
+{
+    // When writing, this is when the last of the data goes out.
+    if (m_file  &&  gzclose(m_file) != Z_OK)
+        m_error = true;
+    m_file = nullptr;
+
+    return !m_error;
+}
+
+}
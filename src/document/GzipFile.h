@@ -15,18 +15,84 @@
     COPYING included with this distribution for more information.
 */
 
+#ifndef RG_GZIPFILE_H
+#define RG_GZIPFILE_H
+
+#include <QByteArray>
 #include <QString>
 
+#include <rosegardenprivate_export.h>
+
+#include <string>
+
+// From zlib.h.
+typedef struct gzFile_s *gzFile;
+
 namespace Rosegarden
 {
 
-class GzipFile
+/// Reads and writes gzipped files, such as .rg files.
+/**
+ * The static functions do the whole file in one go.  For large files,
+ * open a GzipFile for reading and read() it a chunk at a time, or open
+ * it for writing and write() it a piece at a time.
+ */
+class ROSEGARDENPRIVATE_EXPORT GzipFile
 {
 public:
     static bool writeToFile(QString file, QString text);
     static bool readFromFile(QString file, QString &text);
+
+    explicit GzipFile(const QString &fileName);
+    ~GzipFile();
+
+    /// Open for read().
+    bool openForReading();
+
+    /// Open for write().  Replaces the file.
+    bool openForWriting();
+
+    /// Compress and write some data.
+    /**
+     * Returns false if this or an earlier write() failed.  Check close()
+     * as well, since zlib holds on to some of the data until then.
+     */
+    bool write(const char *data, int size);
+    bool write(const QByteArray &data)
+            { return write(data.constData(), data.size()); }
+    bool write(const std::string &data)
+            { return write(data.data(), static_cast<int>(data.size())); }
+
+    /// Read up to maxSize bytes of uncompressed data.
+    /**
+     * Returns an empty array at the end of the file, or on error.  See
+     * hasError().
+     */
+    QByteArray read(int maxSize);
+
+    /// The file is corrupt, or couldn't be read.
+    bool hasError() const  { return m_error; }
+
+    /// How far through the file read() has got, from 0 to 1.
+    /**
+     * Based on the compressed data consumed, which is the only size we
+     * know up front.
+     */
+    double getProgress() const;
+
+    /// Returns false if there was an error at any point.
+    bool close();
+
+private:
+    GzipFile(const GzipFile &);
+    GzipFile &operator=(const GzipFile &);
+
+    QString m_fileName;
+    gzFile m_file;
+    qint64 m_compressedSize;
+    bool m_error;
 };
 
 }
 
-
+#endif
@@ -52,8 +52,9 @@
 #include "gui/studio/AudioPluginManager.h"
 #include "RosegardenDocument.h"
 #include "sound/AudioFileManager.h"
-#include "XmlStorableEvent.h"
+#include "SegmentXmlHandler.h"
 #include "XmlSubHandler.h"
+#include "document/io/XMLReader.h"
 #include "sound/PluginIdentifier.h"
 
 #include <QApplication>
@@ -63,6 +64,7 @@
 #include <QDataStream>
 #include <QDialog>
 #include <QFileInfo>
+#include <QRunnable>
 #include <QString>
 #include <QStringList>
 
@@ -71,6 +73,44 @@ namespace Rosegarden
 
 using namespace BaseProperties;
 
+namespace
+{
+    /// Reads the content of a <segment> on a worker thread.
+    class SegmentContentJob : public QRunnable
+    {
+    public:
+        SegmentContentJob(SegmentXmlHandler *handler,
+                          const QByteArray &content) :
+            m_handler(handler),
+            m_content(content)
+        {
+        }
+
+        void run() override
+        {
+            XMLReader reader;
+            reader.setHandler(m_handler);
+            reader.parseContent(m_content);
+        }
+
+    private:
+        SegmentXmlHandler *m_handler;
+        QByteArray m_content;
+    };
+
+    /// Elements found in a <segment> that SegmentXmlHandler reads.
+    bool isSegmentContent(const QString &lcName)
+    {
+        return (lcName == "event"  ||  lcName == "property"  ||
+                lcName == "nproperty"  ||  lcName == "chord"  ||
+                lcName == "group"  ||  lcName == "resync"  ||
+                lcName == "matrix"  ||  lcName == "notation"  ||
+                lcName == "hzoom"  ||  lcName == "vzoom"  ||
+                lcName == "ruler"  ||  lcName == "gui"  ||
+                lcName == "controller");
+    }
+}
+
 class ConfigurationXmlSubHandler : public XmlSubHandler
 {
 public:
@@ -209,25 +249,13 @@ ConfigurationXmlSubHandler::endElement(const QString&,
 
 
 RoseXmlHandler::RoseXmlHandler(RosegardenDocument *doc,
-                               unsigned int elementCount,
                                QPointer<QProgressDialog> progressDialog,
                                bool createNewDevicesWhenNeeded) :
     m_doc(doc),
     m_currentSegment(nullptr),
-    m_currentEvent(nullptr),
-    m_currentTime(0),
-    m_chordDuration(0),
-    m_segmentEndMarkerTime(nullptr),
-    m_inChord(false),
-    m_inGroup(false),
+    m_segmentHandler(nullptr),
     m_inComposition(false),
     m_inColourMap(false),
-    m_inMatrix(false),
-    m_inNotation(false),
-    m_groupId(0),
-    m_groupTupletBase(0),
-    m_groupTupledCount(0),
-    m_groupUntupledCount(0),
     m_foundTempo(false),
     m_section(NoSection),
     m_device(nullptr),
@@ -246,8 +274,6 @@ RoseXmlHandler::RoseXmlHandler(RosegardenDocument *doc,
     m_pluginInBuss(false),
     m_colourMap(nullptr),
     m_keyMapping(),
-    m_totalElements(elementCount),
-    m_elementsSoFar(0),
     m_subHandler(nullptr),
     m_deprecation(false),
     m_createDevices(createNewDevicesWhenNeeded),
@@ -260,6 +286,13 @@ RoseXmlHandler::RoseXmlHandler(RosegardenDocument *doc,
 
 RoseXmlHandler::~RoseXmlHandler()
 {
+    // If we stopped early, there may still be segments being read.
+    m_threadPool.waitForDone();
+    for (SegmentXmlHandler *handler : m_pendingSegments) {
+        delete handler;
+    }
+    delete m_segmentHandler;
+
     delete m_subHandler;
 }
 
@@ -328,108 +361,25 @@ RoseXmlHandler::startElement(const QString& namespaceURI,
         return getSubHandler()->startElement(namespaceURI, localName, lcName, atts);
     }
 
-    if (lcName == "event") {
-
-        //RG_DEBUG << "startElement(): found event, current time is " << m_currentTime;
-
-        if (m_currentEvent) {
-            RG_DEBUG << "RoseXmlHandler::startElement: Warning: new event found at time " << m_currentTime << " before previous event has ended; previous event will be lost";
-            delete m_currentEvent;
-        }
-
-        m_currentEvent = new XmlStorableEvent(atts, m_currentTime);
-
-        if (m_currentEvent->has(BEAMED_GROUP_ID)) {
-
-            // remap -- we want to ensure that the segment's nextId
-            // is always used (and incremented) in preference to the
-            // stored id
-
-            if (!m_currentSegment) {
-                m_errorString = "Got grouped event outside of a segment";
-                return false;
-            }
-
-            long storedId = m_currentEvent->get<Int>(BEAMED_GROUP_ID);
-
-            if (m_groupIdMap.find(storedId) == m_groupIdMap.end()) {
-                m_groupIdMap[storedId] = m_currentSegment->getNextId();
-            }
-
-            m_currentEvent->set<Int>(
-                    BEAMED_GROUP_ID, m_groupIdMap[storedId]);
-
-        } else if (m_inGroup) {
-            m_currentEvent->set<Int>(BEAMED_GROUP_ID, m_groupId);
-            m_currentEvent->set<String>(BEAMED_GROUP_TYPE, m_groupType);
-            if (m_groupType == GROUP_TYPE_TUPLED) {
-                m_currentEvent->set<Int>(
-                        BEAMED_GROUP_TUPLET_BASE, m_groupTupletBase);
-                m_currentEvent->set<Int>(
-                        BEAMED_GROUP_TUPLED_COUNT, m_groupTupledCount);
-                m_currentEvent->set<Int>(
-                        BEAMED_GROUP_UNTUPLED_COUNT, m_groupUntupledCount);
-            }
-        }
-
-        timeT duration = m_currentEvent->getDuration();
-
-        if (!m_inChord) {
-
-            m_currentTime = m_currentEvent->getAbsoluteTime() + duration;
-
-            //            RG_DEBUG << "RoseXmlHandler::startElement: (we're not in a chord) ";
-
-        } else if (duration != 0) {
-
-            // set chord duration to the duration of the shortest
-            // element with a non-null duration (if no such elements,
-            // leave it as 0).
-
-            if (m_chordDuration == 0 || duration < m_chordDuration) {
-                m_chordDuration = duration;
-            }
-        }
-
-    } else if (lcName == "property") {
-
-        if (!m_currentEvent) {
-            RG_DEBUG << "RoseXmlHandler::startElement: Warning: Found property outside of event at time " << m_currentTime << ", ignoring";
-        } else {
-            m_currentEvent->setPropertyFromAttributes(atts, true);
-        }
+    if (isSegmentContent(lcName)) {
 
-    } else if (lcName == "nproperty") {
+        // In a <segment> that wasn't deferred.  E.g. an audio segment.
+        if (m_segmentHandler)
+            return m_segmentHandler->startElement(
+                    namespaceURI, localName, qName, atts);
 
-        if (!m_currentEvent) {
-            RG_DEBUG << "RoseXmlHandler::startElement: Warning: Found nproperty outside of event at time " << m_currentTime << ", ignoring";
-        } else {
-            m_currentEvent->setPropertyFromAttributes(atts, false);
+        if (lcName == "event") {
+            m_errorString = "Got event outside of a Segment";
+            return false;
         }
 
-    } else if (lcName == "chord") {
-
-        m_inChord = true;
-
-    } else if (lcName == "group") {
-
-        if (!m_currentSegment) {
+        if (lcName == "group") {
             m_errorString = "Got group outside of a segment";
             return false;
         }
 
-        if (!m_deprecation)
-            RG_WARNING << "WARNING: This Rosegarden file uses the deprecated element \"group\".  We recommend re-saving the file from this version of Rosegarden to assure your ability to re-load it in future versions";
-        m_deprecation = true;
-
-        m_inGroup = true;
-        m_groupId = m_currentSegment->getNextId();
-        m_groupType = qstrtostr(atts.value("type").toString());
-
-        if (m_groupType == GROUP_TYPE_TUPLED) {
-            m_groupTupletBase = atts.value("base").toInt();
-            m_groupTupledCount = atts.value("tupled").toInt();
-            m_groupUntupledCount = atts.value("untupled").toInt();
+        if (lcName == "property"  ||  lcName == "nproperty") {
+            RG_DEBUG << "RoseXmlHandler::startElement: Warning: Found " << lcName << " outside of event, ignoring";
         }
 
     } else if (lcName == "rosegarden-data") {
@@ -1070,8 +1020,6 @@ RoseXmlHandler::startElement(const QString& namespaceURI,
             }
         }
 
-        m_currentTime = startTime;
-
         QString triggerIdStr = atts.value("triggerid").toString();
         QString triggerPitchStr = atts.value("triggerbasepitch").toString();
         QString triggerVelocityStr = atts.value("triggerbasevelocity").toString();
@@ -1130,81 +1078,13 @@ RoseXmlHandler::startElement(const QString& namespaceURI,
         }
 
         QString endMarkerStr = atts.value("endmarker").toString();
-        if (!endMarkerStr.isEmpty()) {
-            delete m_segmentEndMarkerTime;
-            m_segmentEndMarkerTime = new timeT(endMarkerStr.toInt());
-        }
-
-        m_groupIdMap.clear();
-
-    } else if (lcName == "matrix") {  // <matrix>
-
-        // If we're in a <segment>, <matrix> is valid.
-        if (m_currentSegment)
-            m_inMatrix = true;
-
-    } else if (lcName == "notation") {  // <notation>
-
-        // If we're in a <segment>, <notation> is valid.
-        if (m_currentSegment)
-            m_inNotation = true;
-
-    } else if (lcName == "hzoom") {  // <hzoom>
-
-        if (m_currentSegment && m_inMatrix)
-            m_currentSegment->matrixHZoomFactor = atts.value("factor").toDouble();
-
-    } else if (lcName == "vzoom") {  // <vzoom>
-
-        if (m_currentSegment && m_inMatrix)
-            m_currentSegment->matrixVZoomFactor = atts.value("factor").toDouble();
-
-    } else if (lcName == "ruler") {  // <ruler>
-
-        if (m_currentSegment && m_inMatrix) {
-            Segment::Ruler segmentRuler;
-            segmentRuler.type = atts.value("type").toString().toStdString();
-            segmentRuler.ccNumber = atts.value("ccnumber").toInt();
-            m_currentSegment->matrixRulers->insert(segmentRuler);
-        }
-
-        if (m_currentSegment && m_inNotation) {
-            Segment::Ruler segmentRuler;
-            segmentRuler.type = atts.value("type").toString().toStdString();
-            segmentRuler.ccNumber = atts.value("ccnumber").toInt();
-            m_currentSegment->notationRulers->insert(segmentRuler);
-        }
+        const timeT endMarkerTime = endMarkerStr.toInt();
 
-    } else if (lcName == "gui") {  // <gui>
-
-        // This element is no longer supported.  But please don't reuse
-        // the name in case it pops up in an old file.
-
-        // <gui> elements used to be found in <segment> elements.
-        // <gui> elements contained <controller> elements.
-        // The example file bogus-surf-jam.rg still has this.
-        // However, they never did anything.
-
-    } else if (lcName == "controller") {  // <controller>
-
-        // This element is no longer supported.  But please don't reuse
-        // the name in case it pops up in an old file.
-
-        // <controller> elements used to be found in <gui> elements.
-        // The example file bogus-surf-jam.rg still has this.
-        // However, they never did anything.
-
-    } else if (lcName == "resync") {
-
-        if (!m_deprecation)
-            RG_WARNING << "WARNING: This Rosegarden file uses the deprecated element \"resync\".  We recommend re-saving the file from this version of Rosegarden to assure your ability to re-load it in future versions";
-        m_deprecation = true;
-
-        QString time(atts.value("time").toString());
-        bool isNumeric;
-        int numTime = time.toInt(&isNumeric);
-        if (isNumeric)
-            m_currentTime = numTime;
+        delete m_segmentHandler;
+        m_segmentHandler = new SegmentXmlHandler(
+                m_currentSegment,
+                startTime,
+                endMarkerStr.isEmpty() ? nullptr : &endMarkerTime);
 
     } else if (lcName == "audio") {
 
@@ -2343,29 +2223,19 @@ RoseXmlHandler::endElement(const QString& namespaceURI,
         return res;
     }
 
-    // Set percentage done
-    //
-    if ((m_totalElements > m_elementsSoFar) &&
-        (++m_elementsSoFar % 300 == 0)) {
-
-        if (m_progressDialog) {
-            // If the user cancelled, bail.
-            if (m_progressDialog->wasCanceled())
-                return false;
+    QString lcName = qName.toLower();
 
-            m_progressDialog->setValue(static_cast<int>(
-                    static_cast<double>(m_elementsSoFar) /
-                    static_cast<double>(m_totalElements) * 100.0));
-        }
+    if (isSegmentContent(lcName)) {
 
-        // Kick the event loop so that we don't appear to be in
-        // an endless loop.
-        qApp->processEvents(QEventLoop::AllEvents, 100);
-    }
+        if (m_segmentHandler)
+            return m_segmentHandler->endElement(namespaceURI, localName, qName);
 
-    QString lcName = qName.toLower();
+    } else if (lcName == "rosegarden-data") {
 
-    if (lcName == "rosegarden-data") {
+        // The segments need their events before the trigger segment
+        // references are updated.
+        if (!applyPendingSegments())
+            return false;
 
         Composition &comp = getComposition();
 
@@ -2404,42 +2274,20 @@ RoseXmlHandler::endElement(const QString& namespaceURI,
         // archived tracks might record.
         comp.refreshRecordTracks();
 
-    } else if (lcName == "event") {
-
-        if (m_currentSegment && m_currentEvent) {
-            m_currentSegment->insert(m_currentEvent);
-            m_currentEvent = nullptr;
-        } else if (!m_currentSegment && m_currentEvent) {
-            m_errorString = "Got event outside of a Segment";
-            return false;
-        }
-
-    } else if (lcName == "chord") {
-
-        m_currentTime += m_chordDuration;
-        m_inChord = false;
-        m_chordDuration = 0;
-
-    } else if (lcName == "group") {
-
-        m_inGroup = false;
-
     } else if (lcName == "segment") {
 
-        if (m_currentSegment && m_segmentEndMarkerTime) {
-            m_currentSegment->setEndMarkerTime(*m_segmentEndMarkerTime);
+        // Not deferred.  Finish it off now.
+        if (m_segmentHandler) {
+            const bool ok = m_segmentHandler->apply();
+            if (!ok)
+                m_errorString = m_segmentHandler->errorString();
+            setDeprecated(m_segmentHandler->getDeprecatedElement());
 
-            // If the segment is zero or negative duration
-            if (m_currentSegment->getEndMarkerTime() <=
-                    m_currentSegment->getStartTime()) {
-                // Make it stick out so the user can take care of it.
-                m_currentSegment->setEndMarkerTime(
-                    m_currentSegment->getStartTime() +
-                        Note(Note::Shortest).getDuration());
-            }
+            delete m_segmentHandler;
+            m_segmentHandler = nullptr;
 
-            delete m_segmentEndMarkerTime;
-            m_segmentEndMarkerTime = nullptr;
+            if (!ok)
+                return false;
         }
 
         m_currentSegment = nullptr;
@@ -2520,10 +2368,6 @@ RoseXmlHandler::endElement(const QString& namespaceURI,
     } else if (lcName == "colourmap") {
         m_inColourMap = false;
         m_colourMap = nullptr;
-    } else if (lcName == "matrix") {
-        m_inMatrix = false;
-    } else if (lcName == "notation") {
-        m_inNotation = false;
     }
 
     return true;
@@ -2555,6 +2399,77 @@ RoseXmlHandler::fatalError(int lineNumber, int columnNumber,
     return false;
 }
 
+bool
+RoseXmlHandler::progress(double fraction)
+{
+    if (m_progressDialog) {
+        // If the user cancelled, bail.
+        if (m_progressDialog->wasCanceled())
+            return false;
+
+        m_progressDialog->setValue(static_cast<int>(fraction * 100.0));
+    }
+
+    // Kick the event loop so that we don't appear to be in
+    // an endless loop.
+    qApp->processEvents(QEventLoop::AllEvents, 100);
+
+    return true;
+}
+
+bool
+RoseXmlHandler::deferredContent(const QByteArray &content)
+{
+    // Audio segments have elements of their own, and a dropped audio
+    // segment has no handler.  There are never many of these, so read
+    // them here, as usual.
+    if (!m_segmentHandler  ||
+        m_currentSegment->getType() != Segment::Internal) {
+        XMLReader reader;
+        reader.setHandler(this);
+        return reader.parseContent(content);
+    }
+
+    // The handler is ours again in applyPendingSegments().
+    m_pendingSegments.push_back(m_segmentHandler);
+    m_threadPool.start(new SegmentContentJob(m_segmentHandler, content));
+    m_segmentHandler = nullptr;
+
+    return true;
+}
+
+void
+RoseXmlHandler::setDeprecated(const QString &elementName)
+{
+    if (elementName.isEmpty())
+        return;
+
+    if (!m_deprecation)
+        RG_WARNING << "WARNING: This Rosegarden file uses the deprecated element \"" << elementName << "\".  We recommend re-saving the file from this version of Rosegarden to assure your ability to re-load it in future versions";
+    m_deprecation = true;
+}
+
+bool
+RoseXmlHandler::applyPendingSegments()
+{
+    m_threadPool.waitForDone();
+
+    bool ok = true;
+
+    for (SegmentXmlHandler *handler : m_pendingSegments) {
+        if (ok  &&  !handler->apply()) {
+            m_errorString = handler->errorString();
+            ok = false;
+        }
+        setDeprecated(handler->getDeprecatedElement());
+
+        delete handler;
+    }
+    m_pendingSegments.clear();
+
+    return ok;
+}
+
 bool
 RoseXmlHandler::endDocument()
 {
@@ -28,6 +28,9 @@
 #include <QPointer>
 #include <QProgressDialog>
 #include <QSharedPointer>
+#include <QThreadPool>
+
+#include <rosegardenprivate_export.h>
 
 #include <map>
 #include <set>
@@ -38,7 +41,7 @@
 namespace Rosegarden
 {
 
-class XmlStorableEvent;
+class SegmentXmlHandler;
 class XmlSubHandler;
 class Studio;
 class Segment;
@@ -57,7 +60,7 @@ class AudioFileManager;
 /**
  * Handler for the Rosegarden XML format
  */
-class RoseXmlHandler : public QObject, public XMLHandler
+class ROSEGARDENPRIVATE_EXPORT RoseXmlHandler : public QObject, public XMLHandler
 {
     Q_OBJECT
 public:
@@ -78,9 +81,11 @@ public:
     /**
      * Construct a new RoseXmlHandler which will put the data extracted
      * from the XML file into the specified composition
+     *
+     * To read the events of the segments in parallel, have the XMLReader
+     * defer "segment" elements.  See XMLReader::setDeferredElement().
      */
     RoseXmlHandler(RosegardenDocument *doc,
-                   unsigned int elementCount,
                    QPointer<QProgressDialog> progressDialog,
                    bool createNewDevicesWhenNeeded);
 
@@ -114,6 +119,17 @@ public:
     bool fatalError(int lineNumber, int columnNumber,
                     const QString& msg) override;
 
+    bool progress(double fraction) override;
+
+    /// The content of a <segment>.
+    /**
+     * The events of an internal segment are read by a SegmentXmlHandler
+     * on m_threadPool.  They are added to the segment at the end of
+     * <rosegarden-data>, before anything needs them.  See
+     * applyPendingSegments().
+     */
+    bool deferredContent(const QByteArray &content) override;
+
 
 protected:
 
@@ -135,28 +151,25 @@ protected:
     // unused void skipToNextPlayDevice();
     InstrumentId mapToActualInstrument(InstrumentId oldId);
 
+    /// Note a deprecated element, warning about the first one.
+    void setDeprecated(const QString &elementName);
+
+    /// Add the events read on m_threadPool to their segments.
+    bool applyPendingSegments();
+
     RosegardenDocument    *m_doc;
     Segment *m_currentSegment;
-    XmlStorableEvent    *m_currentEvent;
     typedef std::map<int, SegmentLinker *> SegmentLinkerMap;
     SegmentLinkerMap m_segmentLinkers;
 
-    timeT m_currentTime;
-    timeT m_chordDuration;
-    timeT *m_segmentEndMarkerTime;
+    /// Reads the content of m_currentSegment.
+    SegmentXmlHandler *m_segmentHandler;
+    /// Segments being read on m_threadPool, in file order.
+    std::vector<SegmentXmlHandler *> m_pendingSegments;
+    QThreadPool m_threadPool;
 
-    bool m_inChord;
-    bool m_inGroup;
     bool m_inComposition;
     bool m_inColourMap;
-    bool m_inMatrix;
-    bool m_inNotation;
-    std::string m_groupType;
-    int m_groupId;
-    int m_groupTupletBase;
-    int m_groupTupledCount;
-    int m_groupUntupledCount;
-    std::map<long, long> m_groupIdMap;
 
     bool m_foundTempo;
 
@@ -190,8 +203,6 @@ protected:
     ColourMap                        *m_colourMap;
     QSharedPointer<MidiKeyMapping> m_keyMapping;
     MidiKeyMapping::KeyNameMap        m_keyNameMap;
-    unsigned int                      m_totalElements;
-    unsigned int                      m_elementsSoFar;
 
     XmlSubHandler                    *m_subHandler;
     bool                              m_deprecation;
@@ -95,9 +95,12 @@
 #include "rosegarden-version.h"
 
 #include <QApplication>
+#include <QCoreApplication>
+#include <QEvent>
 #include <QSettings>
 #include <QMessageBox>
 #include <QProcess>
+#include <QRunnable>
 #include <QTemporaryFile>
 #include <QByteArray>
 #include <QDataStream>
@@ -109,10 +112,16 @@
 #include <QString>
 #include <QStringList>
 #include <QTextStream>
+#include <QThreadPool>
 #include <QWidget>
 #include <QHostInfo>
 #include <QLockFile>
 
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <sstream>
+
 // ??? Get rid of this.
 using namespace Rosegarden::BaseProperties;
 
@@ -150,6 +159,9 @@ RosegardenDocument::RosegardenDocument(
     connect(CommandHistory::getInstance(), &CommandHistory::documentRestored,
             this, &RosegardenDocument::slotDocumentRestored);
 
+    // One autosave at a time.
+    m_autoSaveThreadPool.setMaxThreadCount(1);
+
     // autoload a new document
     if (!skipAutoload)
         performAutoload();
@@ -164,6 +176,9 @@ RosegardenDocument::~RosegardenDocument()
 
     m_beingDestroyed = true;
 
+    // Let any autosave finish.  Its snapshot goes with us.
+    m_autoSaveThreadPool.waitForDone();
+
     m_audioPeaksThread.finish();
     m_audioPeaksThread.wait();
 
@@ -238,6 +253,9 @@ const QString &RosegardenDocument::getAbsFilePath() const
 
 void RosegardenDocument::deleteAutoSaveFile()
 {
+    // So an autosave that's still being written doesn't bring it back.
+    m_autoSaveThreadPool.waitForDone();
+
     QFile::remove(getAutoSaveFileName());
 }
 
@@ -336,25 +354,6 @@ QString RosegardenDocument::getAutoSaveFileName()
     return autoSaveFileName;
 }
 
-void RosegardenDocument::slotAutoSave()
-{
-    //     RG_DEBUG << "RosegardenDocument::slotAutoSave()";
-
-    if (isAutoSaved() || !isModified())
-        return ;
-
-    QString autoSaveFileName = getAutoSaveFileName();
-
-    RG_DEBUG << "RosegardenDocument::slotAutoSave() - doc modified - saving '"
-    << getAbsFilePath() << "' as"
-    << autoSaveFileName;
-
-    QString errMsg;
-
-    saveDocument(autoSaveFileName, errMsg, true);
-
-}
-
 bool RosegardenDocument::isRegularDotRGFile() const
 {
     return getAbsFilePath().right(3).toLower() == ".rg";
@@ -605,10 +604,9 @@ bool RosegardenDocument::openDocument(const QString &filename,
 
     // Load.
 
-    QString fileContents;
-
-    // Unzip
-    bool okay = GzipFile::readFromFile(filename, fileContents);
+    // Unzipped a chunk at a time as it is parsed.
+    GzipFile file(filename);
+    bool okay = file.openForReading();
 
     QString errMsg;
     bool cancelled = false;
@@ -617,7 +615,7 @@ bool RosegardenDocument::openDocument(const QString &filename,
         errMsg = tr("Could not open Rosegarden file");
     } else {
         // Parse the XML
-        okay = xmlParse(fileContents,
+        okay = xmlParse(file,
                         errMsg,
                         permanent,
                         cancelled);
@@ -664,6 +662,9 @@ bool RosegardenDocument::openDocument(const QString &filename,
         QMessageBox::critical(dynamic_cast<QWidget *>(parent()), tr("Rosegarden"), strtoqstr(e.getMessage()));
     }
 
+    // In the background, if the user wants it.
+    m_audioFileManager.resampleFiles();
+
     RG_DEBUG << "openDocument(): Successfully opened document \"" << filename << "\"";
 
     return true;
@@ -1129,138 +1130,440 @@ int RosegardenDocument::FILE_FORMAT_VERSION_MINOR = 6;
 // Older versions will issue helpful "plugin not found" messages.
 int RosegardenDocument::FILE_FORMAT_VERSION_POINT = 10;
 
-bool RosegardenDocument::saveDocument(const QString& filename,
-                                    QString& errMsg,
-                                    bool autosave)
+namespace
 {
-    QFileInfo fileInfo(filename);
+    /// A segment as it was when a save started.
+    struct SegmentSnapshot
+    {
+        /// The start tag, or the whole of an audio segment.
+        std::string head;
+
+        /// Copies of the segment's events.
+        /**
+         * The Event copy constructor shares the properties (Copy On
+         * Write), so these are cheap to make.  They must only be
+         * copied or destroyed on the GUI thread, as the reference
+         * counts aren't atomic.  The writer only reads them.
+         */
+        std::vector<Event> events;
+
+        timeT startTime;
+
+        /// The rulers and the end tag.
+        std::string tail;
+    };
+
+    /// Format a RealTime as QTextStream's operator<< does.
+    std::string realTimeString(const RealTime &rt)
+    {
+        char buffer[32];
+        snprintf(buffer, sizeof(buffer), "%d.%06d", rt.sec, rt.usec());
+        return buffer;
+    }
+
+    /// Copy a segment so it can be written on another thread.
+    /**
+     * Called on the GUI thread.  Everything but the events is written
+     * out now, as there isn't much of it.
+     */
+    void snapshotSegment(SegmentSnapshot &snapshot, const Segment *segment,
+                         const std::string &extraAttributes)
+    {
+        const std::string elementName =
+                qstrtostr(segment->getXmlElementName());
 
-    if (!fileInfo.exists()) { // safe to write directly
-        return saveDocumentActual(filename, errMsg, autosave);
-    }
+        std::ostringstream head;
 
-    if (fileInfo.exists()  &&  !fileInfo.isWritable()) {
-        errMsg = tr("'%1' is read-only.  Please save to a different file.").arg(filename);
-        return false;
-    }
+        head << "<" << elementName
+             << " track=\"" << segment->getTrack()
+             << "\" start=\"" << segment->getStartTime() << "\" ";
 
-    QTemporaryFile temp(filename + ".");
-    //!!! was: KTempFile temp(filename + ".", "", 0644); // will be umask'd
+        if (!extraAttributes.empty())
+            head << extraAttributes << " ";
 
-    temp.setAutoRemove(false);
+        head << "label=\"" << XmlExportable::encode(segment->getLabel());
 
-    temp.open(); // This creates the file and opens it atomically
+        if (segment->isRepeating()) {
+            head << "\" repeat=\"true";
+        }
 
-    if ( temp.error() ) {
-        errMsg = tr("Could not create temporary file in directory of '%1': %2").arg(filename).arg(temp.errorString());        //### removed .arg(strerror(status))
-        return false;
-    }
+        if (segment->getTranspose() != 0) {
+            head << "\" transpose=\"" << segment->getTranspose();
+        }
 
-    QString tempFileName = temp.fileName(); // Must do this before temp.close()
+        if (segment->getDelay() != 0) {
+            head << "\" delay=\"" << segment->getDelay();
+        }
 
-    // The temporary file is now open: close it (without removing it)
-    temp.close();
+        if (segment->getRealTimeDelay() != RealTime::zero()) {
+            head << "\" rtdelaysec=\"" << segment->getRealTimeDelay().sec
+                 << "\" rtdelaynsec=\"" << segment->getRealTimeDelay().nsec;
+        }
 
-    if( temp.error() ){
-        //status = temp.status();
-        errMsg = tr("Failure in temporary file handling for file '%1': %2")
-            .arg(tempFileName).arg(temp.errorString()); // .arg(strerror(status))
-        return false;
+        if (segment->getColourIndex() != 0) {
+            head << "\" colourindex=\"" << segment->getColourIndex();
+        }
+
+        if (segment->getSnapGridSize() != -1) {
+            head << "\" snapgridsize=\"" << segment->getSnapGridSize();
+        }
+
+        if (segment->getViewFeatures() != 0) {
+            head << "\" viewfeatures=\"" << segment->getViewFeatures();
+        }
+
+        if (segment->getExcludeFromPrinting()) {
+            // For compatibility with older versions of rg.
+            head << "\" fornotation=\"" << "false";
+            // New value to match UI.
+            head << "\" excludefromprinting=\"" << "true";
+        }
+
+        const timeT *endMarker = segment->getRawEndMarkerTime();
+        if (endMarker) {
+            head << "\" endmarker=\"" << *endMarker;
+        }
+
+        snapshot.startTime = segment->getStartTime();
+
+        std::ostringstream tail;
+
+        if (segment->getType() == Segment::Audio) {
+
+            head << "\" type=\"audio\" "
+                 << "file=\""
+                 << segment->getAudioFileId();
+
+            if (segment->getStretchRatio() != 1.f &&
+                segment->getStretchRatio() != 0.f) {
+
+                head << "\" unstretched=\""
+                     << segment->getUnstretchedFileId()
+                     << "\" stretch=\""
+                     << segment->getStretchRatio();
+            }
+
+            head << "\">\n";
+
+            // convert out - should do this as XmlExportable really
+            // once all this code is centralised
+            //
+
+            head << "    <begin index=\""
+                 << realTimeString(segment->getAudioStartTime())
+                 << "\"/>\n";
+
+            head << "    <end index=\""
+                 << realTimeString(segment->getAudioEndTime())
+                 << "\"/>\n";
+
+            if (segment->isAutoFading()) {
+                head << "    <fadein time=\""
+                     << realTimeString(segment->getFadeInTime())
+                     << "\"/>\n";
+
+                head << "    <fadeout time=\""
+                     << realTimeString(segment->getFadeOutTime())
+                     << "\"/>\n";
+            }
+
+        } else // Internal type
+        {
+            head << "\">\n";
+
+            // Reserve, so the vector never copies the Events again.
+            snapshot.events.reserve(segment->size());
+
+            for (const Event *event : *segment) {
+                snapshot.events.push_back(*event);
+                // The copy constructor leaves these out, but they're saved.
+                snapshot.events.back().copyNonPersistentProperties(*event);
+            }
+
+            // <matrix>
+
+            tail << "  <matrix>\n";
+
+            // Zoom factors
+            tail << "    <hzoom factor=\"" << segment->matrixHZoomFactor <<
+                    "\" />\n";
+            tail << "    <vzoom factor=\"" << segment->matrixVZoomFactor <<
+                    "\" />\n";
+
+            // For each matrix ruler...
+            for (const Segment::Ruler &ruler : *(segment->matrixRulers))
+            {
+                tail << "    <ruler type=\"" << ruler.type << "\"";
+
+                if (ruler.type == Controller::EventType)
+                    tail << " ccnumber=\"" << ruler.ccNumber << "\"";
+
+                tail << " />\n";
+            }
+
+            tail << "  </matrix>\n";
+
+            // <notation>
+
+            tail << "  <notation>\n";
+
+            // For each notation ruler...
+            for (const Segment::Ruler &ruler : *(segment->notationRulers))
+            {
+                tail << "    <ruler type=\"" << ruler.type << "\"";
+
+                if (ruler.type == Controller::EventType)
+                    tail << " ccnumber=\"" << ruler.ccNumber << "\"";
+
+                tail << " />\n";
+            }
+
+            tail << "  </notation>\n";
+
+        }
+
+        tail << "</" << elementName << ">\n";
+
+        snapshot.head = head.str();
+        snapshot.tail = tail.str();
     }
 
-    bool success = saveDocumentActual(tempFileName, errMsg, autosave);
+    /// Write one segment, as UTF-8, to \a xml.
+    /**
+     * Called on worker threads by SaveSegmentJob.
+     */
+    void saveSegment(std::string &xml, const SegmentSnapshot &snapshot)
+    {
+        xml += snapshot.head;
 
-    if (!success) {
-        // errMsg should be already set
-        return false;
+        const std::vector<Event> &events = snapshot.events;
+
+        bool inChord = false;
+        timeT chordStart = 0, chordDuration = 0;
+        timeT expectedTime = snapshot.startTime;
+
+        for (size_t i = 0; i < events.size(); ++i) {
+
+            const Event &event = events[i];
+            const timeT absTime = event.getAbsoluteTime();
+
+            const bool haveNext = (i + 1 < events.size());
+
+            if (haveNext &&
+                    events[i + 1].getAbsoluteTime() == absTime &&
+                    event.getDuration() != 0 &&
+                    !inChord) {
+                xml += "<chord>\n";
+                inChord = true;
+                chordStart = absTime;
+                chordDuration = 0;
+            }
+
+            if (inChord && event.getDuration() > 0)
+                if (chordDuration == 0 || event.getDuration() < chordDuration)
+                    chordDuration = event.getDuration();
+
+            xml += '\t';
+            xml += event.toXmlString(expectedTime);
+            xml += '\n';
+
+            if (haveNext &&
+                    events[i + 1].getAbsoluteTime() != absTime &&
+                    inChord) {
+                xml += "</chord>\n";
+                inChord = false;
+                expectedTime = chordStart + chordDuration;
+            } else if (inChord) {
+                expectedTime = absTime;
+            } else {
+                expectedTime = absTime + event.getDuration();
+            }
+
+        }
+
+        if (inChord) {
+            xml += "</chord>\n";
+        }
+
+        xml += snapshot.tail;
     }
 
-    QDir dir(QFileInfo(tempFileName).dir());
-    // According to  http://doc.trolltech.com/4.4/qdir.html#rename
-    // some systems fail, if renaming over an existing file.
-    // Therefore, delete first the existing file.
-    if (dir.exists(filename)) dir.remove(filename);
-    if (!dir.rename(tempFileName, filename)) {
-        errMsg = tr("Failed to rename temporary output file '%1' to desired output file '%2'").arg(tempFileName).arg(filename);
-        return false;
+    /// Writes a segment to a buffer on a worker thread.
+    class SaveSegmentJob : public QRunnable
+    {
+    public:
+        SaveSegmentJob(const SegmentSnapshot &snapshot, std::string *xml) :
+            m_snapshot(snapshot),
+            m_xml(xml)
+        {
+        }
+
+        void run() override
+        {
+            saveSegment(*m_xml, m_snapshot);
+        }
+
+    private:
+        const SegmentSnapshot &m_snapshot;
+        std::string *m_xml;
+    };
+
+    /// Save the segments in parallel, in order.
+    /**
+     * They're done a batch at a time, so only a batch's worth of XML is
+     * in memory at once, however big the composition is.
+     */
+    bool saveSegments(GzipFile &file,
+                      const std::vector<SegmentSnapshot> &segments)
+    {
+        QThreadPool threadPool;
+        const size_t batchSize = static_cast<size_t>(
+                std::max(1, threadPool.maxThreadCount())) * 4;
+
+        std::vector<std::string> xml;
+
+        for (size_t first = 0; first < segments.size(); first += batchSize) {
+            const size_t last = std::min(first + batchSize, segments.size());
+
+            xml.clear();
+            xml.resize(last - first);
+
+            for (size_t i = first; i < last; ++i) {
+                threadPool.start(
+                        new SaveSegmentJob(segments[i], &xml[i - first]));
+            }
+            threadPool.waitForDone();
+
+            for (const std::string &segmentXml : xml) {
+                if (!file.write(segmentXml))
+                    return false;
+            }
+        }
+
+        return true;
     }
 
-    return true;
+    /// Posted to the document when an autosave has been written.
+    class AutoSaveDoneEvent : public QEvent
+    {
+    public:
+        static const QEvent::Type Type;
+
+        AutoSaveDoneEvent(bool okay, const QString &errMsg) :
+            QEvent(Type),
+            m_okay(okay),
+            m_errMsg(errMsg)
+        {
+        }
+
+        bool m_okay;
+        QString m_errMsg;
+    };
+
+    const QEvent::Type AutoSaveDoneEvent::Type =
+            QEvent::Type(QEvent::registerEventType());
 }
 
+/// The document as it was when a save started.
+struct RosegardenDocument::SaveSnapshot
+{
+    /// The XML header, composition, audio files and configuration.
+    std::string head;
+
+    std::vector<SegmentSnapshot> segments;
+    std::vector<SegmentSnapshot> triggerSegments;
+
+    /// The studio, the appearance and the end tag.
+    std::string tail;
+};
 
-bool RosegardenDocument::saveDocumentActual(const QString& filename,
-                                          QString& errMsg,
-                                          bool autosave)
+/// Writes an autosave on RosegardenDocument::m_autoSaveThreadPool.
+class RosegardenDocument::AutoSaveJob : public QRunnable
 {
-    //Profiler profiler("RosegardenDocument::saveDocumentActual");
+public:
+    AutoSaveJob(RosegardenDocument *document,
+                const QString &filename,
+                const SaveSnapshot *snapshot) :
+        m_document(document),
+        m_filename(filename),
+        m_snapshot(snapshot)
+    {
+    }
 
-    RG_DEBUG << "RosegardenDocument::saveDocumentActual(" << filename << ")";
+    void run() override
+    {
+        QString errMsg;
+        const bool okay = writeSaveSnapshot(m_filename, *m_snapshot, errMsg);
 
-    QString outText;
-    QTextStream outStream(&outText, QIODevice::WriteOnly);
-//    outStream.setEncoding(QTextStream::UnicodeUTF8); qt3
-#if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
-    // qt6 default codec is UTF-8
-#else
-    outStream.setCodec("UTF-8");
-#endif
+        // The document's dtor waits for us, so it's still there.
+        QCoreApplication::postEvent(m_document,
+                                    new AutoSaveDoneEvent(okay, errMsg));
+    }
 
-    // output XML header
-    //
-    outStream << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
-    << "<!DOCTYPE rosegarden-data>\n"
-    << "<rosegarden-data version=\"" << VERSION
-    << "\" format-version-major=\"" << FILE_FORMAT_VERSION_MAJOR
-    << "\" format-version-minor=\"" << FILE_FORMAT_VERSION_MINOR
-    << "\" format-version-point=\"" << FILE_FORMAT_VERSION_POINT
-    << "\">\n";
+private:
+    RosegardenDocument *m_document;
+    QString m_filename;
+    const SaveSnapshot *m_snapshot;
+};
+
+std::unique_ptr<RosegardenDocument::SaveSnapshot>
+RosegardenDocument::makeSaveSnapshot()
+{
+    //Profiler profiler("RosegardenDocument::makeSaveSnapshot");
+
+    std::unique_ptr<SaveSnapshot> snapshot(new SaveSnapshot);
 
     // First make sure all MIDI devices know their current connections
     //
     m_studio.resyncDeviceConnections();
 
     // tell plugins to save state
-    RosegardenSequencer::getInstance()->savePluginState();
+    if (m_soundEnabled)
+        RosegardenSequencer::getInstance()->savePluginState();
+
+    // output XML header
+    //
+    std::string &head = snapshot->head;
+
+    head = qstrtostr(QString(
+            "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+            "<!DOCTYPE rosegarden-data>\n"
+            "<rosegarden-data version=\"%1\" format-version-major=\"%2\" "
+            "format-version-minor=\"%3\" format-version-point=\"%4\">\n")
+            .arg(VERSION)
+            .arg(FILE_FORMAT_VERSION_MAJOR)
+            .arg(FILE_FORMAT_VERSION_MINOR)
+            .arg(FILE_FORMAT_VERSION_POINT));
 
     // Send out Composition (this includes Tracks, Instruments, Tempo
     // and Time Signature changes and any other sub-objects)
     //
-    outStream << strtoqstr(getComposition().toXmlString())
-              << "\n\n";
-
-    outStream << strtoqstr(getAudioFileManager().toXmlString())
-              << "\n\n";
+    head += getComposition().toXmlString();
+    head += "\n\n";
 
-    outStream << strtoqstr(getConfiguration().toXmlString())
-              << "\n\n";
+    head += getAudioFileManager().toXmlString();
+    head += "\n\n";
 
-    long totalEvents = 0;
-    for (Composition::iterator segitr = m_composition.begin();
-         segitr != m_composition.end(); ++segitr) {
-        totalEvents += (long)(*segitr)->size();
-    }
+    head += getConfiguration().toXmlString();
+    head += "\n\n";
 
-    for (Composition::triggersegmentcontaineriterator ci =
-             m_composition.getTriggerSegments().begin();
-         ci != m_composition.getTriggerSegments().end(); ++ci) {
-        totalEvents += (long)(*ci)->getSegment()->size();
-    }
+    // Put a break in the file
+    //
+    head += "\n\n";
 
     // output all elements
     //
     // Iterate on segments
-    long eventCount = 0;
-
-    // Put a break in the file
-    //
-    outStream << "\n\n";
+    snapshot->segments.resize(m_composition.getNbSegments());
+    size_t segmentIndex = 0;
 
     for (Composition::iterator segitr = m_composition.begin();
          segitr != m_composition.end(); ++segitr) {
 
         Segment *segment = *segitr;
 
+        std::string linkedSegAtts;
+
         // Fix #1446 : Replace isLinked() with isTrulyLinked().
         // Maybe this fix will need to be removed some day if the
         // LinkTransposeParams come to be used.
@@ -1270,30 +1573,29 @@ bool RosegardenDocument::saveDocumentActual(const QString& filename,
             attsString += QString("linkertransposesteps=\"%3\" ");
             attsString += QString("linkertransposesemitones=\"%4\" ");
             attsString += QString("linkertransposesegmentback=\"%5\" ");
-            QString linkedSegAtts = QString(attsString)
+            linkedSegAtts = qstrtostr(QString(attsString)
               .arg(segment->getLinker()->getSegmentLinkerId())
               .arg(segment->getLinkTransposeParams().m_changeKey ? "true" :
                                                                    "false")
               .arg(segment->getLinkTransposeParams().m_steps)
               .arg(segment->getLinkTransposeParams().m_semitones)
               .arg(segment->getLinkTransposeParams().m_transposeSegmentBack
-                                                         ? "true" : "false");
-
-            saveSegment(outStream, segment, totalEvents,
-                                            eventCount, linkedSegAtts);
-        } else {
-            saveSegment(outStream, segment, totalEvents, eventCount);
+                                                         ? "true" : "false"));
         }
 
+        snapshotSegment(snapshot->segments[segmentIndex++],
+                        segment, linkedSegAtts);
     }
 
-    // Put a break in the file
-    //
-    outStream << "\n\n";
+    const Composition::triggersegmentcontainer &triggerSegments =
+            m_composition.getTriggerSegments();
 
-    for (Composition::triggersegmentcontaineriterator ci =
-                m_composition.getTriggerSegments().begin();
-            ci != m_composition.getTriggerSegments().end(); ++ci) {
+    snapshot->triggerSegments.resize(triggerSegments.size());
+    segmentIndex = 0;
+
+    for (Composition::triggersegmentcontainer::const_iterator ci =
+                triggerSegments.begin();
+            ci != triggerSegments.end(); ++ci) {
 
         QString triggerAtts = QString
                               ("triggerid=\"%1\" triggerbasepitch=\"%2\" triggerbasevelocity=\"%3\" triggerretune=\"%4\" triggeradjusttimes=\"%5\" ")
@@ -1303,33 +1605,43 @@ bool RosegardenDocument::saveDocumentActual(const QString& filename,
                               .arg((*ci)->getDefaultRetune())
                               .arg(strtoqstr((*ci)->getDefaultTimeAdjust()));
 
-        Segment *segment = (*ci)->getSegment();
-        saveSegment(outStream, segment, totalEvents, eventCount, triggerAtts);
+        snapshotSegment(snapshot->triggerSegments[segmentIndex++],
+                        (*ci)->getSegment(), qstrtostr(triggerAtts));
     }
 
-    // Put a break in the file
-    //
-    outStream << "\n\n";
-
     // Send out the studio - a self contained command
     //
-    outStream << strtoqstr(m_studio.toXmlString()) << "\n\n";
+    std::string &tail = snapshot->tail;
+
+    tail = m_studio.toXmlString();
+    tail += "\n\n";
 
     // Send out the appearance data
-    outStream << "<appearance>\n";
-    outStream << strtoqstr(getComposition().getSegmentColourMap().toXmlString("segmentmap"));
-    outStream << strtoqstr(getComposition().getGeneralColourMap().toXmlString("generalmap"));
-    outStream << "</appearance>\n\n\n";
+    tail += "<appearance>\n";
+    tail += getComposition().getSegmentColourMap().toXmlString("segmentmap");
+    tail += getComposition().getGeneralColourMap().toXmlString("generalmap");
+    tail += "</appearance>\n\n\n";
 
     // close the top-level XML tag
     //
-    outStream << "</rosegarden-data>\n";
+    tail += "</rosegarden-data>\n";
 
-    bool okay = GzipFile::writeToFile(filename, outText);
-    if (!okay) {
-        errMsg = tr("Error while writing on '%1'").arg(filename);
+    return snapshot;
+}
+
+bool RosegardenDocument::saveDocument(const QString& filename,
+                                    QString& errMsg,
+                                    bool autosave)
+{
+    RG_DEBUG << "RosegardenDocument::saveDocument(" << filename << ")";
+
+    // The file is written on this thread, as the callers need to know
+    // how it went before they carry on.  The autosave doesn't, so it's
+    // written on another.  See slotAutoSave().
+    std::unique_ptr<SaveSnapshot> snapshot = makeSaveSnapshot();
+
+    if (!writeSaveSnapshot(filename, *snapshot, errMsg))
         return false;
-    }
 
     RG_DEBUG << "RosegardenDocument::saveDocument() finished";
 
@@ -1344,242 +1656,200 @@ bool RosegardenDocument::saveDocumentActual(const QString& filename,
     return true;
 }
 
-bool RosegardenDocument::exportStudio(const QString& filename,
-                                      QString &errMsg,
-                                      std::vector<DeviceId> devices)
+bool RosegardenDocument::writeSaveSnapshot(const QString &filename,
+                                           const SaveSnapshot &snapshot,
+                                           QString &errMsg)
 {
-    Profiler profiler("RosegardenDocument::exportStudio");
-    RG_DEBUG << "RosegardenDocument::exportStudio(" << filename << ")";
-
-    QString outText;
-    QTextStream outStream(&outText, QIODevice::WriteOnly);
-//    outStream.setEncoding(QTextStream::UnicodeUTF8); qt3
-#if (QT_VERSION >= QT_VERSION_CHECK(6, 0, 0))
-    // qt6 default codec is UTF-8
-#else
-    outStream.setCodec("UTF-8");
-#endif
-
-    // output XML header
-    //
-    outStream << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
-              << "<!DOCTYPE rosegarden-data>\n"
-              << "<rosegarden-data version=\"" << VERSION << "\">\n";
-
-    // Send out the studio - a self contained command
-    //
-    outStream << strtoqstr(m_studio.toXmlString(devices)) << "\n\n";
+    QFileInfo fileInfo(filename);
 
-    // close the top-level XML tag
-    //
-    outStream << "</rosegarden-data>\n";
+    if (!fileInfo.exists()) { // safe to write directly
+        return writeSaveSnapshotActual(filename, snapshot, errMsg);
+    }
 
-    bool okay = GzipFile::writeToFile(filename, outText);
-    if (!okay) {
-        errMsg = tr("Could not open file '%1' for writing").arg(filename);
+    if (fileInfo.exists()  &&  !fileInfo.isWritable()) {
+        errMsg = tr("'%1' is read-only.  Please save to a different file.").arg(filename);
         return false;
     }
 
-    RG_DEBUG << "RosegardenDocument::exportStudio() finished";
-    return true;
-}
-
-void RosegardenDocument::saveSegment(QTextStream& outStream, Segment *segment,
-                                   long /*totalEvents*/, long &/*count*/,
-                                   QString extraAttributes)
-{
-    QString time;
-
-    outStream << QString("<%1 track=\"%2\" start=\"%3\" ")
-    .arg(segment->getXmlElementName())
-    .arg(segment->getTrack())
-    .arg(segment->getStartTime());
-
-    if (!extraAttributes.isEmpty())
-        outStream << extraAttributes << " ";
-
-    outStream << "label=\"" <<
-    strtoqstr(XmlExportable::encode(segment->getLabel()));
+    QTemporaryFile temp(filename + ".");
+    //!!! was: KTempFile temp(filename + ".", "", 0644); // will be umask'd
 
-    if (segment->isRepeating()) {
-        outStream << "\" repeat=\"true";
-    }
+    temp.setAutoRemove(false);
 
-    if (segment->getTranspose() != 0) {
-        outStream << "\" transpose=\"" << segment->getTranspose();
-    }
+    temp.open(); // This creates the file and opens it atomically
 
-    if (segment->getDelay() != 0) {
-        outStream << "\" delay=\"" << segment->getDelay();
+    if ( temp.error() ) {
+        //### removed .arg(strerror(status))
+        errMsg = tr("Could not create temporary file in directory of '%1': %2")
+                .arg(filename).arg(temp.errorString());
+        return false;
     }
 
-    if (segment->getRealTimeDelay() != RealTime::zero()) {
-        outStream << "\" rtdelaysec=\"" << segment->getRealTimeDelay().sec
-        << "\" rtdelaynsec=\"" << segment->getRealTimeDelay().nsec;
-    }
+    QString tempFileName = temp.fileName(); // Must do this before temp.close()
 
-    if (segment->getColourIndex() != 0) {
-        outStream << "\" colourindex=\"" << segment->getColourIndex();
-    }
+    // The temporary file is now open: close it (without removing it)
+    temp.close();
 
-    if (segment->getSnapGridSize() != -1) {
-        outStream << "\" snapgridsize=\"" << segment->getSnapGridSize();
+    if( temp.error() ){
+        //status = temp.status();
+        errMsg = tr("Failure in temporary file handling for file '%1': %2")
+            .arg(tempFileName).arg(temp.errorString()); // .arg(strerror(status))
+        return false;
     }
 
-    if (segment->getViewFeatures() != 0) {
-        outStream << "\" viewfeatures=\"" << segment->getViewFeatures();
-    }
+    bool success = writeSaveSnapshotActual(tempFileName, snapshot, errMsg);
 
-    if (segment->getExcludeFromPrinting()) {
-        // For compatibility with older versions of rg.
-        outStream << "\" fornotation=\"" << "false";
-        // New value to match UI.
-        outStream << "\" excludefromprinting=\"" << "true";
+    if (!success) {
+        // errMsg should be already set
+        return false;
     }
 
-    const timeT *endMarker = segment->getRawEndMarkerTime();
-    if (endMarker) {
-        outStream << "\" endmarker=\"" << *endMarker;
+    QDir dir(QFileInfo(tempFileName).dir());
+    // According to  http://doc.trolltech.com/4.4/qdir.html#rename
+    // some systems fail, if renaming over an existing file.
+    // Therefore, delete first the existing file.
+    if (dir.exists(filename)) dir.remove(filename);
+    if (!dir.rename(tempFileName, filename)) {
+        errMsg = tr("Failed to rename temporary output file '%1' to desired output file '%2'")
+                .arg(tempFileName).arg(filename);
+        return false;
     }
 
-    if (segment->getType() == Segment::Audio) {
-
-        outStream << "\" type=\"audio\" "
-                  << "file=\""
-                  << segment->getAudioFileId();
-
-        if (segment->getStretchRatio() != 1.f &&
-            segment->getStretchRatio() != 0.f) {
+    return true;
+}
 
-            outStream << "\" unstretched=\""
-                      << segment->getUnstretchedFileId()
-                      << "\" stretch=\""
-                      << segment->getStretchRatio();
-        }
 
-        outStream << "\">\n";
+bool RosegardenDocument::writeSaveSnapshotActual(const QString &filename,
+                                                 const SaveSnapshot &snapshot,
+                                                 QString &errMsg)
+{
+    //Profiler profiler("RosegardenDocument::writeSaveSnapshotActual");
 
-        // convert out - should do this as XmlExportable really
-        // once all this code is centralised
-        //
+    RG_DEBUG << "RosegardenDocument::writeSaveSnapshotActual(" << filename << ")";
 
-        outStream << "    <begin index=\""
-        << segment->getAudioStartTime()
-        << "\"/>\n";
+    // The XML goes straight to the file, a piece at a time, as UTF-8.
+    GzipFile file(filename);
+    bool okay = file.openForWriting();
 
-        outStream << "    <end index=\""
-        << segment->getAudioEndTime()
-        << "\"/>\n";
+    if (okay)
+        okay = file.write(snapshot.head);
 
-        if (segment->isAutoFading()) {
-            outStream << "    <fadein time=\""
-            << segment->getFadeInTime()
-            << "\"/>\n";
+    if (okay)
+        okay = saveSegments(file, snapshot.segments);
 
-            outStream << "    <fadeout time=\""
-            << segment->getFadeOutTime()
-            << "\"/>\n";
-        }
+    // Put a break in the file
+    //
+    if (okay)
+        okay = file.write(std::string("\n\n"));
 
-    } else // Internal type
-    {
-        outStream << "\">\n";
+    if (okay)
+        okay = saveSegments(file, snapshot.triggerSegments);
 
-        bool inChord = false;
-        timeT chordStart = 0, chordDuration = 0;
-        timeT expectedTime = segment->getStartTime();
+    // Put a break in the file
+    //
+    if (okay)
+        okay = file.write(std::string("\n\n"));
 
-        for (Segment::iterator i = segment->begin();
-                i != segment->end(); ++i) {
+    if (okay)
+        okay = file.write(snapshot.tail);
 
-            timeT absTime = (*i)->getAbsoluteTime();
+    // Always close, so the file isn't left open on failure.
+    if (!file.close())
+        okay = false;
 
-            Segment::iterator nextEl = i;
-            ++nextEl;
+    if (!okay) {
+        errMsg = tr("Error while writing on '%1'").arg(filename);
+        return false;
+    }
 
-            if (nextEl != segment->end() &&
-                    (*nextEl)->getAbsoluteTime() == absTime &&
-                    (*i)->getDuration() != 0 &&
-                    !inChord) {
-                outStream << "<chord>\n";
-                inChord = true;
-                chordStart = absTime;
-                chordDuration = 0;
-            }
+    return true;
+}
 
-            if (inChord && (*i)->getDuration() > 0)
-                if (chordDuration == 0 || (*i)->getDuration() < chordDuration)
-                    chordDuration = (*i)->getDuration();
+void RosegardenDocument::slotAutoSave()
+{
+    //     RG_DEBUG << "RosegardenDocument::slotAutoSave()";
 
-            outStream << '\t'
-            << strtoqstr((*i)->toXmlString(expectedTime)) << "\n";
+    if (isAutoSaved() || !isModified())
+        return ;
 
-            if (nextEl != segment->end() &&
-                    (*nextEl)->getAbsoluteTime() != absTime &&
-                    inChord) {
-                outStream << "</chord>\n";
-                inChord = false;
-                expectedTime = chordStart + chordDuration;
-            } else if (inChord) {
-                expectedTime = absTime;
-            } else {
-                expectedTime = absTime + (*i)->getDuration();
-            }
+    // Still writing the last one?  Try again next time.
+    if (m_autoSaveSnapshot)
+        return;
 
-//            if ((++count % 500 == 0) && progress) {
-//                progress->setValue(count * 100 / totalEvents);
-//            }
-        }
+    QString autoSaveFileName = getAutoSaveFileName();
 
-        if (inChord) {
-            outStream << "</chord>\n";
-        }
+    RG_DEBUG << "RosegardenDocument::slotAutoSave() - doc modified - saving '"
+    << getAbsFilePath() << "' as"
+    << autoSaveFileName;
 
-        // <matrix>
+    // Only the snapshot is taken here.  It's written on another thread,
+    // so the GUI can carry on, and customEvent() hears how it went.
+    m_autoSaveSnapshot = makeSaveSnapshot();
 
-        outStream << "  <matrix>\n";
+    // Anything changed from now on clears this, and goes in the next one.
+    setAutoSaved(true);
 
-        // Zoom factors
-        outStream << "    <hzoom factor=\"" << segment->matrixHZoomFactor <<
-                     "\" />\n";
-        outStream << "    <vzoom factor=\"" << segment->matrixVZoomFactor <<
-                     "\" />\n";
+    m_autoSaveThreadPool.start(new AutoSaveJob(
+            this, autoSaveFileName, m_autoSaveSnapshot.get()));
+}
 
-        // For each matrix ruler...
-        for (const Segment::Ruler &ruler : *(segment->matrixRulers))
-        {
-            outStream << "    <ruler type=\"" << ruler.type << "\"";
+void RosegardenDocument::customEvent(QEvent *event)
+{
+    if (event->type() != AutoSaveDoneEvent::Type)
+        return;
 
-            if (ruler.type == Controller::EventType)
-                outStream << " ccnumber=\"" << ruler.ccNumber << "\"";
+    const AutoSaveDoneEvent *autoSaveDoneEvent =
+            static_cast<const AutoSaveDoneEvent *>(event);
 
-            outStream << " />\n";
-        }
+    // On this thread, as the Event reference counts aren't atomic.
+    m_autoSaveSnapshot.reset();
 
-        outStream << "  </matrix>\n";
+    if (!autoSaveDoneEvent->m_okay) {
+        RG_WARNING << "customEvent(): Autosave failed:"
+                   << autoSaveDoneEvent->m_errMsg;
+        // Try again next time.
+        setAutoSaved(false);
+    }
+}
 
-        // <notation>
+bool RosegardenDocument::exportStudio(const QString& filename,
+                                      QString &errMsg,
+                                      std::vector<DeviceId> devices)
+{
+    Profiler profiler("RosegardenDocument::exportStudio");
+    RG_DEBUG << "RosegardenDocument::exportStudio(" << filename << ")";
 
-        outStream << "  <notation>\n";
+    GzipFile file(filename);
+    bool okay = file.openForWriting();
 
-        // For each notation ruler...
-        for (const Segment::Ruler &ruler : *(segment->notationRulers))
-        {
-            outStream << "    <ruler type=\"" << ruler.type << "\"";
+    // output XML header
+    //
+    if (okay)
+        okay = file.write(qstrtostr(QString(
+                "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                "<!DOCTYPE rosegarden-data>\n"
+                "<rosegarden-data version=\"%1\">\n").arg(VERSION)));
 
-            if (ruler.type == Controller::EventType)
-                outStream << " ccnumber=\"" << ruler.ccNumber << "\"";
+    // Send out the studio - a self contained command
+    //
+    if (okay)
+        okay = file.write(m_studio.toXmlString(devices) + "\n\n");
 
-            outStream << " />\n";
-        }
+    // close the top-level XML tag
+    //
+    if (okay)
+        okay = file.write(std::string("</rosegarden-data>\n"));
 
-        outStream << "  </notation>\n";
+    if (!file.close())
+        okay = false;
 
+    if (!okay) {
+        errMsg = tr("Could not open file '%1' for writing").arg(filename);
+        return false;
     }
 
-
-    outStream << QString("</%1>\n").arg(segment->getXmlElementName()); //-------------------------
-
+    RG_DEBUG << "RosegardenDocument::exportStudio() finished";
+    return true;
 }
 
 bool RosegardenDocument::saveAs(const QString &newName, QString &errMsg)
@@ -1634,7 +1904,7 @@ bool RosegardenDocument::isSoundEnabled() const
 }
 
 bool
-RosegardenDocument::xmlParse(QString fileContents, QString &errMsg,
+RosegardenDocument::xmlParse(GzipFile &file, QString &errMsg,
                            bool permanent,
                            bool &cancelled)
 {
@@ -1642,21 +1912,16 @@ RosegardenDocument::xmlParse(QString fileContents, QString &errMsg,
 
     cancelled = false;
 
-    unsigned int elementCount = 0;
-    for (int i = 0; i < fileContents.length() - 1; ++i) {
-        if (fileContents[i] == '<' && fileContents[i+1] != '/') {
-            ++elementCount;
-        }
-    }
-
     if (permanent && m_soundEnabled) RosegardenSequencer::getInstance()->removeAllDevices();
 
-    RoseXmlHandler handler(this, elementCount, m_progressDialog, permanent);
+    RoseXmlHandler handler(this, m_progressDialog, permanent);
 
     XMLReader reader;
     reader.setHandler(&handler);
+    // The events in each segment are read in parallel.
+    reader.setDeferredElement("segment");
 
-    bool ok = reader.parse(fileContents);
+    bool ok = reader.parse(file);
 
     if (m_progressDialog  &&  m_progressDialog->wasCanceled()) {
         QMessageBox::information(dynamic_cast<QWidget *>(parent()), tr("Rosegarden"), tr("File load cancelled"));
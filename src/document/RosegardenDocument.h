@@ -35,13 +35,15 @@
 #include <QProgressDialog>
 #include <QPointer>
 #include <QSharedPointer>
+#include <QThreadPool>
 
 #include <map>
+#include <memory>
 #include <vector>
 
+class QEvent;
 class QLockFile;
 class QWidget;
-class QTextStream;
 class NoteOnRecSet;
 
 namespace Rosegarden
@@ -54,6 +56,7 @@ class MappedEventList;
 class Event;
 class EditViewBase;
 class AudioPluginManager;
+class GzipFile;
 
 
 /// The document object for a document-view model.
@@ -512,6 +515,9 @@ public slots:
 
     /**
      * saves the document to a suitably-named backup file
+     *
+     * The file is written on another thread.  The document can be
+     * edited meanwhile, and customEvent() hears how it went.
      */
     void slotAutoSave();
 
@@ -591,7 +597,8 @@ private:
     void performAutoload();
 
     /**
-     * Parse the Rosegarden file in \a file
+     * Parse the Rosegarden file in \a file, which must be open for
+     * reading.  It is decompressed as it is parsed.
      *
      * \a errMsg will contains the error messages
      * if parsing failed.
@@ -599,7 +606,7 @@ private:
      * @return false if parsing failed
      * @see RoseXmlHandler
      */
-    bool xmlParse(QString fileContents, QString &errMsg,
+    bool xmlParse(GzipFile &file, QString &errMsg,
                   bool permanent,
                   bool &cancelled);
 
@@ -620,22 +627,38 @@ private:
      */
     QString getAutoSaveFileName();
 
+    /// The document as it was when a save started.
+    struct SaveSnapshot;
+
+    /// Writes an autosave on m_autoSaveThreadPool.
+    class AutoSaveJob;
+
+    /// Copy everything a save writes, so it can be written on any thread.
     /**
-     * Save document to the given file.  This function does the actual
-     * save of the file to the given filename; saveDocument() wraps
-     * this, saving to a temporary file and then renaming to the
-     * required file, so as not to lose the original if a failure
-     * occurs during overwriting.
+     * The segments' Events are copied, which is cheap as they're Copy
+     * On Write.  The rest is written out to XML here.  Must be called
+     * on the GUI thread, and the snapshot must be destroyed there too.
      */
-    bool saveDocumentActual(const QString &filename, QString& errMsg,
-                            bool autosave = false);
+    std::unique_ptr<SaveSnapshot> makeSaveSnapshot();
 
     /**
-     * Save one segment to the given text stream
+     * Write \a snapshot to the given file.  Can be called on any thread.
+     *
+     * If the file exists, this saves to a temporary file and then
+     * renames it to the required file, so as not to lose the original
+     * if a failure occurs during overwriting.
      */
-    void saveSegment(QTextStream&, Segment*,
-                     long totalNbOfEvents, long &count,
-                     QString extraAttributes = QString());
+    static bool writeSaveSnapshot(const QString &filename,
+                                  const SaveSnapshot &snapshot,
+                                  QString &errMsg);
+
+    /// Does the actual writing for writeSaveSnapshot().
+    static bool writeSaveSnapshotActual(const QString &filename,
+                                        const SaveSnapshot &snapshot,
+                                        QString &errMsg);
+
+    /// Handles the event AutoSaveJob posts when it's done.
+    void customEvent(QEvent *event) override;
 
     /// Identifies a specific event within a specific segment.
     /**
@@ -808,6 +831,12 @@ private:
      */
     int m_autoSavePeriod;
 
+    /// Runs AutoSaveJob, one at a time.
+    QThreadPool m_autoSaveThreadPool;
+
+    /// What the autosave in progress is writing, if one is.
+    std::unique_ptr<SaveSnapshot> m_autoSaveSnapshot;
+
     // Set to true when the dtor starts
     bool m_beingDestroyed;
 
@@ -0,0 +1,305 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+
+    Other copyrights also apply to some parts of this work.  Please
+    see the AUTHORS file and individual file headers for details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[SegmentXmlHandler]"
+#define RG_NO_DEBUG_PRINT
+
+#include "SegmentXmlHandler.h"
+
+#include "XmlStorableEvent.h"
+#include "base/BaseProperties.h"
+#include "base/NotationTypes.h"
+#include "misc/Debug.h"
+
+#include <QXmlStreamAttributes>
+
+
+namespace Rosegarden
+{
+
+
+using namespace BaseProperties;
+
+
+SegmentXmlHandler::SegmentXmlHandler(Segment *segment,
+                                     timeT startTime,
+                                     const timeT *endMarkerTime) :
+    m_segment(segment),
+    m_hasEndMarker(endMarkerTime != nullptr),
+    m_endMarkerTime(endMarkerTime ? *endMarkerTime : 0),
+    m_currentEvent(nullptr),
+    m_currentTime(startTime),
+    m_chordDuration(0),
+    m_inChord(false),
+    m_inGroup(false),
+    m_inMatrix(false),
+    m_inNotation(false),
+    m_groupId(0),
+    m_groupTupletBase(0),
+    m_groupTupledCount(0),
+    m_groupUntupledCount(0),
+    m_matrixHZoomFactor(segment->matrixHZoomFactor),
+    m_matrixVZoomFactor(segment->matrixVZoomFactor)
+{
+}
+
+SegmentXmlHandler::~SegmentXmlHandler()
+{
+    // Anything apply() didn't hand over.
+    for (Event *event : m_events) {
+        delete event;
+    }
+    delete m_currentEvent;
+}
+
+bool
+SegmentXmlHandler::startElement(const QString & /*namespaceURI*/,
+                                const QString & /*localName*/,
+                                const QString &qName,
+                                const QXmlStreamAttributes &atts)
+{
+    const QString lcName = qName.toLower();
+
+    if (lcName == "event") {
+
+        //RG_DEBUG << "startElement(): found event, current time is " << m_currentTime;
+
+        if (m_currentEvent) {
+            RG_DEBUG << "startElement(): Warning: new event found at time " << m_currentTime << " before previous event has ended; previous event will be lost";
+            delete m_currentEvent;
+        }
+
+        m_currentEvent = new XmlStorableEvent(atts, m_currentTime, m_names);
+
+        if (m_currentEvent->has(BEAMED_GROUP_ID)) {
+
+            // remap -- we want to ensure that the segment's nextId
+            // is always used (and incremented) in preference to the
+            // stored id
+
+            long storedId = m_currentEvent->get<Int>(BEAMED_GROUP_ID);
+
+            if (m_groupIdMap.find(storedId) == m_groupIdMap.end()) {
+                m_groupIdMap[storedId] = m_segment->getNextId();
+            }
+
+            m_currentEvent->set<Int>(
+                    BEAMED_GROUP_ID, m_groupIdMap[storedId]);
+
+        } else if (m_inGroup) {
+            m_currentEvent->set<Int>(BEAMED_GROUP_ID, m_groupId);
+            m_currentEvent->set<String>(BEAMED_GROUP_TYPE, m_groupType);
+            if (m_groupType == GROUP_TYPE_TUPLED) {
+                m_currentEvent->set<Int>(
+                        BEAMED_GROUP_TUPLET_BASE, m_groupTupletBase);
+                m_currentEvent->set<Int>(
+                        BEAMED_GROUP_TUPLED_COUNT, m_groupTupledCount);
+                m_currentEvent->set<Int>(
+                        BEAMED_GROUP_UNTUPLED_COUNT, m_groupUntupledCount);
+            }
+        }
+
+        timeT duration = m_currentEvent->getDuration();
+
+        if (!m_inChord) {
+
+            m_currentTime = m_currentEvent->getAbsoluteTime() + duration;
+
+        } else if (duration != 0) {
+
+            // set chord duration to the duration of the shortest
+            // element with a non-null duration (if no such elements,
+            // leave it as 0).
+
+            if (m_chordDuration == 0 || duration < m_chordDuration) {
+                m_chordDuration = duration;
+            }
+        }
+
+    } else if (lcName == "property") {
+
+        if (!m_currentEvent) {
+            RG_DEBUG << "startElement(): Warning: Found property outside of event at time " << m_currentTime << ", ignoring";
+        } else {
+            m_currentEvent->setPropertyFromAttributes(atts, true, m_names);
+        }
+
+    } else if (lcName == "nproperty") {
+
+        if (!m_currentEvent) {
+            RG_DEBUG << "startElement(): Warning: Found nproperty outside of event at time " << m_currentTime << ", ignoring";
+        } else {
+            m_currentEvent->setPropertyFromAttributes(atts, false, m_names);
+        }
+
+    } else if (lcName == "chord") {
+
+        m_inChord = true;
+
+    } else if (lcName == "group") {
+
+        m_deprecatedElement = "group";
+
+        m_inGroup = true;
+        m_groupId = m_segment->getNextId();
+        m_groupType = atts.value("type").toUtf8().toStdString();
+
+        if (m_groupType == GROUP_TYPE_TUPLED) {
+            m_groupTupletBase = atts.value("base").toInt();
+            m_groupTupledCount = atts.value("tupled").toInt();
+            m_groupUntupledCount = atts.value("untupled").toInt();
+        }
+
+    } else if (lcName == "resync") {
+
+        m_deprecatedElement = "resync";
+
+        bool isNumeric;
+        int numTime = atts.value("time").toInt(&isNumeric);
+        if (isNumeric)
+            m_currentTime = numTime;
+
+    } else if (lcName == "matrix") {  // <matrix>
+
+        m_inMatrix = true;
+
+    } else if (lcName == "notation") {  // <notation>
+
+        m_inNotation = true;
+
+    } else if (lcName == "hzoom") {  // <hzoom>
+
+        if (m_inMatrix)
+            m_matrixHZoomFactor = atts.value("factor").toDouble();
+
+    } else if (lcName == "vzoom") {  // <vzoom>
+
+        if (m_inMatrix)
+            m_matrixVZoomFactor = atts.value("factor").toDouble();
+
+    } else if (lcName == "ruler") {  // <ruler>
+
+        Segment::Ruler segmentRuler;
+        segmentRuler.type = atts.value("type").toUtf8().toStdString();
+        segmentRuler.ccNumber = atts.value("ccnumber").toInt();
+
+        if (m_inMatrix)
+            m_matrixRulers.insert(segmentRuler);
+        if (m_inNotation)
+            m_notationRulers.insert(segmentRuler);
+
+    } else if (lcName == "gui"  ||  lcName == "controller") {
+
+        // These elements are no longer supported.  But please don't reuse
+        // the names in case they pop up in an old file.
+
+        // <gui> elements used to be found in <segment> elements.
+        // <gui> elements contained <controller> elements.
+        // The example file bogus-surf-jam.rg still has this.
+        // However, they never did anything.
+
+    } else {
+        RG_DEBUG << "startElement(): Don't know how to parse this : " << qName;
+    }
+
+    return true;
+}
+
+bool
+SegmentXmlHandler::endElement(const QString & /*namespaceURI*/,
+                              const QString & /*localName*/,
+                              const QString &qName)
+{
+    const QString lcName = qName.toLower();
+
+    if (lcName == "event") {
+
+        if (m_currentEvent) {
+            m_events.push_back(m_currentEvent);
+            m_currentEvent = nullptr;
+        }
+
+    } else if (lcName == "chord") {
+
+        m_currentTime += m_chordDuration;
+        m_inChord = false;
+        m_chordDuration = 0;
+
+    } else if (lcName == "group") {
+
+        m_inGroup = false;
+
+    } else if (lcName == "matrix") {
+
+        m_inMatrix = false;
+
+    } else if (lcName == "notation") {
+
+        m_inNotation = false;
+
+    }
+
+    return true;
+}
+
+bool
+SegmentXmlHandler::fatalError(int lineNumber, int columnNumber,
+                              const QString &msg)
+{
+    // Line numbers are from the start of the <segment>'s content.
+    m_errorString = QString("%1 in segment at line %2, column %3")
+                    .arg(msg)
+                    .arg(lineNumber)
+                    .arg(columnNumber);
+    return false;
+}
+
+bool
+SegmentXmlHandler::apply()
+{
+    if (!m_errorString.isEmpty())
+        return false;
+
+    // In file order.  Segment::insert() is quickest that way.
+    for (Event *event : m_events) {
+        m_segment->insert(event);
+    }
+    m_events.clear();
+
+    m_segment->matrixHZoomFactor = m_matrixHZoomFactor;
+    m_segment->matrixVZoomFactor = m_matrixVZoomFactor;
+    m_segment->matrixRulers->insert(m_matrixRulers.begin(),
+                                    m_matrixRulers.end());
+    m_segment->notationRulers->insert(m_notationRulers.begin(),
+                                      m_notationRulers.end());
+
+    if (m_hasEndMarker) {
+        m_segment->setEndMarkerTime(m_endMarkerTime);
+
+        // If the segment is zero or negative duration
+        if (m_segment->getEndMarkerTime() <= m_segment->getStartTime()) {
+            // Make it stick out so the user can take care of it.
+            m_segment->setEndMarkerTime(m_segment->getStartTime() +
+                                        Note(Note::Shortest).getDuration());
+        }
+    }
+
+    return true;
+}
+
+
+}
@@ -0,0 +1,131 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+
+    Other copyrights also apply to some parts of this work.  Please
+    see the AUTHORS file and individual file headers for details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_SEGMENTXMLHANDLER_H
+#define RG_SEGMENTXMLHANDLER_H
+
+#include "base/Segment.h"
+#include "base/TimeT.h"
+#include "document/XmlStorableEvent.h"
+#include "document/io/XMLHandler.h"
+
+#include <QString>
+
+#include <map>
+#include <string>
+#include <vector>
+
+
+namespace Rosegarden
+{
+
+
+class Event;
+
+
+/// Handler for the content of a <segment> element.
+/**
+ * Reads the events and the matrix and notation settings of one Segment.
+ * It only collects them, apply() puts them in the Segment.  That way it
+ * can run on a worker thread while RoseXmlHandler carries on with the
+ * rest of the file (see XMLReader::setDeferredElement()).
+ *
+ * Until apply(), the only thing it calls on the Segment is getNextId(),
+ * and nothing else calls that on a Segment that is being loaded.
+ *
+ * RoseXmlHandler also passes it the elements of segments it reads
+ * itself, e.g. audio segments.
+ */
+class SegmentXmlHandler : public XMLHandler
+{
+public:
+    /**
+     * endMarkerTime is from the <segment>'s "endmarker" attribute, or
+     * nullptr if it has none.
+     */
+    SegmentXmlHandler(Segment *segment,
+                      timeT startTime,
+                      const timeT *endMarkerTime);
+    ~SegmentXmlHandler() override;
+
+    bool startElement(const QString &namespaceURI,
+                      const QString &localName,
+                      const QString &qName,
+                      const QXmlStreamAttributes &atts) override;
+
+    bool endElement(const QString &namespaceURI,
+                    const QString &localName,
+                    const QString &qName) override;
+
+    QString errorString() const override  { return m_errorString; }
+
+    bool fatalError(int lineNumber, int columnNumber,
+                    const QString &msg) override;
+
+    Segment *getSegment() const  { return m_segment; }
+
+    /// A deprecated element that was found, or empty if there were none.
+    QString getDeprecatedElement() const  { return m_deprecatedElement; }
+
+    /// Put what was read into the Segment.
+    /**
+     * GUI thread only.  Returns false, with errorString() set, if the
+     * content couldn't be parsed.
+     */
+    bool apply();
+
+private:
+    SegmentXmlHandler(const SegmentXmlHandler &);
+    SegmentXmlHandler &operator=(const SegmentXmlHandler &);
+
+    Segment *m_segment;
+
+    bool m_hasEndMarker;
+    timeT m_endMarkerTime;
+
+    /// In file order, which is time order.
+    std::vector<Event *> m_events;
+    XmlStorableEvent *m_currentEvent;
+    XmlStorableEvent::NameCache m_names;
+
+    timeT m_currentTime;
+    timeT m_chordDuration;
+
+    bool m_inChord;
+    bool m_inGroup;
+    bool m_inMatrix;
+    bool m_inNotation;
+    std::string m_groupType;
+    int m_groupId;
+    int m_groupTupletBase;
+    int m_groupTupledCount;
+    int m_groupUntupledCount;
+    std::map<long, long> m_groupIdMap;
+
+    double m_matrixHZoomFactor;
+    double m_matrixVZoomFactor;
+    Segment::RulerSet m_matrixRulers;
+    Segment::RulerSet m_notationRulers;
+
+    QString m_deprecatedElement;
+    QString m_errorString;
+};
+
+
+}
+
+#endif
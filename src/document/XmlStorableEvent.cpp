@@ -20,7 +20,6 @@
 #include "XmlStorableEvent.h"
 
 #include "misc/Debug.h"
-#include "misc/Strings.h"
 #include "base/Event.h"
 #include "base/NotationTypes.h"
 //#include "base/BaseProperties.h"
@@ -33,69 +32,73 @@ namespace Rosegarden
 {
 
 XmlStorableEvent::XmlStorableEvent(const QXmlStreamAttributes &attributes,
-                                   timeT &absoluteTime)
+                                   timeT &absoluteTime,
+                                   NameCache &names)
 {
     setDuration(0);
 
+    // The attributes are read in place, without a QString for each.
+    // That matters when there are a lot of events.
+
     for (int i = 0; i < attributes.length(); ++i) {
 
-        QString attrName(attributes.at(i).name().toString()),
-            attrVal(attributes.at(i).value().toString());
+        const auto attrName = attributes.at(i).name();
+        const auto attrVal = attributes.at(i).value();
 
-        if (attrName == "package") {
+        if (attrName == QLatin1String("package")) {
 
             RG_DEBUG << "XmlStorableEvent::XmlStorableEvent: Warning: XML still uses deprecated \"package\" attribute";
 
-        } else if (attrName == "type") {
+        } else if (attrName == QLatin1String("type")) {
 
-            setType(qstrtostr(attrVal));
+            setType(names.getTypeName(attrVal));
 
-        } else if (attrName == "subordering") {
+        } else if (attrName == QLatin1String("subordering")) {
 
             bool isNumeric = true;
             int o = attrVal.toInt(&isNumeric);
 
             if (!isNumeric) {
-                RG_DEBUG << "XmlStorableEvent::XmlStorableEvent: Bad subordering: " << attrVal;
+                RG_DEBUG << "XmlStorableEvent::XmlStorableEvent: Bad subordering: " << attrVal.toString();
             } else {
                 if (o != 0)
                     setSubOrdering(o);
             }
 
-        } else if (attrName == "duration") {
+        } else if (attrName == QLatin1String("duration")) {
 
             bool isNumeric = true;
             timeT d = attrVal.toInt(&isNumeric);
 
             if (!isNumeric) {
                 try {
-                    Note n(NotationStrings::getNoteForName(attrVal));
+                    Note n(NotationStrings::getNoteForName(attrVal.toString()));
                     setDuration(n.getDuration());
                 } catch (const NotationStrings::MalformedNoteName &m) {
-                    RG_DEBUG << "XmlStorableEvent::XmlStorableEvent: Bad duration: " << attrVal << " (" << m.getMessage() << ")";
+                    RG_DEBUG << "XmlStorableEvent::XmlStorableEvent: Bad duration: " << attrVal.toString() << " (" << m.getMessage() << ")";
                 }
             } else {
                 setDuration(d);
             }
 
-        } else if (attrName == "absoluteTime") {
+        } else if (attrName == QLatin1String("absoluteTime")) {
 
             bool isNumeric = true;
             timeT t = attrVal.toInt(&isNumeric);
 
             if (!isNumeric) {
-                RG_DEBUG << "XmlStorableEvent::XmlStorableEvent: Bad absolute time: " << attrVal;
+                RG_DEBUG << "XmlStorableEvent::XmlStorableEvent: Bad absolute time: " << attrVal.toString();
             } else {
                 absoluteTime = t;
             }
 
-        } else if (attrName == "timeOffset") {
+        } else if (attrName == QLatin1String("timeOffset")) {
 
             bool isNumeric = true;
             timeT t = attrVal.toInt(&isNumeric);
 
             if (!isNumeric) {
-                RG_DEBUG << "XmlStorableEvent::XmlStorableEvent: Bad time offset: " << attrVal;
+                RG_DEBUG << "XmlStorableEvent::XmlStorableEvent: Bad time offset: " << attrVal.toString();
             } else {
                 absoluteTime += t;
             }
@@ -104,28 +107,29 @@ XmlStorableEvent::XmlStorableEvent(const QXmlStreamAttributes &attributes,
 
             // set generic property
             //
-            QString val(attrVal);
+            const PropertyName name = names.getPropertyName(attrName);
 
             // Check if boolean val
-            QString valLowerCase(val.toLower());
-            bool isNumeric;
+            if (attrVal.compare(QLatin1String("true"),
+                                Qt::CaseInsensitive) == 0) {
+
+                set<Bool>(name, true);
 
-            if (valLowerCase == "true" || valLowerCase == "false") {
+            } else if (attrVal.compare(QLatin1String("false"),
+                                       Qt::CaseInsensitive) == 0) {
 
-                set<Bool>(static_cast<PropertyName>(qstrtostr(attrName)),
-                          valLowerCase == "true");
+                set<Bool>(name, false);
 
             } else {
 
                 // Not a bool, check if integer val
-                int numVal = val.toInt(&isNumeric);
+                bool isNumeric;
+                int numVal = attrVal.toInt(&isNumeric);
                 if (isNumeric) {
-                    set<Int>(static_cast<PropertyName>(qstrtostr(attrName)),
-                             numVal);
+                    set<Int>(name, numVal);
                 } else {
                     // not an int either, default to string
-                    set<String>(static_cast<PropertyName>(qstrtostr(attrName)),
-                                qstrtostr(attrVal));
+                    set<String>(name, attrVal.toUtf8().toStdString());
                 }
             }
         }
@@ -148,43 +152,45 @@ XmlStorableEvent::XmlStorableEvent(Event &e) :
 void
 XmlStorableEvent::setPropertyFromAttributes
 (const QXmlStreamAttributes &attributes,
- bool persistent)
+ bool persistent,
+ NameCache &names)
 {
     bool have = false;
-    QString name = attributes.value("name").toString();
-    if (name == "") {
+    const auto nameStr = attributes.value("name");
+    if (nameStr.isEmpty()) {
         RG_DEBUG << "XmlStorableEvent::setProperty: no property name found, ignoring";
         return ;
     }
+    const PropertyName name = names.getPropertyName(nameStr);
 
     for (int i = 0; i < attributes.length(); ++i) {
-        QString attrName(attributes.at(i).name().toString()),
-            attrVal(attributes.at(i).value().toString());
+        const auto attrName = attributes.at(i).name();
+        const auto attrVal = attributes.at(i).value();
 
-        if (attrName == "name") {
+        if (attrName == QLatin1String("name")) {
             continue;
         } else if (have) {
             RG_DEBUG << "XmlStorableEvent::setProperty: multiple values found, ignoring all but the first";
             continue;
-        } else if (attrName == "bool") {
-            set<Bool>(static_cast<PropertyName>(qstrtostr(name)),
-                      attrVal.toLower() == "true", persistent);
+        } else if (attrName == QLatin1String("bool")) {
+            set<Bool>(name,
+                      attrVal.compare(QLatin1String("true"),
+                                      Qt::CaseInsensitive) == 0,
+                      persistent);
             have = true;
-        } else if (attrName == "int") {
-            set<Int>(static_cast<PropertyName>(qstrtostr(name)),
-                     attrVal.toInt(), persistent);
+        } else if (attrName == QLatin1String("int")) {
+            set<Int>(name, attrVal.toInt(), persistent);
             have = true;
-        } else if (attrName == "string") {
-            set<String>(static_cast<PropertyName>(qstrtostr(name)),
-                        qstrtostr(attrVal), persistent);
+        } else if (attrName == QLatin1String("string")) {
+            set<String>(name, attrVal.toUtf8().toStdString(), persistent);
             have = true;
         } else {
-            RG_DEBUG << "XmlStorableEvent::setProperty: unknown attribute name \"" << name << "\", ignoring";
+            RG_DEBUG << "XmlStorableEvent::setProperty: unknown attribute name \"" << nameStr.toString() << "\", ignoring";
         }
     }
 
     if (!have)
-        RG_DEBUG << "XmlStorableEvent::setProperty: Warning: no property value found for property " << name;
+        RG_DEBUG << "XmlStorableEvent::setProperty: Warning: no property value found for property " << nameStr.toString();
 }
 
 }
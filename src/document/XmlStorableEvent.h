@@ -20,6 +20,13 @@
 #define RG_XMLSTORABLEEVENT_H
 
 #include "base/Event.h"
+#include "base/EventTypeName.h"
+#include "base/PropertyName.h"
+
+#include <QString>
+
+#include <utility>
+#include <vector>
 
 class QXmlStreamAttributes;
 
@@ -35,15 +42,66 @@ namespace Rosegarden
 class XmlStorableEvent : public Event
 {
 public:
+    /// Type and property names already looked up, for a parser to reuse.
+    /**
+     * Making a PropertyName or EventTypeName from a string takes the
+     * name table's lock.  A file uses the same few names over and over,
+     * and with several threads parsing segments at once they would
+     * queue for that lock on every attribute.  Each parser keeps one
+     * of these, so each name is looked up once per parser.
+     *
+     * Not thread-safe.  There are rarely more than a few dozen names,
+     * so a linear search, which needs no QString for the key, is fine.
+     */
+    class NameCache
+    {
+    public:
+        template <typename String>
+        PropertyName getPropertyName(const String &name)
+        {
+            for (const PropertyNameEntry &entry : m_propertyNames) {
+                if (entry.first == name)
+                    return entry.second;
+            }
+            m_propertyNames.push_back(PropertyNameEntry(
+                    name.toString(),
+                    PropertyName(name.toUtf8().toStdString())));
+            return m_propertyNames.back().second;
+        }
+
+        /// The reference is good until the next call.
+        template <typename String>
+        const EventTypeName &getTypeName(const String &name)
+        {
+            for (const TypeNameEntry &entry : m_typeNames) {
+                if (entry.first == name)
+                    return entry.second;
+            }
+            m_typeNames.push_back(TypeNameEntry(
+                    name.toString(),
+                    EventTypeName(name.toUtf8().toStdString())));
+            return m_typeNames.back().second;
+        }
+
+    private:
+        typedef std::pair<QString, PropertyName> PropertyNameEntry;
+        std::vector<PropertyNameEntry> m_propertyNames;
+
+        typedef std::pair<QString, EventTypeName> TypeNameEntry;
+        std::vector<TypeNameEntry> m_typeNames;
+    };
+
     /**
      * Construct an XmlStorableEvent out of the XML attributes \a atts.
      * If the attributes do not include absoluteTime, use the given
      * value plus the value of any timeOffset attribute.  If the
      * attributes include absoluteTime or timeOffset, update the given
-     * absoluteTime reference accordingly.
+     * absoluteTime reference accordingly.  Names are looked up
+     * through \a names.
      */
     XmlStorableEvent(const QXmlStreamAttributes& attributes,
-                     timeT &absoluteTime);
+                     timeT &absoluteTime,
+                     NameCache &names);
 
     /**
      * Construct an XmlStorableEvent from the specified Event.
@@ -55,7 +113,8 @@ public:
      */
     // cppcheck-suppress functionStatic
     void setPropertyFromAttributes(const QXmlStreamAttributes& attributes,
-                                   bool persistent);
+                                   bool persistent,
+                                   NameCache &names);
 };
 
 
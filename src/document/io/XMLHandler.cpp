@@ -76,4 +76,14 @@ bool XMLHandler::fatalError(int , int ,
     return true;
 }
 
+bool XMLHandler::progress(double)
+{
+    return true;
+}
+
+bool XMLHandler::deferredContent(const QByteArray &)
+{
+    return true;
+}
+
 }
@@ -18,6 +18,7 @@
 #ifndef RG_XMLHANDLER_H
 #define RG_XMLHANDLER_H
 
+#include <QByteArray>
 #include <QString>
 #include <QXmlStreamAttributes>
 #include <rosegardenprivate_export.h>
@@ -51,6 +52,22 @@ class ROSEGARDENPRIVATE_EXPORT XMLHandler
                               const QXmlStreamAttributes &atts);
     virtual bool fatalError(int lineNumber, int columnNumber,
                             const QString& msg);
+
+    /// How far through the input XMLReader has got, from 0 to 1.
+    /**
+     * Only called by XMLReader::parse(GzipFile &), between chunks.
+     * Return false to stop parsing, e.g. if the user cancelled.
+     */
+    virtual bool progress(double fraction);
+
+    /// The content of an element named by XMLReader::setDeferredElement().
+    /**
+     * Called right after startElement() for the element, with the raw
+     * UTF-8 XML between its start and end tags.  The content's own
+     * elements are not passed to startElement() and endElement().  Use
+     * XMLReader::parseContent() to parse it, now or on another thread.
+     */
+    virtual bool deferredContent(const QByteArray &content);
 };
 
 }
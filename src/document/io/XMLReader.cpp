@@ -21,14 +21,73 @@
 #include "misc/Debug.h"
 #include "document/io/XMLReader.h"
 #include "document/io/XMLHandler.h"
+#include "document/GzipFile.h"
 
 #include <QXmlStreamReader>
 #include <QFile>
 
+#include <algorithm>
+
+namespace
+{
+    // Uncompressed bytes per read.  Also how often the handler hears
+    // about progress.
+    constexpr int a_chunkSize = 256 * 1024;
+
+    // The end of the name in a start or end tag.
+    bool isNameEnd(char c)
+    {
+        return (c == '>'  ||  c == '/'  ||  c == ' '  ||  c == '\t'  ||
+                c == '\n'  ||  c == '\r');
+    }
+
+    // Find the '>' that ends the tag starting at from, skipping over
+    // quoted attribute values, which may contain '>'.  Returns -1 if
+    // data ends first.
+    int findTagEnd(const QByteArray &data, int from)
+    {
+        char quote = 0;
+
+        for (int i = from; i < data.size(); ++i) {
+            const char c = data.at(i);
+            if (quote) {
+                if (c == quote)
+                    quote = 0;
+            } else if (c == '"'  ||  c == '\'') {
+                quote = c;
+            } else if (c == '>') {
+                return i;
+            }
+        }
+
+        return -1;
+    }
+
+    // Find "tag" followed by the end of a name.  Returns -1 if there
+    // isn't one, or if one might continue past the end of data.
+    int findTag(const QByteArray &data, const QByteArray &tag, int from)
+    {
+        int i = data.indexOf(tag, from);
+
+        while (i >= 0) {
+            const int next = i + tag.size();
+            if (next >= data.size())
+                return -1;
+            if (isNameEnd(data.at(next)))
+                return i;
+            i = data.indexOf(tag, i + 1);
+        }
+
+        return -1;
+    }
+}
+
 namespace Rosegarden
 {
 
-XMLReader::XMLReader()
+XMLReader::XMLReader() :
+    m_inDeferred(false),
+    m_searchFrom(0)
 {
     m_handler = nullptr;
 }
@@ -38,13 +97,27 @@ void XMLReader::setHandler(XMLHandler* handler)
     m_handler = handler;
 }
 
+void XMLReader::setDeferredElement(const QString &name)
+{
+    if (name.isEmpty()) {
+        m_deferredStartTag.clear();
+        m_deferredEndTag.clear();
+        return;
+    }
+
+    m_deferredStartTag = "<" + name.toUtf8();
+    m_deferredEndTag = "</" + name.toUtf8();
+}
+
 bool XMLReader::parse(const QString& xmlString)
 {
     if (! m_handler) return false;
     QXmlStreamReader xml;
     xml.addData(xmlString);
 
-    return doParse(xml);
+    m_characters.clear();
+
+    return finish(xml, readTokens(xml, false));
 }
 
 bool XMLReader::parse(QFile& xmlFile)
@@ -57,30 +130,177 @@ bool XMLReader::parse(QFile& xmlFile)
     QXmlStreamReader xml;
     xml.setDevice(&xmlFile);
 
-    return doParse(xml);
+    m_characters.clear();
+
+    return finish(xml, readTokens(xml, false));
 }
 
-bool XMLReader::doParse(QXmlStreamReader& reader)
+bool XMLReader::parse(GzipFile &file)
 {
+    if (! m_handler) return false;
+
+    QXmlStreamReader xml;
+
+    m_inDeferred = false;
+    m_searchFrom = 0;
+    m_characters.clear();
+
+    // Data read but not yet given to xml.
+    QByteArray pending;
+
+    bool ok = true;
+
+    while (ok) {
+        const QByteArray chunk = file.read(a_chunkSize);
+        const bool atEnd = chunk.isEmpty();
+
+        pending.append(chunk);
+        ok = feed(xml, pending, atEnd);
+
+        if (atEnd)
+            break;
+
+        if (ok)
+            ok = m_handler->progress(file.getProgress());
+    }
+
+    if (ok  &&  file.hasError()) {
+        m_handler->fatalError(xml.lineNumber(), xml.columnNumber(),
+                              "Could not decompress file");
+        return false;
+    }
+
+    return finish(xml, ok);
+}
+
+bool XMLReader::parseContent(const QByteArray &content)
+{
+    if (! m_handler) return false;
+
+    // The reader wants a single root element.  readTokens() leaves it out.
+    QXmlStreamReader xml;
+    xml.addData(QByteArray("<content>"));
+    xml.addData(content);
+    xml.addData(QByteArray("</content>"));
+
+    m_characters.clear();
+
+    return finish(xml, readTokens(xml, true));
+}
+
+bool XMLReader::feed(QXmlStreamReader &reader, QByteArray &pending,
+                     bool atEnd)
+{
+    if (m_deferredStartTag.isEmpty()) {
+        reader.addData(pending);
+        pending.clear();
+        return readTokens(reader, false);
+    }
+
+    while (true) {
+
+        if (m_inDeferred) {
+            const int end = findTag(pending, m_deferredEndTag, m_searchFrom);
+
+            if (end < 0) {
+                if (atEnd) {
+                    // No end tag.  Let the reader find the error.
+                    m_inDeferred = false;
+                    reader.addData(pending);
+                    pending.clear();
+                    return readTokens(reader, false);
+                }
+
+                // Wait for more.  Don't search the same data again.
+                m_searchFrom = std::max(
+                        0, pending.size() - m_deferredEndTag.size());
+                return true;
+            }
+
+            if (!m_handler->deferredContent(pending.left(end)))
+                return false;
+
+            // The end tag goes to the reader as usual.
+            pending.remove(0, end);
+            m_inDeferred = false;
+            m_searchFrom = 0;
+
+            continue;
+        }
+
+        const int start = findTag(pending, m_deferredStartTag, 0);
+        const int close = (start < 0) ? -1 :
+                findTagEnd(pending, start + m_deferredStartTag.size());
+
+        if (close < 0) {
+            // Everything up to where a start tag might be can go.
+            int keep = 0;
+            if (!atEnd) {
+                keep = (start < 0) ?
+                        std::min(pending.size(), m_deferredStartTag.size()) :
+                        pending.size() - start;
+            }
+
+            reader.addData(pending.left(pending.size() - keep));
+            pending.remove(0, pending.size() - keep);
+
+            return readTokens(reader, false);
+        }
+
+        // Give the reader the start tag, so the handler has seen it
+        // before it gets the content.
+        const bool empty = (pending.at(close - 1) == '/');
+        reader.addData(pending.left(close + 1));
+        pending.remove(0, close + 1);
+
+        if (!readTokens(reader, false))
+            return false;
+
+        if (!empty) {
+            m_inDeferred = true;
+            m_searchFrom = 0;
+        }
+    }
+}
+
+bool XMLReader::readTokens(QXmlStreamReader& reader, bool content)
+{
+    // For content, the depth below the root element.
+    int depth = 0;
+
     bool ok = true;
     while (ok  &&  !reader.atEnd()) {
         QXmlStreamReader::TokenType token = reader.readNext();
+
+        // Invalid is also what we get when a chunk runs out part way
+        // through some text.
+        if (token != QXmlStreamReader::Characters  &&
+            token != QXmlStreamReader::Invalid) {
+            ok = flushCharacters();
+            if (!ok)
+                break;
+        }
+
         // Silence gcc compiler warnings due to the switches below not covering all cases, on purpose
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wswitch-enum"
         switch (token) {
         case QXmlStreamReader::StartDocument:
             {
-                ok = m_handler->startDocument();
+                if (!content)
+                    ok = m_handler->startDocument();
             }
             break;
         case QXmlStreamReader::EndDocument:
             {
-                ok = m_handler->endDocument();
+                if (!content)
+                    ok = m_handler->endDocument();
             }
             break;
         case QXmlStreamReader::StartElement:
             {
+                if (content  &&  depth++ == 0)
+                    break;
                 ok = m_handler->startElement(reader.namespaceUri().toString(),
                                              reader.name().toString(),
                                              reader.qualifiedName().toString(),
@@ -89,6 +309,8 @@ bool XMLReader::doParse(QXmlStreamReader& reader)
             break;
         case QXmlStreamReader::EndElement:
             {
+                if (content  &&  --depth == 0)
+                    break;
                 ok = m_handler->endElement(reader.namespaceUri().toString(),
                                            reader.name().toString(),
                                            reader.qualifiedName().toString());
@@ -96,7 +318,7 @@ bool XMLReader::doParse(QXmlStreamReader& reader)
             break;
         case QXmlStreamReader::Characters:
             {
-                ok = m_handler->characters(reader.text().toString());
+                m_characters.append(reader.text());
             }
             break;
         default:
@@ -107,14 +329,30 @@ bool XMLReader::doParse(QXmlStreamReader& reader)
         }
 #pragma GCC diagnostic pop
     }
-    
+
+    return ok;
+}
+
+bool XMLReader::flushCharacters()
+{
+    if (m_characters.isEmpty())
+        return true;
+
+    const bool ok = m_handler->characters(m_characters);
+    m_characters.clear();
+
+    return ok;
+}
+
+bool XMLReader::finish(QXmlStreamReader& reader, bool ok)
+{
     if (! ok) {
         qDebug() << m_handler->errorString();
-    }
-    if (reader.hasError()) {
+    } else if (reader.hasError()) {
         RG_DEBUG << "error";
-        m_handler->fatalError(reader.lineNumber(), reader.columnNumber(),
-                              reader.errorString());
+        ok = m_handler->fatalError(reader.lineNumber(),
+                                   reader.columnNumber(),
+                                   reader.errorString());
     }
     return ok;
 }
@@ -21,12 +21,14 @@
 class QFile;
 class QXmlStreamReader;
 
+#include <QByteArray>
 #include <QString>
 #include <rosegardenprivate_export.h>
 
 namespace Rosegarden
 {
 
+class GzipFile;
 class XMLHandler;
 
 /**
@@ -43,17 +45,73 @@ class ROSEGARDENPRIVATE_EXPORT XMLReader
     /// set the (SAX like) handler for processing the XML elements
     void setHandler(XMLHandler* handler);
 
+    /// Pass the content of elements with this name to the handler unparsed.
+    /**
+     * Only parse(GzipFile &) does this.  See
+     * XMLHandler::deferredContent().  The content is found by looking
+     * for the start and end tags in the raw UTF-8, so these elements
+     * must not nest, or appear in comments or CDATA sections.
+     */
+    void setDeferredElement(const QString &name);
+
     /// Parse the give string containing XML
     bool parse(const QString& xmlString);
 
     /// parse the XML file
     bool parse(QFile& xmlFile);
-    
+
+    /// Parse a gzipped XML file, decompressing a chunk at a time.
+    /**
+     * The whole file is never in memory.  The handler's progress() is
+     * called between chunks.
+     */
+    bool parse(GzipFile &file);
+
+    /// Parse the content of an element.
+    /**
+     * E.g. from XMLHandler::deferredContent().  The handler gets the
+     * elements in content but not startDocument() or endDocument().
+     */
+    bool parseContent(const QByteArray &content);
+
  private:
     XMLHandler* m_handler;
 
-    /// do the work
-    bool doParse(QXmlStreamReader& reader);
+    /// "<name" and "</name" for setDeferredElement().
+    QByteArray m_deferredStartTag;
+    QByteArray m_deferredEndTag;
+
+    /// We're between a deferred element's start and end tags.
+    bool m_inDeferred;
+    /// Where to continue looking for the deferred element's end tag.
+    int m_searchFrom;
+
+    /// Text read but not yet passed to the handler's characters().
+    /**
+     * When the data arrives a chunk at a time, text can be split across
+     * chunks.  We pass it on in one piece.
+     */
+    QString m_characters;
+
+    /// Hand the data in pending to the reader, cutting out deferred content.
+    /**
+     * Anything that might be the start of a tag that continues in the
+     * next chunk is left in pending, unless atEnd.
+     */
+    bool feed(QXmlStreamReader &reader, QByteArray &pending, bool atEnd);
+
+    /// Pass the tokens read so far to the handler.
+    /**
+     * Stops at the end of the data the reader has been given.  With
+     * content, the document and the outermost element aren't passed on.
+     * See parseContent().
+     */
+    bool readTokens(QXmlStreamReader &reader, bool content);
+
+    bool flushCharacters();
+
+    /// Report any error once everything has been read.
+    bool finish(QXmlStreamReader &reader, bool ok);
 };
  
 }
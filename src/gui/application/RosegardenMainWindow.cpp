@@ -104,6 +104,7 @@
 #include "gui/dialogs/AddTracksDialog.h"
 #include "gui/dialogs/AboutDialog.h"
 #include "gui/dialogs/AudioManagerDialog.h"
+#include "gui/dialogs/AudioPerformanceDialog.h"
 #include "gui/dialogs/AudioPluginDialog.h"
 #include "gui/dialogs/AudioSplitDialog.h"
 #include "gui/dialogs/BeatsBarsDialog.h"
@@ -289,6 +290,7 @@ RosegardenMainWindow::RosegardenMainWindow(bool enableSound,
     m_playList(nullptr),
     m_synthManager(nullptr),
     m_audioMixerWindow2(),
+    m_audioPerformanceDialog(),
     m_midiMixer(nullptr),
     m_bankEditor(nullptr),
     m_markerEditor(nullptr),
@@ -850,6 +852,7 @@ RosegardenMainWindow::setupActions()
     createAction("remap_instruments", SLOT(slotRemapInstruments()));
     createAction("audio_mixer", SLOT(slotOpenAudioMixer()));
     createAction("midi_mixer", SLOT(slotOpenMidiMixer()));
+    createAction("audio_performance", SLOT(slotOpenAudioPerformance()));
     createAction("manage_midi_devices", SLOT(slotManageMIDIDevices()));
     createAction("manage_synths", SLOT(slotManageSynths()));
     createAction("modify_midi_filters", SLOT(slotModifyMIDIFilters()));
@@ -1255,6 +1258,13 @@ RosegardenMainWindow::setDocument(RosegardenDocument *newDocument)
                 &RosegardenDocument::loopChanged,
             this, &RosegardenMainWindow::slotLoopChanged);
 
+    connect(&RosegardenDocument::currentDocument->getAudioFileManager(),
+                &AudioFileManager::resamplingProgress,
+            this, &RosegardenMainWindow::slotResamplingProgress);
+    connect(&RosegardenDocument::currentDocument->getAudioFileManager(),
+                &AudioFileManager::resamplingFinished,
+            this, &RosegardenMainWindow::slotResamplingFinished);
+
 //    CommandHistory::getInstance()->attachView(actionCollection());        //&&& needed ? how to ?
 
     connect(CommandHistory::getInstance(), &CommandHistory::commandExecuted,
@@ -3741,6 +3751,18 @@ RosegardenMainWindow::slotStatusHelpMsg(QString text)
     statusBar()->showMessage(text, 2000);
 }
 
+void
+RosegardenMainWindow::slotResamplingProgress(int percent)
+{
+    slotStatusMsg(tr("Resampling audio files... %1%").arg(percent));
+}
+
+void
+RosegardenMainWindow::slotResamplingFinished()
+{
+    statusBar()->clearMessage();
+}
+
 void
 RosegardenMainWindow::slotEnableTransport(bool enable)
 {
@@ -6976,6 +6998,20 @@ RosegardenMainWindow::slotOpenAudioMixer()
     return;
 }
 
+void
+RosegardenMainWindow::slotOpenAudioPerformance()
+{
+    if (m_audioPerformanceDialog) {
+        m_audioPerformanceDialog->activateWindow();
+        m_audioPerformanceDialog->raise();
+        return;
+    }
+
+    // Deletes itself on close.
+    m_audioPerformanceDialog = new AudioPerformanceDialog(this);
+    m_audioPerformanceDialog->show();
+}
+
 void
 RosegardenMainWindow::slotOpenMidiMixer()
 {
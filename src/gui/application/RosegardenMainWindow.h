@@ -88,6 +88,7 @@ class AudioPluginGUIManager;
 class AudioPluginManager;
 class AudioPluginDialog;
 class AudioMixerWindow2;
+class AudioPerformanceDialog;
 class AudioManagerDialog;
 class EditTempoController;
 class SequencerThread;
@@ -937,6 +938,11 @@ public slots:
     void slotOpenAudioMixer();
     void slotOpenMidiMixer();
 
+    /**
+     * Show the audio performance counters
+     */
+    void slotOpenAudioPerformance();
+
     /**
      * Edit Banks/Programs
      */
@@ -1062,6 +1068,10 @@ public slots:
      */
     void slotStatusHelpMsg(QString text);
 
+    /// Show AudioFileManager::resampleFiles() progress in the statusbar.
+    void slotResamplingProgress(int percent);
+    void slotResamplingFinished();
+
     /**
      * enables/disables the transport window
      */
@@ -1615,6 +1625,7 @@ private:
     PlayListDialog        *m_playList;
     SynthPluginManagerDialog *m_synthManager;
     QPointer<AudioMixerWindow2> m_audioMixerWindow2;
+    QPointer<AudioPerformanceDialog> m_audioPerformanceDialog;
     MidiMixerWindow       *m_midiMixer;
     BankEditorDialog      *m_bankEditor;
     MarkerEditor          *m_markerEditor;
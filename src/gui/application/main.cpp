@@ -29,6 +29,7 @@
 #include "misc/Preferences.h"
 
 #include "sound/MidiFile.h"
+#include "sound/OfflineRenderer.h"
 #include "sound/audiostream/WavFileReadStream.h"
 #include "sound/audiostream/WavFileWriteStream.h"
 #include "sound/audiostream/OggVorbisReadStream.h"
@@ -40,6 +41,7 @@
 #include <QSettings>
 #include <QMessageBox>
 #include <QDir>
+#include <QElapsedTimer>
 #include <QFile>
 #include <QTranslator>
 #include <QLocale>
@@ -340,6 +342,7 @@ static void usage()
     std::cerr << "Rosegarden: A sequencer and musical notation editor\n";
     std::cerr << "Usage: rosegarden [--nosplash] [--nosound] [file.rg]\n";
     std::cerr << "       rosegarden --convert source.rg dest.mid\n";
+    std::cerr << "       rosegarden --render source.rg dest.wav [stemdir]\n";
     std::cerr << "       rosegarden --version\n";
     exit(2);
 }
@@ -382,6 +385,68 @@ static void convert(const QStringList &args)
     exit(0);
 }
 
+static void render(const QStringList &args)
+{
+    if (args.size() < 4)
+        usage();
+
+    QString inFile  = args[2];
+    QString outFile = args[3];
+    QString stemDir = (args.size() > 4 ? args[4] : QString());
+
+    std::cout << "Rendering \"" << inFile << "\" to \"" << outFile << "\"\n";
+
+    RosegardenDocument doc(
+            nullptr,  // parent
+            {},  // audioPluginManager
+            true,  // skipAutoload
+            true,  // clearCommandHistory
+            false);  // m_useSequencer
+
+    RosegardenDocument::currentDocument = &doc;
+
+    bool ok;
+
+    ok = doc.openDocument(
+            inFile,
+            false,  // permanent
+            true,  // squelchProgressDialog
+            false);  // enableLock
+    if (!ok) {
+        std::cerr << "Error opening rg file: " << inFile << "\n";
+        exit(1);
+    }
+
+    // There's no JACK to take the rate from.
+    OfflineRenderer renderer(48000);
+
+    if (stemDir != "") {
+        QDir().mkpath(stemDir);
+
+        // One file for each audio or synth instrument that has a track.
+        renderer.addStems(&doc, stemDir);
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    ok = renderer.render(&doc, outFile);
+    if (!ok) {
+        std::cerr << "Error rendering: " << renderer.getError() << "\n";
+        exit(1);
+    }
+
+    const double seconds = double(renderer.getFramesRendered()) /
+            renderer.getSampleRate();
+    const double elapsed = double(timer.elapsed()) / 1000;
+    std::cout << "Rendered " << seconds << "s in " << elapsed << "s";
+    if (elapsed > 0)
+        std::cout << " (" << seconds / elapsed << "x real time)";
+    std::cout << "\n";
+
+    exit(0);
+}
+
 int main(int argc, char *argv[])
 {
 
@@ -529,6 +594,7 @@ int main(int argc, char *argv[])
             if (args[i] == "--nosplash") nosplash = true;
             else if (args[i] == "--nosound") nosound = true;
             else if (args[i] == "--convert") convert(args);
+            else if (args[i] == "--render") render(args);
             else usage();
         } else {
             ++nonOptArgs;
@@ -18,6 +18,8 @@
 
 #include "AudioConfigurationPage.h"
 
+#include "sound/AudioCache.h"
+#include "sound/AudioFileManager.h"
 #include "sound/Midi.h"
 #include "sound/SoundDriver.h"
 #include "misc/ConfigGroups.h"
@@ -269,6 +271,58 @@ AudioConfigurationPage::AudioConfigurationPage(
     layout->addWidget(m_outOfProcessorPower, row, 1);
     ++row;
 
+    layout->addWidget(
+            new QLabel(tr("Audio mixer threads"), frame),
+            row, 0);
+    m_mixerThreads = new QSpinBox(frame);
+    m_mixerThreads->setRange(0, 32);
+    m_mixerThreads->setSpecialValueText(tr("Automatic"));
+    m_mixerThreads->setToolTip(tr(
+            "<qt><p>Number of threads used to process audio and synth "
+            "instruments and their plugins.  Automatic uses one per "
+            "processor core.</p><p>Takes effect the next time "
+            "Rosegarden starts.</p></qt>"));
+    m_mixerThreads->setValue(Preferences::getAudioMixerThreads());
+    connect(m_mixerThreads,
+                static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+            this, &AudioConfigurationPage::slotModified);
+    layout->addWidget(m_mixerThreads, row, 1);
+    ++row;
+
+    layout->addWidget(
+            new QLabel(tr("Audio file cache"), frame),
+            row, 0);
+    m_audioCacheSize = new QSpinBox(frame);
+    m_audioCacheSize->setRange(16, 16384);
+    m_audioCacheSize->setSingleStep(64);
+    m_audioCacheSize->setSuffix(tr(" MB"));
+    m_audioCacheSize->setToolTip(tr(
+            "<qt><p>Memory used to keep audio files that have been "
+            "played, so that they don't need to be read from disk "
+            "again.</p></qt>"));
+    m_audioCacheSize->setValue(Preferences::getAudioCacheSize());
+    connect(m_audioCacheSize,
+                static_cast<void(QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+            this, &AudioConfigurationPage::slotModified);
+    layout->addWidget(m_audioCacheSize, row, 1);
+    ++row;
+
+    layout->addWidget(
+            new QLabel(tr("Keep resampled copies of audio files"), frame),
+            row, 0);
+    m_resampleAudioFiles = new QCheckBox(frame);
+    m_resampleAudioFiles->setToolTip(tr(
+            "<qt><p>When an audio file's sample rate differs from JACK's, "
+            "make a copy at JACK's rate in the background and play that "
+            "instead, so that the file doesn't need to be converted each "
+            "time it plays.  The copies are kept next to the original "
+            "files.</p></qt>"));
+    m_resampleAudioFiles->setChecked(Preferences::getResampleAudioFiles());
+    connect(m_resampleAudioFiles, &QCheckBox::stateChanged,
+            this, &AudioConfigurationPage::slotModified);
+    layout->addWidget(m_resampleAudioFiles, row, 1);
+    ++row;
+
 #endif
 
     layout->setRowStretch(row, 10);
@@ -302,6 +356,22 @@ AudioConfigurationPage::apply()
     settings.endGroup();
 
     Preferences::setJACKLoadCheck(m_outOfProcessorPower->isChecked());
+    Preferences::setAudioMixerThreads(m_mixerThreads->value());
+    Preferences::setAudioCacheSize(m_audioCacheSize->value());
+    AudioCache::getInstance()->setMemoryBudget(
+            size_t(m_audioCacheSize->value()) * 1024 * 1024);
+
+    if (m_resampleAudioFiles->isChecked() !=
+            Preferences::getResampleAudioFiles()) {
+        Preferences::setResampleAudioFiles(m_resampleAudioFiles->isChecked());
+
+        AudioFileManager &audioFileManager =
+                RosegardenDocument::currentDocument->getAudioFileManager();
+        if (m_resampleAudioFiles->isChecked())
+            audioFileManager.resampleFiles();
+        else
+            audioFileManager.stopResampling();
+    }
 #endif
 
     settings.beginGroup( GeneralOptionsConfigGroup );
@@ -93,6 +93,9 @@ private:
 
     QCheckBox *m_autoStartJackServer;
     QCheckBox *m_outOfProcessorPower;
+    QSpinBox *m_mixerThreads;
+    QSpinBox *m_audioCacheSize;
+    QCheckBox *m_resampleAudioFiles;
 
     //QCheckBox *m_startJack;
     //LineEdit  *m_jackPath;
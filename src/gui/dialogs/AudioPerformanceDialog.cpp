@@ -0,0 +1,356 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[AudioPerformanceDialog]"
+
+#include "AudioPerformanceDialog.h"
+
+#include "base/Instrument.h"
+#include "base/Studio.h"
+#include "document/RosegardenDocument.h"
+#include "gui/widgets/FileDialog.h"
+#include "sound/AudioCache.h"
+#include "sound/SequencerDataBlock.h"
+#include "misc/Debug.h"
+
+#include <QDialogButtonBox>
+#include <QFile>
+#include <QFileInfo>
+#include <QGridLayout>
+#include <QGroupBox>
+#include <QHeaderView>
+#include <QLabel>
+#include <QMessageBox>
+#include <QPushButton>
+#include <QTableWidget>
+#include <QTableWidgetItem>
+#include <QTextStream>
+#include <QTimer>
+#include <QVBoxLayout>
+
+
+namespace Rosegarden
+{
+
+
+namespace
+{
+    // Columns in m_instruments before and after the plugins.
+    constexpr int a_firstPluginColumn = 4;
+    constexpr int a_underrunsColumn =
+            a_firstPluginColumn + PluginContainer::PLUGIN_COUNT;
+
+    QString quoteCSV(const QString &text)
+    {
+        QString quoted = text;
+        quoted.replace("\"", "\"\"");
+        return "\"" + quoted + "\"";
+    }
+
+    void setCell(QTableWidget *table, int row, int column, const QString &text)
+    {
+        QTableWidgetItem *item = table->item(row, column);
+        if (!item) {
+            item = new QTableWidgetItem;
+            item->setFlags(Qt::ItemIsEnabled);
+            if (column > 0)
+                item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+            table->setItem(row, column, item);
+        }
+        item->setText(text);
+    }
+}
+
+AudioPerformanceDialog::AudioPerformanceDialog(QWidget *parent) :
+        QDialog(parent)
+{
+    setModal(false);
+    setAttribute(Qt::WA_DeleteOnClose);
+    setWindowTitle(tr("Audio Performance"));
+
+    QVBoxLayout *layout = new QVBoxLayout;
+    setLayout(layout);
+
+    // JACK process callback
+
+    QGroupBox *periodBox = new QGroupBox(tr("JACK process callback"));
+    QGridLayout *periodLayout = new QGridLayout;
+    periodBox->setLayout(periodLayout);
+    layout->addWidget(periodBox);
+
+    int row = 0;
+
+    auto addCounter = [&row](QGridLayout *grid, const QString &name,
+                             int column) -> QLabel * {
+        grid->addWidget(new QLabel(name), row, column);
+        QLabel *value = new QLabel;
+        value->setAlignment(Qt::AlignRight | Qt::AlignVCenter);
+        grid->addWidget(value, row, column + 1);
+        return value;
+    };
+
+    m_periods = addCounter(periodLayout, tr("Periods"), 0);
+    m_xruns = addCounter(periodLayout, tr("XRuns"), 2);
+    ++row;
+    m_budget = addCounter(periodLayout, tr("Period length"), 0);
+    m_mixUnderruns = addCounter(periodLayout, tr("Instrument underruns"), 2);
+    ++row;
+    m_longest = addCounter(periodLayout, tr("Longest period"), 0);
+    m_bussMixUnderruns = addCounter(periodLayout, tr("Buss underruns"), 2);
+    ++row;
+    m_deadlineMisses = addCounter(periodLayout, tr("Deadline misses"), 0);
+
+    periodLayout->setColumnMinimumWidth(2, 40);
+
+    m_histogram = new QTableWidget(SEQUENCER_DATABLOCK_PERIOD_BUCKETS, 2);
+    m_histogram->setHorizontalHeaderLabels(
+            QStringList() << tr("Time taken") << tr("Periods"));
+    m_histogram->horizontalHeader()->setStretchLastSection(true);
+    m_histogram->verticalHeader()->hide();
+    for (int bucket = 0; bucket < SEQUENCER_DATABLOCK_PERIOD_BUCKETS; ++bucket) {
+        setCell(m_histogram, bucket, 0, bucketName(bucket));
+    }
+    periodLayout->addWidget(m_histogram, ++row, 0, 1, 4);
+
+    // Audio file cache
+
+    QGroupBox *cacheBox = new QGroupBox(tr("Audio file cache"));
+    QGridLayout *cacheLayout = new QGridLayout;
+    cacheBox->setLayout(cacheLayout);
+    layout->addWidget(cacheBox);
+
+    row = 0;
+    m_cacheHits = addCounter(cacheLayout, tr("Hits"), 0);
+    m_cacheMisses = addCounter(cacheLayout, tr("Misses"), 2);
+    ++row;
+    m_cacheSize = addCounter(cacheLayout, tr("Size"), 0);
+    m_cacheEvictions = addCounter(cacheLayout, tr("Evictions"), 2);
+
+    cacheLayout->setColumnMinimumWidth(2, 40);
+
+    // Instruments
+
+    QGroupBox *instrumentBox = new QGroupBox(tr("Instruments"));
+    QVBoxLayout *instrumentLayout = new QVBoxLayout;
+    instrumentBox->setLayout(instrumentLayout);
+    layout->addWidget(instrumentBox);
+
+    QStringList headers;
+    headers << tr("Instrument") << tr("Total (us)") << tr("Peak (us)")
+            << tr("Synth (us)");
+    for (unsigned i = 0; i < PluginContainer::PLUGIN_COUNT; ++i) {
+        headers << tr("Plugin %1 (us)").arg(i + 1);
+    }
+    headers << tr("Underruns");
+
+    m_instruments = new QTableWidget(0, headers.size());
+    m_instruments->setHorizontalHeaderLabels(headers);
+    m_instruments->verticalHeader()->hide();
+    m_instruments->setMinimumWidth(600);
+    instrumentLayout->addWidget(m_instruments);
+
+    QDialogButtonBox *buttonBox = new QDialogButtonBox(QDialogButtonBox::Close);
+    QPushButton *resetButton =
+            buttonBox->addButton(tr("Reset"), QDialogButtonBox::ResetRole);
+    QPushButton *exportButton =
+            buttonBox->addButton(tr("Export CSV..."),
+                                 QDialogButtonBox::ActionRole);
+    layout->addWidget(buttonBox);
+
+    connect(resetButton, &QAbstractButton::clicked,
+            this, &AudioPerformanceDialog::slotReset);
+    connect(exportButton, &QAbstractButton::clicked,
+            this, &AudioPerformanceDialog::slotExport);
+    connect(buttonBox, &QDialogButtonBox::rejected, this, &QDialog::reject);
+
+    m_updateTimer = new QTimer(this);
+    connect(m_updateTimer, &QTimer::timeout,
+            this, &AudioPerformanceDialog::slotUpdate);
+    m_updateTimer->start(500);
+
+    slotUpdate();
+}
+
+QString
+AudioPerformanceDialog::bucketName(int bucket)
+{
+    if (bucket == SEQUENCER_DATABLOCK_PERIOD_BUCKETS - 1)
+        return tr("%1% or more").arg(bucket * 10);
+    return tr("%1-%2%").arg(bucket * 10).arg(bucket * 10 + 10);
+}
+
+QString
+AudioPerformanceDialog::instrumentName(InstrumentId id)
+{
+    RosegardenDocument *document = RosegardenDocument::currentDocument;
+    if (document) {
+        const Instrument *instrument =
+                document->getStudio().getInstrumentById(id);
+        if (instrument)
+            return instrument->getLocalizedPresentationName();
+    }
+
+    return QString::number(id);
+}
+
+void
+AudioPerformanceDialog::slotUpdate()
+{
+    SequencerDataBlock *dataBlock = SequencerDataBlock::getInstance();
+
+    PeriodPerformance period;
+    dataBlock->getPeriodPerformance(period);
+
+    m_periods->setText(QString::number(period.periods));
+    m_budget->setText(tr("%1 us").arg(period.budgetUsec));
+    m_longest->setText(tr("%1 us").arg(period.maxUsec));
+    m_deadlineMisses->setText(QString::number(period.deadlineMisses));
+    m_xruns->setText(QString::number(period.xruns));
+    m_mixUnderruns->setText(QString::number(period.mixUnderruns));
+    m_bussMixUnderruns->setText(QString::number(period.bussMixUnderruns));
+
+    for (int bucket = 0; bucket < SEQUENCER_DATABLOCK_PERIOD_BUCKETS; ++bucket) {
+        setCell(m_histogram, bucket, 1,
+                QString::number(period.histogram[bucket]));
+    }
+
+    const AudioCache::Statistics cache =
+            AudioCache::getInstance()->getStatistics();
+
+    m_cacheHits->setText(QString::number(cache.hits));
+    m_cacheMisses->setText(QString::number(cache.misses));
+    m_cacheEvictions->setText(QString::number(cache.evictions));
+    m_cacheSize->setText(tr("%1 of %2 MB")
+            .arg(double(cache.bytes) / (1024 * 1024), 0, 'f', 1)
+            .arg(cache.budget / (1024 * 1024)));
+
+    const int count = dataBlock->getInstrumentPerformanceCount();
+    m_instruments->setRowCount(count);
+
+    for (int row = 0; row < count; ++row) {
+        InstrumentPerformance info;
+        dataBlock->getInstrumentPerformance(row, info);
+
+        setCell(m_instruments, row, 0, instrumentName(info.id));
+        setCell(m_instruments, row, 1, QString::number(info.usec));
+        setCell(m_instruments, row, 2, QString::number(info.peakUsec));
+        setCell(m_instruments, row, 3, QString::number(info.synthUsec));
+        for (unsigned i = 0; i < PluginContainer::PLUGIN_COUNT; ++i) {
+            setCell(m_instruments, row, a_firstPluginColumn + i,
+                    QString::number(info.pluginUsec[i]));
+        }
+        setCell(m_instruments, row, a_underrunsColumn,
+                QString::number(info.underruns));
+    }
+}
+
+void
+AudioPerformanceDialog::slotReset()
+{
+    SequencerDataBlock::getInstance()->resetPerformanceCounters();
+    AudioCache::getInstance()->resetStatistics();
+    slotUpdate();
+}
+
+void
+AudioPerformanceDialog::writeCSV(QTextStream &out) const
+{
+    SequencerDataBlock *dataBlock = SequencerDataBlock::getInstance();
+
+    PeriodPerformance period;
+    dataBlock->getPeriodPerformance(period);
+
+    out << "periods,budget_usec,max_usec,deadline_misses,xruns,"
+           "mix_underruns,buss_mix_underruns\n";
+    out << period.periods << ',' << period.budgetUsec << ','
+        << period.maxUsec << ',' << period.deadlineMisses << ','
+        << period.xruns << ',' << period.mixUnderruns << ','
+        << period.bussMixUnderruns << '\n';
+
+    out << '\n' << "from_percent,to_percent,periods\n";
+    for (int bucket = 0; bucket < SEQUENCER_DATABLOCK_PERIOD_BUCKETS; ++bucket) {
+        out << bucket * 10 << ',';
+        // The last bucket is open ended.
+        if (bucket < SEQUENCER_DATABLOCK_PERIOD_BUCKETS - 1)
+            out << bucket * 10 + 10;
+        out << ',' << period.histogram[bucket] << '\n';
+    }
+
+    const AudioCache::Statistics cache =
+            AudioCache::getInstance()->getStatistics();
+
+    out << '\n' << "cache_hits,cache_misses,cache_evictions,cache_blocks,"
+                  "cache_bytes,cache_budget_bytes\n";
+    out << cache.hits << ',' << cache.misses << ',' << cache.evictions << ','
+        << cache.blocks << ',' << qulonglong(cache.bytes) << ','
+        << qulonglong(cache.budget) << '\n';
+
+    out << '\n' << "instrument_id,instrument,usec,peak_usec,synth_usec";
+    for (unsigned i = 0; i < PluginContainer::PLUGIN_COUNT; ++i) {
+        out << ",plugin" << i + 1 << "_usec";
+    }
+    out << ",underruns\n";
+
+    const int count = dataBlock->getInstrumentPerformanceCount();
+    for (int row = 0; row < count; ++row) {
+        InstrumentPerformance info;
+        dataBlock->getInstrumentPerformance(row, info);
+
+        out << info.id << ',' << quoteCSV(instrumentName(info.id)) << ','
+            << info.usec << ',' << info.peakUsec << ',' << info.synthUsec;
+        for (unsigned i = 0; i < PluginContainer::PLUGIN_COUNT; ++i) {
+            out << ',' << info.pluginUsec[i];
+        }
+        out << ',' << info.underruns << '\n';
+    }
+}
+
+void
+AudioPerformanceDialog::slotExport()
+{
+    // Last directory we exported to.
+    static QString lastExportDirectory;
+
+    QString name = FileDialog::getSaveFileName(
+            this,  // parent
+            tr("Export Audio Performance"),  // caption
+            lastExportDirectory,  // dir
+            "",  // defaultName
+            tr("CSV files") + " (*.csv)");  // filter
+
+    if (name.isEmpty())
+        return;
+
+    if (!name.endsWith(".csv", Qt::CaseInsensitive))
+        name += ".csv";
+
+    QFile file(name);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        QMessageBox::warning(this, tr("Rosegarden"),
+                             tr("Could not open file %1 for writing.")
+                                     .arg(name));
+        return;
+    }
+
+    lastExportDirectory = QFileInfo(name).absolutePath();
+
+    QTextStream out(&file);
+    writeCSV(out);
+
+    RG_DEBUG << "slotExport(): wrote" << name;
+}
+
+
+}
@@ -0,0 +1,85 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_AUDIOPERFORMANCEDIALOG_H
+#define RG_AUDIOPERFORMANCEDIALOG_H
+
+#include "base/Instrument.h"  // InstrumentId
+
+#include <QDialog>
+
+class QLabel;
+class QTableWidget;
+class QTextStream;
+class QTimer;
+class QWidget;
+
+
+namespace Rosegarden
+{
+
+
+/// Studio > Audio Performance
+/**
+ * Shows the performance counters that JackDriver and AudioInstrumentMixer
+ * keep in SequencerDataBlock: how long each JACK period takes against
+ * its deadline, xruns and underruns, and the time each instrument's
+ * synth and plugins take, and how well AudioCache is doing.  Updates
+ * while it is open, and can export what it shows as CSV for offline
+ * analysis.
+ */
+class AudioPerformanceDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit AudioPerformanceDialog(QWidget *parent);
+
+private slots:
+    void slotUpdate();
+    void slotReset();
+    void slotExport();
+
+private:
+    QLabel *m_periods;
+    QLabel *m_budget;
+    QLabel *m_longest;
+    QLabel *m_deadlineMisses;
+    QLabel *m_xruns;
+    QLabel *m_mixUnderruns;
+    QLabel *m_bussMixUnderruns;
+
+    QLabel *m_cacheHits;
+    QLabel *m_cacheMisses;
+    QLabel *m_cacheEvictions;
+    QLabel *m_cacheSize;
+
+    QTableWidget *m_histogram;
+    QTableWidget *m_instruments;
+
+    QTimer *m_updateTimer;
+
+    /// Label for a row of m_histogram.
+    static QString bucketName(int bucket);
+    /// Name to show for an instrument.
+    static QString instrumentName(InstrumentId id);
+
+    void writeCSV(QTextStream &out) const;
+};
+
+
+}
+
+#endif
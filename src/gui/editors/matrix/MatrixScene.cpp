@@ -31,6 +31,7 @@
 #include "misc/ConfigGroups.h"
 
 #include "misc/Debug.h"
+#include "base/BarIndex.h"
 #include "base/RulerScale.h"
 #include "base/SnapGrid.h"
 
@@ -352,19 +353,18 @@ MatrixScene::recreateLines()
 
     Composition *c = &m_document->getComposition();
 
-    int firstbar = c->getBarNumber(start), lastbar = c->getBarNumber(end);
+    std::shared_ptr<const BarIndex> barIndex = c->getBarIndex();
+    const std::vector<BarIndex::Bar> bars = barIndex->getBars(
+            barIndex->getBarNumber(start), barIndex->getBarNumber(end));
 
     // Draw Vertical Lines
     i = 0;
-    for (int bar = firstbar; bar <= lastbar; ++bar) {
+    for (const BarIndex::Bar &bar : bars) {
 
-        std::pair<timeT, timeT> range = c->getBarRange(bar);
+        const TimeSignature &timeSig = bar.timeSig;
 
-        bool discard = false;  // was not initalied...hmmm...try false?
-        TimeSignature timeSig = c->getTimeSignatureInBar(bar, discard);
-
-        double x0 = m_scale->getXForTime(range.first);
-        double x1 = m_scale->getXForTime(range.second);
+        double x0 = m_scale->getXForTime(bar.start);
+        double x1 = m_scale->getXForTime(bar.end);
         double width = x1 - x0;
 
         double gridLines; // number of grid lines per bar may be fractional
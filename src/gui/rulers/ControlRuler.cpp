@@ -20,6 +20,7 @@
 
 #include "ControlRuler.h"
 
+#include "base/BarIndex.h"
 #include "base/Event.h"
 #include "misc/Debug.h"
 #include "base/RulerScale.h"
@@ -587,21 +588,16 @@ void ControlRuler::paintEvent(QPaintEvent * /*event*/)
 
         timeT startt = m_segment->getStartTime();
         timeT endt = m_segment->getEndMarkerTime();
-        int firstbar = comp->getBarNumber(startt);
-        int lastbar = comp->getBarNumber(endt);
+        std::shared_ptr<const BarIndex> barIndex = comp->getBarIndex();
+        const std::vector<BarIndex::Bar> bars = barIndex->getBars(
+                barIndex->getBarNumber(startt), barIndex->getBarNumber(endt));
 
-        for (int bar = firstbar; bar <= lastbar; ++bar) {
-            std::pair<timeT, timeT> range = comp->getBarRange(bar);
-
-            bool newTimeSig = false;
-            TimeSignature timeSig =
-                comp->getTimeSignatureInBar(bar, newTimeSig);
-
-            double x0 = m_rulerScale->getXForTime(range.first);
-            double x1 = m_rulerScale->getXForTime(range.second);
+        for (const BarIndex::Bar &bar : bars) {
+            double x0 = m_rulerScale->getXForTime(bar.start);
+            double x1 = m_rulerScale->getXForTime(bar.end);
             double width = x1 - x0;
 
-            double gridLines = double(timeSig.getBarDuration()) /
+            double gridLines = double(bar.timeSig.getBarDuration()) /
                 double(m_snapGrid->getSnapTime(x0));
 
             double dx = width / gridLines;
@@ -67,6 +67,19 @@ CompositionMapper::segmentModified(Segment *segment)
     return mapper->refresh();
 }
 
+bool
+CompositionMapper::segmentModified(Segment *segment, timeT from, timeT to)
+{
+    SegmentMappers::const_iterator mapperIter = m_segmentMappers.find(segment);
+    if (mapperIter == m_segmentMappers.end())
+        return false;
+
+    if (!mapperIter->second)
+        return false;
+
+    return mapperIter->second->refresh(from, to);
+}
+
 void
 CompositionMapper::segmentAdded(Segment *segment)
 {
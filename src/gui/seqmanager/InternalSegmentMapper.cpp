@@ -28,6 +28,7 @@
 #include "base/RealTime.h"
 #include "base/Segment.h"
 #include "base/SegmentPerformanceHelper.h"
+#include "base/TempoMap.h"
 #include "base/TriggerSegment.h"
 #include "document/RosegardenDocument.h"
 #include "misc/Debug.h"
@@ -47,7 +48,9 @@ InternalSegmentMapper::InternalSegmentMapper(RosegardenDocument *doc,
                                              Segment *segment)
     : SegmentMapper(doc, segment),
       m_channelManager(doc->getInstrument(segment)),
-      m_triggeredEvents(new Segment)
+      m_triggeredEvents(new Segment),
+      m_haveTriggers(false),
+      m_mappingRange(false)
 {}
 
 InternalSegmentMapper::
@@ -58,10 +61,10 @@ InternalSegmentMapper::
 
 RealTime
 InternalSegmentMapper::
-toRealTime(Composition &comp, timeT t)
+toRealTime(timeT t)
 {
     return
-        comp.getElapsedRealTime(t) + m_segment->getRealTimeDelay();
+        m_tempoMap->toRealTime(t) + m_segment->getRealTimeDelay();
 }
 
 
@@ -87,6 +90,9 @@ void InternalSegmentMapper::fillBuffer()
         repeatEndTime = m_segment->getRepeatEndTime();
 
     resize(0);
+    m_sourceTimes.clear();
+    m_haveTriggers = false;
+    m_tempoMap = comp.getTempoMap();
 
 #ifdef DEBUG_INTERNAL_SEGMENT_MAPPER
     RG_DEBUG
@@ -163,6 +169,8 @@ void InternalSegmentMapper::fillBuffer()
 
                 if (triggerId >= 0) {
 
+                    m_haveTriggers = true;
+
                     TriggerSegmentRec *rec =
                         comp.getTriggerSegmentRec(triggerId);
                     // We will invalidate `implied' so we arrange to
@@ -206,74 +214,9 @@ void InternalSegmentMapper::fillBuffer()
                 }
             }
 
-            // Ignore rests
-            //
-            if (!(**k)->isa(Note::EventRestType)) {
-
-                SegmentPerformanceHelper helper
-                (usingImplied ? *m_triggeredEvents : *m_segment);
-
-                timeT playTime =
-                    helper.getSoundingAbsoluteTime(*k) + timeForRepeats;
-                if (playTime >= repeatEndTime) break;
-
-                timeT playDuration = helper.getSoundingDuration(*k);
-
-                // Ignore notes without duration -- they're probably in a tied
-                // series but not as first note
-                //
-                if (playDuration > 0 || !(**k)->isa(Note::EventType)) {
-
-                    if (playTime + playDuration > repeatEndTime)
-                        playDuration = repeatEndTime - playTime;
-
-                    playTime = playTime + m_segment->getDelay();
-                    const RealTime eventTime = toRealTime(comp, playTime);
-
-                    // slightly quicker than calling helper.getRealSoundingDuration()
-                    RealTime endTime =
-                        toRealTime(comp, playTime + playDuration);
-                    const RealTime duration = endTime - eventTime;
-
-                    try {
-                        // Create mapped event and put it in buffer.
-                        // The instrument will be set later by
-                        // ChannelManager, so we set it to zero here.
-                        MappedEvent e(0,
-                                      ***k,  // three stars! what an accolade
-                                      eventTime,
-                                      duration);
-
-                        // Somewhat hacky: The MappedEvent ctor makes
-                        // events that needn't be inserted invalid.
-                        if (e.isValid()) {
-                            e.setTrackId(track->getId());
-
-                            if ((**k)->isa(Controller::EventType) ||
-                                (**k)->isa(PitchBend::EventType)) {
-                                m_controllerCache.storeLatestValue((**k));
-                            }
-
-                            if ((**k)->isa(Note::EventType)) {
-                                if (m_segment->getTranspose() != 0) {
-                                    e.setPitch(e.getPitch() +
-                                               m_segment->getTranspose());
-                                }
-                                if (e.getType() != MappedEvent::MidiNoteOneShot) {
-                                    enqueueNoteoff(playTime + playDuration,
-                                                   e.getPitch());
-                                }
-                            }
-                            mapAnEvent(&e);
-                        } else {}
-
-                    } catch (...) {
-#ifdef DEBUG_INTERNAL_SEGMENT_MAPPER
-                        RG_DEBUG << "fillBuffer() - caught exception while trying to create MappedEvent";
-#endif
-                    }
-                }
-            }
+            if (!mapSegmentEvent(comp, track->getId(), *k, usingImplied,
+                                 timeForRepeats, repeatEndTime))
+                break;
 
             ++*k; // increment either i or j, whichever one we just used
         }
@@ -284,6 +227,97 @@ void InternalSegmentMapper::fillBuffer()
         popInsertNoteoff(track->getId(), comp);
     }
 
+    m_layout = getLayout();
+    // fillBufferRange() doesn't know how to redo triggered ornaments.
+    m_layout.valid = !m_haveTriggers;
+
+    finishFill(track->getId());
+}
+
+bool
+InternalSegmentMapper::mapSegmentEvent(Composition &comp, TrackId trackId,
+                                       Segment::iterator i, bool usingImplied,
+                                       timeT timeForRepeats,
+                                       timeT repeatEndTime)
+{
+    // See m_sourceTimes.
+    const timeT sourceTime = (*i)->getAbsoluteTime() + timeForRepeats;
+
+    // Ignore rests
+    //
+    if (!(*i)->isa(Note::EventRestType)) {
+
+        SegmentPerformanceHelper helper
+        (usingImplied ? *m_triggeredEvents : *m_segment);
+
+        timeT playTime =
+            helper.getSoundingAbsoluteTime(i) + timeForRepeats;
+        if (playTime >= repeatEndTime) return false;
+
+        timeT playDuration = helper.getSoundingDuration(i);
+
+        // Ignore notes without duration -- they're probably in a tied
+        // series but not as first note
+        //
+        if (playDuration > 0 || !(*i)->isa(Note::EventType)) {
+
+            if (playTime + playDuration > repeatEndTime)
+                playDuration = repeatEndTime - playTime;
+
+            playTime = playTime + m_segment->getDelay();
+            const RealTime eventTime = toRealTime(playTime);
+
+            // slightly quicker than calling helper.getRealSoundingDuration()
+            RealTime endTime =
+                toRealTime(playTime + playDuration);
+            const RealTime duration = endTime - eventTime;
+
+            try {
+                // Create mapped event and put it in buffer.
+                // The instrument will be set later by
+                // ChannelManager, so we set it to zero here.
+                MappedEvent e(0,
+                              **i,
+                              eventTime,
+                              duration);
+
+                // Somewhat hacky: The MappedEvent ctor makes
+                // events that needn't be inserted invalid.
+                if (e.isValid()) {
+                    e.setTrackId(trackId);
+
+                    if ((*i)->isa(Controller::EventType) ||
+                        (*i)->isa(PitchBend::EventType)) {
+                        m_controllerCache.storeLatestValue((*i));
+                    }
+
+                    if ((*i)->isa(Note::EventType)) {
+                        if (m_segment->getTranspose() != 0) {
+                            e.setPitch(e.getPitch() +
+                                       m_segment->getTranspose());
+                        }
+                        if (e.getType() != MappedEvent::MidiNoteOneShot) {
+                            enqueueNoteoff(playTime + playDuration,
+                                           e.getPitch(), sourceTime);
+                        }
+                    }
+                    output(e, sourceTime);
+                } else {}
+
+            } catch (...) {
+#ifdef DEBUG_INTERNAL_SEGMENT_MAPPER
+                RG_DEBUG << "fillBuffer() - caught exception while trying to create MappedEvent";
+#endif
+            }
+        }
+    }
+
+    return true;
+}
+
+void
+InternalSegmentMapper::finishFill(TrackId trackId)
+{
     bool anything = (size() != 0);
 
     RealTime minRealTime;
@@ -307,8 +341,8 @@ void InternalSegmentMapper::fillBuffer()
                                          RealTime::zero(), RealTime(1,0));
 
     // If the track is making sound
-    if (!ControlBlock::getInstance()->isTrackMuted(track->getId())  &&
-        !ControlBlock::getInstance()->isTrackArchived(track->getId())) {
+    if (!ControlBlock::getInstance()->isTrackMuted(trackId)  &&
+        !ControlBlock::getInstance()->isTrackArchived(trackId)) {
         // Track is unmuted, so get a channel interval to play on.
         // This also releases the old channel interval (possibly
         // getting it again)
@@ -328,6 +362,367 @@ void InternalSegmentMapper::fillBuffer()
     setStartEnd(minRealTime, maxRealTime);
 }
 
+InternalSegmentMapper::Layout
+InternalSegmentMapper::getLayout() const
+{
+    Layout layout;
+
+    layout.startTime = m_segment->getStartTime();
+    layout.endMarkerTime = m_segment->getEndMarkerTime();
+    layout.repeatCount = getSegmentRepeatCount();
+    layout.repeatEndTime = layout.endMarkerTime;
+    if (layout.repeatCount > 0)
+        layout.repeatEndTime = m_segment->getRepeatEndTime();
+    layout.delay = m_segment->getDelay();
+    layout.realTimeDelay = m_segment->getRealTimeDelay();
+    layout.transpose = m_segment->getTranspose();
+    layout.trackId = m_segment->getTrack();
+    layout.valid = true;
+
+    return layout;
+}
+
+bool
+InternalSegmentMapper::Layout::operator==(const Layout &other) const
+{
+    return valid == other.valid  &&
+           startTime == other.startTime  &&
+           endMarkerTime == other.endMarkerTime  &&
+           repeatCount == other.repeatCount  &&
+           repeatEndTime == other.repeatEndTime  &&
+           delay == other.delay  &&
+           realTimeDelay == other.realTimeDelay  &&
+           transpose == other.transpose  &&
+           trackId == other.trackId;
+}
+
+void
+InternalSegmentMapper::output(MappedEvent &event, timeT sourceTime)
+{
+    if (m_mappingRange) {
+        m_rangeEvents.push_back(event);
+        m_rangeSourceTimes.push_back(sourceTime);
+        return;
+    }
+
+    mapAnEvent(&event);
+    m_sourceTimes.push_back(sourceTime);
+}
+
+bool
+InternalSegmentMapper::fillBufferRange(timeT from, timeT to)
+{
+    // We can only patch what fillBuffer() produced, and only if the
+    // Segment's timing, repeats, etc... are as they were then.
+    if (!m_layout.valid  ||  !(getLayout() == m_layout))
+        return false;
+    if (int(m_sourceTimes.size()) != size())
+        return false;
+
+    Composition &comp = m_doc->getComposition();
+    const Track *track = comp.getTrackById(m_segment->getTrack());
+    if (!track)
+        return false;
+    // Everything outside the range would need new times.
+    if (comp.getTempoMap() != m_tempoMap)
+        return false;
+
+    const timeT segmentStartTime = m_layout.startTime;
+    const timeT segmentEndTime = m_layout.endMarkerTime;
+    const timeT segmentDuration = segmentEndTime - segmentStartTime;
+    const int repeats = m_layout.repeatCount + 1;
+
+    timeT rangeStart = std::max(from, segmentStartTime);
+    timeT rangeEnd = std::max(to, rangeStart + 1);
+
+    // For each repeat, the run of old entries in the buffer and what
+    // replaces it.
+    std::vector<int> oldFirst(repeats);
+    std::vector<int> oldLast(repeats);
+    std::vector<std::vector<MappedEvent> > newEvents(repeats);
+    std::vector<std::vector<timeT> > newSourceTimes(repeats);
+
+    // Widen the range until nothing (old or new) sounds across either
+    // end of it.  Then the old entries for it are a contiguous run in
+    // the buffer, and swapping in the new ones leaves the buffer exactly
+    // as fillBuffer() would have made it.  Usually one pass.
+    bool stable = false;
+    for (int pass = 0; pass < 8  &&  !stable; ++pass) {
+
+        // No point.
+        if (rangeStart <= segmentStartTime  &&  rangeEnd >= segmentEndTime)
+            return false;
+
+        stable = true;
+
+        for (int repeatNo = 0; repeatNo < repeats; ++repeatNo) {
+            const timeT timeForRepeats = repeatNo * segmentDuration;
+            timeT start = rangeStart + timeForRepeats;
+            timeT end = rangeEnd + timeForRepeats;
+
+            if (!findRun(start, end, oldFirst[repeatNo], oldLast[repeatNo])) {
+                rangeStart = start - timeForRepeats;
+                rangeEnd = end - timeForRepeats;
+                stable = false;
+                break;
+            }
+        }
+
+        if (!stable)
+            continue;
+
+        for (int repeatNo = 0; repeatNo < repeats; ++repeatNo) {
+            const timeT timeForRepeats = repeatNo * segmentDuration;
+            timeT lastNoteoff;
+
+            if (!mapRange(comp, track->getId(), timeForRepeats,
+                          rangeStart, rangeEnd, lastNoteoff))
+                return false;
+
+            // A new note sounds past the end.
+            const timeT end = lastNoteoff - m_layout.delay - timeForRepeats;
+            if (end > rangeEnd) {
+                rangeEnd = end;
+                stable = false;
+                break;
+            }
+
+            newEvents[repeatNo].swap(m_rangeEvents);
+            newSourceTimes[repeatNo].swap(m_rangeSourceTimes);
+        }
+    }
+
+    if (!stable)
+        return false;
+
+    // The notes outside the range would need redoing too.
+    if (joinedAcross(rangeStart, rangeEnd))
+        return false;
+
+    int newSize = size();
+
+    for (int repeatNo = 0; repeatNo < repeats; ++repeatNo) {
+        // Runs must be in order.
+        if (repeatNo > 0  &&  oldFirst[repeatNo] < oldLast[repeatNo - 1])
+            return false;
+
+        // Controllers would need m_controllerCache redone, which needs
+        // the whole Segment.
+        for (int i = oldFirst[repeatNo]; i < oldLast[repeatNo]; ++i) {
+            const MappedEvent::MappedEventType type = getBuffer()[i].getType();
+            if (type == MappedEvent::MidiController  ||
+                type == MappedEvent::MidiPitchBend)
+                return false;
+        }
+
+        newSize += int(newEvents[repeatNo].size()) -
+                   (oldLast[repeatNo] - oldFirst[repeatNo]);
+    }
+
+#ifdef DEBUG_INTERNAL_SEGMENT_MAPPER
+    RG_DEBUG << "fillBufferRange(): redid" << rangeStart << "to" << rangeEnd
+             << "for" << repeats << "repeat(s), size" << size()
+             << "->" << newSize;
+#endif
+
+    if (newSize == size()) {
+        // Same number of events as before (e.g. a note was moved or
+        // changed) so everything else stays where it is.
+        for (int repeatNo = 0; repeatNo < repeats; ++repeatNo) {
+            std::copy(newEvents[repeatNo].begin(), newEvents[repeatNo].end(),
+                      getBuffer() + oldFirst[repeatNo]);
+            std::copy(newSourceTimes[repeatNo].begin(),
+                      newSourceTimes[repeatNo].end(),
+                      m_sourceTimes.begin() + oldFirst[repeatNo]);
+        }
+    } else {
+        std::vector<MappedEvent> events;
+        events.reserve(newSize);
+        std::vector<timeT> sourceTimes;
+        sourceTimes.reserve(newSize);
+
+        int i = 0;
+        for (int repeatNo = 0; repeatNo < repeats; ++repeatNo) {
+            events.insert(events.end(),
+                          getBuffer() + i, getBuffer() + oldFirst[repeatNo]);
+            sourceTimes.insert(sourceTimes.end(),
+                               m_sourceTimes.begin() + i,
+                               m_sourceTimes.begin() + oldFirst[repeatNo]);
+            events.insert(events.end(),
+                          newEvents[repeatNo].begin(),
+                          newEvents[repeatNo].end());
+            sourceTimes.insert(sourceTimes.end(),
+                               newSourceTimes[repeatNo].begin(),
+                               newSourceTimes[repeatNo].end());
+            i = oldLast[repeatNo];
+        }
+        events.insert(events.end(), getBuffer() + i, getBuffer() + size());
+        sourceTimes.insert(sourceTimes.end(),
+                           m_sourceTimes.begin() + i, m_sourceTimes.end());
+
+        reserve(newSize);
+        std::copy(events.begin(), events.end(), getBuffer());
+        resize(newSize);
+        m_sourceTimes.swap(sourceTimes);
+    }
+
+    finishFill(track->getId());
+
+    return true;
+}
+
+bool
+InternalSegmentMapper::findRun(timeT &start, timeT &end,
+                               int &first, int &last) const
+{
+    const int count = size();
+
+    first = 0;
+    while (first < count  &&  m_sourceTimes[first] < start)
+        ++first;
+
+    last = count;
+    while (last > 0  &&  m_sourceTimes[last - 1] >= end)
+        --last;
+
+    // Anything from before the range that comes after the start of the
+    // run (e.g. the noteoff of a note that is still sounding) or from
+    // after the range that comes before the end of it has to be taken
+    // in.
+    timeT newStart = start;
+    for (int i = first; i < count; ++i) {
+        if (m_sourceTimes[i] < newStart)
+            newStart = m_sourceTimes[i];
+    }
+    timeT newEnd = end;
+    for (int i = 0; i < last; ++i) {
+        if (m_sourceTimes[i] >= newEnd)
+            newEnd = m_sourceTimes[i] + 1;
+    }
+
+    if (newStart != start  ||  newEnd != end) {
+        start = newStart;
+        end = newEnd;
+        return false;
+    }
+
+    // Nothing from the range in the buffer.  Insert at first.
+    if (last < first)
+        last = first;
+
+    return true;
+}
+
+bool
+InternalSegmentMapper::joinedAcross(timeT start, timeT end)
+{
+    // Ties from notes in the range that haven't been matched up yet, by
+    // pitch and the time of the note they are tied to.
+    std::set<std::pair<long, timeT> > tiedForward;
+
+    for (Segment::iterator i = m_segment->findTime(start);
+         m_segment->isBeforeEndMarker(i)  &&  (*i)->getAbsoluteTime() <= end;
+         ++i) {
+        const Event *event = *i;
+
+        if (event->has(BaseProperties::TRIGGER_SEGMENT_ID))
+            return true;
+
+        if (!event->isa(Note::EventType))
+            continue;
+
+        // Grace notes take their timing from the notes around them.
+        if (event->has(BaseProperties::IS_GRACE_NOTE)  ||
+            event->has(BaseProperties::MAY_HAVE_GRACE_NOTES))
+            return true;
+
+        bool tiedBack = false;
+        event->get<Bool>(BaseProperties::TIED_BACKWARD, tiedBack);
+        bool tiedOn = false;
+        event->get<Bool>(BaseProperties::TIED_FORWARD, tiedOn);
+
+        // Just past the range.  Tied back to a note in it, or to one
+        // that was.
+        if (event->getAbsoluteTime() >= end) {
+            if (tiedBack)
+                return true;
+            continue;
+        }
+
+        long pitch = -1;
+        event->get<Int>(BaseProperties::PITCH, pitch);
+        const timeT time = event->getNotationAbsoluteTime();
+
+        // Tied back to a note before the range.
+        if (tiedBack  &&
+            tiedForward.erase(std::make_pair(pitch, time)) == 0)
+            return true;
+
+        if (tiedOn) {
+            const timeT tiedTo = time + event->getNotationDuration();
+            // Tied on to a note past the range.
+            if (tiedTo >= end)
+                return true;
+            tiedForward.insert(std::make_pair(pitch, tiedTo));
+        }
+    }
+
+    return false;
+}
+
+bool
+InternalSegmentMapper::mapRange(Composition &comp, TrackId trackId,
+                                timeT timeForRepeats,
+                                timeT start, timeT end, timeT &lastNoteoff)
+{
+    m_rangeEvents.clear();
+    m_rangeSourceTimes.clear();
+    m_noteOffs = NoteoffContainer();
+    m_mappingRange = true;
+
+    bool ok = true;
+    lastNoteoff = start + timeForRepeats + m_layout.delay;
+
+    // Same as the main loop in fillBuffer(), without the triggered
+    // segment handling.
+    Segment::iterator j = m_segment->findTime(start);
+    while (m_segment->isBeforeEndMarker(j)  &&
+           (*j)->getAbsoluteTime() < end) {
+
+        if (haveEarlierNoteoff((*j)->getAbsoluteTime() + timeForRepeats)) {
+            lastNoteoff = std::max(lastNoteoff, m_noteOffs.begin()->m_time);
+            popInsertNoteoff(trackId, comp);
+            continue;
+        }
+
+        long triggerId = -1;
+        (*j)->get<Int>(BaseProperties::TRIGGER_SEGMENT_ID, triggerId);
+
+        // Need a full fillBuffer() for these.  See m_controllerCache.
+        if (triggerId >= 0  ||
+            (*j)->isa(Controller::EventType)  ||
+            (*j)->isa(PitchBend::EventType)) {
+            ok = false;
+            break;
+        }
+
+        if (!mapSegmentEvent(comp, trackId, j, false,
+                             timeForRepeats, m_layout.repeatEndTime))
+            break;
+
+        ++j;
+    }
+
+    while (!m_noteOffs.empty()) {
+        lastNoteoff = std::max(lastNoteoff, m_noteOffs.begin()->m_time);
+        popInsertNoteoff(trackId, comp);
+    }
+
+    m_mappingRange = false;
+
+    return ok;
+}
+
     /** Functions about the noteoff queue **/
 
 bool
@@ -336,16 +731,16 @@ haveEarlierNoteoff(timeT t)
 {
     return
         (!m_noteOffs.empty()) &&
-        (m_noteOffs.begin()->first <= t);
+        (m_noteOffs.begin()->m_time <= t);
 }
 
 void
 InternalSegmentMapper::
-enqueueNoteoff(timeT time, int pitch)
+enqueueNoteoff(timeT time, int pitch, timeT noteOnTime)
 {
     for (NoteoffContainer::iterator i = m_noteOffs.begin();
          i != m_noteOffs.end(); ++i) {
-        if (i->second == pitch) {
+        if (i->m_pitch == pitch) {
 #ifdef DEBUG_INTERNAL_SEGMENT_MAPPER
             RG_DEBUG << "enqueueNoteoff(): duplicated NOTE OFF  pitch: " << pitch << " at " << time;
 #endif
@@ -354,7 +749,7 @@ enqueueNoteoff(timeT time, int pitch)
     }
 
     // Enqueue this noteoff
-    m_noteOffs.insert(Noteoff(time, pitch));
+    m_noteOffs.insert(Noteoff(time, pitch, noteOnTime));
 }
 
 
@@ -363,16 +758,17 @@ InternalSegmentMapper::
 popInsertNoteoff(int trackid, Composition &comp)
 {
     // Look at top element
-    timeT internalTime = m_noteOffs.begin()->first;
-    int pitch          = m_noteOffs.begin()->second;
+    timeT internalTime = m_noteOffs.begin()->m_time;
+    int pitch          = m_noteOffs.begin()->m_pitch;
+    timeT noteOnTime   = m_noteOffs.begin()->m_noteOnTime;
 
     // A noteoff looks like a note with velocity = 0.
     // Our noteoffs already have performance pitch, so
     // don't add segment's transpose.
     MappedEvent event(0, MappedEvent::MidiNote, pitch, 0);
-    event.setEventTime(toRealTime(comp, internalTime));
+    event.setEventTime(toRealTime(internalTime));
     event.setTrackId(trackid);
-    mapAnEvent(&event);
+    output(event, noteOnTime);
 
     // pop
     m_noteOffs.erase(m_noteOffs.begin());
@@ -19,18 +19,25 @@
 #define RG_INTERNALSEGMENTMAPPER_H
 
 #include "base/ControllerContext.h"
+#include "base/RealTime.h"
+#include "base/Segment.h"
 #include "gui/seqmanager/MappedEventBuffer.h"
 #include "gui/seqmanager/SegmentMapper.h"
 #include "gui/seqmanager/ChannelManager.h"
+#include "sound/MappedEvent.h"
 
+#include <memory>
 #include <set>
+#include <vector>
+
+#include <rosegardenprivate_export.h>
 
 namespace Rosegarden
 {
 
 class TriggerSegmentRec;
 class Composition;
-class RealTime;
+class TempoMap;
 
 /// Converts (maps) Event objects into MappedEvent objects for a Segment
 /**
@@ -54,8 +61,15 @@ class RealTime;
  * This is the first part of a two-part process to convert the Event objects
  * in a Composition into MappedEvent objects that can be sent to ALSA.  For
  * the second part of this conversion, see MappedBufMetaIterator.
+ *
+ * When only part of the Segment has changed (e.g. a note was edited),
+ * fillBufferRange() redoes just that part of the buffer, for each
+ * repeat, rather than the whole thing.  It falls back on fillBuffer()
+ * when the Segment's timing or repeats have changed, when triggered
+ * segments or controllers are involved, or when a tie or grace note
+ * joins the changed part to the rest.
  */
-class InternalSegmentMapper : public SegmentMapper
+class ROSEGARDENPRIVATE_EXPORT InternalSegmentMapper : public SegmentMapper
 {
 public:
     InternalSegmentMapper(RosegardenDocument *doc, Segment *segment);
@@ -67,6 +81,9 @@ protected:
     /// dump all segment data in the file
     void fillBuffer() override;
 
+    /// Redo the part of the buffer mapped from [from, to).
+    bool fillBufferRange(timeT from, timeT to) override;
+
     // Return whether the event should be played.
     bool shouldPlay(MappedEvent *evt, RealTime startTime) override;
 
@@ -97,12 +114,24 @@ private:
      */
     ControllerAndPBList getControllers(Instrument *instrument, RealTime start);
 
-    typedef std::pair<timeT, int> Noteoff;
+    struct Noteoff
+    {
+        Noteoff(timeT time, int pitch, timeT noteOnTime) :
+            m_time(time),
+            m_pitch(pitch),
+            m_noteOnTime(noteOnTime)
+        { }
+
+        timeT m_time;
+        int m_pitch;
+        /// See m_sourceTimes.
+        timeT m_noteOnTime;
+    };
     struct NoteoffCmp
     {
         typedef InternalSegmentMapper::Noteoff Noteoff;
         bool operator()(const Noteoff &e1, const Noteoff &e2) const {
-            return e1.first < e2.first;
+            return e1.m_time < e2.m_time;
         }
         bool operator()(const Noteoff *e1, const Noteoff *e2) const {
             return operator()(*e1, *e2);
@@ -118,14 +147,86 @@ private:
         { return m_channelManager.getInstrument(); }
 
     void popInsertNoteoff(int trackid, Composition &comp);
-    void enqueueNoteoff(timeT time, int pitch);
+    void enqueueNoteoff(timeT time, int pitch, timeT noteOnTime);
 
     bool haveEarlierNoteoff(timeT t);
-    RealTime toRealTime(Composition &comp, timeT t);
+    /// Performance time of t, using m_tempoMap.
+    RealTime toRealTime(timeT t);
     int getControllerValue(timeT searchTime,
                            const std::string& eventType,
                            int controllerId);
 
+    /// Map one Event from the Segment (or m_triggeredEvents if usingImplied).
+    /**
+     * Returns false if the Event is past repeatEndTime, in which case
+     * the rest of this repeat should be skipped.
+     */
+    bool mapSegmentEvent(Composition &comp, TrackId trackId,
+                         Segment::iterator i, bool usingImplied,
+                         timeT timeForRepeats, timeT repeatEndTime);
+
+    /// Put a mapped event in the buffer, or in m_rangeEvents.
+    void output(MappedEvent &event, timeT sourceTime);
+
+    /// Set the start/end times and sort out the channel after a fill.
+    void finishFill(TrackId trackId);
+
+    /// Find the run of buffer entries with m_sourceTimes in [start, end).
+    /**
+     * If entries from outside [start, end) are mixed in with the run,
+     * widens start and end to take them in and returns false.
+     */
+    bool findRun(timeT &start, timeT &end, int &first, int &last) const;
+
+    /// Whether anything in [start, end) affects how notes outside it play.
+    /**
+     * That is a tie to or from a note outside the range (or a note at
+     * end that is tied back to anything), a grace note, or a triggered
+     * segment.  fillBufferRange() can't redo just the range then.
+     */
+    bool joinedAcross(timeT start, timeT end);
+
+    /// Map [start, end) of one repeat into m_rangeEvents.
+    /**
+     * lastNoteoff is set to the time of the last noteoff.  Returns
+     * false if there is something in the range that needs a full
+     * fillBuffer().
+     */
+    bool mapRange(Composition &comp, TrackId trackId, timeT timeForRepeats,
+                  timeT start, timeT end, timeT &lastNoteoff);
+
+    /// What the buffer was last filled for.
+    /**
+     * fillBufferRange() can only be used if none of this has changed
+     * since the last fillBuffer().
+     */
+    struct Layout
+    {
+        Layout() :
+            startTime(0),
+            endMarkerTime(0),
+            repeatCount(0),
+            repeatEndTime(0),
+            delay(0),
+            transpose(0),
+            trackId(NoTrack),
+            valid(false)
+        { }
+
+        bool operator==(const Layout &other) const;
+
+        timeT startTime;
+        timeT endMarkerTime;
+        int repeatCount;
+        timeT repeatEndTime;
+        timeT delay;
+        RealTime realTimeDelay;
+        int transpose;
+        TrackId trackId;
+        bool valid;
+    };
+    Layout getLayout() const;
+
     /** Data members **/
 
     ChannelManager m_channelManager;
@@ -141,6 +242,30 @@ private:
 
     /// Queue of noteoffs.
     NoteoffContainer m_noteOffs;
+
+    /// Performance time of the Segment Event each buffer entry came from.
+    /**
+     * Parallel to the buffer.  This is the Event's absolute time plus the
+     * offset for the repeat it is in.  For noteoffs it is that of the
+     * note.  fillBufferRange() uses this to find the entries to replace.
+     */
+    std::vector<timeT> m_sourceTimes;
+
+    /// The tempo map of the last fillBuffer().
+    /**
+     * Held for the whole fill so that each conversion doesn't have to
+     * go through Composition.  fillBufferRange() also uses it to tell
+     * whether the tempo has changed since the buffer was filled.
+     */
+    std::shared_ptr<const TempoMap> m_tempoMap;
+
+    Layout m_layout;
+    bool m_haveTriggers;
+
+    /// Whether output() goes to m_rangeEvents rather than the buffer.
+    bool m_mappingRange;
+    std::vector<MappedEvent> m_rangeEvents;
+    std::vector<timeT> m_rangeSourceTimes;
 };
 
 
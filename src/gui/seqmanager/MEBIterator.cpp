@@ -35,10 +35,19 @@ MEBIterator::MEBIterator(
 }
 
 // ++prefix
+bool
+MEBIterator::atEnd() const
+{
+    const MappedEventBuffer::Snapshot *snapshot =
+            m_mappedEventBuffer->getSnapshot();
+
+    return (!snapshot  ||  m_index >= snapshot->size);
+}
+
 MEBIterator &
 MEBIterator::operator++()
 {
-    if (m_index < m_mappedEventBuffer->size())
+    if (!atEnd())
         ++m_index;
 
     return *this;
@@ -47,10 +56,6 @@ MEBIterator::operator++()
 void
 MEBIterator::moveTo(const RealTime &time)
 {
-    // Rather than briefly unlock and immediately relock each
-    // iteration, we leave the lock on until we're done.
-    QReadLocker locker(getLock());
-
     // For each event from the current iterator position
     while (1) {
         if (atEnd())
@@ -86,14 +91,16 @@ MEBIterator::moveTo(const RealTime &time)
 MappedEvent *
 MEBIterator::peek() const
 {
-    // The lock formerly here has moved out to callers.
+    // Lock-free.  See MappedEventBuffer::Snapshot.
+    const MappedEventBuffer::Snapshot *snapshot =
+            m_mappedEventBuffer->getSnapshot();
 
     // If we're at the end, return nullptr
-    if (m_index >= m_mappedEventBuffer->size())
+    if (!snapshot  ||  m_index >= snapshot->size)
         return nullptr;
 
     // Otherwise return a pointer into the buffer.
-    return &m_mappedEventBuffer->m_buffer[m_index];
+    return &snapshot->events[m_index];
 }
 
 void
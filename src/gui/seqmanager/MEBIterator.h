@@ -22,6 +22,8 @@
 
 #include <QSharedPointer>
 
+#include <rosegardenprivate_export.h>
+
 namespace Rosegarden {
 
 
@@ -30,7 +32,7 @@ namespace Rosegarden {
  * MappedBufMetaIterator creates and manages these.
  * MappedBufMetaIterator::m_iterators is a std::vector of these.
  */
-class MEBIterator
+class ROSEGARDENPRIVATE_EXPORT MEBIterator
 {
 public:
     explicit MEBIterator(QSharedPointer<MappedEventBuffer> mappedEventBuffer);
@@ -38,8 +40,7 @@ public:
     /// Go back to the beginning of the MappedEventBuffer
     void reset()  { m_index = 0; }
 
-    bool atEnd() const
-        { return (m_index >= m_mappedEventBuffer->size()); }
+    bool atEnd() const;
 
     /// Prefix operator++
     MEBIterator& operator++();
@@ -53,12 +54,10 @@ public:
      *
      * Returns 0 if atEnd().
      *
-     * Callers should lock the iterator by using QReadLocker on the return
-     * from getLock() for as long as they are using the pointer.
-     *
-     *   QReadLocker locker(iter->getLock());
-     *
-     * @see getLock()
+     * No locking is needed.  The pointer is into the MappedEventBuffer's
+     * currently published snapshot, which stays valid for a good while
+     * after it is replaced.  Callers must not hold on to it beyond the
+     * current call into the sequencer (e.g. a fetchEvents()).
      */
     MappedEvent *peek() const;
 
@@ -148,14 +147,6 @@ public:
     bool shouldPlay(MappedEvent *evt, RealTime startTime)
         { return m_mappedEventBuffer->shouldPlay(evt, startTime); }
 
-    /// Get a pointer to the MappedEventBuffer's lock.
-    /**
-     * This is used when reading to prevent MappedEventBuffer from
-     * reallocating the buffer while we are holding a pointer.
-     */
-    QReadWriteLock *getLock() const
-        { return &m_mappedEventBuffer->m_lock; }
-
 private:
     /// The buffer this iterator points into.
     QSharedPointer<MappedEventBuffer> m_mappedEventBuffer;
@@ -23,7 +23,9 @@
 #include "misc/Debug.h"
 #include "sound/MappedEvent.h"
 #include "sound/MappedInserterBase.h"
+#include "sound/Scavenger.h"
 
+#include <algorithm>
 #include <limits>  // for std::numeric_limits
 
 // #define DEBUG_MAPPED_EVENT_BUFFER 1
@@ -31,21 +33,67 @@
 namespace Rosegarden
 {
 
+MappedEventBuffer::Snapshot::Snapshot(int capacity) :
+    events(new MappedEvent[capacity]),
+    capacity(capacity),
+    size(0),
+    start(),
+    end()
+{
+}
+
+MappedEventBuffer::Snapshot::~Snapshot()
+{
+    delete[] events;
+}
+
 MappedEventBuffer::MappedEventBuffer(RosegardenDocument *doc) :
     m_doc(doc),
     m_end(std::numeric_limits<int>::max(), 0),  // 68 years
-    m_buffer(nullptr),
-    m_capacity(0),
-    m_size(0),
-    m_lock(),
+    m_current(nullptr),
+    m_writeBuffer(nullptr),
     m_refCount(0)
 {
 }
 
 MappedEventBuffer::~MappedEventBuffer()
 {
+    // We are the last owner, so nobody can be reading.
     // Safe even if nullptr.
-    delete[] m_buffer;
+    delete m_writeBuffer;
+    delete m_current.loadAcquire();
+}
+
+Scavenger<MappedEventBuffer::Snapshot> &
+MappedEventBuffer::getScavenger()
+{
+    // Two seconds is far longer than the sequencer thread holds on to
+    // a Snapshot.  Enough slots for a large composition being refreshed
+    // in one go (e.g. after a tempo change) without falling back on
+    // Scavenger's locking path.
+    //
+    // Create on first use to avoid static init order fiasco.
+    // Deliberately leaked so that Snapshots retired during shutdown
+    // don't go away under a sequencer thread that is still running.
+    static Scavenger<Snapshot> *scavenger =
+            new Scavenger<Snapshot>(2, 1000);
+
+    return *scavenger;
+}
+
+QAtomicInt &
+MappedEventBuffer::getPublishCounter()
+{
+    // Create on first use to avoid static init order fiasco.
+    static QAtomicInt publishCounter;
+
+    return publishCounter;
+}
+
+int
+MappedEventBuffer::getPublishCount()
+{
+    return getPublishCounter().loadAcquire();
 }
 
 void
@@ -54,11 +102,12 @@ MappedEventBuffer::init()
     int size = calculateSize();
 
     if (size > 0) {
-        reserve(size);
+        beginWrite(size, false);
 
         //RG_DEBUG << "init() : size = " << size;
 
         fillBuffer();
+        publish();
     } else {
         //RG_DEBUG << "init() : mmap size = 0 - skipping mmapping for now";
     }
@@ -67,8 +116,6 @@ MappedEventBuffer::init()
 bool
 MappedEventBuffer::refresh()
 {
-    bool resized = false;
-
     int newFill = calculateSize();
     int oldSize = capacity();
 
@@ -79,77 +126,163 @@ MappedEventBuffer::refresh()
                  << " - new fill = " << newFill;
 #endif
 
-    // If we need to expand the buffer to hold the events
-    if (newFill > oldSize) {
-        resized = true;
-        reserve(newFill);
-    }
+    // The sequencer may be reading the current buffer, so we always
+    // fill a new one.  It only needs to be big enough for the events
+    // we expect.
+    beginWrite(newFill, false);
 
     // Ask the deriver to fill the buffer from the document
     fillBuffer();
 
-    return resized;
+    publish();
+
+    // If we needed to expand the buffer to hold the events
+    return (capacity() > oldSize);
+}
+
+bool
+MappedEventBuffer::refresh(timeT from, timeT to)
+{
+    const int oldCapacity = capacity();
+
+    // fillBufferRange() patches a copy of the current buffer.  Copying
+    // is still much cheaper than mapping every event again.
+    beginWrite(oldCapacity, true);
+
+    if (fillBufferRange(from, to)) {
+        publish();
+#ifdef DEBUG_MAPPED_EVENT_BUFFER
+        RG_DEBUG << "refresh() - " << this
+                 << " - refreshed" << from << "to" << to
+                 << " - new fill = " << size();
+#endif
+        return (capacity() > oldCapacity);
+    }
+
+    abandonWrite();
+
+    return refresh();
+}
+
+void
+MappedEventBuffer::beginWrite(int capacity, bool keepContents)
+{
+    // Left over from a fill that threw?
+    delete m_writeBuffer;
+
+    const Snapshot *current = getSnapshot();
+
+    m_writeBuffer = new Snapshot(capacity);
+
+    if (keepContents  &&  current) {
+        const int size = std::min(current->size, capacity);
+        std::copy(current->events, current->events + size,
+                  m_writeBuffer->events);
+        m_writeBuffer->size = size;
+    }
+}
+
+void
+MappedEventBuffer::publish()
+{
+    if (!m_writeBuffer)
+        return;
+
+    m_writeBuffer->start = m_start;
+    m_writeBuffer->end = m_end;
+
+    Snapshot *old = m_current.fetchAndStoreOrdered(m_writeBuffer);
+    m_writeBuffer = nullptr;
+
+    // After the store, so whoever sees the new count sees the new Snapshot.
+    getPublishCounter().fetchAndAddRelease(1);
+
+    Scavenger<Snapshot> &scavenger = getScavenger();
+
+    // Free up slots before claiming one.
+    scavenger.scavenge();
+
+    if (old)
+        scavenger.claim(old);
+}
+
+void
+MappedEventBuffer::abandonWrite()
+{
+    delete m_writeBuffer;
+    m_writeBuffer = nullptr;
 }
 
 int
 MappedEventBuffer::capacity() const
 {
-#if (QT_VERSION >= QT_VERSION_CHECK(5, 14, 0))
-    return m_capacity.loadRelaxed();
-#else
-    return m_capacity.load();
-#endif
+    if (m_writeBuffer)
+        return m_writeBuffer->capacity;
+
+    const Snapshot *current = getSnapshot();
+    return current ? current->capacity : 0;
 }
 
 int
 MappedEventBuffer::size() const
 {
-#if (QT_VERSION >= QT_VERSION_CHECK(5, 14, 0))
-    return m_size.loadRelaxed();
-#else
-    return m_size.load();
-#endif
+    if (m_writeBuffer)
+        return m_writeBuffer->size;
+
+    const Snapshot *current = getSnapshot();
+    return current ? current->size : 0;
 }
 
 void
-MappedEventBuffer::reserve(int newSize)
+MappedEventBuffer::getStartEnd(RealTime &start, RealTime &end) const
 {
-    if (newSize <= capacity())  return;
-
-    MappedEvent *oldBuffer = m_buffer;
-    MappedEvent *newBuffer = new MappedEvent[newSize];
+    const Snapshot *current = getSnapshot();
 
-    if (oldBuffer) {
-#if (QT_VERSION >= QT_VERSION_CHECK(5, 14, 0))
-        for (int i = 0; i < m_size.loadRelaxed(); ++i) {
-#else
-        for (int i = 0; i < m_size.load(); ++i) {
-#endif
-            newBuffer[i] = m_buffer[i];
-        }
+    if (current) {
+        start = current->start;
+        end   = current->end;
+    } else {
+        start = m_start;
+        end   = m_end;
     }
+}
 
-    {
-        QWriteLocker locker(&m_lock);
-        m_buffer = newBuffer;
-        m_capacity.storeRelease(newSize);
+void
+MappedEventBuffer::reserve(int newSize)
+{
+    if (!m_writeBuffer) {
+        RG_WARNING << "reserve(): called while not filling";
+        return;
     }
 
+    if (newSize <= m_writeBuffer->capacity)  return;
+
+    // Nobody else can see the buffer being filled, so there is nothing
+    // to lock.
+    MappedEvent *oldEvents = m_writeBuffer->events;
+    MappedEvent *newEvents = new MappedEvent[newSize];
+
+    std::copy(oldEvents, oldEvents + m_writeBuffer->size, newEvents);
+
+    m_writeBuffer->events = newEvents;
+    m_writeBuffer->capacity = newSize;
+
 #ifdef DEBUG_MAPPED_EVENT_BUFFER
     SEQUENCER_DEBUG << "MappedEventBuffer::reserve: Resized to " << newSize << " events";
 #endif
 
-    delete[] oldBuffer;
+    delete[] oldEvents;
 }
 
 void
 MappedEventBuffer::resize(int newFill)
 {
-#if (QT_VERSION >= QT_VERSION_CHECK(5, 14, 0))
-    m_size.storeRelaxed(newFill);
-#else
-    m_size.store(newFill);
-#endif
+    if (!m_writeBuffer) {
+        RG_WARNING << "resize(): called while not filling";
+        return;
+    }
+
+    m_writeBuffer->size = newFill;
 }
 
 void
@@ -19,10 +19,13 @@
 #define RG_MAPPEDEVENTBUFFER_H
 
 #include "base/RealTime.h"
+#include "base/TimeT.h"
 #include "base/Track.h"
 
-#include <QReadWriteLock>
 #include <QAtomicInt>
+#include <QAtomicPointer>
+
+#include <rosegardenprivate_export.h>
 
 namespace Rosegarden
 {
@@ -30,6 +33,7 @@ namespace Rosegarden
 class MappedEvent;
 class MappedInserterBase;
 class RosegardenDocument;
+template <typename T> class Scavenger;
 
 /// Abstract Base Class container for MappedEvent objects.
 /**
@@ -46,13 +50,14 @@ class RosegardenDocument;
  * The mapping logic is handled by mappers derived from this class; this
  * class provides the basic container and the reading logic.
  *
- * Reading and writing may take place simultaneously without locks (we are
- * prepared to accept the lossage from individual mangled MappedEvent
- * reads) but a read/write lock (m_lock) on the buffer space guards
- * against bad
- * access caused by resizes.  [Actually, it doesn't at all since the
- * caller of peek() has a pointer they can access after the lock has
- * been released.  See comments on m_lock below and in iterator::peek().]
+ * Reading and writing take place simultaneously without locks.  The
+ * mapper (in the GUI thread) never writes to the events the sequencer
+ * thread is reading.  Each init() or refresh() fills a fresh Snapshot
+ * and then publishes it with a single atomic pointer store.  Readers
+ * (MEBIterator) always see a complete, consistent Snapshot: events,
+ * size and start/end times all from the same fill.  The Snapshot that
+ * was replaced is handed to a Scavenger which deletes it once the
+ * sequencer can no longer be holding a pointer into it.
  *
  * MappedEventBuffer only concerns itself with the state of the
  * composition, as opposed to the state of performance.  No matter how
@@ -63,7 +68,7 @@ class RosegardenDocument;
  * metaiterators (MappedBufMetaIterator?) and by ChannelManager and deletes
  * itself when the last owner is removed.  See addOwner() and removeOwner().
  */
-class MappedEventBuffer
+class ROSEGARDENPRIVATE_EXPORT MappedEventBuffer
 {
 
 public:
@@ -77,9 +82,10 @@ public:
      */
     void init();
 
-    /// Access to the internal buffer of events.  NOT LOCKED
+    /// Access to the buffer of events being filled.
     /**
-     * un-locked, use only from write/resize thread
+     * For use by fillBuffer() and fillBufferRange() only.  Outside of
+     * those there is no buffer being filled and this returns nullptr.
      *
      * This is always used along with [] to access a specific MappedEvent.
      *
@@ -87,11 +93,20 @@ public:
      *     sort of range checking.  Recommend adding an operator[] and/or an
      *     at() that asserts on range problems.
      */
-    MappedEvent *getBuffer()  { return m_buffer; }
+    MappedEvent *getBuffer()
+        { return m_writeBuffer ? m_writeBuffer->events : nullptr; }
 
     /// Capacity of the buffer in MappedEvent's.
+    /**
+     * While filling, this is the capacity of the buffer being filled.
+     * Otherwise it is that of the published buffer.
+     */
     int capacity() const;
     /// Number of MappedEvent objects in the buffer.
+    /**
+     * While filling, this is the size of the buffer being filled.
+     * Otherwise it is that of the published buffer.
+     */
     int size() const;
 
     /// Sets the buffer capacity.
@@ -114,14 +129,26 @@ public:
 
     /// Refresh the buffer
     /**
-     * Called after the segment has been modified.  Resizes the buffer if
-     * needed, then calls fillBuffer() to fill it from the segment.
+     * Called after the segment has been modified.  Calls fillBuffer() to
+     * fill a new buffer from the segment, then publishes it to the
+     * sequencer.
      *
      * Returns true if buffer size changed (and thus the sequencer
      * needs to be told about it).
      */
     bool refresh();
 
+    /// Refresh the buffer after a change to part of the segment
+    /**
+     * from and to are the time range that changed, as accumulated in
+     * the Segment's SegmentRefreshStatus.  If the deriver can regenerate
+     * just that part of the buffer (see fillBufferRange()) only that
+     * part is redone.  Otherwise this is the same as refresh().
+     *
+     * Returns true if buffer size changed.
+     */
+    bool refresh(timeT from, timeT to);
+
     /// Get the earliest and latest sounding times.
     /**
      * Called by MappedBufMetaIterator::fetchEvents() and
@@ -129,14 +156,20 @@ public:
      *
      * @see setStartEnd()
      */
-    void getStartEnd(RealTime &start, RealTime &end) const {
-        start = m_start;
-        end   = m_end;
-    }
+    void getStartEnd(RealTime &start, RealTime &end) const;
 
     virtual TrackId getTrackID() const  { return NoTrack; }
     virtual void insertChannelSetup(MappedInserterBase &)  { }
 
+    /// Number of times any MappedEventBuffer has published.
+    /**
+     * Some mappers (metronome, tempo, time signature) republish without
+     * telling the sequencer.  MappedBufMetaIterator compares this with
+     * what it saw last to know when its iterators need a fresh look.
+     * Wraps around, so only compare for equality.
+     */
+    static int getPublishCount();
+
 protected:
     /* Virtual functions */
 
@@ -195,6 +228,18 @@ protected:
      */
     virtual void fillBuffer() = 0;
 
+    /// Regenerate only the part of the buffer mapped from [from, to]
+    /**
+     * Derivers that can do this override it.  Returns false if the
+     * change can't be handled incrementally (e.g. the segment's
+     * structure changed) in which case the caller falls back to
+     * fillBuffer().  The default always returns false.
+     *
+     * @see refresh(timeT, timeT)
+     */
+    virtual bool fillBufferRange(timeT /*from*/, timeT /*to*/)
+        { return false; }
+
     /// Return whether the event would even sound.
     /**
      * For instance, it might be on a muted track and shouldn't be
@@ -214,7 +259,7 @@ protected:
     /// Earliest sounding time.
     /**
      * It is the responsibility of "fillBuffer()" to keep this field
-     * up to date.
+     * up to date.  It is published along with the events.
      *
      * @see m_end
      */
@@ -223,7 +268,7 @@ protected:
     /// Latest sounding time.
     /**
      * It is the responsibility of "fillBuffer()" to keep this field
-     * up to date.
+     * up to date.  It is published along with the events.
      *
      * @see m_start
      */
@@ -250,8 +295,7 @@ private:
     MappedEventBuffer &operator=(const MappedEventBuffer &);
 
     // MEBIterator needs:
-    //   m_buffer
-    //   m_lock
+    //   getSnapshot()
     //   makeReady()
     //   shouldPlay()
     //   doInsert()
@@ -259,37 +303,66 @@ private:
     //     just make those public and get rid of this.
     friend class MEBIterator;
 
-    /// The Mapped Event Buffer
-    MappedEvent *m_buffer;
+    /// One complete fill of the buffer.
+    /**
+     * Once published, a Snapshot is never modified.  It is deleted by
+     * the Scavenger a while after it has been replaced.
+     */
+    struct Snapshot
+    {
+        explicit Snapshot(int capacity);
+        ~Snapshot();
+
+        MappedEvent *events;
+        int capacity;
+        int size;
+
+        // Copies of m_start and m_end at the time of publishing.
+        RealTime start;
+        RealTime end;
 
-    /// Capacity of the buffer.
+    private:
+        Snapshot(const Snapshot &);
+        Snapshot &operator=(const Snapshot &);
+    };
+
+    /// The most recently published Snapshot.  For readers.
     /**
-     * ??? While storeRelease() is used with this, it's somewhat dubious
-     *     as to whether that is necessary.  There are no other uses
-     *     of m_capacity anywhere near that one.  It's very likely that
-     *     QAtomicInt is not needed here.
+     * Lock-free.  The pointer may be used until the sequencer thread
+     * returns from the current call into MappedBufMetaIterator.
+     * Returns nullptr if nothing has been published yet.
      */
-    mutable QAtomicInt m_capacity;
+    const Snapshot *getSnapshot() const  { return m_current.loadAcquire(); }
 
-    /// Number of events in the buffer.
+    /// Start filling a new Snapshot.
     /**
-     * ??? We only use load() and store().  This doesn't need to be a
-     *     QAtomicInt.
+     * If keepContents is true, the new Snapshot starts out as a copy
+     * of the current one.  fillBufferRange() needs this.
      */
-    mutable QAtomicInt m_size;
+    void beginWrite(int capacity, bool keepContents);
+    /// Make the Snapshot being filled visible to the sequencer.
+    void publish();
+    /// Throw away the Snapshot being filled.
+    void abandonWrite();
 
-    /// Lock for reserve() and callers to iterator::peek()
+    /// Where replaced Snapshots go to die.
     /**
-     * Used by reserve() to lock the swapping of the old for the new
-     * and the changing of the buffer capacity.
-     *
-     * Used by callers to MappedEventBuffer::iterator::peek() to
-     * ensure that buffer isn't reallocated while the caller is
-     * holding the current item.  Doing so avoids the scenario where
-     * peek() gets a pointer to the element and then reserve() swaps
-     * the entire buffer out from under it.
+     * Shared by all MappedEventBuffers.  claim() and scavenge() are only
+     * ever called from the GUI thread (by publish()).
+     */
+    static Scavenger<Snapshot> &getScavenger();
+
+    /// For getPublishCount().  Bumped by publish().
+    static QAtomicInt &getPublishCounter();
+
+    /// The published Snapshot.  Read by the sequencer thread.
+    QAtomicPointer<Snapshot> m_current;
+
+    /// The Snapshot being filled.  Only touched by the GUI thread.
+    /**
+     * Only non-null during init() and refresh().
      */
-    QReadWriteLock m_lock;
+    Snapshot *m_writeBuffer;
 
     /// How many metaiterators share this mapper.
     /**
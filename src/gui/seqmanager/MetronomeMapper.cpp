@@ -24,6 +24,7 @@
 #include "base/MidiProgram.h"  // For InstrumentId
 #include "base/RealTime.h"
 #include "base/Studio.h"
+#include "base/TempoMap.h"
 #include "base/TimeT.h"
 #include "document/RosegardenDocument.h"
 #include "gui/seqmanager/MappedEventBuffer.h"
@@ -36,6 +37,7 @@
 #include <QSettings>
 
 #include <algorithm>  // For std::sort().
+#include <vector>
 
 namespace Rosegarden
 {
@@ -182,6 +184,17 @@ void MetronomeMapper::fillBuffer()
 
     const RealTime tickDuration(0, 100000000);
 
+    // Convert all the tick times in one go.  With MIDI clock on there
+    // are 24 ticks per beat, so this is worth it.
+    std::vector<timeT> tickTimes;
+    tickTimes.reserve(m_ticks.size());
+    for (const Tick &tick : m_ticks) {
+        tickTimes.push_back(tick.first);
+    }
+    std::vector<RealTime> eventTimes(tickTimes.size());
+    composition.getTempoMap()->toRealTime(
+            tickTimes.data(), eventTimes.data(), tickTimes.size());
+
     int index = 0;
 
     // For each tick
@@ -191,7 +204,7 @@ void MetronomeMapper::fillBuffer()
 
         //RG_DEBUG << "fillBuffer(): velocity = " << int(velocity);
 
-        RealTime eventTime = composition.getElapsedRealTime(tick->first);
+        const RealTime &eventTime = eventTimes[index];
 
         MappedEvent e;
 
@@ -22,6 +22,8 @@
 
 #include <QString>
 
+#include <rosegardenprivate_export.h>
+
 namespace Rosegarden
 {
 
@@ -29,7 +31,7 @@ namespace Rosegarden
 class Segment;
 class RosegardenDocument;
 
-class SegmentMapper : public MappedEventBuffer
+class ROSEGARDENPRIVATE_EXPORT SegmentMapper : public MappedEventBuffer
 {
 
 public:
@@ -380,6 +380,8 @@ private:
     void segmentAdded(Segment *);
     /// Inform CompositionMapper and RosegardenSequencer that a Segment has changed.
     void segmentModified(Segment *);
+    /// Same, but only [from, to] of the Segment has changed.
+    void segmentModified(Segment *, timeT from, timeT to);
     /**
      * Remove Segment from CompositionMapper, RosegardenSequencer, and the
      * SegmentRefreshMap (m_segments).
@@ -174,6 +174,45 @@ bool Preferences::getJACKLoadCheck()
     return jackLoadCheck.get();
 }
 
+PreferenceInt audioMixerThreads(
+        SequencerOptionsConfigGroup, "audioMixerThreads", 0);
+
+void Preferences::setAudioMixerThreads(int threads)
+{
+    audioMixerThreads.set(threads);
+}
+
+int Preferences::getAudioMixerThreads()
+{
+    return audioMixerThreads.get();
+}
+
+PreferenceInt audioCacheSize(
+        SequencerOptionsConfigGroup, "audioCacheSize", 256);
+
+void Preferences::setAudioCacheSize(int megabytes)
+{
+    audioCacheSize.set(megabytes);
+}
+
+int Preferences::getAudioCacheSize()
+{
+    return audioCacheSize.get();
+}
+
+PreferenceBool resampleAudioFiles(
+        SequencerOptionsConfigGroup, "resampleAudioFiles", false);
+
+void Preferences::setResampleAudioFiles(bool value)
+{
+    resampleAudioFiles.set(value);
+}
+
+bool Preferences::getResampleAudioFiles()
+{
+    return resampleAudioFiles.get();
+}
+
 PreferenceBool bug1623(ExperimentalConfigGroup, "bug1623", false);
 
 bool Preferences::getBug1623()
@@ -85,6 +85,18 @@ namespace Preferences
     void setJACKLoadCheck(bool value);
     bool getJACKLoadCheck();
 
+    /// Threads used to process audio instruments.  0 means automatic.
+    void setAudioMixerThreads(int threads);
+    int getAudioMixerThreads();
+
+    /// Memory for decoded audio file data, in MB.  See AudioCache.
+    void setAudioCacheSize(int megabytes);
+    int getAudioCacheSize();
+
+    /// Keep copies of audio files at the JACK rate.  See AudioFileResampler.
+    void setResampleAudioFiles(bool value);
+    bool getResampleAudioFiles();
+
     void setShowNoteNames(bool value);
     bool getShowNoteNames();
 
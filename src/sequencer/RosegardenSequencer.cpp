@@ -56,8 +56,8 @@ RosegardenSequencer::RosegardenSequencer() :
     m_transportStatus(STOPPED),
     m_songPosition(0, 0),
     m_lastFetchSongPosition(0, 0),
-    // 160 msecs for low latency mode.  Historically, we used
-    // 500 msecs for "high" latency mode.
+    // Set from m_scheduler by startPlaying() and keepPlaying().
+    // Historically, a fixed 160 msecs.
     m_readAhead(0, 160000000),
     // 60 msecs for low latency mode.  Historically, we used
     // 400 msecs for "high" latency mode.
@@ -170,6 +170,7 @@ RosegardenSequencer::quit()
 #endif
     // and break out of the loop next time around
     m_transportStatus = QUIT;
+    wake();
 }
 
 
@@ -183,9 +184,6 @@ RosegardenSequencer::play(const RealTime &time)
 {
     LOCKED;
 
-    // ??? Precondition: readAhead should be larger than the JACK
-    //     (m_driver) period size.
-
     if (m_transportStatus == PLAYING ||
         m_transportStatus == STARTING_TO_PLAY)
         return true;
@@ -209,6 +207,7 @@ RosegardenSequencer::play(const RealTime &time)
         m_transportStatus != STARTING_TO_RECORD) {
         m_transportStatus = STARTING_TO_PLAY;
     }
+    wake();
 
     m_driver->stopClocks();
 
@@ -233,9 +232,6 @@ RosegardenSequencer::record(const RealTime &time,
 {
     LOCKED;
 
-    // ??? Precondition: readAhead should be larger than the JACK
-    //     (m_driver) period size.
-
     TransportStatus localRecordMode = (TransportStatus) recordMode;
 
 #ifdef DEBUG_ROSEGARDEN_SEQUENCER
@@ -333,6 +329,7 @@ RosegardenSequencer::record(const RealTime &time,
     //
     //
     m_transportStatus = localRecordMode;
+    wake();
 
     if (localRecordMode == RECORDING) { // punch in
         return true;
@@ -354,6 +351,7 @@ RosegardenSequencer::stop(bool autoStop)
     // set our state at this level to STOPPING (pending any
     // unfinished NOTES)
     m_transportStatus = STOPPING;
+    wake();
 
     // report
     //
@@ -388,6 +386,7 @@ RosegardenSequencer::punchOut()
     if (m_transportStatus == RECORDING) {
         m_driver->punchOut();
         m_transportStatus = PLAYING;
+        wake();
         return true;
     }
     return false;
@@ -437,7 +436,8 @@ RosegardenSequencer::jumpTo(const RealTime &pos)
 
     m_driver->startClocks();
 
-    return ;
+    // Fetch from here.
+    wake();
 }
 
 void
@@ -466,6 +466,9 @@ RosegardenSequencer::setLoop(
         // Handle as appropriate in updateClocks().
         m_withinLoop = inLoop;
     }
+
+    // getSleepTime() may need to wake at the new loop end.
+    wake();
 }
 
 unsigned
@@ -520,10 +523,15 @@ RosegardenSequencer::setMappedInstrument(int type, unsigned int id)
 void
 RosegardenSequencer::processMappedEvent(MappedEvent mE)
 {
-    QMutexLocker locker(&m_asyncQueueMutex);
-    m_asyncOutQueue.push_back(new MappedEvent(mE));
-//    SEQUENCER_DEBUG << "processMappedEvent: Have " << m_asyncOutQueue.size()
-//                    << " events in async out queue" << endl;
+    {
+        QMutexLocker locker(&m_asyncQueueMutex);
+        m_asyncOutQueue.push_back(new MappedEvent(mE));
+//        SEQUENCER_DEBUG << "processMappedEvent: Have " << m_asyncOutQueue.size()
+//                        << " events in async out queue" << endl;
+    }
+
+    // Send it now rather than at the end of the main loop's sleep.
+    wake();
 }
 
 bool
@@ -595,6 +603,8 @@ RosegardenSequencer::setConnection(unsigned int deviceId,
     LOCKED;
 
     m_driver->setConnection(deviceId, connection);
+
+    wake();
 }
 
 void
@@ -679,6 +689,9 @@ RosegardenSequencer::setMappedProperty(int id,
 
     if (object)
         object->setProperty(property, value);
+
+    // processPending() hands level and routing changes to JACK.
+    wake();
 }
 
 void
@@ -704,6 +717,8 @@ RosegardenSequencer::setMappedProperties(const MappedObjectIdList &ids,
             object->setProperty(properties[i], values[i]);
         }
     }
+
+    wake();
 }
 
 void
@@ -721,6 +736,8 @@ RosegardenSequencer::setMappedProperty(int id,
     MappedObject *object = m_studio->getObjectById(id);
 
     if (object) object->setStringProperty(property, value);
+
+    wake();
 }
 
 QString
@@ -742,6 +759,7 @@ RosegardenSequencer::setMappedPropertyList(int id, const QString &property,
         } catch (QString& err) {
             return err;
         }
+        wake();
         return "";
     }
 
@@ -1030,8 +1048,6 @@ void RosegardenSequencer::dumpFirstSegment()
 
     MEBIterator it(firstMappedEventBuffer);
 
-    QReadLocker locker(it.getLock());
-
     for (; !it.atEnd(); ++it) {
 
         MappedEvent *evt = it.peek();
@@ -1068,6 +1084,8 @@ RosegardenSequencer::segmentModified(QSharedPointer<MappedEventBuffer> mapper)
       might be introduced. */
    bool immediate = (m_transportStatus == PLAYING);
    m_metaIterator.resetIteratorForBuffer(mapper, immediate);
+   // Get the changes out with the next slice.
+   wake();
 }
 
 void
@@ -1083,6 +1101,7 @@ RosegardenSequencer::segmentAdded(QSharedPointer<MappedEventBuffer> mapper)
     // m_metaIterator takes ownership of the mapper, shared with other
     // MappedBufMetaIterators
     m_metaIterator.addBuffer(mapper);
+    wake();
 }
 
 void
@@ -1122,6 +1141,7 @@ RosegardenSequencer::remapTracks()
     SEQUENCER_DEBUG << "RosegardenSequencer::remapTracks";
 #endif
     rationalisePlayingAudio();
+    wake();
 }
 
 bool
@@ -1217,6 +1237,9 @@ RosegardenSequencer::applyLatencyCompensation(MappedEventList &mappedEventList)
         (*i)->setEventTime((*i)->getEventTime() +
                            maxLatency - instrumentLatency);
     }
+
+    // Instruments with different latencies may have swapped places.
+    mappedEventList.sort();
 }
 
 
@@ -1227,6 +1250,10 @@ RosegardenSequencer::applyLatencyCompensation(MappedEventList &mappedEventList)
 bool
 RosegardenSequencer::startPlaying()
 {
+    // Read-ahead should be larger than the JACK (m_driver) period size.
+    m_scheduler.reset(m_driver->getAudioPlayLatency());
+    m_readAhead = m_scheduler.getReadAhead();
+
     // Fetch up to m_readAhead microseconds worth of events
     m_lastFetchSongPosition = m_songPosition + m_readAhead;
 
@@ -1261,24 +1288,28 @@ RosegardenSequencer::keepPlaying()
 {
     //Profiler profiler("RosegardenSequencer::keepPlaying()");
 
+    // Adapted to how late we've been waking up.
+    m_readAhead = m_scheduler.getReadAhead();
+
     RealTime fetchEnd = m_songPosition + m_readAhead;
 
     // If we are looping, don't fetch past the end of the loop.
     if (isLooping()  &&  fetchEnd >= m_loopEnd)
         fetchEnd = m_loopEnd - RealTime(0, 1);
 
-    MappedEventList mappedEventList;
+    // Reused from slice to slice so that it doesn't allocate.
+    m_sliceEvents.clear();
 
     // If time has actually moved, get the events.
     if (fetchEnd > m_lastFetchSongPosition) {
         fetchEvents(
-                mappedEventList, m_lastFetchSongPosition, fetchEnd, false);
+                m_sliceEvents, m_lastFetchSongPosition, fetchEnd, false);
     }
 
     // Again, process whether we need to or not to keep
     // the Sequencer up-to-date with audio events
     m_driver->processEventsOut(
-            mappedEventList, m_lastFetchSongPosition, fetchEnd);
+            m_sliceEvents, m_lastFetchSongPosition, fetchEnd);
 
     if (fetchEnd > m_lastFetchSongPosition)
         m_lastFetchSongPosition = fetchEnd;
@@ -1356,6 +1387,48 @@ RosegardenSequencer::sleep(const RealTime &rt)
     m_driver->sleep(rt);
 }
 
+RealTime
+RosegardenSequencer::getSleepTime() const
+{
+    if (m_transportStatus != PLAYING  &&  m_transportStatus != RECORDING) {
+        // Don't let notes sent by processMappedEvent() ring on until
+        // the next housekeeping wake up.
+        RealTime untilNoteOff;
+        if (m_driver->getTimeToNextNoteOff(untilNoteOff))
+            return SequencerScheduler::getStoppedSleep(untilNoteOff);
+
+        return SequencerScheduler::getStoppedSleep();
+    }
+
+    // keepPlaying() doesn't fetch past the loop end, so there's nothing
+    // more to fetch until updateClocks() jumps back to the loop start.
+    // Wake for that instead.
+    if (isLooping()  &&  m_lastFetchSongPosition >= m_loopEnd - RealTime(0, 1)) {
+        return std::min(m_scheduler.getPlayingSleep(RealTime(1, 0)),
+                        std::max(m_loopEnd - m_songPosition,
+                                 RealTime::zero()));
+    }
+
+    return m_scheduler.getPlayingSleep(
+            m_lastFetchSongPosition - m_songPosition);
+}
+
+void
+RosegardenSequencer::wokeUp(const RealTime &asked, const RealTime &actual)
+{
+    if (m_transportStatus != PLAYING  &&  m_transportStatus != RECORDING)
+        return;
+
+    m_scheduler.woke(asked, actual);
+}
+
+void
+RosegardenSequencer::wake()
+{
+    if (m_driver)
+        m_driver->wake();
+}
+
 void
 RosegardenSequencer::processRecordedMidi()
 {
@@ -1491,23 +1564,12 @@ RosegardenSequencer::applyFiltering(MappedEventList *mC,
                                        MidiFilter filter,
                                        bool filterControlDevice)
 {
-    // For each event in the list
-    for (MappedEventList::iterator i = mC->begin();
-         i != mC->end();
-         /* increment in loop */) {
-
-        // Hold on to the current event for processing.
-        MappedEventList::iterator j = i;
-        // Move to the next in case the current is erased.
-        ++i;
-
-        // If this event matches the filter, erase it from the list
-        if (((*j)->getType() & filter) ||
-                (filterControlDevice && ((*j)->getRecordedDevice() ==
-                                         Device::EXTERNAL_CONTROLLER))) {
-            mC->erase(j);
-        }
-    }
+    // Erase each event that matches the filter.
+    mC->eraseIf([filter, filterControlDevice](const MappedEvent &event) {
+        return (event.getType() & filter)  ||
+               (filterControlDevice  &&
+                event.getRecordedDevice() == Device::EXTERNAL_CONTROLLER);
+    });
 }
 
 // Initialise the virtual studio with a few audio faders and
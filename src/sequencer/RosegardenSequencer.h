@@ -20,6 +20,7 @@
 #include "sound/MappedEventList.h"
 #include "sound/MappedStudio.h"  // MappedObjectIdList, etc...
 #include "sound/MappedBufMetaIterator.h"
+#include "sequencer/SequencerScheduler.h"
 
 #include "base/MidiDevice.h"
 
@@ -396,15 +397,36 @@ public:
      */
     void processAsynchronousEvents();
 
-    /// Sleep for the given time, approximately.
+    /// Sleep for up to the given time.
     /**
-     * Called from the main loop in order to lighten CPU load (i.e. the
-     * timing quality of the sequencer does not depend on this being
-     * accurate).  A good implementation of this call would return right
-     * away when an incoming MIDI event needed to be handled.
+     * Called from the main loop in order to lighten CPU load.  Returns
+     * early when wake() is called, and with AlsaDriver, when MIDI comes
+     * in.
      */
     void sleep(const RealTime &rt);
 
+    /// How long the main loop can sleep() before there's work to do.
+    /**
+     * While playing, that's just before the events already sent to the
+     * driver run out, or the loop end.  While stopped, it's when the
+     * first pending note-off is due.  See SequencerScheduler.
+     */
+    RealTime getSleepTime() const;
+
+    /// Report how long a sleep() of getSleepTime() actually took.
+    /**
+     * Adapts the read-ahead to how late the main loop gets to run.
+     */
+    void wokeUp(const RealTime &asked, const RealTime &actual);
+
+    /// Have the main loop run now rather than at the end of its sleep().
+    /**
+     * Called by the API above that gives the main loop work to do, so that
+     * the GUI doesn't wait on a polling interval.  Safe to call from any
+     * thread.
+     */
+    void wake();
+
     /// Removes events not matching a MidiFilter from a MappedEventsList.
     /**
      * From the menu, Studio > Modify MIDI Filters... allows the user to
@@ -521,6 +543,15 @@ private:
     MappedBufMetaIterator m_metaIterator;
     RealTime m_lastStartTime;
 
+    /// The events for each keepPlaying() slice.
+    /**
+     * Kept so that its storage is reused.  See MappedEventList.
+     */
+    MappedEventList m_sliceEvents;
+
+    /// How long to sleep and how far to read ahead.
+    SequencerScheduler m_scheduler;
+
     /**
      * m_asyncOutQueue is not a MappedEventList: order of receipt
      * matters in ordering, timestamp doesn't
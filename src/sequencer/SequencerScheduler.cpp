@@ -0,0 +1,105 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "SequencerScheduler.h"
+
+#include <algorithm>
+
+namespace Rosegarden
+{
+
+
+namespace
+{
+    // Read-ahead with no lateness at all.  Was a fixed 160msecs.
+    const RealTime a_baseReadAhead(0, 60000000);
+    // Beyond this, something is badly wrong and fetching further won't
+    // help.
+    const RealTime a_maxReadAhead(1, 0);
+    // Read-ahead per unit of lateness.
+    constexpr double a_readAheadPerJitter = 4;
+
+    // Wake this long before queued events run out, plus lateness.
+    const RealTime a_baseMargin(0, 5000000);
+    constexpr double a_marginPerJitter = 2;
+
+    // Keeps the position pointer smooth.  The GUI reads it every 50msecs.
+    const RealTime a_maxPlayingSleep(0, 20000000);
+    // Never spin.
+    const RealTime a_minSleep(0, 1000000);
+
+    const RealTime a_stoppedSleep(1, 0);
+
+    // The lateness peak decays by 1/a_decayWakes of the way to each new
+    // measurement.  At a_maxPlayingSleep that's a few seconds.
+    constexpr int a_decayWakes = 200;
+}
+
+SequencerScheduler::SequencerScheduler() :
+    m_minimumReadAhead(RealTime::zero()),
+    m_jitter(RealTime::zero())
+{
+}
+
+void
+SequencerScheduler::reset(const RealTime &minimumReadAhead)
+{
+    m_minimumReadAhead = std::max(minimumReadAhead, RealTime::zero());
+    m_jitter = RealTime::zero();
+}
+
+void
+SequencerScheduler::woke(const RealTime &asked, const RealTime &actual)
+{
+    // Woken early (by wake()) counts as on time.
+    const RealTime late = std::max(actual - asked, RealTime::zero());
+
+    if (late > m_jitter)
+        m_jitter = late;
+    else
+        m_jitter = m_jitter - (m_jitter - late) / a_decayWakes;
+}
+
+RealTime
+SequencerScheduler::getReadAhead() const
+{
+    const RealTime readAhead = m_minimumReadAhead + a_baseReadAhead +
+            m_jitter * a_readAheadPerJitter;
+
+    return std::min(readAhead, m_minimumReadAhead + a_maxReadAhead);
+}
+
+RealTime
+SequencerScheduler::getPlayingSleep(const RealTime &queuedAhead) const
+{
+    const RealTime margin = a_baseMargin + m_jitter * a_marginPerJitter;
+
+    return std::max(a_minSleep,
+                    std::min(a_maxPlayingSleep, queuedAhead - margin));
+}
+
+RealTime
+SequencerScheduler::getStoppedSleep()
+{
+    return a_stoppedSleep;
+}
+
+RealTime
+SequencerScheduler::getStoppedSleep(const RealTime &untilNoteOff)
+{
+    return std::max(a_minSleep, std::min(a_stoppedSleep, untilNoteOff));
+}
+
+
+}
@@ -0,0 +1,99 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A MIDI and audio sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_SEQUENCER_SCHEDULER_H
+#define RG_SEQUENCER_SCHEDULER_H
+
+#include "base/RealTime.h"
+
+#include <rosegardenprivate_export.h>
+
+namespace Rosegarden
+{
+
+
+/// How long the sequencer thread sleeps and how far ahead it fetches.
+/**
+ * The sequencer thread used to wake every 10msecs and fetch a fixed
+ * 160msecs ahead.  Now it sleeps until it is woken (see
+ * SoundDriver::wake()) or until the events it has sent are about to
+ * run out, and it fetches just far enough ahead to cover how late it
+ * has been waking up.
+ *
+ * Lateness is tracked as a peak that decays slowly, so a single stall
+ * (a long edit holding the sequencer lock, say) raises the read-ahead
+ * straight away and it then comes back down over a few seconds.
+ *
+ * Owned by RosegardenSequencer and only used by the sequencer thread.
+ */
+class ROSEGARDENPRIVATE_EXPORT SequencerScheduler
+{
+public:
+    SequencerScheduler();
+
+    /// Forget the lateness measured so far.  Call when playback starts.
+    /**
+     * minimumReadAhead is added to the read-ahead.  Use the audio play
+     * latency, so that audio events reach JACK at least a period early.
+     */
+    void reset(const RealTime &minimumReadAhead);
+
+    /// Report how long a sleep of "asked" actually took.
+    /**
+     * "actual" should run to when the sequencer thread has the lock
+     * back and is ready to work, so it includes waiting for the GUI.
+     */
+    void woke(const RealTime &asked, const RealTime &actual);
+
+    /// Current estimate of how late a wake up can be.
+    RealTime getJitter() const  { return m_jitter; }
+
+    /// How far ahead of the play position to fetch events.
+    RealTime getReadAhead() const;
+
+    /// How long to sleep while playing.
+    /**
+     * queuedAhead is how far past the play position events have already
+     * been sent to the driver.  The sleep ends early enough to fetch
+     * more before those run out, but never longer than it takes for
+     * the position pointer and recorded MIDI to stay responsive.
+     */
+    RealTime getPlayingSleep(const RealTime &queuedAhead) const;
+
+    /// How long to sleep while stopped.
+    /**
+     * There's no deadline when stopped.  The GUI wakes us when it has
+     * work, and AlsaDriver wakes on MIDI input.  This is just often
+     * enough for housekeeping, e.g. checkForNewClients().
+     */
+    static RealTime getStoppedSleep();
+
+    /// How long to sleep while stopped, with note-offs pending.
+    /**
+     * While stopped, note-offs (e.g. for notes previewed through
+     * RosegardenSequencer::processMappedEvent()) are only sent by
+     * SoundDriver::processPending().  untilNoteOff is how long until the
+     * first of them is due.  See SoundDriver::getTimeToNextNoteOff().
+     */
+    static RealTime getStoppedSleep(const RealTime &untilNoteOff);
+
+private:
+    RealTime m_minimumReadAhead;
+    RealTime m_jitter;
+};
+
+
+}
+
+#endif
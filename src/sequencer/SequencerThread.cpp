@@ -20,6 +20,7 @@
 #include "base/RealTime.h"
 #include "RosegardenSequencer.h"
 #include "gui/application/TransportStatus.h"
+#include "sound/RealTimeLog.h"
 
 #include <QElapsedTimer>
 
@@ -36,11 +37,12 @@ SequencerThread::run()
 
     TransportStatus lastSeqStatus = seq.getStatus();
 
-    const RealTime sleepTime = RealTime::fromMilliseconds(10);
-
     QElapsedTimer timer;
     timer.start();
 
+    // For measuring how late we wake up.
+    QElapsedTimer sleepTimer;
+
     bool exiting = false;
 
     seq.lock();
@@ -157,26 +159,41 @@ SequencerThread::run()
             atLeisure = false;
         }
 
+        // Print anything the audio threads have logged.
+        RealTimeLog::drain();
+
         // Every second
         if (timer.elapsed() > 1000) {
             seq.checkForNewClients();
             timer.restart();
         }
 
+        // Until there's something to do.  See SequencerScheduler.
+        const RealTime sleepTime = seq.getSleepTime();
+
         seq.unlock();
 
         // permitting synchronised calls from the gui or wherever to
         // be made now
 
-        // If the sequencer status hasn't changed, sleep for a bit
+        // If the sequencer status hasn't changed, sleep until there's
+        // something to do.  The GUI wakes us when it has something
+        // for us (e.g. play()), so there's no delay between pressing
+        // play and playing.
         if (atLeisure) {
-            // ??? Could we use a QWaitCondition/QMutex here to reduce the
-            //     (upwards of sleepTime) delay between pressing play and
-            //     playing?
+            sleepTimer.start();
+
             seq.sleep(sleepTime);
-        }
 
-        seq.lock();
+            seq.lock();
+
+            // Including any wait for the lock.
+            const qint64 nsecs = sleepTimer.nsecsElapsed();
+            seq.wokeUp(sleepTime, RealTime(int(nsecs / 1000000000),
+                                           int(nsecs % 1000000000)));
+        } else {
+            seq.lock();
+        }
     }
 
     seq.unlock();
@@ -63,6 +63,8 @@
 //#include <pthread.h>
 #include <math.h>
 #include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 
 
 //#define DEBUG_ALSA 1
@@ -134,6 +136,7 @@ AlsaDriver::AlsaDriver(MappedStudio *studio):
     m_startPlayback(false),
     m_midiHandle(nullptr),
     m_client( -1),
+    m_wakeFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
     m_inputPort( -1),
     m_syncOutputPort( -1),
     m_externalControllerPort( -1),
@@ -211,6 +214,9 @@ AlsaDriver::~AlsaDriver()
     delete m_pendSysExcMap;
 
     clearRecentNoteOffs();
+
+    if (m_wakeFd >= 0)
+        close(m_wakeFd);
 }
 
 int
@@ -3742,7 +3748,7 @@ AlsaDriver::processMidiOut(const MappedEventList &rgEventList,
     // hard to follow.
     std::string sysExData;
 
-    // NB the MappedEventList is implicitly ordered by time (std::multiset)
+    // NB the MappedEventList is implicitly ordered by time
 
     // For each incoming mapped (Rosegarden) event
     for (MappedEvent *rgEvent : rgEventList) {
@@ -3957,6 +3963,7 @@ AlsaDriver::processMidiOut(const MappedEventList &rgEventList,
                 LevelInfo info;
                 info.level = rgEvent->getVelocity();
                 info.levelRight = 0;
+                info.rms = info.rmsRight = 0;
                 SequencerDataBlock::getInstance()->setInstrumentLevel
                     (rgEvent->getInstrument(), info);
             }
@@ -4936,6 +4943,17 @@ AlsaDriver::processPending()
     m_audioQueueScavenger.scavenge();
 }
 
+bool
+AlsaDriver::getTimeToNextNoteOff(RealTime &untilNoteOff)
+{
+    if (m_noteOffQueue.empty())
+        return false;
+
+    // m_noteOffQueue is in time order.
+    untilNoteOff = (*m_noteOffQueue.begin())->realTime - getAlsaTime();
+    return true;
+}
+
 void
 AlsaDriver::insertMappedEventForReturn(MappedEvent *mE)
 {
@@ -5465,9 +5483,45 @@ AlsaDriver::sleep(const RealTime &rt)
 {
     int npfd = snd_seq_poll_descriptors_count(m_midiHandle, POLLIN);
     // cppcheck-suppress allocaCalled
-    struct pollfd *pfd = (struct pollfd *)alloca(npfd * sizeof(struct pollfd));
+    struct pollfd *pfd =
+            (struct pollfd *)alloca((npfd + 1) * sizeof(struct pollfd));
     snd_seq_poll_descriptors(m_midiHandle, pfd, npfd, POLLIN);
-    poll(pfd, npfd, rt.sec * 1000 + rt.msec());
+
+    // Wake on MIDI input or wake(), whichever comes first.
+    if (m_wakeFd >= 0) {
+        pfd[npfd].fd = m_wakeFd;
+        pfd[npfd].events = POLLIN;
+        pfd[npfd].revents = 0;
+        ++npfd;
+    }
+
+    // poll() only has msec resolution, and the sequencer thread now
+    // sleeps until a deadline.
+    const RealTime timeout = std::max(rt, RealTime::zero());
+    struct timespec ts;
+    ts.tv_sec = timeout.sec;
+    ts.tv_nsec = timeout.nsec;
+    ppoll(pfd, npfd, &ts, nullptr);
+
+    // Clear any wake() so that the next sleep() isn't cut short.
+    if (m_wakeFd >= 0) {
+        uint64_t count;
+        const ssize_t bytesRead = read(m_wakeFd, &count, sizeof(count));
+        (void)bytesRead;
+    }
+}
+
+void
+AlsaDriver::wake()
+{
+    // No eventfd, so sleep() will have to run to its timeout.
+    if (m_wakeFd < 0)
+        return;
+
+    // Only fails if the count would overflow, and then it's awake anyway.
+    const uint64_t one = 1;
+    const ssize_t written = write(m_wakeFd, &one, sizeof(one));
+    (void)written;
 }
 
 void
@@ -139,6 +139,7 @@ public:
     // Process pending
     //
     void processPending() override;
+    bool getTimeToNextNoteOff(RealTime &untilNoteOff) override;
 
     RealTime getAudioPlayLatency() override {
 #ifdef HAVE_LIBJACK
@@ -362,6 +363,7 @@ public:
     void setLoop(const RealTime &loopStart, const RealTime &loopEnd) override;
 
     void sleep(const RealTime &) override;
+    void wake() override;
 
     // ----------------------- End of Virtuals ----------------------
 
@@ -561,6 +563,9 @@ private:
     /// Rosegarden's ALSA client ID.
     int m_client;
 
+    /// An eventfd that wake() writes to, to end sleep()'s poll().
+    int m_wakeFd;
+
     int                          m_inputPort;
 
     typedef std::map<DeviceId, int /* portNumber */> DeviceIntMap;
@@ -5,7 +5,7 @@
     A sequencer and musical notation editor.
     Copyright 2000-2024 the Rosegarden development team.
     See the AUTHORS file for more details.
- 
+
     This program is free software; you can redistribute it and/or
     modify it under the terms of the GNU General Public License as
     published by the Free Software Foundation; either version 2 of the
@@ -16,116 +16,217 @@
 #define RG_MODULE_STRING "[AudioCache]"
 
 #include "AudioCache.h"
+
 #include "misc/Debug.h"
+#include "misc/Preferences.h"
+
+#include <QMutexLocker>
 
 //#define DEBUG_AUDIO_CACHE 1
 
 namespace Rosegarden
 {
 
+
+const size_t AudioCache::BlockFrames;
+
+AudioCache *
+AudioCache::getInstance()
+{
+    // Guaranteed in C++11 to be lazy initialized and thread-safe.
+    // See ISO/IEC 14882:2011 6.7(4).  The disk thread and the GUI thread
+    // can both be first here.  Never deleted, as the disk thread may
+    // still be reading through it as we go down.
+    static AudioCache *instance = new AudioCache(
+            size_t(Preferences::getAudioCacheSize()) * 1024 * 1024);
+    return instance;
+}
+
+AudioCache::AudioCache(size_t memoryBudget) :
+    m_bytes(0),
+    m_budget(memoryBudget),
+    m_hits(0),
+    m_misses(0),
+    m_evictions(0)
+{
+}
+
 AudioCache::~AudioCache()
 {
-    clear();
+    for (const BlockMap::value_type &pair : m_blocks) {
+        if (pair.second.block.use_count() > 1) {
+            RG_WARNING << "WARNING: AudioCache::~AudioCache: block still in use";
+            break;
+        }
+    }
 }
 
 bool
-AudioCache::has(void *index)
+AudioCache::Key::operator<(const Key &other) const
 {
-    return m_cache.find(index) != m_cache.end();
+    // File first, so that forget() can find all of a file's blocks
+    // together.
+    if (file != other.file)
+        return file < other.file;
+    if (sampleRate != other.sampleRate)
+        return sampleRate < other.sampleRate;
+    if (channels != other.channels)
+        return channels < other.channels;
+    return block < other.block;
+}
+
+AudioCache::BlockPtr
+AudioCache::get(const AudioFile *file, int sampleRate, int channels,
+                size_t block)
+{
+    QMutexLocker locker(&m_mutex);
+
+    BlockMap::iterator i = m_blocks.find(Key{file, sampleRate, channels, block});
+    if (i == m_blocks.end()) {
+        ++m_misses;
+        return BlockPtr();
+    }
+
+    ++m_hits;
+
+    // Most recently used.
+    m_lru.splice(m_lru.begin(), m_lru, i->second.lru);
+
+    return i->second.block;
 }
 
-float **
-AudioCache::getData(void *index, size_t &channels, size_t &frames)
+bool
+AudioCache::has(const AudioFile *file, int sampleRate, int channels,
+                size_t block) const
 {
-    if (m_cache.find(index) == m_cache.end())
-        return nullptr;
-    CacheRec *rec = m_cache[index];
-    channels = rec->channels;
-    frames = rec->nframes;
-    return rec->data;
+    QMutexLocker locker(&m_mutex);
+
+    return m_blocks.find(Key{file, sampleRate, channels, block}) !=
+            m_blocks.end();
 }
 
-void
-AudioCache::addData(void *index, size_t channels, size_t nframes, float **data)
+AudioCache::BlockPtr
+AudioCache::add(const AudioFile *file, int sampleRate, int channels,
+                size_t block, std::shared_ptr<Block> data)
 {
+    QMutexLocker locker(&m_mutex);
+
+    const Key key{file, sampleRate, channels, block};
+
+    BlockMap::iterator i = m_blocks.find(key);
+    if (i != m_blocks.end())
+        return i->second.block;
+
 #ifdef DEBUG_AUDIO_CACHE
-    RG_DEBUG << "AudioCache::addData(" << index << ")";
+    RG_DEBUG << "add(" << file << ", " << sampleRate << ", " << channels << ", " << block << "): " << data->getBytes() << " bytes, " << m_bytes << " cached";
 #endif
 
-    if (m_cache.find(index) != m_cache.end()) {
-        RG_WARNING << "WARNING: AudioCache::addData(" << index << ", "
-        << channels << ", " << nframes
-        << ": already cached";
-        return ;
-    }
+    m_lru.push_front(key);
+
+    Entry &entry = m_blocks[key];
+    entry.block = data;
+    entry.lru = m_lru.begin();
+
+    m_bytes += data->getBytes();
 
-    m_cache[index] = new CacheRec(data, channels, nframes);
+    evict();
+
+    return data;
 }
 
 void
-AudioCache::incrementReference(void *index)
+AudioCache::forget(const AudioFile *file)
 {
-    if (m_cache.find(index) == m_cache.end()) {
-        RG_WARNING << "WARNING: AudioCache::incrementReference(" << index
-        << "): not found";
-        return ;
+    QMutexLocker locker(&m_mutex);
+
+    BlockMap::iterator i = m_blocks.lower_bound(Key{file, 0, 0, 0});
+
+    while (i != m_blocks.end()  &&  i->first.file == file) {
+        m_bytes -= i->second.block->getBytes();
+        m_lru.erase(i->second.lru);
+        i = m_blocks.erase(i);
     }
-    ++m_cache[index]->refCount;
+}
 
-#ifdef DEBUG_AUDIO_CACHE
-    RG_DEBUG << "AudioCache::incrementReference(" << index << ") [to " << (m_cache[index]->refCount) << "]";
-#endif
+void
+AudioCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+
+    const size_t budget = m_budget;
+    m_budget = 0;
+    evict();
+    m_budget = budget;
 }
 
 void
-AudioCache::decrementReference(void *index)
+AudioCache::setMemoryBudget(size_t bytes)
 {
-    std::map<void *, CacheRec *>::iterator i = m_cache.find(index);
+    QMutexLocker locker(&m_mutex);
 
-    if (i == m_cache.end()) {
-        RG_WARNING << "WARNING: AudioCache::decrementReference(" << index
-        << "): not found";
-        return ;
-    }
-    if (i->second->refCount <= 1) {
-        delete i->second;
-        m_cache.erase(i);
-#ifdef DEBUG_AUDIO_CACHE
-        RG_DEBUG << "AudioCache::decrementReference(" << index << ") [deleting]";
-#endif
+    m_budget = bytes;
+    evict();
+}
 
-    } else {
-        --i->second->refCount;
-#ifdef DEBUG_AUDIO_CACHE
-        RG_DEBUG << "AudioCache::decrementReference(" << index << ") [to " << (m_cache[index]->refCount) << "]";
-#endif
+size_t
+AudioCache::getMemoryBudget() const
+{
+    QMutexLocker locker(&m_mutex);
 
-    }
+    return m_budget;
 }
 
-void
-AudioCache::clear()
+AudioCache::Statistics
+AudioCache::getStatistics() const
 {
-#ifdef DEBUG_AUDIO_CACHE
-    RG_DEBUG << "AudioCache::clear()";
-#endif
+    QMutexLocker locker(&m_mutex);
 
-    for (std::map<void *, CacheRec *>::iterator i = m_cache.begin();
-            i != m_cache.end(); ++i) {
-        if (i->second->refCount > 0) {
-            RG_WARNING << "WARNING: AudioCache::clear: deleting cached data with refCount " << i->second->refCount;
-        }
-    }
-    m_cache.clear();
+    Statistics statistics;
+    statistics.hits = m_hits;
+    statistics.misses = m_misses;
+    statistics.evictions = m_evictions;
+    statistics.blocks = long(m_blocks.size());
+    statistics.bytes = m_bytes;
+    statistics.budget = m_budget;
+
+    return statistics;
 }
 
-AudioCache::CacheRec::~CacheRec()
+void
+AudioCache::resetStatistics()
 {
-    for (size_t j = 0; j < channels; ++j)
-        delete[] data[j];
-    delete[] data;
+    QMutexLocker locker(&m_mutex);
+
+    m_hits = 0;
+    m_misses = 0;
+    m_evictions = 0;
 }
 
+void
+AudioCache::evict()
+{
+    LRUList::iterator lru = m_lru.end();
+
+    while (m_bytes > m_budget  &&  lru != m_lru.begin()) {
+        --lru;
+
+        BlockMap::iterator i = m_blocks.find(*lru);
+
+        // Still in use?  Leave it.  Only we can hand out new references,
+        // so this can't go from 1 to more behind our back.
+        if (i->second.block.use_count() > 1)
+            continue;
+
+#ifdef DEBUG_AUDIO_CACHE
+        RG_DEBUG << "evict(): dropping block " << i->first.block << " of " << i->first.file;
+#endif
+
+        m_bytes -= i->second.block->getBytes();
+        m_blocks.erase(i);
+        lru = m_lru.erase(lru);
+        ++m_evictions;
+    }
 }
 
 
+}
@@ -16,78 +16,180 @@
 #ifndef RG_AUDIO_CACHE_H
 #define RG_AUDIO_CACHE_H
 
+#include <QMutex>
+
+#include <list>
 #include <map>
+#include <memory>
+#include <vector>
 #include <stddef.h>
 
+#include <rosegardenprivate_export.h>
+
 namespace Rosegarden
 {
 
+
+class AudioFile;
+
+
+/// Decoded audio shared by every PlayableAudioFile.
 /**
- * A simple cache for smallish bits of audio data, indexed by some
- * opaque pointer type.  (The PlayableAudioFile uses this with an
- * AudioFile* index type, for example.)  With reference counting.
+ * A bounded cache of decoded sample data, in blocks of BlockFrames
+ * frames.  Blocks are keyed by AudioFile, target sample rate, target
+ * channel count and block number, so all the PlayableAudioFile objects
+ * that play the same file at the same rate and channel count share one
+ * copy, and a file used in many segments (a loop, say) is only read from
+ * disk and decoded once.
+ *
+ * When the cached data goes over the memory budget, the least recently
+ * used blocks are dropped.  Blocks that someone is still holding on to
+ * (PlayableAudioFile holds every block of a small file for as long as it
+ * plays) are never dropped, so the budget can be exceeded by that much.
+ *
+ * All functions are thread safe, but lock, so none of them may be called
+ * from an RT thread.  Once obtained, a Block never changes, so it can be
+ * read from any thread for as long as it is held.
  */
-
-class AudioCache
+class ROSEGARDENPRIVATE_EXPORT AudioCache
 {
 public:
-    AudioCache() { }
-    virtual ~AudioCache();
+    typedef float sample_t;
 
-    /**
-     * Look some audio data up in the cache and report whether it
-     * exists.
-     */
-    bool has(void *index);
+    /// Frames in a block, at the target sample rate.  The last block of
+    /// a file may be shorter.
+    static const size_t BlockFrames = 32768;
 
-    /**
-     * Look some audio data up in the cache and return it if it
-     * exists, returning the number of channels in channels, the frame
-     * count in frames, and one pointer per channel to samples in the
-     * return value.  Return 0 if the data is not in cache.  Does not
-     * affect the reference count.  Ownership of the returned data
-     * remains with the cache object.  You should not call this unless
-     * you have already called incrementReference (or addData) to
-     * register your interest.
-     */
-    float **getData(void *index, size_t &channels, size_t &frames);
+    /// The cache everyone uses.  Its budget comes from the preferences.
+    static AudioCache *getInstance();
+
+    explicit AudioCache(size_t memoryBudget);
+    ~AudioCache();
+
+    /// Decoded samples for one block of a file.
+    struct Block
+    {
+        Block(size_t channels_, size_t frames_) :
+            channels(channels_),
+            frames(frames_),
+            samples(channels_ * frames_)
+        { }
+
+        size_t channels;
+        size_t frames;
+
+        sample_t *getChannel(size_t channel)
+            { return &samples[channel * frames]; }
+        const sample_t *getChannel(size_t channel) const
+            { return &samples[channel * frames]; }
+
+        size_t getBytes() const  { return samples.size() * sizeof(sample_t); }
+
+    private:
+        /// One channel after another.
+        std::vector<sample_t> samples;
+    };
+
+    typedef std::shared_ptr<const Block> BlockPtr;
 
+    /// Look a block up, and count a hit or a miss.
     /**
-     * Add a piece of data to the cache, and increment the reference
-     * count for that data (to 1).  Ownership of the data is passed
-     * to the cache, which will delete it with delete[] when done.
+     * Returns nullptr if the block isn't cached.  The caller should then
+     * decode it and add() it.
      */
-    void addData(void *index, size_t channels, size_t nframes, float **data);
+    BlockPtr get(const AudioFile *file, int sampleRate, int channels,
+                 size_t block);
 
+    /// Is the block cached?  Doesn't count as a hit or a miss.
+    bool has(const AudioFile *file, int sampleRate, int channels,
+             size_t block) const;
+
+    /// Add a block that get() didn't find, dropping others if need be.
     /**
-     * Increment the reference count for a given piece of data.
+     * If someone else added the same block meanwhile, theirs is kept and
+     * returned instead.
      */
-    void incrementReference(void *index);
+    BlockPtr add(const AudioFile *file, int sampleRate, int channels,
+                 size_t block, std::shared_ptr<Block> data);
 
+    /// Drop every block of a file.
     /**
-     * Decrement the reference count for a given piece of data,
-     * and delete the data from the cache if the reference count has
-     * reached zero.
+     * AudioFile calls this when it is deleted, so that a new AudioFile
+     * at the same address doesn't find the old one's samples.
      */
-    void decrementReference(void *index);
+    void forget(const AudioFile *file);
 
-protected:
+    /// Drop everything that isn't in use.
     void clear();
 
-    struct CacheRec {
-        CacheRec() : data(nullptr), channels(0), nframes(0), refCount(0) { }
-        CacheRec(float **d, size_t c, size_t n) :
-            data(d), channels(c), nframes(n), refCount(1) { }
-        ~CacheRec();
-        float **data;
-        size_t channels;
-        size_t nframes;
-        int refCount;
+    void setMemoryBudget(size_t bytes);
+    size_t getMemoryBudget() const;
+
+    struct Statistics
+    {
+        /// get() calls that found their block.
+        long hits;
+        /// get() calls that didn't.
+        long misses;
+        /// Blocks dropped to stay within the budget.
+        long evictions;
+        /// Blocks cached now.
+        long blocks;
+        /// Bytes of samples cached now.
+        size_t bytes;
+        size_t budget;
+    };
+
+    Statistics getStatistics() const;
+    /// Zero the hit, miss and eviction counts.
+    void resetStatistics();
+
+private:
+    // Hide copy ctor and op=.
+    AudioCache(const AudioCache &);
+    AudioCache &operator=(const AudioCache &);
+
+    struct Key
+    {
+        const AudioFile *file;
+        int sampleRate;
+        int channels;
+        size_t block;
+
+        bool operator<(const Key &other) const;
+    };
+
+    /// Most recently used at the front.
+    typedef std::list<Key> LRUList;
+
+    struct Entry
+    {
+        BlockPtr block;
+        LRUList::iterator lru;
     };
 
-    std::map<void *, CacheRec *> m_cache;
+    typedef std::map<Key, Entry> BlockMap;
+
+    /// Drop least recently used blocks until we are within the budget.
+    /**
+     * Call with m_mutex locked.
+     */
+    void evict();
+
+    mutable QMutex m_mutex;
+
+    BlockMap m_blocks;
+    LRUList m_lru;
+
+    size_t m_bytes;
+    size_t m_budget;
+
+    long m_hits;
+    long m_misses;
+    long m_evictions;
 };
 
+
 }
 
 #endif
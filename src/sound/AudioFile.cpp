@@ -13,6 +13,7 @@
 
 
 #include "AudioFile.h"
+#include "AudioCache.h"
 #include "QDateTime"
 
 namespace Rosegarden
@@ -54,6 +55,8 @@ AudioFile::AudioFile(const QString &absoluteFilePath,
 
 AudioFile::~AudioFile()
 {
+    AudioCache::getInstance()->forget(this);
+
     delete m_fileInfo;
 }
 
@@ -33,6 +33,8 @@
 namespace Rosegarden
 {
 
+class AudioFileMapping;
+
 typedef unsigned int AudioFileId;
 
 /// The different types of audio file we support.
@@ -141,6 +143,11 @@ public:
     virtual std::string getSampleFrameSlice(std::ifstream *file,
                                             const RealTime &time) = 0;
 
+    /// Map the file into memory for playback.  Returns nullptr on
+    /// failure.  The caller owns the result.  See AudioFileMapping.
+    ///
+    virtual AudioFileMapping *map() = 0;
+
     /// Append a string of samples to an already open (for writing)
     /// audio file.  Caller must have interleaved samples etc.
     ///
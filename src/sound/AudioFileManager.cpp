@@ -35,8 +35,15 @@
 #include "gui/dialogs/AudioFileLocationDialog.h"
 #include "gui/general/FileSource.h"
 #include "AudioFile.h"
+#include "AudioFileResampler.h"
+#include "ResampledAudioFiles.h"
 #include "WAVAudioFile.h"
 #include "BWFAudioFile.h"
+#include "base/Composition.h"
+#include "base/Instrument.h"
+#include "base/Segment.h"
+#include "base/Studio.h"
+#include "base/Track.h"
 #include "misc/Debug.h"
 #include "misc/Preferences.h"
 #include "misc/Strings.h"  // qstrtostr() and friends
@@ -98,7 +105,8 @@ AudioFileManager::AudioFileManager(RosegardenDocument *doc) :
     m_document(doc),
     m_lastAudioFileID(0),
     m_audioLocationConfirmed(false),
-    m_expectedSampleRate(0)
+    m_expectedSampleRate(0),
+    m_resampler(nullptr)
 {
     pthread_mutexattr_t attr;
     pthread_mutexattr_init(&attr);
@@ -121,6 +129,7 @@ AudioFileManager::AudioFileManager(RosegardenDocument *doc) :
 
 AudioFileManager::~AudioFileManager()
 {
+    stopResampling();
     clear();
 }
 
@@ -463,10 +472,14 @@ AudioFileManager::clear()
     MutexLock lock (&audioFileManagerLock)
         ;
 
+    ResampledAudioFiles *resampledFiles = ResampledAudioFiles::getInstance();
+
     // For each AudioFile
     for (AudioFile *audioFile : m_audioFiles) {
         m_recordedAudioFiles.erase(audioFile);
         m_derivedAudioFiles.erase(audioFile);
+        // Close any copies at the sequencer's rate.
+        resampledFiles->forget(audioFile->getAbsoluteFilePath());
         delete audioFile;
     }
 
@@ -1099,6 +1112,89 @@ AudioFileManager::getActualSampleRates() const
     return rates;
 }
 
+void
+AudioFileManager::resampleFiles()
+{
+    stopResampling();
+
+    if (!Preferences::getResampleAudioFiles())
+        return;
+
+    const int sampleRate = RosegardenSequencer::getInstance()->getSampleRate();
+    if (sampleRate == 0)
+        return;
+
+    std::vector<AudioFileResampler::Job> jobs;
+
+    {
+        MutexLock lock (&audioFileManagerLock)
+            ;
+
+        const Composition &composition = m_document->getComposition();
+        const Studio &studio = m_document->getStudio();
+
+        // Each file once per channel count it's played with.
+        std::set<std::pair<AudioFileId, int /* channels */>> uses;
+
+        for (const Segment *segment : composition) {
+            if (segment->getType() != Segment::Audio)
+                continue;
+
+            const Track *track = composition.getTrackById(segment->getTrack());
+            if (!track)
+                continue;
+            const Instrument *instrument =
+                    studio.getInstrumentById(track->getInstrument());
+            if (!instrument)
+                continue;
+
+            uses.insert(std::make_pair(segment->getAudioFileId(),
+                                       int(instrument->getNumAudioChannels())));
+        }
+
+        for (const std::pair<AudioFileId, int> &use : uses) {
+            AudioFile *audioFile = getAudioFile(use.first);
+            if (!audioFile)
+                continue;
+            // Nothing to gain.
+            if (int(audioFile->getSampleRate()) == sampleRate)
+                continue;
+
+            jobs.push_back(AudioFileResampler::Job{
+                    audioFile->getAbsoluteFilePath(),
+                    use.second,
+                    audioFile->getLength()});
+        }
+    }
+
+    if (jobs.empty())
+        return;
+
+    RG_DEBUG << "resampleFiles(): resampling" << jobs.size() << "files to" << sampleRate << "Hz";
+
+    m_resampler = new AudioFileResampler(sampleRate, jobs);
+
+    connect(m_resampler, &AudioFileResampler::progress,
+            this, &AudioFileManager::resamplingProgress);
+    connect(m_resampler, &QThread::finished,
+            this, &AudioFileManager::resamplingFinished);
+
+    m_resampler->start(QThread::LowPriority);
+}
+
+void
+AudioFileManager::stopResampling()
+{
+    if (!m_resampler)
+        return;
+
+    m_resampler->cancel();
+    delete m_resampler;
+    m_resampler = nullptr;
+
+    emit resamplingFinished();
+}
+
 QString
 AudioFileManager::toAbsolute(const QString &relativePath) const
 {
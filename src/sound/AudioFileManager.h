@@ -40,6 +40,7 @@ namespace Rosegarden
 {
 
 
+class AudioFileResampler;
 class RosegardenDocument;
 
 typedef std::vector<AudioFile *> AudioFileVector;
@@ -265,6 +266,23 @@ public:
 
     std::set<int> getActualSampleRates() const;
 
+    /// Start making copies of files that aren't at the sequencer's rate.
+    /**
+     * Does nothing unless Preferences::getResampleAudioFiles() is set.
+     *
+     * For each audio segment whose file is at another sample rate, an
+     * AudioFileResampler makes a copy at the sequencer's rate with the
+     * channels of the segment's instrument, in the background.  Playback
+     * switches to the copies as they become ready.  Progress is reported
+     * by resamplingProgress().
+     *
+     * Any resampling already going on is stopped first.
+     */
+    void resampleFiles();
+
+    /// Stop resampleFiles()'s work, if any, and wait for it.
+    void stopResampling();
+
     /// Provide a progress dialog to be used to show progress.
     void setProgressDialog(QPointer<QProgressDialog> progressDialog)
             { m_progressDialog = progressDialog; }
@@ -299,6 +317,12 @@ public:
         QString m_path;
     };
 
+signals:
+    /// Percentage of the files from resampleFiles() that are ready.
+    void resamplingProgress(int percent);
+    /// resampleFiles() is done, or has been stopped.
+    void resamplingFinished();
+
 private:
     // Hide copy ctor and op=.
     AudioFileManager(const AudioFileManager &aFM);
@@ -392,6 +416,9 @@ private:
 
     /// Progress Dialog passed in by clients.
     QPointer<QProgressDialog> m_progressDialog;
+
+    /// See resampleFiles().
+    AudioFileResampler *m_resampler;
 };
 
 
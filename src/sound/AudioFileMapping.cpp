@@ -0,0 +1,164 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[AudioFileMapping]"
+
+#include "AudioFileMapping.h"
+
+#include "misc/Debug.h"
+
+#include <atomic>
+#include <cerrno>
+#include <new>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace Rosegarden
+{
+
+
+namespace
+{
+    size_t pageSize()
+    {
+        static const size_t size = size_t(sysconf(_SC_PAGESIZE));
+        return size;
+    }
+
+    std::atomic<bool> a_mappingEnabled(true);
+}
+
+void
+AudioFileMapping::setMappingEnabled(bool enabled)
+{
+    a_mappingEnabled = enabled;
+}
+
+AudioFileMapping::AudioFileMapping(const QString &absoluteFilePath) :
+    m_fileData(nullptr),
+    m_fileSize(0),
+    m_mapped(false),
+    m_sampleOffset(0),
+    m_sampleBytes(0)
+{
+    const int fd = ::open(absoluteFilePath.toLocal8Bit().constData(),
+                          O_RDONLY);
+    if (fd < 0) {
+        RG_WARNING << "ctor: Failed to open audio file" << absoluteFilePath;
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0  ||  st.st_size <= 0) {
+        RG_WARNING << "ctor: Empty or unreadable audio file" << absoluteFilePath;
+        ::close(fd);
+        return;
+    }
+
+    if (a_mappingEnabled) {
+        void *data = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_SHARED,
+                          fd, 0);
+
+        if (data != MAP_FAILED) {
+            m_fileData = static_cast<unsigned char *>(data);
+            m_fileSize = size_t(st.st_size);
+            m_mapped = true;
+
+            // Playback reads straight through, so the kernel can read
+            // ahead aggressively and drop pages behind us.
+            posix_madvise(m_fileData, m_fileSize, POSIX_MADV_SEQUENTIAL);
+        } else {
+            RG_WARNING << "ctor: Failed to map audio file, reading it instead:" << absoluteFilePath;
+        }
+    }
+
+    if (!m_mapped)
+        readFile(fd, size_t(st.st_size));
+
+    // A mapping keeps its own reference to the file.
+    ::close(fd);
+}
+
+AudioFileMapping::~AudioFileMapping()
+{
+    if (m_mapped)
+        munmap(m_fileData, m_fileSize);
+    else
+        delete[] m_fileData;
+}
+
+void
+AudioFileMapping::readFile(int fd, size_t size)
+{
+    unsigned char *data = new (std::nothrow) unsigned char[size];
+    if (!data) {
+        RG_WARNING << "readFile(): Not enough memory to read audio file";
+        return;
+    }
+
+    size_t done = 0;
+    while (done < size) {
+        const ssize_t count = ::read(fd, data + done, size - done);
+        if (count < 0  &&  errno == EINTR)
+            continue;
+        if (count <= 0) {
+            RG_WARNING << "readFile(): Failed to read audio file";
+            delete[] data;
+            return;
+        }
+        done += size_t(count);
+    }
+
+    m_fileData = data;
+    m_fileSize = size;
+}
+
+void
+AudioFileMapping::setSampleData(size_t offset, size_t bytes)
+{
+    if (offset > m_fileSize)
+        offset = m_fileSize;
+    if (bytes > m_fileSize - offset)
+        bytes = m_fileSize - offset;
+
+    m_sampleOffset = offset;
+    m_sampleBytes = bytes;
+}
+
+void
+AudioFileMapping::willNeed(size_t offset, size_t bytes)
+{
+    // Anything read into memory is there already.
+    if (!m_mapped  ||  offset >= m_sampleBytes)
+        return;
+
+    if (bytes > m_sampleBytes - offset)
+        bytes = m_sampleBytes - offset;
+
+    // madvise() wants a page-aligned start.
+    size_t start = m_sampleOffset + offset;
+    const size_t misalignment = start % pageSize();
+    start -= misalignment;
+    bytes += misalignment;
+
+    posix_madvise(m_fileData + start, bytes, POSIX_MADV_WILLNEED);
+}
+
+
+}
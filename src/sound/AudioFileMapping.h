@@ -0,0 +1,103 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_AUDIO_FILE_MAPPING_H
+#define RG_AUDIO_FILE_MAPPING_H
+
+#include <QString>
+
+#include <cstddef>
+
+#include <rosegardenprivate_export.h>
+
+namespace Rosegarden
+{
+
+
+/// A read-only memory mapping of an audio file for playback.
+/**
+ * Get one from AudioFile::map(), which also locates the sample data
+ * within the file.  PlayableAudioFile decodes straight from the mapping,
+ * so reading needs no file handle, no seeking and no copying into an
+ * intermediate buffer.
+ *
+ * Each PlayableAudioFile has its own mapping.  Mappings of the same file
+ * share the kernel's page cache, so this costs address space, not
+ * memory.
+ *
+ * If the file can't be mapped, e.g. because its filesystem doesn't
+ * support mmap(), it is read into memory instead.  That costs the whole
+ * file's worth of memory, but it still plays.
+ */
+class ROSEGARDENPRIVATE_EXPORT AudioFileMapping
+{
+public:
+    /// Map the whole file.  Check isValid() afterwards.
+    explicit AudioFileMapping(const QString &absoluteFilePath);
+    ~AudioFileMapping();
+
+    bool isValid() const  { return m_fileData != nullptr; }
+
+    /// Whether the file is mapped, rather than read into memory.
+    bool isMapped() const  { return m_mapped; }
+
+    /// Read files into memory rather than mapping them.
+    /**
+     * For testing the fallback.  Affects mappings made afterwards.
+     */
+    static void setMappingEnabled(bool enabled);
+
+    /// The whole file.
+    const unsigned char *getFileData() const  { return m_fileData; }
+    size_t getFileSize() const  { return m_fileSize; }
+
+    /// Set the location of the sample data within the file.
+    /**
+     * Called by AudioFile::map().  bytes is clamped to the end of the
+     * file.
+     */
+    void setSampleData(size_t offset, size_t bytes);
+
+    /// The sample data.  See setSampleData().
+    const unsigned char *getSampleData() const
+        { return m_fileData + m_sampleOffset; }
+    size_t getSampleBytes() const  { return m_sampleBytes; }
+
+    /// Ask the kernel to start reading sample data ahead of playback.
+    /**
+     * offset is from the start of the sample data.  Returns immediately.
+     */
+    void willNeed(size_t offset, size_t bytes);
+
+private:
+    // Hide copy ctor and op=.
+    AudioFileMapping(const AudioFileMapping &);
+    AudioFileMapping &operator=(const AudioFileMapping &);
+
+    /// Read the file into m_fileData if it couldn't be mapped.
+    void readFile(int fd, size_t size);
+
+    unsigned char *m_fileData;
+    size_t m_fileSize;
+    bool m_mapped;
+
+    size_t m_sampleOffset;
+    size_t m_sampleBytes;
+};
+
+
+}
+
+#endif
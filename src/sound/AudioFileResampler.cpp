@@ -0,0 +1,215 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[AudioFileResampler]"
+
+#include "AudioFileResampler.h"
+
+#include "ResampledAudioFiles.h"
+#include "misc/Debug.h"
+#include "sound/audiostream/AudioReadStream.h"
+#include "sound/audiostream/AudioReadStreamFactory.h"
+#include "sound/audiostream/AudioWriteStream.h"
+#include "sound/audiostream/AudioWriteStreamFactory.h"
+
+#include <QFile>
+#include <QScopedPointer>
+
+#include <algorithm>
+
+//#define DEBUG_AUDIO_FILE_RESAMPLER 1
+
+namespace Rosegarden
+{
+
+
+namespace
+{
+    // Frames read and written at a time.
+    constexpr size_t a_blockFrames = 32768;
+}
+
+AudioFileResampler::AudioFileResampler(int sampleRate,
+                                       const std::vector<Job> &jobs) :
+    m_sampleRate(sampleRate),
+    m_jobs(jobs),
+    m_cancelled(0),
+    m_totalFrames(0),
+    m_framesDone(0),
+    m_percent(0)
+{
+    for (const Job &job : m_jobs) {
+        m_totalFrames +=
+                size_t(RealTime::realTime2Frame(job.length, m_sampleRate));
+    }
+}
+
+void
+AudioFileResampler::cancel()
+{
+    m_cancelled.storeRelease(1);
+    wait();
+}
+
+void
+AudioFileResampler::run()
+{
+    ResampledAudioFiles *resampledFiles = ResampledAudioFiles::getInstance();
+
+    for (const Job &job : m_jobs) {
+
+        if (m_cancelled.loadAcquire())
+            return;
+
+        const size_t framesBefore = m_framesDone;
+
+        const QString copyPath = ResampledAudioFiles::getCopyPath(
+                job.sourcePath, m_sampleRate, job.channels);
+
+        if (copyPath.isEmpty()) {
+            RG_WARNING << "run(): Can't read" << job.sourcePath;
+        } else if (QFile::exists(copyPath)  &&
+                   resampledFiles->add(job.sourcePath, m_sampleRate,
+                                       job.channels, copyPath)) {
+            // Made last time.
+#ifdef DEBUG_AUDIO_FILE_RESAMPLER
+            RG_DEBUG << "run(): already have" << copyPath;
+#endif
+        } else if (resample(job, copyPath)) {
+            resampledFiles->add(
+                    job.sourcePath, m_sampleRate, job.channels, copyPath);
+        }
+
+        // The copy won't be exactly as long as we guessed.
+        m_framesDone = framesBefore +
+                size_t(RealTime::realTime2Frame(job.length, m_sampleRate));
+        addProgress(0);
+    }
+}
+
+bool
+AudioFileResampler::resample(const Job &job, const QString &copyPath)
+{
+#ifdef DEBUG_AUDIO_FILE_RESAMPLER
+    RG_DEBUG << "resample(): " << job.sourcePath << " -> " << copyPath;
+#endif
+
+    QScopedPointer<AudioReadStream> readStream(
+            AudioReadStreamFactory::createReadStream(job.sourcePath));
+    if (!readStream  ||  !readStream->isOK()) {
+        RG_WARNING << "resample(): Can't read" << job.sourcePath;
+        return false;
+    }
+
+    readStream->setRetrievalSampleRate(m_sampleRate);
+
+    // Write somewhere else until we're done, so that a copy that exists
+    // is always complete.
+    const QString partPath = copyPath + ".part.wav";
+
+    QScopedPointer<AudioWriteStream> writeStream(
+            AudioWriteStreamFactory::createWriteStream(
+                    partPath, job.channels, m_sampleRate));
+    if (!writeStream) {
+        RG_WARNING << "resample(): Can't write" << partPath;
+        return false;
+    }
+
+    const size_t sourceChannels = readStream->getChannelCount();
+    const size_t targetChannels = size_t(job.channels);
+
+    std::vector<float> source(a_blockFrames * sourceChannels);
+    std::vector<float> target(a_blockFrames * targetChannels);
+
+    while (true) {
+
+        if (m_cancelled.loadAcquire()) {
+            writeStream.reset();
+            QFile::remove(partPath);
+            return false;
+        }
+
+        const size_t frames =
+                readStream->getInterleavedFrames(a_blockFrames, source.data());
+
+        // Match the channels the way WAVAudioFile::decode() does, so the
+        // copy sounds the same as the original would have.  Stereo to
+        // mono is mixed, mono to stereo is duplicated, and otherwise the
+        // channels that match are copied and the rest are silent.
+        for (size_t i = 0; i < frames; ++i) {
+            const float *in = &source[i * sourceChannels];
+            float *out = &target[i * targetChannels];
+
+            if (targetChannels == 1  &&  sourceChannels == 2) {
+                out[0] = in[0] + in[1];
+                continue;
+            }
+
+            for (size_t ch = 0; ch < targetChannels; ++ch) {
+                if (ch < sourceChannels)
+                    out[ch] = in[ch];
+                else if (ch == 1  &&  targetChannels == 2)
+                    out[ch] = in[0];
+                else
+                    out[ch] = 0;
+            }
+        }
+
+        if (frames > 0  &&
+            !writeStream->putInterleavedFrames(frames, target.data())) {
+            RG_WARNING << "resample(): Failed to write" << partPath;
+            writeStream.reset();
+            QFile::remove(partPath);
+            return false;
+        }
+
+        addProgress(frames);
+
+        if (frames < a_blockFrames)
+            break;
+    }
+
+    // Finish the file.
+    writeStream.reset();
+
+    QFile::remove(copyPath);
+    if (!QFile::rename(partPath, copyPath)) {
+        RG_WARNING << "resample(): Can't rename" << partPath << "to" << copyPath;
+        QFile::remove(partPath);
+        return false;
+    }
+
+    return true;
+}
+
+void
+AudioFileResampler::addProgress(size_t frames)
+{
+    m_framesDone += frames;
+
+    if (m_totalFrames == 0)
+        return;
+
+    const int percent = int(std::min(
+            size_t(100), m_framesDone * 100 / m_totalFrames));
+    if (percent == m_percent)
+        return;
+
+    m_percent = percent;
+    emit progress(percent);
+}
+
+
+}
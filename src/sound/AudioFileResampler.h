@@ -0,0 +1,95 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_AUDIOFILERESAMPLER_H
+#define RG_AUDIOFILERESAMPLER_H
+
+#include "base/RealTime.h"
+
+#include <QAtomicInt>
+#include <QString>
+#include <QThread>
+
+#include <vector>
+
+namespace Rosegarden
+{
+
+
+/// Make copies of audio files at another sample rate, in the background.
+/**
+ * For each file it is given, this writes a copy at the sample rate and
+ * channel count it will be played at, and registers it with
+ * ResampledAudioFiles so that PlayableAudioFile reads it instead of
+ * converting the original every time it plays.  Copies made by an
+ * earlier session are checked and registered without being made again.
+ *
+ * Only file paths are kept, so the AudioFile objects may come and go
+ * while this runs.
+ *
+ * AudioFileManager::resampleFiles() starts one of these.
+ */
+class AudioFileResampler : public QThread
+{
+    Q_OBJECT
+
+public:
+    struct Job
+    {
+        QString sourcePath;
+        /// Channels to write.  Mixed and duplicated as WAVAudioFile::decode().
+        int channels;
+        /// For progress.
+        RealTime length;
+    };
+
+    AudioFileResampler(int sampleRate, const std::vector<Job> &jobs);
+
+    /// Stop as soon as possible and wait for the thread to finish.
+    /**
+     * A copy that was being written is removed.
+     */
+    void cancel();
+
+signals:
+    /// Percentage of all the jobs done.
+    void progress(int percent);
+
+protected:
+    // QThread override
+    void run() override;
+
+private:
+    /// Returns false if the copy couldn't be made, or we were cancelled.
+    bool resample(const Job &job, const QString &copyPath);
+
+    /// Add frames to the total done, and emit progress() if that's a new
+    /// percentage.
+    void addProgress(size_t frames);
+
+    int m_sampleRate;
+    std::vector<Job> m_jobs;
+
+    QAtomicInt m_cancelled;
+
+    size_t m_totalFrames;
+    size_t m_framesDone;
+    int m_percent;
+};
+
+
+}
+
+#endif
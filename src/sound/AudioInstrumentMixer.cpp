@@ -18,6 +18,8 @@
 
 #include "AudioInstrumentMixer.h"
 
+#include "AudioKernels.h"
+#include "AudioWorkerPool.h"
 #include "RunnablePluginInstance.h"
 #include "PlayableAudioFile.h"
 #include "MappedStudio.h"  // MappedAudioFader
@@ -25,12 +27,16 @@
 #include "AudioPlayQueue.h"
 #include "PluginFactory.h"
 #include "ControlBlock.h"
+#include "RealTimeLog.h"
+#include "SequencerDataBlock.h"
 #include "misc/Debug.h"
 
 #include <sys/time.h>
 #include <pthread.h>
+#include <time.h>
+#include <unistd.h>
 
-#include <algorithm>  // std::max()
+#include <algorithm>  // std::max(), std::sort()
 
 #ifdef __FreeBSD__
 #include <stdlib.h>
@@ -65,14 +71,39 @@ static inline void denormalKill(float *buffer, int size)
 
 static AudioInstrumentMixer *aimInstance{nullptr};
 
+namespace
+{
+    constexpr size_t a_maxFilesPerInstrument = 500;
+
+    // Automatic thread count limit.  Past this we're likely to be
+    // limited by memory bandwidth rather than cores.
+    constexpr int a_maxAutoThreads = 16;
+
+    long monotonicNsec()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return long(ts.tv_sec) * 1000000000L + ts.tv_nsec;
+    }
+}
+
 AudioInstrumentMixer::AudioInstrumentMixer(SoundDriver *driver,
         AudioFileReader *fileReader,
         unsigned int sampleRate,
-        unsigned int blockSize) :
+        unsigned int blockSize,
+        int threadCount) :
         AudioThread("AudioInstrumentMixer", driver, sampleRate),
         m_fileReader(fileReader),
         m_bussMixer(nullptr),
         m_blockSize(blockSize),
+        m_workerPool(nullptr),
+        m_threadStates(),
+        m_jobInstruments(),
+        m_jobInstrumentCount(0),
+        m_serialCount(0),
+        m_publishPerformance(true),
+        m_instrumentTable(nullptr),
+        m_tableScavenger(2, 10),
         m_numSoftSynths(0)
 {
     // Pregenerate empty plugin slots
@@ -120,17 +151,47 @@ AudioInstrumentMixer::AudioInstrumentMixer(SoundDriver *driver,
     }
 #endif
 
+    // Worker threads for processBlocks().
+
+    if (threadCount <= 0) {
+        threadCount = int(sysconf(_SC_NPROCESSORS_ONLN));
+        threadCount = std::min(std::max(threadCount, 1), a_maxAutoThreads);
+    }
+
+    if (threadCount > 1) {
+        m_workerPool = new AudioWorkerPool(
+                "AudioInstrumentMixer", threadCount - 1, getPriority());
+        threadCount = m_workerPool->getThreadCount();
+    }
+
+    RG_DEBUG << "ctor: processing instruments on" << threadCount << "thread(s)";
+
+    m_threadStates.resize(threadCount);
+    for (ThreadState &state : m_threadStates) {
+        state.playing.resize(a_maxFilesPerInstrument, nullptr);
+        state.readSomething = false;
+        state.underrun = false;
+    }
+
+    m_jobInstruments.resize(audioInstrumentCount + synthInstrumentCount);
+
     // Leave the buffer map and process buffer list empty for now.
     // The buffer length can change between plays, so we always
     // examine the buffers in fillBuffers and are prepared to
     // regenerate from scratch if necessary.  Don't like it though.
+    // The instrument table still needs to exist for the plugin and
+    // synth lookups.
+    rebuildInstrumentTable();
 
     // Keep track of the instance globally.  See getInstance().
     // We do this last to ensure that the object is completely
     // initialized before other threads call getInstance().
     // This is likely pretty questionable since the ctor hasn't
     // exited yet.
-    aimInstance = this;
+    // If there is one already (JackDriver's, while OfflineRenderer
+    // makes another), leave it alone.
+    if (!aimInstance)
+        aimInstance = this;
 }
 
 AudioInstrumentMixer *
@@ -148,11 +209,17 @@ AudioInstrumentMixer::~AudioInstrumentMixer()
     }
 #endif
 
-    aimInstance = nullptr;
+    if (aimInstance == this)
+        aimInstance = nullptr;
 
     //std::cerr << "AudioInstrumentMixer::~AudioInstrumentMixer" << std::endl;
     // BufferRec dtor will handle the BufferMap
 
+    delete m_workerPool;
+
+    // Any earlier ones are left to m_tableScavenger.
+    delete m_instrumentTable.fetchAndStoreOrdered(nullptr);
+
     removeAllPlugins();
 
     for (auto& pair : m_processBuffers) {
@@ -643,15 +710,19 @@ AudioInstrumentMixer::getPluginLatency(unsigned int id)
 
     size_t latency = 0;
 
-    RunnablePluginInstance *synth = m_synths[id];
-    if (synth)
-        latency += m_synths[id]->getLatency();
+    // find() rather than [], so that asking doesn't add to the maps
+    // while the mixer threads are walking them.
+
+    SynthPluginMap::const_iterator synthIter = m_synths.find(id);
+    if (synthIter != m_synths.end()  &&  synthIter->second)
+        latency += synthIter->second->getLatency();
 
-    for (PluginList::iterator i = m_plugins[id].begin();
-            i != m_plugins[id].end(); ++i) {
-        RunnablePluginInstance *plugin = *i;
-        if (plugin)
-            latency += plugin->getLatency();
+    PluginMap::const_iterator pluginsIter = m_plugins.find(id);
+    if (pluginsIter != m_plugins.end()) {
+        for (RunnablePluginInstance *plugin : pluginsIter->second) {
+            if (plugin)
+                latency += plugin->getLatency();
+        }
     }
 
     return latency;
@@ -764,6 +835,11 @@ AudioInstrumentMixer::generateBuffers()
 
         setInstrumentLevels(id, level, pan);
 
+        // Start at the fader level rather than ramping up from silence.
+        rec.appliedGainLeft = rec.gainLeft;
+        rec.appliedGainRight = rec.gainRight;
+        rec.appliedVolume = rec.volume;
+
         ProcessBufferType &pBuf = m_processBuffers[id];
         while ((unsigned int)pBuf.size() > channels) {
             std::vector<sample_t *>::iterator bi = pBuf.end();
@@ -777,6 +853,74 @@ AudioInstrumentMixer::generateBuffers()
 
     }
 
+    rebuildInstrumentTable();
+}
+
+void
+AudioInstrumentMixer::rebuildInstrumentTable()
+{
+    // Not RT safe
+
+    InstrumentTable *table = new InstrumentTable;
+
+    int audioInstruments;
+    m_driver->getAudioInstrumentNumbers(table->audioBase, audioInstruments);
+    table->audioCount = std::max(audioInstruments, 0);
+
+    int synthInstruments;
+    m_driver->getSoftSynthInstrumentNumbers(table->synthBase, synthInstruments);
+    table->synthCount = std::max(synthInstruments, 0);
+
+    table->instruments.resize(table->audioCount + table->synthCount);
+
+    for (size_t i = 0; i < table->instruments.size(); ++i) {
+
+        InstrumentId id;
+        if (i < table->audioCount)
+            id = table->audioBase + InstrumentId(i);
+        else
+            id = table->synthBase + InstrumentId(i - table->audioCount);
+
+        InstrumentSlot &slot = table->instruments[i];
+        slot.id = id;
+
+        // Only instruments that generateBuffers() has set up can be
+        // processed.
+        BufferMap::iterator bufferIter = m_bufferMap.find(id);
+        std::map<InstrumentId, ProcessBufferType>::iterator pBufIter =
+                m_processBuffers.find(id);
+        if (bufferIter != m_bufferMap.end()  &&
+            pBufIter != m_processBuffers.end()) {
+            slot.buffers = &bufferIter->second;
+            slot.processBuffers = &pBufIter->second;
+        } else {
+            slot.buffers = nullptr;
+            slot.processBuffers = nullptr;
+        }
+
+        // The ctor creates these for every instrument.
+        PluginMap::iterator pluginsIter = m_plugins.find(id);
+        slot.plugins = (pluginsIter == m_plugins.end() ?
+                        nullptr : &pluginsIter->second);
+
+        SynthPluginMap::iterator synthIter = m_synths.find(id);
+        slot.synth = (synthIter == m_synths.end() ?
+                      nullptr : &synthIter->second);
+    }
+
+    const int bussCount = AudioBussMixer::getMaxBussCount();
+    table->bussPlugins.resize(bussCount + 1, nullptr);
+    for (int buss = 1; buss < bussCount + 1; ++buss) {
+        PluginMap::iterator pluginsIter = m_plugins.find(buss);
+        if (pluginsIter != m_plugins.end())
+            table->bussPlugins[buss] = &pluginsIter->second;
+    }
+
+    InstrumentTable *oldTable = m_instrumentTable.fetchAndStoreOrdered(table);
+    if (oldTable)
+        m_tableScavenger.claim(oldTable);
+
+    m_tableScavenger.scavenge();
 }
 
 void
@@ -921,15 +1065,45 @@ void AudioInstrumentMixer::audioProcessingDone()
 sample_t* AudioInstrumentMixer::getAudioBuffer
 (InstrumentId id, unsigned int channel) const
 {
-    auto it = m_processBuffers.find(id);
-    if (it == m_processBuffers.end()) return nullptr;
+    const InstrumentSlot *slot = m_instrumentTable.loadAcquire()->find(id);
+    if (!slot || !slot->processBuffers) return nullptr;
 
-    auto& pBuf = (*it).second;
+    const ProcessBufferType &pBuf = *slot->processBuffers;
     if (channel >= pBuf.size()) return nullptr;
 
     return pBuf[channel];
 }
 
+int
+AudioInstrumentMixer::getThreadCount() const
+{
+    return int(m_threadStates.size());
+}
+
+void
+AudioInstrumentMixer::getProcessingTime(
+        InstrumentId id, int &lastUsec, int &peakUsec) const
+{
+    lastUsec = 0;
+    peakUsec = 0;
+
+    BufferMap::const_iterator i = m_bufferMap.find(id);
+    if (i == m_bufferMap.end())
+        return;
+
+    lastUsec = i->second.lastProcessUsec.loadAcquire();
+    peakUsec = i->second.peakProcessUsec.loadAcquire();
+}
+
+void
+AudioInstrumentMixer::resetProcessingTimes()
+{
+    for (BufferMap::iterator i = m_bufferMap.begin();
+            i != m_bufferMap.end(); ++i) {
+        i->second.peakProcessUsec.storeRelease(0);
+    }
+}
+
 void
 AudioInstrumentMixer::processBlocks(bool &readSomething)
 {
@@ -937,16 +1111,23 @@ AudioInstrumentMixer::processBlocks(bool &readSomething)
 
 #ifdef DEBUG_MIXER
     if (m_driver->isPlaying())
-        std::cerr << "AudioInstrumentMixer::processBlocks" << std::endl;
+        RG_RT_LOG("processBlocks()");
 #endif
 
     const AudioPlayQueue *queue = m_driver->getAudioQueue();
 
-    for (BufferMap::iterator i = m_bufferMap.begin();
-            i != m_bufferMap.end(); ++i) {
+    // The slots stay valid until well after we're done with them.
+    // See rebuildInstrumentTable().
+    std::vector<InstrumentSlot> &instruments =
+            m_instrumentTable.loadAcquire()->instruments;
+
+    for (InstrumentSlot &slot : instruments) {
+
+        if (!slot.buffers)
+            continue;
 
-        InstrumentId id = i->first;
-        BufferRec &rec = i->second;
+        const InstrumentId id = slot.id;
+        BufferRec &rec = *slot.buffers;
 
         // This "muted" flag actually only strictly means muted when
         // applied to synth instruments.  For audio instruments it's
@@ -961,16 +1142,15 @@ AudioInstrumentMixer::processBlocks(bool &readSomething)
         if (rec.muted) {
             empty = true;
         } else {
-            if (id >= SoftSynthInstrumentBase) {
-                empty = (!m_synths[id] || m_synths[id]->isBypassed());
+            if (slot.synth) {
+                empty = (!*slot.synth || (*slot.synth)->isBypassed());
             } else {
                 empty = !queue->haveFilesForInstrument(id);
             }
 
-            if (empty) {
-                for (PluginList::iterator j = m_plugins[id].begin();
-                        j != m_plugins[id].end(); ++j) {
-                    if (*j != nullptr) {
+            if (empty  &&  slot.plugins) {
+                for (const RunnablePluginInstance *plugin : *slot.plugins) {
+                    if (plugin != nullptr) {
                         empty = false;
                         break;
                     }
@@ -984,15 +1164,14 @@ AudioInstrumentMixer::processBlocks(bool &readSomething)
             // to set its filledTo field to match that of an existing
             // non-empty instrument, if we can find one.
 
-            for (BufferMap::iterator j = m_bufferMap.begin();
-                    j != m_bufferMap.end(); ++j) {
+            for (const InstrumentSlot &other : instruments) {
 
-                if (j->first == i->first)
+                if (&other == &slot  ||  !other.buffers)
                     continue;
-                if (j->second.empty)
+                if (other.buffers->empty)
                     continue;
 
-                rec.filledTo = j->second.filledTo;
+                rec.filledTo = other.buffers->filledTo;
                 break;
             }
         }
@@ -1005,61 +1184,213 @@ AudioInstrumentMixer::processBlocks(bool &readSomething)
         // read it, so it'll fall behind if we put the volume up again.
     }
 
-    bool more = true;
+    // Sort the non-empty instruments into jobs.  Instruments with
+    // plugins that can't run alongside any others all go in job 0 and
+    // are processed one after another on a single thread.  The rest
+    // are independent of each other and get a job each, slowest first
+    // so that a heavy instrument isn't left until the end.
+
+    m_jobInstrumentCount = 0;
+    m_serialCount = 0;
 
-    static const int MAX_FILES_PER_INSTRUMENT = 500;
-    static PlayableData *playing[MAX_FILES_PER_INSTRUMENT];
+    for (const InstrumentSlot &slot : instruments) {
+
+        if (!slot.buffers)
+            continue;
+
+        BufferRec &rec = *slot.buffers;
+
+        if (rec.empty) {
+            rec.dormant = true;
+            rec.lastProcessUsec.storeRelease(0);
+            if (rec.published  &&  m_publishPerformance) {
+                const int noPlugins[Instrument::PLUGIN_COUNT] = { };
+                SequencerDataBlock::getInstance()->setInstrumentPerformance(
+                        slot.id, 0, 0, noPlugins, 0);
+                rec.published = false;
+            }
+            continue;
+        }
+
+        // Anything beyond the instruments the driver told us about
+        // can't have buffers, so there's nothing to process.
+        if (m_jobInstrumentCount == m_jobInstruments.size())
+            continue;
+
+        bool concurrent = (m_workerPool != nullptr);
+
+        if (concurrent  &&  slot.synth) {
+            RunnablePluginInstance *synth = *slot.synth;
+            if (synth  &&  !synth->canRunConcurrently())
+                concurrent = false;
+        }
+        if (concurrent  &&  slot.plugins) {
+            for (const RunnablePluginInstance *plugin : *slot.plugins) {
+                if (plugin  &&  !plugin->canRunConcurrently()) {
+                    concurrent = false;
+                    break;
+                }
+            }
+        }
+
+        rec.processNsec = 0;
+        rec.synthNsec = 0;
+        std::fill(rec.pluginNsec, rec.pluginNsec + Instrument::PLUGIN_COUNT, 0);
+        rec.underruns = 0;
+
+        m_jobInstruments[m_jobInstrumentCount++] = &slot;
+
+        // Keep the serial ones at the front, in instrument order.
+        if (!concurrent) {
+            std::rotate(m_jobInstruments.begin() + m_serialCount,
+                        m_jobInstruments.begin() + m_jobInstrumentCount - 1,
+                        m_jobInstruments.begin() + m_jobInstrumentCount);
+            ++m_serialCount;
+        }
+    }
+
+    std::sort(m_jobInstruments.begin() + m_serialCount,
+              m_jobInstruments.begin() + m_jobInstrumentCount,
+              [](const InstrumentSlot *a, const InstrumentSlot *b) {
+                  return a->buffers->lastProcessUsec.loadAcquire() >
+                         b->buffers->lastProcessUsec.loadAcquire();
+              });
+
+    for (ThreadState &state : m_threadStates) {
+        state.readSomething = false;
+        state.underrun = false;
+    }
+
+    if (m_workerPool) {
+        const int jobCount = int(m_jobInstrumentCount - m_serialCount) +
+                             (m_serialCount > 0 ? 1 : 0);
+        m_workerPool->run(processJob, this, jobCount);
+    } else {
+        processInstruments(m_jobInstruments.data(), m_jobInstrumentCount,
+                           m_threadStates[0]);
+    }
+
+    for (const ThreadState &state : m_threadStates) {
+        if (state.readSomething)
+            readSomething = true;
+        if (state.underrun)
+            m_driver->reportFailure(MappedEvent::FailureDiscUnderrun);
+    }
+
+    // Publish the timings.
+    for (size_t i = 0; i < m_jobInstrumentCount; ++i) {
+        BufferRec &rec = *m_jobInstruments[i]->buffers;
+        const int usec = int(rec.processNsec / 1000);
+        rec.lastProcessUsec.storeRelease(usec);
+        if (usec > rec.peakProcessUsec.loadAcquire())
+            rec.peakProcessUsec.storeRelease(usec);
+
+        if (!m_publishPerformance)
+            continue;
+
+        int pluginUsec[Instrument::PLUGIN_COUNT];
+        for (unsigned plugin = 0; plugin < Instrument::PLUGIN_COUNT; ++plugin) {
+            pluginUsec[plugin] = int(rec.pluginNsec[plugin] / 1000);
+        }
+        SequencerDataBlock::getInstance()->setInstrumentPerformance(
+                m_jobInstruments[i]->id, usec, int(rec.synthNsec / 1000),
+                pluginUsec, rec.underruns);
+        rec.published = true;
+    }
+}
+
+void
+AudioInstrumentMixer::processJob(void *context, int job, int thread)
+{
+    // Needs to be RT safe
+
+    AudioInstrumentMixer *mixer = static_cast<AudioInstrumentMixer *>(context);
+    ThreadState &state = mixer->m_threadStates[thread];
+
+    if (mixer->m_serialCount > 0) {
+        if (job == 0) {
+            mixer->processInstruments(mixer->m_jobInstruments.data(),
+                                      mixer->m_serialCount, state);
+            return;
+        }
+        --job;
+    }
+
+    mixer->processInstruments(
+            mixer->m_jobInstruments.data() + mixer->m_serialCount + job,
+            1, state);
+}
+
+void
+AudioInstrumentMixer::processInstruments(const InstrumentSlot *const *instruments,
+                                         size_t count,
+                                         ThreadState &state)
+{
+    // Needs to be RT safe.  May be called on several threads at once,
+    // each with different instruments.
+
+    const AudioPlayQueue *queue = m_driver->getAudioQueue();
 
     RealTime blockDuration = RealTime::frame2RealTime(m_blockSize, m_sampleRate);
 
+    bool more = true;
+
     while (more) {
 
         more = false;
 
-        for (BufferMap::iterator i = m_bufferMap.begin();
-                i != m_bufferMap.end(); ++i) {
+        for (size_t i = 0; i < count; ++i) {
 
-            InstrumentId id = i->first;
-            BufferRec &rec = i->second;
+            const InstrumentSlot &slot = *instruments[i];
+            const InstrumentId id = slot.id;
+            BufferRec &rec = *slot.buffers;
 
-            if (rec.empty) {
-                rec.dormant = true;
-                continue;
-            }
+            const long startNsec = monotonicNsec();
 
-            size_t playCount = MAX_FILES_PER_INSTRUMENT;
+            size_t playCount = state.playing.size();
 
             if (id >= SoftSynthInstrumentBase)
                 playCount = 0;
             else {
                 queue->getPlayingFilesForInstrument(rec.filledTo,
                                                     blockDuration, id,
-                                                    playing, playCount);
+                                                    state.playing.data(),
+                                                    playCount);
             }
 
-            if (processBlock(id, playing, playCount, readSomething)) {
+            if (processBlock(slot, state.playing.data(), playCount,
+                             state.readSomething, state.underrun)) {
                 more = true;
             }
+
+            rec.processNsec += monotonicNsec() - startNsec;
         }
     }
 }
 
 bool
-AudioInstrumentMixer::processBlock(InstrumentId id,
+AudioInstrumentMixer::processBlock(const InstrumentSlot &slot,
                                    PlayableData **playing,
                                    size_t playCount,
-                                   bool &readSomething)
+                                   bool &readSomething,
+                                   bool &underrun)
 {
-    // Needs to be RT safe
+    // Needs to be RT safe.  Other threads may be processing other
+    // instruments at the same time, so only this instrument's slot is
+    // touched.
+
+    // processBlocks() skips slots whose buffers haven't been set up yet.
+    const InstrumentId id = slot.id;
+    BufferRec &rec = *slot.buffers;
+    ProcessBufferType &pBuf = *slot.processBuffers;
 
-    BufferRec &rec = m_bufferMap[id];
-    ProcessBufferType &pBuf = m_processBuffers[id];
     RealTime bufferTime = rec.filledTo;
 
 #ifdef DEBUG_MIXER
     //    if (m_driver->isPlaying()) {
     if ((id % 100) == 0)
-        std::cerr << "AudioInstrumentMixer::processBlock(" << id << "): buffer time is " << bufferTime << std::endl;
+        RG_RT_LOG("processBlock(%1): buffer time is %2s + %3ns",
+                  id, bufferTime.sec, bufferTime.nsec);
     //    }
 #endif
 
@@ -1071,7 +1402,8 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
     if (channels == 0) {
 #ifdef DEBUG_MIXER
         if ((id % 100) == 0)
-            std::cerr << "AudioInstrumentMixer::processBlock(" << id << "): nominal channels " << rec.channels << ", ring buffers " << rec.buffers.size() << ", process buffers " << pBuf.size() << std::endl;
+            RG_RT_LOG("processBlock(%1): nominal channels %2, ring buffers %3, process buffers %4",
+                      id, rec.channels, rec.buffers.size(), pBuf.size());
 #endif
 
         return false; // buffers just haven't been set up yet
@@ -1090,7 +1422,8 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
 #ifdef DEBUG_MIXER
                 //		if (m_driver->isPlaying()) {
                 if ((id % 100) == 0)
-                    std::cerr << "AudioInstrumentMixer::processBlock(" << id << "): only " << minWriteSpace << " write space on channel " << ch << " for block size " << m_blockSize << std::endl;
+                    RG_RT_LOG("processBlock(%1): only %2 write space on channel %3 for block size %4",
+                              id, minWriteSpace, ch, m_blockSize);
                 //		}
 #endif
 
@@ -1099,24 +1432,26 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
         }
     }
 
-    PluginList &plugins = m_plugins[id];
+    static const PluginList noPlugins;
+    const PluginList &plugins = (slot.plugins ? *slot.plugins : noPlugins);
 
 #ifdef DEBUG_MIXER
 
     if ((id % 100) == 0 && m_driver->isPlaying())
-        std::cerr << "AudioInstrumentMixer::processBlock(" << id << "): minWriteSpace is " << minWriteSpace << std::endl;
+        RG_RT_LOG("processBlock(%1): minWriteSpace is %2", id, minWriteSpace);
 #else
 #ifdef DEBUG_MIXER_LIGHTWEIGHT
 
     if ((id % 100) == 0 && m_driver->isPlaying())
-        std::cout << minWriteSpace << "/" << rec.buffers[0]->getSize() << std::endl;
+        RG_RT_LOG("%1/%2", minWriteSpace, rec.buffers[0]->getSize());
 #endif
 #endif
 
 #ifdef DEBUG_MIXER
 
     if ((id % 100) == 0 && playCount > 0)
-        std::cerr << "AudioInstrumentMixer::processBlock(" << id << "): " << playCount << " audio file(s) to consider" << std::endl;
+        RG_RT_LOG("processBlock(%1): %2 audio file(s) to consider",
+                  id, playCount);
 #endif
 
     bool haveBlock = true;
@@ -1135,7 +1470,7 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
 
 #ifdef DEBUG_MIXER
             if ((id % 100) == 0)
-                std::cerr << "AudioInstrumentMixer::processBlock(" << id << "): will be asking for more" << std::endl;
+                RG_RT_LOG("processBlock(%1): will be asking for more", id);
 #endif
 
             haveMore = true;
@@ -1143,7 +1478,8 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
 
 #ifdef DEBUG_MIXER
         if ((id % 100) == 0)
-            std::cerr << "AudioInstrumentMixer::processBlock(" << id << "): file has " << frames << " frames available" << std::endl;
+            RG_RT_LOG("processBlock(%1): file has %2 frames available",
+                      id, frames);
 #endif
 
         if (!acceptable) {
@@ -1165,7 +1501,11 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
                 // to accept that it won't be available for a while
                 // and just read silence from it instead.
                 if (file->isBuffered()) {
-                    m_driver->reportFailure(MappedEvent::FailureDiscUnderrun);
+                    // Reported by processBlocks().
+                    underrun = true;
+                    ++rec.underruns;
+                    RG_RT_LOG("processBlock(%1): WARNING: only %2 frames buffered",
+                              id, frames);
                     haveBlock = false;
                 } else {
                     // ignore happily.
@@ -1181,7 +1521,7 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
 #ifdef DEBUG_MIXER
     if (!haveMore) {
         if ((id % 100) == 0)
-            std::cerr << "AudioInstrumentMixer::processBlock(" << id << "): won't be asking for more" << std::endl;
+            RG_RT_LOG("processBlock(%1): won't be asking for more", id);
     }
 #endif
 
@@ -1189,11 +1529,13 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
         memset(pBuf[ch], 0, sizeof(sample_t) * m_blockSize);
     }
 
-    RunnablePluginInstance *synth = m_synths[id];
+    RunnablePluginInstance *synth = (slot.synth ? *slot.synth : nullptr);
 
     if (synth && !synth->isBypassed()) {
 
+        const long startNsec = monotonicNsec();
         synth->run(bufferTime);
+        rec.synthNsec += monotonicNsec() - startNsec;
 
         unsigned int ch = 0;
 
@@ -1227,7 +1569,8 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
                     blockSize = 0;
 #ifdef DEBUG_MIXER
 
-                std::cerr << "AudioInstrumentMixer::processBlock: file starts at offset " << offset << ", block size now " << blockSize << std::endl;
+                RG_RT_LOG("processBlock(): file starts at offset %1, block size now %2",
+                          offset, blockSize);
 #endif
 
             }
@@ -1243,7 +1586,11 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
             // pooled buffers.
 
             if (blockSize > 0) {
-                file->addSamples(pBuf, channels, blockSize, offset);
+                const size_t added =
+                        file->addSamples(pBuf, channels, blockSize, offset);
+                // Short of the end of the file, the reader fell behind.
+                if (added < size_t(blockSize)  &&  !file->isFullyBuffered())
+                    ++rec.underruns;
                 readSomething = true;
             }
         }
@@ -1256,7 +1603,7 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
     // -- stereo only comes into effect at the pan stage, and
     // these are pre-fader plugins.
 
-    for (PluginList::iterator pli = plugins.begin();
+    for (PluginList::const_iterator pli = plugins.begin();
             pli != plugins.end(); ++pli) {
 
         RunnablePluginInstance *plugin = *pli;
@@ -1283,11 +1630,15 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
         }
 
 #ifdef DEBUG_MIXER
-        std::cerr << "Running plugin with " << plugin->getAudioInputCount()
-        << " inputs, " << plugin->getAudioOutputCount() << " outputs" << std::endl;
+        RG_RT_LOG("Running plugin with %1 inputs, %2 outputs",
+                  plugin->getAudioInputCount(), plugin->getAudioOutputCount());
 #endif
 
+        const long startNsec = monotonicNsec();
         plugin->run(bufferTime);
+        const size_t position = pli - plugins.begin();
+        if (position < Instrument::PLUGIN_COUNT)
+            rec.pluginNsec[position] += monotonicNsec() - startNsec;
 
         ch = 0;
 
@@ -1302,11 +1653,10 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
                        m_blockSize * sizeof(sample_t));
             } else if (ch == 1) {
                 // stereo output from plugin on a mono track
-                for (size_t i = 0; i < m_blockSize; ++i) {
-                    pBuf[0][i] +=
-                        plugin->getAudioOutputBuffers()[ch][i];
-                    pBuf[0][i] /= 2;
-                }
+                AudioKernels::add(pBuf[0],
+                                  plugin->getAudioOutputBuffers()[ch],
+                                  m_blockSize);
+                AudioKernels::multiply(pBuf[0], 0.5f, m_blockSize);
             } else {
                 break;
             }
@@ -1319,16 +1669,35 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
 
     bool allZeros = true;
 
-    if (targetChannels == 2 && channels == 1) {
-
-        for (size_t i = 0; i < m_blockSize; ++i) {
+    // Read the targets once, as the GUI may change them at any time.
+    const float gainLeft = rec.gainLeft;
+    const float gainRight = rec.gainRight;
+    const float volume = rec.volume;
 
-            sample_t sample = pBuf[0][i];
-
-            pBuf[0][i] = sample * rec.gainLeft;
-            pBuf[1][i] = sample * rec.gainRight;
+    if (targetChannels == 2 && channels == 1) {
 
-            if (allZeros && sample != 0.0)
+        if (gainLeft == rec.appliedGainLeft  &&
+            gainRight == rec.appliedGainRight) {
+            // Steady pan and level, do it in one pass.
+            const float peak = AudioKernels::pan(pBuf[0], pBuf[0], pBuf[1],
+                                                 gainLeft, gainRight,
+                                                 m_blockSize);
+            if (peak != 0.0)
+                allZeros = false;
+        } else {
+            memcpy(pBuf[1], pBuf[0], m_blockSize * sizeof(sample_t));
+
+            // JackDriver meters what it plays, so only the peaks are
+            // wanted here, to tell whether the instrument is silent.
+            float peak[2];
+            float sumOfSquares;
+            AudioKernels::multiplyRampAndMeter(
+                    pBuf[0], rec.appliedGainLeft, gainLeft, m_blockSize,
+                    peak[0], sumOfSquares);
+            AudioKernels::multiplyRampAndMeter(
+                    pBuf[1], rec.appliedGainRight, gainRight, m_blockSize,
+                    peak[1], sumOfSquares);
+            if (peak[0] != 0.0  ||  peak[1] != 0.0)
                 allZeros = false;
         }
 
@@ -1339,22 +1708,29 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
 
         for (unsigned int ch = 0; ch < targetChannels; ++ch) {
 
-            float gain = ((ch == 0) ? rec.gainLeft :
-                          (ch == 1) ? rec.gainRight : rec.volume);
-
-            for (size_t i = 0; i < m_blockSize; ++i) {
-
-                // handle volume and pan
-                pBuf[ch][i] *= gain;
-
-                if (allZeros && pBuf[ch][i] != 0.0)
-                    allZeros = false;
-            }
+            const float gain = ((ch == 0) ? gainLeft :
+                                (ch == 1) ? gainRight : volume);
+            const float appliedGain = ((ch == 0) ? rec.appliedGainLeft :
+                                       (ch == 1) ? rec.appliedGainRight :
+                                       rec.appliedVolume);
+
+            // handle volume and pan
+            float peak;
+            float sumOfSquares;
+            AudioKernels::multiplyRampAndMeter(pBuf[ch], appliedGain, gain,
+                                               m_blockSize,
+                                               peak, sumOfSquares);
+            if (peak != 0.0)
+                allZeros = false;
 
             rec.buffers[ch]->write(pBuf[ch], m_blockSize);
         }
     }
 
+    rec.appliedGainLeft = gainLeft;
+    rec.appliedGainRight = gainRight;
+    rec.appliedVolume = volume;
+
     bool dormant = true;
 
     if (allZeros) {
@@ -1371,7 +1747,7 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
 
 #ifdef DEBUG_MIXER
     if ((id % 100) == 0 && m_driver->isPlaying())
-        std::cerr << "AudioInstrumentMixer::processBlock(" << id << "): setting dormant to " << dormant << std::endl;
+        RG_RT_LOG("processBlock(%1): setting dormant to %2", id, dormant);
 #endif
 
     rec.dormant = dormant;
@@ -1383,7 +1759,7 @@ AudioInstrumentMixer::processBlock(InstrumentId id,
 #ifdef DEBUG_MIXER
 
     if ((id % 100) == 0)
-        std::cerr << "AudioInstrumentMixer::processBlock(" << id << "): done, returning " << haveMore << std::endl;
+        RG_RT_LOG("processBlock(%1): done, returning %2", id, haveMore);
 #endif
 
     return haveMore;
@@ -18,6 +18,11 @@
 
 #include "AudioProcess.h"
 
+#include "Scavenger.h"
+
+#include <QAtomicInt>
+#include <QAtomicPointer>
+
 #include <vector>
 
 
@@ -27,6 +32,7 @@ namespace Rosegarden
 
 class AudioFileReader;
 class AudioFileWriter;
+class AudioWorkerPool;
 class RunnablePluginInstance;
 
 
@@ -35,10 +41,15 @@ class AudioInstrumentMixer : public AudioThread
 public:
     typedef std::vector<RunnablePluginInstance *> PluginList;
 
+    /**
+     * threadCount is the number of threads to process instruments on,
+     * including this one.  0 means one per processor core.
+     */
     AudioInstrumentMixer(SoundDriver *driver,
                          AudioFileReader *fileReader,
                          unsigned int sampleRate,
-                         unsigned int blockSize);
+                         unsigned int blockSize,
+                         int threadCount);
 
     ~AudioInstrumentMixer() override;
 
@@ -53,6 +64,9 @@ public:
      *
      * The issue is that AIM does not have a default ctor.  So the usual
      * "static instance in getInstance()" doesn't work.
+     *
+     * If more than one exists (OfflineRenderer has its own), this is
+     * the first one created.
      */
     static AudioInstrumentMixer *getInstance();
 
@@ -88,8 +102,10 @@ public:
     void destroyAllPlugins();
 
     // Avoid these.  Use the above routines if possible.
-    RunnablePluginInstance *getSynthPlugin(InstrumentId id)
-            { return m_synths[id]; }
+    RunnablePluginInstance *getSynthPlugin(InstrumentId id) {
+        const InstrumentSlot *slot = m_instrumentTable.loadAcquire()->find(id);
+        return (slot  &&  slot->synth) ? *slot->synth : nullptr;
+    }
     RunnablePluginInstance *getPluginInstance(InstrumentId, int position);
 
     /**
@@ -98,7 +114,9 @@ public:
      * It's purely by historical accident that the instrument mixer happens
      * to hold buss plugins as well -- this could do with being refactored.
      */
-    PluginList &getBussPlugins(unsigned int bussId) { return m_plugins[bussId]; }
+    PluginList &getBussPlugins(unsigned int bussId) {
+        return m_instrumentTable.loadAcquire()->getBussPlugins(bussId);
+    }
 
     /**
      * Return the total of the plugin latencies for a given instrument
@@ -130,7 +148,8 @@ public:
      * instruments can safely be ignored during playback.
      */
     bool isInstrumentEmpty(InstrumentId id) {
-        return m_bufferMap[id].empty;
+        const InstrumentSlot *slot = m_instrumentTable.loadAcquire()->find(id);
+        return !slot  ||  !slot->buffers  ||  slot->buffers->empty;
     }
 
     /**
@@ -140,7 +159,8 @@ public:
      * be ignored (unless also empty).
      */
     bool isInstrumentDormant(InstrumentId id) {
-        return m_bufferMap[id].dormant;
+        const InstrumentSlot *slot = m_instrumentTable.loadAcquire()->find(id);
+        return !slot  ||  !slot->buffers  ||  slot->buffers->dormant;
     }
 
     /**
@@ -150,8 +170,10 @@ public:
      * these buffers.
      */
     RingBuffer<sample_t, 2> *getRingBuffer(InstrumentId id, unsigned int channel) {
-        if (channel < (unsigned int)m_bufferMap[id].buffers.size()) {
-            return m_bufferMap[id].buffers[channel];
+        const InstrumentSlot *slot = m_instrumentTable.loadAcquire()->find(id);
+        if (slot  &&  slot->buffers  &&
+            channel < (unsigned int)slot->buffers->buffers.size()) {
+            return slot->buffers->buffers[channel];
         } else {
             return nullptr;
         }
@@ -170,20 +192,75 @@ public:
 
     unsigned int getNumSoftSynths() const {return m_numSoftSynths;};
 
+    /// Number of threads instruments are processed on.
+    int getThreadCount() const;
+
+    /// Time spent processing an instrument's files, synth and plugins.
+    /**
+     * lastUsec is for the most recent pass of the mixer and peakUsec the
+     * longest since resetProcessingTimes(), both in microseconds.  May
+     * be called from any thread.
+     */
+    void getProcessingTime(InstrumentId id, int &lastUsec, int &peakUsec) const;
+    void resetProcessingTimes();
+
+    /// Whether to report timings to SequencerDataBlock.  Default true.
+    /**
+     * SequencerDataBlock::setInstrumentPerformance() takes one writer
+     * only, and that's the live mixer.  OfflineRenderer turns this off
+     * for its own mixer.  Call before the first kick().
+     */
+    void setPublishPerformance(bool publish)
+        { m_publishPerformance = publish; }
+
 protected:
     void threadRun() override;
 
     int getPriority() override { return 3; }
 
+    struct InstrumentSlot;
+
+    /// Per-thread scratch space for processBlocks().
+    struct ThreadState
+    {
+        std::vector<PlayableData *> playing;
+        bool readSomething;
+        bool underrun;
+    };
+
     void processBlocks(bool &readSomething);
     void processEmptyBlocks(InstrumentId id);
-    bool processBlock(InstrumentId id, PlayableData **, size_t, bool &readSomething);
+    /// Process instruments until none of them can take another block.
+    void processInstruments(const InstrumentSlot *const *instruments,
+                            size_t count, ThreadState &state);
+    static void processJob(void *context, int job, int thread);
+    bool processBlock(const InstrumentSlot &slot, PlayableData **, size_t,
+                      bool &readSomething, bool &underrun);
     void generateBuffers();
+    void rebuildInstrumentTable();
 
     AudioFileReader  *m_fileReader;
     AudioBussMixer   *m_bussMixer;
     size_t            m_blockSize;
 
+    /// Extra threads for processBlocks().  nullptr if we only use one.
+    AudioWorkerPool  *m_workerPool;
+    std::vector<ThreadState> m_threadStates;
+
+    /// Non-empty instruments in job order.  See processBlocks().
+    /**
+     * Sized in the ctor for every audio and synth instrument so that
+     * processBlocks() can fill it without allocating.  The first
+     * m_serialCount instruments make up job 0 and are processed one
+     * after another.  Each one after that is a job of its own.
+     */
+    std::vector<const InstrumentSlot *> m_jobInstruments;
+    size_t m_jobInstrumentCount;
+    size_t m_serialCount;
+
+    /// See setPublishPerformance().
+    bool m_publishPerformance;
+
     typedef std::map<InstrumentId, PluginList> PluginMap;
     typedef std::map<InstrumentId, RunnablePluginInstance *> SynthPluginMap;
 
@@ -216,7 +293,11 @@ protected:
         BufferRec() : empty(true), dormant(true), zeroFrames(0),
                       filledTo(RealTime::zero()), channels(2),
                       buffers(), gainLeft(0.0), gainRight(0.0), volume(0.0),
-                      muted(false) { }
+                      appliedGainLeft(0.0), appliedGainRight(0.0),
+                      appliedVolume(0.0),
+                      muted(false), processNsec(0), synthNsec(0),
+                      pluginNsec(), underruns(0), published(false),
+                      lastProcessUsec(0), peakProcessUsec(0) { }
         ~BufferRec();
 
         bool empty;
@@ -227,14 +308,100 @@ protected:
         size_t channels;
         std::vector<RingBuffer<sample_t, 2> *> buffers;
 
+        /// Targets, set by setInstrumentLevels().
         float gainLeft;
         float gainRight;
         float volume;
+        /// The gains at the end of the last block processed.
+        /**
+         * processBlock() ramps from these to the targets across each
+         * block so that fader and pan moves don't click.  generateBuffers()
+         * starts them at the targets.
+         */
+        float appliedGainLeft;
+        float appliedGainRight;
+        float appliedVolume;
         bool muted;
+
+        /// Accumulated by whichever thread processes this instrument.
+        long processNsec;
+        long synthNsec;
+        long pluginNsec[Instrument::PLUGIN_COUNT];
+        /// Blocks a playing file's ring buffer couldn't supply.
+        int underruns;
+        /// Whether SequencerDataBlock has non-zero counters for this.
+        bool published;
+        /// Published by processBlocks() for getProcessingTime().
+        QAtomicInt lastProcessUsec;
+        QAtomicInt peakProcessUsec;
     };
 
     typedef std::map<InstrumentId, BufferRec> BufferMap;
     BufferMap m_bufferMap;
+
+    /// Everything the RT paths need for one instrument.
+    /**
+     * These point into the maps above, whose entries never move or go
+     * away once created.
+     */
+    struct InstrumentSlot
+    {
+        InstrumentId id;
+        /// nullptr if generateBuffers() found no fader for it.
+        BufferRec *buffers;
+        ProcessBufferType *processBuffers;
+        PluginList *plugins;
+        /// nullptr for audio instruments.
+        RunnablePluginInstance **synth;
+    };
+
+    /// Dense lookup from instrument or buss id to what the RT paths need.
+    /**
+     * The maps above are fine for setting things up, but operator[] can
+     * insert, and even find() is a tree walk, which is too much once
+     * per instrument per period in jackProcess().  So the RT paths go
+     * through this instead: an array indexed by id minus the audio or
+     * soft synth instrument base.
+     *
+     * The table is never changed once published.  rebuildInstrumentTable()
+     * makes a new one whenever generateBuffers() runs (i.e. when the
+     * studio changes) and swaps it in, and the old one goes to
+     * m_tableScavenger in case an RT thread is still looking at it.
+     */
+    struct InstrumentTable
+    {
+        InstrumentTable() : audioBase(0), audioCount(0),
+                            synthBase(0), synthCount(0) { }
+
+        InstrumentId audioBase;
+        size_t audioCount;
+        InstrumentId synthBase;
+        size_t synthCount;
+
+        /// Audio instruments then soft synths.
+        std::vector<InstrumentSlot> instruments;
+        /// Indexed by buss id.
+        std::vector<PluginList *> bussPlugins;
+
+        const InstrumentSlot *find(InstrumentId id) const {
+            if (id >= audioBase  &&  id - audioBase < audioCount)
+                return &instruments[id - audioBase];
+            if (id >= synthBase  &&  id - synthBase < synthCount)
+                return &instruments[audioCount + (id - synthBase)];
+            return nullptr;
+        }
+
+        PluginList &getBussPlugins(unsigned int bussId) const {
+            static PluginList noPlugins;
+            if (bussId < bussPlugins.size()  &&  bussPlugins[bussId])
+                return *bussPlugins[bussId];
+            return noPlugins;
+        }
+    };
+
+    QAtomicPointer<InstrumentTable> m_instrumentTable;
+    Scavenger<InstrumentTable> m_tableScavenger;
+
  private:
     unsigned int m_numSoftSynths;
 };
@@ -0,0 +1,769 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[AudioKernels]"
+
+#include "AudioKernels.h"
+
+#include <algorithm>  // std::max()
+#include <cmath>  // std::fabs()
+
+#if (defined(__x86_64__)  ||  defined(__i386__))  &&  \
+    (defined(__GNUC__)  ||  defined(__clang__))
+#define RG_AUDIO_KERNELS_X86 1
+#include <immintrin.h>
+#endif
+
+
+namespace Rosegarden
+{
+
+
+namespace
+{
+
+    // Scalar.  These are also the reference for the SIMD versions.
+
+    void addScalar(sample_t *dest, const sample_t *source, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            dest[i] += source[i];
+    }
+
+    void addScaledScalar(sample_t *dest, const sample_t *source,
+                         float gain, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            dest[i] += source[i] * gain;
+    }
+
+    void multiplyScalar(sample_t *buffer, float gain, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+            buffer[i] *= gain;
+    }
+
+    void multiplyRampScalar(sample_t *buffer,
+                            float startGain, float endGain, size_t n)
+    {
+        if (n == 0)
+            return;
+        const float step = (endGain - startGain) / float(n);
+        for (size_t i = 0; i < n; ++i)
+            buffer[i] *= startGain + step * float(i);
+    }
+
+    float panScalar(const sample_t *mono, sample_t *left, sample_t *right,
+                    float gainLeft, float gainRight, size_t n)
+    {
+        float peak = 0;
+        for (size_t i = 0; i < n; ++i) {
+            const sample_t sample = mono[i];
+            peak = std::max(peak, std::fabs(sample));
+            left[i] = sample * gainLeft;
+            right[i] = sample * gainRight;
+        }
+        return peak;
+    }
+
+    float peakScalar(const sample_t *buffer, size_t n)
+    {
+        float peak = 0;
+        for (size_t i = 0; i < n; ++i)
+            peak = std::max(peak, std::fabs(buffer[i]));
+        return peak;
+    }
+
+    void meterScalar(const sample_t *buffer, size_t n,
+                     float &peak, float &sumOfSquares)
+    {
+        float p = 0;
+        float sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            p = std::max(p, std::fabs(buffer[i]));
+            sum += buffer[i] * buffer[i];
+        }
+        peak = p;
+        sumOfSquares = sum;
+    }
+
+    void addAndMeterScalar(sample_t *dest, const sample_t *source, size_t n,
+                           float &peak, float &sumOfSquares)
+    {
+        float p = 0;
+        float sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            p = std::max(p, std::fabs(source[i]));
+            sum += source[i] * source[i];
+            dest[i] += source[i];
+        }
+        peak = p;
+        sumOfSquares = sum;
+    }
+
+    float multiplyAndPeakScalar(sample_t *buffer, float gain, size_t n)
+    {
+        float peak = 0;
+        for (size_t i = 0; i < n; ++i) {
+            buffer[i] *= gain;
+            peak = std::max(peak, std::fabs(buffer[i]));
+        }
+        return peak;
+    }
+
+    void scaleAndMeterScalar(sample_t *dest, const sample_t *source,
+                             float gain, size_t n,
+                             float &peak, float &sumOfSquares)
+    {
+        float p = 0;
+        float sum = 0;
+        for (size_t i = 0; i < n; ++i) {
+            dest[i] = source[i] * gain;
+            p = std::max(p, std::fabs(dest[i]));
+            sum += dest[i] * dest[i];
+        }
+        peak = p;
+        sumOfSquares = sum;
+    }
+
+    // The ramp from sample first to n, for the SIMD versions' leftovers
+    // as well as the scalar version.
+    void rampAndMeterTail(sample_t *buffer, float startGain, float step,
+                          size_t first, size_t n,
+                          float &peak, float &sumOfSquares)
+    {
+        float p = 0;
+        float sum = 0;
+        for (size_t i = first; i < n; ++i) {
+            buffer[i] *= startGain + step * float(i);
+            p = std::max(p, std::fabs(buffer[i]));
+            sum += buffer[i] * buffer[i];
+        }
+        peak = p;
+        sumOfSquares = sum;
+    }
+
+    void multiplyRampAndMeterScalar(sample_t *buffer,
+                                    float startGain, float endGain, size_t n,
+                                    float &peak, float &sumOfSquares)
+    {
+        const float step = n ? (endGain - startGain) / float(n) : 0;
+        rampAndMeterTail(buffer, startGain, step, 0, n, peak, sumOfSquares);
+    }
+
+#ifdef RG_AUDIO_KERNELS_X86
+
+    // SSE2.  Four samples at a time, then the scalar version for
+    // whatever is left over.
+
+#define RG_SSE2 __attribute__((target("sse2")))
+
+    RG_SSE2 inline __m128 absSSE2(__m128 v)
+    {
+        return _mm_and_ps(v, _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff)));
+    }
+
+    RG_SSE2 inline float horizontalMaxSSE2(__m128 v)
+    {
+        v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+        v = _mm_max_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+        return _mm_cvtss_f32(v);
+    }
+
+    RG_SSE2 inline float horizontalSumSSE2(__m128 v)
+    {
+        v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+        v = _mm_add_ps(v, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+        return _mm_cvtss_f32(v);
+    }
+
+    RG_SSE2 void addSSE2(sample_t *dest, const sample_t *source, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            _mm_storeu_ps(dest + i, _mm_add_ps(_mm_loadu_ps(dest + i),
+                                               _mm_loadu_ps(source + i)));
+        }
+        addScalar(dest + i, source + i, n - i);
+    }
+
+    RG_SSE2 void addScaledSSE2(sample_t *dest, const sample_t *source,
+                               float gain, size_t n)
+    {
+        const __m128 g = _mm_set1_ps(gain);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            const __m128 s = _mm_mul_ps(_mm_loadu_ps(source + i), g);
+            _mm_storeu_ps(dest + i, _mm_add_ps(_mm_loadu_ps(dest + i), s));
+        }
+        addScaledScalar(dest + i, source + i, gain, n - i);
+    }
+
+    RG_SSE2 void multiplySSE2(sample_t *buffer, float gain, size_t n)
+    {
+        const __m128 g = _mm_set1_ps(gain);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            _mm_storeu_ps(buffer + i, _mm_mul_ps(_mm_loadu_ps(buffer + i), g));
+        }
+        multiplyScalar(buffer + i, gain, n - i);
+    }
+
+    RG_SSE2 void multiplyRampSSE2(sample_t *buffer,
+                                  float startGain, float endGain, size_t n)
+    {
+        if (n == 0)
+            return;
+        const float step = (endGain - startGain) / float(n);
+        const __m128 start = _mm_set1_ps(startGain);
+        const __m128 steps = _mm_set1_ps(step);
+        __m128 index = _mm_setr_ps(0, 1, 2, 3);
+        const __m128 four = _mm_set1_ps(4);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            // Gain from the index rather than accumulated, so that it
+            // matches the scalar version.
+            const __m128 g = _mm_add_ps(start, _mm_mul_ps(steps, index));
+            _mm_storeu_ps(buffer + i, _mm_mul_ps(_mm_loadu_ps(buffer + i), g));
+            index = _mm_add_ps(index, four);
+        }
+        for (; i < n; ++i)
+            buffer[i] *= startGain + step * float(i);
+    }
+
+    RG_SSE2 float panSSE2(const sample_t *mono,
+                          sample_t *left, sample_t *right,
+                          float gainLeft, float gainRight, size_t n)
+    {
+        const __m128 gl = _mm_set1_ps(gainLeft);
+        const __m128 gr = _mm_set1_ps(gainRight);
+        __m128 peak = _mm_setzero_ps();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            const __m128 s = _mm_loadu_ps(mono + i);
+            peak = _mm_max_ps(peak, absSSE2(s));
+            _mm_storeu_ps(left + i, _mm_mul_ps(s, gl));
+            _mm_storeu_ps(right + i, _mm_mul_ps(s, gr));
+        }
+        return std::max(horizontalMaxSSE2(peak),
+                        panScalar(mono + i, left + i, right + i,
+                                  gainLeft, gainRight, n - i));
+    }
+
+    RG_SSE2 float peakSSE2(const sample_t *buffer, size_t n)
+    {
+        __m128 peak = _mm_setzero_ps();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            peak = _mm_max_ps(peak, absSSE2(_mm_loadu_ps(buffer + i)));
+        }
+        return std::max(horizontalMaxSSE2(peak),
+                        peakScalar(buffer + i, n - i));
+    }
+
+    RG_SSE2 void meterSSE2(const sample_t *buffer, size_t n,
+                           float &peak, float &sumOfSquares)
+    {
+        __m128 p = _mm_setzero_ps();
+        __m128 sum = _mm_setzero_ps();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            const __m128 s = _mm_loadu_ps(buffer + i);
+            p = _mm_max_ps(p, absSSE2(s));
+            sum = _mm_add_ps(sum, _mm_mul_ps(s, s));
+        }
+        meterScalar(buffer + i, n - i, peak, sumOfSquares);
+        peak = std::max(peak, horizontalMaxSSE2(p));
+        sumOfSquares += horizontalSumSSE2(sum);
+    }
+
+    RG_SSE2 void addAndMeterSSE2(sample_t *dest, const sample_t *source,
+                                 size_t n, float &peak, float &sumOfSquares)
+    {
+        __m128 p = _mm_setzero_ps();
+        __m128 sum = _mm_setzero_ps();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            const __m128 s = _mm_loadu_ps(source + i);
+            p = _mm_max_ps(p, absSSE2(s));
+            sum = _mm_add_ps(sum, _mm_mul_ps(s, s));
+            _mm_storeu_ps(dest + i, _mm_add_ps(_mm_loadu_ps(dest + i), s));
+        }
+        addAndMeterScalar(dest + i, source + i, n - i, peak, sumOfSquares);
+        peak = std::max(peak, horizontalMaxSSE2(p));
+        sumOfSquares += horizontalSumSSE2(sum);
+    }
+
+    RG_SSE2 float multiplyAndPeakSSE2(sample_t *buffer, float gain, size_t n)
+    {
+        const __m128 g = _mm_set1_ps(gain);
+        __m128 peak = _mm_setzero_ps();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            const __m128 s = _mm_mul_ps(_mm_loadu_ps(buffer + i), g);
+            peak = _mm_max_ps(peak, absSSE2(s));
+            _mm_storeu_ps(buffer + i, s);
+        }
+        return std::max(horizontalMaxSSE2(peak),
+                        multiplyAndPeakScalar(buffer + i, gain, n - i));
+    }
+
+    RG_SSE2 void scaleAndMeterSSE2(sample_t *dest, const sample_t *source,
+                                   float gain, size_t n,
+                                   float &peak, float &sumOfSquares)
+    {
+        const __m128 g = _mm_set1_ps(gain);
+        __m128 p = _mm_setzero_ps();
+        __m128 sum = _mm_setzero_ps();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            const __m128 s = _mm_mul_ps(_mm_loadu_ps(source + i), g);
+            p = _mm_max_ps(p, absSSE2(s));
+            sum = _mm_add_ps(sum, _mm_mul_ps(s, s));
+            _mm_storeu_ps(dest + i, s);
+        }
+        scaleAndMeterScalar(dest + i, source + i, gain, n - i,
+                            peak, sumOfSquares);
+        peak = std::max(peak, horizontalMaxSSE2(p));
+        sumOfSquares += horizontalSumSSE2(sum);
+    }
+
+    RG_SSE2 void multiplyRampAndMeterSSE2(sample_t *buffer,
+                                          float startGain, float endGain,
+                                          size_t n,
+                                          float &peak, float &sumOfSquares)
+    {
+        const float step = n ? (endGain - startGain) / float(n) : 0;
+        const __m128 start = _mm_set1_ps(startGain);
+        const __m128 steps = _mm_set1_ps(step);
+        __m128 index = _mm_setr_ps(0, 1, 2, 3);
+        const __m128 four = _mm_set1_ps(4);
+        __m128 p = _mm_setzero_ps();
+        __m128 sum = _mm_setzero_ps();
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            const __m128 g = _mm_add_ps(start, _mm_mul_ps(steps, index));
+            const __m128 s = _mm_mul_ps(_mm_loadu_ps(buffer + i), g);
+            p = _mm_max_ps(p, absSSE2(s));
+            sum = _mm_add_ps(sum, _mm_mul_ps(s, s));
+            _mm_storeu_ps(buffer + i, s);
+            index = _mm_add_ps(index, four);
+        }
+        rampAndMeterTail(buffer, startGain, step, i, n, peak, sumOfSquares);
+        peak = std::max(peak, horizontalMaxSSE2(p));
+        sumOfSquares += horizontalSumSSE2(sum);
+    }
+
+#undef RG_SSE2
+
+    // AVX2.  Eight samples at a time, then the SSE2 version for
+    // whatever is left over.  These only need AVX instructions, but
+    // anything with AVX2 is new enough that unaligned 256-bit loads
+    // don't cost extra.
+
+#define RG_AVX2 __attribute__((target("avx2")))
+
+    RG_AVX2 inline __m256 absAVX2(__m256 v)
+    {
+        return _mm256_and_ps(
+                v, _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff)));
+    }
+
+    RG_AVX2 inline float horizontalMaxAVX2(__m256 v)
+    {
+        return horizontalMaxSSE2(_mm_max_ps(_mm256_castps256_ps128(v),
+                                            _mm256_extractf128_ps(v, 1)));
+    }
+
+    RG_AVX2 inline float horizontalSumAVX2(__m256 v)
+    {
+        return horizontalSumSSE2(_mm_add_ps(_mm256_castps256_ps128(v),
+                                            _mm256_extractf128_ps(v, 1)));
+    }
+
+    RG_AVX2 void addAVX2(sample_t *dest, const sample_t *source, size_t n)
+    {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_ps(dest + i,
+                             _mm256_add_ps(_mm256_loadu_ps(dest + i),
+                                           _mm256_loadu_ps(source + i)));
+        }
+        addSSE2(dest + i, source + i, n - i);
+    }
+
+    RG_AVX2 void addScaledAVX2(sample_t *dest, const sample_t *source,
+                               float gain, size_t n)
+    {
+        const __m256 g = _mm256_set1_ps(gain);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            const __m256 s = _mm256_mul_ps(_mm256_loadu_ps(source + i), g);
+            _mm256_storeu_ps(dest + i,
+                             _mm256_add_ps(_mm256_loadu_ps(dest + i), s));
+        }
+        addScaledSSE2(dest + i, source + i, gain, n - i);
+    }
+
+    RG_AVX2 void multiplyAVX2(sample_t *buffer, float gain, size_t n)
+    {
+        const __m256 g = _mm256_set1_ps(gain);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_ps(buffer + i,
+                             _mm256_mul_ps(_mm256_loadu_ps(buffer + i), g));
+        }
+        multiplySSE2(buffer + i, gain, n - i);
+    }
+
+    RG_AVX2 void multiplyRampAVX2(sample_t *buffer,
+                                  float startGain, float endGain, size_t n)
+    {
+        if (n == 0)
+            return;
+        const float step = (endGain - startGain) / float(n);
+        const __m256 start = _mm256_set1_ps(startGain);
+        const __m256 steps = _mm256_set1_ps(step);
+        __m256 index = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256 eight = _mm256_set1_ps(8);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            const __m256 g = _mm256_add_ps(start, _mm256_mul_ps(steps, index));
+            _mm256_storeu_ps(buffer + i,
+                             _mm256_mul_ps(_mm256_loadu_ps(buffer + i), g));
+            index = _mm256_add_ps(index, eight);
+        }
+        for (; i < n; ++i)
+            buffer[i] *= startGain + step * float(i);
+    }
+
+    RG_AVX2 float panAVX2(const sample_t *mono,
+                          sample_t *left, sample_t *right,
+                          float gainLeft, float gainRight, size_t n)
+    {
+        const __m256 gl = _mm256_set1_ps(gainLeft);
+        const __m256 gr = _mm256_set1_ps(gainRight);
+        __m256 peak = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            const __m256 s = _mm256_loadu_ps(mono + i);
+            peak = _mm256_max_ps(peak, absAVX2(s));
+            _mm256_storeu_ps(left + i, _mm256_mul_ps(s, gl));
+            _mm256_storeu_ps(right + i, _mm256_mul_ps(s, gr));
+        }
+        return std::max(horizontalMaxAVX2(peak),
+                        panSSE2(mono + i, left + i, right + i,
+                                gainLeft, gainRight, n - i));
+    }
+
+    RG_AVX2 float peakAVX2(const sample_t *buffer, size_t n)
+    {
+        __m256 peak = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            peak = _mm256_max_ps(peak, absAVX2(_mm256_loadu_ps(buffer + i)));
+        }
+        return std::max(horizontalMaxAVX2(peak),
+                        peakSSE2(buffer + i, n - i));
+    }
+
+    RG_AVX2 void meterAVX2(const sample_t *buffer, size_t n,
+                           float &peak, float &sumOfSquares)
+    {
+        __m256 p = _mm256_setzero_ps();
+        __m256 sum = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            const __m256 s = _mm256_loadu_ps(buffer + i);
+            p = _mm256_max_ps(p, absAVX2(s));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(s, s));
+        }
+        meterSSE2(buffer + i, n - i, peak, sumOfSquares);
+        peak = std::max(peak, horizontalMaxAVX2(p));
+        sumOfSquares += horizontalSumAVX2(sum);
+    }
+
+    RG_AVX2 void addAndMeterAVX2(sample_t *dest, const sample_t *source,
+                                 size_t n, float &peak, float &sumOfSquares)
+    {
+        __m256 p = _mm256_setzero_ps();
+        __m256 sum = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            const __m256 s = _mm256_loadu_ps(source + i);
+            p = _mm256_max_ps(p, absAVX2(s));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(s, s));
+            _mm256_storeu_ps(dest + i, _mm256_add_ps(_mm256_loadu_ps(dest + i), s));
+        }
+        addAndMeterSSE2(dest + i, source + i, n - i, peak, sumOfSquares);
+        peak = std::max(peak, horizontalMaxAVX2(p));
+        sumOfSquares += horizontalSumAVX2(sum);
+    }
+
+    RG_AVX2 float multiplyAndPeakAVX2(sample_t *buffer, float gain, size_t n)
+    {
+        const __m256 g = _mm256_set1_ps(gain);
+        __m256 peak = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            const __m256 s = _mm256_mul_ps(_mm256_loadu_ps(buffer + i), g);
+            peak = _mm256_max_ps(peak, absAVX2(s));
+            _mm256_storeu_ps(buffer + i, s);
+        }
+        return std::max(horizontalMaxAVX2(peak),
+                        multiplyAndPeakSSE2(buffer + i, gain, n - i));
+    }
+
+    RG_AVX2 void scaleAndMeterAVX2(sample_t *dest, const sample_t *source,
+                                   float gain, size_t n,
+                                   float &peak, float &sumOfSquares)
+    {
+        const __m256 g = _mm256_set1_ps(gain);
+        __m256 p = _mm256_setzero_ps();
+        __m256 sum = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            const __m256 s = _mm256_mul_ps(_mm256_loadu_ps(source + i), g);
+            p = _mm256_max_ps(p, absAVX2(s));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(s, s));
+            _mm256_storeu_ps(dest + i, s);
+        }
+        scaleAndMeterSSE2(dest + i, source + i, gain, n - i,
+                          peak, sumOfSquares);
+        peak = std::max(peak, horizontalMaxAVX2(p));
+        sumOfSquares += horizontalSumAVX2(sum);
+    }
+
+    RG_AVX2 void multiplyRampAndMeterAVX2(sample_t *buffer,
+                                          float startGain, float endGain,
+                                          size_t n,
+                                          float &peak, float &sumOfSquares)
+    {
+        const float step = n ? (endGain - startGain) / float(n) : 0;
+        const __m256 start = _mm256_set1_ps(startGain);
+        const __m256 steps = _mm256_set1_ps(step);
+        __m256 index = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256 eight = _mm256_set1_ps(8);
+        __m256 p = _mm256_setzero_ps();
+        __m256 sum = _mm256_setzero_ps();
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            const __m256 g = _mm256_add_ps(start, _mm256_mul_ps(steps, index));
+            const __m256 s = _mm256_mul_ps(_mm256_loadu_ps(buffer + i), g);
+            p = _mm256_max_ps(p, absAVX2(s));
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(s, s));
+            _mm256_storeu_ps(buffer + i, s);
+            index = _mm256_add_ps(index, eight);
+        }
+        rampAndMeterTail(buffer, startGain, step, i, n, peak, sumOfSquares);
+        peak = std::max(peak, horizontalMaxAVX2(p));
+        sumOfSquares += horizontalSumAVX2(sum);
+    }
+
+#undef RG_AVX2
+
+#endif  // RG_AUDIO_KERNELS_X86
+
+    struct Kernels
+    {
+        AudioKernels::Implementation implementation;
+
+        void (*add)(sample_t *, const sample_t *, size_t);
+        void (*addScaled)(sample_t *, const sample_t *, float, size_t);
+        void (*multiply)(sample_t *, float, size_t);
+        void (*multiplyRamp)(sample_t *, float, float, size_t);
+        float (*pan)(const sample_t *, sample_t *, sample_t *,
+                     float, float, size_t);
+        float (*peak)(const sample_t *, size_t);
+        void (*meter)(const sample_t *, size_t, float &, float &);
+        void (*addAndMeter)(sample_t *, const sample_t *, size_t,
+                            float &, float &);
+        float (*multiplyAndPeak)(sample_t *, float, size_t);
+        void (*scaleAndMeter)(sample_t *, const sample_t *, float, size_t,
+                              float &, float &);
+        void (*multiplyRampAndMeter)(sample_t *, float, float, size_t,
+                                     float &, float &);
+    };
+
+    const Kernels scalarKernels = {
+        AudioKernels::Scalar,
+        addScalar, addScaledScalar, multiplyScalar, multiplyRampScalar,
+        panScalar, peakScalar, meterScalar,
+        addAndMeterScalar, multiplyAndPeakScalar, scaleAndMeterScalar,
+        multiplyRampAndMeterScalar
+    };
+
+#ifdef RG_AUDIO_KERNELS_X86
+    const Kernels sse2Kernels = {
+        AudioKernels::SSE2,
+        addSSE2, addScaledSSE2, multiplySSE2, multiplyRampSSE2,
+        panSSE2, peakSSE2, meterSSE2,
+        addAndMeterSSE2, multiplyAndPeakSSE2, scaleAndMeterSSE2,
+        multiplyRampAndMeterSSE2
+    };
+
+    const Kernels avx2Kernels = {
+        AudioKernels::AVX2,
+        addAVX2, addScaledAVX2, multiplyAVX2, multiplyRampAVX2,
+        panAVX2, peakAVX2, meterAVX2,
+        addAndMeterAVX2, multiplyAndPeakAVX2, scaleAndMeterAVX2,
+        multiplyRampAndMeterAVX2
+    };
+#endif
+
+    const Kernels *findKernels(AudioKernels::Implementation implementation)
+    {
+        switch (implementation) {
+#ifdef RG_AUDIO_KERNELS_X86
+        case AudioKernels::AVX2:
+            if (__builtin_cpu_supports("avx2"))
+                return &avx2Kernels;
+            break;
+        case AudioKernels::SSE2:
+            if (__builtin_cpu_supports("sse2"))
+                return &sse2Kernels;
+            break;
+#else
+        case AudioKernels::AVX2:
+        case AudioKernels::SSE2:
+            break;
+#endif
+        case AudioKernels::Scalar:
+            return &scalarKernels;
+        }
+
+        return nullptr;
+    }
+
+    const Kernels *bestKernels()
+    {
+        const Kernels *kernels = findKernels(AudioKernels::AVX2);
+        if (!kernels)
+            kernels = findKernels(AudioKernels::SSE2);
+        if (!kernels)
+            kernels = &scalarKernels;
+        return kernels;
+    }
+
+    const Kernels *&currentKernels()
+    {
+        static const Kernels *kernels = bestKernels();
+        return kernels;
+    }
+
+}
+
+void
+AudioKernels::add(sample_t *dest, const sample_t *source, size_t n)
+{
+    currentKernels()->add(dest, source, n);
+}
+
+void
+AudioKernels::addScaled(sample_t *dest, const sample_t *source,
+                        float gain, size_t n)
+{
+    currentKernels()->addScaled(dest, source, gain, n);
+}
+
+void
+AudioKernels::multiply(sample_t *buffer, float gain, size_t n)
+{
+    currentKernels()->multiply(buffer, gain, n);
+}
+
+void
+AudioKernels::multiplyRamp(sample_t *buffer,
+                           float startGain, float endGain, size_t n)
+{
+    currentKernels()->multiplyRamp(buffer, startGain, endGain, n);
+}
+
+float
+AudioKernels::pan(const sample_t *mono, sample_t *left, sample_t *right,
+                  float gainLeft, float gainRight, size_t n)
+{
+    return currentKernels()->pan(mono, left, right, gainLeft, gainRight, n);
+}
+
+float
+AudioKernels::peak(const sample_t *buffer, size_t n)
+{
+    return currentKernels()->peak(buffer, n);
+}
+
+void
+AudioKernels::meter(const sample_t *buffer, size_t n,
+                    float &peak, float &sumOfSquares)
+{
+    currentKernels()->meter(buffer, n, peak, sumOfSquares);
+}
+
+void
+AudioKernels::addAndMeter(sample_t *dest, const sample_t *source, size_t n,
+                          float &peak, float &sumOfSquares)
+{
+    currentKernels()->addAndMeter(dest, source, n, peak, sumOfSquares);
+}
+
+float
+AudioKernels::multiplyAndPeak(sample_t *buffer, float gain, size_t n)
+{
+    return currentKernels()->multiplyAndPeak(buffer, gain, n);
+}
+
+void
+AudioKernels::scaleAndMeter(sample_t *dest, const sample_t *source,
+                            float gain, size_t n,
+                            float &peak, float &sumOfSquares)
+{
+    currentKernels()->scaleAndMeter(dest, source, gain, n,
+                                    peak, sumOfSquares);
+}
+
+void
+AudioKernels::multiplyRampAndMeter(sample_t *buffer,
+                                   float startGain, float endGain, size_t n,
+                                   float &peak, float &sumOfSquares)
+{
+    currentKernels()->multiplyRampAndMeter(buffer, startGain, endGain, n,
+                                           peak, sumOfSquares);
+}
+
+AudioKernels::Implementation
+AudioKernels::getImplementation()
+{
+    return currentKernels()->implementation;
+}
+
+bool
+AudioKernels::isSupported(Implementation implementation)
+{
+    return findKernels(implementation) != nullptr;
+}
+
+bool
+AudioKernels::setImplementation(Implementation implementation)
+{
+    const Kernels *kernels = findKernels(implementation);
+    if (!kernels)
+        return false;
+
+    currentKernels() = kernels;
+    return true;
+}
+
+
+}
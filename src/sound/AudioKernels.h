@@ -0,0 +1,127 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_AUDIO_KERNELS_H
+#define RG_AUDIO_KERNELS_H
+
+#include <cstddef>
+
+#include <rosegardenprivate_export.h>
+
+
+namespace Rosegarden
+{
+
+
+typedef float sample_t;
+
+/// Vectorised inner loops for the audio mixers.
+/**
+ * Each kernel has a scalar version plus, on x86, SSE2 and AVX2
+ * versions.  The best one the CPU supports is picked the first time any
+ * kernel is called.  The results agree with the scalar versions to
+ * within float rounding.
+ *
+ * None of these allocate or lock, so they are all RT safe.  Buffers
+ * need no particular alignment.  Where a kernel takes both a source and
+ * a destination they may be the same buffer, but must not otherwise
+ * overlap.
+ */
+class ROSEGARDENPRIVATE_EXPORT AudioKernels
+{
+public:
+    /// dest[i] += source[i]
+    static void add(sample_t *dest, const sample_t *source, size_t n);
+
+    /// dest[i] += source[i] * gain
+    static void addScaled(sample_t *dest, const sample_t *source,
+                          float gain, size_t n);
+
+    /// buffer[i] *= gain
+    static void multiply(sample_t *buffer, float gain, size_t n);
+
+    /// buffer[i] *= startGain + (endGain - startGain) * i / n
+    /**
+     * A linear ramp that stops one step short of endGain, so that a
+     * following block at endGain (or ramping on from it) continues it
+     * without a step.
+     */
+    static void multiplyRamp(sample_t *buffer,
+                             float startGain, float endGain, size_t n);
+
+    /// left[i] = mono[i] * gainLeft, right[i] = mono[i] * gainRight
+    /**
+     * left (but not right) may be the same buffer as mono.  Returns the
+     * peak absolute value of mono.
+     */
+    static float pan(const sample_t *mono,
+                     sample_t *left, sample_t *right,
+                     float gainLeft, float gainRight, size_t n);
+
+    /// Peak absolute value.
+    static float peak(const sample_t *buffer, size_t n);
+
+    /// Peak absolute value and sum of squares in one pass.
+    /**
+     * For RMS: sqrt(sumOfSquares / n).
+     */
+    static void meter(const sample_t *buffer, size_t n,
+                      float &peak, float &sumOfSquares);
+
+    /// add() and meter() of source in one pass.
+    static void addAndMeter(sample_t *dest, const sample_t *source, size_t n,
+                            float &peak, float &sumOfSquares);
+
+    /// multiply() and peak() of the result in one pass.
+    static float multiplyAndPeak(sample_t *buffer, float gain, size_t n);
+
+    /// dest[i] = source[i] * gain, and meter() of the result, in one pass.
+    static void scaleAndMeter(sample_t *dest, const sample_t *source,
+                              float gain, size_t n,
+                              float &peak, float &sumOfSquares);
+
+    /// multiplyRamp() and meter() of the result in one pass.
+    /**
+     * This is what the mixers use to apply a fader level: the gain moves
+     * smoothly from the level at the end of the previous block to the
+     * current one, and the meters see the result without another pass
+     * over the buffer.  With startGain == endGain it is a plain gain.
+     */
+    static void multiplyRampAndMeter(sample_t *buffer,
+                                     float startGain, float endGain, size_t n,
+                                     float &peak, float &sumOfSquares);
+
+    enum Implementation {
+        Scalar,
+        SSE2,
+        AVX2
+    };
+
+    /// The implementation in use.
+    static Implementation getImplementation();
+    /// Whether this CPU can run the given implementation.
+    static bool isSupported(Implementation implementation);
+    /// For tests and benchmarks only.  Not thread safe.
+    /**
+     * Returns false, and changes nothing, if the CPU doesn't support
+     * the implementation.
+     */
+    static bool setImplementation(Implementation implementation);
+};
+
+
+}
+
+#endif
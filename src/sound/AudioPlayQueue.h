@@ -21,6 +21,8 @@
 
 #include "PlayableData.h"
 
+#include <rosegardenprivate_export.h>
+
 #include <set>
 #include <vector>
 #include <map>
@@ -42,7 +44,7 @@ class PlayableAudioFile;
  * that no threads will be performing lookup.
  */
 
-class AudioPlayQueue
+class ROSEGARDENPRIVATE_EXPORT AudioPlayQueue
 {
 public:
     AudioPlayQueue();
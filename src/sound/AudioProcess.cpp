@@ -13,9 +13,12 @@
     COPYING included with this distribution for more information.
 */
 
+#define RG_MODULE_STRING "[AudioProcess]"
+
 #include "AudioProcess.h"
 
 #include "AudioInstrumentMixer.h"
+#include "AudioKernels.h"
 #include "RunnablePluginInstance.h"
 #include "PlayableAudioFile.h"
 #include "RecordableAudioFile.h"
@@ -23,13 +26,16 @@
 #include "MappedStudio.h"
 #include "base/AudioLevel.h"
 #include "AudioPlayQueue.h"
+#include "RealTimeLog.h"
 
 #include "misc/Strings.h"
 
 #include <sys/time.h>
 #include <pthread.h>
 
+#include <algorithm>
 #include <cmath>
+#include <functional>
 
 #ifdef __FreeBSD__
 #include <stdlib.h>
@@ -48,6 +54,18 @@ namespace Rosegarden
 {
 
 
+namespace
+{
+    // How far ahead of playback AudioFileReader::kick() fills ring
+    // buffers, beyond the read buffer length.
+    const RealTime a_fillAhead(3, 0);
+
+    // How far beyond that it maps files and asks for their first
+    // few seconds to be read from disk.
+    const RealTime a_prefetchAhead(5, 0);
+}
+
+
 /* Branch-free optimizer-resistant denormal killer courtesy of Simon
    Jenkins on LAD: */
 // ??? These are defined in two places.  Pull out.
@@ -213,6 +231,8 @@ AudioThread::staticThreadRun(void *arg)
 
     pthread_cleanup_push(staticThreadCleanup, arg);
 
+    RealTimeLog::registerThread();
+
     inst->getLock();
     inst->m_exiting = false;
     inst->threadRun();
@@ -225,12 +245,17 @@ AudioThread::staticThreadRun(void *arg)
     inst->releaseLock();
     pthread_cleanup_pop(0);
 
+    RealTimeLog::unregisterThread();
+
     return nullptr;
 }
 
 void
 AudioThread::staticThreadCleanup(void *arg)
 {
+    // Cancelled, so staticThreadRun() won't get to it.
+    RealTimeLog::unregisterThread();
+
     AudioThread *inst = static_cast<AudioThread *>(arg);
     if (!inst || inst->m_exiting)
         return ;
@@ -393,6 +418,11 @@ AudioBussMixer::generateBuffers()
             (void)mbuss->getProperty(MappedAudioBuss::Pan, pan);
 
             setBussLevels(i + 1, level, pan);
+
+            // Start at the fader level rather than ramping up from
+            // silence.
+            rec.appliedGainLeft = rec.gainLeft;
+            rec.appliedGainRight = rec.gainRight;
         }
     }
 
@@ -454,14 +484,14 @@ AudioBussMixer::kick(bool wantLock, bool signalInstrumentMixer)
 
 #ifdef DEBUG_BUSS_MIXER
 
-    std::cerr << "AudioBussMixer::kick" << std::endl;
+    RG_RT_LOG("AudioBussMixer::kick()");
 #endif
 
     processBlocks();
 
 #ifdef DEBUG_BUSS_MIXER
 
-    std::cerr << "AudioBussMixer::kick: processed" << std::endl;
+    RG_RT_LOG("AudioBussMixer::kick(): processed");
 #endif
 
     if (wantLock)
@@ -559,7 +589,7 @@ AudioBussMixer::processBlocks()
 #ifdef DEBUG_BUSS_MIXER
 
     if (m_driver->isPlaying())
-        std::cerr << "AudioBussMixer::processBlocks" << std::endl;
+        RG_RT_LOG("AudioBussMixer::processBlocks()");
 #endif
 
     InstrumentId audioInstrumentBase;
@@ -602,7 +632,8 @@ AudioBussMixer::processBlocks()
 
 #ifdef DEBUG_BUSS_MIXER
 
-            std::cerr << "AudioBussMixer::processBlocks: buss " << buss << ": write space " << w << " on channel " << ch << std::endl;
+            RG_RT_LOG("AudioBussMixer::processBlocks(): buss %1: write space %2 on channel %3",
+                      buss, w, ch);
 #endif
 
             if (minSpace == 0)
@@ -634,7 +665,8 @@ AudioBussMixer::processBlocks()
 #ifdef DEBUG_BUSS_MIXER
 
                     if (id == 1000) {
-                        std::cerr << "AudioBussMixer::processBlocks: buss " << buss << ": read space " << r << " on instrument " << id << ", channel " << ch << std::endl;
+                        RG_RT_LOG("AudioBussMixer::processBlocks(): buss %1: read space %2 on instrument %3, channel %4",
+                                  buss, r, id, ch);
                     }
 #endif
 
@@ -655,7 +687,8 @@ AudioBussMixer::processBlocks()
 
 #ifdef DEBUG_BUSS_MIXER
         if (m_driver->isPlaying())
-            std::cerr << "AudioBussMixer::processBlocks: doing " << blocks << " blocks at block size " << m_blockSize << std::endl;
+            RG_RT_LOG("AudioBussMixer::processBlocks(): doing %1 blocks at block size %2",
+                      blocks, m_blockSize);
 #endif
 
         for (size_t block = 0; block < blocks; ++block) {
@@ -744,8 +777,9 @@ AudioBussMixer::processBlocks()
                     }
 
 #ifdef DEBUG_BUSS_MIXER
-                    std::cerr << "Running buss plugin with " << plugin->getAudioInputCount()
-                    << " inputs, " << plugin->getAudioOutputCount() << " outputs" << std::endl;
+                    RG_RT_LOG("Running buss plugin with %1 inputs, %2 outputs",
+                              plugin->getAudioInputCount(),
+                              plugin->getAudioOutputCount());
 #endif
 
                     // We don't currently maintain a record of our
@@ -772,23 +806,33 @@ AudioBussMixer::processBlocks()
                 }
             }
 
+            const float appliedGain[2] = {
+                rec.appliedGainLeft, rec.appliedGainRight
+            };
+
             for (int ch = 0; ch < 2; ++ch) {
                 if (dormant) {
                     rec.buffers[ch]->zero(m_blockSize);
                 } else {
-                    for (size_t j = 0; j < m_blockSize; ++j) {
-                        m_processBuffersBuss[ch][j] *= gain[ch];
-                    }
+                    // Ramp from the last block's gain so that fader and
+                    // pan moves don't click.
+                    AudioKernels::multiplyRamp(m_processBuffersBuss[ch],
+                                               appliedGain[ch], gain[ch],
+                                               m_blockSize);
                     rec.buffers[ch]->write(m_processBuffersBuss[ch], m_blockSize);
                 }
             }
 
+            rec.appliedGainLeft = gain[0];
+            rec.appliedGainRight = gain[1];
+
             rec.dormant = dormant;
 
 #ifdef DEBUG_BUSS_MIXER
 
             if (m_driver->isPlaying())
-                std::cerr << "AudioBussMixer::processBlocks: buss " << buss << (dormant ? " dormant" : " not dormant") << std::endl;
+                RG_RT_LOG("AudioBussMixer::processBlocks(): buss %1 dormant %2",
+                          buss, dormant);
 #endif
 
         }
@@ -822,7 +866,7 @@ AudioBussMixer::processBlocks()
 
 
 #ifdef DEBUG_BUSS_MIXER
-    std::cerr << "AudioBussMixer::processBlocks: done" << std::endl;
+    RG_RT_LOG("AudioBussMixer::processBlocks(): done");
 #endif
 }
 
@@ -912,6 +956,7 @@ AudioFileReader::kick(bool wantLock)
 
     RealTime now = m_driver->getSequencerTime();
     const AudioPlayQueue *queue = m_driver->getAudioQueue();
+    const RealTime bufferLength = m_driver->getAudioReadBufferLength();
 
     bool someFilled = false;
 
@@ -920,27 +965,97 @@ AudioFileReader::kick(bool wantLock)
 
     AudioPlayQueue::FileSet playing;
 
-    queue->getPlayingFiles
-    (now, RealTime(3, 0) + m_driver->getAudioReadBufferLength(), playing);
+    queue->getPlayingFiles(now, a_fillAhead + bufferLength, playing);
+
+    // Anything that would run dry within half a buffer's time is read
+    // first, soonest first.
+    const RealTime urgentTime = bufferLength / 2;
+
+    m_requests.clear();
+
+    for (PlayableData *file : playing) {
+
+        ReadRequest request;
+        request.file = file;
+
+        // Time until it starts playing, if it hasn't yet.
+        RealTime lead = RealTime::zero();
+        if (file->getStartTime() > now)
+            lead = file->getStartTime() - now;
 
-    for (AudioPlayQueue::FileSet::iterator fi = playing.begin();
-            fi != playing.end(); ++fi) {
+        if (!file->isBuffered()) {
+            // Nothing in its buffers at all.
+            request.timeToUnderrun = lead;
+        } else if (file->isFullyBuffered()) {
+            // Nothing left to read.
+            continue;
+        } else {
+            // Played at one frame per frame.
+            request.timeToUnderrun = lead + RealTime::frame2RealTime(
+                    file->getSampleFramesAvailable(), m_sampleRate);
+        }
+
+        request.urgent = (request.timeToUnderrun < urgentTime);
+
+        m_requests.push_back(request);
+    }
+
+    std::sort(m_requests.begin(), m_requests.end(),
+              [](const ReadRequest &a, const ReadRequest &b) {
+                  if (a.urgent != b.urgent)
+                      return a.urgent;
+                  // Keep reads from the same file together unless
+                  // there's a rush.
+                  if (!a.urgent) {
+                      const AudioFile *fileA = a.file->getAudioFile();
+                      const AudioFile *fileB = b.file->getAudioFile();
+                      if (fileA != fileB)
+                          return std::less<const AudioFile *>()(fileA, fileB);
+                  }
+                  return a.timeToUnderrun < b.timeToUnderrun;
+              });
+
+#ifdef DEBUG_READER
+    if (!m_requests.empty()) {
+        std::cerr << "AudioFileReader::kick: " << m_requests.size()
+                  << " files to read, soonest to run dry in "
+                  << m_requests.front().timeToUnderrun << std::endl;
+    }
+#endif
+
+    for (const ReadRequest &request : m_requests) {
 
-        if (!(*fi)->isBuffered()) {
+        PlayableData *file = request.file;
+
+        if (!file->isBuffered()) {
             // fillBuffers has not been called on this file.  This
             // happens when a file is unmuted during playback.  The
             // results are unpredictable because we can no longer
             // synchronise with the correct JACK callback slice at
             // this point, but this is better than allowing the file
             // to update from its start as would otherwise happen.
-            (*fi)->fillBuffers(now);
+            file->fillBuffers(now);
             someFilled = true;
         } else {
-            if ((*fi)->updateBuffers())
+            if (file->updateBuffers())
                 someFilled = true;
         }
     }
 
+    // Get the disk started on files that are coming up, so that they
+    // don't all need reading from cold when they start.
+
+    AudioPlayQueue::FileSet upcoming;
+
+    queue->getPlayingFiles(now + a_fillAhead + bufferLength,
+                           a_prefetchAhead, upcoming);
+
+    for (PlayableData *file : upcoming) {
+        // Those at the start of the window were filled above.
+        if (file->getStartTime() > now  &&  !file->isBuffered())
+            file->prefetch();
+    }
+
     if (wantLock)
         releaseLock();
 
@@ -18,9 +18,12 @@
 
 #include "SoundDriver.h"
 #include "base/Instrument.h"
+#include "base/RealTime.h"
 #include "RingBuffer.h"
 #include "RecordableAudioFile.h"
 
+#include <rosegardenprivate_export.h>
+
 
 namespace Rosegarden
 {
@@ -153,7 +156,8 @@ protected:
     struct BufferRec
     {
         BufferRec() : dormant(true), buffers(), instruments(),
-                      gainLeft(0.0), gainRight(0.0) { }
+                      gainLeft(0.0), gainRight(0.0),
+                      appliedGainLeft(0.0), appliedGainRight(0.0) { }
         ~BufferRec();
 
         bool dormant;
@@ -161,15 +165,21 @@ protected:
         std::vector<RingBuffer<sample_t> *> buffers;
         std::vector<bool> instruments; // index is instrument id minus base
 
+        /// Targets, set by setBussLevels().
         float gainLeft;
         float gainRight;
+        /// The gains at the end of the last block, ramped from.
+        float appliedGainLeft;
+        float appliedGainRight;
     };
 
     typedef std::map<int, BufferRec> BufferMap;
     BufferMap m_bufferMap;
 };
 
-class AudioFileReader : public AudioThread
+class PlayableData;
+
+class ROSEGARDENPRIVATE_EXPORT AudioFileReader : public AudioThread
 {
 public:
     AudioFileReader(SoundDriver *driver,
@@ -177,6 +187,15 @@ public:
 
     ~AudioFileReader() override;
 
+    /// Top up the ring buffers of the files playing now or soon.
+    /**
+     * Files are read in order of how soon they would run dry, so that
+     * with many files playing the ones that happen to be late in the
+     * play queue don't underrun first.  Files that aren't in danger
+     * are read grouped by audio file so that reads of the same file
+     * are together.  Files starting a little further ahead are mapped
+     * and their first few seconds requested from the disk.
+     */
     bool kick(bool wantLock = true);
 
     /**
@@ -187,6 +206,20 @@ public:
 
 protected:
     void threadRun() override;
+
+private:
+    /// A file for kick() to update and how soon it needs it.
+    struct ReadRequest
+    {
+        PlayableData *file;
+        /// How long before the file's ring buffers run dry.
+        RealTime timeToUnderrun;
+        /// Whether timeToUnderrun is short enough to go first.
+        bool urgent;
+    };
+
+    /// Reused by kick() to save reallocating.
+    std::vector<ReadRequest> m_requests;
 };
 
 
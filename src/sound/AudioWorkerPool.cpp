@@ -0,0 +1,191 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[AudioWorkerPool]"
+
+#include "AudioWorkerPool.h"
+
+#include "RealTimeLog.h"
+
+#include <algorithm>  // std::min()
+#include <cerrno>
+#include <cstring>  // memset()
+#include <iostream>
+
+
+namespace Rosegarden
+{
+
+
+AudioWorkerPool::AudioWorkerPool(const std::string &name,
+                                 int workerCount,
+                                 int priority) :
+    m_name(name),
+    m_workers(),
+    m_function(nullptr),
+    m_context(nullptr),
+    m_jobCount(0),
+    m_nextJob(0),
+    m_exiting(false)
+{
+    sem_init(&m_start, 0, 0);
+    sem_init(&m_done, 0, 0);
+
+    // The workers keep pointers into this, so it must not reallocate.
+    m_workers.resize(std::max(workerCount, 0));
+
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+
+        Worker &worker = m_workers[i];
+        worker.pool = this;
+        worker.thread = int(i) + 1;
+        worker.started = false;
+
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+
+        if (priority > 0) {
+            struct sched_param param;
+            memset(&param, 0, sizeof(struct sched_param));
+            param.sched_priority = priority;
+
+            if (pthread_attr_setinheritsched(
+                        &attr, PTHREAD_EXPLICIT_SCHED)  ||
+                pthread_attr_setschedpolicy(&attr, SCHED_FIFO)  ||
+                pthread_attr_setschedparam(&attr, &param)) {
+                pthread_attr_destroy(&attr);
+                pthread_attr_init(&attr); // reset to safety
+            }
+        }
+
+        pthread_attr_setstacksize(&attr, 1048576);
+
+        int rv = pthread_create(&worker.id, &attr, staticWorkerRun, &worker);
+
+        if (rv != 0  &&  priority > 0) {
+            // Probably not allowed RT scheduling.
+            pthread_attr_destroy(&attr);
+            pthread_attr_init(&attr);
+            pthread_attr_setstacksize(&attr, 1048576);
+            rv = pthread_create(&worker.id, &attr, staticWorkerRun, &worker);
+        }
+
+        pthread_attr_destroy(&attr);
+
+        if (rv != 0) {
+            std::cerr << m_name << ": WARNING: failed to create worker "
+                      << worker.thread << std::endl;
+            break;
+        }
+
+        worker.started = true;
+    }
+
+    // Drop any we failed to start.
+    while (!m_workers.empty()  &&  !m_workers.back().started)
+        m_workers.pop_back();
+}
+
+AudioWorkerPool::~AudioWorkerPool()
+{
+    m_exiting = true;
+
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+        sem_post(&m_start);
+    }
+    for (size_t i = 0; i < m_workers.size(); ++i) {
+        pthread_join(m_workers[i].id, nullptr);
+    }
+
+    sem_destroy(&m_start);
+    sem_destroy(&m_done);
+}
+
+void
+AudioWorkerPool::run(JobFunction function, void *context, int jobCount)
+{
+    // Needs to be RT safe
+
+    if (jobCount <= 0)
+        return;
+
+    // AudioThread::terminate() cancels the mixer thread.  Don't let
+    // that happen while workers are still running jobs for us.
+    int oldCancelState;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &oldCancelState);
+
+    m_function = function;
+    m_context = context;
+    m_jobCount = jobCount;
+    m_nextJob.storeRelease(0);
+
+    // We take jobs too, so there's no point waking more workers than
+    // there are jobs beyond the first.
+    const int wake = std::min(int(m_workers.size()), jobCount - 1);
+
+    for (int i = 0; i < wake; ++i) {
+        sem_post(&m_start);
+    }
+
+    work(0);
+
+    for (int i = 0; i < wake; ++i) {
+        while (sem_wait(&m_done) != 0  &&  errno == EINTR) { }
+    }
+
+    pthread_setcancelstate(oldCancelState, nullptr);
+}
+
+void
+AudioWorkerPool::work(int thread)
+{
+    while (true) {
+        const int job = m_nextJob.fetchAndAddOrdered(1);
+        if (job >= m_jobCount)
+            break;
+
+        m_function(m_context, job, thread);
+    }
+}
+
+void *
+AudioWorkerPool::staticWorkerRun(void *arg)
+{
+    Worker *worker = static_cast<Worker *>(arg);
+    worker->pool->workerRun(worker->thread);
+    return nullptr;
+}
+
+void
+AudioWorkerPool::workerRun(int thread)
+{
+    RealTimeLog::registerThread();
+
+    while (true) {
+        while (sem_wait(&m_start) != 0  &&  errno == EINTR) { }
+
+        if (m_exiting)
+            break;
+
+        work(thread);
+
+        sem_post(&m_done);
+    }
+
+    RealTimeLog::unregisterThread();
+}
+
+
+}
@@ -0,0 +1,113 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_AUDIO_WORKER_POOL_H
+#define RG_AUDIO_WORKER_POOL_H
+
+#include <QAtomicInt>
+
+#include <pthread.h>
+#include <semaphore.h>
+
+#include <string>
+#include <vector>
+
+#include <rosegardenprivate_export.h>
+
+
+namespace Rosegarden
+{
+
+
+/// Pre-spawned real-time threads that share out a batch of jobs.
+/**
+ * AudioInstrumentMixer uses this to process independent instruments in
+ * parallel.  The threads are created up front, at the same SCHED_FIFO
+ * priority as the mixer, and sleep on a semaphore between batches.
+ *
+ * run() hands out jobs by index from a shared atomic counter.  Each
+ * thread, including the caller, takes the next unclaimed job as soon as
+ * it finishes the previous one, so a thread stuck on a heavy job doesn't
+ * hold up the rest.  run() returns once every job is done.  It doesn't
+ * allocate or lock, so it is safe to call from the audio threads.
+ *
+ * Only one thread may call run() at a time.
+ */
+class ROSEGARDENPRIVATE_EXPORT AudioWorkerPool
+{
+public:
+    /// Job callback.
+    /**
+     * thread identifies the calling thread: 0 for the thread that called
+     * run(), 1 to getThreadCount() - 1 for the workers.  Use it to pick
+     * per-thread scratch space.
+     */
+    typedef void (*JobFunction)(void *context, int job, int thread);
+
+    /// Start workerCount threads.
+    /**
+     * priority is the SCHED_FIFO priority.  If that can't be had, the
+     * workers run with normal scheduling.
+     */
+    AudioWorkerPool(const std::string &name, int workerCount, int priority);
+    ~AudioWorkerPool();
+
+    /// The number of threads that run() uses, including the caller.
+    int getThreadCount() const  { return int(m_workers.size()) + 1; }
+
+    /// Run jobs 0 to jobCount - 1 and wait for them all to finish.
+    void run(JobFunction function, void *context, int jobCount);
+
+private:
+    // Hide copy ctor and op=.
+    AudioWorkerPool(const AudioWorkerPool &);
+    AudioWorkerPool &operator=(const AudioWorkerPool &);
+
+    struct Worker
+    {
+        AudioWorkerPool *pool;
+        int thread;
+        pthread_t id;
+        bool started;
+    };
+
+    static void *staticWorkerRun(void *arg);
+    void workerRun(int thread);
+
+    /// Claim and run jobs until there are none left.
+    void work(int thread);
+
+    std::string m_name;
+
+    std::vector<Worker> m_workers;
+
+    /// Posted once per worker needed for a batch.
+    sem_t m_start;
+    /// Posted by each worker when it runs out of jobs.
+    sem_t m_done;
+
+    // The current batch.  Written before m_start is posted.
+    JobFunction m_function;
+    void *m_context;
+    int m_jobCount;
+    QAtomicInt m_nextJob;
+
+    bool m_exiting;
+};
+
+
+}
+
+#endif
@@ -877,7 +877,9 @@ DSSIPluginInstance::handleController(snd_seq_event_t *ev)
 void
 DSSIPluginInstance::run(const RealTime &blockTime)
 {
-    static snd_seq_event_t localEventBuffer[EVENT_BUFFER_SIZE];
+    // One per thread, as the instrument mixer may run several
+    // instances at once.
+    static thread_local snd_seq_event_t localEventBuffer[EVENT_BUFFER_SIZE];
     int evCount = 0;
     unsigned int evDeferred = 0;
 
@@ -65,6 +65,9 @@ public:
     bool isBypassed() const override { return m_bypassed; }
     void setBypassed(bool bypassed) override { m_bypassed = bypassed; }
 
+    // Grouped instances share run_multiple_synths() and its buffers.
+    bool canRunConcurrently() const override { return !m_grouped; }
+
     size_t getLatency() override;
 
     void silence() override;
@@ -21,10 +21,12 @@
 #include "MappedStudio.h"
 #include "AudioProcess.h"
 #include "AudioInstrumentMixer.h"
+#include "AudioKernels.h"
 #include "base/Profiler.h"
 #include "base/AudioLevel.h"
 #include "Audit.h"
 #include "PluginFactory.h"
+#include "RealTimeLog.h"
 #include "SequencerDataBlock.h"
 
 #include "misc/ConfigGroups.h"
@@ -35,6 +37,8 @@
 #include <QtGlobal>
 #include <QThread>
 
+#include <cmath>
+
 #ifdef HAVE_ALSA
 #ifdef HAVE_LIBJACK
 
@@ -46,6 +50,30 @@
 namespace Rosegarden
 {
 
+
+namespace
+{
+    /// 0 to 127, as LevelInfo has it.
+    int toFader(float multiplier)
+    {
+        return AudioLevel::multiplier_to_fader(
+                multiplier, 127, AudioLevel::LongFader);
+    }
+
+    /// Meter levels from each channel's peak and sum of squares.
+    LevelInfo makeLevelInfo(const float peak[2], const float sumOfSquares[2],
+                            size_t frames)
+    {
+        LevelInfo info;
+        info.level = toFader(peak[0]);
+        info.levelRight = toFader(peak[1]);
+        info.rms = toFader(frames ? std::sqrt(sumOfSquares[0] / frames) : 0);
+        info.rmsRight =
+                toFader(frames ? std::sqrt(sumOfSquares[1] / frames) : 0);
+        return info;
+    }
+}
+
 #if (defined(DEBUG_JACK_DRIVER) || defined(DEBUG_JACK_PROCESS) || defined(DEBUG_JACK_TRANSPORT))
 static unsigned long framesThisPlay = 0;
 static RealTime startTime;
@@ -68,10 +96,12 @@ JackDriver::JackDriver(AlsaDriver *alsaDriver) :
         m_fileWriter(nullptr),
         m_alsaDriver(alsaDriver),
         m_masterLevel(1.0),
+        m_masterGain(AudioLevel::dB_to_multiplier(1.0)),
         m_directMasterAudioInstruments(0L),
         m_directMasterSynthInstruments(0L),
         m_haveAsyncAudioEvent(false),
         m_kickedOutAt(0),
+        m_realTimeLogChannel(-1),
         m_framesProcessed(0),
         m_ok(false)
 {
@@ -185,6 +215,7 @@ JackDriver::~JackDriver()
 #endif
 
         jack_client_close(m_client);
+        releaseRealTimeLogChannel();
         RG_DEBUG << "dtor: done";
         m_client = nullptr;
     }
@@ -254,6 +285,7 @@ JackDriver::initialise(bool reinitialise)
 
     // set callbacks
     //
+    jack_set_thread_init_callback(m_client, jackThreadInit, this);
     jack_set_process_callback(m_client, jackProcessStatic, this);
     jack_set_buffer_size_callback(m_client, jackBufferSize, this);
     jack_set_sample_rate_callback(m_client, jackSampleRate, this);
@@ -286,7 +318,8 @@ JackDriver::initialise(bool reinitialise)
         m_fileReader = new AudioFileReader(m_alsaDriver, m_sampleRate);
         m_fileWriter = new AudioFileWriter(m_alsaDriver, m_sampleRate);
         m_instrumentMixer = new AudioInstrumentMixer
-                            (m_alsaDriver, m_fileReader, m_sampleRate, m_bufferSize);
+                            (m_alsaDriver, m_fileReader, m_sampleRate, m_bufferSize,
+                             Preferences::getAudioMixerThreads());
         m_bussMixer = new AudioBussMixer
                       (m_alsaDriver, m_instrumentMixer, m_sampleRate, m_bufferSize);
         m_instrumentMixer->setBussMixer(m_bussMixer);
@@ -792,8 +825,18 @@ JackDriver::jackProcessStatic(jack_nframes_t nframes, void *arg)
 {
     JackDriver *inst = static_cast<JackDriver*>(arg);
     if (inst) {
+        const jack_time_t start = jack_get_time();
         int ret = inst->jackProcess(nframes);
         inst->jackProcessDone();
+
+        // For the audio performance dialog.  The deadline is the time
+        // it takes to play the period.
+        if (inst->m_sampleRate > 0) {
+            SequencerDataBlock::getInstance()->addPeriod(
+                    int(jack_get_time() - start),
+                    int(jack_time_t(nframes) * 1000000 / inst->m_sampleRate));
+        }
+
         return ret;
     } else {
         return 0;
@@ -870,7 +913,7 @@ JackDriver::jackProcess(jack_nframes_t nframes)
                     m_instrumentMixer->releaseLock();
                     //#ifdef DEBUG_JACK_PROCESS
                 } else {
-                    RG_WARNING << "jackProcess(): WARNING: no instrument mixer lock available";
+                    RG_RT_LOG("jackProcess(): WARNING: no instrument mixer lock available");
                     //#endif
                 }
                 if (m_bussMixer->getBussCount() > 0) {
@@ -879,7 +922,7 @@ JackDriver::jackProcess(jack_nframes_t nframes)
                         m_bussMixer->releaseLock();
                         //#ifdef DEBUG_JACK_PROCESS
                     } else {
-                        RG_WARNING << "jackProcess(): WARNING: no buss mixer lock available";
+                        RG_RT_LOG("jackProcess(): WARNING: no buss mixer lock available");
                         //#endif
                     }
                 }
@@ -968,7 +1011,8 @@ JackDriver::jackProcess(jack_nframes_t nframes)
         } else if (state == JackTransportStarting) {
             return jackProcessEmpty(nframes);
         } else if (state != JackTransportRolling) {
-            RG_WARNING << "jackProcess(): WARNING: unexpected JACK transport state " << state;
+            RG_RT_LOG("jackProcess(): WARNING: unexpected JACK transport state %1",
+                      state);
         }
     }
 
@@ -1071,7 +1115,8 @@ JackDriver::jackProcess(jack_nframes_t nframes)
     for (int buss = 0; buss < bussCount; ++buss) {
 
         sample_t *submaster[2] = { nullptr, nullptr };
-        sample_t peak[2] = { 0.0, 0.0 };
+        float peak[2] = { 0.0, 0.0 };
+        float sumOfSquares[2] = { 0.0, 0.0 };
 
         if ((int)m_outputSubmasters.size() > buss * 2 + 1) {
             submaster[0] =
@@ -1098,24 +1143,16 @@ JackDriver::jackProcess(jack_nframes_t nframes)
             } else {
                 size_t actual = rb->read(submaster[ch], nframes);
                 if (actual < nframes) {
+                    SequencerDataBlock::getInstance()->addBussMixUnderrun();
                     reportFailure(MappedEvent::FailureBussMixUnderrun);
                 }
-                for (size_t i = 0; i < nframes; ++i) {
-                    sample_t sample = submaster[ch][i];
-                    if (sample > peak[ch])
-                        peak[ch] = sample;
-                    master[ch][i] += sample;
-                }
+                AudioKernels::addAndMeter(master[ch], submaster[ch], nframes,
+                                          peak[ch], sumOfSquares[ch]);
             }
         }
 
-        LevelInfo info;
-        info.level = AudioLevel::multiplier_to_fader(
-                peak[0], 127, AudioLevel::LongFader);
-        info.levelRight = AudioLevel::multiplier_to_fader(
-                peak[1], 127, AudioLevel::LongFader);
-
-        SequencerDataBlock::getInstance()->setSubmasterLevel(buss, info);
+        SequencerDataBlock::getInstance()->setSubmasterLevel(
+                buss, makeLevelInfo(peak, sumOfSquares, nframes));
 
         for (InstrumentId id = audioInstrumentBase;
                 id < audioInstrumentBase + audioInstruments; ++id) {
@@ -1144,7 +1181,8 @@ JackDriver::jackProcess(jack_nframes_t nframes)
             continue;
 
         sample_t *instrument[2] = { nullptr, nullptr };
-        sample_t peak[2] = { 0.0, 0.0 };
+        float peak[2] = { 0.0, 0.0 };
+        float sumOfSquares[2] = { 0.0, 0.0 };
 
         if (int(m_outputInstruments.size()) > i * 2 + 1) {
             instrument[0] =
@@ -1212,16 +1250,19 @@ JackDriver::jackProcess(jack_nframes_t nframes)
 #endif
 
                 if (actual < nframes) {
-                    RG_WARNING << "jackProcess(): WARNING: read " << actual << " of " << nframes << " frames for " << id << " ch " << ch << " (pl " << playing << ", cl " << clocksRunning << ", aa " << asyncAudio << ")";
+                    RG_RT_LOG("jackProcess(): WARNING: read %1 of %2 frames for %3 ch %4",
+                              actual, nframes, id, ch);
+                    SequencerDataBlock::getInstance()->addMixUnderrun();
                     reportFailure(MappedEvent::FailureMixUnderrun);
                 }
 
-                for (size_t f = 0; f < nframes; ++f) {
-                    sample_t sample = instrument[ch][f];
-                    if (sample > peak[ch])
-                        peak[ch] = sample;
-                    if (directToMaster)
-                        master[ch][f] += sample;
+                if (directToMaster) {
+                    AudioKernels::addAndMeter(master[ch], instrument[ch],
+                                              nframes,
+                                              peak[ch], sumOfSquares[ch]);
+                } else {
+                    AudioKernels::meter(instrument[ch], nframes,
+                                        peak[ch], sumOfSquares[ch]);
                 }
             }
 
@@ -1235,13 +1276,8 @@ JackDriver::jackProcess(jack_nframes_t nframes)
             }
         }
 
-        LevelInfo info;
-        info.level = AudioLevel::multiplier_to_fader(
-                peak[0], 127, AudioLevel::LongFader);
-        info.levelRight = AudioLevel::multiplier_to_fader(
-                peak[1], 127, AudioLevel::LongFader);
-
-        SequencerDataBlock::getInstance()->setInstrumentLevel(id, info);
+        SequencerDataBlock::getInstance()->setInstrumentLevel(
+                id, makeLevelInfo(peak, sumOfSquares, nframes));
     }
 
     if (asyncAudio && synthCount == 0) {
@@ -1251,32 +1287,29 @@ JackDriver::jackProcess(jack_nframes_t nframes)
             dormantTime = dormantTime +
                           RealTime::frame2RealTime(m_bufferSize, m_sampleRate);
             if (dormantTime > RealTime(10, 0)) {
-                RG_WARNING << "jackProcess(): WARNING: dormantTime = " << dormantTime << ", resetting m_haveAsyncAudioEvent";
+                RG_RT_LOG("jackProcess(): WARNING: dormantTime = %1ms, resetting m_haveAsyncAudioEvent",
+                          dormantTime.sec * 1000 + dormantTime.msec());
                 m_haveAsyncAudioEvent = false;
             }
         }
     }
 
-    // Get master fader levels.  There's no pan on the master.
+    // Get master fader levels.  There's no pan on the master.  Ramp
+    // from the last period's gain so that fader moves don't click.
     float gain = AudioLevel::dB_to_multiplier(m_masterLevel);
     float masterPeak[2] = { 0.0, 0.0 };
+    float masterSumOfSquares[2] = { 0.0, 0.0 };
 
     for (int ch = 0; ch < 2; ++ch) {
-        for (size_t i = 0; i < nframes; ++i) {
-            sample_t sample = master[ch][i] * gain;
-            if (sample > masterPeak[ch])
-                masterPeak[ch] = sample;
-            master[ch][i] = sample;
-        }
+        AudioKernels::multiplyRampAndMeter(
+                master[ch], m_masterGain, gain, nframes,
+                masterPeak[ch], masterSumOfSquares[ch]);
     }
 
-    LevelInfo info;
-    info.level = AudioLevel::multiplier_to_fader(
-            masterPeak[0], 127, AudioLevel::LongFader);
-    info.levelRight = AudioLevel::multiplier_to_fader(
-            masterPeak[1], 127, AudioLevel::LongFader);
+    m_masterGain = gain;
 
-    SequencerDataBlock::getInstance()->setMasterLevel(info);
+    SequencerDataBlock::getInstance()->setMasterLevel(
+            makeLevelInfo(masterPeak, masterSumOfSquares, nframes));
 
     for (InstrumentId id = audioInstrumentBase;
             id < audioInstrumentBase + audioInstruments; ++id) {
@@ -1392,7 +1425,8 @@ JackDriver::jackProcessRecord(InstrumentId id,
 #endif
 
     bool wroteSomething = false;
-    sample_t peakLeft = 0.0, peakRight = 0.0;
+    float peak[2] = { 0.0, 0.0 };
+    float sumOfSquares[2] = { 0.0, 0.0 };
 
 #ifdef DEBUG_JACK_PROCESS
     RG_DEBUG << "jackProcessRecord(" << id << "): clocksRunning " << clocksRunning;
@@ -1461,25 +1495,17 @@ JackDriver::jackProcessRecord(InstrumentId id,
         RG_DEBUG << "jackProcessRecord(" << id << "): recording";
 #endif
 
-        memset(m_tempOutBuffer, 0, nframes * sizeof(sample_t));
-
         if (inputBufferLeft) {
-            for (size_t i = 0; i < nframes; ++i) {
-                sample_t sample = inputBufferLeft[i] * gain;
-                if (sample > peakLeft)
-                    peakLeft = sample;
-                m_tempOutBuffer[i] = sample;
-            }
+            AudioKernels::scaleAndMeter(m_tempOutBuffer, inputBufferLeft,
+                                        gain, nframes,
+                                        peak[0], sumOfSquares[0]);
 
             if (!m_outputMonitors.empty()) {
                 sample_t *buf =
                     static_cast<sample_t *>
                     (jack_port_get_buffer(m_outputMonitors[0], nframes));
-                if (buf) {
-                    for (size_t i = 0; i < nframes; ++i) {
-                        buf[i] += m_tempOutBuffer[i];
-                    }
-                }
+                if (buf)
+                    AudioKernels::add(buf, m_tempOutBuffer, nframes);
             }
 
             m_fileWriter->write(id, m_tempOutBuffer, 0, nframes);
@@ -1488,22 +1514,20 @@ JackDriver::jackProcessRecord(InstrumentId id,
         if (channels == 2) {
 
             if (inputBufferRight) {
-                for (size_t i = 0; i < nframes; ++i) {
-                    sample_t sample = inputBufferRight[i] * gain;
-                    if (sample > peakRight)
-                        peakRight = sample;
-                    m_tempOutBuffer[i] = sample;
-                }
+                AudioKernels::scaleAndMeter(m_tempOutBuffer, inputBufferRight,
+                                            gain, nframes,
+                                            peak[1], sumOfSquares[1]);
+
                 if (m_outputMonitors.size() > 1) {
                     sample_t *buf =
                         static_cast<sample_t *>
                         (jack_port_get_buffer(m_outputMonitors[1], nframes));
-                    if (buf) {
-                        for (size_t i = 0; i < nframes; ++i) {
-                            buf[i] += m_tempOutBuffer[i];
-                        }
-                    }
+                    if (buf)
+                        AudioKernels::add(buf, m_tempOutBuffer, nframes);
                 }
+            } else if (!inputBufferLeft) {
+                // Nothing has been written to it.
+                memset(m_tempOutBuffer, 0, nframes * sizeof(sample_t));
             }
 
             m_fileWriter->write(id, m_tempOutBuffer, 1, nframes);
@@ -1527,12 +1551,15 @@ JackDriver::jackProcessRecord(InstrumentId id,
                     (jack_port_get_buffer(m_outputMonitors[0], nframes));
             }
 
-            for (size_t i = 0; i < nframes; ++i) {
-                sample_t sample = inputBufferLeft[i] * gain;
-                if (sample > peakLeft)
-                    peakLeft = sample;
-                if (buf)
-                    buf[i] = sample;
+            if (buf) {
+                AudioKernels::scaleAndMeter(buf, inputBufferLeft, gain,
+                                            nframes,
+                                            peak[0], sumOfSquares[0]);
+            } else {
+                AudioKernels::meter(inputBufferLeft, nframes,
+                                    peak[0], sumOfSquares[0]);
+                peak[0] *= gain;
+                sumOfSquares[0] *= gain * gain;
             }
 
             if (channels == 2 && inputBufferRight) {
@@ -1543,26 +1570,27 @@ JackDriver::jackProcessRecord(InstrumentId id,
                         (jack_port_get_buffer(m_outputMonitors[1], nframes));
                 }
 
-                for (size_t i = 0; i < nframes; ++i) {
-                    sample_t sample = inputBufferRight[i] * gain;
-                    if (sample > peakRight)
-                        peakRight = sample;
-                    if (buf)
-                        buf[i] = sample;
+                if (buf) {
+                    AudioKernels::scaleAndMeter(buf, inputBufferRight, gain,
+                                                nframes,
+                                                peak[1], sumOfSquares[1]);
+                } else {
+                    AudioKernels::meter(inputBufferRight, nframes,
+                                        peak[1], sumOfSquares[1]);
+                    peak[1] *= gain;
+                    sumOfSquares[1] *= gain * gain;
                 }
             }
         }
     }
 
-    if (channels < 2)
-        peakRight = peakLeft;
+    if (channels < 2) {
+        peak[1] = peak[0];
+        sumOfSquares[1] = sumOfSquares[0];
+    }
 
-    LevelInfo info;
-    info.level = AudioLevel::multiplier_to_fader
-            (peakLeft, 127, AudioLevel::LongFader);
-    info.levelRight = AudioLevel::multiplier_to_fader
-            (peakRight, 127, AudioLevel::LongFader);
-    SequencerDataBlock::getInstance()->setInstrumentRecordLevel(id, info);
+    SequencerDataBlock::getInstance()->setInstrumentRecordLevel(
+            id, makeLevelInfo(peak, sumOfSquares, nframes));
 
     if (wroteSomething) {
         m_fileWriter->signal();
@@ -1909,6 +1937,26 @@ JackDriver::jackShutdown(void *arg)
     inst->reportFailure(MappedEvent::FailureJackDied);
 }
 
+void
+JackDriver::jackThreadInit(void *arg)
+{
+    // So that jackProcess() can use RG_RT_LOG.  JACK gives us no way to
+    // run anything on this thread as it ends, so remember the ring for
+    // releaseRealTimeLogChannel().
+    RealTimeLog::registerThread();
+
+    JackDriver *inst = static_cast<JackDriver *>(arg);
+    inst->m_realTimeLogChannel.storeRelease(RealTimeLog::getThreadChannel());
+}
+
+void
+JackDriver::releaseRealTimeLogChannel()
+{
+    // jack_client_close() has joined the process thread, so nothing is
+    // writing to the ring.
+    RealTimeLog::releaseChannel(m_realTimeLogChannel.fetchAndStoreOrdered(-1));
+}
+
 int
 JackDriver::jackXRun(void *arg)
 {
@@ -1921,6 +1969,8 @@ JackDriver::jackXRun(void *arg)
     Profiles::getInstance()->dump();
 #endif
 
+    SequencerDataBlock::getInstance()->addXRun();
+
     // Report to GUI
     //
     JackDriver *inst = static_cast<JackDriver*>(arg);
@@ -1939,6 +1989,7 @@ JackDriver::restoreIfRestorable()
 
     if (m_client) {
         jack_client_close(m_client);
+        releaseRealTimeLogChannel();
         RG_DEBUG << "restoreIfRestorable(): closed client";
         m_client = nullptr;
     }
@@ -26,6 +26,7 @@
 #include "base/RealTime.h"
 #include "sequencer/RosegardenSequencer.h"
 
+#include <QAtomicInt>
 #include <QStringList>
 
 namespace Rosegarden
@@ -203,6 +204,7 @@ protected:
     static int   jackSampleRate(jack_nframes_t nframes, void *arg);
     static void  jackShutdown(void *arg);
     static int   jackXRun(void *);
+    static void  jackThreadInit(void *);
 
     // static JACK transport callbacks
     static int   jackSyncCallback(jack_transport_state_t,
@@ -267,6 +269,8 @@ protected:
     AlsaDriver                  *m_alsaDriver;
 
     float                        m_masterLevel;
+    /// Master gain at the end of the last period, ramped from.
+    float                        m_masterGain;
     unsigned long                m_directMasterAudioInstruments; // bitmap
     unsigned long                m_directMasterSynthInstruments;
     std::map<InstrumentId, RealTime> m_instrumentLatencies;
@@ -284,6 +288,12 @@ protected:
     RecordInputMap               m_recordInputs;
 
     time_t                       m_kickedOutAt;
+
+    /// The RealTimeLog ring claimed by JACK's process thread, or -1.
+    QAtomicInt                   m_realTimeLogChannel;
+    /// Release it, once jack_client_close() has ended that thread.
+    void releaseRealTimeLogChannel();
+
     size_t                       m_framesProcessed;
 
     // initialise() has completed successfully, and there are no other issues
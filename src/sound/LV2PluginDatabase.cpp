@@ -96,6 +96,11 @@ initPluginData()
         pluginData.isInstrument = ((curis == LV2_CORE__InstrumentPlugin) ||
                                    (curis == LV2_CORE__OscillatorPlugin));
 
+        LilvNode* hardRTNode = lilv_new_uri(world, LV2_CORE__hardRTCapable);
+        pluginData.hardRTCapable = lilv_plugin_has_feature(plugin, hardRTNode);
+        lilv_node_free(hardRTNode);
+        RG_DEBUG << "Hard RT capable:" << pluginData.hardRTCapable;
+
         unsigned int nports = lilv_plugin_get_num_ports(plugin);
         RG_DEBUG << "Plugin ports:" << nports;
 
@@ -51,6 +51,8 @@ namespace LV2PluginDatabase
         QString pluginClass;
         QString author;
         bool isInstrument{false};
+        /// Declares lv2:hardRTCapable.  run() doesn't block or allocate.
+        bool hardRTCapable{false};
         std::vector<LV2PortData> ports;
     };
 
@@ -316,6 +316,31 @@ LV2PluginInstance::init(int idealChannelCount)
     RG_DEBUG << "connections:" << m_connections.connections.size();
 }
 
+bool
+LV2PluginInstance::canRunConcurrently() const
+{
+    // LV2 allows run() on different instances at once, but many plugins
+    // keep state in statics all the same.  Only trust those that declare
+    // themselves hard RT capable.
+    if (!m_pluginData.hardRTCapable)
+        return false;
+
+    // Worker responses go through LV2Worker's shared queues.
+    if (m_workerInterface)
+        return false;
+
+    // Side chain inputs read another instrument's buffers, which may
+    // still be being written.  See run().
+    for (const PluginPort::Connection &c : m_connections.connections) {
+        if (c.instrumentId != 0  &&
+            c.instrumentId != m_instrument  &&
+            !c.isOutput)
+            return false;
+    }
+
+    return true;
+}
+
 size_t
 LV2PluginInstance::getLatency()
 {
@@ -100,6 +100,8 @@ public:
     bool isBypassed() const override { return m_bypassed; }
     void setBypassed(bool bypassed) override { m_bypassed = bypassed; }
 
+    bool canRunConcurrently() const override;
+
     size_t getLatency() override;
 
     void silence() override;
@@ -25,7 +25,7 @@
 #include "gui/seqmanager/MEBIterator.h"
 #include "sound/ControlBlock.h"
 
-#include <queue>  // std::priority_queue
+#include <algorithm>  // std::push_heap() etc...
 #include <functional>  // std::greater
 
 //#define DEBUG_META_ITERATOR 1
@@ -53,6 +53,8 @@ MappedBufMetaIterator::addBuffer(
     QSharedPointer<MEBIterator> iter(new MEBIterator(mappedEventBuffer));
     iter->moveTo(m_currentTime);
     m_iterators.push_back(iter);
+
+    m_dirty = true;
 }
 
 void
@@ -72,6 +74,8 @@ MappedBufMetaIterator::removeBuffer(
 
     // Remove from m_segments
     m_buffers.erase(mappedEventBuffer);
+
+    m_dirty = true;
 }
 
 void
@@ -79,6 +83,8 @@ MappedBufMetaIterator::clear()
 {
     m_iterators.clear();
     m_buffers.clear();
+
+    m_dirty = true;
 }
 
 void
@@ -92,6 +98,8 @@ MappedBufMetaIterator::reset()
          ++i) {
         (*i)->reset();
     }
+
+    m_dirty = true;
 }
 
 void
@@ -108,6 +116,8 @@ MappedBufMetaIterator::jumpToTime(const RealTime &time)
          ++i) {
         (*i)->moveTo(time);
     }
+
+    m_dirty = true;
 }
 
 void
@@ -160,37 +170,18 @@ MappedBufMetaIterator::fetchEvents(MappedInserterBase &inserter,
     // Note that the slices are about 160msecs.  It's very unlikely that
     // there will be anything interesting ever going on in this routine.
 
-    // Make a set of all buffer starts that occur during the slice sorted
-    // from earliest to latest.
-    typedef std::set<RealTime> TimeSet;
-    TimeSet bufferStarts;
-
-    // For each buffer.
-    for (BufferSet::iterator i = m_buffers.begin();
-         i != m_buffers.end();
-         ++i) {
-        RealTime start;
-        RealTime end;
-        (*i)->getStartEnd(start, end);
-        // If this segment's start is within the timeslice, add it
-        // to bufferStarts.
-        if (start >= startTime  &&  start < endTime) {
-            bufferStarts.insert(start);
-            //RG_DEBUG << "sub-slice: " << start;
-        }
-    }
-
-    //if (!bufferStarts.empty()) {
-    //    RG_DEBUG << "  fetchEvents()" << startTime << "-" << endTime;
-    //    RG_DEBUG << "  bufferStarts.size(): " << bufferStarts.size();
-    //}
+    update();
 
     // The progressive starting time, updated each iteration.
     RealTime innerStart = startTime;
 
-    // For each sub-slice
-    for (TimeSet::const_iterator i = bufferStarts.begin();
-         i != bufferStarts.end();
+    // For each buffer start that occurs during the slice, from earliest
+    // to latest.
+    for (std::vector<RealTime>::const_iterator i =
+                 std::lower_bound(m_bufferStarts.begin(),
+                                  m_bufferStarts.end(),
+                                  startTime);
+         i != m_bufferStarts.end()  &&  *i < endTime;
          ++i) {
         // Get the end of the current sub-slice.
         RealTime innerEnd = *i;
@@ -205,7 +196,7 @@ MappedBufMetaIterator::fetchEvents(MappedInserterBase &inserter,
     }
 
     // Do one more slice to take us to the end time.  This is always
-    // correct to do, since bufferStarts can't contain a start equal to
+    // correct to do, since we stopped at the first start at or after
     // endTime.
     fetchEventsNoncompeting(inserter, innerStart, endTime);
 
@@ -224,160 +215,186 @@ fetchEventsNoncompeting(MappedInserterBase &inserter,
     Profiler profiler("MappedBufMetaIterator::fetchEventsNoncompeting", false);
 
     m_currentTime = endTime;
-    
-    // For each segment (MEBIterator), activate segments that have anything
-    // playing.
-    for (IteratorVector::iterator i = m_iterators.begin();
-         i != m_iterators.end();
-         ++i) { 
+
+    // Take the iterators that need attention before the end of the slice,
+    // earliest first.  Each event taken puts its iterator back in the
+    // heap, keyed on its next event, so the events come out in time order.
+    // Iterators that have nothing until later stay where they are.
+    while (!m_heap.empty()  &&  m_heap.front().time < endTime) {
+        std::pop_heap(m_heap.begin(), m_heap.end(), std::greater<Cursor>());
+        const Cursor cursor = m_heap.back();
+        m_heap.pop_back();
+
+        QSharedPointer<MEBIterator> iter = m_iterators[cursor.index];
+
         RealTime start;
         RealTime end;
-        (*i)->getMappedEventBuffer()->getStartEnd(start, end);
-
-        // Activate MEBIterators for Segments that have something playing during
-        // this time slice.  We include Segments that end exactly when we start,
-        // but not Segments that start exactly when we end.
-        //
-        // Activation makes it easier to focus on relevant Segments later in
-        // this routine.
-        // Might want to consider assembling a vector of relevant MEBIterators
-        // and iterating through that instead of storing a flag in MEBIterator.
-        // We'll still need to set the current time.  Alternatively, we could
-        // do this check further down while we are going through the
-        // MEBIterators.  That would eliminate the need for a flag or a vector.
-        bool active = (start < endTime  &&  end >= startTime);
-        (*i)->setActive(active, startTime);
-    }
+        iter->getMappedEventBuffer()->getStartEnd(start, end);
+
+        // Only take events from buffers that have something playing during
+        // this time slice.  We include buffers that end exactly when we
+        // start, but not buffers that start exactly when we end.
+        if (!(start < endTime  &&  end >= startTime)) {
+            // Finished.  Time only goes backwards via jumpToTime(), and
+            // the buffer only changes when it is republished, both of
+            // which rebuild the heap.  So forget it until then.
+            if (end < startTime)
+                continue;
 
-    // State variable to allow the outer (round-robin) loop to run until
-    // the inner (segment) loop has nothing to do.
-    bool segmentsHaveMore = false;
-
-    // For each pass through the segments.
-    // On each pass, we only process one event in each segment.
-    // ??? Why not process all the events in each segment?
-    //     for each segment
-    //         for each event
-    //             process the event
-    //         rof
-    //     rof
-    //     Is this round-robin approach intended to spread the locks out?
-    //     Is it really necessary?
-    //     Prior to the auto-channels feature, this routine was called
-    //     MappedSegmentsMetaIterator::fillCompositionWithEventsUntil().
-    //     It has always used this round-robin approach.
-    do {
-        segmentsHaveMore = false;
-
-        // For each segment, process only the first event.
-        for (IteratorVector::iterator i = m_iterators.begin();
-             i != m_iterators.end();
-             ++i) {
-            QSharedPointer<MEBIterator> iter = (*i);
+            // Not started.  Look again next time.
+            m_idle.push_back(cursor);
+            continue;
+        }
 
-#ifdef DEBUG_META_ITERATOR
-            RG_DEBUG << "fetchEventsNoncompeting() : checking segment #" << i;
-#endif
+        iter->setActive(true, startTime);
 
-            // Skip any segments that aren't active.
-            if (!iter->getActive()) {
-#ifdef DEBUG_META_ITERATOR
-                RG_DEBUG << "fetchEventsNoncompeting() : no more events to get for this slice in segment #" << i;
-#endif
+        // No lock needed.  The mapper never writes to the buffer
+        // we are reading, it publishes a new one.  No function we
+        // call will hold the `event' pointer past its own scope.
+        // See MappedEventBuffer::Snapshot.
+        MappedEvent *event = iter->peek();
 
-                continue;
-            }
+        // At the end, or an event that failed a sanity check.  The
+        // iterator won't get any further until the buffer is
+        // republished, which rebuilds the heap.
+        if (!event  ||  !event->isValid())
+            continue;
 
-            if (iter->atEnd()) {
-#ifdef DEBUG_META_ITERATOR
-                RG_DEBUG << "fetchEventsNoncompeting() : " << endTime << " reached end of segment #" << i;
-#endif
-                // Make this iterator abort early in future
-                // iterations, since we know it's all done.
-                iter->setInactive();
-                continue;
-            }
+        // If we got this far, make the mapper ready.  Do this
+        // even if the note won't play during this slice, because
+        // sometimes/always we prepare channels slightly ahead of
+        // their first notes, to fix bug #1378
+        if (!iter->isReady())
+            iter->makeReady(inserter, startTime);
 
-            // This locks the iterator's buffer against writes, lest
-            // writing cause reallocating the buffer while we are
-            // holding a pointer into it.  No function we call will
-            // hold the `event' pointer past its own scope, implying
-            // that nothing holds it past an iteration of this loop,
-            // which is this lock's scope.
-            QReadLocker locker(iter->getLock());
-
-            MappedEvent *event = iter->peek();
-
-            // We couldn't fetch an event or it failed a sanity check.
-            // So proceed to the next iterator but keep looking at
-            // this one - incrementing it does nothing useful, and it
-            // might get more events.  But don't set segmentsHaveMore,
-            // lest we loop forever waiting for a valid event.
-            if (!event  ||  !event->isValid())
-                continue;
+        // If this event starts prior to the end of the slice, take it.
+        if (event->getEventTime() < endTime) {
+            // Increment the iterator, since we're taking this
+            // event.  NB, in the other branch it is not yet used
+            // so we leave `iter' where it is.
+            ++(*iter);
 
-            // If we got this far, make the mapper ready.  Do this
-            // even if the note won't play during this slice, because
-            // sometimes/always we prepare channels slightly ahead of
-            // their first notes, to fix bug #1378
-            if (!iter->isReady())
-                iter->makeReady(inserter, startTime);
-
-            // If this event starts prior to the end of the slice, take it.
-            if (event->getEventTime() < endTime) {
-                // Increment the iterator, since we're taking this
-                // event.  NB, in the other branch it is not yet used
-                // so we leave `iter' where it is.
-                ++(*iter);
-
-                // If we got this far, we'll want to try the next
-                // iteration, so note it.
-                segmentsHaveMore = true;
-                
 #ifdef DEBUG_META_ITERATOR
-                RG_DEBUG << "  Event...";
-                QString trackId = QString::number(event->getTrackId());
-                if (event->getTrackId() == NoTrack)
-                    trackId += " (NoTrack)";
-                RG_DEBUG << "    Track ID:" << trackId <<
-                            " channel:" << (unsigned int) event->getRecordedChannel() <<
-                            " inst:" << event->getInstrument();
-                QString eventType = QString::number(event->getType());
-                if (event->getType() & MappedEvent::MidiNote)
-                    eventType += " (MidiNote)";
-                if (event->getType() & MappedEvent::MidiNoteOneShot)
-                    eventType += " (MidiNoteOneShot)";
-                RG_DEBUG << "    Event type:" << eventType <<
-                            " time:" << event->getEventTime() <<
-                            " duration:" << event->getDuration() <<
-                            " data1:" << (unsigned int)event->getData1() <<
-                            " data2:" << (unsigned int)event->getData2();
+            RG_DEBUG << "  Event...";
+            QString trackId = QString::number(event->getTrackId());
+            if (event->getTrackId() == NoTrack)
+                trackId += " (NoTrack)";
+            RG_DEBUG << "    Track ID:" << trackId <<
+                        " channel:" << (unsigned int) event->getRecordedChannel() <<
+                        " inst:" << event->getInstrument();
+            QString eventType = QString::number(event->getType());
+            if (event->getType() & MappedEvent::MidiNote)
+                eventType += " (MidiNote)";
+            if (event->getType() & MappedEvent::MidiNoteOneShot)
+                eventType += " (MidiNoteOneShot)";
+            RG_DEBUG << "    Event type:" << eventType <<
+                        " time:" << event->getEventTime() <<
+                        " duration:" << event->getDuration() <<
+                        " data1:" << (unsigned int)event->getData1() <<
+                        " data2:" << (unsigned int)event->getData2();
 #endif
 
-                if (iter->shouldPlay(event, startTime)) {
-                    iter->doInsert(inserter, *event);
+            if (iter->shouldPlay(event, startTime)) {
+                // doInsert() fills in the channel and instrument,
+                // and the published buffer must not change, so
+                // work on a copy.
+                MappedEvent copy(*event);
+                iter->doInsert(inserter, copy);
 #ifdef DEBUG_META_ITERATOR
-                    RG_DEBUG << "  Inserting event";
+                RG_DEBUG << "  Inserting event";
 #endif
 
-                } else {
-#ifdef DEBUG_META_ITERATOR
-                    RG_DEBUG << "  Skipping event";
-#endif
-                }
             } else {
-                // This iterator has more events but they only sound
-                // after the end of this slice, so it's done.
-                iter->setInactive();
-
 #ifdef DEBUG_META_ITERATOR
-                RG_DEBUG << "fetchEventsNoncompeting() : Event is past end for segment #" << i;
+                RG_DEBUG << "  Skipping event";
 #endif
             }
         }
-    } while (segmentsHaveMore);
+#ifdef DEBUG_META_ITERATOR
+        else {
+            RG_DEBUG << "fetchEventsNoncompeting() : Event is past end for segment #" << cursor.index;
+        }
+#endif
+
+        // Wait for the next event.
+        pushCursor(cursor.index);
+    }
 
-    return;
+    // Back in for the next slice.
+    for (const Cursor &cursor : m_idle) {
+        m_heap.push_back(cursor);
+        std::push_heap(m_heap.begin(), m_heap.end(), std::greater<Cursor>());
+    }
+    m_idle.clear();
+}
+
+bool
+MappedBufMetaIterator::getCursor(size_t index, Cursor &cursor) const
+{
+    const MEBIterator &iter = *m_iterators[index];
+
+    const MappedEvent *event = iter.peek();
+    if (!event  ||  !event->isValid())
+        return false;
+
+    cursor.time = event->getEventTime();
+    cursor.index = index;
+
+    // Needs to be made ready as soon as the buffer starts playing, even
+    // if its next event is later.
+    if (!iter.isReady()) {
+        RealTime start;
+        RealTime end;
+        iter.getMappedEventBuffer()->getStartEnd(start, end);
+        cursor.time = std::min(cursor.time, start);
+    }
+
+    return true;
+}
+
+void
+MappedBufMetaIterator::pushCursor(size_t index)
+{
+    Cursor cursor;
+    if (!getCursor(index, cursor))
+        return;
+
+    m_heap.push_back(cursor);
+    std::push_heap(m_heap.begin(), m_heap.end(), std::greater<Cursor>());
+}
+
+void
+MappedBufMetaIterator::update()
+{
+    // Read this first.  If a buffer is republished while we rebuild, the
+    // count will have moved on again by the next slice.
+    const int publishCount = MappedEventBuffer::getPublishCount();
+
+    if (!m_dirty  &&  publishCount == m_publishCount)
+        return;
+
+    m_dirty = false;
+    m_publishCount = publishCount;
+
+    m_heap.clear();
+    for (size_t index = 0; index < m_iterators.size(); ++index) {
+        Cursor cursor;
+        if (getCursor(index, cursor))
+            m_heap.push_back(cursor);
+    }
+    std::make_heap(m_heap.begin(), m_heap.end(), std::greater<Cursor>());
+
+    m_bufferStarts.clear();
+    for (const QSharedPointer<MappedEventBuffer> &buffer : m_buffers) {
+        RealTime start;
+        RealTime end;
+        buffer->getStartEnd(start, end);
+        m_bufferStarts.push_back(start);
+    }
+    std::sort(m_bufferStarts.begin(), m_bufferStarts.end());
+    m_bufferStarts.erase(
+            std::unique(m_bufferStarts.begin(), m_bufferStarts.end()),
+            m_bufferStarts.end());
 }
 
 void
@@ -405,6 +422,8 @@ MappedBufMetaIterator::resetIteratorForBuffer(
                 iter->setReady(false);
             }
 
+            m_dirty = true;
+
             break;
         }
     }
@@ -422,14 +441,9 @@ MappedBufMetaIterator::getAudioEvents(std::vector<MappedEvent> &audioEvents)
          i != m_buffers.end(); ++i) {
 
         // ??? The various features of MEBIterator are not needed here.
-        //     Instead, we should probably lock the buffer for read
-        //     (MappedEventBuffer::m_lock which should probably be
-        //     public) and get at it directly via
-        //     MappedEventBuffer::getBuffer() (or just make m_buffer public).
+        //     We only need its lock-free access to the published buffer.
         MEBIterator iter(*i);
 
-        QReadLocker locker(iter.getLock());
-
         // For each event
         while (!iter.atEnd()) {
             const MappedEvent *event = iter.peek();
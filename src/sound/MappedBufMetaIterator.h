@@ -27,6 +27,8 @@
 #include <set>
 #include <vector>
 
+#include <rosegardenprivate_export.h>
+
 namespace Rosegarden {
 
 
@@ -56,8 +58,15 @@ class MEBIterator;
  * This is the second part of a two-part process to convert the Event objects
  * in a Composition into MappedEvent objects that can be sent to ALSA.  For
  * the first part of this conversion, see InternalSegmentMapper.
+ *
+ * The iterators wait in a min-heap keyed on when each next needs
+ * attention (see Cursor), so a slice only touches the buffers that have
+ * events in it, and it hands them to the inserter in time order.
+ * Buffers that are finished or haven't started yet cost nothing until
+ * they come up.  The heap is rebuilt when buffers are added, removed,
+ * reset or republished.
  */
-class MappedBufMetaIterator
+class ROSEGARDENPRIVATE_EXPORT MappedBufMetaIterator
 {
 public:
     void addBuffer(QSharedPointer<MappedEventBuffer>);
@@ -109,6 +118,55 @@ private:
     typedef std::vector<QSharedPointer<MEBIterator>> IteratorVector;
     IteratorVector m_iterators;
 
+    /// An iterator waiting in m_heap.
+    struct Cursor
+    {
+        /// When the iterator next needs attention.
+        /**
+         * Its next event's time, or for an iterator that isn't ready,
+         * its buffer's start if that is earlier.  It must be made ready
+         * as soon as its buffer is playing.
+         */
+        RealTime time;
+        /// Index into m_iterators.  Breaks ties, so the order is stable.
+        size_t index;
+
+        bool operator>(const Cursor &other) const {
+            if (time != other.time)
+                return time > other.time;
+            return index > other.index;
+        }
+    };
+
+    /// Min-heap of the iterators with events to come.
+    /**
+     * Iterators at their end aren't in here.
+     */
+    std::vector<Cursor> m_heap;
+    /// Cursors that came up but whose buffers weren't playing.
+    std::vector<Cursor> m_idle;
+    /// Start times of all the buffers, sorted and without duplicates.
+    /**
+     * For fetchEvents()'s sub-slices.
+     */
+    std::vector<RealTime> m_bufferStarts;
+
+    /// m_heap and m_bufferStarts need to be rebuilt.
+    bool m_dirty = true;
+    /// MappedEventBuffer::getPublishCount() when they were last built.
+    int m_publishCount = 0;
+
+    /// Rebuild m_heap and m_bufferStarts if anything has changed.
+    void update();
+    /// Get the Cursor for m_iterators[index].
+    /**
+     * Returns false if the iterator has nothing more to give until its
+     * buffer is republished.
+     */
+    bool getCursor(size_t index, Cursor &cursor) const;
+    /// Put m_iterators[index] back in m_heap if it has more to give.
+    void pushCursor(size_t index);
+
     /// Reset all iterators to beginning
     void reset();
 
@@ -20,14 +20,20 @@
 #include "base/MidiTypes.h"
 #include "base/NotationTypes.h" // for Note::EventType
 #include "misc/Debug.h"
-#include "misc/TempDir.h"
+#include "sound/Scavenger.h"
 
-#include <QDir>
-#include <QFile>
-#include <QFileInfo>
+#include <QMutex>
+#include <QAtomicPointer>
 #include <QtGlobal>
 
+#include <cstdint>
 #include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include <sys/mman.h>
 
 // #define DEBUG_MAPPEDEVENT 1
 
@@ -322,132 +328,350 @@ QDebug operator<<(QDebug dbg, const MappedEvent &mE)
 
 //--------------------------------------------------
 
-class DataBlockFile
+namespace
 {
-public:
-    explicit DataBlockFile(DataBlockRepository::blockid id);
-    ~DataBlockFile();
+    // Blocks up to this size are packed into 64KiB arena chunks.  Most
+    // SysEx messages (patch changes, MMC, GM reset, ...) are a few bytes
+    // to a few KiB.
+    constexpr size_t ArenaChunkSize = 64 * 1024;
+    constexpr size_t SmallBlockSize = ArenaChunkSize / 4;
+    // Blocks this big (bulk dumps) get their own anonymous mapping so
+    // that their memory goes straight back to the system on clear().
+    constexpr size_t MmapBlockSize = 256 * 1024;
+
+    // The block index is a directory of pages of block pointers.
+    // Enough for 16M distinct blocks between clear()s.
+    constexpr unsigned PageBits = 10;
+    constexpr unsigned PageSize = 1u << PageBits;
+    constexpr unsigned DirectorySize = 16384;
+
+    struct DataBlock
+    {
+        const char *data;
+        size_t size;
+        // Number of times this data has been registered.
+        unsigned refCount;
+        uint64_t hash;
+    };
+
+    // FNV-1a.
+    uint64_t hashData(const std::string &s)
+    {
+        uint64_t hash = 14695981039346656037ULL;
+        for (const char c : s) {
+            hash ^= static_cast<unsigned char>(c);
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
 
-    QString getFileName() const
+    /// The blocks registered since the last clear().
+    /**
+     * find() is lock-free and may be called from any thread.  Everything
+     * else must be called with the write mutex held.
+     *
+     * Blocks are never freed individually.  A block that is replaced
+     * (setDataBlockForEvent() on an event that already has a block)
+     * stays in the arena, since a reader may still be copying it.  All
+     * memory is released when the store is deleted after clear().
+     */
+    class DataBlockStore
+    {
+    public:
+        explicit DataBlockStore(DataBlockRepository::blockid firstId);
+        ~DataBlockStore();
+
+        /// Returns nullptr if there is no such block.
+        const DataBlock *find(DataBlockRepository::blockid id) const;
+
+        /// Add a block, or share an existing one with the same data.
+        /**
+         * Returns 0 if the store is full.
+         */
+        DataBlockRepository::blockid add(const std::string &s);
+
+        /// Change the data of a block.
+        /**
+         * If the block is shared by other registrations, the data goes
+         * in a new block and its ID is returned.
+         */
+        DataBlockRepository::blockid replace(
+                DataBlockRepository::blockid id, const std::string &s);
+
+        DataBlockRepository::blockid getNextId() const  { return m_nextId; }
+        bool empty() const  { return m_nextId == m_firstId; }
+
+    private:
+        typedef QAtomicPointer<DataBlock> Slot;
+
+        DataBlock *makeBlock(const std::string &s, uint64_t hash);
+        char *allocate(size_t size);
+        void publish(DataBlockRepository::blockid id, DataBlock *block);
+        void unindex(DataBlockRepository::blockid id, uint64_t hash);
+
+        DataBlockRepository::blockid m_firstId;
+        DataBlockRepository::blockid m_nextId;
+
+        QAtomicPointer<Slot> m_directory[DirectorySize];
+
+        // Addresses are stable across push_back().
+        std::deque<DataBlock> m_blocks;
+
+        // For sharing blocks with the same data.  Re-mapping a segment
+        // registers all of its SysEx again.
+        std::unordered_multimap<uint64_t, DataBlockRepository::blockid>
+                m_index;
+
+        std::vector<char *> m_chunks;
+        char *m_chunkPos;
+        size_t m_chunkLeft;
+
+        struct Allocation
+        {
+            char *data;
+            size_t size;
+            bool mapped;
+        };
+        std::vector<Allocation> m_allocations;
+    };
+
+    DataBlockStore::DataBlockStore(DataBlockRepository::blockid firstId) :
+        m_firstId(firstId),
+        m_nextId(firstId),
+        m_chunkPos(nullptr),
+        m_chunkLeft(0)
     {
-        return m_fileName;
     }
 
-    void addDataString(const std::string&);
+    DataBlockStore::~DataBlockStore()
+    {
+        for (unsigned i = 0; i < DirectorySize; ++i)
+            delete[] m_directory[i].loadAcquire();
+
+        for (char *chunk : m_chunks)
+            delete[] chunk;
+
+        for (const Allocation &allocation : m_allocations) {
+            if (allocation.mapped)
+                munmap(allocation.data, allocation.size);
+            else
+                delete[] allocation.data;
+        }
+    }
 
-    void clear()
+    const DataBlock *
+    DataBlockStore::find(DataBlockRepository::blockid id) const
     {
-        m_cleared = true;
+        if (id < m_firstId)
+            return nullptr;
+
+        const DataBlockRepository::blockid index = id - m_firstId;
+        if (index >= DataBlockRepository::blockid(PageSize) * DirectorySize)
+            return nullptr;
+
+        const Slot *page = m_directory[index >> PageBits].loadAcquire();
+        if (!page)
+            return nullptr;
+
+        return page[index & (PageSize - 1)].loadAcquire();
     }
-    bool exists();
-    void setData(const std::string&);
-    std::string getData();
-
-protected:
-    void prepareToWrite();
-    void prepareToRead();
-
-    //--------------- Data members ---------------------------------
-    QString m_fileName;
-    QFile m_file;
-    bool m_cleared;
-};
-
-DataBlockFile::DataBlockFile(DataBlockRepository::blockid id)
-    : m_fileName(TempDir::path() + QString("/rosegarden_datablock_%1").arg(id)),
-      m_file(m_fileName),
-      m_cleared(false)
-{
-    //     std::cerr << "DataBlockFile " << m_fileName.toLatin1().data() << std::endl;
-}
 
-DataBlockFile::~DataBlockFile()
-{
-    if (m_cleared) {
-//        std::cerr << "~DataBlockFile : removing " << m_fileName.toLatin1().data() << std::endl;
-        QFile::remove
-            (m_fileName);
+    DataBlockRepository::blockid
+    DataBlockStore::add(const std::string &s)
+    {
+        const uint64_t hash = hashData(s);
+
+        auto range = m_index.equal_range(hash);
+        for (auto i = range.first; i != range.second; ++i) {
+            DataBlock *block = const_cast<DataBlock *>(find(i->second));
+            if (block  &&  block->size == s.size()  &&
+                memcmp(block->data, s.data(), s.size()) == 0) {
+                ++block->refCount;
+                return i->second;
+            }
+        }
+
+        const DataBlockRepository::blockid id = m_nextId;
+        if (id - m_firstId >= DataBlockRepository::blockid(PageSize) * DirectorySize) {
+            RG_WARNING << "DataBlockStore::add(): Too many data blocks.  Dropping" << s.size() << "bytes.";
+            return 0;
+        }
+        ++m_nextId;
+
+        m_index.emplace(hash, id);
+        publish(id, makeBlock(s, hash));
+
+        return id;
     }
 
-}
+    DataBlockRepository::blockid
+    DataBlockStore::replace(DataBlockRepository::blockid id,
+                            const std::string &s)
+    {
+        DataBlock *old = const_cast<DataBlock *>(find(id));
 
-bool DataBlockFile::exists()
-{
-    return QFile::exists(m_fileName);
-}
+        // Gone after a clear(), or shared.
+        if (!old  ||  old->refCount > 1) {
+            if (old)
+                --old->refCount;
+            return add(s);
+        }
 
-void DataBlockFile::setData(const std::string& s)
-{
-  //  std::cerr << "DataBlockFile::setData() : setting data to " << m_fileName << std::endl;
-    prepareToWrite();
+        // Only one registration.  Its copies share the ID, so keep it.
+        unindex(id, old->hash);
 
-    QDataStream stream(&m_file);
-    stream.writeRawData(s.data(), s.length());
-}
+        const uint64_t hash = hashData(s);
+        m_index.emplace(hash, id);
+        publish(id, makeBlock(s, hash));
 
-std::string DataBlockFile::getData()
-{
-    if (!exists())
-        return std::string();
+        return id;
+    }
 
-    prepareToRead();
+    DataBlock *
+    DataBlockStore::makeBlock(const std::string &s, uint64_t hash)
+    {
+        char *data = allocate(s.size());
+        memcpy(data, s.data(), s.size());
 
-    QDataStream stream(&m_file);
- //   std::cerr << "DataBlockFile::getData() : file size = " << m_file.size() << std::endl;
-    char* tmp = new char[m_file.size()];
-    stream.readRawData(tmp, m_file.size());
-    std::string res(tmp, m_file.size());
-    delete[] tmp;
+        m_blocks.push_back(DataBlock());
+        DataBlock &block = m_blocks.back();
+        block.data = data;
+        block.size = s.size();
+        block.refCount = 1;
+        block.hash = hash;
 
-    return res;
-}
+        return &block;
+    }
 
-void DataBlockFile::addDataString(const std::string& s)
-{
-    prepareToWrite();
-    QDataStream stream(&m_file);
-    stream.writeRawData(s.data(), s.length());
-}
+    char *
+    DataBlockStore::allocate(size_t size)
+    {
+        if (size > SmallBlockSize) {
+            Allocation allocation;
+            allocation.size = size;
+            allocation.mapped = false;
+            allocation.data = nullptr;
+
+            if (size >= MmapBlockSize) {
+                void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if (p != MAP_FAILED) {
+                    allocation.data = static_cast<char *>(p);
+                    allocation.mapped = true;
+                }
+            }
 
-void DataBlockFile::prepareToWrite()
-{
- //   std::cerr << "DataBlockFile[" << m_fileName << "]: prepareToWrite" << std::endl;
-    if (!m_file.isWritable()) {
-        m_file.close();
-        m_file.open(QIODevice::WriteOnly | QIODevice::Append);
-        Q_ASSERT(m_file.isWritable());
+            if (!allocation.data)
+                allocation.data = new char[size];
+
+            m_allocations.push_back(allocation);
+            return allocation.data;
+        }
+
+        if (size > m_chunkLeft) {
+            m_chunks.push_back(new char[ArenaChunkSize]);
+            m_chunkPos = m_chunks.back();
+            m_chunkLeft = ArenaChunkSize;
+        }
+
+        char *data = m_chunkPos;
+        m_chunkPos += size;
+        m_chunkLeft -= size;
+
+        return data;
     }
-}
 
-void DataBlockFile::prepareToRead()
-{
-//    std::cerr << "DataBlockFile[" << m_fileName << "]: prepareToRead" << std::endl;
-    if (!m_file.isReadable()) {
-        m_file.close();
-        m_file.open(QIODevice::ReadOnly);
-        Q_ASSERT(m_file.isReadable());
+    void
+    DataBlockStore::publish(DataBlockRepository::blockid id, DataBlock *block)
+    {
+        const DataBlockRepository::blockid index = id - m_firstId;
+
+        QAtomicPointer<Slot> &directoryEntry = m_directory[index >> PageBits];
+        Slot *page = directoryEntry.loadAcquire();
+        if (!page) {
+            page = new Slot[PageSize];
+            directoryEntry.storeRelease(page);
+        }
+
+        page[index & (PageSize - 1)].storeRelease(block);
+    }
+
+    void
+    DataBlockStore::unindex(DataBlockRepository::blockid id, uint64_t hash)
+    {
+        auto range = m_index.equal_range(hash);
+        for (auto i = range.first; i != range.second; ++i) {
+            if (i->second == id) {
+                m_index.erase(i);
+                return;
+            }
+        }
     }
-}
 
+    /// The current store.  Read lock-free by the sequencer thread.
+    QAtomicPointer<DataBlockStore> &getStore()
+    {
+        static QAtomicPointer<DataBlockStore> store;
+        return store;
+    }
 
+    /// Serializes registration (GUI thread, MIDI input) and clear().
+    QMutex &getWriteMutex()
+    {
+        static QMutex mutex;
+        return mutex;
+    }
 
-//--------------------------------------------------
+    /// Holds cleared stores until readers are done with them.
+    /**
+     * Only used with the write mutex held.
+     */
+    Scavenger<DataBlockStore> &getScavenger()
+    {
+        // Create on first use to avoid static init order fiasco.
+        // Deliberately leaked so that nothing is deleted out from under
+        // the sequencer thread during shutdown.
+        static Scavenger<DataBlockStore> *scavenger =
+                new Scavenger<DataBlockStore>(2, 10);
+        return *scavenger;
+    }
+
+    /// Get the current store, creating it if needed.
+    /**
+     * Call with the write mutex held.
+     */
+    DataBlockStore *getWritableStore()
+    {
+        DataBlockStore *store = getStore().loadAcquire();
+        if (!store) {
+            store = new DataBlockStore(1);
+            getStore().storeRelease(store);
+        }
+        return store;
+    }
+}
 
 DataBlockRepository* DataBlockRepository::getInstance()
 {
-    if (!m_instance)
-        m_instance = new DataBlockRepository;
-    return m_instance;
+    // Guaranteed in C++11 to be lazy initialized and thread-safe.
+    // See ISO/IEC 14882:2011 6.7(4).
+    // Deliberately leaked, like the scavenger.
+    static DataBlockRepository *instance = new DataBlockRepository;
+    return instance;
 }
 
 std::string DataBlockRepository::getDataBlock(DataBlockRepository::blockid id)
 {
-    DataBlockFile dataBlockFile(id);
+    // Lock-free.
+    const DataBlockStore *store = getStore().loadAcquire();
+    if (!store)
+        return std::string();
 
-    if (dataBlockFile.exists())
-        return dataBlockFile.getData();
+    const DataBlock *block = store->find(id);
+    if (!block)
+        return std::string();
 
-    return std::string();
+    return std::string(block->data, block->size);
 }
 
 
@@ -474,58 +698,31 @@ void DataBlockRepository::setDataBlockForEvent(MappedEvent* e,
     } else {
 #ifdef DEBUG_MAPPEDEVENT
         RG_DEBUG << "Writing" << s.length()
-                  << "chars to file for datablock" << id;
+                  << "chars to datablock" << id;
 #endif
-        DataBlockFile dataBlockFile(id);
+        QMutexLocker locker(&getWriteMutex());
+
+        std::string data;
         if (extend)
-            { dataBlockFile.addDataString(s);}
-        else
-            { dataBlockFile.setData(s); }
-    }
-}
+            data = getDataBlock(id);
+        data += s;
 
-/* unused
-bool DataBlockRepository::hasDataBlock(DataBlockRepository::blockid id)
-{
-    return DataBlockFile(id).exists();
+        e->setDataBlockId(getWritableStore()->replace(id, data));
+    }
 }
-*/
 
 DataBlockRepository::blockid DataBlockRepository::registerDataBlock(const std::string& s)
 {
-    blockid id = 0;
-    while (id == 0 || DataBlockFile(id).exists())
-        id = (blockid)random();
-
- //   std::cerr << "DataBlockRepository::registerDataBlock: " << s.length() << " chars, id is " << id << std::endl;
-
-    DataBlockFile dataBlockFile(id);
-    dataBlockFile.setData(s);
-
-    return id;
-}
-
-/* unused
-void DataBlockRepository::unregisterDataBlock(DataBlockRepository::blockid id)
-{
-    DataBlockFile dataBlockFile(id);
+    QMutexLocker locker(&getWriteMutex());
 
-    dataBlockFile.clear();
+    return getWritableStore()->add(s);
 }
-*/
 
 void DataBlockRepository::registerDataBlockForEvent(const std::string& s, MappedEvent* e)
 {
     e->setDataBlockId(registerDataBlock(s));
 }
 
-/* unused
-void DataBlockRepository::unregisterDataBlockForEvent(MappedEvent* e)
-{
-    unregisterDataBlock(e->getDataBlockId());
-}
-*/
-
 DataBlockRepository::DataBlockRepository()
 {}
 
@@ -535,29 +732,20 @@ void DataBlockRepository::clear()
     RG_DEBUG << "DataBlockRepository::clear()";
 #endif
 
-    // Erase all 'datablock_*' files
-    //
-    QString tmpPath = TempDir::path();
+    QMutexLocker locker(&getWriteMutex());
 
-    QDir segmentsDir(tmpPath, "rosegarden_datablock_*");
+    DataBlockStore *oldStore = getStore().loadAcquire();
+    if (!oldStore  ||  oldStore->empty())
+        return;
 
-    if (segmentsDir.count() > 2000) {
-        RG_DEBUG << "DataBlockRepository::clear(): A rather large number of rosegarden_datablock_*\n" <<
-                     "  files (" << segmentsDir.count() << " of them) have been found in " << tmpPath.toStdString() << ".\n" <<
-                     "  It may take a while to delete them all.  Working...";
-    }
+    // IDs carry on from the old store so that any stale MappedEvent
+    // finds nothing rather than someone else's data.
+    getStore().storeRelease(new DataBlockStore(oldStore->getNextId()));
 
-    for (unsigned int i = 0; i < segmentsDir.count(); ++i) {
-        QString segmentName = tmpPath + '/' + segmentsDir[i];
-        QFile::remove
-            (segmentName);
-    }
+    Scavenger<DataBlockStore> &scavenger = getScavenger();
+    scavenger.scavenge();
+    scavenger.claim(oldStore);
 }
 
-// setDataBlockForEvent does what addDataStringForEvent used to do.
-
-
-DataBlockRepository* DataBlockRepository::m_instance = nullptr;
-
 
 }
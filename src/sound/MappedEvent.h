@@ -21,6 +21,8 @@
 #include "base/Track.h"
 #include "base/Event.h"
 
+#include <rosegardenprivate_export.h>
+
 
 namespace Rosegarden
 {
@@ -28,9 +30,17 @@ class MappedEvent;
 
 /// Used for storing data blocks for SysEx messages.
 /**
+ *  Also used for the text of Text and Marker events.
+ *
+ *  Blocks are kept in memory, small ones packed into an arena and very
+ *  large ones (bulk dumps) in their own anonymous mappings.  Blocks with
+ *  the same data are shared, so re-mapping a segment doesn't add its
+ *  SysEx again.  Reading (getDataBlockForEvent()) is lock-free and is
+ *  safe from the sequencer thread.  Everything is freed by clear().
+ *
  *  @see MappedEvent::m_dataBlockId
  */
-class DataBlockRepository
+class ROSEGARDENPRIVATE_EXPORT DataBlockRepository
 {
 public:
     friend class MappedEvent;
@@ -41,10 +51,9 @@ public:
     static void setDataBlockForEvent(MappedEvent*, const std::string&,
                                      bool extend = false);
     /**
-     * Clear all block files
+     * Clear all blocks.  Events that refer to them will get no data.
      */
     static void clear();
-    // unused static bool hasDataBlock(blockid);
 
 protected:
     DataBlockRepository();
@@ -52,15 +61,8 @@ protected:
     static std::string getDataBlock(blockid);
 
     static blockid registerDataBlock(const std::string&);
-    // unused static void unregisterDataBlock(blockid);
 
     static void registerDataBlockForEvent(const std::string&, MappedEvent*);
-    // unused static void unregisterDataBlockForEvent(MappedEvent*);
-
-
-    //--------------- Data members ---------------------------------
-
-    static DataBlockRepository* m_instance;
 };
 
 /// A MIDI event that is ready for playback
@@ -92,7 +94,7 @@ protected:
  *  the "getSequencerSlice" and "processAsync/Recorded" interfaces on
  *  which the control messages can piggyback and eventually stripped out.
  */
-class MappedEvent
+class ROSEGARDENPRIVATE_EXPORT MappedEvent
 {
 public:
     typedef enum
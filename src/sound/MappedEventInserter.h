@@ -20,6 +20,8 @@
 
 #include "MappedInserterBase.h"
 
+#include <rosegardenprivate_export.h>
+
 namespace Rosegarden
 {
 
@@ -34,7 +36,7 @@ class MappedEventList;
  *     a MappedEventList & to whoever needs to insert things, and let them
  *     call a MappedEventList::insertCopy()?
  */
-class MappedEventInserter : public MappedInserterBase
+class ROSEGARDENPRIVATE_EXPORT MappedEventInserter : public MappedInserterBase
 {
 public:
     explicit MappedEventInserter(MappedEventList &list) :
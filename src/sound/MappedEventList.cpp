@@ -17,24 +17,29 @@
 #include "MappedEvent.h"
 #include "base/SegmentPerformanceHelper.h"
 
+#include <algorithm>
+#include <functional>
+
 namespace Rosegarden
 {
 
+const size_t MappedEventList::SlabBlockEvents;
+
 MappedEventList::~MappedEventList()
 {
     clear();
+
+    for (MappedEvent *block : m_slab) {
+        delete[] block;
+    }
 }
 
 // copy constructor
-MappedEventList::MappedEventList(const MappedEventList &mC):
-    std::multiset<MappedEvent *, MappedEvent::MappedEventCmp>()
+MappedEventList::MappedEventList(const MappedEventList &mC) :
+    m_slabUsed(0)
 {
-    clear();
-
     // deep copy
-    for (MappedEventList::const_iterator it = mC.begin(); it != mC.end(); ++it)
-        insert(new MappedEvent(**it));
-
+    merge(mC);
 }
 
 MappedEventList &
@@ -43,13 +48,73 @@ MappedEventList::operator=(const MappedEventList &mC)
     if (&mC == this) return *this;
 
     clear();
-
-    for (MappedEventList::const_iterator it = mC.begin(); it != mC.end(); ++it)
-        insert(new MappedEvent(**it));
+    merge(mC);
 
     return *this;
 }
 
+MappedEventList::iterator
+MappedEventList::insert(MappedEvent *event)
+{
+    return insertSorted(event);
+}
+
+MappedEventList::iterator
+MappedEventList::insertCopy(const MappedEvent &event)
+{
+    const size_t block = m_slabUsed / SlabBlockEvents;
+
+    // Out of room?  This is the only allocation, and once the slab is
+    // big enough for the busiest slice it doesn't happen again.
+    if (block == m_slab.size()) {
+        m_slab.push_back(new MappedEvent[SlabBlockEvents]);
+
+        const MappedEvent *start = m_slab.back();
+        m_slabByAddress.insert(
+                std::upper_bound(m_slabByAddress.begin(),
+                                 m_slabByAddress.end(), start,
+                                 std::less<const MappedEvent *>()),
+                start);
+    }
+
+    MappedEvent *copy = &m_slab[block][m_slabUsed % SlabBlockEvents];
+    *copy = event;
+    ++m_slabUsed;
+
+    return insertSorted(copy);
+}
+
+MappedEventList::iterator
+MappedEventList::insertSorted(MappedEvent *event)
+{
+    // Events usually arrive in order, so try the end first.
+    if (m_events.empty()  ||  !(*event < *m_events.back())) {
+        m_events.push_back(event);
+        return m_events.end() - 1;
+    }
+
+    // After any equal events, like std::multiset::insert().
+    iterator i = std::upper_bound(m_events.begin(), m_events.end(), event,
+                                  MappedEvent::MappedEventCmp());
+    return m_events.insert(i, event);
+}
+
+MappedEventList::iterator
+MappedEventList::erase(iterator i)
+{
+    release(*i);
+    return m_events.erase(i);
+}
+
+MappedEventList::iterator
+MappedEventList::erase(iterator first, iterator last)
+{
+    for (iterator i = first; i != last; ++i) {
+        release(*i);
+    }
+    return m_events.erase(first, last);
+}
+
 void
 MappedEventList::merge(const MappedEventList &mC)
 {
@@ -57,13 +122,47 @@ MappedEventList::merge(const MappedEventList &mC)
         insert(new MappedEvent(**it)); // deep copy
 }
 
+void
+MappedEventList::sort()
+{
+    std::stable_sort(m_events.begin(), m_events.end(),
+                     MappedEvent::MappedEventCmp());
+}
+
 void
 MappedEventList::clear()
 {
-    for (MappedEventListIterator it = begin(); it != end(); ++it)
-        delete (*it);
+    for (MappedEvent *event : m_events) {
+        release(event);
+    }
+
+    // Keeps its capacity, as does the slab.
+    m_events.clear();
+    m_slabUsed = 0;
+}
+
+bool
+MappedEventList::isPooled(const MappedEvent *event) const
+{
+    // std::less, as the pointers may be into different arrays.
+    std::less<const MappedEvent *> less;
+
+    // The last block that starts at or before event.
+    std::vector<const MappedEvent *>::const_iterator block =
+            std::upper_bound(m_slabByAddress.begin(), m_slabByAddress.end(),
+                             event, less);
+    if (block == m_slabByAddress.begin())
+        return false;
+    --block;
+
+    return less(event, *block + SlabBlockEvents);
+}
 
-    erase(begin(), end());
+void
+MappedEventList::release(MappedEvent *event)
+{
+    if (!isPooled(event))
+        delete event;
 }
 
 
@@ -19,9 +19,11 @@
 
 #include "base/Composition.h"
 #include "MappedEvent.h"
-#include <set>
+#include <vector>
 #include <QDataStream>
 
+#include <rosegardenprivate_export.h>
+
 namespace Rosegarden
 {
 
@@ -36,26 +38,127 @@ namespace Rosegarden
  * MappedEventList is a normal container with nothing fixed about it;
  * it's just the container that happens to be used in sequencer
  * threads when a set of MappedEvents is called for.
+ *
+ * The events are kept in time order (MappedEvent::operator<()) in a
+ * flat array, with equal events in the order they were inserted, as
+ * std::multiset did.  The list owns its events: clear(), erase() and the
+ * dtor delete them.
+ *
+ * insertCopy() copies into a slab of events that the list keeps across
+ * clear()s.  RosegardenSequencer keeps one list for the playback slices
+ * and reuses it, so once the slab and the array have grown to fit the
+ * busiest slice, a slice doesn't allocate at all.
+ *
+ * Iterators are invalidated by insert(), erase() and eraseIf(), as for
+ * std::vector.
  */
-class MappedEventList : public std::multiset<MappedEvent *,
-                                             MappedEvent::MappedEventCmp>
+class ROSEGARDENPRIVATE_EXPORT MappedEventList
 {
 public:
-    MappedEventList() { }
-    MappedEventList(const MappedEventList &mC);
+    typedef std::vector<MappedEvent *>::iterator iterator;
+    typedef std::vector<MappedEvent *>::const_iterator const_iterator;
+    typedef std::vector<MappedEvent *>::size_type size_type;
 
-    void merge(const MappedEventList &mC);
+    MappedEventList() : m_slabUsed(0)  { }
+    MappedEventList(const MappedEventList &mC);
 
     MappedEventList &operator=(const MappedEventList &mC);
 
     ~MappedEventList();
 
+    iterator begin()  { return m_events.begin(); }
+    iterator end()  { return m_events.end(); }
+    const_iterator begin() const  { return m_events.begin(); }
+    const_iterator end() const  { return m_events.end(); }
+    const_iterator cbegin() const  { return m_events.cbegin(); }
+    const_iterator cend() const  { return m_events.cend(); }
+
+    bool empty() const  { return m_events.empty(); }
+    size_type size() const  { return m_events.size(); }
+
+    /// Insert an event allocated with new.  The list takes ownership.
+    iterator insert(MappedEvent *event);
+
+    /// Insert a copy of event, from the slab.
+    iterator insertCopy(const MappedEvent &event);
+
+    /// Remove and delete an event.  Returns the one after it.
+    /**
+     * This moves every event after it, so use eraseIf() to remove more
+     * than a few.
+     */
+    iterator erase(iterator i);
+    iterator erase(iterator first, iterator last);
+
+    /// Remove and delete every event for which pred(const MappedEvent &)
+    /// is true.
+    /**
+     * E.g. RosegardenSequencer::applyFiltering().  One pass, keeping the
+     * rest in order.
+     */
+    template <class Predicate>
+    void eraseIf(Predicate pred);
+
+    /// Insert a copy of each of mC's events.
+    void merge(const MappedEventList &mC);
+
+    /// Put the events back in time order after changing their times.
+    /**
+     * E.g. RosegardenSequencer::applyLatencyCompensation().  Equal events
+     * stay in the order they were in.
+     */
+    void sort();
+
     // Clear out
     void clear();
+
+private:
+    /// Insert into m_events, in order.
+    iterator insertSorted(MappedEvent *event);
+
+    /// Whether event is in m_slab rather than allocated with new.
+    /**
+     * A binary search of m_slabByAddress.
+     */
+    bool isPooled(const MappedEvent *event) const;
+
+    /// Delete event, unless it's in the slab.
+    void release(MappedEvent *event);
+
+    std::vector<MappedEvent *> m_events;
+
+    /// Storage for insertCopy(), in blocks of SlabBlockEvents.
+    /**
+     * Blocks are kept until the list is destroyed.  m_slabUsed counts
+     * the events given out since the last clear().
+     */
+    std::vector<MappedEvent *> m_slab;
+    size_t m_slabUsed;
+
+    /// m_slab in address order, for isPooled().
+    std::vector<const MappedEvent *> m_slabByAddress;
+
+    static const size_t SlabBlockEvents = 256;
 };
 
-typedef std::multiset<MappedEvent *, MappedEvent::MappedEventCmp>::iterator
-    MappedEventListIterator;
+template <class Predicate>
+void
+MappedEventList::eraseIf(Predicate pred)
+{
+    // Like std::remove_if(), but deleting what goes.
+    iterator kept = m_events.begin();
+
+    for (iterator i = m_events.begin(); i != m_events.end(); ++i) {
+        if (pred(static_cast<const MappedEvent &>(**i)))
+            release(*i);
+        else
+            *kept++ = *i;
+    }
+
+    m_events.erase(kept, m_events.end());
+}
+
+typedef MappedEventList::iterator MappedEventListIterator;
 
 }
 
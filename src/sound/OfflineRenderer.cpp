@@ -0,0 +1,754 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[OfflineRenderer]"
+
+#include "OfflineRenderer.h"
+
+#include "AudioInstrumentMixer.h"
+#include "AudioKernels.h"
+#include "AudioProcess.h"
+#include "MappedBufMetaIterator.h"
+#include "MappedEventInserter.h"
+#include "MappedEventList.h"
+#include "MappedStudio.h"
+#include "Midi.h"
+#include "PluginIdentifier.h"
+#include "audiostream/AudioWriteStream.h"
+#include "audiostream/AudioWriteStreamFactory.h"
+#include "base/AudioLevel.h"
+#include "base/AudioPluginInstance.h"
+#include "base/Buss.h"
+#include "base/Composition.h"
+#include "base/Instrument.h"
+#include "base/Studio.h"
+#include "base/Track.h"
+#include "document/RosegardenDocument.h"
+#include "gui/application/RosegardenMainWindow.h"
+#include "gui/seqmanager/SequenceManager.h"
+#include "misc/Debug.h"
+#include "misc/Strings.h"
+
+#include <QRegularExpression>
+#include <QScopedPointer>
+
+#ifdef HAVE_ALSA
+#include <alsa/asoundlib.h>
+#endif
+
+#include <algorithm>
+#include <string.h>
+
+//#define DEBUG_OFFLINE_RENDERER 1
+
+namespace Rosegarden
+{
+
+
+namespace
+{
+    // Soft synth events are sent this many blocks ahead of the mix, so
+    // that they are queued before the instrument mixer gets to them.
+    constexpr int a_eventBlocksAhead = 2;
+
+    // As AlsaDriver.
+    constexpr MidiByte a_noteOffVelocity = 64;
+}
+
+OfflineRenderer::OfflineRenderer(unsigned int sampleRate,
+                                 unsigned int blockSize) :
+    SoundDriver(new MappedStudio(), "OfflineRenderer"),
+    m_sampleRate(sampleRate),
+    m_blockSize(blockSize),
+    m_fileReader(nullptr),
+    m_instrumentMixer(nullptr),
+    m_bussMixer(nullptr),
+    m_time(RealTime::zero()),
+    m_eventsSentTo(RealTime::zero()),
+    m_masterLevel(0),
+    m_masterStream(nullptr),
+    m_framesRendered(0)
+{
+    m_studio->setSoundDriver(this);
+
+    // Same as RosegardenSequencer.  The mix buffer length doesn't
+    // matter in low latency mode.
+    setAudioBufferSizes(RealTime(0, 60000000), RealTime(2, 500000000),
+                        RealTime(4, 0), 256);
+
+    m_driverStatus = AUDIO_OK;
+
+    for (int ch = 0; ch < 2; ++ch) {
+        m_master[ch].resize(m_blockSize);
+        m_buffer[ch].resize(m_blockSize);
+    }
+    m_interleaved.resize(m_blockSize * 2);
+}
+
+OfflineRenderer::~OfflineRenderer()
+{
+    for (std::pair<const InstrumentId, Stem> &pair : m_stems)
+        delete pair.second.stream;
+    delete m_masterStream;
+
+    // The buss mixer uses the instrument mixer, which uses the file
+    // reader.  The plugins come back to m_pluginScavenger.
+    delete m_bussMixer;
+    delete m_instrumentMixer;
+    delete m_fileReader;
+
+    // SoundDriver doesn't own it.
+    delete m_studio;
+}
+
+void
+OfflineRenderer::addStem(InstrumentId id, const QString &path)
+{
+    m_stems[id] = Stem{path, nullptr};
+}
+
+int
+OfflineRenderer::addStems(RosegardenDocument *doc, const QString &dir)
+{
+    std::set<InstrumentId> done;
+
+    const Composition::trackcontainer &tracks =
+            doc->getComposition().getTracks();
+
+    for (const Composition::trackcontainer::value_type &pair : tracks) {
+        const Instrument *instrument = doc->getStudio().getInstrumentById(
+                pair.second->getInstrument());
+        if (!instrument  ||
+            (instrument->getType() != Instrument::Audio  &&
+             instrument->getType() != Instrument::SoftSynth))
+            continue;
+        if (!done.insert(instrument->getId()).second)
+            continue;
+
+        // Names needn't be unique, so the ID goes first.
+        QString name = strtoqstr(instrument->getPresentationName());
+        name.replace(QRegularExpression("[^A-Za-z0-9_.-]+"), "_");
+        addStem(instrument->getId(), QString("%1/%2-%3.wav").
+                arg(dir).arg(instrument->getId()).arg(name));
+    }
+
+    return int(done.size());
+}
+
+void
+OfflineRenderer::setAudioBussLevels(int bussId, float dB, float pan)
+{
+    if (bussId == 0) {
+        // No pan on the master.
+        m_masterLevel = dB;
+        return;
+    }
+
+    if (m_bussMixer)
+        m_bussMixer->setBussLevels(bussId, dB, pan);
+}
+
+void
+OfflineRenderer::setAudioInstrumentLevels(InstrumentId id, float dB, float pan)
+{
+    if (m_instrumentMixer)
+        m_instrumentMixer->setInstrumentLevels(id, dB, pan);
+}
+
+void
+OfflineRenderer::getPluginPlayableAudio(std::vector<PlayableData *> &playable)
+{
+    if (m_instrumentMixer)
+        m_instrumentMixer->getPluginPlayableAudio(playable);
+}
+
+void
+OfflineRenderer::claimUnwantedPlugin(void *plugin)
+{
+    m_pluginScavenger.claim(static_cast<RunnablePluginInstance *>(plugin));
+}
+
+void
+OfflineRenderer::scavengePlugins()
+{
+    m_pluginScavenger.scavenge();
+}
+
+void
+OfflineRenderer::setUpStudio(RosegardenDocument *doc)
+{
+    Studio &studio = doc->getStudio();
+
+    BussList busses = studio.getBusses();
+    std::vector<MappedObjectId> bussIds;
+
+    // First one is the master.
+    for (size_t i = 0; i < busses.size(); ++i) {
+        MappedObject *buss = m_studio->createObject(MappedObject::AudioBuss);
+        buss->setProperty(MappedAudioBuss::BussId, MappedObjectValue(i));
+        buss->setProperty(MappedAudioBuss::Level,
+                          MappedObjectValue(busses[i]->getLevel()));
+        buss->setProperty(MappedAudioBuss::Pan,
+                          MappedObjectValue(busses[i]->getPan()) - 100.0);
+        bussIds.push_back(buss->getId());
+    }
+
+    m_directMaster.clear();
+
+    InstrumentList instruments = studio.getAllInstruments();
+
+    for (const Instrument *instrument : instruments) {
+
+        if (instrument->getType() != Instrument::Audio  &&
+            instrument->getType() != Instrument::SoftSynth)
+            continue;
+
+        MappedObject *fader = m_studio->createObject(MappedObject::AudioFader);
+
+        fader->setProperty(MappedObject::Instrument,
+                           MappedObjectValue(instrument->getId()));
+        fader->setProperty(MappedAudioFader::Channels,
+                           MappedObjectValue(instrument->getNumAudioChannels()));
+        fader->setProperty(MappedAudioFader::FaderLevel,
+                           MappedObjectValue(instrument->getLevel()));
+        fader->setProperty(MappedAudioFader::Pan,
+                           MappedObjectValue(instrument->getPan()) - 100.0f);
+
+        // Nothing is recorded, so the inputs don't matter.
+
+        const BussId output = instrument->getAudioOutput();
+        if (output > 0  &&  output < bussIds.size())
+            m_studio->connectObjects(fader->getId(), bussIds[output]);
+        else
+            m_directMaster.insert(instrument->getId());
+    }
+}
+
+void
+OfflineRenderer::setUpPlugins(RosegardenDocument *doc)
+{
+    Studio &studio = doc->getStudio();
+
+    // All the softsynths, audio instruments, and busses.
+    std::vector<PluginContainer *> pluginContainers;
+
+    BussList busses = studio.getBusses();
+    for (Buss *buss : busses) {
+        pluginContainers.push_back(buss);
+    }
+
+    InstrumentList instruments = studio.getAllInstruments();
+    for (Instrument *instrument : instruments) {
+        if (instrument->getType() == Instrument::Audio  ||
+            instrument->getType() == Instrument::SoftSynth)
+            pluginContainers.push_back(instrument);
+    }
+
+    const QString projectDirectory =
+            doc->getAudioFileManager().getAbsoluteAudioPath();
+
+    // Same order as RosegardenDocument::initialiseStudio().
+    for (PluginContainer *container : pluginContainers) {
+
+        const InstrumentId id = container->getId();
+
+        for (AudioPluginVector::iterator i = container->beginPlugins();
+             i != container->endPlugins(); ++i) {
+
+            AudioPluginInstance &plugin = **i;
+
+            if (!plugin.isAssigned())
+                continue;
+
+            const int position = int(plugin.getPosition());
+
+            m_instrumentMixer->setPlugin(
+                    id, position, strtoqstr(plugin.getIdentifier()));
+
+            m_instrumentMixer->configurePlugin(
+                    id, position,
+                    PluginIdentifier::RESERVED_PROJECT_DIRECTORY_KEY,
+                    projectDirectory);
+
+            for (const AudioPluginInstance::ConfigMap::value_type &pair :
+                     plugin.getConfiguration()) {
+                const QString error = m_instrumentMixer->configurePlugin(
+                        id, position,
+                        strtoqstr(pair.first), strtoqstr(pair.second));
+                if (error != "")
+                    RG_WARNING << "setUpPlugins(): " << error;
+            }
+
+            m_instrumentMixer->setPluginBypass(
+                    id, position, plugin.isBypassed());
+
+            for (PortInstanceIterator port = plugin.begin();
+                 port != plugin.end(); ++port) {
+                m_instrumentMixer->setPluginPortValue(
+                        id, position, (*port)->number, (*port)->value);
+            }
+
+            if (plugin.getProgram() != "") {
+                m_instrumentMixer->setPluginProgram(
+                        id, position, strtoqstr(plugin.getProgram()));
+
+                for (PortInstanceIterator port = plugin.begin();
+                     port != plugin.end(); ++port) {
+                    if ((*port)->changedSinceProgramChange) {
+                        m_instrumentMixer->setPluginPortValue(
+                                id, position, (*port)->number, (*port)->value);
+                    }
+                }
+            }
+        }
+    }
+}
+
+bool
+OfflineRenderer::render(RosegardenDocument *doc, const QString &masterPath)
+{
+    m_error = "";
+    m_framesRendered = 0;
+
+    Composition &composition = doc->getComposition();
+
+    const RealTime start =
+            composition.getElapsedRealTime(composition.getStartMarker());
+    const RealTime end =
+            composition.getElapsedRealTime(composition.getEndMarker());
+
+    // *** The studio
+
+    setUpStudio(doc);
+
+    clearAudioFiles();
+    AudioFileManager &audioFileManager = doc->getAudioFileManager();
+    for (AudioFileVector::const_iterator i = audioFileManager.cbegin();
+         i != audioFileManager.cend(); ++i) {
+        addAudioFile((*i)->getAbsoluteFilePath(), (*i)->getId());
+    }
+
+    m_fileReader = new AudioFileReader(this, m_sampleRate);
+
+    // Every core.  The mixer threads are never run(); we kick them.
+    m_instrumentMixer = new AudioInstrumentMixer(
+            this, m_fileReader, m_sampleRate, m_blockSize, 0);
+    // The live mixer may be running, and it owns the performance
+    // counters.
+    m_instrumentMixer->setPublishPerformance(false);
+
+    m_bussMixer = new AudioBussMixer(
+            this, m_instrumentMixer, m_sampleRate, m_blockSize);
+    m_instrumentMixer->setBussMixer(m_bussMixer);
+
+    setUpPlugins(doc);
+
+    MappedAudioBuss *master = m_studio->getAudioBuss(0);
+    if (master)
+        (void)master->getProperty(MappedAudioBuss::Level, m_masterLevel);
+
+    // *** The output files
+
+    m_masterStream = AudioWriteStreamFactory::createWriteStream(
+            masterPath, 2, m_sampleRate);
+    if (!m_masterStream) {
+        m_error = QString("Failed to open \"%1\" for writing").arg(masterPath);
+        return false;
+    }
+
+    for (std::pair<const InstrumentId, Stem> &pair : m_stems) {
+        Stem &stem = pair.second;
+        stem.stream = AudioWriteStreamFactory::createWriteStream(
+                stem.path, 2, m_sampleRate);
+        if (!stem.stream) {
+            m_error = QString("Failed to open \"%1\" for writing").arg(stem.path);
+            return false;
+        }
+    }
+
+    // *** The events
+
+    // Same as MidiFile::convertToMidi().
+    SequenceManager *sequenceManager = nullptr;
+    QScopedPointer<SequenceManager> ownSequenceManager;
+
+    if (RosegardenMainWindow::self()) {
+        sequenceManager = RosegardenMainWindow::self()->getSequenceManager();
+    } else {
+        ownSequenceManager.reset(new SequenceManager());
+        sequenceManager = ownSequenceManager.data();
+        sequenceManager->setDocument(doc);
+        sequenceManager->resetCompositionMapper();
+    }
+
+    QScopedPointer<MappedBufMetaIterator> metaIterator(
+            sequenceManager->makeTempMetaiterator());
+
+    std::vector<MappedEvent> audioEvents;
+    metaIterator->getAudioEvents(audioEvents);
+
+    m_playing = true;
+    m_time = start;
+    m_playStartPosition = start;
+
+    initialiseAudioQueue(audioEvents);
+
+    // Program changes and so on for soft synths on fixed channels.
+    // These go first, as at the start of playback.
+    {
+        MappedEventList setup;
+        MappedEventInserter inserter(setup);
+        metaIterator->fetchFixedChannelSetup(inserter);
+        for (const MappedEvent *event : setup) {
+            MappedEvent now(*event);
+            now.setEventTime(start);
+            sendSynthEvent(now);
+        }
+    }
+
+    metaIterator->jumpToTime(start);
+    m_eventsSentTo = start;
+    m_noteOffs.clear();
+
+    const RealTime blockDuration =
+            RealTime::frame2RealTime(m_blockSize, m_sampleRate);
+    const RealTime eventLead = RealTime::frame2RealTime(
+            m_blockSize * a_eventBlocksAhead, m_sampleRate);
+
+    sendEvents(*metaIterator, start + eventLead);
+
+    // As JackDriver::prebufferAudio().  Don't discard the events we've
+    // just sent.
+    m_instrumentMixer->resetAllPlugins(false);
+    m_fileReader->fillBuffers(start);
+    m_bussMixer->fillBuffers(start);  // also fills the instrument mixer
+
+    // As JackDriver::updateAudioData().
+    m_bussMixer->updateInstrumentConnections();
+    m_instrumentMixer->updateInstrumentMuteStates();
+
+    RG_DEBUG << "render(): " << start << " to " << end << " in blocks of " << m_blockSize << " on " << m_instrumentMixer->getThreadCount() << " thread(s)";
+
+    // *** Freewheel
+
+    // The last block is cut short at the end marker.
+    const size_t totalFrames = size_t(std::max(
+            0L, RealTime::realTime2Frame(end - start, m_sampleRate)));
+
+    bool ok = true;
+
+    while (m_framesRendered < totalFrames) {
+
+        const size_t frames =
+                std::min(size_t(m_blockSize), totalFrames - m_framesRendered);
+
+        sendEvents(*metaIterator, m_time + blockDuration + eventLead);
+
+        // What the reader and mixer threads would do if we were playing
+        // to JACK, but all of it now, on this thread.
+        m_fileReader->kick(false);
+        m_instrumentMixer->kick(false);
+        m_bussMixer->kick(false, false);
+
+        ok = mixBlock(frames);
+
+        m_instrumentMixer->audioProcessingDone();
+
+        if (ok)
+            ok = write(m_masterStream, m_master, frames);
+        if (!ok)
+            break;
+
+        m_framesRendered += frames;
+
+        m_time = m_time + blockDuration;
+
+        m_audioQueueScavenger.scavenge();
+        scavengePlugins();
+    }
+
+    m_playing = false;
+
+#ifdef DEBUG_OFFLINE_RENDERER
+    RG_DEBUG << "render(): wrote " << m_framesRendered << " frames";
+#endif
+
+    // Close the files.
+    for (std::pair<const InstrumentId, Stem> &pair : m_stems) {
+        delete pair.second.stream;
+        pair.second.stream = nullptr;
+    }
+    delete m_masterStream;
+    m_masterStream = nullptr;
+
+    m_sysExData.clear();
+
+    return ok;
+}
+
+void
+OfflineRenderer::sendEvents(MappedBufMetaIterator &metaIterator,
+                            const RealTime &to)
+{
+    if (to <= m_eventsSentTo)
+        return;
+
+    MappedEventList events;
+    MappedEventInserter inserter(events);
+    metaIterator.fetchEvents(inserter, m_eventsSentTo, to);
+
+    // MappedEventList is ordered by time.
+    for (const MappedEvent *event : events) {
+        if (event->getInstrument() < SoftSynthInstrumentBase)
+            continue;
+        sendNoteOffs(event->getEventTime());
+        sendSynthEvent(*event);
+    }
+
+    sendNoteOffs(to);
+
+    m_eventsSentTo = to;
+}
+
+void
+OfflineRenderer::sendSynthEvent(const MappedEvent &event)
+{
+#ifdef HAVE_ALSA
+    if (!m_instrumentMixer)
+        return;
+
+    const InstrumentId id = event.getInstrument();
+
+    RunnablePluginInstance *synth = m_instrumentMixer->getSynthPlugin(id);
+    if (!synth)
+        return;
+
+    const MidiByte channel = event.getRecordedChannel();
+
+    snd_seq_event_t alsaEvent;
+    memset(&alsaEvent, 0, sizeof(alsaEvent));
+
+    // As AlsaDriver::processMidiOut().
+    switch (event.getType()) {
+
+    case MappedEvent::MidiNote:
+        if (event.getVelocity() == 0) {
+            snd_seq_ev_set_noteoff(&alsaEvent, channel, event.getPitch(),
+                                   a_noteOffVelocity);
+            break;
+        }
+
+        // !!! FALLTHROUGH
+
+    case MappedEvent::MidiNoteOneShot:
+        snd_seq_ev_set_noteon(&alsaEvent, channel, event.getPitch(),
+                              event.getVelocity());
+
+        if (event.getDuration() > RealTime(-1, 0)) {
+            // Notch it back 1nsec to go before any note-on at the same
+            // nominal time.
+            m_noteOffs.insert(std::make_pair(
+                    event.getEventTime() + event.getDuration() -
+                            RealTime(0, 1),
+                    NoteOff{id, channel, event.getPitch()}));
+        }
+        break;
+
+    case MappedEvent::MidiProgramChange:
+        snd_seq_ev_set_pgmchange(&alsaEvent, channel, event.getData1());
+        break;
+
+    case MappedEvent::MidiKeyPressure:
+        snd_seq_ev_set_keypress(&alsaEvent, channel,
+                                event.getData1(), event.getData2());
+        break;
+
+    case MappedEvent::MidiChannelPressure:
+        snd_seq_ev_set_chanpress(&alsaEvent, channel, event.getData1());
+        break;
+
+    case MappedEvent::MidiPitchBend:
+        snd_seq_ev_set_pitchbend(
+                &alsaEvent, channel,
+                ((int(event.getData1()) << 7) | int(event.getData2())) - 8192);
+        break;
+
+    case MappedEvent::MidiController:
+        snd_seq_ev_set_controller(&alsaEvent, channel,
+                                  event.getData1(), event.getData2());
+        break;
+
+    case MappedEvent::MidiSystemMessage:
+        if (event.getData1() != MIDI_SYSTEM_EXCLUSIVE)
+            return;
+
+        m_sysExData.push_back(
+                std::string(1, char(MIDI_SYSTEM_EXCLUSIVE)) +
+                DataBlockRepository::getDataBlockForEvent(&event) +
+                std::string(1, char(MIDI_END_OF_EXCLUSIVE)));
+        snd_seq_ev_set_sysex(&alsaEvent, m_sysExData.back().length(),
+                             (char *)(m_sysExData.back().c_str()));
+        break;
+
+    default:
+        return;
+    }
+
+    synth->sendEvent(event.getEventTime(), &alsaEvent);
+#else
+    (void)event;
+#endif
+}
+
+void
+OfflineRenderer::sendNoteOffs(const RealTime &to)
+{
+#ifdef HAVE_ALSA
+    while (!m_noteOffs.empty()  &&  m_noteOffs.begin()->first <= to) {
+
+        const RealTime time = m_noteOffs.begin()->first;
+        const NoteOff &noteOff = m_noteOffs.begin()->second;
+
+        RunnablePluginInstance *synth =
+                m_instrumentMixer->getSynthPlugin(noteOff.instrument);
+
+        if (synth) {
+            snd_seq_event_t alsaEvent;
+            memset(&alsaEvent, 0, sizeof(alsaEvent));
+            snd_seq_ev_set_noteoff(&alsaEvent, noteOff.channel,
+                                   noteOff.pitch, a_noteOffVelocity);
+            synth->sendEvent(time, &alsaEvent);
+        }
+
+        m_noteOffs.erase(m_noteOffs.begin());
+    }
+#else
+    (void)to;
+#endif
+}
+
+bool
+OfflineRenderer::mixBlock(size_t writeFrames)
+{
+    // As JackDriver::jackProcess(), less the ports and meters.
+
+    const size_t frames = m_blockSize;
+
+    for (int ch = 0; ch < 2; ++ch)
+        std::fill(m_master[ch].begin(), m_master[ch].end(), 0.0f);
+
+    const int bussCount = m_bussMixer->getBussCount();
+
+    for (int buss = 0; buss < bussCount; ++buss) {
+        for (int ch = 0; ch < 2; ++ch) {
+            RingBuffer<sample_t> *rb = m_bussMixer->getRingBuffer(buss, ch);
+            if (!rb)
+                continue;
+            if (m_bussMixer->isBussDormant(buss)) {
+                rb->skip(frames);
+            } else {
+                rb->read(m_buffer[ch].data(), frames);
+                AudioKernels::add(m_master[ch].data(), m_buffer[ch].data(),
+                                  frames);
+            }
+        }
+    }
+
+    InstrumentId audioBase;
+    int audioCount;
+    getAudioInstrumentNumbers(audioBase, audioCount);
+
+    InstrumentId synthBase;
+    int synthCount;
+    getSoftSynthInstrumentNumbers(synthBase, synthCount);
+
+    for (int i = 0; i < audioCount + synthCount; ++i) {
+
+        InstrumentId id;
+        if (i < audioCount)
+            id = audioBase + i;
+        else
+            id = synthBase + (i - audioCount);
+
+        std::map<InstrumentId, Stem>::iterator stem = m_stems.find(id);
+
+        if (m_instrumentMixer->isInstrumentEmpty(id)) {
+            if (stem != m_stems.end()) {
+                for (int ch = 0; ch < 2; ++ch)
+                    std::fill(m_buffer[ch].begin(), m_buffer[ch].end(), 0.0f);
+                if (!write(stem->second.stream, m_buffer, writeFrames))
+                    return false;
+            }
+            continue;
+        }
+
+        const bool directToMaster =
+                (m_directMaster.find(id) != m_directMaster.end());
+
+        for (int ch = 0; ch < 2; ++ch) {
+
+            RingBuffer<sample_t, 2> *rb =
+                    m_instrumentMixer->getRingBuffer(id, ch);
+
+            if (!rb  ||  m_instrumentMixer->isInstrumentDormant(id)) {
+                if (rb)
+                    rb->skip(frames);
+                std::fill(m_buffer[ch].begin(), m_buffer[ch].end(), 0.0f);
+            } else {
+                rb->read(m_buffer[ch].data(), frames);
+                if (directToMaster) {
+                    AudioKernels::add(m_master[ch].data(),
+                                      m_buffer[ch].data(), frames);
+                }
+            }
+
+            // The buss mixer isn't reading these, so move its reader on.
+            if (rb  &&  directToMaster)
+                rb->skip(frames, 1);
+        }
+
+        if (stem != m_stems.end()) {
+            if (!write(stem->second.stream, m_buffer, writeFrames))
+                return false;
+        }
+    }
+
+    // No pan on the master.  The level doesn't change, so no ramp.
+    const float gain = AudioLevel::dB_to_multiplier(m_masterLevel);
+    for (int ch = 0; ch < 2; ++ch)
+        AudioKernels::multiply(m_master[ch].data(), gain, frames);
+
+    return true;
+}
+
+bool
+OfflineRenderer::write(AudioWriteStream *stream,
+                       const std::vector<sample_t> *channels, size_t frames)
+{
+    for (size_t i = 0; i < frames; ++i) {
+        m_interleaved[i * 2] = channels[0][i];
+        m_interleaved[i * 2 + 1] = channels[1][i];
+    }
+
+    if (!stream->putInterleavedFrames(frames, m_interleaved.data())) {
+        m_error = QString("Failed to write to \"%1\"").arg(stream->getPath());
+        return false;
+    }
+
+    return true;
+}
+
+
+}
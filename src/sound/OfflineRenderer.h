@@ -0,0 +1,195 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_OFFLINE_RENDERER_H
+#define RG_OFFLINE_RENDERER_H
+
+#include "SoundDriver.h"
+#include "Scavenger.h"
+#include "RunnablePluginInstance.h"
+#include "base/RealTime.h"
+
+#include <QString>
+
+#include <rosegardenprivate_export.h>
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace Rosegarden
+{
+
+
+class AudioBussMixer;
+class AudioFileReader;
+class AudioInstrumentMixer;
+class AudioWriteStream;
+class MappedBufMetaIterator;
+class MappedEvent;
+class RosegardenDocument;
+
+
+/// Renders a document's audio to files, as fast as the CPU allows.
+/**
+ * A SoundDriver with no hardware behind it.  It has its own
+ * AudioFileReader, AudioInstrumentMixer and AudioBussMixer, set up from
+ * the document's Studio, and rather than waiting for JACK to ask for each
+ * period it asks for the next one as soon as the last is done.  The
+ * instrument mixer processes instruments on every core.
+ *
+ * Audio segments and soft synths are rendered, through their plugins,
+ * faders and busses.  MIDI for external devices is not, as there is
+ * nothing to record it from.
+ *
+ * The master out is written to one file, and any instruments given to
+ * addStem() to files of their own, taken after their plugins and fader.
+ * The file type comes from the extension, as for AudioWriteStreamFactory.
+ *
+ * This doesn't need the sequencer, so it works with no UI (see
+ * "rosegarden --render").
+ */
+class ROSEGARDENPRIVATE_EXPORT OfflineRenderer : public SoundDriver
+{
+public:
+    OfflineRenderer(unsigned int sampleRate, unsigned int blockSize = 2048);
+    ~OfflineRenderer() override;
+
+    /// Also write this instrument on its own to path.
+    void addStem(InstrumentId id, const QString &path);
+
+    /// addStem() for each audio and soft synth instrument with a track.
+    /**
+     * The files go in dir, named for the instrument's ID and name, e.g.
+     * "1000-Audio_1.wav".  Returns the number of stems added.
+     */
+    int addStems(RosegardenDocument *doc, const QString &dir);
+
+    /// Render doc from its start marker to its end marker.
+    /**
+     * The files are exactly that long, the last block being cut short.
+     * Returns false if something couldn't be set up or written.  See
+     * getError().  Only call this once on any renderer.
+     */
+    bool render(RosegardenDocument *doc, const QString &masterPath);
+
+    QString getError() const  { return m_error; }
+
+    /// Frames written by the last render().
+    size_t getFramesRendered() const  { return m_framesRendered; }
+
+    // SoundDriver overrides.
+
+    RealTime getSequencerTime() override  { return m_time; }
+    unsigned int getSampleRate() const override  { return m_sampleRate; }
+
+    void getAudioInstrumentNumbers(InstrumentId &base, int &count) override
+        { base = AudioInstrumentBase; count = AudioInstrumentCount; }
+    void getSoftSynthInstrumentNumbers(InstrumentId &base, int &count) override
+        { base = SoftSynthInstrumentBase; count = SoftSynthInstrumentCount; }
+
+    void setAudioBussLevels(int bussId, float dB, float pan) override;
+    void setAudioInstrumentLevels(InstrumentId id, float dB, float pan) override;
+
+    void getPluginPlayableAudio(std::vector<PlayableData *> &playable) override;
+
+    void claimUnwantedPlugin(void *plugin) override;
+    void scavengePlugins() override;
+
+private:
+    // Hide copy ctor and op=.
+    OfflineRenderer(const OfflineRenderer &);
+    OfflineRenderer &operator=(const OfflineRenderer &);
+
+    /// Faders and busses, as RosegardenDocument::initialiseStudio() does.
+    void setUpStudio(RosegardenDocument *doc);
+    /// After the mixers exist.
+    void setUpPlugins(RosegardenDocument *doc);
+
+    /// Send soft synth events up to the given time.
+    /**
+     * Events for other instruments are dropped.  Note-offs are held back
+     * until their time comes round, as synths want their events in order.
+     */
+    void sendEvents(MappedBufMetaIterator &metaIterator, const RealTime &to);
+    void sendSynthEvent(const MappedEvent &event);
+    void sendNoteOffs(const RealTime &to);
+
+    /// Mix one block into m_master, writing the stems as we go.
+    /**
+     * Only the first writeFrames of the block are written.
+     */
+    bool mixBlock(size_t writeFrames);
+
+    /// Write the first frames of a block of two channels.
+    bool write(AudioWriteStream *stream,
+               const std::vector<sample_t> *channels, size_t frames);
+
+    unsigned int m_sampleRate;
+    unsigned int m_blockSize;
+
+    AudioFileReader *m_fileReader;
+    AudioInstrumentMixer *m_instrumentMixer;
+    AudioBussMixer *m_bussMixer;
+
+    Scavenger<RunnablePluginInstance> m_pluginScavenger;
+
+    /// Start of the block being rendered.
+    RealTime m_time;
+    /// Soft synth events have been sent up to here.
+    RealTime m_eventsSentTo;
+
+    float m_masterLevel;
+
+    /// Instruments whose fader goes straight to the master.
+    std::set<InstrumentId> m_directMaster;
+
+    struct NoteOff
+    {
+        InstrumentId instrument;
+        MidiByte channel;
+        MidiByte pitch;
+    };
+    std::multimap<RealTime, NoteOff> m_noteOffs;
+
+    /// SysEx data has to outlast the events that point to it.
+    std::list<std::string> m_sysExData;
+
+    struct Stem
+    {
+        QString path;
+        AudioWriteStream *stream;
+    };
+    std::map<InstrumentId, Stem> m_stems;
+
+    AudioWriteStream *m_masterStream;
+
+    /// One block per channel.
+    std::vector<sample_t> m_master[2];
+    std::vector<sample_t> m_buffer[2];
+    /// Interleaved, for writing.
+    std::vector<sample_t> m_interleaved;
+
+    size_t m_framesRendered;
+
+    QString m_error;
+};
+
+
+}
+
+#endif
@@ -15,8 +15,13 @@
 
 #include "PlayableAudioFile.h"
 
+#include "AudioFileMapping.h"
+#include "AudioKernels.h"
+#include "ResampledAudioFiles.h"
 #include "RingBufferPool.h"
 
+#include <algorithm>
+#include <memory>
 #include <utility>
 
 #include <pthread.h>
@@ -29,19 +34,17 @@ namespace Rosegarden
 //#define DEBUG_PLAYABLE 1
 //#define DEBUG_PLAYABLE_READ 1
 
-AudioCache PlayableAudioFile::m_smallFileCache;
-
-std::vector<sample_t *> PlayableAudioFile::m_workBuffers;
-size_t PlayableAudioFile::m_workBufferSize = 0;
-QMutex PlayableAudioFile::m_workBuffersMutex;
-
-char *PlayableAudioFile::m_rawFileBuffer;
-size_t PlayableAudioFile::m_rawFileBufferSize = 0;
-
 RingBufferPool *PlayableAudioFile::m_ringBufferPool = nullptr;
 
 static constexpr size_t a_xfadeFrames = 30;
 
+// Frames faded at a time on their way from AudioCache to the ring
+// buffers.  See m_decodeBuffers.
+static constexpr size_t a_decodeBlockFrames = 4096;
+
+// How far ahead of the read position to ask the kernel to read.
+static constexpr size_t a_readAheadSeconds = 2;
+
 PlayableAudioFile::PlayableAudioFile(InstrumentId instrumentId,
                                      AudioFile *audioFile,
                                      const RealTime &startTime,
@@ -54,15 +57,19 @@ PlayableAudioFile::PlayableAudioFile(InstrumentId instrumentId,
     m_startTime(startTime),
     m_startIndex(startIndex),
     m_duration(duration),
-    m_file(nullptr),
+    m_mapping(nullptr),
+    m_readPosition(0),
+    m_readAheadPosition(0),
     m_audioFile(audioFile),
+    m_readFile(audioFile),
     m_instrumentId(instrumentId),
     m_targetChannels(targetChannels),
     m_targetSampleRate(targetSampleRate),
     m_fileEnded(false),
     m_firstRead(true),
     m_isSmallFile(false),
-    m_smallFileScanFrame(0)
+    m_totalFrames(0),
+    m_scanFrame(0)
 {
 #ifdef DEBUG_PLAYABLE
     std::cerr << "PlayableAudioFile::PlayableAudioFile - creating " << this << " for instrument " << instrumentId << " with file " << (m_audioFile ? m_audioFile->getShortFilename() : "(none)") << std::endl;
@@ -102,33 +109,42 @@ PlayableAudioFile::initialise(size_t bufferSize, size_t smallFileSize)
     std::cerr << "PlayableAudioFile::initialise() " << this << std::endl;
 #endif
 
-    checkSmallFileCache(smallFileSize);
-
-    if (!m_isSmallFile) {
-
-        m_file = new std::ifstream(m_audioFile->getAbsoluteFilePath().toLocal8Bit(),
-                                   std::ios::in | std::ios::binary);
-
-        if (!*m_file) {
-            std::cerr << "ERROR: PlayableAudioFile::initialise: Failed to open audio file " << m_audioFile->getAbsoluteFilePath() << std::endl;
-            delete m_file;
-            m_file = nullptr;
-        }
-    }
+    if (m_targetChannels <= 0)
+        m_targetChannels = m_audioFile->getChannels();
+    if (m_targetSampleRate <= 0)
+        m_targetSampleRate = m_audioFile->getSampleRate();
 
-    // Scan to the beginning of the data chunk we need
-    //
+    // If the file has been resampled to our rate in the background, read
+    // that instead, and save decode() the work.
+    if (m_targetSampleRate != int(m_audioFile->getSampleRate())) {
+        AudioFile *copy = ResampledAudioFiles::getInstance()->find(
+                m_audioFile->getAbsoluteFilePath(),
+                m_targetSampleRate, m_targetChannels);
+        if (copy)
+            m_readFile = copy;
+    }
+
+    // Small files are decoded in full now.  Anything else is mapped, and
+    // the kernel asked to read it, on the first prefetch() or
+    // fillBuffers(), so that AudioFileReader::kick() decides which files
+    // go to the disk first.
+    if (m_readFile->getSize() <= smallFileSize  &&  map())
+        loadSmallFile(smallFileSize);
+
+    if (!m_isSmallFile  &&  !m_mapping) {
+        // Nothing read yet.  fillBuffers() will scan to m_startIndex.
+        m_currentScanPoint = m_startIndex;
+    } else {
+        // Scan to the beginning of the data chunk we need
+        //
 #ifdef DEBUG_PLAYABLE
-    std::cerr << "PlayableAudioFile::initialise - scanning to " << m_startIndex << std::endl;
+        std::cerr << "PlayableAudioFile::initialise - scanning to " << m_startIndex << std::endl;
 #endif
 
-    if (m_file) {
-        scanTo(m_startIndex);
-    } else {
-        m_fileEnded = false;
-        m_currentScanPoint = m_startIndex;
-        m_smallFileScanFrame = (size_t)RealTime::realTime2Frame
-            (m_currentScanPoint, m_audioFile->getSampleRate());
+        if (!scanTo(m_startIndex)) {
+            m_currentScanPoint = m_startIndex;
+            m_scanFrame = m_totalFrames;
+        }
     }
 
 #ifdef DEBUG_PLAYABLE
@@ -137,35 +153,26 @@ PlayableAudioFile::initialise(size_t bufferSize, size_t smallFileSize)
     (void)bufferSize;
 #endif
 
-    if (m_targetChannels <= 0)
-        m_targetChannels = m_audioFile->getChannels();
-    if (m_targetSampleRate <= 0)
-        m_targetSampleRate = m_audioFile->getSampleRate();
-
     m_ringBuffers = new RingBuffer<sample_t> *[m_targetChannels];
     for (int ch = 0; ch < m_targetChannels; ++ch) {
         m_ringBuffers[ch] = nullptr;
     }
+
+    for (int ch = 0; ch < m_targetChannels; ++ch) {
+        m_decodeBuffers.push_back(new sample_t[a_decodeBlockFrames]);
+    }
 }
 
 PlayableAudioFile::~PlayableAudioFile()
 {
-    if (m_file) {
-        m_file->close();
-        delete m_file;
-    }
+    delete m_mapping;
 
     returnRingBuffers();
     delete[] m_ringBuffers;
     m_ringBuffers = nullptr;
 
-    if (m_isSmallFile) {
-        m_smallFileCache.decrementReference(m_audioFile);
-    }
-
-    {
-        QMutexLocker lock(&m_workBuffersMutex);
-        clearWorkBuffers();
+    for (sample_t *buffer : m_decodeBuffers) {
+        delete[] buffer;
     }
 
 #ifdef DEBUG_PLAYABLE
@@ -173,6 +180,126 @@ PlayableAudioFile::~PlayableAudioFile()
 #endif
 }
 
+bool
+PlayableAudioFile::map()
+{
+    if (m_mapping)
+        return true;
+
+    m_mapping = m_readFile->map();
+
+    if (!m_mapping) {
+        std::cerr << "ERROR: PlayableAudioFile::map: Failed to map audio file " << m_readFile->getAbsoluteFilePath() << std::endl;
+        return false;
+    }
+
+    m_readPosition = 0;
+    m_readAheadPosition = 0;
+
+    const size_t sourceFrames =
+            m_mapping->getSampleBytes() / getBytesPerFrame();
+    m_totalFrames = size_t(double(sourceFrames) *
+                           double(m_targetSampleRate) /
+                           double(getSourceSampleRate()));
+
+    return true;
+}
+
+size_t
+PlayableAudioFile::toSourceFrame(size_t targetFrame) const
+{
+    if (m_targetSampleRate == int(getSourceSampleRate()))
+        return targetFrame;
+
+    return size_t(double(targetFrame) * double(getSourceSampleRate()) /
+                  double(m_targetSampleRate));
+}
+
+AudioCache::BlockPtr
+PlayableAudioFile::getBlock(size_t block)
+{
+    AudioCache *cache = AudioCache::getInstance();
+
+    AudioCache::BlockPtr cached =
+            cache->get(m_readFile, m_targetSampleRate, m_targetChannels,
+                       block);
+    if (cached)
+        return cached;
+
+    // Not cached.  Decode it from the file.
+
+    if (!m_mapping)
+        return AudioCache::BlockPtr();
+
+    const size_t start = block * AudioCache::BlockFrames;
+    if (start >= m_totalFrames)
+        return AudioCache::BlockPtr();
+    const size_t frames =
+            std::min(AudioCache::BlockFrames, m_totalFrames - start);
+
+    const size_t bytesPerFrame = getBytesPerFrame();
+    const size_t sourceFrames = m_mapping->getSampleBytes() / bytesPerFrame;
+
+    const size_t sourceStart = toSourceFrame(start);
+    size_t sourceEnd = toSourceFrame(start + frames);
+    if (start + frames == m_totalFrames)
+        sourceEnd = sourceFrames;
+    if (sourceEnd > sourceFrames)
+        sourceEnd = sourceFrames;
+    if (sourceEnd <= sourceStart)
+        return AudioCache::BlockPtr();
+
+    std::shared_ptr<AudioCache::Block> data =
+            std::make_shared<AudioCache::Block>(m_targetChannels, frames);
+
+    std::vector<sample_t *> channels;
+    for (int ch = 0; ch < m_targetChannels; ++ch) {
+        channels.push_back(data->getChannel(ch));
+    }
+
+    if (!m_readFile->decode(m_mapping->getSampleData() +
+                                     sourceStart * bytesPerFrame,
+                             (sourceEnd - sourceStart) * bytesPerFrame,
+                             m_targetSampleRate,
+                             m_targetChannels,
+                             frames,
+                             channels,
+                             false)) {
+        std::cerr << "ERROR: PlayableAudioFile::getBlock: failed to decode block " << block << " of " << m_readFile->getAbsoluteFilePath() << std::endl;
+        return AudioCache::BlockPtr();
+    }
+
+    // Keep the kernel reading ahead of us.
+    m_readPosition = sourceEnd * bytesPerFrame;
+    readAhead();
+
+    return cache->add(m_readFile, m_targetSampleRate, m_targetChannels,
+                      block, data);
+}
+
+void
+PlayableAudioFile::readAhead()
+{
+    if (!m_mapping)
+        return;
+
+    const size_t window =
+            size_t(getSourceSampleRate()) * getBytesPerFrame() *
+            a_readAheadSeconds;
+
+    // Top up once half of what we asked for has been played.
+    if (m_readAheadPosition >= m_readPosition + window / 2)
+        return;
+    if (m_readAheadPosition >= m_mapping->getSampleBytes())
+        return;
+
+    const size_t start = std::max(m_readAheadPosition, m_readPosition);
+    const size_t end = m_readPosition + window;
+
+    m_mapping->willNeed(start, end - start);
+    m_readAheadPosition = end;
+}
+
 void
 PlayableAudioFile::returnRingBuffers()
 {
@@ -196,21 +323,30 @@ PlayableAudioFile::scanTo(const RealTime &time)
 
     bool ok = false;
 
-    if (m_isSmallFile) {
+    const size_t frame =
+            size_t(RealTime::realTime2Frame(time, m_targetSampleRate));
 
-        m_currentScanPoint = time;
-        m_smallFileScanFrame = (size_t)RealTime::realTime2Frame
-            (time, m_audioFile->getSampleRate());
 #ifdef DEBUG_PLAYABLE_READ
-        std::cerr << "... maps to frame " << m_smallFileScanFrame << std::endl;
+    std::cerr << "... maps to frame " << frame << " of " << m_totalFrames << std::endl;
 #endif
+
+    if (frame <= m_totalFrames) {
+
+        m_scanFrame = frame;
+        m_currentScanPoint = time;
         ok = true;
 
-    } else {
+        if (m_mapping) {
+            m_readPosition = toSourceFrame(frame) * getBytesPerFrame();
+            m_readAheadPosition = m_readPosition;
 
-        ok = m_audioFile->scanTo(m_file, time);
-        if (ok) {
-            m_currentScanPoint = time;
+            // Start reading ahead from here, unless there's no need to
+            // read at all.
+            if (!AudioCache::getInstance()->has(
+                        m_readFile, m_targetSampleRate, m_targetChannels,
+                        frame / AudioCache::BlockFrames)) {
+                readAhead();
+            }
         }
     }
 
@@ -230,11 +366,8 @@ PlayableAudioFile::getSampleFramesAvailable()
     size_t actual = 0;
 
     if (m_isSmallFile) {
-        size_t cchannels;
-        size_t cframes;
-        (void)m_smallFileCache.getData(m_audioFile, cchannels, cframes);
-        if (cframes > m_smallFileScanFrame)
-            return cframes - m_smallFileScanFrame;
+        if (m_totalFrames > m_scanFrame)
+            return m_totalFrames - m_scanFrame;
         else
             return 0;
     }
@@ -295,166 +428,89 @@ PlayableAudioFile::addSamples(std::vector<sample_t *> &destination,
 #endif
 
         return qty;
+    }
 
-    } else {  // Small file.  Use m_smallFileCache.
-
-        size_t cchannels;
-        size_t cframes;
-        float **cached = m_smallFileCache.getData(m_audioFile, cchannels, cframes);
-
-        if (!cached) {
-            std::cerr << "WARNING: PlayableAudioFile::addSamples: Failed to find small file in cache" << std::endl;
-            m_isSmallFile = false;
-        } else {
-
-            size_t scanFrame = m_smallFileScanFrame;
-
-            if (scanFrame >= cframes) {
-                m_fileEnded = true;
-                return 0;
-            }
-
-            size_t endFrame = scanFrame + nframes;
-            size_t n = nframes;
-
-            if (endFrame >= cframes) {
-                m_fileEnded = true;
-                n = cframes - scanFrame;
-            }
-
-#ifdef DEBUG_PLAYABLE_READ
-            std::cerr << "PlayableAudioFile::addSamples: it's a small file: want frames " << scanFrame << " to " << endFrame << " of " << cframes << std::endl;
-#endif
-
-            // size_t xfadeIn = (m_firstRead ? m_xfadeFrames : 0);
-            // size_t xfadeOut = (m_fileEnded ? m_xfadeFrames : 0);
-
-            // all this could be neater!
-
-            if (channels == 1 && cchannels == 2) { // mix
-                for (size_t i = 0; i < n; ++i) {
-                    sample_t v =
-                        cached[0][scanFrame + i] +
-                        cached[1][scanFrame + i];
-                    //if ((i + 1) < xfadeIn)
-                    //    v = (v * (i + 1)) / xfadeIn;
-                    //if ((n - i) < xfadeOut)
-                    //    v = (v * (n - i)) / xfadeOut;
-                    destination[0][i + offset] += v;
-                }
-            } else {
-                for (size_t ch = 0; ch < channels; ++ch) {
-                    int sch = ch;
-                    if (ch >= cchannels) {
-                        if (channels == 2 && cchannels == 1)
-                            sch = 0;
-                        else
-                            break;
-                    } else {
-                        for (size_t i = 0; i < n; ++i) {
-                            sample_t v = cached[sch][scanFrame + i];
-                            //if ((i + 1) < xfadeIn)
-                            //    v = (v * (i + 1)) / xfadeIn;
-                            //if ((n - i) < xfadeOut)
-                            //    v = (v * (n - i)) / xfadeOut;
-                            destination[ch][i + offset] += v;
-                        }
-                    }
-                }
-            }
+    // Small file.  Use m_smallFileBlocks.
 
-            m_smallFileScanFrame += nframes;
-            m_currentScanPoint = m_currentScanPoint +
-                RealTime::frame2RealTime(nframes, m_targetSampleRate);
-            return nframes;
-        }
+    if (m_scanFrame >= m_totalFrames) {
+        m_fileEnded = true;
+        return 0;
     }
 
-    return 0;
-}
+    size_t n = nframes;
 
-void
-PlayableAudioFile::checkSmallFileCache(size_t smallFileSize)
-{
-    if (m_smallFileCache.has(m_audioFile)) {
+    if (m_scanFrame + nframes >= m_totalFrames) {
+        m_fileEnded = true;
+        n = m_totalFrames - m_scanFrame;
+    }
 
-#ifdef DEBUG_PLAYABLE
-        std::cerr << "PlayableAudioFile::checkSmallFileCache: Found file in small file cache" << std::endl;
+#ifdef DEBUG_PLAYABLE_READ
+    std::cerr << "PlayableAudioFile::addSamples: it's a small file: want frames " << m_scanFrame << " to " << (m_scanFrame + n) << " of " << m_totalFrames << std::endl;
 #endif
 
-        m_smallFileCache.incrementReference(m_audioFile);
-        m_isSmallFile = true;
+    // The blocks were decoded with our target channels, so there's no
+    // mixing down or up to do here.
+    const size_t sourceChannels = std::min(channels, size_t(m_targetChannels));
 
-    } else if (m_audioFile->getSize() <= smallFileSize) {
+    for (size_t done = 0; done < n; ) {
 
-        std::ifstream file(m_audioFile->getAbsoluteFilePath().toLocal8Bit(),
-                           std::ios::in | std::ios::binary);
+        const size_t frame = m_scanFrame + done;
+        const AudioCache::Block &block =
+                *m_smallFileBlocks[frame / AudioCache::BlockFrames];
+        const size_t blockOffset = frame % AudioCache::BlockFrames;
+        const size_t frames = std::min(n - done, block.frames - blockOffset);
 
-        if (!file) {
-            std::cerr << "ERROR: PlayableAudioFile::checkSmallFileCache: Failed to open audio file " << m_audioFile->getAbsoluteFilePath() << std::endl;
-            return ;
+        for (size_t ch = 0; ch < sourceChannels; ++ch) {
+            AudioKernels::add(destination[ch] + offset + done,
+                              block.getChannel(ch) + blockOffset,
+                              frames);
         }
 
-#ifdef DEBUG_PLAYABLE
-        std::cerr << "PlayableAudioFile::checkSmallFileCache: Adding file to small file cache" << std::endl;
-#endif
+        done += frames;
+    }
 
-        // We always encache files with their original number of
-        // channels (because they might be called for in any channel
-        // configuration subsequently) but with the current sample
-        // rate, not their original one.
+    m_scanFrame += nframes;
+    m_currentScanPoint = m_currentScanPoint +
+        RealTime::frame2RealTime(nframes, m_targetSampleRate);
 
-        m_audioFile->scanTo(&file, RealTime::zero());
+    return nframes;
+}
 
-        size_t reqd = m_audioFile->getSize() / m_audioFile->getBytesPerFrame();
-        unsigned char *buffer = new unsigned char[m_audioFile->getSize()];
-        size_t obtained = m_audioFile->getSampleFrames(&file, (char *)buffer, reqd);
+void
+PlayableAudioFile::loadSmallFile(size_t smallFileSize)
+{
+    if (!m_mapping)
+        return;
+    if (m_readFile->getSize() > smallFileSize)
+        return;
 
-//        std::cerr <<"obtained=" << obtained << std::endl;
+    const size_t blocks =
+            (m_totalFrames + AudioCache::BlockFrames - 1) /
+            AudioCache::BlockFrames;
+    if (blocks == 0)
+        return;
 
-        size_t nch = getSourceChannels();
-        size_t nframes = obtained;
-        if (int(getSourceSampleRate()) != m_targetSampleRate) {
 #ifdef DEBUG_PLAYABLE
-            std::cerr << "PlayableAudioFile::checkSmallFileCache: Resampling badly from " << getSourceSampleRate() << " to " << m_targetSampleRate << std::endl;
+    std::cerr << "PlayableAudioFile::loadSmallFile: " << blocks << " blocks" << std::endl;
 #endif
-            nframes = size_t(float(nframes) * float(m_targetSampleRate) /
-                             float(getSourceSampleRate()));
-        }
 
-        std::vector<sample_t *> samples;
-        for (size_t ch = 0; ch < nch; ++ch) {
-            samples.push_back(new sample_t[nframes]);
-        }
+    std::vector<AudioCache::BlockPtr> held;
 
-        if (!m_audioFile->decode(buffer,
-                                 obtained * m_audioFile->getBytesPerFrame(),
-                                 m_targetSampleRate,
-                                 nch,
-                                 nframes,
-                                 samples)) {
-            std::cerr << "PlayableAudioFile::checkSmallFileCache: failed to decode file" << std::endl;
-        } else {
-            sample_t **toCache = new sample_t * [nch];
-            for (size_t ch = 0; ch < nch; ++ch) {
-                toCache[ch] = samples[ch];
-            }
-            m_smallFileCache.addData(m_audioFile, nch, nframes, toCache);
-            m_isSmallFile = true;
+    for (size_t block = 0; block < blocks; ++block) {
+        AudioCache::BlockPtr data = getBlock(block);
+        if (!data) {
+            std::cerr << "PlayableAudioFile::loadSmallFile: failed to decode file" << std::endl;
+            return;
         }
-
-        delete[] buffer;
-
-        file.close();
+        held.push_back(data);
     }
 
-    if (m_isSmallFile) {
-        if (m_file) {
-            m_file->close();
-            delete m_file;
-            m_file = nullptr;
-        }
-    }
+    m_smallFileBlocks.swap(held);
+    m_isSmallFile = true;
+
+    // Everything has been decoded.
+    delete m_mapping;
+    m_mapping = nullptr;
 }
 
 #if 0
@@ -469,16 +525,8 @@ PlayableAudioFile::fillBuffers()
     }
 #endif
 
-    if (!m_isSmallFile && (!m_file || !*m_file)) {
-        m_file = new std::ifstream(m_audioFile->getAbsoluteFilePath().toLocal8Bit(),
-                                   std::ios::in | std::ios::binary);
-        if (!*m_file) {
-            std::cerr << "ERROR: PlayableAudioFile::fillBuffers: Failed to open audio file " << m_audioFile->getAbsoluteFilePath() << std::endl;
-            delete m_file;
-            m_file = nullptr;
-            return ;
-        }
-    }
+    if (!m_isSmallFile && !map())
+        return ;
 
     scanTo(m_startIndex);
     updateBuffers();
@@ -514,16 +562,12 @@ PlayableAudioFile::fillBuffers(const RealTime &currentTime)
         return true;
     }
 
-    if (!m_isSmallFile && (!m_file || !*m_file)) {
-        m_file = new std::ifstream(m_audioFile->getAbsoluteFilePath().toLocal8Bit(),
-                                   std::ios::in | std::ios::binary);
-        if (!*m_file) {
-            std::cerr << "ERROR: PlayableAudioFile::fillBuffers: Failed to open audio file " << m_audioFile->getAbsoluteFilePath() << std::endl;
-            delete m_file;
-            m_file = nullptr;
+    // Not prefetch()ed?  Map it now.
+    bool justMapped = false;
+    if (!m_isSmallFile && !m_mapping) {
+        if (!map())
             return false;
-        }
-        scanTo(m_startIndex);
+        justMapped = true;
     }
 
     RealTime scanTime = m_startIndex;
@@ -536,7 +580,9 @@ PlayableAudioFile::fillBuffers(const RealTime &currentTime)
     //        (scanTime,
     //         m_isSmallFile ? m_targetSampleRate : m_audioFile->getSampleRate());
 
-    if (scanTime != m_currentScanPoint) {
+    // A fresh mapping needs scanning even if we are at m_startIndex, to
+    // set the read position and start the read-ahead.
+    if (justMapped  ||  scanTime != m_currentScanPoint) {
         scanTo(scanTime);
     }
 
@@ -551,12 +597,30 @@ PlayableAudioFile::fillBuffers(const RealTime &currentTime)
     return true;
 }
 
+bool
+PlayableAudioFile::prefetch()
+{
+    // Small files are decoded in full up front, and anything mapped has
+    // been prefetched or filled already.
+    if (m_isSmallFile  ||  m_mapping)
+        return false;
+
+    if (!map())
+        return false;
+
+    // As fillBuffers() would.  This starts the kernel reading from where
+    // playback will begin, unless AudioCache has the samples already.
+    scanTo(m_startIndex);
+
+    return true;
+}
+
 bool
 PlayableAudioFile::updateBuffers()
 {
     if (m_isSmallFile)
         return false;
-    if (!m_file)
+    if (!m_mapping)
         return false;
 
     if (m_fileEnded) {
@@ -614,162 +678,138 @@ PlayableAudioFile::updateBuffers()
         m_fileEnded = true;
     }
 
-    size_t fileFrames = nframes;
-    if (m_targetSampleRate != int(getSourceSampleRate())) {
-        fileFrames = size_t(float(fileFrames) * float(getSourceSampleRate()) /
-                            float(m_targetSampleRate));
+    // Only as many frames as the file has left.
+    if (m_scanFrame + nframes >= m_totalFrames) {
+        nframes = (m_scanFrame < m_totalFrames) ?
+                m_totalFrames - m_scanFrame : 0;
+        m_fileEnded = true;
     }
 
 #ifdef DEBUG_PLAYABLE_READ
-    std::cerr << "Want " << fileFrames << " (" << block << ") from file (" << (m_duration + m_startIndex - m_currentScanPoint - block) << " to go)" << std::endl;
+    std::cerr << "Want " << nframes << " (" << block << ") from frame " << m_scanFrame << " (" << (m_duration + m_startIndex - m_currentScanPoint - block) << " to go)" << std::endl;
 #endif
 
-    // !!! need to be doing this in initialise, want to avoid allocations here
-    if ((getBytesPerFrame() * fileFrames) > m_rawFileBufferSize) {
-        delete[] m_rawFileBuffer;
-        m_rawFileBufferSize = getBytesPerFrame() * fileFrames;
-#ifdef DEBUG_PLAYABLE_READ
+    /* !!! No -- GUI and notification side of things isn't up to this yet,
+      so comment it out just in case
 
-        std::cerr << "Expanding raw file buffer to " << m_rawFileBufferSize << " chars" << std::endl;
-#endif
+    if (m_autoFade) {
 
-        m_rawFileBuffer = new char[m_rawFileBufferSize];
-    }
+        if (m_currentScanPoint < m_startIndex + m_fadeInTime) {
 
-    size_t obtained =
-        m_audioFile->getSampleFrames(m_file, m_rawFileBuffer, fileFrames);
+            size_t fadeSamples =
+                    (size_t)RealTime::realTime2Frame(m_fadeInTime, getTargetSampleRate());
+            size_t originSamples =
+                    (size_t)RealTime::realTime2Frame(m_currentScanPoint - m_startIndex, // is x - y strictly non-negative?
+                                                     getTargetSampleRate());
 
-    if (obtained < fileFrames || m_file->eof()) {
-        m_fileEnded = true;
-    }
+            for (size_t i = 0; i < nframes; ++i) {
+                if (i + originSamples > fadeSamples) {
+                    break;
+                }
+                float gain = float(i + originSamples) / float(fadeSamples);
+                for (int ch = 0; ch < m_targetChannels; ++ch) {
+                    m_decodeBuffers[ch][i] *= gain;
+                }
+            }
+        }
 
-    {
-        // We're about to hit the work buffers.
-        QMutexLocker lock(&m_workBuffersMutex);
+        if (m_currentScanPoint + block >
+            m_startIndex + m_duration - m_fadeOutTime) {
+
+            size_t fadeSamples =
+                    (size_t)RealTime::realTime2Frame(m_fadeOutTime, getTargetSampleRate());
+            size_t originSamples = // counting from end
+                    (size_t)RealTime::realTime2Frame
+                            (m_startIndex + m_duration - m_currentScanPoint, // is x - y strictly non-negative?
+                             getTargetSampleRate());
+
+            for (size_t i = 0; i < nframes; ++i) {
+                float gain = 1.0;
+                if (originSamples < i) gain = 0.0;
+                else {
+                    size_t fromEnd = originSamples - i;
+                    if (fromEnd < fadeSamples) {
+                        gain = float(fromEnd) / float(fadeSamples);
+                    }
+                }
+                for (int ch = 0; ch < m_targetChannels; ++ch) {
+                    m_decodeBuffers[ch][i] *= gain;
+                }
+            }
+        }
+    }
+    */
 
-#ifdef DEBUG_PLAYABLE
-        std::cerr << "requested " << fileFrames << " frames from file for " << nframes << " frames, got " << obtained << " frames" << std::endl;
-#endif
+    m_currentScanPoint = m_currentScanPoint + block;
 
-        if (nframes > m_workBufferSize) {
+    if (nframes > 0) {
 
-            clearWorkBuffers();
+        const size_t xfadeFrames = std::min(a_xfadeFrames, nframes);
+        const float xfade = float(xfadeFrames);
 
-            m_workBufferSize = nframes;
+        // A piece at a time, each from within one block.
+        size_t done = 0;
+        while (done < nframes) {
 
-#ifdef DEBUG_PLAYABLE_READ
-            std::cerr << "Expanding work buffer to " << m_workBufferSize << " frames" << std::endl;
-#endif
+            const size_t frame = m_scanFrame + done;
 
-            for (int i = 0; i < m_targetChannels; ++i) {
-                m_workBuffers.push_back(new sample_t[m_workBufferSize]);
+            AudioCache::BlockPtr cached =
+                    getBlock(frame / AudioCache::BlockFrames);
+            if (!cached) {
+                m_fileEnded = true;
+                break;
             }
 
-        } else {
-
-            while (m_targetChannels > (int)m_workBuffers.size()) {
-                m_workBuffers.push_back(new sample_t[m_workBufferSize]);
-            }
-        }
+            const size_t blockOffset = frame % AudioCache::BlockFrames;
+            const size_t frames =
+                    std::min(std::min(nframes - done,
+                                      cached->frames - blockOffset),
+                             a_decodeBlockFrames);
 
-        if (m_audioFile->decode((const unsigned char *)m_rawFileBuffer,
-                                obtained * getBytesPerFrame(),
-                                m_targetSampleRate,
-                                m_targetChannels,
-                                nframes,
-                                m_workBuffers,
-                                false)) {
+            const bool fadeIn = m_firstRead  &&  done < xfadeFrames;
+            const bool fadeOut =
+                    m_fileEnded  &&  done + frames > nframes - xfadeFrames;
 
-            /* !!! No -- GUI and notification side of things isn't up to this yet,
-              so comment it out just in case
+            for (int ch = 0; ch < m_targetChannels; ++ch) {
 
-            if (m_autoFade) {
+                if (!m_ringBuffers[ch])
+                    continue;
 
-                if (m_currentScanPoint < m_startIndex + m_fadeInTime) {
+                const sample_t *source =
+                        cached->getChannel(ch) + blockOffset;
 
-                    size_t fadeSamples =
-                            (size_t)RealTime::realTime2Frame(m_fadeInTime, getTargetSampleRate());
-                    size_t originSamples =
-                            (size_t)RealTime::realTime2Frame(m_currentScanPoint - m_startIndex, // is x - y strictly non-negative?
-                                                             getTargetSampleRate());
+                // Cached samples are shared, so fade a copy.
+                if (fadeIn  ||  fadeOut) {
+                    sample_t *buffer = m_decodeBuffers[ch];
+                    std::copy(source, source + frames, buffer);
 
-                    for (size_t i = 0; i < nframes; ++i) {
-                        if (i + originSamples > fadeSamples) {
-                            break;
-                        }
-                        float gain = float(i + originSamples) / float(fadeSamples);
-                        for (int ch = 0; ch < m_targetChannels; ++ch) {
-                            m_workBuffers[ch][i] *= gain;
+                    if (fadeIn) {
+                        for (size_t i = done;
+                             i < done + frames && i < xfadeFrames; ++i) {
+                            buffer[i - done] *= float(i + 1) / xfade;
                         }
                     }
-                }
-
-                if (m_currentScanPoint + block >
-                    m_startIndex + m_duration - m_fadeOutTime) {
-
-                    size_t fadeSamples =
-                            (size_t)RealTime::realTime2Frame(m_fadeOutTime, getTargetSampleRate());
-                    size_t originSamples = // counting from end
-                            (size_t)RealTime::realTime2Frame
-                                    (m_startIndex + m_duration - m_currentScanPoint, // is x - y strictly non-negative?
-                                     getTargetSampleRate());
-
-                    for (size_t i = 0; i < nframes; ++i) {
-                        float gain = 1.0;
-                        if (originSamples < i) gain = 0.0;
-                        else {
-                            size_t fromEnd = originSamples - i;
-                            if (fromEnd < fadeSamples) {
-                                gain = float(fromEnd) / float(fadeSamples);
-                            }
-                        }
-                        for (int ch = 0; ch < m_targetChannels; ++ch) {
-                            m_workBuffers[ch][i] *= gain;
+                    if (fadeOut) {
+                        for (size_t i = std::max(done, nframes - xfadeFrames);
+                             i < done + frames; ++i) {
+                            buffer[i - done] *= float(nframes - i) / xfade;
                         }
                     }
-                }
-            }
-            */
-
-            m_currentScanPoint = m_currentScanPoint + block;
 
-            for (int ch = 0; ch < m_targetChannels; ++ch) {
-
-                if (m_firstRead || m_fileEnded) {
-                    float xfade = std::min(a_xfadeFrames, nframes);
-                    if (m_firstRead) {
-                        for (size_t i = 0; i < xfade; ++i) {
-                            m_workBuffers[ch][i] *= float(i + 1) / xfade;
-                        }
-                    }
-                    if (m_fileEnded) {
-                        for (size_t i = 0; i < xfade; ++i) {
-                            m_workBuffers[ch][nframes - i - 1] *=
-                                float(i + 1) / xfade;
-                        }
-                    }
+                    source = buffer;
                 }
 
-                if (m_ringBuffers[ch]) {
-                    m_ringBuffers[ch]->write(m_workBuffers[ch], nframes);
-                }
+                m_ringBuffers[ch]->write(source, frames);
             }
+
+            done += frames;
         }
 
-        // Done.
-        //m_workBuffersMutex.unlock();
+        m_scanFrame += done;
     }
 
     m_firstRead = false;
 
-    if (obtained < fileFrames) {
-        if (m_file) {
-            m_file->close();
-            delete m_file;
-            m_file = nullptr;
-        }
-    }
-
     return true;
 }
 
@@ -794,8 +834,8 @@ PlayableAudioFile::getTargetChannels() const
 unsigned int
 PlayableAudioFile::getBytesPerFrame() const
 {
-    if (m_audioFile) {
-        return m_audioFile->getBytesPerFrame();
+    if (m_readFile) {
+        return m_readFile->getBytesPerFrame();
     }
     return 0;
 }
@@ -803,8 +843,8 @@ PlayableAudioFile::getBytesPerFrame() const
 unsigned int
 PlayableAudioFile::getSourceSampleRate() const
 {
-    if (m_audioFile) {
-        return m_audioFile->getSampleRate();
+    if (m_readFile) {
+        return m_readFile->getSampleRate();
     }
     return 0;
 }
@@ -830,14 +870,5 @@ PlayableAudioFile::getBitsPerSample()
 }
 #endif
 
-void
-PlayableAudioFile::clearWorkBuffers()
-{
-    for (size_t i = 0; i < m_workBuffers.size(); ++i) {
-        delete[] m_workBuffers[i];
-    }
-    m_workBuffers.clear();
-}
-
 
 }
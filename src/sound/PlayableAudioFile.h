@@ -23,15 +23,15 @@
 #include "AudioCache.h"
 #include "PlayableData.h"
 
-#include <QMutex>
-
 #include <vector>
-#include <fstream>
+
+#include <rosegardenprivate_export.h>
 
 namespace Rosegarden
 {
 
 
+class AudioFileMapping;
 class RingBufferPool;
 
 
@@ -43,7 +43,7 @@ class RingBufferPool;
  *
  * AudioInstrumentMixer gets audio data from PlayableAudioFile objects.
  */
- class PlayableAudioFile : public PlayableData
+class ROSEGARDENPRIVATE_EXPORT PlayableAudioFile : public PlayableData
 {
 public:
     PlayableAudioFile(InstrumentId instrumentId,
@@ -137,6 +137,12 @@ public:
     //
     bool updateBuffers() override;
 
+    // Map the file and ask the kernel to start reading from where
+    // playback will begin, without taking any ring buffers.  Used by
+    // AudioFileReader for files that start soon.
+    //
+    bool prefetch() override;
+
     // Has fillBuffers been called and completed yet?
     //
     bool isBuffered() const override
@@ -177,23 +183,44 @@ private:
     PlayableAudioFile &operator=(const PlayableAudioFile &);
 
     void initialise(size_t bufferSize, size_t smallFileSize);
-    void checkSmallFileCache(size_t smallFileSize);
+    /// Get every block of a small file, to hold for as long as we play.
+    void loadSmallFile(size_t smallFileSize);
+    /// Map the file for reading if we haven't already.
+    bool map();
+    /// A block of decoded samples, from AudioCache if it has it,
+    /// otherwise decoded from the file and added to AudioCache.
+    AudioCache::BlockPtr getBlock(size_t block);
+    /// The frame in the file at the source sample rate.
+    size_t toSourceFrame(size_t targetFrame) const;
     bool scanTo(const RealTime &time);
+    /// Ask for the next stretch of the file to be read in the background.
+    void readAhead();
     void returnRingBuffers();
 
     RealTime              m_startTime;
     RealTime              m_startIndex;
     RealTime              m_duration;
 
-    // Performance file handle - must open non-blocking to
-    // allow other potential PlayableAudioFiles access to
-    // the same file.
-    //
-    std::ifstream        *m_file;
+    /// The file, mapped into memory.  See map().
+    AudioFileMapping     *m_mapping;
+
+    /// How far we have decoded, in bytes from the start of the sample
+    /// data in m_mapping.  For readAhead().
+    size_t                m_readPosition;
+
+    /// How far we have asked the kernel to read ahead.  See readAhead().
+    size_t                m_readAheadPosition;
 
     // AudioFile handle
     //
     AudioFile            *m_audioFile;
+
+    /// The file the samples are read from.
+    /**
+     * m_audioFile, or a copy of it that is already at our target rate and
+     * channels if ResampledAudioFiles has one.
+     */
+    AudioFile            *m_readFile;
     unsigned int getSourceChannels() const;
     unsigned int getSourceSampleRate() const;
     unsigned int getBytesPerFrame() const;
@@ -210,27 +237,32 @@ private:
     int                   m_runtimeSegmentId = -1;
 
 
-    static AudioCache     m_smallFileCache;
     bool                  m_isSmallFile;
 
-    static std::vector<sample_t *> m_workBuffers;
-    static size_t m_workBufferSize;
-
+    /// Every block of a small file.  See loadSmallFile().
     /**
-     * m_workBuffers is used by the AudioThread and the SequencerThread,
-     * so it needs synchronization.
+     * Holding them stops AudioCache from dropping them, so addSamples()
+     * can read them without locking.
      */
-    static QMutex m_workBuffersMutex;
-    static void clearWorkBuffers();
+    std::vector<AudioCache::BlockPtr> m_smallFileBlocks;
 
-    static char          *m_rawFileBuffer;
-    static size_t         m_rawFileBufferSize;
+    /// Length of the file in frames at the target sample rate.
+    size_t                m_totalFrames;
+
+    /// Samples being faded on their way to m_ringBuffers.
+    /**
+     * One per target channel, a_decodeBlockFrames long.  Each
+     * PlayableAudioFile has its own so that files can be read
+     * concurrently.
+     */
+    std::vector<sample_t *> m_decodeBuffers;
 
     RingBuffer<sample_t>  **m_ringBuffers;
     static RingBufferPool  *m_ringBufferPool;
 
     RealTime              m_currentScanPoint;
-    size_t                m_smallFileScanFrame;
+    /// m_currentScanPoint in frames at the target sample rate.
+    size_t                m_scanFrame;
 
     bool m_autoFade = false;
     RealTime m_fadeInTime;
@@ -63,6 +63,13 @@ public:
 
     virtual bool updateBuffers() = 0;
 
+    /// Start reading in the beginning of the data, ahead of fillBuffers().
+    /**
+     * Returns true if there was anything to do.  Like fillBuffers(), only
+     * to be called from the file reader thread.
+     */
+    virtual bool prefetch() { return false; }
+
     virtual InstrumentId getInstrument() const = 0;
 
     virtual AudioFile* getAudioFile() const = 0;
@@ -16,10 +16,15 @@
 #define RG_MODULE_STRING "[RIFFAudioFile]"
 
 #include "RIFFAudioFile.h"
+#include "AudioFileMapping.h"
 #include "base/RealTime.h"
 #include "misc/Strings.h"
 #include "misc/Debug.h"
 
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
 //#define DEBUG_RIFF
 
 // Constants related to RIFF/WAV files
@@ -311,6 +316,66 @@ RIFFAudioFile::getSampleFrameSlice(const RealTime &time)
     }
 }
 
+AudioFileMapping *
+RIFFAudioFile::map()
+{
+    std::unique_ptr<AudioFileMapping> mapping(
+            new AudioFileMapping(m_absoluteFilePath));
+    if (!mapping->isValid())
+        return nullptr;
+
+    const unsigned char *data = mapping->getFileData();
+    const size_t size = mapping->getFileSize();
+
+    auto littleEndian = [data](size_t offset) {
+        return uint32_t(data[offset]) |
+               uint32_t(data[offset + 1]) << 8 |
+               uint32_t(data[offset + 2]) << 16 |
+               uint32_t(data[offset + 3]) << 24;
+    };
+
+    // Same walk as scanTo(): past the RIFF header and the format chunk,
+    // then chunk by chunk until we find the data.
+    if (size < 20) {
+        RG_WARNING << "map(): file too short:" << m_absoluteFilePath;
+        return nullptr;
+    }
+
+    size_t offset = 20 + size_t(littleEndian(16));
+
+    while (offset + 8 <= size) {
+
+        const size_t chunkLength = littleEndian(offset + 4);
+
+        if (memcmp(data + offset, "data", 4) == 0) {
+            size_t bytes = chunkLength;
+            // A length of zero means the header was never updated,
+            // e.g. after a crash while recording.  Play the lot.
+            if (bytes == 0  ||  bytes > size - (offset + 8))
+                bytes = size - (offset + 8);
+            // Whole frames only.
+            if (m_bytesPerFrame > 0)
+                bytes -= bytes % m_bytesPerFrame;
+
+            mapping->setSampleData(offset + 8, bytes);
+            return mapping.release();
+        }
+
+#ifdef DEBUG_RIFF
+        RG_DEBUG << "map(): skipping chunk: " << std::string((const char *)data + offset, 4);
+#endif
+
+        if (chunkLength > size - (offset + 8))
+            break;
+
+        // Chunks are word aligned.
+        offset += 8 + chunkLength + (chunkLength & 1);
+    }
+
+    RG_WARNING << "map(): failed to find data in" << m_absoluteFilePath;
+    return nullptr;
+}
+
 RealTime
 RIFFAudioFile::getLength()
 {
@@ -105,6 +105,10 @@ public:
                                             const RealTime &time) override;
     virtual std::string getSampleFrameSlice(const RealTime &time);
 
+    // Map the file and find the data chunk in it.
+    //
+    AudioFileMapping *map() override;
+
     // Append a string of samples to an already open (for writing)
     // audio file.
     //
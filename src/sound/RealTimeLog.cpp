@@ -0,0 +1,211 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[RealTimeLog]"
+
+#include "RealTimeLog.h"
+
+#include "misc/Debug.h"
+
+#include <QAtomicInt>
+
+#include <time.h>
+
+
+namespace Rosegarden
+{
+
+
+namespace
+{
+
+    // Enough for the JACK callback, the mixers, the file reader and
+    // writer and a full AudioWorkerPool.
+    constexpr int a_channelCount = 32;
+    // Per thread.  Must be a power of two.
+    constexpr int a_channelSize = 256;
+
+    struct Channel
+    {
+        /// Non-zero while a thread has claimed this channel.
+        QAtomicInt owned;
+        /// Written only by the owning thread.
+        QAtomicInt writeIndex;
+        /// Written only by the reader.
+        QAtomicInt readIndex;
+        /// Incremented by the owning thread, taken by the reader.
+        QAtomicInt dropped;
+
+        RealTimeLog::Message messages[a_channelSize];
+    };
+
+    Channel channels[a_channelCount];
+
+    /// Messages dropped because there was no free channel.
+    QAtomicInt noChannelDropped;
+
+    /// Index into channels of this thread's channel, or -1 for none.
+    /**
+     * A plain int rather than something with a destructor, so that
+     * nothing runs for it when a thread exits (some RT threads, JACK's
+     * among them, are created and ended by code we don't control) and
+     * accessing it needs no guard.  registerThread() and
+     * unregisterThread() set it.
+     */
+    thread_local int channelIndex = -1;
+
+    RealTime now()
+    {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return RealTime(int(ts.tv_sec), int(ts.tv_nsec));
+    }
+
+}
+
+bool
+RealTimeLog::registerThread()
+{
+    if (channelIndex >= 0)
+        return true;
+
+    for (int i = 0; i < a_channelCount; ++i) {
+        if (channels[i].owned.testAndSetOrdered(0, 1)) {
+            channelIndex = i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void
+RealTimeLog::unregisterThread()
+{
+    releaseChannel(channelIndex);
+    channelIndex = -1;
+}
+
+int
+RealTimeLog::getThreadChannel()
+{
+    return channelIndex;
+}
+
+void
+RealTimeLog::releaseChannel(int channel)
+{
+    if (channel < 0  ||  channel >= a_channelCount)
+        return;
+
+    // Anything still in the ring is read as usual.  The next owner
+    // carries on after it.
+    channels[channel].owned.storeRelease(0);
+}
+
+void
+RealTimeLog::write(const char *format, int argCount, const long long *args)
+{
+    // Needs to be RT safe
+
+    if (channelIndex < 0) {
+        noChannelDropped.fetchAndAddOrdered(1);
+        return;
+    }
+
+    Channel *channel = &channels[channelIndex];
+
+    const int writeIndex = channel->writeIndex.loadAcquire();
+    const int readIndex = channel->readIndex.loadAcquire();
+
+    // One slot is always left empty to tell full from empty.
+    if (((writeIndex + 1) & (a_channelSize - 1)) == readIndex) {
+        channel->dropped.fetchAndAddOrdered(1);
+        return;
+    }
+
+    Message &message = channel->messages[writeIndex];
+    message.format = format;
+    message.argCount = argCount;
+    for (int i = 0; i < argCount; ++i)
+        message.args[i] = args[i];
+    message.time = now();
+
+    channel->writeIndex.storeRelease((writeIndex + 1) & (a_channelSize - 1));
+}
+
+bool
+RealTimeLog::read(Message &message)
+{
+    for (int i = 0; i < a_channelCount; ++i) {
+        Channel &channel = channels[i];
+
+        const int readIndex = channel.readIndex.loadAcquire();
+        if (readIndex == channel.writeIndex.loadAcquire())
+            continue;
+
+        message = channel.messages[readIndex];
+        channel.readIndex.storeRelease((readIndex + 1) & (a_channelSize - 1));
+        return true;
+    }
+
+    return false;
+}
+
+int
+RealTimeLog::takeDroppedCount()
+{
+    int dropped = noChannelDropped.fetchAndStoreOrdered(0);
+    for (int i = 0; i < a_channelCount; ++i) {
+        dropped += channels[i].dropped.fetchAndStoreOrdered(0);
+    }
+    return dropped;
+}
+
+QString
+RealTimeLog::toString(const Message &message)
+{
+    QString text(message.format);
+    for (int i = 0; i < message.argCount; ++i) {
+        text = text.arg(message.args[i]);
+    }
+    return text;
+}
+
+int
+RealTimeLog::drain()
+{
+    int count = 0;
+
+    Message message;
+    while (read(message)) {
+        // The message carries the logging module's RG_MODULE_STRING, so
+        // not RG_WARNING, which would add ours.
+        QDebug(QtDebugMsg) << qPrintable(toString(message))
+                           << "(at" << message.time.toText().c_str() << ")";
+        ++count;
+    }
+
+    const int dropped = takeDroppedCount();
+    if (dropped > 0) {
+        RG_WARNING << "drain(): WARNING:" << dropped
+                   << "real-time log messages dropped";
+    }
+
+    return count;
+}
+
+
+}
@@ -0,0 +1,143 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_REAL_TIME_LOG_H
+#define RG_REAL_TIME_LOG_H
+
+#include "base/RealTime.h"
+
+#include <QString>
+
+#include <rosegardenprivate_export.h>
+
+
+namespace Rosegarden
+{
+
+
+/// Log from an RT thread.
+/**
+ * The RT safe counterpart of RG_WARNING (and of std::cerr debug tracing)
+ * for the JACK process callback and the mixer threads.  The message must
+ * be a string literal, with %1 to %4 standing for the integer arguments
+ * that follow it.  E.g.:
+ *
+ *   RG_RT_LOG("jackProcess(): WARNING: read %1 of %2 frames",
+ *             actual, nframes);
+ *
+ * The message goes to the debug output, with RG_MODULE_STRING in front
+ * as usual, when RealTimeLog::drain() next runs on the sequencer thread.
+ */
+#define RG_RT_LOG(message, ...) \
+    Rosegarden::RealTimeLog::log(RG_MODULE_STRING " " message, ##__VA_ARGS__)
+
+/// Lock-free logging for RT threads.
+/**
+ * RG_WARNING and std::cerr allocate and lock, which is enough to cause
+ * xruns when they are used from the JACK process callback.  Instead,
+ * RT threads write fixed-size records (message, arguments, timestamp)
+ * into a preallocated single-producer/single-consumer ring, and a non-RT
+ * thread formats and prints them later.
+ *
+ * Each thread that logs gets a ring of its own, claimed from a fixed set
+ * by registerThread() when the thread starts and released by
+ * unregisterThread() before it ends, so producers never contend with
+ * each other.  A thread that is ended by code we don't control (JACK's,
+ * for one) has its ring released by releaseChannel() once it is gone.  If a thread's ring is full, or the thread has no ring
+ * (it didn't register, or all the rings were taken), the message is
+ * dropped and counted.  The count is reported with the next drain.
+ *
+ * log() never blocks or allocates.  read() and drain() must only be
+ * called from one thread at a time; SequencerThread drains the log on
+ * every pass of its loop.
+ */
+class ROSEGARDENPRIVATE_EXPORT RealTimeLog
+{
+public:
+    static const int MaxArgs = 4;
+
+    struct Message
+    {
+        /// A string literal, so only the pointer needs copying.
+        const char *format;
+        int argCount;
+        long long args[MaxArgs];
+        /// CLOCK_MONOTONIC at the time of the log() call.
+        RealTime time;
+    };
+
+    /// Claim a ring for the calling thread, so that it can log.
+    /**
+     * Call at the start of a thread that logs.  RT safe.  Calling again
+     * does nothing.  Returns false if all the rings are taken.
+     */
+    static bool registerThread();
+
+    /// Release the calling thread's ring for another thread to use.
+    /**
+     * Call before a registered thread ends.  RT safe.
+     */
+    static void unregisterThread();
+
+    /// The calling thread's ring, or -1 if it has none.  RT safe.
+    static int getThreadChannel();
+
+    /// Release a ring claimed by a thread that has since ended.
+    /**
+     * For threads that can't call unregisterThread() themselves.  Save
+     * getThreadChannel() when the thread starts, and call this with it
+     * once the thread is known to have ended.  Does nothing for -1.
+     */
+    static void releaseChannel(int channel);
+
+    /// Log a message with up to MaxArgs integer arguments.  RT safe.
+    template <typename... Args>
+    static void log(const char *format, Args... args)
+    {
+        static_assert(sizeof...(args) <= MaxArgs,
+                      "RealTimeLog: too many arguments");
+        // Leading 0 so that the array is never empty.
+        const long long values[] = { 0, static_cast<long long>(args)... };
+        write(format, int(sizeof...(args)), values + 1);
+    }
+
+    /// Get the next logged message, from any thread.
+    /**
+     * Messages from the same thread come out in order.  There is no
+     * ordering between threads; compare the times if it matters.
+     */
+    static bool read(Message &message);
+
+    /// Messages dropped since the last call.
+    static int takeDroppedCount();
+
+    /// The message with its arguments filled in.
+    static QString toString(const Message &message);
+
+    /// Send everything logged so far to RG_WARNING.
+    /**
+     * Returns the number of messages written.
+     */
+    static int drain();
+
+private:
+    static void write(const char *format, int argCount,
+                      const long long *args);
+};
+
+
+}
+
+#endif
@@ -0,0 +1,202 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[ResampledAudioFiles]"
+
+#include "ResampledAudioFiles.h"
+
+#include "WAVAudioFile.h"
+#include "misc/Debug.h"
+#include "misc/Strings.h"  // qstrtostr()
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+//#define DEBUG_RESAMPLED_AUDIO_FILES 1
+
+namespace Rosegarden
+{
+
+
+namespace
+{
+    // How much of the source goes into the fingerprint.
+    constexpr qint64 a_fingerprintBytes = 64 * 1024;
+
+    // Hex digits of the fingerprint to put in the name.
+    constexpr int a_fingerprintLength = 12;
+}
+
+ResampledAudioFiles *
+ResampledAudioFiles::getInstance()
+{
+    // Guaranteed in C++11 to be lazy initialized and thread-safe.
+    // See ISO/IEC 14882:2011 6.7(4).  The resampler and the sequencer
+    // thread can both be first here.
+    //
+    // Never deleted, as the disk thread may still be reading a copy as
+    // we go down.
+    static ResampledAudioFiles *instance = new ResampledAudioFiles;
+    return instance;
+}
+
+bool
+ResampledAudioFiles::Key::operator<(const Key &other) const
+{
+    if (sampleRate != other.sampleRate)
+        return sampleRate < other.sampleRate;
+    if (channels != other.channels)
+        return channels < other.channels;
+    return sourcePath < other.sourcePath;
+}
+
+QString
+ResampledAudioFiles::getCopyPath(const QString &sourcePath,
+                                 int sampleRate,
+                                 int channels)
+{
+    QFile source(sourcePath);
+    if (!source.open(QIODevice::ReadOnly))
+        return QString();
+
+    const QFileInfo info(sourcePath);
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(QByteArray::number(info.size()));
+    hash.addData(QByteArray::number(info.lastModified().toMSecsSinceEpoch()));
+    hash.addData(source.read(a_fingerprintBytes));
+
+    const QString fingerprint =
+            QString::fromLatin1(hash.result().toHex().left(a_fingerprintLength));
+
+    return QString("%1.%2-%3-%4.rs.wav")
+            .arg(info.absoluteFilePath())
+            .arg(fingerprint)
+            .arg(sampleRate)
+            .arg(channels);
+}
+
+bool
+ResampledAudioFiles::add(const QString &sourcePath,
+                         int sampleRate,
+                         int channels,
+                         const QString &copyPath)
+{
+    // Open it before taking the lock.  find() is called by the
+    // sequencer thread.
+    WAVAudioFile *copy = new WAVAudioFile(
+            0, qstrtostr(QFileInfo(copyPath).fileName()), copyPath);
+
+    if (!copy->open()  ||
+        int(copy->getSampleRate()) != sampleRate  ||
+        int(copy->getChannels()) != channels) {
+        RG_WARNING << "add(): Can't use" << copyPath;
+        delete copy;
+        return false;
+    }
+
+#ifdef DEBUG_RESAMPLED_AUDIO_FILES
+    RG_DEBUG << "add(): " << sourcePath << " at " << sampleRate << "Hz, " << channels << " channels: " << copyPath;
+#endif
+
+    const QFileInfo sourceInfo(sourcePath);
+    const Copy entry{copy,
+                     sourceInfo.size(),
+                     sourceInfo.lastModified().toMSecsSinceEpoch()};
+
+    QMutexLocker locker(&m_mutex);
+
+    const Key key{sourcePath, sampleRate, channels};
+
+    CopyMap::iterator i = m_copies.find(key);
+    if (i == m_copies.end()) {
+        m_copies.insert(CopyMap::value_type(key, entry));
+    } else {
+        m_replaced.push_back(std::make_pair(sourcePath, i->second.file));
+        i->second = entry;
+    }
+
+    return true;
+}
+
+AudioFile *
+ResampledAudioFiles::find(const QString &sourcePath,
+                          int sampleRate,
+                          int channels)
+{
+    // Before taking the lock, as add() does.
+    const QFileInfo sourceInfo(sourcePath);
+    const qint64 sourceSize = sourceInfo.size();
+    const qint64 sourceModified = sourceInfo.lastModified().toMSecsSinceEpoch();
+
+    QMutexLocker locker(&m_mutex);
+
+    CopyMap::iterator i =
+            m_copies.find(Key{sourcePath, sampleRate, channels});
+    if (i == m_copies.end())
+        return nullptr;
+
+    // Edited since the copy was made.
+    if (i->second.sourceSize != sourceSize  ||
+        i->second.sourceModified != sourceModified) {
+#ifdef DEBUG_RESAMPLED_AUDIO_FILES
+        RG_DEBUG << "find(): " << sourcePath << " has changed, not using " << i->second.file->getAbsoluteFilePath();
+#endif
+        m_replaced.push_back(std::make_pair(sourcePath, i->second.file));
+        m_copies.erase(i);
+        return nullptr;
+    }
+
+    return i->second.file;
+}
+
+void
+ResampledAudioFiles::forget(const QString &sourcePath)
+{
+    std::vector<AudioFile *> files;
+
+    {
+        QMutexLocker locker(&m_mutex);
+
+        for (CopyMap::iterator i = m_copies.begin(); i != m_copies.end(); ) {
+            if (i->first.sourcePath == sourcePath) {
+                files.push_back(i->second.file);
+                i = m_copies.erase(i);
+            } else {
+                ++i;
+            }
+        }
+
+        std::vector<std::pair<QString, AudioFile *>> kept;
+        for (const std::pair<QString, AudioFile *> &replaced : m_replaced) {
+            if (replaced.first == sourcePath)
+                files.push_back(replaced.second);
+            else
+                kept.push_back(replaced);
+        }
+        m_replaced.swap(kept);
+    }
+
+    // Outside the lock.  ~AudioFile() goes to AudioCache.
+    for (AudioFile *file : files) {
+        delete file;
+    }
+}
+
+
+}
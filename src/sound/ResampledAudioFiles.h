@@ -0,0 +1,134 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#ifndef RG_RESAMPLED_AUDIO_FILES_H
+#define RG_RESAMPLED_AUDIO_FILES_H
+
+#include <QMutex>
+#include <QString>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <rosegardenprivate_export.h>
+
+namespace Rosegarden
+{
+
+
+class AudioFile;
+
+
+/// Copies of audio files already at the rate and channels they play at.
+/**
+ * When a file's sample rate differs from the sequencer's, every
+ * PlayableAudioFile has to convert it as it reads.  AudioFileResampler
+ * makes copies at the sequencer's rate in the background and registers
+ * them here, and PlayableAudioFile reads a registered copy instead when
+ * there is one.
+ *
+ * Copies are WAV files kept next to their source and its peak file.
+ * Their names include a fingerprint of the source (see getCopyPath()),
+ * so they last from one session to the next, but a source that has
+ * changed won't find an old copy.
+ *
+ * There is one of these per process, shared by the GUI and the
+ * sequencer thread.  It is thread-safe.
+ */
+class ROSEGARDENPRIVATE_EXPORT ResampledAudioFiles
+{
+public:
+    static ResampledAudioFiles *getInstance();
+
+    /// Where the copy of sourcePath at this rate and channel count goes.
+    /**
+     * The name is the source's name, a fingerprint of its size,
+     * modification time and first 64KB, then the rate and channels.
+     * E.g. "take1.wav.3fa9c1e20b7d-48000-2.rs.wav".
+     *
+     * Returns an empty string if the source can't be read.  This reads
+     * from the source, so avoid it on the RT threads.
+     */
+    static QString getCopyPath(const QString &sourcePath,
+                               int sampleRate,
+                               int channels);
+
+    /// Read copyPath in place of sourcePath from now on.
+    /**
+     * Returns false, and leaves things as they were, if copyPath can't
+     * be opened or isn't at the given rate and channels.
+     */
+    bool add(const QString &sourcePath,
+             int sampleRate,
+             int channels,
+             const QString &copyPath);
+
+    /// The copy to read in place of sourcePath, or nullptr if there isn't one.
+    /**
+     * If sourcePath's size or modification time is not what it was when
+     * the copy was added, the copy is out of date and is dropped.
+     *
+     * The copy stays valid until forget() is called for sourcePath, even
+     * if add() replaces it with another.
+     */
+    AudioFile *find(const QString &sourcePath, int sampleRate, int channels);
+
+    /// Close and drop all copies of sourcePath.
+    /**
+     * AudioFileManager::clear() calls this for each of its files when a
+     * document is closed, by which time nothing is reading them.
+     */
+    void forget(const QString &sourcePath);
+
+private:
+    ResampledAudioFiles()  { }
+
+    // Hide copy ctor and op=.
+    ResampledAudioFiles(const ResampledAudioFiles &);
+    ResampledAudioFiles &operator=(const ResampledAudioFiles &);
+
+    struct Key
+    {
+        QString sourcePath;
+        int sampleRate;
+        int channels;
+
+        bool operator<(const Key &other) const;
+    };
+
+    struct Copy
+    {
+        AudioFile *file;
+
+        // The source when the copy was added, to tell if it has changed.
+        qint64 sourceSize;
+        qint64 sourceModified;
+    };
+
+    typedef std::map<Key, Copy> CopyMap;
+    CopyMap m_copies;
+
+    /// Copies that have been replaced or are out of date, kept for anyone
+    /// still reading them.  By source path, for forget().
+    std::vector<std::pair<QString, AudioFile *>> m_replaced;
+
+    QMutex m_mutex;
+};
+
+
+}
+
+#endif
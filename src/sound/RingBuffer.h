@@ -21,6 +21,7 @@
 #include <string.h>
 
 #include "Scavenger.h"
+#include "AudioKernels.h"
 
 //#define DEBUG_RINGBUFFER 1
 //#define DEBUG_RINGBUFFER_CREATE_DESTROY 1
@@ -39,6 +40,23 @@ static int extant_ringbuffers = 0;
 
 namespace Rosegarden {
 
+namespace RingBufferDetail
+{
+    // For readAdding().  Samples get the vectorised version.
+    template <typename T>
+    inline void add(T *destination, const T *source, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i) {
+            destination[i] += source[i];
+        }
+    }
+
+    inline void add(float *destination, const float *source, size_t n)
+    {
+        AudioKernels::add(destination, source, n);
+    }
+}
+
 /**
  * RingBuffer implements a lock-free ring buffer for one writer and N
  * readers, that is to be used to store a sample type T.
@@ -439,16 +457,10 @@ RingBuffer<T, N>::readAdding(T *destination, size_t n, int R)
     size_t here = m_size - m_readers[R];
 
     if (here >= n) {
-        for (size_t i = 0; i < n; ++i) {
-            destination[i] += (m_buffer + m_readers[R])[i];
-        }
+        RingBufferDetail::add(destination, m_buffer + m_readers[R], n);
     } else {
-        for (size_t i = 0; i < here; ++i) {
-            destination[i] += (m_buffer + m_readers[R])[i];
-        }
-        for (size_t i = 0; i < (n - here); ++i) {
-            destination[i + here] += m_buffer[i];
-        }
+        RingBufferDetail::add(destination, m_buffer + m_readers[R], here);
+        RingBufferDetail::add(destination + here, m_buffer, n - here);
     }
 
     m_readers[R] = (m_readers[R] + n) % m_size;
@@ -92,6 +92,15 @@ public:
     virtual bool isBypassed() const = 0;
     virtual void setBypassed(bool value) = 0;
 
+    /**
+     * Return false if run() touches state shared with other instances,
+     * so that it must not be called at the same time as run() on any
+     * other plugin.  The mixer processes such instruments on a single
+     * thread.  LV2PluginInstance is only concurrent when it is known
+     * to be safe.
+     */
+    virtual bool canRunConcurrently() const { return true; }
+
     // This should be called after setup, but while not actually playing.
     virtual size_t getLatency() = 0;
 
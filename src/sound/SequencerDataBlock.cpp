@@ -22,6 +22,8 @@
 
 #include <QMutexLocker>
 
+#include <algorithm>
+
 namespace Rosegarden
 {
 
@@ -177,6 +179,7 @@ SequencerDataBlock::getInstrumentLevel(InstrumentId id,
     int index = instrumentToIndex(id);
     if (index < 0) {
         info.level = info.levelRight = 0;
+        info.rms = info.rmsRight = 0;
         return false;
     }
 
@@ -208,6 +211,7 @@ SequencerDataBlock::getInstrumentLevelForMixer(InstrumentId id,
     int index = instrumentToIndex(id);
     if (index < 0) {
         info.level = info.levelRight = 0;
+        info.rms = info.rmsRight = 0;
         return false;
     }
 
@@ -243,6 +247,7 @@ SequencerDataBlock::getInstrumentRecordLevel(InstrumentId id, LevelInfo &info) c
     int index = instrumentToIndex(id);
     if (index < 0) {
         info.level = info.levelRight = 0;
+        info.rms = info.rmsRight = 0;
         return false;
     }
 
@@ -267,6 +272,7 @@ SequencerDataBlock::getInstrumentRecordLevelForMixer(InstrumentId id, LevelInfo
     int index = instrumentToIndex(id);
     if (index < 0) {
         info.level = info.levelRight = 0;
+        info.rms = info.rmsRight = 0;
         return false;
     }
 
@@ -321,6 +327,7 @@ SequencerDataBlock::getSubmasterLevel(int submaster, LevelInfo &info) const
 
     if (submaster < 0 || submaster >= SEQUENCER_DATABLOCK_MAX_NB_SUBMASTERS) {
         info.level = info.levelRight = 0;
+        info.rms = info.rmsRight = 0;
         return false;
     }
 
@@ -371,6 +378,152 @@ SequencerDataBlock::setMasterLevel(const LevelInfo &info)
     ++m_masterLevelUpdateIndex;
 }
 
+void
+SequencerDataBlock::addPeriod(int usec, int budgetUsec)
+{
+    // Needs to be RT safe
+
+    m_periods.fetchAndAddOrdered(1);
+    m_periodBudgetUsec.storeRelease(budgetUsec);
+
+    if (usec > m_maxPeriodUsec.loadAcquire())
+        m_maxPeriodUsec.storeRelease(usec);
+
+    if (usec > budgetUsec)
+        m_deadlineMisses.fetchAndAddOrdered(1);
+
+    int bucket = SEQUENCER_DATABLOCK_PERIOD_BUCKETS - 1;
+    if (budgetUsec > 0)
+        bucket = std::min(int(long(usec) * 10 / budgetUsec), bucket);
+    m_periodHistogram[std::max(bucket, 0)].fetchAndAddOrdered(1);
+}
+
+void
+SequencerDataBlock::addXRun()
+{
+    m_xruns.fetchAndAddOrdered(1);
+}
+
+void
+SequencerDataBlock::addMixUnderrun()
+{
+    m_mixUnderruns.fetchAndAddOrdered(1);
+}
+
+void
+SequencerDataBlock::addBussMixUnderrun()
+{
+    m_bussMixUnderruns.fetchAndAddOrdered(1);
+}
+
+void
+SequencerDataBlock::getPeriodPerformance(PeriodPerformance &info) const
+{
+    info.periods = m_periods.loadAcquire();
+    info.budgetUsec = m_periodBudgetUsec.loadAcquire();
+    info.maxUsec = m_maxPeriodUsec.loadAcquire();
+    info.deadlineMisses = m_deadlineMisses.loadAcquire();
+    info.xruns = m_xruns.loadAcquire();
+    info.mixUnderruns = m_mixUnderruns.loadAcquire();
+    info.bussMixUnderruns = m_bussMixUnderruns.loadAcquire();
+
+    for (int i = 0; i < SEQUENCER_DATABLOCK_PERIOD_BUCKETS; ++i) {
+        info.histogram[i] = m_periodHistogram[i].loadAcquire();
+    }
+}
+
+void
+SequencerDataBlock::setInstrumentPerformance(InstrumentId id,
+                                             int usec,
+                                             int synthUsec,
+                                             const int *pluginUsec,
+                                             int underruns)
+{
+    // Needs to be RT safe
+
+    const int count = m_instrumentCounterCount.loadAcquire();
+
+    // The mixer goes through its instruments in the same order every
+    // pass, so this is nearly always found at the first try.
+    int index = -1;
+    for (int i = 0; i < count; ++i) {
+        const int candidate = (m_instrumentCounterHint + i) % count;
+        if (m_instrumentCounters[candidate].id.loadAcquire() == int(id)) {
+            index = candidate;
+            break;
+        }
+    }
+
+    if (index < 0) {
+        if (count == SEQUENCER_DATABLOCK_MAX_NB_INSTRUMENTS)
+            return;
+        index = count;
+        m_instrumentCounters[index].id.storeRelease(int(id));
+        m_instrumentCounterCount.storeRelease(count + 1);
+    }
+
+    m_instrumentCounterHint = index + 1;
+
+    InstrumentCounters &counters = m_instrumentCounters[index];
+
+    counters.usec.storeRelease(usec);
+    if (usec > counters.peakUsec.loadAcquire())
+        counters.peakUsec.storeRelease(usec);
+    counters.synthUsec.storeRelease(synthUsec);
+    for (unsigned i = 0; i < PluginContainer::PLUGIN_COUNT; ++i) {
+        counters.pluginUsec[i].storeRelease(pluginUsec[i]);
+    }
+    if (underruns > 0)
+        counters.underruns.fetchAndAddOrdered(underruns);
+}
+
+int
+SequencerDataBlock::getInstrumentPerformanceCount() const
+{
+    return m_instrumentCounterCount.loadAcquire();
+}
+
+void
+SequencerDataBlock::getInstrumentPerformance(
+        int index, InstrumentPerformance &info) const
+{
+    const InstrumentCounters &counters = m_instrumentCounters[index];
+
+    info.id = InstrumentId(counters.id.loadAcquire());
+    info.usec = counters.usec.loadAcquire();
+    info.peakUsec = counters.peakUsec.loadAcquire();
+    info.synthUsec = counters.synthUsec.loadAcquire();
+    for (unsigned i = 0; i < PluginContainer::PLUGIN_COUNT; ++i) {
+        info.pluginUsec[i] = counters.pluginUsec[i].loadAcquire();
+    }
+    info.underruns = counters.underruns.loadAcquire();
+}
+
+void
+SequencerDataBlock::resetPerformanceCounters()
+{
+    // The writers may be adding to these as we go.  Losing the odd
+    // update either side of a reset doesn't matter.
+
+    m_periods.storeRelease(0);
+    m_maxPeriodUsec.storeRelease(0);
+    m_deadlineMisses.storeRelease(0);
+    m_xruns.storeRelease(0);
+    m_mixUnderruns.storeRelease(0);
+    m_bussMixUnderruns.storeRelease(0);
+
+    for (int i = 0; i < SEQUENCER_DATABLOCK_PERIOD_BUCKETS; ++i) {
+        m_periodHistogram[i].storeRelease(0);
+    }
+
+    // Keep the instruments, just zero their totals.
+    const int count = m_instrumentCounterCount.loadAcquire();
+    for (int i = 0; i < count; ++i) {
+        m_instrumentCounters[i].peakUsec.storeRelease(0);
+        m_instrumentCounters[i].underruns.storeRelease(0);
+    }
+}
+
 void
 SequencerDataBlock::clearTemporaries()
 {
@@ -402,6 +555,11 @@ SequencerDataBlock::clearTemporaries()
     m_masterLevelUpdateIndex = 0;
     m_masterLevel.level = 0;
     m_masterLevel.levelRight = 0;
+
+    resetPerformanceCounters();
+    m_periodBudgetUsec.storeRelease(0);
+    m_instrumentCounterCount.storeRelease(0);
+    m_instrumentCounterHint = 0;
 }
 
 }
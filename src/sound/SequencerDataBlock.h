@@ -19,9 +19,13 @@
 #include "ControlBlock.h"
 #include "base/RealTime.h"
 #include "MappedEvent.h"
+#include "base/PluginContainer.h"
 
+#include <QAtomicInt>
 #include <QMutex>
 
+#include <rosegardenprivate_export.h>
+
 namespace Rosegarden
 {
 
@@ -36,6 +40,9 @@ struct LevelInfo
 {
     int level;
     int levelRight; // if stereo audio
+    /// RMS over the last block, on the same scale as level.  Audio only.
+    int rms;
+    int rmsRight;
 };
 
 class MappedEventList;
@@ -44,6 +51,46 @@ class MappedEventList;
 #define SEQUENCER_DATABLOCK_MAX_NB_INSTRUMENTS 512 // can't be a symbol
 #define SEQUENCER_DATABLOCK_MAX_NB_SUBMASTERS   64 // can't be a symbol
 #define SEQUENCER_DATABLOCK_RECORD_BUFFER_SIZE 1024 // MIDI events
+#define SEQUENCER_DATABLOCK_PERIOD_BUCKETS 20
+
+/// JACK process callback timings.  See SequencerDataBlock::addPeriod().
+struct PeriodPerformance
+{
+    /// Number of periods since the counters were last reset.
+    int periods;
+    /// The deadline for one period, in microseconds.
+    int budgetUsec;
+    /// The longest period, in microseconds.
+    int maxUsec;
+    /// Periods that took longer than budgetUsec.
+    int deadlineMisses;
+    /// As reported by JACK.
+    int xruns;
+    /// Instrument ring buffers that were short in the process callback.
+    int mixUnderruns;
+    /// Buss ring buffers that were short in the process callback.
+    int bussMixUnderruns;
+    /// Periods by duration, in steps of 10% of budgetUsec.
+    /**
+     * The last bucket also counts everything longer.
+     */
+    int histogram[SEQUENCER_DATABLOCK_PERIOD_BUCKETS];
+};
+
+/// Mixer timings for one audio or synth instrument.
+struct InstrumentPerformance
+{
+    InstrumentId id;
+    /// Files, synth and plugins for the most recent mixer pass.
+    int usec;
+    /// The longest usec since the counters were last reset.
+    int peakUsec;
+    int synthUsec;
+    /// By plugin position.
+    int pluginUsec[PluginContainer::PLUGIN_COUNT];
+    /// Times a playing file's ring buffer couldn't supply a block.
+    int underruns;
+};
 
 /// Holds MIDI data going from RosegardenSequencer to RosegardenMainWindow
 /**
@@ -56,6 +103,9 @@ class MappedEventList;
  * This class needs to be reviewed for thread safety.  See the comments
  * in addRecordedEvents().
  *
+ * It also carries the audio performance counters from JackDriver and
+ * AudioInstrumentMixer to AudioPerformanceDialog.
+ *
  * This used to be mapped into a shared memory
  * backed file, which had to be of fixed size and layout.  The design
  * reflects that history, though nowadays it is a simple singleton
@@ -85,7 +135,7 @@ class MappedEventList;
  *
  * @see ControlBlock
  */
-class SequencerDataBlock
+class ROSEGARDENPRIVATE_EXPORT SequencerDataBlock
 {
 public:
     // Singleton.
@@ -140,6 +190,37 @@ public:
     bool getMasterLevel(LevelInfo &) const;
     void setMasterLevel(const LevelInfo &);
 
+    /// Record the time taken by one JACK process callback.  RT safe.
+    /**
+     * Called by JackDriver at the end of each period.  budgetUsec is the
+     * length of the period, which is the deadline for processing it.
+     */
+    void addPeriod(int usec, int budgetUsec);
+    /// Called by JackDriver when JACK reports an xrun.
+    void addXRun();
+    /// Called by JackDriver when a ring buffer is short.  RT safe.
+    void addMixUnderrun();
+    void addBussMixUnderrun();
+    void getPeriodPerformance(PeriodPerformance &) const;
+
+    /// Record the costs of one mixer pass for an instrument.  RT safe.
+    /**
+     * Called by the live AudioInstrumentMixer, from one thread only.
+     * OfflineRenderer's mixer doesn't call this.  See
+     * AudioInstrumentMixer::setPublishPerformance().  pluginUsec
+     * has PluginContainer::PLUGIN_COUNT entries.  underruns is the number
+     * for this pass, and is added to the running total.
+     */
+    void setInstrumentPerformance(InstrumentId id, int usec, int synthUsec,
+                                  const int *pluginUsec, int underruns);
+    /// Number of instruments with performance counters.
+    int getInstrumentPerformanceCount() const;
+    /// Get the counters for the index'th instrument, in order of appearance.
+    void getInstrumentPerformance(int index, InstrumentPerformance &) const;
+
+    /// Zero all the counters, e.g. from the audio performance dialog.
+    void resetPerformanceCounters();
+
     // Reset this class on (for example) GUI restart
     // rename: reset()
     void clearTemporaries();
@@ -204,6 +285,39 @@ protected:
     // ??? Thread-safe?
     int m_masterLevelUpdateIndex;
     LevelInfo m_masterLevel;
+
+    // Performance counters.  Each is written from one thread and read
+    // from any, so these are atomic rather than "??? Thread-safe?".
+
+    QAtomicInt m_periods;
+    QAtomicInt m_periodBudgetUsec;
+    QAtomicInt m_maxPeriodUsec;
+    QAtomicInt m_deadlineMisses;
+    QAtomicInt m_xruns;
+    QAtomicInt m_mixUnderruns;
+    QAtomicInt m_bussMixUnderruns;
+    QAtomicInt m_periodHistogram[SEQUENCER_DATABLOCK_PERIOD_BUCKETS];
+
+    struct InstrumentCounters
+    {
+        QAtomicInt id;
+        QAtomicInt usec;
+        QAtomicInt peakUsec;
+        QAtomicInt synthUsec;
+        QAtomicInt pluginUsec[PluginContainer::PLUGIN_COUNT];
+        QAtomicInt underruns;
+    };
+
+    /// Appended to by setInstrumentPerformance() only.
+    /**
+     * Not shared with m_knownInstruments since JackDriver adds to that
+     * from another thread.
+     */
+    InstrumentCounters m_instrumentCounters[
+            SEQUENCER_DATABLOCK_MAX_NB_INSTRUMENTS];
+    QAtomicInt m_instrumentCounterCount;
+    /// Where setInstrumentPerformance() expects the next instrument.
+    int m_instrumentCounterHint;
 };
 
 }
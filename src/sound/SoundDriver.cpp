@@ -24,7 +24,8 @@
 #include "AudioPlayQueue.h"
 #include "PlayableAudioFile.h"
 
-#include <unistd.h>  // for usleep()
+#include <QMutexLocker>
+
 #include <sys/time.h>
 #include <pthread.h> // for mutex
 
@@ -44,7 +45,8 @@ SoundDriver::SoundDriver(MappedStudio *studio, const QString &name) :
         m_audioQueue(nullptr),
         m_smallFileSize(0),
         m_audioRecFileFormat(RIFFAudioFile::FLOAT),
-        m_studio(studio)
+        m_studio(studio),
+        m_wakePending(false)
 {
     m_audioQueue = new AudioPlayQueue();
 }
@@ -301,12 +303,25 @@ SoundDriver::clearAudioFiles()
 void
 SoundDriver::sleep(const RealTime &rt)
 {
-    // The usleep man page says it's deprecated and we should use
-    // nanosleep.  And that's what we did.  But it seems quite a few
-    // people don't have nanosleep, so we're reverting to usleep.
+    QMutexLocker locker(&m_sleepMutex);
+
+    if (!m_wakePending  &&  rt > RealTime::zero()) {
+        // Round up so that we don't wake early.
+        const unsigned long msecs =
+                rt.sec * 1000 + (rt.nsec + 999999) / 1000000;
+        m_sleepCondition.wait(&m_sleepMutex, msecs);
+    }
+
+    m_wakePending = false;
+}
+
+void
+SoundDriver::wake()
+{
+    QMutexLocker locker(&m_sleepMutex);
 
-    unsigned long usec = rt.sec * 1000000 + rt.usec();
-    usleep(usec);
+    m_wakePending = true;
+    m_sleepCondition.wakeAll();
 }
 
 
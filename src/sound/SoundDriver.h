@@ -28,8 +28,12 @@
 
 #include "RIFFAudioFile.h"  // For SubFormat enum
 
+#include <QMutex>
 #include <QString>
 #include <QStringList>
+#include <QWaitCondition>
+
+#include <rosegardenprivate_export.h>
 
 #include <set>
 #include <vector>
@@ -75,7 +79,7 @@ class MappedStudio;
  */
 
 // cppcheck-suppress noCopyConstructor
-class SoundDriver
+class ROSEGARDENPRIVATE_EXPORT SoundDriver
 {
 public:
     SoundDriver(MappedStudio *studio, const QString &name);
@@ -168,12 +172,28 @@ public:
 
     virtual void processPending()  { }
 
+    /// How long until the first pending note-off is due.
+    /**
+     * While stopped, processPending() is what sends note-offs, so the
+     * sequencer thread doesn't sleep past this.  Returns false if there
+     * are no note-offs pending.
+     */
+    virtual bool getTimeToNextNoteOff(RealTime & /*untilNoteOff*/)
+            { return false; }
+
     /// Set a loop position at the driver (used for transport)
     virtual void setLoop(const RealTime & /*start*/,
                          const RealTime & /*end*/)  { }
 
+    /// Wait for up to rt, or until wake() is called.
     virtual void sleep(const RealTime &rt);
 
+    /// End a sleep() in progress, or the next one if there isn't one.
+    /**
+     * Safe to call from any thread.  See RosegardenSequencer::wake().
+     */
+    virtual void wake();
+
     // Set MIDI clock interval - allow redefinition above to ensure
     // we handle this reset correctly.
     virtual void setMIDIClockInterval(RealTime interval)
@@ -383,6 +403,14 @@ protected:
     /// Sequencer-side representation of the audio portion of the Studio.
     MappedStudio *m_studio;
 
+private:
+
+    // *** sleep() and wake() ***
+
+    QMutex m_sleepMutex;
+    QWaitCondition m_sleepCondition;
+    bool m_wakePending;
+
 };
 
 
@@ -21,6 +21,8 @@
 
 #include "RIFFAudioFile.h"
 
+#include <rosegardenprivate_export.h>
+
 
 #ifndef RG_WAVAUDIOFILE_H
 #define RG_WAVAUDIOFILE_H
@@ -28,7 +30,7 @@
 namespace Rosegarden
 {
 
-class WAVAudioFile : public RIFFAudioFile
+class ROSEGARDENPRIVATE_EXPORT WAVAudioFile : public RIFFAudioFile
 {
 public:
     WAVAudioFile(const unsigned int &id,
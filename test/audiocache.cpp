@@ -0,0 +1,174 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "sound/AudioCache.h"
+
+#include <QTest>
+
+using namespace Rosegarden;
+
+/// Unit test for AudioCache.
+class TestAudioCache : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testHitAndMiss();
+    void testVariants();
+    void testEviction();
+    void testHeldBlocksStay();
+    void testForget();
+};
+
+namespace
+{
+    // Only ever used as keys.
+    const AudioFile *const a_file1 = reinterpret_cast<const AudioFile *>(16);
+    const AudioFile *const a_file2 = reinterpret_cast<const AudioFile *>(32);
+
+    // Stereo, so 8 bytes a frame.
+    const size_t a_blockBytes = AudioCache::BlockFrames * 2 * sizeof(float);
+
+    std::shared_ptr<AudioCache::Block> makeBlock(float value)
+    {
+        std::shared_ptr<AudioCache::Block> block =
+                std::make_shared<AudioCache::Block>(2, AudioCache::BlockFrames);
+        block->getChannel(0)[0] = value;
+        block->getChannel(1)[AudioCache::BlockFrames - 1] = value;
+        return block;
+    }
+}
+
+void TestAudioCache::testHitAndMiss()
+{
+    AudioCache cache(10 * a_blockBytes);
+
+    QVERIFY(!cache.get(a_file1, 48000, 2, 0));
+    cache.add(a_file1, 48000, 2, 0, makeBlock(1));
+
+    AudioCache::BlockPtr block = cache.get(a_file1, 48000, 2, 0);
+    QVERIFY(block);
+    QCOMPARE(block->getChannel(0)[0], 1.0f);
+    QCOMPARE(block->getChannel(1)[AudioCache::BlockFrames - 1], 1.0f);
+
+    // has() doesn't count.
+    QVERIFY(cache.has(a_file1, 48000, 2, 0));
+
+    AudioCache::Statistics statistics = cache.getStatistics();
+    QCOMPARE(statistics.hits, 1L);
+    QCOMPARE(statistics.misses, 1L);
+    QCOMPARE(statistics.blocks, 1L);
+    QCOMPARE(statistics.bytes, a_blockBytes);
+
+    // Adding it again keeps the first.
+    block = cache.add(a_file1, 48000, 2, 0, makeBlock(2));
+    QCOMPARE(block->getChannel(0)[0], 1.0f);
+    QCOMPARE(cache.getStatistics().blocks, 1L);
+
+    cache.resetStatistics();
+    QCOMPARE(cache.getStatistics().hits, 0L);
+    QCOMPARE(cache.getStatistics().blocks, 1L);
+}
+
+void TestAudioCache::testVariants()
+{
+    AudioCache cache(10 * a_blockBytes);
+
+    cache.add(a_file1, 48000, 2, 0, makeBlock(1));
+    cache.add(a_file1, 44100, 2, 0, makeBlock(2));
+    cache.add(a_file1, 48000, 1, 0, makeBlock(3));
+    cache.add(a_file2, 48000, 2, 0, makeBlock(4));
+
+    QCOMPARE(cache.get(a_file1, 48000, 2, 0)->getChannel(0)[0], 1.0f);
+    QCOMPARE(cache.get(a_file1, 44100, 2, 0)->getChannel(0)[0], 2.0f);
+    QCOMPARE(cache.get(a_file1, 48000, 1, 0)->getChannel(0)[0], 3.0f);
+    QCOMPARE(cache.get(a_file2, 48000, 2, 0)->getChannel(0)[0], 4.0f);
+    QVERIFY(!cache.get(a_file1, 48000, 2, 1));
+}
+
+void TestAudioCache::testEviction()
+{
+    AudioCache cache(3 * a_blockBytes);
+
+    cache.add(a_file1, 48000, 2, 0, makeBlock(0));
+    cache.add(a_file1, 48000, 2, 1, makeBlock(1));
+    cache.add(a_file1, 48000, 2, 2, makeBlock(2));
+
+    // Block 0 is now the most recently used, so 1 goes first.
+    QVERIFY(cache.get(a_file1, 48000, 2, 0));
+    cache.add(a_file1, 48000, 2, 3, makeBlock(3));
+
+    QVERIFY(cache.has(a_file1, 48000, 2, 0));
+    QVERIFY(!cache.has(a_file1, 48000, 2, 1));
+    QVERIFY(cache.has(a_file1, 48000, 2, 2));
+    QVERIFY(cache.has(a_file1, 48000, 2, 3));
+
+    AudioCache::Statistics statistics = cache.getStatistics();
+    QCOMPARE(statistics.evictions, 1L);
+    QCOMPARE(statistics.bytes, 3 * a_blockBytes);
+
+    // A smaller budget takes effect right away.
+    cache.setMemoryBudget(a_blockBytes);
+    QCOMPARE(cache.getStatistics().blocks, 1L);
+    QVERIFY(cache.has(a_file1, 48000, 2, 3));
+}
+
+void TestAudioCache::testHeldBlocksStay()
+{
+    AudioCache cache(2 * a_blockBytes);
+
+    AudioCache::BlockPtr held = cache.add(a_file1, 48000, 2, 0, makeBlock(0));
+    cache.add(a_file1, 48000, 2, 1, makeBlock(1));
+    cache.add(a_file1, 48000, 2, 2, makeBlock(2));
+
+    // Block 0 is the least recently used, but we have it.
+    QVERIFY(cache.has(a_file1, 48000, 2, 0));
+    QVERIFY(!cache.has(a_file1, 48000, 2, 1));
+
+    // Everything held: over budget rather than dropping any.
+    AudioCache::BlockPtr held2 = cache.get(a_file1, 48000, 2, 2);
+    cache.setMemoryBudget(0);
+    QCOMPARE(cache.getStatistics().blocks, 2L);
+
+    held.reset();
+    held2.reset();
+    cache.clear();
+    QCOMPARE(cache.getStatistics().blocks, 0L);
+    QCOMPARE(cache.getStatistics().bytes, size_t(0));
+}
+
+void TestAudioCache::testForget()
+{
+    AudioCache cache(10 * a_blockBytes);
+
+    cache.add(a_file1, 48000, 2, 0, makeBlock(0));
+    cache.add(a_file1, 44100, 1, 5, makeBlock(0));
+    cache.add(a_file2, 48000, 2, 0, makeBlock(0));
+
+    // Still readable by whoever has it.
+    AudioCache::BlockPtr held = cache.get(a_file1, 48000, 2, 0);
+
+    cache.forget(a_file1);
+
+    QVERIFY(!cache.has(a_file1, 48000, 2, 0));
+    QVERIFY(!cache.has(a_file1, 44100, 1, 5));
+    QVERIFY(cache.has(a_file2, 48000, 2, 0));
+    QCOMPARE(cache.getStatistics().blocks, 1L);
+    QCOMPARE(held->frames, AudioCache::BlockFrames);
+}
+
+QTEST_MAIN(TestAudioCache)
+
+#include "audiocache.moc"
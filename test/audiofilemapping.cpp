@@ -0,0 +1,438 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "base/RealTime.h"
+#include "sound/AudioFileMapping.h"
+#include "sound/PlayableAudioFile.h"
+#include "sound/WAVAudioFile.h"
+
+#include <QByteArray>
+#include <QDataStream>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+using namespace Rosegarden;
+
+/// Unit test for reading audio files through AudioFileMapping.
+/**
+ * RIFFAudioFile::map() finds the sample data in the mapped file, and
+ * PlayableAudioFile decodes straight from it.
+ */
+class TestAudioFileMapping : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testPlainHeader();
+    void testHeaderOffsets();
+    void testTruncated();
+    void testShort();
+    void testFallback();
+    void testPlayableFallback();
+    void testPlayableLazy();
+
+private:
+    /// A stereo WAVAudioFile for path.  Kept until the end, as
+    /// AudioCache knows files by address.
+    WAVAudioFile *addWav(const QString &path);
+    /// addWav(), opened.  nullptr if it won't open.
+    WAVAudioFile *openWav(const QString &path);
+
+    QTemporaryDir m_dir;
+    std::vector<std::unique_ptr<WAVAudioFile>> m_files;
+};
+
+namespace
+{
+    constexpr int a_sampleRate = 48000;
+    constexpr int a_channels = 2;
+    constexpr int a_bytesPerFrame = a_channels * 2;
+
+    qint16 sample(int frame, int channel)
+    {
+        return qint16((frame % 1000) * 10 + channel + 1);
+    }
+
+    /// A 16-bit stereo WAV file.
+    /**
+     * formatLength over 16 gives an extended format chunk.  extraChunks
+     * go between the format and data chunks.  dataLength is what the
+     * header claims, -1 for the truth.
+     */
+    QByteArray makeWav(int frames,
+                       quint32 formatLength = 16,
+                       const QByteArray &extraChunks = QByteArray(),
+                       qint64 dataLength = -1)
+    {
+        const quint32 dataBytes = quint32(frames * a_bytesPerFrame);
+
+        QByteArray wav;
+        QDataStream out(&wav, QIODevice::WriteOnly);
+        out.setByteOrder(QDataStream::LittleEndian);
+
+        out.writeRawData("RIFF", 4);
+        out << quint32(4 + 8 + formatLength + quint32(extraChunks.size()) +
+                       8 + dataBytes);
+        out.writeRawData("WAVE", 4);
+
+        out.writeRawData("fmt ", 4);
+        out << formatLength;
+        out << quint16(1);  // PCM
+        out << quint16(a_channels);
+        out << quint32(a_sampleRate);
+        out << quint32(a_sampleRate * a_bytesPerFrame);
+        out << quint16(a_bytesPerFrame);
+        out << quint16(16);
+        for (quint32 i = 16; i < formatLength; ++i) {
+            out << quint8(0);
+        }
+
+        out.writeRawData(extraChunks.constData(), extraChunks.size());
+
+        out.writeRawData("data", 4);
+        out << quint32(dataLength < 0 ? dataBytes : quint32(dataLength));
+        for (int frame = 0; frame < frames; ++frame) {
+            for (int channel = 0; channel < a_channels; ++channel) {
+                out << sample(frame, channel);
+            }
+        }
+
+        return wav;
+    }
+
+    /// A chunk we don't read, padded to an even length.
+    QByteArray makeChunk(const char *id, int length)
+    {
+        QByteArray chunk;
+        QDataStream out(&chunk, QIODevice::WriteOnly);
+        out.setByteOrder(QDataStream::LittleEndian);
+
+        out.writeRawData(id, 4);
+        out << quint32(length);
+        for (int i = 0; i < length + (length & 1); ++i) {
+            out << quint8('x');
+        }
+
+        return chunk;
+    }
+
+    bool writeFile(const QString &path, const QByteArray &data)
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly))
+            return false;
+        return file.write(data) == data.size();
+    }
+
+    /// The frame at the start of the mapping's sample data.
+    bool startsWith(const AudioFileMapping &mapping, int frame)
+    {
+        if (mapping.getSampleBytes() < size_t(a_bytesPerFrame))
+            return false;
+
+        const unsigned char *data = mapping.getSampleData();
+        for (int channel = 0; channel < a_channels; ++channel) {
+            const qint16 value =
+                    qint16(data[channel * 2] | data[channel * 2 + 1] << 8);
+            if (value != sample(frame, channel))
+                return false;
+        }
+
+        return true;
+    }
+
+    /// Everything a PlayableAudioFile gives, a block at a time.
+    std::vector<float> play(PlayableAudioFile &playable, size_t frames)
+    {
+        std::vector<float> left(frames, 0.0f);
+        std::vector<float> right(frames, 0.0f);
+        std::vector<sample_t *> destination{left.data(), right.data()};
+
+        size_t done = 0;
+        while (done < frames) {
+            const size_t count = playable.addSamples(
+                    destination, a_channels,
+                    std::min(size_t(1024), frames - done), done);
+            if (count == 0)
+                break;
+            done += count;
+        }
+
+        left.resize(done);
+        return left;
+    }
+}
+
+WAVAudioFile *
+TestAudioFileMapping::addWav(const QString &path)
+{
+    WAVAudioFile *file = new WAVAudioFile(path, a_channels, a_sampleRate,
+                                          a_sampleRate * a_bytesPerFrame,
+                                          a_bytesPerFrame, 16);
+    m_files.emplace_back(file);
+    return file;
+}
+
+WAVAudioFile *
+TestAudioFileMapping::openWav(const QString &path)
+{
+    WAVAudioFile *file = addWav(path);
+    if (!file->open())
+        return nullptr;
+    return file;
+}
+
+void TestAudioFileMapping::initTestCase()
+{
+    QVERIFY(m_dir.isValid());
+
+    PlayableAudioFile::setRingBufferPoolSizes(4, 8192);
+}
+
+void TestAudioFileMapping::cleanupTestCase()
+{
+    AudioFileMapping::setMappingEnabled(true);
+    m_files.clear();
+}
+
+void TestAudioFileMapping::testPlainHeader()
+{
+    const QString path = m_dir.filePath("plain.wav");
+    QVERIFY(writeFile(path, makeWav(1000)));
+
+    WAVAudioFile *file = openWav(path);
+    QVERIFY(file);
+
+    std::unique_ptr<AudioFileMapping> mapping(file->map());
+    QVERIFY(mapping);
+    QVERIFY(mapping->isMapped());
+    QCOMPARE(mapping->getFileSize(), size_t(44 + 1000 * a_bytesPerFrame));
+    QCOMPARE(size_t(mapping->getSampleData() - mapping->getFileData()),
+             size_t(44));
+    QCOMPARE(mapping->getSampleBytes(), size_t(1000 * a_bytesPerFrame));
+    QVERIFY(startsWith(*mapping, 0));
+}
+
+void TestAudioFileMapping::testHeaderOffsets()
+{
+    // An extended format chunk, then chunks of odd and even length
+    // before the data.
+    const QByteArray extra = makeChunk("LIST", 5) + makeChunk("fact", 4);
+    const QString path = m_dir.filePath("offsets.wav");
+    QVERIFY(writeFile(path, makeWav(1000, 18, extra)));
+
+    WAVAudioFile *file = openWav(path);
+    QVERIFY(file);
+
+    std::unique_ptr<AudioFileMapping> mapping(file->map());
+    QVERIFY(mapping);
+
+    const size_t offset = 12 + (8 + 18) + (8 + 5 + 1) + (8 + 4) + 8;
+    QCOMPARE(size_t(mapping->getSampleData() - mapping->getFileData()),
+             offset);
+    QCOMPARE(mapping->getSampleBytes(), size_t(1000 * a_bytesPerFrame));
+    QVERIFY(startsWith(*mapping, 0));
+}
+
+void TestAudioFileMapping::testTruncated()
+{
+    // The header claims more than is there, and the last frame is cut
+    // short.  Only the whole frames that are there are played.
+    {
+        QByteArray wav = makeWav(1000, 16, QByteArray(), 4000 * a_bytesPerFrame);
+        wav.chop(a_bytesPerFrame / 2);
+        const QString path = m_dir.filePath("truncated.wav");
+        QVERIFY(writeFile(path, wav));
+
+        WAVAudioFile *file = openWav(path);
+        QVERIFY(file);
+
+        std::unique_ptr<AudioFileMapping> mapping(file->map());
+        QVERIFY(mapping);
+        QCOMPARE(mapping->getSampleBytes(), size_t(999 * a_bytesPerFrame));
+        QVERIFY(startsWith(*mapping, 0));
+    }
+
+    // A length of zero, as left by a crash while recording.
+    {
+        const QString path = m_dir.filePath("unfinished.wav");
+        QVERIFY(writeFile(path, makeWav(1000, 16, QByteArray(), 0)));
+
+        WAVAudioFile *file = openWav(path);
+        QVERIFY(file);
+
+        std::unique_ptr<AudioFileMapping> mapping(file->map());
+        QVERIFY(mapping);
+        QCOMPARE(mapping->getSampleBytes(), size_t(1000 * a_bytesPerFrame));
+    }
+
+    // A chunk that runs past the end before any data.
+    {
+        QByteArray wav = makeWav(0, 16, makeChunk("LIST", 100));
+        wav.chop(60);
+        const QString path = m_dir.filePath("nodata.wav");
+        QVERIFY(writeFile(path, wav));
+
+        WAVAudioFile *file = openWav(path);
+        QVERIFY(file);
+        QVERIFY(!file->map());
+    }
+}
+
+void TestAudioFileMapping::testShort()
+{
+    // Too short for a header.
+    const QString shortPath = m_dir.filePath("short.wav");
+    QVERIFY(writeFile(shortPath, makeWav(0).left(10)));
+    QVERIFY(!addWav(shortPath)->map());
+
+    // Empty.
+    const QString emptyPath = m_dir.filePath("empty.wav");
+    QVERIFY(writeFile(emptyPath, QByteArray()));
+    QVERIFY(!addWav(emptyPath)->map());
+
+    // Gone.
+    QVERIFY(!addWav(m_dir.filePath("missing.wav"))->map());
+
+    // A data chunk with nothing in it maps, but has no samples.
+    const QString silentPath = m_dir.filePath("silent.wav");
+    QVERIFY(writeFile(silentPath, makeWav(0)));
+    WAVAudioFile *silentFile = openWav(silentPath);
+    QVERIFY(silentFile);
+    std::unique_ptr<AudioFileMapping> mapping(silentFile->map());
+    QVERIFY(mapping);
+    QCOMPARE(mapping->getSampleBytes(), size_t(0));
+}
+
+void TestAudioFileMapping::testFallback()
+{
+    const QByteArray extra = makeChunk("LIST", 7);
+    const QString path = m_dir.filePath("fallback.wav");
+    QVERIFY(writeFile(path, makeWav(5000, 18, extra)));
+
+    WAVAudioFile *file = openWav(path);
+    QVERIFY(file);
+
+    std::unique_ptr<AudioFileMapping> mapped(file->map());
+    QVERIFY(mapped);
+    QVERIFY(mapped->isMapped());
+
+    // Read into memory instead, the same as if mmap() had failed.
+    AudioFileMapping::setMappingEnabled(false);
+    std::unique_ptr<AudioFileMapping> read(file->map());
+    AudioFileMapping::setMappingEnabled(true);
+
+    QVERIFY(read);
+    QVERIFY(!read->isMapped());
+    QCOMPARE(read->getFileSize(), mapped->getFileSize());
+    QCOMPARE(size_t(read->getSampleData() - read->getFileData()),
+             size_t(mapped->getSampleData() - mapped->getFileData()));
+    QCOMPARE(read->getSampleBytes(), mapped->getSampleBytes());
+    QVERIFY(memcmp(read->getFileData(), mapped->getFileData(),
+                   read->getFileSize()) == 0);
+
+    // Nothing to read ahead, but asking is harmless.
+    read->willNeed(0, read->getSampleBytes());
+}
+
+void TestAudioFileMapping::testPlayableFallback()
+{
+    // Small enough to be decoded in full on construction, so addSamples()
+    // needs no ring buffers.
+    const int frames = 20000;
+    const QByteArray wav = makeWav(frames);
+
+    const QString mappedPath = m_dir.filePath("playmapped.wav");
+    QVERIFY(writeFile(mappedPath, wav));
+    WAVAudioFile *mappedFile = openWav(mappedPath);
+    QVERIFY(mappedFile);
+
+    const QString readPath = m_dir.filePath("playread.wav");
+    QVERIFY(writeFile(readPath, wav));
+    WAVAudioFile *readFile = openWav(readPath);
+    QVERIFY(readFile);
+
+    const RealTime duration = RealTime::frame2RealTime(frames, a_sampleRate);
+
+    PlayableAudioFile mappedPlayable(AudioInstrumentBase, mappedFile,
+                                     RealTime::zero(), RealTime::zero(),
+                                     duration, 4096, wav.size());
+    QVERIFY(mappedPlayable.isSmallFile());
+    const std::vector<float> expected = play(mappedPlayable, frames);
+    QCOMPARE(expected.size(), size_t(frames));
+    QVERIFY(expected[0] != 0.0f);
+
+    AudioFileMapping::setMappingEnabled(false);
+    PlayableAudioFile readPlayable(AudioInstrumentBase, readFile,
+                                   RealTime::zero(), RealTime::zero(),
+                                   duration, 4096, wav.size());
+    AudioFileMapping::setMappingEnabled(true);
+
+    QVERIFY(readPlayable.isSmallFile());
+    QVERIFY(play(readPlayable, frames) == expected);
+}
+
+void TestAudioFileMapping::testPlayableLazy()
+{
+    const int frames = 100000;
+    const QString path = m_dir.filePath("lazy.wav");
+    QVERIFY(writeFile(path, makeWav(frames)));
+    WAVAudioFile *file = openWav(path);
+    QVERIFY(file);
+
+    const RealTime start(10, 0);
+    const RealTime duration = RealTime::frame2RealTime(frames, a_sampleRate);
+
+    // Not small, so nothing is mapped until the reader gets to it.
+    PlayableAudioFile playable(AudioInstrumentBase, file, start,
+                               RealTime::zero(), duration, 8192, 0);
+    QVERIFY(!playable.isSmallFile());
+    QVERIFY(!playable.isBuffered());
+    QCOMPARE(playable.getSampleFramesAvailable(), size_t(0));
+
+    // The first prefetch() maps it.  After that there's nothing to do.
+    QVERIFY(playable.prefetch());
+    QVERIFY(!playable.prefetch());
+
+    QVERIFY(playable.fillBuffers(start));
+    QVERIFY(playable.getSampleFramesAvailable() > 0);
+
+    // Gone before anything was read: fillBuffers() fails, and nothing
+    // plays.
+    const QString gonePath = m_dir.filePath("gone.wav");
+    QVERIFY(writeFile(gonePath, makeWav(frames)));
+    WAVAudioFile *goneFile = openWav(gonePath);
+    QVERIFY(goneFile);
+
+    PlayableAudioFile gone(AudioInstrumentBase, goneFile, start,
+                           RealTime::zero(), duration, 8192, 0);
+    QVERIFY(QFile::remove(gonePath));
+    QVERIFY(!gone.prefetch());
+    QVERIFY(!gone.fillBuffers(start));
+    QCOMPARE(gone.getSampleFramesAvailable(), size_t(0));
+}
+
+QTEST_MAIN(TestAudioFileMapping)
+
+#include "audiofilemapping.moc"
@@ -0,0 +1,258 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "sound/AudioProcess.h"
+#include "sound/DummyDriver.h"
+#include "sound/PlayableData.h"
+
+#include <QTest>
+
+#include <string>
+#include <vector>
+
+using namespace Rosegarden;
+
+/// Unit test for the order in which AudioFileReader::kick() reads files.
+class TestAudioFileReader : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testKickOrder();
+    void testNothingToDo();
+};
+
+namespace
+{
+    constexpr unsigned a_sampleRate = 48000;
+
+    /// Frames for a length of time at a_sampleRate.
+    size_t frames(double seconds)
+    {
+        return size_t(seconds * a_sampleRate);
+    }
+
+    /// What kick() asked of which file, in order.
+    typedef std::vector<std::string> Log;
+
+    /// A file with as much buffered as we say, that logs what it's asked.
+    class TestFile : public PlayableData
+    {
+    public:
+        TestFile(Log &log, const std::string &name, AudioFile *audioFile,
+                 const RealTime &startTime) :
+            m_log(log),
+            m_name(name),
+            m_audioFile(audioFile),
+            m_startTime(startTime)
+        {
+        }
+
+        size_t getSampleFramesAvailable() override  { return m_available; }
+        bool isFullyBuffered() const override  { return m_fullyBuffered; }
+        bool isBuffered() const override  { return m_buffered; }
+        RealTime getStartTime() const override  { return m_startTime; }
+        RealTime getEndTime() const override
+            { return m_startTime + getDuration(); }
+        RealTime getDuration() const override  { return RealTime(60, 0); }
+
+        size_t addSamples(std::vector<sample_t *> &, size_t, size_t,
+                          size_t) override
+            { return 0; }
+        void clearBuffers() override  { }
+
+        bool fillBuffers(const RealTime &) override
+        {
+            m_log.push_back("fill " + m_name);
+            m_buffered = true;
+            return true;
+        }
+        bool updateBuffers() override
+        {
+            m_log.push_back("update " + m_name);
+            return true;
+        }
+        bool prefetch() override
+        {
+            m_log.push_back("prefetch " + m_name);
+            return true;
+        }
+
+        InstrumentId getInstrument() const override
+            { return AudioInstrumentBase; }
+        AudioFile *getAudioFile() const override  { return m_audioFile; }
+        void cancel() override  { }
+        int getRuntimeSegmentId() const override  { return -1; }
+        bool isSmallFile() const override  { return false; }
+        unsigned int getTargetChannels() const override  { return 2; }
+
+        /// Buffered, with this many seconds left to play.
+        void setBuffered(double seconds)
+        {
+            m_buffered = true;
+            m_available = frames(seconds);
+        }
+        void setFullyBuffered()
+        {
+            m_buffered = true;
+            m_fullyBuffered = true;
+        }
+
+    private:
+        Log &m_log;
+        std::string m_name;
+        AudioFile *m_audioFile;
+        RealTime m_startTime;
+
+        bool m_buffered = false;
+        bool m_fullyBuffered = false;
+        size_t m_available = 0;
+    };
+
+    /// A driver whose clock we set, with files we schedule.
+    class TestDriver : public DummyDriver
+    {
+    public:
+        TestDriver() :
+            DummyDriver(nullptr)
+        {
+            // One second read buffers.  So files are filled within four
+            // seconds, urgent within half a second, and prefetched
+            // within nine.
+            setAudioBufferSizes(RealTime(0, 100000000), RealTime(1, 0),
+                                RealTime(1, 0), 0);
+        }
+
+        RealTime getSequencerTime() override  { return m_now; }
+
+        void schedule(PlayableData *file)
+            { m_audioQueue->addScheduled(file); }
+
+        RealTime m_now;
+    };
+
+    /// Only compared, never dereferenced.
+    char a_fileA;
+    char a_fileB;
+    AudioFile *const a_audioFileA = reinterpret_cast<AudioFile *>(&a_fileA);
+    AudioFile *const a_audioFileB = reinterpret_cast<AudioFile *>(&a_fileB);
+
+    int indexOf(const Log &log, const std::string &entry)
+    {
+        for (size_t i = 0; i < log.size(); ++i) {
+            if (log[i] == entry)
+                return int(i);
+        }
+        return -1;
+    }
+}
+
+void TestAudioFileReader::testKickOrder()
+{
+    Log log;
+    TestDriver driver;
+    driver.m_now = RealTime(100, 0);
+
+    // Scheduled in the opposite order to how they should be read, as
+    // kick() used to read in play queue order.
+
+    // Not in danger.  Grouped by audio file, soonest first in each.
+    TestFile *calmA2 = new TestFile(log, "calm A2", a_audioFileA,
+                                    RealTime(50, 0));
+    calmA2->setBuffered(2.0);
+    driver.schedule(calmA2);
+    TestFile *calmB = new TestFile(log, "calm B", a_audioFileB,
+                                   RealTime(51, 0));
+    calmB->setBuffered(0.8);
+    driver.schedule(calmB);
+    TestFile *calmA1 = new TestFile(log, "calm A1", a_audioFileA,
+                                    RealTime(52, 0));
+    calmA1->setBuffered(1.0);
+    driver.schedule(calmA1);
+    // Starts in a second, so nothing buffered is fine for now.
+    TestFile *starting = new TestFile(log, "starting", a_audioFileB,
+                                      RealTime(101, 0));
+    driver.schedule(starting);
+
+    // Nothing to read.
+    TestFile *full = new TestFile(log, "full", a_audioFileA,
+                                  RealTime(53, 0));
+    full->setFullyBuffered();
+    driver.schedule(full);
+
+    // Running dry.  Soonest first, whatever the audio file.
+    TestFile *dry = new TestFile(log, "dry", a_audioFileA, RealTime(54, 0));
+    dry->setBuffered(0.2);
+    driver.schedule(dry);
+    TestFile *drier = new TestFile(log, "drier", a_audioFileB,
+                                   RealTime(55, 0));
+    drier->setBuffered(0.01);
+    driver.schedule(drier);
+    // Playing, and never filled, as when unmuted.
+    TestFile *unmuted = new TestFile(log, "unmuted", a_audioFileA,
+                                     RealTime(56, 0));
+    driver.schedule(unmuted);
+
+    // Coming up: prefetched after everything else.  "starting" is in
+    // the prefetch window too, but it has just been filled.
+    TestFile *upcoming = new TestFile(log, "upcoming", a_audioFileA,
+                                      RealTime(106, 0));
+    driver.schedule(upcoming);
+    // Too far ahead for anything.
+    TestFile *later = new TestFile(log, "later", a_audioFileA,
+                                   RealTime(130, 0));
+    driver.schedule(later);
+
+    AudioFileReader reader(&driver, a_sampleRate);
+    QVERIFY(reader.kick(false));
+
+    QCOMPARE(log.size(), size_t(8));
+
+    // The urgent ones.
+    QCOMPARE(log[0], std::string("fill unmuted"));
+    QCOMPARE(log[1], std::string("update drier"));
+    QCOMPARE(log[2], std::string("update dry"));
+
+    // The rest, a file at a time.  Which file goes first depends on
+    // where they are in memory.
+    const int a1 = indexOf(log, "update calm A1");
+    const int a2 = indexOf(log, "update calm A2");
+    const int b = indexOf(log, "update calm B");
+    const int s = indexOf(log, "fill starting");
+    QVERIFY(a1 >= 3  &&  a2 >= 3  &&  b >= 3  &&  s >= 3);
+    QCOMPARE(a2, a1 + 1);
+    QCOMPARE(s, b + 1);
+
+    QCOMPARE(log[7], std::string("prefetch upcoming"));
+}
+
+void TestAudioFileReader::testNothingToDo()
+{
+    Log log;
+    TestDriver driver;
+    driver.m_now = RealTime(10, 0);
+
+    TestFile *full = new TestFile(log, "full", a_audioFileA, RealTime(0, 0));
+    full->setFullyBuffered();
+    driver.schedule(full);
+
+    AudioFileReader reader(&driver, a_sampleRate);
+    QVERIFY(!reader.kick(false));
+    QVERIFY(log.empty());
+}
+
+QTEST_MAIN(TestAudioFileReader)
+
+#include "audiofilereader.moc"
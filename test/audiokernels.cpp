@@ -0,0 +1,322 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "sound/AudioKernels.h"
+
+#include <QTest>
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+using namespace Rosegarden;
+
+Q_DECLARE_METATYPE(AudioKernels::Implementation)
+
+/// Unit test and benchmark for AudioKernels.
+/**
+ * The tests check each SIMD implementation against the scalar one at
+ * lengths and alignments that exercise the leftover handling.  The
+ * benchmarks run a typical mixer pass (pan, gain and peak, sum into a
+ * buss) at common JACK block sizes for each implementation.
+ */
+class TestAudioKernels : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testAgainstScalar_data();
+    void testAgainstScalar();
+    void testRampContinuity();
+    void testRampAndMeter_data();
+    void testRampAndMeter();
+
+    void benchmarkMix_data();
+    void benchmarkMix();
+
+private:
+    std::vector<sample_t> randomSamples(size_t n);
+
+    std::mt19937 m_rng;
+    AudioKernels::Implementation m_best;
+};
+
+void TestAudioKernels::initTestCase()
+{
+    m_rng.seed(1627);
+    m_best = AudioKernels::getImplementation();
+}
+
+void TestAudioKernels::cleanupTestCase()
+{
+    AudioKernels::setImplementation(m_best);
+}
+
+std::vector<sample_t> TestAudioKernels::randomSamples(size_t n)
+{
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    std::vector<sample_t> samples(n);
+    for (sample_t &sample : samples)
+        sample = dist(m_rng);
+    return samples;
+}
+
+namespace
+{
+    bool close(float a, float b)
+    {
+        return std::fabs(a - b) <= 1e-5f * (1 + std::fabs(a) + std::fabs(b));
+    }
+
+    void addImplementations()
+    {
+        QTest::addColumn<AudioKernels::Implementation>("implementation");
+
+        QTest::newRow("scalar") << AudioKernels::Scalar;
+        if (AudioKernels::isSupported(AudioKernels::SSE2))
+            QTest::newRow("sse2") << AudioKernels::SSE2;
+        if (AudioKernels::isSupported(AudioKernels::AVX2))
+            QTest::newRow("avx2") << AudioKernels::AVX2;
+    }
+}
+
+void TestAudioKernels::testAgainstScalar_data()
+{
+    addImplementations();
+}
+
+void TestAudioKernels::testAgainstScalar()
+{
+    QFETCH(AudioKernels::Implementation, implementation);
+
+    for (size_t n = 0; n < 40; ++n) {
+        for (size_t offset = 0; offset < 4; ++offset) {
+
+            const std::vector<sample_t> a = randomSamples(n + offset);
+            const std::vector<sample_t> b = randomSamples(n + offset);
+
+            // Run f on a copy of a with the scalar kernels and with the
+            // ones under test, and compare.
+            auto compare = [&](auto f) {
+                std::vector<sample_t> expected = a;
+                std::vector<sample_t> actual = a;
+                AudioKernels::setImplementation(AudioKernels::Scalar);
+                const float expectedResult = f(expected.data() + offset);
+                AudioKernels::setImplementation(implementation);
+                const float actualResult = f(actual.data() + offset);
+                QVERIFY(close(expectedResult, actualResult));
+                for (size_t i = 0; i < a.size(); ++i)
+                    QVERIFY(close(expected[i], actual[i]));
+            };
+
+            const sample_t *source = b.data() + offset;
+
+            compare([&](sample_t *buf) {
+                AudioKernels::add(buf, source, n); return 0.0f; });
+            compare([&](sample_t *buf) {
+                AudioKernels::addScaled(buf, source, 0.3f, n); return 0.0f; });
+            compare([&](sample_t *buf) {
+                AudioKernels::multiply(buf, 0.7f, n); return 0.0f; });
+            compare([&](sample_t *buf) {
+                AudioKernels::multiplyRamp(buf, 0.2f, 0.9f, n); return 0.0f; });
+            compare([&](sample_t *buf) {
+                return AudioKernels::peak(buf, n); });
+            compare([&](sample_t *buf) {
+                float peak;
+                float sumOfSquares;
+                AudioKernels::addAndMeter(buf, source, n, peak, sumOfSquares);
+                return peak + sumOfSquares; });
+            compare([&](sample_t *buf) {
+                return AudioKernels::multiplyAndPeak(buf, 1.5f, n); });
+            compare([&](sample_t *buf) {
+                float peak;
+                float sumOfSquares;
+                AudioKernels::scaleAndMeter(buf, source, 0.6f, n,
+                                            peak, sumOfSquares);
+                return peak + sumOfSquares; });
+            compare([&](sample_t *buf) {
+                float peak;
+                float sumOfSquares;
+                AudioKernels::meter(buf, n, peak, sumOfSquares);
+                return peak + sumOfSquares; });
+            compare([&](sample_t *buf) {
+                float peak;
+                float sumOfSquares;
+                AudioKernels::multiplyRampAndMeter(buf, 0.9f, 0.1f, n,
+                                                   peak, sumOfSquares);
+                return peak + sumOfSquares; });
+
+            // In place, as the instrument mixer does for mono.
+            std::vector<sample_t> right(n);
+            compare([&](sample_t *buf) {
+                return AudioKernels::pan(buf, buf, right.data(),
+                                         0.4f, 0.6f, n); });
+        }
+    }
+
+    // Peak is of absolute values.
+    AudioKernels::setImplementation(implementation);
+    std::vector<sample_t> negative(37, -0.25f);
+    negative[20] = -0.75f;
+    QCOMPARE(AudioKernels::peak(negative.data(), negative.size()), 0.75f);
+
+    // A scaled copy, leaving the source alone.
+    std::vector<sample_t> scaled(negative.size(), 1.0f);
+    float peak;
+    float sumOfSquares;
+    AudioKernels::scaleAndMeter(scaled.data(), negative.data(), 2.0f,
+                                negative.size(), peak, sumOfSquares);
+    QCOMPARE(peak, 1.5f);
+    QVERIFY(close(sumOfSquares, 36 * 0.25f + 1.5f * 1.5f));
+    QCOMPARE(scaled[0], -0.5f);
+    QCOMPARE(negative[0], -0.25f);
+}
+
+void TestAudioKernels::testRampContinuity()
+{
+    // Two ramps back to back should be one ramp.
+    const size_t n = 64;
+    std::vector<sample_t> ones(2 * n, 1.0f);
+
+    AudioKernels::multiplyRamp(ones.data(), 0.0f, 0.5f, n);
+    AudioKernels::multiplyRamp(ones.data() + n, 0.5f, 1.0f, n);
+
+    const float step = 0.5f / n;
+    for (size_t i = 0; i < 2 * n; ++i)
+        QVERIFY(close(ones[i], step * i));
+}
+
+void TestAudioKernels::testRampAndMeter_data()
+{
+    addImplementations();
+}
+
+void TestAudioKernels::testRampAndMeter()
+{
+    QFETCH(AudioKernels::Implementation, implementation);
+    AudioKernels::setImplementation(implementation);
+
+    // Same result as a ramp and then a meter.
+    const size_t n = 133;
+    const std::vector<sample_t> input = randomSamples(n);
+
+    std::vector<sample_t> separate = input;
+    AudioKernels::multiplyRamp(separate.data(), 1.0f, 0.25f, n);
+    float expectedPeak;
+    float expectedSumOfSquares;
+    AudioKernels::meter(separate.data(), n,
+                        expectedPeak, expectedSumOfSquares);
+
+    std::vector<sample_t> fused = input;
+    float peak;
+    float sumOfSquares;
+    AudioKernels::multiplyRampAndMeter(fused.data(), 1.0f, 0.25f, n,
+                                       peak, sumOfSquares);
+
+    for (size_t i = 0; i < n; ++i)
+        QVERIFY(close(separate[i], fused[i]));
+    QVERIFY(close(expectedPeak, peak));
+    QVERIFY(close(expectedSumOfSquares, sumOfSquares));
+
+    // A flat "ramp" is a plain gain.
+    std::vector<sample_t> flat = input;
+    AudioKernels::multiplyRampAndMeter(flat.data(), 0.5f, 0.5f, n,
+                                       peak, sumOfSquares);
+    for (size_t i = 0; i < n; ++i)
+        QVERIFY(close(flat[i], input[i] * 0.5f));
+
+    // Nothing to do.
+    AudioKernels::multiplyRampAndMeter(nullptr, 0.0f, 1.0f, 0,
+                                       peak, sumOfSquares);
+    QCOMPARE(peak, 0.0f);
+    QCOMPARE(sumOfSquares, 0.0f);
+}
+
+void TestAudioKernels::benchmarkMix_data()
+{
+    QTest::addColumn<AudioKernels::Implementation>("implementation");
+    QTest::addColumn<int>("blockSize");
+
+    const int blockSizes[] = { 64, 256, 1024, 4096 };
+
+    for (int blockSize : blockSizes) {
+        QTest::newRow(qPrintable(QString("scalar %1").arg(blockSize)))
+                << AudioKernels::Scalar << blockSize;
+        if (AudioKernels::isSupported(AudioKernels::SSE2)) {
+            QTest::newRow(qPrintable(QString("sse2 %1").arg(blockSize)))
+                    << AudioKernels::SSE2 << blockSize;
+        }
+        if (AudioKernels::isSupported(AudioKernels::AVX2)) {
+            QTest::newRow(qPrintable(QString("avx2 %1").arg(blockSize)))
+                    << AudioKernels::AVX2 << blockSize;
+        }
+    }
+}
+
+void TestAudioKernels::benchmarkMix()
+{
+    QFETCH(AudioKernels::Implementation, implementation);
+    QFETCH(int, blockSize);
+
+    AudioKernels::setImplementation(implementation);
+
+    // 40 mono instruments panned and summed into a stereo buss, then
+    // the buss gain and meter.  Scaled by 1024 / blockSize so that the
+    // results compare throughput.
+    const size_t instruments = 40;
+    const int passes = std::max(1, 1024 / blockSize);
+
+    std::vector<std::vector<sample_t> > inputs;
+    for (size_t i = 0; i < instruments; ++i)
+        inputs.push_back(randomSamples(blockSize));
+
+    std::vector<sample_t> mono(blockSize);
+    std::vector<sample_t> left(blockSize);
+    std::vector<sample_t> right(blockSize);
+    std::vector<sample_t> bussLeft(blockSize);
+    std::vector<sample_t> bussRight(blockSize);
+
+    float peak = 0;
+
+    QBENCHMARK {
+        for (int pass = 0; pass < passes; ++pass) {
+            std::fill(bussLeft.begin(), bussLeft.end(), 0.0f);
+            std::fill(bussRight.begin(), bussRight.end(), 0.0f);
+
+            for (size_t i = 0; i < instruments; ++i) {
+                std::copy(inputs[i].begin(), inputs[i].end(), mono.begin());
+                AudioKernels::pan(mono.data(), left.data(), right.data(),
+                                  0.7f, 0.3f, blockSize);
+                AudioKernels::add(bussLeft.data(), left.data(), blockSize);
+                AudioKernels::add(bussRight.data(), right.data(), blockSize);
+            }
+
+            peak = AudioKernels::multiplyAndPeak(bussLeft.data(), 0.5f,
+                                                 blockSize);
+            peak += AudioKernels::multiplyAndPeak(bussRight.data(), 0.5f,
+                                                  blockSize);
+        }
+    }
+
+    QVERIFY(peak > 0);
+}
+
+QTEST_MAIN(TestAudioKernels)
+
+#include "audiokernels.moc"
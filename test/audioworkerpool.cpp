@@ -0,0 +1,103 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "sound/AudioWorkerPool.h"
+
+#include <QAtomicInt>
+#include <QTest>
+
+#include <vector>
+
+using namespace Rosegarden;
+
+/// Unit test for AudioWorkerPool.
+class TestAudioWorkerPool : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testNoWorkers();
+    void testEachJobOnce();
+    void testThreadIndex();
+};
+
+namespace
+{
+    struct Counts
+    {
+        explicit Counts(int jobs) : runs(jobs), badThread(0), threadCount(0)
+        { }
+
+        std::vector<QAtomicInt> runs;
+        QAtomicInt badThread;
+        int threadCount;
+    };
+
+    void countJob(void *context, int job, int thread)
+    {
+        Counts *counts = static_cast<Counts *>(context);
+        counts->runs[job].fetchAndAddOrdered(1);
+        if (thread < 0  ||  thread >= counts->threadCount)
+            counts->badThread.fetchAndAddOrdered(1);
+    }
+}
+
+void TestAudioWorkerPool::testNoWorkers()
+{
+    // Everything runs on the caller.
+    AudioWorkerPool pool("test", 0, 0);
+    QCOMPARE(pool.getThreadCount(), 1);
+
+    Counts counts(10);
+    counts.threadCount = 1;
+    pool.run(countJob, &counts, 10);
+
+    for (int i = 0; i < 10; ++i)
+        QCOMPARE(counts.runs[i].loadAcquire(), 1);
+    QCOMPARE(counts.badThread.loadAcquire(), 0);
+}
+
+void TestAudioWorkerPool::testEachJobOnce()
+{
+    AudioWorkerPool pool("test", 3, 0);
+
+    // Fewer, as many and more jobs than threads, over and over, as the
+    // mixer does once per block.
+    for (int round = 0; round < 1000; ++round) {
+        const int jobs = round % 40;
+
+        Counts counts(jobs);
+        counts.threadCount = pool.getThreadCount();
+        pool.run(countJob, &counts, jobs);
+
+        for (int i = 0; i < jobs; ++i)
+            QCOMPARE(counts.runs[i].loadAcquire(), 1);
+    }
+}
+
+void TestAudioWorkerPool::testThreadIndex()
+{
+    AudioWorkerPool pool("test", 4, 0);
+
+    Counts counts(1000);
+    counts.threadCount = pool.getThreadCount();
+    pool.run(countJob, &counts, 1000);
+
+    QCOMPARE(counts.badThread.loadAcquire(), 0);
+}
+
+QTEST_MAIN(TestAudioWorkerPool)
+
+#include "audioworkerpool.moc"
@@ -0,0 +1,418 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "base/BarIndex.h"
+#include "base/Composition.h"
+#include "base/TimeSignature.h"
+
+#include <QTest>
+
+#include <random>
+#include <utility>
+#include <vector>
+
+using namespace Rosegarden;
+
+namespace
+{
+
+    /// The bar arithmetic Composition used before BarIndex.
+    /**
+     * Works from the Composition's public time signature list, the way
+     * calculateBarPositions(), getBarNumber(), getBarRange() and
+     * getTimeSignatureAtAux() did.
+     */
+    class ReferenceBars
+    {
+    public:
+        explicit ReferenceBars(const Composition &composition);
+
+        int getBarNumber(timeT t) const;
+        std::pair<timeT, timeT> getBarRange(int n) const;
+        /// Index of the time signature at t, or -1.
+        int getTimeSignatureNumberAt(timeT t) const;
+        TimeSignature getTimeSignatureInBar(int n, bool &isNew) const;
+
+    private:
+        struct Sig
+        {
+            timeT time;
+            TimeSignature timeSig;
+            int barNumber;
+        };
+        std::vector<Sig> m_sigs;
+
+        /// findAtOrBefore()
+        int atOrBefore(timeT t) const;
+    };
+
+    ReferenceBars::ReferenceBars(const Composition &composition)
+    {
+        for (int i = 0; i < composition.getTimeSignatureCount(); ++i) {
+            std::pair<timeT, TimeSignature> change =
+                    composition.getTimeSignatureChange(i);
+            m_sigs.push_back(Sig{change.first, change.second, 0});
+        }
+
+        timeT lastBarNo = 0;
+        timeT lastSigTime = 0;
+        timeT barDuration = TimeSignature().getBarDuration();
+
+        const timeT startMarker = composition.getStartMarker();
+        if (startMarker < 0) {
+            if (!m_sigs.empty()  &&  m_sigs[0].time <= 0)
+                barDuration = m_sigs[0].timeSig.getBarDuration();
+            lastBarNo = startMarker / barDuration;
+            lastSigTime = startMarker;
+        }
+
+        for (Sig &sig : m_sigs) {
+            int n = (sig.time - lastSigTime) / barDuration;
+            if (sig.time < lastSigTime)
+                --n;
+            if (barDuration * n + lastSigTime == sig.time)
+                n += lastBarNo;
+            else
+                n += lastBarNo + 1;
+
+            sig.barNumber = n;
+
+            lastBarNo = n;
+            lastSigTime = sig.time;
+            barDuration = sig.timeSig.getBarDuration();
+        }
+    }
+
+    int ReferenceBars::atOrBefore(timeT t) const
+    {
+        int i = -1;
+        while (i + 1 < int(m_sigs.size())  &&  m_sigs[i + 1].time <= t)
+            ++i;
+        return i;
+    }
+
+    int ReferenceBars::getBarNumber(timeT t) const
+    {
+        const int i = atOrBefore(t);
+
+        if (i < 0) {
+            timeT bd = TimeSignature().getBarDuration();
+            if (t < 0  &&  !m_sigs.empty()  &&  m_sigs[0].time <= 0)
+                bd = m_sigs[0].timeSig.getBarDuration();
+            int n = t / bd;
+            if (t < 0  &&  n * bd != t)
+                --n;
+            return n;
+        }
+
+        return m_sigs[i].barNumber +
+                (t - m_sigs[i].time) / m_sigs[i].timeSig.getBarDuration();
+    }
+
+    std::pair<timeT, timeT> ReferenceBars::getBarRange(int n) const
+    {
+        // lower_bound by bar number
+        int j = 0;
+        while (j < int(m_sigs.size())  &&  m_sigs[j].barNumber < n)
+            ++j;
+        int i = j;
+
+        if (i == int(m_sigs.size())  ||  m_sigs[i].barNumber > n)
+            --i;
+        else
+            ++j;
+
+        timeT start;
+        timeT barDuration;
+
+        if (i < 0) {
+            barDuration = TimeSignature().getBarDuration();
+            if (n < 0  &&  !m_sigs.empty()  &&  m_sigs[0].time <= 0)
+                barDuration = m_sigs[0].timeSig.getBarDuration();
+            start = n * barDuration;
+        } else {
+            barDuration = m_sigs[i].timeSig.getBarDuration();
+            start = m_sigs[i].time + (n - m_sigs[i].barNumber) * barDuration;
+        }
+
+        timeT finish = start + barDuration;
+        if (j < int(m_sigs.size())  &&  finish > m_sigs[j].time)
+            finish = m_sigs[j].time;
+
+        return std::pair<timeT, timeT>(start, finish);
+    }
+
+    int ReferenceBars::getTimeSignatureNumberAt(timeT t) const
+    {
+        int i = atOrBefore(t);
+        if (t < 0  &&  i < 0  &&  !m_sigs.empty()  &&  m_sigs[0].time <= 0)
+            i = 0;
+        return i;
+    }
+
+    TimeSignature ReferenceBars::getTimeSignatureInBar(int n,
+                                                       bool &isNew) const
+    {
+        isNew = false;
+        const timeT t = getBarRange(n).first;
+        const int i = getTimeSignatureNumberAt(t);
+        if (i < 0)
+            return TimeSignature();
+        if (t == m_sigs[i].time)
+            isNew = true;
+        return m_sigs[i].timeSig;
+    }
+
+    /// Fill composition with a random time signature map.
+    void randomise(Composition &composition, std::mt19937 &rng)
+    {
+        static const int denominators[] = { 1, 2, 4, 8, 16 };
+
+        std::uniform_int_distribution<int> count(0, 40);
+        std::uniform_int_distribution<int> numerator(1, 13);
+        std::uniform_int_distribution<int> denominator(0, 4);
+        std::uniform_int_distribution<int> bars(-2, 12);
+        std::uniform_int_distribution<timeT> offset(0, 3839);
+        std::uniform_int_distribution<int> coin(0, 3);
+
+        composition.clear();
+
+        // Count-in bars, sometimes on a barline, sometimes not.
+        switch (coin(rng)) {
+        case 0:
+            composition.setStartMarker(-3840 * bars(rng) - 3840 * 3);
+            break;
+        case 1:
+            composition.setStartMarker(-offset(rng) - 3840);
+            break;
+        default:
+            break;
+        }
+
+        const int sigs = count(rng);
+        for (int i = 0; i < sigs; ++i) {
+            // Mostly on a barline, as the GUI would have it.
+            timeT t = bars(rng) * 3840 * (i + 1) / 4;
+            if (coin(rng) == 0)
+                t += offset(rng);
+            composition.addTimeSignature(
+                    t,
+                    TimeSignature(numerator(rng),
+                                  denominators[denominator(rng)]));
+        }
+    }
+
+}
+
+/// Unit test and benchmark for BarIndex.
+class TestBarIndex : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testDefault();
+    void testCountIn();
+    void testRandomMaps();
+    void testInvalidation();
+
+    void benchmarkBarRange();
+    void benchmarkGetBars();
+
+private:
+    /// A long piece with frequent time signature changes.
+    static void makeLongPiece(Composition &composition);
+};
+
+void TestBarIndex::testDefault()
+{
+    Composition composition;
+
+    // 4/4 with no time signatures.
+    QCOMPARE(composition.getBarNumber(0), 0);
+    QCOMPARE(composition.getBarNumber(3839), 0);
+    QCOMPARE(composition.getBarNumber(3840), 1);
+    QCOMPARE(composition.getBarNumber(-1), -1);
+    QCOMPARE(composition.getBarNumber(-3840), -1);
+    QCOMPARE(composition.getBarNumber(-3841), -2);
+    QCOMPARE(composition.getBarRange(2), std::make_pair(timeT(7680),
+                                                        timeT(11520)));
+
+    // 3/4 from bar 2, with a partial bar before a 5/8 at 9000.
+    composition.addTimeSignature(7680, TimeSignature(3, 4));
+    composition.addTimeSignature(9000, TimeSignature(5, 8));
+
+    QCOMPARE(composition.getBarNumber(7680), 2);
+    QCOMPARE(composition.getBarRange(2), std::make_pair(timeT(7680),
+                                                        timeT(9000)));
+    QCOMPARE(composition.getBarNumber(9000), 3);
+    QCOMPARE(composition.getBarRange(3), std::make_pair(timeT(9000),
+                                                        timeT(11400)));
+
+    bool isNew = false;
+    TimeSignature timeSig = composition.getTimeSignatureInBar(3, isNew);
+    QVERIFY(isNew);
+    QCOMPARE(timeSig.getNumerator(), 5);
+    QCOMPARE(composition.getTimeSignatureNumberAt(8000), 0);
+    QCOMPARE(composition.getTimeSignatureNumberAt(100), -1);
+}
+
+void TestBarIndex::testCountIn()
+{
+    Composition composition;
+    composition.setStartMarker(-3 * 2880);
+    composition.addTimeSignature(0, TimeSignature(3, 4));
+
+    // Count-in bars use the time signature at time zero.
+    QCOMPARE(composition.getBarNumber(-1), -1);
+    QCOMPARE(composition.getBarNumber(-2880), -1);
+    QCOMPARE(composition.getBarNumber(-2881), -2);
+    QCOMPARE(composition.getBarRange(-3), std::make_pair(timeT(-8640),
+                                                         timeT(-5760)));
+    QCOMPARE(composition.getTimeSignatureAt(-100).getNumerator(), 3);
+}
+
+void TestBarIndex::testRandomMaps()
+{
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<timeT> time(-40000, 400000);
+
+    for (int map = 0; map < 500; ++map) {
+        Composition composition;
+        randomise(composition, rng);
+
+        const ReferenceBars reference(composition);
+
+        for (int i = 0; i < 200; ++i) {
+            const timeT t = time(rng);
+            QCOMPARE(composition.getBarNumber(t), reference.getBarNumber(t));
+            QCOMPARE(composition.getTimeSignatureNumberAt(t),
+                     reference.getTimeSignatureNumberAt(t));
+        }
+
+        const int firstBar = reference.getBarNumber(-40000);
+        const int lastBar = reference.getBarNumber(400000);
+
+        std::shared_ptr<const BarIndex> barIndex = composition.getBarIndex();
+        const std::vector<BarIndex::Bar> bars =
+                barIndex->getBars(firstBar, lastBar);
+        QCOMPARE(int(bars.size()), lastBar - firstBar + 1);
+
+        for (int n = firstBar; n <= lastBar; ++n) {
+            const std::pair<timeT, timeT> range = reference.getBarRange(n);
+            QCOMPARE(composition.getBarRange(n), range);
+
+            bool isNew = false;
+            const TimeSignature timeSig =
+                    reference.getTimeSignatureInBar(n, isNew);
+
+            bool compositionIsNew = false;
+            QVERIFY(composition.getTimeSignatureInBar(
+                            n, compositionIsNew) == timeSig);
+            QCOMPARE(compositionIsNew, isNew);
+
+            const BarIndex::Bar &bar = bars[n - firstBar];
+            QCOMPARE(bar.number, n);
+            QCOMPARE(bar.start, range.first);
+            QCOMPARE(bar.end, range.second);
+            QVERIFY(bar.timeSig == timeSig);
+            QCOMPARE(bar.newTimeSig, isNew);
+        }
+    }
+}
+
+void TestBarIndex::testInvalidation()
+{
+    Composition composition;
+
+    std::shared_ptr<const BarIndex> before = composition.getBarIndex();
+    // Cached until something changes.
+    QCOMPARE(composition.getBarIndex(), before);
+
+    const int index = composition.addTimeSignature(3840, TimeSignature(3, 4));
+    QVERIFY(composition.getBarIndex() != before);
+    QCOMPARE(composition.getBarRange(1).second, timeT(3840 + 2880));
+
+    // The old index still gives the old answers.
+    QCOMPARE(before->getBarRange(1).second, timeT(7680));
+
+    composition.removeTimeSignature(index);
+    QCOMPARE(composition.getBarRange(1).second, timeT(7680));
+
+    // Negative bar numbers count from the start marker.
+    composition.addTimeSignature(-1000, TimeSignature(3, 4));
+    const int bar = composition.getBarNumber(-1000);
+    composition.setStartMarker(-3840 * 2);
+    QCOMPARE(composition.getBarNumber(-1000),
+             ReferenceBars(composition).getBarNumber(-1000));
+    QVERIFY(composition.getBarNumber(-1000) != bar);
+}
+
+void TestBarIndex::makeLongPiece(Composition &composition)
+{
+    // A 3/4 - 4/4 - 7/8 rotation every few bars for 10000 bars.
+    static const int numerators[] = { 3, 4, 7 };
+    static const int denominators[] = { 4, 4, 8 };
+
+    timeT t = 0;
+    for (int i = 0; i < 2500; ++i) {
+        const TimeSignature timeSig(numerators[i % 3], denominators[i % 3]);
+        composition.addTimeSignature(t, timeSig);
+        t += timeSig.getBarDuration() * 4;
+    }
+}
+
+void TestBarIndex::benchmarkBarRange()
+{
+    Composition composition;
+    makeLongPiece(composition);
+    const int lastBar = composition.getBarNumber(
+            composition.getTimeSignatureChange(2499).first) + 3;
+
+    // The way rulers and grids used to go over a range of bars.
+    timeT sum = 0;
+    QBENCHMARK {
+        sum = 0;
+        for (int n = 0; n <= lastBar; ++n) {
+            bool isNew = false;
+            sum += composition.getBarRange(n).second -
+                    composition.getBarRange(n).first;
+            sum += composition.getTimeSignatureInBar(n, isNew)
+                    .getBeatDuration();
+        }
+    }
+    QVERIFY(sum > 0);
+}
+
+void TestBarIndex::benchmarkGetBars()
+{
+    Composition composition;
+    makeLongPiece(composition);
+    const int lastBar = composition.getBarNumber(
+            composition.getTimeSignatureChange(2499).first) + 3;
+
+    timeT sum = 0;
+    QBENCHMARK {
+        sum = 0;
+        const std::vector<BarIndex::Bar> bars =
+                composition.getBarIndex()->getBars(0, lastBar);
+        for (const BarIndex::Bar &bar : bars)
+            sum += bar.end - bar.start + bar.timeSig.getBeatDuration();
+    }
+    QVERIFY(sum > 0);
+}
+
+QTEST_MAIN(TestBarIndex)
+
+#include "barindex.moc"
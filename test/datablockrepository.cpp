@@ -0,0 +1,287 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "sound/MappedEvent.h"
+
+#include <QTest>
+
+#include <atomic>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace Rosegarden;
+
+/// Unit test for DataBlockRepository, where SysEx data is kept.
+/**
+ * Blocks are registered under a mutex and read lock-free, so the reads
+ * are tested while another thread registers and clears.
+ */
+class TestDataBlockRepository : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+
+    void testStoreAndLookup();
+    void testShared();
+    void testLarge();
+    void testClear();
+    void testThreads();
+};
+
+namespace
+{
+    /// Different data for every index, of a size that depends on it.
+    /**
+     * Every 50th is a bulk dump, big enough for its own mapping.  Others
+     * are big enough to miss the arena.
+     */
+    std::string makeData(int index)
+    {
+        size_t size = 1 + size_t(index % 300);
+        if (index % 50 == 49)
+            size = 300 * 1024 + size_t(index);
+        else if (index % 50 == 24)
+            size = 20 * 1024 + size_t(index);
+
+        std::string data(size, '\0');
+        for (size_t i = 0; i < size; ++i) {
+            data[i] = char((index * 7 + i * 13) & 0x7f);
+        }
+        // So that no two are the same.
+        data += std::to_string(index);
+
+        return data;
+    }
+
+    std::string get(const MappedEvent &event)
+    {
+        return DataBlockRepository::getDataBlockForEvent(&event);
+    }
+}
+
+void TestDataBlockRepository::init()
+{
+    DataBlockRepository::clear();
+}
+
+void TestDataBlockRepository::testStoreAndLookup()
+{
+    MappedEvent none;
+    QCOMPARE(get(none), std::string());
+
+    MappedEvent event;
+    DataBlockRepository::setDataBlockForEvent(&event, "\xf0\x7e\x7f\xf7");
+    QVERIFY(event.getDataBlockId() != 0);
+    QCOMPARE(get(event), std::string("\xf0\x7e\x7f\xf7"));
+
+    // Embedded NULs survive.
+    MappedEvent binary;
+    const std::string withNul("a\0b\0c", 5);
+    DataBlockRepository::setDataBlockForEvent(&binary, withNul);
+    QCOMPARE(get(binary), withNul);
+
+    // Extend, as when SysEx arrives in pieces.
+    MappedEvent pieces;
+    pieces.addDataString("\xf0\x43");
+    pieces.addDataString("\x10\x4c");
+    pieces.addDataString("\xf7");
+    QCOMPARE(get(pieces), std::string("\xf0\x43\x10\x4c\xf7"));
+
+    // Replace.
+    DataBlockRepository::setDataBlockForEvent(&pieces, "new");
+    QCOMPARE(get(pieces), std::string("new"));
+
+    // Copies share the block.
+    const MappedEvent copy(event);
+    QCOMPARE(copy.getDataBlockId(), event.getDataBlockId());
+    QCOMPARE(get(copy), get(event));
+}
+
+void TestDataBlockRepository::testShared()
+{
+    // The same data again, as when a segment is re-mapped, shares the
+    // block.
+    MappedEvent a;
+    DataBlockRepository::setDataBlockForEvent(&a, "same");
+    MappedEvent b;
+    DataBlockRepository::setDataBlockForEvent(&b, "same");
+    QCOMPARE(b.getDataBlockId(), a.getDataBlockId());
+
+    // Changing one leaves the other alone.
+    DataBlockRepository::setDataBlockForEvent(&b, "different");
+    QVERIFY(b.getDataBlockId() != a.getDataBlockId());
+    QCOMPARE(get(a), std::string("same"));
+    QCOMPARE(get(b), std::string("different"));
+
+    // No longer shared, so a's block is changed in place.
+    const MappedEvent aBefore(a);
+    DataBlockRepository::setDataBlockForEvent(&a, "changed");
+    QCOMPARE(a.getDataBlockId(), aBefore.getDataBlockId());
+    QCOMPARE(get(a), std::string("changed"));
+}
+
+void TestDataBlockRepository::testLarge()
+{
+    // Small, arena-sized, bigger than the arena takes, and bulk dumps
+    // with their own mapping.
+    const size_t sizes[] = {
+        1, 100, 16 * 1024, 16 * 1024 + 1, 64 * 1024, 256 * 1024,
+        256 * 1024 + 1, 4 * 1024 * 1024
+    };
+
+    std::vector<MappedEvent> events(sizeof(sizes) / sizeof(sizes[0]));
+    std::vector<std::string> data;
+
+    for (size_t i = 0; i < events.size(); ++i) {
+        std::string block(sizes[i], '\0');
+        for (size_t j = 0; j < block.size(); ++j) {
+            block[j] = char((i + j * 31) & 0xff);
+        }
+        data.push_back(block);
+        DataBlockRepository::setDataBlockForEvent(&events[i], block);
+    }
+
+    // Lots of small ones, across several arena chunks.
+    std::vector<MappedEvent> smallEvents(2000);
+    for (size_t i = 0; i < smallEvents.size(); ++i) {
+        DataBlockRepository::setDataBlockForEvent(
+                &smallEvents[i], makeData(int(i) * 50));
+    }
+
+    for (size_t i = 0; i < events.size(); ++i) {
+        QCOMPARE(get(events[i]).size(), sizes[i]);
+        QVERIFY(get(events[i]) == data[i]);
+    }
+    for (size_t i = 0; i < smallEvents.size(); ++i) {
+        QVERIFY(get(smallEvents[i]) == makeData(int(i) * 50));
+    }
+
+    // A bulk dump extended a piece at a time.
+    MappedEvent dump;
+    std::string expected;
+    for (int i = 0; i < 20; ++i) {
+        const std::string piece(32 * 1024, char('a' + i));
+        dump.addDataString(piece);
+        expected += piece;
+    }
+    QVERIFY(get(dump) == expected);
+}
+
+void TestDataBlockRepository::testClear()
+{
+    MappedEvent before;
+    DataBlockRepository::setDataBlockForEvent(&before, "before");
+    MappedEvent big;
+    DataBlockRepository::setDataBlockForEvent(&big, makeData(49));
+
+    DataBlockRepository::clear();
+
+    // Gone.
+    QCOMPARE(get(before), std::string());
+    QCOMPARE(get(big), std::string());
+
+    // New blocks don't reuse the old IDs, so a stale event can't see
+    // someone else's data.
+    MappedEvent after;
+    DataBlockRepository::setDataBlockForEvent(&after, "after");
+    QVERIFY(after.getDataBlockId() != before.getDataBlockId());
+    QVERIFY(after.getDataBlockId() != big.getDataBlockId());
+    QCOMPARE(get(before), std::string());
+    QCOMPARE(get(after), std::string("after"));
+
+    // Extending a cleared block starts afresh.
+    before.addDataString("more");
+    QCOMPARE(get(before), std::string("more"));
+
+    // Clearing when there's nothing there is fine.
+    DataBlockRepository::clear();
+    DataBlockRepository::clear();
+    QCOMPARE(get(after), std::string());
+}
+
+void TestDataBlockRepository::testThreads()
+{
+    // One thread registers blocks and now and then clears them all, as
+    // the GUI does.  The others read them as the sequencer thread does.
+    // A read must give either the right data or, once cleared, nothing.
+
+    constexpr int blockCount = 20000;
+    constexpr int clearEvery = 3000;
+    constexpr int readerCount = 4;
+
+    std::vector<MappedEvent> events(blockCount);
+    std::atomic<int> published(0);
+    std::atomic<bool> done(false);
+
+    std::atomic<int> found(0);
+    std::atomic<int> wrong(0);
+
+    std::vector<std::thread> readers;
+    for (int r = 0; r < readerCount; ++r) {
+        readers.emplace_back([&, r]() {
+            std::mt19937 random(r);
+            while (!done.load(std::memory_order_acquire)) {
+                const int count = published.load(std::memory_order_acquire);
+                if (count == 0)
+                    continue;
+
+                // Mostly the newest, which is being written around.
+                int index = count - 1;
+                if (random() % 2)
+                    index = int(random() % unsigned(count));
+
+                const std::string data = get(events[size_t(index)]);
+                if (data.empty())
+                    continue;
+                if (data == makeData(index))
+                    ++found;
+                else
+                    ++wrong;
+            }
+        });
+    }
+
+    for (int i = 0; i < blockCount; ++i) {
+        DataBlockRepository::setDataBlockForEvent(&events[size_t(i)],
+                                                  makeData(i));
+        published.store(i + 1, std::memory_order_release);
+
+        if (i % clearEvery == clearEvery - 1)
+            DataBlockRepository::clear();
+    }
+
+    done.store(true, std::memory_order_release);
+    for (std::thread &reader : readers) {
+        reader.join();
+    }
+
+    QCOMPARE(wrong.load(), 0);
+    QVERIFY(found.load() > 0);
+
+    // Everything since the last clear() is still there.
+    const int lastClear = (blockCount / clearEvery) * clearEvery;
+    for (int i = lastClear; i < blockCount; ++i) {
+        QVERIFY(get(events[size_t(i)]) == makeData(i));
+    }
+    QCOMPARE(get(events[size_t(lastClear - 1)]), std::string());
+}
+
+QTEST_MAIN(TestDataBlockRepository)
+
+#include "datablockrepository.moc"
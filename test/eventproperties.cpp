@@ -0,0 +1,205 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "base/BaseProperties.h"
+#include "base/Event.h"
+#include "base/NotationTypes.h"
+
+#include <QTest>
+
+#include <string>
+#include <vector>
+
+using namespace Rosegarden;
+
+/// Unit test for Event properties (FlatPropertyMap)
+class TestEventProperties : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testGetSet();
+    void testPersistence();
+    void testCopyOnWrite();
+    void testXml();
+    void testManyProperties();
+    void benchmarkStorage();
+    void benchmarkGet();
+};
+
+void TestEventProperties::testGetSet()
+{
+    const PropertyName realTimeName("realtimetest");
+    const PropertyName stringName("stringtest");
+
+    Event e(Note::EventType, 0, 960);
+    QVERIFY(!e.has(BaseProperties::PITCH));
+
+    e.set<Int>(BaseProperties::PITCH, 60);
+    e.set<Bool>(BaseProperties::TIED_FORWARD, true);
+    e.set<RealTimeT>(realTimeName, RealTime(3, 4));
+    e.set<String>(stringName, "hello");
+
+    QCOMPARE(e.get<Int>(BaseProperties::PITCH), 60l);
+    QCOMPARE(e.get<Bool>(BaseProperties::TIED_FORWARD), true);
+    QVERIFY(e.get<RealTimeT>(realTimeName) == RealTime(3, 4));
+    QCOMPARE(e.get<String>(stringName), std::string("hello"));
+
+    // Update in place.
+    e.set<Int>(BaseProperties::PITCH, 61);
+    QCOMPARE(e.get<Int>(BaseProperties::PITCH), 61l);
+
+    // Wrong type.
+    long l = 0;
+    QVERIFY(!e.get<Int>(stringName, l));
+    QVERIFY_EXCEPTION_THROWN(e.get<Int>(stringName), Event::BadType);
+    QVERIFY_EXCEPTION_THROWN(e.set<Int>(stringName, 1), Event::BadType);
+
+    e.unset(stringName);
+    QVERIFY(!e.has(stringName));
+    QVERIFY_EXCEPTION_THROWN(e.get<String>(stringName), Event::NoData);
+}
+
+void TestEventProperties::testPersistence()
+{
+    Event e(Note::EventType, 0, 960);
+
+    e.setMaybe<Int>(BaseProperties::PITCH, 60);
+    QVERIFY(!e.isPersistent<Int>(BaseProperties::PITCH));
+
+    e.set<Int>(BaseProperties::PITCH, 62);
+    QVERIFY(e.isPersistent<Int>(BaseProperties::PITCH));
+    QCOMPARE(e.get<Int>(BaseProperties::PITCH), 62l);
+
+    // setMaybe() must not touch a persistent value.
+    e.setMaybe<Int>(BaseProperties::PITCH, 64);
+    QCOMPARE(e.get<Int>(BaseProperties::PITCH), 62l);
+
+    e.set<Int>(BaseProperties::PITCH, 65, false);
+    QVERIFY(!e.isPersistent<Int>(BaseProperties::PITCH));
+    QCOMPARE(e.get<Int>(BaseProperties::PITCH), 65l);
+    QCOMPARE(e.getPersistentPropertyNames().size(), size_t(0));
+    QCOMPARE(e.getNonPersistentPropertyNames().size(), size_t(1));
+
+    e.clearNonPersistentProperties();
+    QVERIFY(!e.has(BaseProperties::PITCH));
+}
+
+void TestEventProperties::testCopyOnWrite()
+{
+    const PropertyName stringName("stringtest");
+
+    Event e(Note::EventType, 0, 960);
+    e.set<String>(stringName, "hello");
+
+    Event copy(e);
+    QVERIFY(copy.isCopyOf(e));
+    copy.set<String>(stringName, "world");
+    QVERIFY(!copy.isCopyOf(e));
+
+    QCOMPARE(e.get<String>(stringName), std::string("hello"));
+    QCOMPARE(copy.get<String>(stringName), std::string("world"));
+}
+
+void TestEventProperties::testXml()
+{
+    Event e(Note::EventType, 0, 960);
+    e.set<Int>(BaseProperties::PITCH, 60);
+    e.set<Int>(BaseProperties::VELOCITY, 100);
+    e.set<Bool>(BaseProperties::TIED_FORWARD, true);
+
+    const std::string xml = e.toXmlString(0);
+
+    QVERIFY(xml.find("<property name=\"pitch\" int=\"60\"/>") !=
+            std::string::npos);
+    QVERIFY(xml.find("<property name=\"velocity\" int=\"100\"/>") !=
+            std::string::npos);
+    QVERIFY(xml.find("<property name=\"tiedforward\" bool=\"true\"/>") !=
+            std::string::npos);
+}
+
+void TestEventProperties::testManyProperties()
+{
+    // Enough to spill out of the inline storage.
+    Event e(Note::EventType, 0, 960);
+    for (int i = 0; i < 50; ++i) {
+        e.set<Int>(PropertyName("prop" + std::to_string(i)), i);
+    }
+    for (int i = 0; i < 50; i += 2) {
+        e.unset(PropertyName("prop" + std::to_string(i)));
+    }
+    for (int i = 0; i < 50; ++i) {
+        const PropertyName name("prop" + std::to_string(i));
+        if (i % 2)
+            QCOMPARE(e.get<Int>(name), long(i));
+        else
+            QVERIFY(!e.has(name));
+    }
+}
+
+void TestEventProperties::benchmarkStorage()
+{
+    // 200k notes with the usual persistent properties.
+    std::vector<Event *> events;
+    events.reserve(200000);
+    for (int i = 0; i < 200000; ++i) {
+        Event *e = new Event(Note::EventType, i * 240, 240);
+        e->set<Int>(BaseProperties::PITCH, 60 + i % 12);
+        e->set<Int>(BaseProperties::VELOCITY, 100);
+        events.push_back(e);
+    }
+
+    size_t total = 0;
+    for (const Event *e : events) {
+        total += e->getStorageSize();
+    }
+
+    qDebug() << "Approximate storage per note event:" <<
+                (total / events.size()) << "bytes";
+
+    for (Event *e : events) {
+        delete e;
+    }
+}
+
+void TestEventProperties::benchmarkGet()
+{
+    std::vector<Event *> events;
+    events.reserve(200000);
+    for (int i = 0; i < 200000; ++i) {
+        Event *e = new Event(Note::EventType, i * 240, 240);
+        e->set<Int>(BaseProperties::PITCH, 60 + i % 12);
+        e->set<Int>(BaseProperties::VELOCITY, 100);
+        events.push_back(e);
+    }
+
+    long sum = 0;
+    QBENCHMARK {
+        sum = 0;
+        for (const Event *e : events) {
+            sum += e->get<Int>(BaseProperties::PITCH);
+            sum += e->get<Int>(BaseProperties::VELOCITY);
+        }
+    }
+    QVERIFY(sum > 0);
+
+    for (Event *e : events) {
+        delete e;
+    }
+}
+
+QTEST_MAIN(TestEventProperties)
+
+#include "eventproperties.moc"
@@ -0,0 +1,146 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "base/Event.h"
+#include "base/EventTypeName.h"
+#include "base/MidiTypes.h"
+#include "base/NotationTypes.h"
+#include "base/Segment.h"
+
+#include <QTest>
+
+#include <string>
+
+using namespace Rosegarden;
+
+/// Unit test for EventTypeName and Event::isa()
+class TestEventType : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testInterning();
+    void testIsa();
+    void benchmarkIsaString();
+    void benchmarkIsaTypeName();
+
+private:
+    void fillSegment(Segment &segment);
+};
+
+void TestEventType::testInterning()
+{
+    // Same string, same ID.
+    QCOMPARE(EventTypeName::getId("note"), Note::EventType.getId());
+    QCOMPARE(EventTypeName::getId(std::string("controller")),
+             Controller::EventType.getId());
+    QVERIFY(Note::EventType.getId() != Controller::EventType.getId());
+
+    // Round trip.
+    QCOMPARE(EventTypeName::getName(Note::EventType.getId()),
+             std::string("note"));
+    QCOMPARE(EventTypeName::getName(-1), std::string());
+
+    // Unknown types from e.g. a file get IDs too.
+    const int id = EventTypeName::getId("xyzzy");
+    QCOMPARE(EventTypeName::getName(id), std::string("xyzzy"));
+}
+
+void TestEventType::testIsa()
+{
+    Event note(Note::EventType, 0, 960);
+    QVERIFY(note.isa(Note::EventType));
+    QVERIFY(!note.isa(Note::EventRestType));
+    QVERIFY(note.isa(std::string("note")));
+    QVERIFY(note.getType() == Note::EventType);
+
+    // Constructed from a plain string, same result.
+    Event controller(std::string("controller"), 0);
+    QVERIFY(controller.isa(Controller::EventType));
+    QVERIFY(!controller.isa(Note::EventType));
+
+    // Copies share the type.
+    Event copy(note, 480);
+    QVERIFY(copy.isa(Note::EventType));
+
+    // getType() refers to the interned string, not a temporary.
+    QCOMPARE(&note.getType(), &copy.getType());
+}
+
+void TestEventType::fillSegment(Segment &segment)
+{
+    // 500k events, roughly what a long orchestral segment with
+    // controller automation would look like.
+    for (timeT t = 0; t < 500000; ++t) {
+        switch (t % 4) {
+        case 0:
+        case 1:
+            segment.insert(new Event(Note::EventType, t * 10, 10));
+            break;
+        case 2:
+            segment.insert(new Event(Controller::EventType, t * 10));
+            break;
+        default:
+            segment.insert(new Event(PitchBend::EventType, t * 10));
+            break;
+        }
+    }
+}
+
+void TestEventType::benchmarkIsaString()
+{
+    Segment segment;
+    fillSegment(segment);
+
+    // The old way: compare against a string.
+    const std::string noteType(Note::EventType);
+    const std::string controllerType(Controller::EventType);
+    const std::string pitchBendType(PitchBend::EventType);
+
+    int count = 0;
+    QBENCHMARK {
+        count = 0;
+        for (const Event *event : segment) {
+            if (event->isa(controllerType)  ||  event->isa(pitchBendType))
+                ++count;
+            else if (event->isa(noteType))
+                ++count;
+        }
+    }
+    QCOMPARE(count, 500000);
+}
+
+void TestEventType::benchmarkIsaTypeName()
+{
+    Segment segment;
+    fillSegment(segment);
+
+    int count = 0;
+    QBENCHMARK {
+        count = 0;
+        for (const Event *event : segment) {
+            if (event->isa(Controller::EventType)  ||
+                event->isa(PitchBend::EventType))
+                ++count;
+            else if (event->isa(Note::EventType))
+                ++count;
+        }
+    }
+    QCOMPARE(count, 500000);
+}
+
+QTEST_MAIN(TestEventType)
+
+#include "eventtype.moc"
@@ -0,0 +1,374 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "base/BaseProperties.h"
+#include "base/Composition.h"
+#include "base/Event.h"
+#include "base/NotationTypes.h"
+#include "base/Segment.h"
+#include "base/TriggerSegment.h"
+#include "document/RosegardenDocument.h"
+#include "gui/seqmanager/InternalSegmentMapper.h"
+#include "gui/seqmanager/MEBIterator.h"
+#include "sound/MappedEvent.h"
+
+#include <QSettings>
+#include <QSharedPointer>
+#include <QTest>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace Rosegarden;
+using namespace BaseProperties;
+
+/// Unit test for InternalSegmentMapper's remapping of part of a Segment.
+/**
+ * Makes random edits to a Segment, as commands would, and checks that
+ * after each one refreshing just the changed range gives the same
+ * buffer as mapping the whole Segment again.
+ */
+class TestInternalSegmentMapper : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testRandomEdits();
+    void testRandomEditsRepeating();
+
+private:
+    void randomEdits(bool repeating);
+
+    RosegardenDocument *m_doc = nullptr;
+};
+
+namespace
+{
+    const timeT a_segmentEnd = 16 * 3840;
+
+    /// Counts how often only the range was redone.
+    class TestMapper : public InternalSegmentMapper
+    {
+    public:
+        TestMapper(RosegardenDocument *doc, Segment *segment) :
+            InternalSegmentMapper(doc, segment)
+        {
+        }
+
+        int m_rangeFills = 0;
+
+    protected:
+        bool fillBufferRange(timeT from, timeT to) override
+        {
+            const bool filled =
+                    InternalSegmentMapper::fillBufferRange(from, to);
+            if (filled)
+                ++m_rangeFills;
+            return filled;
+        }
+    };
+
+    QStringList describe(QSharedPointer<MappedEventBuffer> buffer)
+    {
+        QStringList description;
+
+        for (MEBIterator i(buffer); !i.atEnd(); ++i) {
+            const MappedEvent *event = i.peek();
+            description << QString("%1 at %2 for %3: %4 %5 track %6")
+                           .arg(int(event->getType()))
+                           .arg(event->getEventTime().toString())
+                           .arg(event->getDuration().toString())
+                           .arg(int(event->getData1()))
+                           .arg(int(event->getData2()))
+                           .arg(int(event->getTrackId()));
+        }
+
+        return description;
+    }
+
+    Event *makeNote(timeT time, timeT duration, int pitch)
+    {
+        Event *note = new Event(Note::EventType, time, duration);
+        note->set<Int>(PITCH, pitch);
+        note->set<Int>(VELOCITY, 100);
+        return note;
+    }
+
+    /// Makes random edits to a Segment.
+    class Editor
+    {
+    public:
+        Editor(Segment *segment, TriggerSegmentId triggerId) :
+            m_segment(segment),
+            m_triggerId(triggerId),
+            m_random(20240517)
+        {
+        }
+
+        void addNote()
+        {
+            m_segment->insert(makeNote(randomTime(), randomDuration(),
+                                       randomPitch()));
+        }
+
+        /// Do something to a note.
+        void edit()
+        {
+            // fillBufferRange() does nothing while the Segment triggers
+            // anything, so don't leave a trigger there for long.
+            if (untrigger())
+                return;
+
+            if (m_segment->empty()) {
+                addNote();
+                return;
+            }
+
+            Segment::iterator i = m_segment->begin();
+            std::advance(i, random(0, int(m_segment->size()) - 1));
+            const Event *old = *i;
+
+            switch (random(0, 15)) {
+            case 0:
+                addNote();
+                break;
+
+            case 1:  // Delete
+                m_segment->erase(i);
+                break;
+
+            case 2:  // Move
+                replace(i, new Event(*old, randomTime()));
+                break;
+
+            case 3: {  // Change pitch
+                Event *note = new Event(*old);
+                note->set<Int>(PITCH, randomPitch());
+                replace(i, note);
+                break;
+            }
+
+            case 4:  // Change duration
+                replace(i, new Event(*old, old->getAbsoluteTime(),
+                                     randomDuration()));
+                break;
+
+            case 5: {  // Tie on to a new note
+                const timeT end = old->getAbsoluteTime() + old->getDuration();
+                if (end >= a_segmentEnd)
+                    break;
+                Event *next = new Event(*old, end, randomDuration());
+                next->unset(TRIGGER_SEGMENT_ID);
+                next->set<Bool>(TIED_BACKWARD, true);
+                Event *note = new Event(*old);
+                note->set<Bool>(TIED_FORWARD, true);
+                replace(i, note);
+                m_segment->insert(next);
+                break;
+            }
+
+            case 6: {  // Untie one end of a tie
+                Event *note = new Event(*old);
+                note->unset(TIED_FORWARD);
+                note->unset(TIED_BACKWARD);
+                replace(i, note);
+                break;
+            }
+
+            case 7: {  // Trigger an ornament
+                Event *note = new Event(*old);
+                note->set<Int>(TRIGGER_SEGMENT_ID, m_triggerId);
+                replace(i, note);
+                break;
+            }
+
+            default:  // Mostly add and move, so there's plenty to edit
+                if (random(0, 1))
+                    addNote();
+                else
+                    replace(i, new Event(*old, randomTime()));
+                break;
+            }
+        }
+
+    private:
+        Segment *m_segment;
+        TriggerSegmentId m_triggerId;
+        std::mt19937 m_random;
+
+        int random(int min, int max)
+        {
+            return std::uniform_int_distribution<int>(min, max)(m_random);
+        }
+        timeT randomTime()
+        {
+            return random(0, a_segmentEnd / 240 - 8) * 240;
+        }
+        timeT randomDuration()
+        {
+            return random(1, 8) * 120;
+        }
+        int randomPitch()
+        {
+            // Few enough that notes overlap and ties find each other.
+            return random(60, 64);
+        }
+
+        void replace(Segment::iterator i, Event *event)
+        {
+            m_segment->erase(i);
+            m_segment->insert(event);
+        }
+
+        /// Stop triggering anything.  Returns whether anything did.
+        bool untrigger()
+        {
+            std::vector<Segment::iterator> triggers;
+            for (Segment::iterator i = m_segment->begin();
+                 i != m_segment->end(); ++i) {
+                if ((*i)->has(TRIGGER_SEGMENT_ID))
+                    triggers.push_back(i);
+            }
+
+            for (const Segment::iterator &i : triggers) {
+                Event *note = new Event(**i);
+                note->unset(TRIGGER_SEGMENT_ID);
+                replace(i, note);
+            }
+
+            return !triggers.empty();
+        }
+    };
+}
+
+void TestInternalSegmentMapper::initTestCase()
+{
+    // Make sure settings end up in the right place.
+    QCoreApplication::setOrganizationName("rosegardenmusic");
+
+    QSettings settings;
+    settings.beginGroup("Sequencer_Options");
+    // Don't start JACK.
+    settings.setValue("autostartjack", false);
+
+    m_doc = new RosegardenDocument(
+            nullptr,  // parent
+            {},  // audioPluginManager
+            true,  // skipAutoload
+            true,  // clearCommandHistory
+            false);  // useSequencer
+
+    RosegardenDocument::currentDocument = m_doc;
+
+    // For its tracks and instruments.
+    QVERIFY(m_doc->openDocument(
+            QFINDTESTDATA("../data/examples/aylindaamiga.rg"),
+            false,  // permanent
+            true,  // squelchProgressDialog
+            false));  // enableLock
+}
+
+void TestInternalSegmentMapper::cleanupTestCase()
+{
+    RosegardenDocument::currentDocument = nullptr;
+    delete m_doc;
+}
+
+void TestInternalSegmentMapper::randomEdits(bool repeating)
+{
+    Composition &composition = m_doc->getComposition();
+    QVERIFY(!composition.getTracks().empty());
+
+    // A track of its own, so that a repeating Segment repeats to the end
+    // of the Composition.
+    Track *track = new Track(
+            composition.getNewTrackId(),
+            composition.getTracks().begin()->second->getInstrument(),
+            composition.getNbTracks());
+    composition.addTrack(track);
+    composition.setEndMarker(
+            std::max(composition.getEndMarker(), a_segmentEnd * 8));
+
+    Segment *segment = new Segment;
+    segment->setTrack(track->getId());
+    composition.addSegment(segment);
+    composition.setSegmentStartTime(segment, 0);
+    segment->setEndMarkerTime(a_segmentEnd);
+    segment->setRepeating(repeating);
+
+    Segment *ornament = new Segment;
+    ornament->insert(makeNote(0, 60, 60));
+    ornament->insert(makeNote(60, 60, 62));
+    TriggerSegmentRec *rec = composition.addTriggerSegment(ornament, 60, 100);
+    QVERIFY(rec);
+
+    Editor editor(segment, rec->getId());
+    for (int i = 0; i < 100; ++i) {
+        editor.addNote();
+    }
+
+    QSharedPointer<TestMapper> ranged(new TestMapper(m_doc, segment));
+    ranged->init();
+    QSharedPointer<TestMapper> full(new TestMapper(m_doc, segment));
+    full->init();
+
+    QCOMPARE(describe(ranged), describe(full));
+
+    const unsigned statusId = segment->getNewRefreshStatusId();
+
+    for (int edit = 0; edit < 1000; ++edit) {
+        editor.edit();
+
+        SegmentRefreshStatus &status = segment->getRefreshStatus(statusId);
+        if (!status.needsRefresh())
+            continue;
+
+        ranged->refresh(status.from(), status.to());
+        full->refresh();
+        status.setNeedsRefresh(false);
+
+        const QStringList expected = describe(full);
+        if (describe(ranged) != expected)
+            qWarning() << "Different after edit" << edit;
+        QCOMPARE(describe(ranged), expected);
+    }
+
+    // Enough edits didn't need a full refill that the range code was
+    // tested.
+    QVERIFY(ranged->m_rangeFills > 100);
+    QCOMPARE(full->m_rangeFills, 0);
+
+    ranged.reset();
+    full.reset();
+    composition.deleteSegment(segment);
+}
+
+void TestInternalSegmentMapper::testRandomEdits()
+{
+    randomEdits(false);
+}
+
+void TestInternalSegmentMapper::testRandomEditsRepeating()
+{
+    randomEdits(true);
+}
+
+QTEST_MAIN(TestInternalSegmentMapper)
+
+#include "internalsegmentmapper.moc"
@@ -0,0 +1,334 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "sound/MappedBufMetaIterator.h"
+#include "sound/MappedEventInserter.h"
+#include "sound/MappedEventList.h"
+#include "sound/MappedInserterBase.h"
+
+#include <QTest>
+
+#include <vector>
+
+using namespace Rosegarden;
+
+/// Unit test for MappedBufMetaIterator.
+class TestMappedBufMetaIterator : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testOrder();
+    void testDormant();
+    void testRepublish();
+    void testJump();
+    void testRemove();
+    void benchmarkFetch();
+};
+
+namespace
+{
+    const RealTime a_slice(0, 160000000);
+
+    /// A mapper for a fixed list of events.
+    class TestBuffer : public MappedEventBuffer
+    {
+    public:
+        TestBuffer(TrackId trackId, const std::vector<MappedEvent> &events) :
+            MappedEventBuffer(nullptr),
+            m_trackId(trackId),
+            m_events(events)
+        {
+        }
+
+        TrackId getTrackID() const override  { return m_trackId; }
+
+        /// Replace the events and republish.
+        void setEvents(const std::vector<MappedEvent> &events)
+        {
+            m_events = events;
+            refresh();
+        }
+
+    protected:
+        int calculateSize() override  { return int(m_events.size()); }
+
+        void fillBuffer() override
+        {
+            RealTime start = RealTime::zero();
+            RealTime end = RealTime::zero();
+
+            for (size_t i = 0; i < m_events.size(); ++i) {
+                MappedEvent event(m_events[i]);
+                event.setTrackId(m_trackId);
+                mapAnEvent(&event);
+
+                if (i == 0)
+                    start = event.getEventTime();
+                end = std::max(end,
+                               event.getEventTime() + event.getDuration());
+            }
+
+            setStartEnd(start, end);
+        }
+
+        bool shouldPlay(MappedEvent *, RealTime) override  { return true; }
+
+    private:
+        TrackId m_trackId;
+        std::vector<MappedEvent> m_events;
+    };
+
+    /// Keeps the events in the order they were inserted.
+    class RecordingInserter : public MappedInserterBase
+    {
+    public:
+        void insertCopy(const MappedEvent &event) override
+            { m_events.push_back(event); }
+
+        std::vector<MappedEvent> m_events;
+    };
+
+    MappedEvent makeEvent(const RealTime &time, MidiByte pitch)
+    {
+        return MappedEvent(0, MappedEvent::MidiNote, pitch, 100,
+                           time, RealTime(0, 100000000), RealTime::zero());
+    }
+
+    /// count notes, one every interval, starting at start.
+    std::vector<MappedEvent> makeEvents(const RealTime &start,
+                                        const RealTime &interval,
+                                        int count,
+                                        MidiByte pitch)
+    {
+        std::vector<MappedEvent> events;
+        for (int i = 0; i < count; ++i) {
+            events.push_back(makeEvent(start + interval * i, pitch));
+        }
+        return events;
+    }
+
+    QSharedPointer<TestBuffer> makeBuffer(TrackId trackId,
+                                          const std::vector<MappedEvent> &events)
+    {
+        QSharedPointer<TestBuffer> buffer(new TestBuffer(trackId, events));
+        buffer->init();
+        return buffer;
+    }
+
+    /// Fetch in slices, as RosegardenSequencer does, from start to end.
+    void fetch(MappedBufMetaIterator &metaIterator,
+               MappedInserterBase &inserter,
+               const RealTime &start,
+               const RealTime &end)
+    {
+        for (RealTime time = start; time < end; time = time + a_slice) {
+            metaIterator.fetchEvents(inserter, time, time + a_slice);
+        }
+    }
+
+    int count(const std::vector<MappedEvent> &events, TrackId trackId)
+    {
+        int result = 0;
+        for (const MappedEvent &event : events) {
+            if (event.getTrackId() == trackId)
+                ++result;
+        }
+        return result;
+    }
+}
+
+void TestMappedBufMetaIterator::testOrder()
+{
+    MappedBufMetaIterator metaIterator;
+
+    // Interleaved, with ties between the first two.
+    metaIterator.addBuffer(
+            makeBuffer(1, makeEvents(RealTime::zero(), RealTime(0, 50000000),
+                                     40, 60)));
+    metaIterator.addBuffer(
+            makeBuffer(2, makeEvents(RealTime::zero(), RealTime(0, 100000000),
+                                     20, 62)));
+    metaIterator.addBuffer(
+            makeBuffer(3, makeEvents(RealTime(0, 30000000),
+                                     RealTime(0, 70000000), 25, 64)));
+
+    RecordingInserter inserter;
+    fetch(metaIterator, inserter, RealTime::zero(), RealTime(3, 0));
+
+    QCOMPARE(count(inserter.m_events, 1), 40);
+    QCOMPARE(count(inserter.m_events, 2), 20);
+    QCOMPARE(count(inserter.m_events, 3), 25);
+
+    // Straight out of the metaiterator in time order, so inserting them
+    // into a MappedEventList is all appends.
+    for (size_t i = 1; i < inserter.m_events.size(); ++i) {
+        QVERIFY(inserter.m_events[i - 1].getEventTime() <=
+                inserter.m_events[i].getEventTime());
+    }
+
+    // Nothing left.
+    RecordingInserter after;
+    fetch(metaIterator, after, RealTime(3, 0), RealTime(6, 0));
+    QVERIFY(after.m_events.empty());
+}
+
+void TestMappedBufMetaIterator::testDormant()
+{
+    MappedBufMetaIterator metaIterator;
+
+    metaIterator.addBuffer(
+            makeBuffer(1, makeEvents(RealTime::zero(), RealTime(0, 500000000),
+                                     4, 60)));
+    metaIterator.addBuffer(
+            makeBuffer(2, makeEvents(RealTime(10, 0), RealTime(0, 500000000),
+                                     4, 62)));
+
+    // Only the first one has started.
+    RecordingInserter early;
+    fetch(metaIterator, early, RealTime::zero(), RealTime(5, 0));
+    QCOMPARE(count(early.m_events, 1), 4);
+    QCOMPARE(count(early.m_events, 2), 0);
+
+    // And now only the second one has anything left.
+    RecordingInserter late;
+    fetch(metaIterator, late, RealTime(5, 0), RealTime(15, 0));
+    QCOMPARE(count(late.m_events, 1), 0);
+    QCOMPARE(count(late.m_events, 2), 4);
+}
+
+void TestMappedBufMetaIterator::testRepublish()
+{
+    MappedBufMetaIterator metaIterator;
+
+    QSharedPointer<TestBuffer> buffer =
+            makeBuffer(1, makeEvents(RealTime::zero(), RealTime(0, 500000000),
+                                     2, 60));
+    metaIterator.addBuffer(buffer);
+
+    RecordingInserter first;
+    fetch(metaIterator, first, RealTime::zero(), RealTime(2, 0));
+    QCOMPARE(count(first.m_events, 1), 2);
+
+    // The mapper republishes with more events further on, without
+    // telling the metaiterator, as the metronome mapper does.
+    std::vector<MappedEvent> events =
+            makeEvents(RealTime::zero(), RealTime(0, 500000000), 2, 60);
+    const std::vector<MappedEvent> more =
+            makeEvents(RealTime(3, 0), RealTime(0, 500000000), 4, 60);
+    events.insert(events.end(), more.begin(), more.end());
+    buffer->setEvents(events);
+
+    RecordingInserter second;
+    fetch(metaIterator, second, RealTime(2, 0), RealTime(5, 0));
+    QCOMPARE(count(second.m_events, 1), 4);
+}
+
+void TestMappedBufMetaIterator::testJump()
+{
+    MappedBufMetaIterator metaIterator;
+
+    metaIterator.addBuffer(
+            makeBuffer(1, makeEvents(RealTime::zero(), RealTime(1, 0),
+                                     10, 60)));
+    metaIterator.addBuffer(
+            makeBuffer(2, makeEvents(RealTime(0, 500000000), RealTime(1, 0),
+                                     10, 62)));
+
+    RecordingInserter inserter;
+    fetch(metaIterator, inserter, RealTime::zero(), RealTime(10, 0));
+    QCOMPARE(inserter.m_events.size(), size_t(20));
+
+    // Back to the middle.
+    metaIterator.jumpToTime(RealTime(5, 0));
+
+    RecordingInserter again;
+    fetch(metaIterator, again, RealTime(5, 0), RealTime(10, 0));
+    QCOMPARE(count(again.m_events, 1), 5);
+    QCOMPARE(count(again.m_events, 2), 5);
+    QCOMPARE(again.m_events.front().getEventTime(), RealTime(5, 0));
+}
+
+void TestMappedBufMetaIterator::testRemove()
+{
+    MappedBufMetaIterator metaIterator;
+
+    QSharedPointer<TestBuffer> first =
+            makeBuffer(1, makeEvents(RealTime::zero(), RealTime(1, 0), 4, 60));
+    QSharedPointer<TestBuffer> second =
+            makeBuffer(2, makeEvents(RealTime::zero(), RealTime(1, 0), 4, 62));
+    metaIterator.addBuffer(first);
+    metaIterator.addBuffer(second);
+
+    RecordingInserter before;
+    fetch(metaIterator, before, RealTime::zero(), RealTime(2, 0));
+    QCOMPARE(count(before.m_events, 1), 2);
+    QCOMPARE(count(before.m_events, 2), 2);
+
+    metaIterator.removeBuffer(first);
+
+    RecordingInserter after;
+    fetch(metaIterator, after, RealTime(2, 0), RealTime(4, 0));
+    QCOMPARE(count(after.m_events, 1), 0);
+    QCOMPARE(count(after.m_events, 2), 2);
+}
+
+void TestMappedBufMetaIterator::benchmarkFetch()
+{
+    // A large composition: 200 tracks and 500 segments, each segment
+    // 30 seconds of eighth notes at 120bpm, staggered over five minutes.
+    // Most of the segments are dormant in any one slice.
+    const int tracks = 200;
+    const int segments = 500;
+    const RealTime duration(300, 0);
+    const RealTime segmentLength(30, 0);
+    const RealTime noteInterval(0, 250000000);
+
+    MappedBufMetaIterator metaIterator;
+
+    for (int i = 0; i < segments; ++i) {
+        const RealTime start =
+                (duration - segmentLength) * i / segments;
+        metaIterator.addBuffer(
+                makeBuffer(TrackId(i % tracks),
+                           makeEvents(start, noteInterval, 120,
+                                      MidiByte(36 + i % 60))));
+    }
+
+    MappedEventList list;
+    MappedEventInserter inserter(list);
+    size_t events = 0;
+
+    QBENCHMARK {
+        metaIterator.jumpToTime(RealTime::zero());
+        events = 0;
+
+        for (RealTime time = RealTime::zero();
+             time < duration;
+             time = time + a_slice) {
+            metaIterator.fetchEvents(inserter, time, time + a_slice);
+            // As RosegardenSequencer::getSlice() does.
+            list.sort();
+            events += list.size();
+            list.clear();
+        }
+    }
+
+    QCOMPARE(events, size_t(segments * 120));
+}
+
+QTEST_MAIN(TestMappedBufMetaIterator)
+
+#include "mappedbufmetaiterator.moc"
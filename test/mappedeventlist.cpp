@@ -0,0 +1,229 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "sound/MappedEventList.h"
+
+#include <QTest>
+
+using namespace Rosegarden;
+
+/// Unit test for MappedEventList.
+class TestMappedEventList : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testOrder();
+    void testErase();
+    void testEraseIf();
+    void testSort();
+    void testSortStable();
+    void testSlabReuse();
+    void testCopy();
+};
+
+namespace
+{
+    MappedEvent makeEvent(int seconds, MidiByte pitch)
+    {
+        return MappedEvent(0, MappedEvent::MidiNote, pitch, 100,
+                           RealTime(seconds, 0), RealTime(1, 0),
+                           RealTime::zero());
+    }
+
+    QList<int> pitches(const MappedEventList &list)
+    {
+        QList<int> result;
+        for (const MappedEvent *event : list) {
+            result << event->getPitch();
+        }
+        return result;
+    }
+}
+
+void TestMappedEventList::testOrder()
+{
+    MappedEventList list;
+
+    list.insertCopy(makeEvent(2, 60));
+    list.insert(new MappedEvent(makeEvent(0, 61)));
+    list.insertCopy(makeEvent(3, 62));
+    list.insertCopy(makeEvent(1, 63));
+
+    QCOMPARE(list.size(), MappedEventList::size_type(4));
+    QCOMPARE(pitches(list), QList<int>({61, 63, 60, 62}));
+
+    // Equal events stay in the order they were inserted.
+    MappedEventList equal;
+    equal.insertCopy(makeEvent(1, 70));
+    equal.insertCopy(makeEvent(1, 70));
+    MappedEventList::iterator second = equal.insertCopy(makeEvent(1, 70));
+    QVERIFY(second == equal.end() - 1);
+}
+
+void TestMappedEventList::testErase()
+{
+    MappedEventList list;
+
+    for (int i = 0; i < 6; ++i) {
+        if (i % 2)
+            list.insert(new MappedEvent(makeEvent(i, MidiByte(60 + i))));
+        else
+            list.insertCopy(makeEvent(i, MidiByte(60 + i)));
+    }
+
+    // Remove the odd pitches, as RosegardenSequencer::applyFiltering()
+    // does.
+    for (MappedEventList::iterator i = list.begin(); i != list.end(); ) {
+        if ((*i)->getPitch() % 2)
+            i = list.erase(i);
+        else
+            ++i;
+    }
+
+    QCOMPARE(pitches(list), QList<int>({60, 62, 64}));
+
+    list.erase(list.begin(), list.end());
+    QVERIFY(list.empty());
+}
+
+void TestMappedEventList::testEraseIf()
+{
+    MappedEventList list;
+
+    // Several slab blocks, with events from new among them.
+    for (int i = 0; i < 2000; ++i) {
+        if (i % 3 == 0)
+            list.insert(new MappedEvent(makeEvent(i, MidiByte(i % 128))));
+        else
+            list.insertCopy(makeEvent(i, MidiByte(i % 128)));
+    }
+
+    // As RosegardenSequencer::applyFiltering() does.
+    list.eraseIf([](const MappedEvent &event) {
+        return event.getPitch() % 2 != 0;
+    });
+
+    QCOMPARE(list.size(), MappedEventList::size_type(1000));
+    int previous = -1;
+    for (const MappedEvent *event : list) {
+        QCOMPARE(event->getPitch() % 2, 0);
+        QVERIFY(event->getEventTime().sec > previous);
+        previous = event->getEventTime().sec;
+    }
+
+    // Nothing to erase.
+    list.eraseIf([](const MappedEvent &) { return false; });
+    QCOMPARE(list.size(), MappedEventList::size_type(1000));
+
+    // Everything.
+    list.eraseIf([](const MappedEvent &) { return true; });
+    QVERIFY(list.empty());
+
+    // The slab is still there to reuse.
+    list.insertCopy(makeEvent(0, 60));
+    QCOMPARE(pitches(list), QList<int>({60}));
+}
+
+void TestMappedEventList::testSort()
+{
+    MappedEventList list;
+
+    for (int i = 0; i < 4; ++i) {
+        list.insertCopy(makeEvent(i, MidiByte(60 + i)));
+    }
+
+    // As if the last instrument had less latency than the others.
+    (*(list.end() - 1))->setEventTime(RealTime::zero());
+    list.sort();
+
+    QCOMPARE(pitches(list), QList<int>({60, 63, 61, 62}));
+}
+
+void TestMappedEventList::testSortStable()
+{
+    MappedEventList list;
+
+    for (int i = 0; i < 1000; ++i) {
+        list.insertCopy(makeEvent(i, MidiByte(i % 100)));
+    }
+
+    // Every event lands on one of ten times, so there are plenty of
+    // equal ones.
+    for (MappedEvent *event : list) {
+        event->setEventTime(RealTime(9 - event->getEventTime().sec % 10, 0));
+    }
+    list.sort();
+
+    // In time order, and equal events in their old order.
+    for (MappedEventList::const_iterator i = list.begin() + 1;
+         i != list.end(); ++i) {
+        const MappedEvent *previous = *(i - 1);
+        QVERIFY(previous->getEventTime() <= (*i)->getEventTime());
+        if (previous->getEventTime() == (*i)->getEventTime())
+            QVERIFY(previous->getPitch() < (*i)->getPitch());
+    }
+}
+
+void TestMappedEventList::testSlabReuse()
+{
+    MappedEventList list;
+
+    list.insertCopy(makeEvent(0, 60));
+    const MappedEvent *first = *list.begin();
+
+    list.clear();
+    QVERIFY(list.empty());
+
+    // The same storage, no new allocation.
+    list.insertCopy(makeEvent(5, 70));
+    QCOMPARE(*list.begin(), first);
+    QCOMPARE(int((*list.begin())->getPitch()), 70);
+
+    // More than one block's worth.
+    list.clear();
+    for (int i = 0; i < 1000; ++i) {
+        list.insertCopy(makeEvent(1000 - i, 60));
+    }
+    QCOMPARE(list.size(), MappedEventList::size_type(1000));
+    QCOMPARE((*list.begin())->getEventTime(), RealTime(1, 0));
+}
+
+void TestMappedEventList::testCopy()
+{
+    MappedEventList list;
+    list.insertCopy(makeEvent(1, 60));
+    list.insert(new MappedEvent(makeEvent(0, 61)));
+
+    MappedEventList copy(list);
+    QCOMPARE(pitches(copy), QList<int>({61, 60}));
+    QVERIFY(*copy.begin() != *list.begin());
+
+    // Outlives the original's events.
+    list.clear();
+    QCOMPARE(pitches(copy), QList<int>({61, 60}));
+
+    MappedEventList assigned;
+    assigned.insertCopy(makeEvent(9, 99));
+    assigned = copy;
+    QCOMPARE(pitches(assigned), QList<int>({61, 60}));
+
+    assigned.merge(copy);
+    QCOMPARE(pitches(assigned), QList<int>({61, 61, 60, 60}));
+}
+
+QTEST_MAIN(TestMappedEventList)
+
+#include "mappedeventlist.moc"
@@ -0,0 +1,217 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "base/MemoryPool.h"
+
+#include <QTest>
+
+#include <cstdint>
+#include <cstring>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace Rosegarden;
+
+/// Unit test for the slab allocator behind Event, EventData and
+/// FlatPropertyMap.
+class TestMemoryPool : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testAllocateFree();
+    void testSmallObjects();
+    void testSlabReuse();
+    void testThreads();
+};
+
+namespace
+{
+    // Pools are never destroyed, so each test makes its own and leaks it.
+
+    /// Allocate from pool until it has the given number of slabs.
+    void allocateSlabs(MemoryPool &pool, size_t slabs,
+                       std::vector<void *> &objects)
+    {
+        while (pool.getStats().slabs < slabs) {
+            objects.push_back(pool.allocate());
+        }
+    }
+}
+
+void TestMemoryPool::testAllocateFree()
+{
+    MemoryPool &pool = *new MemoryPool("test allocate", 40);
+
+    std::set<void *> objects;
+    for (int i = 0; i < 100; ++i) {
+        void *p = pool.allocate();
+        QVERIFY(p);
+        QCOMPARE(reinterpret_cast<uintptr_t>(p) % alignof(std::max_align_t),
+                 uintptr_t(0));
+        // Nothing handed out twice.
+        QVERIFY(objects.insert(p).second);
+        // All of it is ours.
+        memset(p, 0xff, 40);
+    }
+
+    MemoryPool::Stats stats = pool.getStats();
+    QCOMPARE(stats.allocations, size_t(100));
+    QCOMPARE(stats.liveObjects, size_t(100));
+    QCOMPARE(stats.slabs, size_t(1));
+    QVERIFY(stats.objectSize >= 40);
+
+    // A freed object is the next one handed out.
+    void *freed = *objects.begin();
+    pool.deallocate(freed);
+    QCOMPARE(pool.allocate(), freed);
+
+    for (void *p : objects) {
+        pool.deallocate(p);
+    }
+    // Does nothing.
+    pool.deallocate(nullptr);
+
+    stats = pool.getStats();
+    QCOMPARE(stats.allocations, size_t(101));
+    QCOMPARE(stats.deallocations, size_t(101));
+    QCOMPARE(stats.liveObjects, size_t(0));
+    QCOMPARE(stats.peakObjects, size_t(100));
+}
+
+void TestMemoryPool::testSmallObjects()
+{
+    // Smaller than the free list link.
+    MemoryPool &pool = *new MemoryPool("test small", 1);
+    QVERIFY(pool.getStats().objectSize >= sizeof(void *));
+
+    std::vector<void *> objects;
+    for (int i = 0; i < 1000; ++i) {
+        objects.push_back(pool.allocate());
+        *static_cast<char *>(objects.back()) = char(i);
+    }
+    for (int i = 0; i < 1000; ++i) {
+        QCOMPARE(*static_cast<char *>(objects[i]), char(i));
+    }
+    for (void *p : objects) {
+        pool.deallocate(p);
+    }
+    QCOMPARE(pool.getStats().liveObjects, size_t(0));
+}
+
+void TestMemoryPool::testSlabReuse()
+{
+    MemoryPool &pool = *new MemoryPool("test slabs", 64);
+
+    // Two full slabs and the first object of a third.
+    std::vector<void *> objects;
+    allocateSlabs(pool, 2, objects);
+    const size_t perSlab = objects.size() - 1;
+    QVERIFY(perSlab > 100);
+    allocateSlabs(pool, 3, objects);
+    QCOMPARE(objects.size(), perSlab * 2 + 1);
+
+    // Slabs are 64KiB and aligned to that.
+    std::set<uintptr_t> slabs;
+    for (void *p : objects) {
+        slabs.insert(reinterpret_cast<uintptr_t>(p) & ~uintptr_t(0xffff));
+    }
+    QCOMPARE(slabs.size(), size_t(3));
+
+    // Freeing an object of a full slab puts the slab back on the
+    // partial list, and the next allocation reuses the object.
+    void *first = objects[0];
+    pool.deallocate(first);
+    QCOMPARE(pool.allocate(), first);
+    QCOMPARE(pool.getStats().slabs, size_t(3));
+
+    // Empty slabs go back to the system, except for one spare.
+    for (void *p : objects) {
+        pool.deallocate(p);
+    }
+    MemoryPool::Stats stats = pool.getStats();
+    QCOMPARE(stats.liveObjects, size_t(0));
+    QCOMPARE(stats.slabs, size_t(1));
+    QCOMPARE(stats.peakSlabs, size_t(3));
+
+    // The spare is used before a new slab is allocated.
+    objects.clear();
+    for (size_t i = 0; i < perSlab; ++i) {
+        objects.push_back(pool.allocate());
+    }
+    QCOMPARE(pool.getStats().slabs, size_t(1));
+    for (void *p : objects) {
+        pool.deallocate(p);
+    }
+    QCOMPARE(pool.getStats().slabs, size_t(1));
+}
+
+void TestMemoryPool::testThreads()
+{
+    MemoryPool &pool = *new MemoryPool("test threads", 32);
+
+    constexpr int threadCount = 4;
+    constexpr int rounds = 50;
+    constexpr int perRound = 5000;
+
+    bool ok[threadCount] = {};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&pool, &ok, t]() {
+            ok[t] = true;
+            std::vector<void *> objects;
+            for (int round = 0; round < rounds; ++round) {
+                for (int i = 0; i < perRound; ++i) {
+                    void *p = pool.allocate();
+                    memset(p, t, 32);
+                    objects.push_back(p);
+                }
+                // Nobody else wrote to ours.
+                for (void *p : objects) {
+                    if (static_cast<unsigned char *>(p)[31] != t)
+                        ok[t] = false;
+                }
+                // Free every other one, then the rest, so slabs are
+                // both partially and completely emptied.
+                for (size_t i = 0; i < objects.size(); i += 2) {
+                    pool.deallocate(objects[i]);
+                }
+                for (size_t i = 1; i < objects.size(); i += 2) {
+                    pool.deallocate(objects[i]);
+                }
+                objects.clear();
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    for (int t = 0; t < threadCount; ++t) {
+        QVERIFY(ok[t]);
+    }
+
+    const MemoryPool::Stats stats = pool.getStats();
+    QCOMPARE(stats.allocations, size_t(threadCount * rounds * perRound));
+    QCOMPARE(stats.deallocations, stats.allocations);
+    QCOMPARE(stats.liveObjects, size_t(0));
+    QVERIFY(stats.slabs <= 1);
+}
+
+QTEST_MAIN(TestMemoryPool)
+
+#include "memorypool.moc"
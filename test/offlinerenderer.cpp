@@ -0,0 +1,188 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "base/Composition.h"
+#include "base/Instrument.h"
+#include "base/RealTime.h"
+#include "base/Track.h"
+#include "document/RosegardenDocument.h"
+#include "sound/OfflineRenderer.h"
+#include "sound/SequencerDataBlock.h"
+
+#include <QByteArray>
+#include <QDir>
+#include <QFile>
+#include <QSettings>
+#include <QStringList>
+#include <QTemporaryDir>
+#include <QTest>
+#include <QtEndian>
+
+using namespace Rosegarden;
+
+/// Unit test for OfflineRenderer.
+/**
+ * OfflineRenderer is its own SoundDriver, so like DummyDriver this needs
+ * no sound hardware.
+ */
+class TestOfflineRenderer : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void testRender();
+};
+
+namespace
+{
+    constexpr unsigned a_sampleRate = 48000;
+
+    /// Frames in a WAV file, from its header.  -1 if it isn't one, or
+    /// isn't stereo.
+    long wavFrames(const QString &path)
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::ReadOnly))
+            return -1;
+        const QByteArray data = file.readAll();
+
+        if (data.size() < 12  ||
+            data.left(4) != "RIFF"  ||  data.mid(8, 4) != "WAVE")
+            return -1;
+
+        int blockAlign = 0;
+
+        // The chunks.
+        int pos = 12;
+        while (pos + 8 <= data.size()) {
+            const QByteArray id = data.mid(pos, 4);
+            const quint32 size =
+                    qFromLittleEndian<quint32>(data.constData() + pos + 4);
+            const char *body = data.constData() + pos + 8;
+
+            if (id == "fmt ") {
+                if (qFromLittleEndian<quint16>(body + 2) != 2)
+                    return -1;
+                blockAlign = qFromLittleEndian<quint16>(body + 12);
+            } else if (id == "data") {
+                if (blockAlign == 0)
+                    return -1;
+                return long(size / blockAlign);
+            }
+
+            // Chunks are padded to an even length.
+            pos += 8 + int(size) + int(size & 1);
+        }
+
+        return -1;
+    }
+}
+
+void TestOfflineRenderer::initTestCase()
+{
+    // Make sure settings end up in the right place.
+    QCoreApplication::setOrganizationName("rosegardenmusic");
+
+    QSettings settings;
+    settings.beginGroup("Sequencer_Options");
+    // Don't start JACK.
+    settings.setValue("autostartjack", false);
+}
+
+void TestOfflineRenderer::testRender()
+{
+    RosegardenDocument doc(
+            nullptr,  // parent
+            {},  // audioPluginManager
+            true,  // skipAutoload
+            true,  // clearCommandHistory
+            false);  // useSequencer
+
+    RosegardenDocument::currentDocument = &doc;
+
+    // Four MIDI tracks.
+    QVERIFY(doc.openDocument(
+            QFINDTESTDATA("../data/examples/aylindaamiga.rg"),
+            false,  // permanent
+            true,  // squelchProgressDialog
+            false));  // enableLock
+
+    Composition &composition = doc.getComposition();
+
+    // Two audio instruments, one of them on two tracks, and a synth.
+    const InstrumentId instruments[] = {
+        AudioInstrumentBase, AudioInstrumentBase + 1, AudioInstrumentBase,
+        SoftSynthInstrumentBase
+    };
+    for (const InstrumentId instrument : instruments) {
+        composition.addTrack(new Track(composition.getNewTrackId(),
+                                       instrument,
+                                       composition.getNbTracks()));
+    }
+
+    // A bar and a bit, so the end isn't on a block boundary.
+    composition.setStartMarker(0);
+    composition.setEndMarker(3840 + 7);
+
+    const long expectedFrames = RealTime::realTime2Frame(
+            composition.getElapsedRealTime(composition.getEndMarker()),
+            a_sampleRate);
+    QVERIFY(expectedFrames > 0);
+    QVERIFY(expectedFrames % 2048 != 0);
+
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString stemDir = dir.path() + "/stems";
+    QVERIFY(QDir().mkpath(stemDir));
+    const QString masterPath = dir.path() + "/master.wav";
+
+    OfflineRenderer renderer(a_sampleRate, 2048);
+
+    QCOMPARE(renderer.addStems(&doc, stemDir), 3);
+
+    SequencerDataBlock *dataBlock = SequencerDataBlock::getInstance();
+    const int performanceCount = dataBlock->getInstrumentPerformanceCount();
+
+    QVERIFY(renderer.render(&doc, masterPath));
+    QCOMPARE(renderer.getError(), QString());
+    QCOMPARE(long(renderer.getFramesRendered()), expectedFrames);
+
+    // The performance counters are the live mixer's alone.
+    QCOMPARE(dataBlock->getInstrumentPerformanceCount(), performanceCount);
+
+    QCOMPARE(wavFrames(masterPath), expectedFrames);
+
+    // One per instrument, named for its ID.
+    const QDir stemsDir(stemDir);
+    QCOMPARE(stemsDir.entryList(QDir::Files).size(), 3);
+    const InstrumentId stemInstruments[] = {
+        AudioInstrumentBase, AudioInstrumentBase + 1, SoftSynthInstrumentBase
+    };
+    for (const InstrumentId instrument : stemInstruments) {
+        const QStringList stems = stemsDir.entryList(
+                QStringList(QString("%1-*.wav").arg(instrument)),
+                QDir::Files);
+        QCOMPARE(stems.size(), 1);
+        QCOMPARE(wavFrames(stemsDir.filePath(stems[0])), expectedFrames);
+    }
+
+    RosegardenDocument::currentDocument = nullptr;
+}
+
+QTEST_MAIN(TestOfflineRenderer)
+
+#include "offlinerenderer.moc"
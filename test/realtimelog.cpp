@@ -0,0 +1,217 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#define RG_MODULE_STRING "[test]"
+
+#include "sound/RealTimeLog.h"
+
+#include <QTest>
+
+#include <map>
+#include <thread>
+#include <vector>
+
+using namespace Rosegarden;
+
+/// Unit test for RealTimeLog.
+class TestRealTimeLog : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void init();
+
+    void testFormat();
+    void testOrderPerThread();
+    void testFullRingDrops();
+    void testChannelReuse();
+    void testReleaseChannel();
+    void testUnregistered();
+};
+
+namespace
+{
+    const char *const a_countMessage = "count %1 from %2";
+
+    // Everything left over from earlier tests.
+    void discardAll()
+    {
+        RealTimeLog::Message message;
+        while (RealTimeLog::read(message)) { }
+        RealTimeLog::takeDroppedCount();
+    }
+}
+
+void TestRealTimeLog::initTestCase()
+{
+    // This thread logs too.
+    QVERIFY(RealTimeLog::registerThread());
+    QVERIFY(RealTimeLog::registerThread());
+}
+
+void TestRealTimeLog::init()
+{
+    discardAll();
+}
+
+void TestRealTimeLog::testFormat()
+{
+    RG_RT_LOG("read %1 of %2 frames for %3 ch %4", 100, 256, 1000, 1);
+    RG_RT_LOG("no arguments");
+
+    RealTimeLog::Message message;
+    QVERIFY(RealTimeLog::read(message));
+    QCOMPARE(RealTimeLog::toString(message),
+             QString("[test] read 100 of 256 frames for 1000 ch 1"));
+    QVERIFY(message.time > RealTime::zero());
+
+    QVERIFY(RealTimeLog::read(message));
+    QCOMPARE(RealTimeLog::toString(message), QString("[test] no arguments"));
+
+    QVERIFY(!RealTimeLog::read(message));
+}
+
+void TestRealTimeLog::testOrderPerThread()
+{
+    const int threadCount = 4;
+    const int perThread = 100;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadCount; ++t) {
+        threads.emplace_back([t]() {
+            RealTimeLog::registerThread();
+            for (int i = 0; i < perThread; ++i)
+                RealTimeLog::log(a_countMessage, i, t);
+            RealTimeLog::unregisterThread();
+        });
+    }
+    for (std::thread &thread : threads)
+        thread.join();
+
+    // Each thread's messages arrive complete and in order.
+    std::map<long long, long long> next;
+    int total = 0;
+    RealTimeLog::Message message;
+    while (RealTimeLog::read(message)) {
+        QCOMPARE(message.format, a_countMessage);
+        QCOMPARE(message.argCount, 2);
+        QCOMPARE(message.args[0], next[message.args[1]]);
+        ++next[message.args[1]];
+        ++total;
+    }
+
+    QCOMPARE(total, threadCount * perThread);
+    QCOMPARE(RealTimeLog::takeDroppedCount(), 0);
+}
+
+void TestRealTimeLog::testFullRingDrops()
+{
+    // Far more than one ring holds, with nobody reading.
+    const int count = 10000;
+    for (int i = 0; i < count; ++i)
+        RealTimeLog::log(a_countMessage, i, 0);
+
+    int read = 0;
+    RealTimeLog::Message message;
+    while (RealTimeLog::read(message)) {
+        // The oldest are kept, the newest dropped.
+        QCOMPARE(message.args[0], (long long)read);
+        ++read;
+    }
+
+    QVERIFY(read > 0);
+    QCOMPARE(RealTimeLog::takeDroppedCount(), count - read);
+    QCOMPARE(RealTimeLog::takeDroppedCount(), 0);
+}
+
+void TestRealTimeLog::testChannelReuse()
+{
+    // More short-lived threads than there are channels.  Each releases
+    // its channel before it exits, so nothing is dropped.
+    for (int t = 0; t < 100; ++t) {
+        std::thread thread([t]() {
+            RealTimeLog::registerThread();
+            RealTimeLog::log(a_countMessage, 0, t);
+            RealTimeLog::unregisterThread();
+        });
+        thread.join();
+    }
+
+    int read = 0;
+    RealTimeLog::Message message;
+    while (RealTimeLog::read(message))
+        ++read;
+
+    QCOMPARE(read, 100);
+    QCOMPARE(RealTimeLog::takeDroppedCount(), 0);
+}
+
+void TestRealTimeLog::testReleaseChannel()
+{
+    // Threads that never unregister, as JACK's don't, with their rings
+    // released by someone else once they've gone.
+    for (int t = 0; t < 100; ++t) {
+        int channel = -1;
+        std::thread thread([t, &channel]() {
+            RealTimeLog::registerThread();
+            channel = RealTimeLog::getThreadChannel();
+            RealTimeLog::log(a_countMessage, 0, t);
+        });
+        thread.join();
+
+        QVERIFY(channel >= 0);
+        RealTimeLog::releaseChannel(channel);
+    }
+
+    int read = 0;
+    RealTimeLog::Message message;
+    while (RealTimeLog::read(message))
+        ++read;
+
+    QCOMPARE(read, 100);
+    QCOMPARE(RealTimeLog::takeDroppedCount(), 0);
+
+    // No ring, nothing to release.
+    int none = 0;
+    std::thread([&none]() {
+        none = RealTimeLog::getThreadChannel();
+    }).join();
+    QCOMPARE(none, -1);
+    RealTimeLog::releaseChannel(none);
+}
+
+void TestRealTimeLog::testUnregistered()
+{
+    // Never registered, or no longer.
+    std::thread thread([]() {
+        RealTimeLog::log(a_countMessage, 0, 0);
+        RealTimeLog::registerThread();
+        RealTimeLog::log(a_countMessage, 1, 0);
+        RealTimeLog::unregisterThread();
+        RealTimeLog::log(a_countMessage, 2, 0);
+    });
+    thread.join();
+
+    RealTimeLog::Message message;
+    QVERIFY(RealTimeLog::read(message));
+    QCOMPARE(message.args[0], 1LL);
+    QVERIFY(!RealTimeLog::read(message));
+    QCOMPARE(RealTimeLog::takeDroppedCount(), 2);
+}
+
+QTEST_MAIN(TestRealTimeLog)
+
+#include "realtimelog.moc"
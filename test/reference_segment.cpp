@@ -32,7 +32,7 @@ void TestReferenceSegment::testEventType()
 {
     ReferenceSegment rs(TempoEventType);
     std::string et = rs.getEventType();
-    QCOMPARE(et, TempoEventType);
+    QCOMPARE(et, std::string(TempoEventType));
 }
 
 /**
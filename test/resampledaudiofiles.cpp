@@ -0,0 +1,227 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "sound/ResampledAudioFiles.h"
+#include "sound/AudioFile.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QTest>
+
+using namespace Rosegarden;
+
+/// Unit test for ResampledAudioFiles.
+class TestResampledAudioFiles : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testCopyPath();
+    void testAddAndFind();
+    void testSourceChanged();
+    void testForget();
+
+private:
+    QTemporaryDir m_dir;
+};
+
+namespace
+{
+    /// Write a 16-bit WAV file of silence, with one non-zero sample.
+    bool writeWav(const QString &path, int sampleRate, int channels,
+                  int frames, qint16 sample)
+    {
+        QFile file(path);
+        if (!file.open(QIODevice::WriteOnly))
+            return false;
+
+        const quint32 dataBytes = quint32(frames * channels * 2);
+
+        QDataStream out(&file);
+        out.setByteOrder(QDataStream::LittleEndian);
+
+        out.writeRawData("RIFF", 4);
+        out << quint32(36 + dataBytes);
+        out.writeRawData("WAVE", 4);
+
+        out.writeRawData("fmt ", 4);
+        out << quint32(16);
+        out << quint16(1);  // PCM
+        out << quint16(channels);
+        out << quint32(sampleRate);
+        out << quint32(sampleRate * channels * 2);
+        out << quint16(channels * 2);
+        out << quint16(16);
+
+        out.writeRawData("data", 4);
+        out << dataBytes;
+        out << sample;
+        for (quint32 i = 2; i < dataBytes; i += 2) {
+            out << qint16(0);
+        }
+
+        return out.status() == QDataStream::Ok;
+    }
+}
+
+void TestResampledAudioFiles::testCopyPath()
+{
+    QVERIFY(m_dir.isValid());
+
+    const QString source = m_dir.filePath("source.wav");
+    QVERIFY(writeWav(source, 44100, 1, 1000, 1));
+
+    const QString path =
+            ResampledAudioFiles::getCopyPath(source, 48000, 2);
+    QVERIFY(path.startsWith(source + "."));
+    QVERIFY(path.endsWith("-48000-2.rs.wav"));
+
+    // The same every time.
+    QCOMPARE(ResampledAudioFiles::getCopyPath(source, 48000, 2), path);
+
+    // Different for other rates and channels.
+    QVERIFY(ResampledAudioFiles::getCopyPath(source, 96000, 2) != path);
+    QVERIFY(ResampledAudioFiles::getCopyPath(source, 48000, 1) != path);
+
+    // A changed source gets a new copy.
+    QVERIFY(writeWav(source, 44100, 1, 1000, 2));
+    QVERIFY(ResampledAudioFiles::getCopyPath(source, 48000, 2) != path);
+
+    QVERIFY(ResampledAudioFiles::getCopyPath(
+            m_dir.filePath("missing.wav"), 48000, 2).isEmpty());
+}
+
+void TestResampledAudioFiles::testAddAndFind()
+{
+    QVERIFY(m_dir.isValid());
+
+    ResampledAudioFiles *resampledFiles = ResampledAudioFiles::getInstance();
+
+    const QString source = m_dir.filePath("take.wav");
+    QVERIFY(writeWav(source, 44100, 1, 1000, 1));
+
+    QVERIFY(!resampledFiles->find(source, 48000, 2));
+
+    const QString copyPath =
+            ResampledAudioFiles::getCopyPath(source, 48000, 2);
+    QVERIFY(writeWav(copyPath, 48000, 2, 1088, 1));
+
+    // Not what it says it is.
+    QVERIFY(!resampledFiles->add(source, 96000, 2, copyPath));
+    QVERIFY(!resampledFiles->add(source, 48000, 1, copyPath));
+    QVERIFY(!resampledFiles->add(
+            source, 48000, 2, m_dir.filePath("missing.wav")));
+    QVERIFY(!resampledFiles->find(source, 48000, 2));
+
+    QVERIFY(resampledFiles->add(source, 48000, 2, copyPath));
+
+    AudioFile *copy = resampledFiles->find(source, 48000, 2);
+    QVERIFY(copy);
+    QCOMPARE(copy->getAbsoluteFilePath(), copyPath);
+    QCOMPARE(int(copy->getSampleRate()), 48000);
+    QCOMPARE(int(copy->getChannels()), 2);
+
+    // Only for that rate and channel count.
+    QVERIFY(!resampledFiles->find(source, 48000, 1));
+    QVERIFY(!resampledFiles->find(source, 96000, 2));
+}
+
+void TestResampledAudioFiles::testSourceChanged()
+{
+    QVERIFY(m_dir.isValid());
+
+    ResampledAudioFiles *resampledFiles = ResampledAudioFiles::getInstance();
+
+    const QString source = m_dir.filePath("edited.wav");
+    QVERIFY(writeWav(source, 44100, 1, 1000, 1));
+
+    const QString copyPath =
+            ResampledAudioFiles::getCopyPath(source, 48000, 2);
+    QVERIFY(writeWav(copyPath, 48000, 2, 1088, 1));
+    QVERIFY(resampledFiles->add(source, 48000, 2, copyPath));
+
+    AudioFile *copy = resampledFiles->find(source, 48000, 2);
+    QVERIFY(copy);
+
+    // Edited after the copy was made.
+    QVERIFY(writeWav(source, 44100, 1, 2000, 1));
+    QVERIFY(!resampledFiles->find(source, 48000, 2));
+
+    // Still there for anyone who was reading it.
+    QCOMPARE(copy->getAbsoluteFilePath(), copyPath);
+
+    // A copy of the edited source is used.
+    const QString newCopyPath =
+            ResampledAudioFiles::getCopyPath(source, 48000, 2);
+    QVERIFY(newCopyPath != copyPath);
+    QVERIFY(writeWav(newCopyPath, 48000, 2, 2176, 1));
+    QVERIFY(resampledFiles->add(source, 48000, 2, newCopyPath));
+
+    AudioFile *newCopy = resampledFiles->find(source, 48000, 2);
+    QVERIFY(newCopy);
+    QCOMPARE(newCopy->getAbsoluteFilePath(), newCopyPath);
+
+    resampledFiles->forget(source);
+}
+
+void TestResampledAudioFiles::testForget()
+{
+    QVERIFY(m_dir.isValid());
+
+    ResampledAudioFiles *resampledFiles = ResampledAudioFiles::getInstance();
+
+    const QString source = m_dir.filePath("closed.wav");
+    QVERIFY(writeWav(source, 44100, 1, 1000, 1));
+    const QString other = m_dir.filePath("other.wav");
+    QVERIFY(writeWav(other, 44100, 1, 1000, 1));
+
+    // Two copies of source, one of them replaced, and one of other.
+    const QString stereoPath =
+            ResampledAudioFiles::getCopyPath(source, 48000, 2);
+    QVERIFY(writeWav(stereoPath, 48000, 2, 1088, 1));
+    QVERIFY(resampledFiles->add(source, 48000, 2, stereoPath));
+    QVERIFY(resampledFiles->add(source, 48000, 2, stereoPath));
+    const QString monoPath =
+            ResampledAudioFiles::getCopyPath(source, 48000, 1);
+    QVERIFY(writeWav(monoPath, 48000, 1, 1088, 1));
+    QVERIFY(resampledFiles->add(source, 48000, 1, monoPath));
+    const QString otherPath =
+            ResampledAudioFiles::getCopyPath(other, 48000, 2);
+    QVERIFY(writeWav(otherPath, 48000, 2, 1088, 1));
+    QVERIFY(resampledFiles->add(other, 48000, 2, otherPath));
+
+    // As when the document is closed.
+    resampledFiles->forget(source);
+
+    QVERIFY(!resampledFiles->find(source, 48000, 2));
+    QVERIFY(!resampledFiles->find(source, 48000, 1));
+    QVERIFY(resampledFiles->find(other, 48000, 2));
+
+    // Nothing to forget.
+    resampledFiles->forget(source);
+    resampledFiles->forget(m_dir.filePath("missing.wav"));
+
+    // Opened again.
+    QVERIFY(resampledFiles->add(source, 48000, 2, stereoPath));
+    QVERIFY(resampledFiles->find(source, 48000, 2));
+
+    resampledFiles->forget(source);
+    resampledFiles->forget(other);
+}
+
+QTEST_MAIN(TestResampledAudioFiles)
+
+#include "resampledaudiofiles.moc"
@@ -0,0 +1,246 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "base/Event.h"
+#include "base/NotationTypes.h"
+#include "base/Segment.h"
+
+#include <QTest>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+using namespace Rosegarden;
+
+/// Unit test and benchmark for Segment's EventContainer.
+class TestSegmentContainer : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+    void cleanupTestCase();
+
+    void testOrdering();
+    void testCopies();
+    void testFind();
+
+    void benchmarkAppend();
+    void benchmarkInsertRandom();
+    void benchmarkRangeScan();
+    void benchmarkFindTime();
+
+private:
+    // 1M notes, one every 10 ticks.
+    static const int EventCount = 1000000;
+
+    std::vector<Event *> m_events;
+    // m_events in shuffled order, as e.g. a quantize or a merge would
+    // deliver them.
+    std::vector<Event *> m_shuffled;
+};
+
+namespace
+{
+    long scan(const EventContainer &container, timeT from, timeT to)
+    {
+        long sum = 0;
+        Event temp("temp", from, 0, MIN_SUBORDERING);
+        for (EventContainer::const_iterator i =
+                     container.lower_bound(&temp);
+             i != container.end()  &&  (*i)->getAbsoluteTime() < to;
+             ++i) {
+            sum += (*i)->getDuration();
+        }
+        return sum;
+    }
+
+    void fill(EventContainer &container, const std::vector<Event *> &events)
+    {
+        for (Event *event : events)
+            container.insert(event);
+    }
+}
+
+void TestSegmentContainer::initTestCase()
+{
+    m_events.reserve(EventCount);
+    for (int i = 0; i < EventCount; ++i)
+        m_events.push_back(new Event(Note::EventType, i * 10, 10));
+
+    m_shuffled = m_events;
+    std::mt19937 rng(42);
+    std::shuffle(m_shuffled.begin(), m_shuffled.end(), rng);
+}
+
+void TestSegmentContainer::cleanupTestCase()
+{
+    for (Event *event : m_events)
+        delete event;
+    m_events.clear();
+    m_shuffled.clear();
+}
+
+void TestSegmentContainer::testOrdering()
+{
+    EventContainer container;
+
+    // Same time, different subordering.  Lower subordering first.
+    Event a(Note::EventType, 100, 10, 0);
+    Event b(Note::EventType, 100, 10, -5);
+    Event c(Note::EventType, 50, 10, 0);
+    Event d(Note::EventType, 100, 10, 0);
+    container.insert(&a);
+    container.insert(&b);
+    container.insert(&c);
+    container.insert(&d);
+
+    QCOMPARE(container.size(), size_t(4));
+
+    EventContainer::const_iterator i = container.begin();
+    QCOMPARE(*i, &c);
+    ++i;
+    QCOMPARE(*i, &b);
+    ++i;
+    // Equal events stay in insertion order.
+    QCOMPARE(*i, &a);
+    ++i;
+    QCOMPARE(*i, &d);
+
+    // Erase doesn't disturb the others.
+    container.erase(container.find(&b));
+    QCOMPARE(container.size(), size_t(3));
+    QCOMPARE(*container.begin(), &c);
+    QCOMPARE(*container.rbegin(), &d);
+}
+
+void TestSegmentContainer::testCopies()
+{
+    Event note(Note::EventType, 960, 480, 0);
+    note.set<Int>(PropertyName("pitch"), 60);
+
+    // Copies share the data but carry their own time.
+    Event moved(note, 1920);
+    QCOMPARE(moved.getAbsoluteTime(), timeT(1920));
+    QCOMPARE(moved.getNotationAbsoluteTime(), timeT(1920));
+    QCOMPARE(moved.getDuration(), timeT(480));
+    QCOMPARE(moved.get<Int>(PropertyName("pitch")), long(60));
+    QCOMPARE(note.getAbsoluteTime(), timeT(960));
+    QCOMPARE(note.getNotationAbsoluteTime(), timeT(960));
+
+    Event copy(note);
+    QVERIFY(copy.isCopyOf(note));
+    QVERIFY(!moved.isCopyOf(note));
+    QCOMPARE(copy.getAbsoluteTime(), timeT(960));
+
+    Event assigned(Note::EventRestType, 0, 10);
+    assigned = moved;
+    QCOMPARE(assigned.getAbsoluteTime(), timeT(1920));
+    QVERIFY(assigned.isa(Note::EventType));
+
+    Event *copyMoved = note.copyMoving(100);
+    QCOMPARE(copyMoved->getAbsoluteTime(), timeT(1060));
+    QCOMPARE(copyMoved->getNotationAbsoluteTime(), timeT(1060));
+    QCOMPARE(copyMoved->getSubOrdering(), short(0));
+    delete copyMoved;
+}
+
+void TestSegmentContainer::testFind()
+{
+    Segment segment;
+    for (timeT t = 0; t < 1000; t += 10)
+        segment.insert(new Event(Note::EventType, t, 10));
+
+    Segment::iterator i = segment.findTime(55);
+    QVERIFY(i != segment.end());
+    QCOMPARE((*i)->getAbsoluteTime(), timeT(60));
+
+    i = segment.findTime(60);
+    QCOMPARE((*i)->getAbsoluteTime(), timeT(60));
+
+    i = segment.findNearestTime(55);
+    QVERIFY(i != segment.end());
+    QCOMPARE((*i)->getAbsoluteTime(), timeT(50));
+
+    QVERIFY(segment.findTime(5000) == segment.end());
+    QVERIFY(segment.findNearestTime(-10) == segment.end());
+
+    QCOMPARE(scan(segment, 100, 200), long(100));
+}
+
+void TestSegmentContainer::benchmarkAppend()
+{
+    // As when loading or recording.  Segment::insert() takes the
+    // append fast path for every Event.
+    QBENCHMARK {
+        Segment segment;
+        for (const Event *event : m_events)
+            segment.insert(new Event(*event));
+        QCOMPARE(segment.size(), size_t(EventCount));
+    }
+}
+
+void TestSegmentContainer::benchmarkInsertRandom()
+{
+    QBENCHMARK {
+        EventContainer container;
+        fill(container, m_shuffled);
+        QCOMPARE(container.size(), size_t(EventCount));
+    }
+}
+
+void TestSegmentContainer::benchmarkRangeScan()
+{
+    EventContainer container;
+    fill(container, m_events);
+
+    long sum = 0;
+    QBENCHMARK {
+        // A bar's worth of notes at a time across the whole container,
+        // like the mappers and the notation layout do.
+        sum = 0;
+        for (timeT t = 0; t < EventCount * 10; t += 3840)
+            sum += scan(container, t, t + 3840);
+    }
+    QCOMPARE(sum, long(EventCount) * 10);
+}
+
+void TestSegmentContainer::benchmarkFindTime()
+{
+    Segment segment;
+    for (int i = 0; i < EventCount; ++i)
+        segment.insert(new Event(Note::EventType, i * 10, 10));
+
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<timeT> dist(0, EventCount * 10);
+    std::vector<timeT> times(10000);
+    for (timeT &t : times)
+        t = dist(rng);
+
+    long found = 0;
+    QBENCHMARK {
+        found = 0;
+        for (timeT t : times) {
+            if (segment.findTime(t) != segment.end())
+                ++found;
+        }
+    }
+    QVERIFY(found > 0);
+}
+
+QTEST_MAIN(TestSegmentContainer)
+
+#include "segmentcontainer.moc"
@@ -0,0 +1,438 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "base/BaseProperties.h"
+#include "base/Composition.h"
+#include "base/Event.h"
+#include "base/Segment.h"
+#include "base/TriggerSegment.h"
+#include "document/GzipFile.h"
+#include "document/RosegardenDocument.h"
+#include "document/RoseXmlHandler.h"
+#include "document/io/XMLReader.h"
+#include "misc/Strings.h"
+
+#include <QPointer>
+#include <QProgressDialog>
+#include <QSettings>
+#include <QTemporaryDir>
+#include <QTest>
+
+using namespace Rosegarden;
+using namespace BaseProperties;
+
+/// Unit test and benchmark for reading segment contents in parallel.
+/**
+ * RosegardenDocument::xmlParse() has the XMLReader defer the content of
+ * each <segment> to a SegmentXmlHandler on a worker thread.  Without the
+ * deferral, RoseXmlHandler hands the same elements to a SegmentXmlHandler
+ * inline, as it did before.  Both must give the same Composition.
+ */
+class TestSegmentXmlHandler : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void testContent();
+    void testSameAsInline();
+    void testExampleFile();
+
+    void benchmarkLoadWhole();
+    void benchmarkLoadInline();
+    void benchmarkLoadDeferred();
+
+private:
+    QTemporaryDir m_dir;
+    QString m_contentFile;
+    QString m_largeFile;
+};
+
+namespace
+{
+    const char *a_header =
+        "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+        "<!DOCTYPE rosegarden-data>\n"
+        "<rosegarden-data version=\"16.13\" format-version-major=\"1\" "
+        "format-version-minor=\"6\" format-version-point=\"2\">\n"
+        "<composition recordtracks=\"0\" pointer=\"0\" "
+        "defaultTempo=\"120.0000\" compositionDefaultTempo=\"12000000\" "
+        "startMarker=\"0\" endMarker=\"384000\" selected=\"0\" "
+        "nexttriggerid=\"1\" panlaw=\"0\">\n"
+        "  <track id=\"0\" label=\"\" position=\"0\" muted=\"false\" "
+        "instrument=\"2000\"/>\n"
+        "  <track id=\"1\" label=\"\" position=\"1\" muted=\"false\" "
+        "instrument=\"2001\"/>\n"
+        "  <timesignature time=\"0\" numerator=\"4\" denominator=\"4\"/>\n"
+        "  <tempo time=\"0\" bph=\"7200\" tempo=\"12000000\"/>\n"
+        "</composition>\n";
+
+    /// Everything SegmentXmlHandler deals with: chords, the deprecated
+    /// <group> and <resync>, stored group IDs, triggers, the matrix and
+    /// notation settings and the end marker.
+    const char *a_content =
+        "<segment track=\"0\" start=\"0\" label=\"content\" "
+        "endmarker=\"7680\">\n"
+        "  <event type=\"clefchange\" subordering=\"-250\" absoluteTime=\"0\">"
+        "<property name=\"clef\" string=\"treble\"/></event>\n"
+        "  <chord>\n"
+        "    <event type=\"note\" duration=\"960\">"
+        "<property name=\"pitch\" int=\"60\"/></event>\n"
+        "    <event type=\"note\" duration=\"480\">"
+        "<property name=\"pitch\" int=\"64\"/></event>\n"
+        "    <event type=\"note\" duration=\"960\">"
+        "<property name=\"pitch\" int=\"67\"/></event>\n"
+        "  </chord>\n"
+        "  <group type=\"tupled\" base=\"320\" tupled=\"2\" untupled=\"3\">\n"
+        "    <event type=\"note\" duration=\"320\">"
+        "<property name=\"pitch\" int=\"62\"/></event>\n"
+        "    <event type=\"note\" duration=\"320\">"
+        "<property name=\"pitch\" int=\"64\"/></event>\n"
+        "    <event type=\"note\" duration=\"320\">"
+        "<property name=\"pitch\" int=\"65\"/></event>\n"
+        "  </group>\n"
+        "  <resync time=\"3840\"/>\n"
+        "  <event type=\"note\" duration=\"480\">"
+        "<property name=\"pitch\" int=\"67\"/>"
+        "<property name=\"groupid\" int=\"12\"/>"
+        "<property name=\"grouptype\" string=\"beamed\"/>"
+        "<nproperty name=\"Beamed\" bool=\"true\"/></event>\n"
+        "  <event type=\"note\" duration=\"480\">"
+        "<property name=\"pitch\" int=\"69\"/>"
+        "<property name=\"groupid\" int=\"12\"/>"
+        "<property name=\"grouptype\" string=\"beamed\"/></event>\n"
+        "  <event type=\"note\" duration=\"960\" absoluteTime=\"5760\">"
+        "<property name=\"pitch\" int=\"72\"/>"
+        "<property name=\"triggersegmentid\" int=\"0\"/>"
+        "<property name=\"triggersegmentretune\" bool=\"true\"/>"
+        "<property name=\"triggersegmentadjusttimes\" string=\"squish\"/>"
+        "</event>\n"
+        "  <matrix>\n"
+        "    <hzoom factor=\"2.5\"/>\n"
+        "    <vzoom factor=\"1.5\"/>\n"
+        "    <ruler type=\"controller\" ccnumber=\"7\"/>\n"
+        "  </matrix>\n"
+        "  <notation>\n"
+        "    <ruler type=\"controller\" ccnumber=\"10\"/>\n"
+        "  </notation>\n"
+        "</segment>\n"
+        "<segment track=\"1\" start=\"0\" label=\"ornament\" triggerid=\"0\" "
+        "triggerbasepitch=\"60\" triggerbasevelocity=\"100\" "
+        "triggerretune=\"true\" triggeradjusttimes=\"squish\">\n"
+        "  <event type=\"note\" duration=\"120\">"
+        "<property name=\"pitch\" int=\"60\"/></event>\n"
+        "  <event type=\"note\" duration=\"120\">"
+        "<property name=\"pitch\" int=\"62\"/></event>\n"
+        "</segment>\n"
+        "<segment track=\"1\" start=\"7680\" label=\"linked a\" linkerid=\"3\">\n"
+        "  <event type=\"note\" duration=\"960\">"
+        "<property name=\"pitch\" int=\"55\"/></event>\n"
+        "</segment>\n"
+        "<segment track=\"1\" start=\"15360\" label=\"linked b\" "
+        "linkerid=\"3\">\n"
+        "  <event type=\"note\" duration=\"960\">"
+        "<property name=\"pitch\" int=\"55\"/></event>\n"
+        "</segment>\n"
+        "<segment track=\"0\" start=\"23040\" label=\"empty\" "
+        "endmarker=\"23040\"/>\n";
+
+    const char *a_footer = "</rosegarden-data>\n";
+
+    /// A document with many, long segments.
+    QString makeLargeDocument()
+    {
+        QString xml = a_header;
+
+        // 48 segments of 8000 notes, about 50MB.
+        for (int s = 0; s < 48; ++s) {
+            xml += QString("<segment track=\"%1\" start=\"0\" "
+                           "label=\"segment %2\">\n").arg(s % 2).arg(s);
+            for (int i = 0; i < 8000; ++i) {
+                xml += QString(
+                        "<event type=\"note\" duration=\"240\">"
+                        "<property name=\"pitch\" int=\"%1\"/>"
+                        "<property name=\"velocity\" int=\"100\"/>"
+                        "<nproperty name=\"notetype\" int=\"3\"/>"
+                        "<nproperty name=\"notedots\" int=\"0\"/>"
+                        "</event>\n").arg(48 + i % 36);
+            }
+            xml += "</segment>\n";
+        }
+
+        xml += a_footer;
+        return xml;
+    }
+
+    RosegardenDocument *makeDocument()
+    {
+        return new RosegardenDocument(
+                nullptr,  // parent
+                {},  // audioPluginManager
+                true,  // skipAutoload
+                true,  // clearCommandHistory
+                false);  // useSequencer
+    }
+
+    /// Load fileName into doc as RosegardenDocument::xmlParse() does,
+    /// with or without reading the segment contents in parallel.
+    bool load(RosegardenDocument *doc, const QString &fileName,
+              bool deferred)
+    {
+        RoseXmlHandler handler(doc, QPointer<QProgressDialog>(), false);
+        XMLReader reader;
+        reader.setHandler(&handler);
+        if (deferred)
+            reader.setDeferredElement("segment");
+
+        GzipFile file(fileName);
+        if (!file.openForReading())
+            return false;
+        return reader.parse(file);
+    }
+
+    QString describe(const Segment &segment)
+    {
+        QString description = QString(
+                "%1 track %2 start %3 end %4 marker %5 linked %6 "
+                "zoom %7 %8 rulers %9 %10\n")
+                .arg(strtoqstr(segment.getLabel()))
+                .arg(segment.getTrack())
+                .arg(segment.getStartTime())
+                .arg(segment.getEndTime())
+                .arg(segment.getEndMarkerTime(false))
+                .arg(int(segment.isLinked()))
+                .arg(segment.matrixHZoomFactor)
+                .arg(segment.matrixVZoomFactor)
+                .arg(int(segment.matrixRulers->size()))
+                .arg(int(segment.notationRulers->size()));
+
+        for (const Event *event : segment) {
+            description += strtoqstr(event->toXmlString(0));
+        }
+
+        return description;
+    }
+
+    /// All the segments and trigger segments of a Composition, in an
+    /// order that doesn't depend on where they are in memory.
+    QStringList describe(const Composition &composition)
+    {
+        QStringList descriptions;
+
+        for (const Segment *segment : composition) {
+            descriptions << describe(*segment);
+        }
+
+        for (const TriggerSegmentRec *rec :
+                 composition.getTriggerSegments()) {
+            descriptions << QString("trigger %1 pitch %2 velocity %3 "
+                                    "retune %4 adjust %5 references %6\n")
+                            .arg(rec->getId())
+                            .arg(rec->getBasePitch())
+                            .arg(rec->getBaseVelocity())
+                            .arg(int(rec->getDefaultRetune()))
+                            .arg(strtoqstr(rec->getDefaultTimeAdjust()))
+                            .arg(int(rec->getReferences().size())) +
+                            describe(*rec->getSegment());
+        }
+
+        descriptions.sort();
+        return descriptions;
+    }
+
+    const Segment *findSegment(const Composition &composition,
+                               const std::string &label)
+    {
+        for (const Segment *segment : composition) {
+            if (segment->getLabel() == label)
+                return segment;
+        }
+        return nullptr;
+    }
+}
+
+void TestSegmentXmlHandler::initTestCase()
+{
+    // Make sure settings end up in the right place.
+    QCoreApplication::setOrganizationName("rosegardenmusic");
+
+    QSettings settings;
+    settings.beginGroup("Sequencer_Options");
+    // Don't start JACK.
+    settings.setValue("autostartjack", false);
+
+    QVERIFY(m_dir.isValid());
+
+    m_contentFile = m_dir.filePath("content.rg");
+    QVERIFY(GzipFile::writeToFile(
+            m_contentFile,
+            QString(a_header) + QString(a_content) + QString(a_footer)));
+
+    m_largeFile = m_dir.filePath("large.rg");
+    QVERIFY(GzipFile::writeToFile(m_largeFile, makeLargeDocument()));
+}
+
+void TestSegmentXmlHandler::testContent()
+{
+    // What the elements mean, worked out by hand, for the parallel path.
+    QScopedPointer<RosegardenDocument> doc(makeDocument());
+    QVERIFY(load(doc.data(), m_contentFile, true));
+    const Composition &composition = doc->getComposition();
+
+    const Segment *segment = findSegment(composition, "content");
+    QVERIFY(segment);
+
+    std::vector<const Event *> events(segment->begin(), segment->end());
+    QCOMPARE(events.size(), size_t(10));
+
+    // A <chord>'s notes start together, and the next event comes after
+    // the shortest of them.
+    QCOMPARE(events[0]->getType(), std::string("clefchange"));
+    for (int i = 1; i <= 3; ++i) {
+        QCOMPARE(events[i]->getAbsoluteTime(), timeT(0));
+        QVERIFY(events[i]->isa(Note::EventType));
+    }
+
+    // A <group> puts its tuplet properties on each of its events.
+    const timeT tupletTimes[] = { 480, 800, 1120 };
+    for (int i = 0; i < 3; ++i) {
+        const Event *event = events[4 + i];
+        QCOMPARE(event->getAbsoluteTime(), tupletTimes[i]);
+        QCOMPARE(event->get<String>(BEAMED_GROUP_TYPE),
+                 std::string(GROUP_TYPE_TUPLED));
+        QCOMPARE(event->get<Int>(BEAMED_GROUP_TUPLET_BASE), 320L);
+        QCOMPARE(event->get<Int>(BEAMED_GROUP_TUPLED_COUNT), 2L);
+        QCOMPARE(event->get<Int>(BEAMED_GROUP_UNTUPLED_COUNT), 3L);
+        QCOMPARE(event->get<Int>(BEAMED_GROUP_ID),
+                 events[4]->get<Int>(BEAMED_GROUP_ID));
+    }
+
+    // <resync> moves the time on.  A stored group ID is renumbered, the
+    // same way for each event that has it.
+    QCOMPARE(events[7]->getAbsoluteTime(), timeT(3840));
+    QCOMPARE(events[8]->getAbsoluteTime(), timeT(4320));
+    QCOMPARE(events[7]->get<Int>(BEAMED_GROUP_ID),
+             events[8]->get<Int>(BEAMED_GROUP_ID));
+    QVERIFY(events[7]->get<Int>(BEAMED_GROUP_ID) !=
+            events[4]->get<Int>(BEAMED_GROUP_ID));
+    QVERIFY(events[7]->has(PropertyName("Beamed")));
+
+    QCOMPARE(events[9]->getAbsoluteTime(), timeT(5760));
+    QCOMPARE(events[9]->get<Int>(TRIGGER_SEGMENT_ID), 0L);
+
+    QCOMPARE(segment->getEndMarkerTime(false), timeT(7680));
+    QCOMPARE(segment->matrixHZoomFactor, 2.5);
+    QCOMPARE(segment->matrixVZoomFactor, 1.5);
+    QCOMPARE(segment->matrixRulers->size(), size_t(1));
+    QCOMPARE(segment->notationRulers->size(), size_t(1));
+
+    // The trigger segment, and the note that uses it.
+    QCOMPARE(composition.getTriggerSegments().size(), size_t(1));
+    const TriggerSegmentRec *rec = *composition.getTriggerSegments().begin();
+    QCOMPARE(rec->getBasePitch(), 60);
+    QCOMPARE(rec->getBaseVelocity(), 100);
+    QVERIFY(rec->getDefaultRetune());
+    QCOMPARE(rec->getDefaultTimeAdjust(), std::string("squish"));
+    QCOMPARE(rec->getReferences().size(), size_t(1));
+    QCOMPARE(rec->getSegment()->getStartTime(), timeT(0));
+    QCOMPARE(int(std::distance(rec->getSegment()->begin(),
+                               rec->getSegment()->end())), 2);
+
+    // Linked segments.
+    const Segment *linkedA = findSegment(composition, "linked a");
+    const Segment *linkedB = findSegment(composition, "linked b");
+    QVERIFY(linkedA  &&  linkedB);
+    QVERIFY(linkedA->isLinked());
+    QCOMPARE(linkedA->getLinker(), linkedB->getLinker());
+
+    // An empty segment with a zero length end marker sticks out.
+    const Segment *empty = findSegment(composition, "empty");
+    QVERIFY(empty);
+    QVERIFY(empty->getEndMarkerTime(false) > empty->getStartTime());
+}
+
+void TestSegmentXmlHandler::testSameAsInline()
+{
+    QScopedPointer<RosegardenDocument> inlineDoc(makeDocument());
+    QVERIFY(load(inlineDoc.data(), m_contentFile, false));
+
+    QScopedPointer<RosegardenDocument> deferredDoc(makeDocument());
+    QVERIFY(load(deferredDoc.data(), m_contentFile, true));
+
+    const QStringList expected = describe(inlineDoc->getComposition());
+    QCOMPARE(expected.size(), 6);
+    QCOMPARE(describe(deferredDoc->getComposition()), expected);
+}
+
+void TestSegmentXmlHandler::testExampleFile()
+{
+    // A real file, with tuplets, beams, ties and triggered ornaments.
+    const QString fileName =
+            QFINDTESTDATA("../data/examples/bwv-1060-trumpet-duet-excerpt.rg");
+    QVERIFY(!fileName.isEmpty());
+
+    QScopedPointer<RosegardenDocument> inlineDoc(makeDocument());
+    QVERIFY(load(inlineDoc.data(), fileName, false));
+
+    QScopedPointer<RosegardenDocument> deferredDoc(makeDocument());
+    QVERIFY(load(deferredDoc.data(), fileName, true));
+
+    const QStringList expected = describe(inlineDoc->getComposition());
+    QVERIFY(!expected.isEmpty());
+    QVERIFY(!inlineDoc->getComposition().getTriggerSegments().empty());
+    QCOMPARE(describe(deferredDoc->getComposition()), expected);
+}
+
+void TestSegmentXmlHandler::benchmarkLoadWhole()
+{
+    // The old way: the whole file in a QString, then parse that.
+    QBENCHMARK_ONCE {
+        QScopedPointer<RosegardenDocument> doc(makeDocument());
+        RoseXmlHandler handler(doc.data(), QPointer<QProgressDialog>(),
+                               false);
+        XMLReader reader;
+        reader.setHandler(&handler);
+
+        QString xml;
+        QVERIFY(GzipFile::readFromFile(m_largeFile, xml));
+        QVERIFY(reader.parse(xml));
+        QCOMPARE(doc->getComposition().getNbSegments(), 48u);
+    }
+}
+
+void TestSegmentXmlHandler::benchmarkLoadInline()
+{
+    // A chunk at a time, segment contents read on this thread.
+    QBENCHMARK_ONCE {
+        QScopedPointer<RosegardenDocument> doc(makeDocument());
+        QVERIFY(load(doc.data(), m_largeFile, false));
+        QCOMPARE(doc->getComposition().getNbSegments(), 48u);
+    }
+}
+
+void TestSegmentXmlHandler::benchmarkLoadDeferred()
+{
+    // As RosegardenDocument::xmlParse() does it.
+    QBENCHMARK_ONCE {
+        QScopedPointer<RosegardenDocument> doc(makeDocument());
+        QVERIFY(load(doc.data(), m_largeFile, true));
+        QCOMPARE(doc->getComposition().getNbSegments(), 48u);
+    }
+}
+
+QTEST_MAIN(TestSegmentXmlHandler)
+
+#include "segmentxmlhandler.moc"
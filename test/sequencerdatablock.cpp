@@ -0,0 +1,150 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "sound/SequencerDataBlock.h"
+
+#include <QTest>
+
+using namespace Rosegarden;
+
+/// Unit test for the SequencerDataBlock performance counters.
+class TestSequencerDataBlock : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void init();
+
+    void testPeriods();
+    void testInstruments();
+    void testReset();
+};
+
+namespace
+{
+    const int a_noPlugins[PluginContainer::PLUGIN_COUNT] = { };
+}
+
+void TestSequencerDataBlock::init()
+{
+    SequencerDataBlock::getInstance()->clearTemporaries();
+}
+
+void TestSequencerDataBlock::testPeriods()
+{
+    SequencerDataBlock *dataBlock = SequencerDataBlock::getInstance();
+
+    // 1000us periods.
+    dataBlock->addPeriod(50, 1000);
+    dataBlock->addPeriod(99, 1000);
+    dataBlock->addPeriod(550, 1000);
+    dataBlock->addPeriod(1000, 1000);
+    dataBlock->addPeriod(1001, 1000);
+    dataBlock->addPeriod(50000, 1000);
+    dataBlock->addXRun();
+    dataBlock->addMixUnderrun();
+    dataBlock->addMixUnderrun();
+    dataBlock->addBussMixUnderrun();
+
+    PeriodPerformance period;
+    dataBlock->getPeriodPerformance(period);
+
+    QCOMPARE(period.periods, 6);
+    QCOMPARE(period.budgetUsec, 1000);
+    QCOMPARE(period.maxUsec, 50000);
+    // Exactly on the deadline isn't a miss.
+    QCOMPARE(period.deadlineMisses, 2);
+    QCOMPARE(period.xruns, 1);
+    QCOMPARE(period.mixUnderruns, 2);
+    QCOMPARE(period.bussMixUnderruns, 1);
+
+    QCOMPARE(period.histogram[0], 2);
+    QCOMPARE(period.histogram[5], 1);
+    QCOMPARE(period.histogram[10], 2);
+    // Everything too long ends up in the last bucket.
+    QCOMPARE(period.histogram[SEQUENCER_DATABLOCK_PERIOD_BUCKETS - 1], 1);
+
+    int total = 0;
+    for (int bucket = 0; bucket < SEQUENCER_DATABLOCK_PERIOD_BUCKETS; ++bucket)
+        total += period.histogram[bucket];
+    QCOMPARE(total, period.periods);
+}
+
+void TestSequencerDataBlock::testInstruments()
+{
+    SequencerDataBlock *dataBlock = SequencerDataBlock::getInstance();
+
+    int plugins[PluginContainer::PLUGIN_COUNT] = { };
+    plugins[1] = 30;
+
+    // Two passes of the mixer.
+    for (int pass = 0; pass < 2; ++pass) {
+        dataBlock->setInstrumentPerformance(1000, 100 - pass * 50, 0,
+                                            plugins, 1);
+        dataBlock->setInstrumentPerformance(10000, 200, 150,
+                                            a_noPlugins, 0);
+    }
+
+    // A new one turning up later goes on the end.
+    dataBlock->setInstrumentPerformance(1001, 10, 0, a_noPlugins, 0);
+
+    QCOMPARE(dataBlock->getInstrumentPerformanceCount(), 3);
+
+    InstrumentPerformance info;
+
+    dataBlock->getInstrumentPerformance(0, info);
+    QCOMPARE(info.id, InstrumentId(1000));
+    QCOMPARE(info.usec, 50);
+    QCOMPARE(info.peakUsec, 100);
+    QCOMPARE(info.pluginUsec[1], 30);
+    // Added up over the passes.
+    QCOMPARE(info.underruns, 2);
+
+    dataBlock->getInstrumentPerformance(1, info);
+    QCOMPARE(info.id, InstrumentId(10000));
+    QCOMPARE(info.synthUsec, 150);
+
+    dataBlock->getInstrumentPerformance(2, info);
+    QCOMPARE(info.id, InstrumentId(1001));
+}
+
+void TestSequencerDataBlock::testReset()
+{
+    SequencerDataBlock *dataBlock = SequencerDataBlock::getInstance();
+
+    dataBlock->addPeriod(2000, 1000);
+    dataBlock->setInstrumentPerformance(1000, 100, 0, a_noPlugins, 3);
+
+    dataBlock->resetPerformanceCounters();
+
+    PeriodPerformance period;
+    dataBlock->getPeriodPerformance(period);
+    QCOMPARE(period.periods, 0);
+    QCOMPARE(period.maxUsec, 0);
+    QCOMPARE(period.deadlineMisses, 0);
+    QCOMPARE(period.histogram[SEQUENCER_DATABLOCK_PERIOD_BUCKETS - 1], 0);
+
+    // The instruments stay, with their totals cleared.
+    QCOMPARE(dataBlock->getInstrumentPerformanceCount(), 1);
+    InstrumentPerformance info;
+    dataBlock->getInstrumentPerformance(0, info);
+    QCOMPARE(info.usec, 100);
+    QCOMPARE(info.peakUsec, 0);
+    QCOMPARE(info.underruns, 0);
+}
+
+QTEST_MAIN(TestSequencerDataBlock)
+
+#include "sequencerdatablock.moc"
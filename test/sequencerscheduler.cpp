@@ -0,0 +1,229 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "sequencer/SequencerScheduler.h"
+#include "sound/DummyDriver.h"
+
+#include <QElapsedTimer>
+#include <QTest>
+
+#include <thread>
+
+using namespace Rosegarden;
+
+/// Unit test for SequencerScheduler.
+class TestSequencerScheduler : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void testReadAhead();
+    void testPlayingSleep();
+    void testStoppedSleep();
+    void testWake();
+    void benchmarkJitter();
+};
+
+namespace
+{
+    const RealTime a_msec(0, 1000000);
+
+    RealTime elapsed(const QElapsedTimer &timer)
+    {
+        const qint64 nsecs = timer.nsecsElapsed();
+        return RealTime(int(nsecs / 1000000000), int(nsecs % 1000000000));
+    }
+}
+
+void TestSequencerScheduler::testReadAhead()
+{
+    SequencerScheduler scheduler;
+    scheduler.reset(RealTime::zero());
+
+    const RealTime base = scheduler.getReadAhead();
+    QVERIFY(base > RealTime::zero());
+
+    // On time, or woken early, doesn't change anything.
+    scheduler.woke(a_msec * 10, a_msec * 10);
+    scheduler.woke(a_msec * 10, a_msec * 2);
+    QCOMPARE(scheduler.getJitter(), RealTime::zero());
+    QCOMPARE(scheduler.getReadAhead(), base);
+
+    // A stall raises the read-ahead straight away...
+    scheduler.woke(a_msec * 10, a_msec * 60);
+    QCOMPARE(scheduler.getJitter(), a_msec * 50);
+    const RealTime stalled = scheduler.getReadAhead();
+    QVERIFY(stalled >= base + a_msec * 50);
+
+    // ...and it comes back down.
+    for (int i = 0; i < 2000; ++i) {
+        scheduler.woke(a_msec * 10, a_msec * 10);
+    }
+    QVERIFY(scheduler.getReadAhead() < base + a_msec);
+
+    // But never past the limit.
+    scheduler.woke(RealTime::zero(), RealTime(60, 0));
+    QVERIFY(scheduler.getReadAhead() <= RealTime(1, 0));
+
+    // The minimum (audio latency) is added.
+    scheduler.reset(a_msec * 100);
+    QCOMPARE(scheduler.getJitter(), RealTime::zero());
+    QCOMPARE(scheduler.getReadAhead(), base + a_msec * 100);
+}
+
+void TestSequencerScheduler::testPlayingSleep()
+{
+    SequencerScheduler scheduler;
+    scheduler.reset(RealTime::zero());
+
+    const RealTime readAhead = scheduler.getReadAhead();
+
+    // Right after a fetch, sleep a while, but wake before the events
+    // that were sent run out.
+    const RealTime sleep = scheduler.getPlayingSleep(readAhead);
+    QVERIFY(sleep > RealTime::zero());
+    QVERIFY(sleep < readAhead);
+
+    // Less queued, less sleep.
+    QVERIFY(scheduler.getPlayingSleep(a_msec * 3) <= sleep);
+
+    // Never spin, even if we're behind.
+    QVERIFY(scheduler.getPlayingSleep(-a_msec * 10) > RealTime::zero());
+
+    // More lateness, wake up earlier.
+    scheduler.woke(RealTime::zero(), a_msec * 10);
+    QVERIFY(scheduler.getPlayingSleep(a_msec * 30) <
+            SequencerScheduler().getPlayingSleep(a_msec * 30));
+
+    // Stopped, there's nothing to wake up for.
+    QVERIFY(SequencerScheduler::getStoppedSleep() > sleep);
+}
+
+void TestSequencerScheduler::testStoppedSleep()
+{
+    const RealTime stopped = SequencerScheduler::getStoppedSleep();
+
+    // Wake for a pending note-off...
+    QCOMPARE(SequencerScheduler::getStoppedSleep(a_msec * 250),
+             a_msec * 250);
+
+    // ...but not more often than with nothing pending...
+    QCOMPARE(SequencerScheduler::getStoppedSleep(stopped * 10), stopped);
+
+    // ...and don't spin on one that's overdue.
+    QVERIFY(SequencerScheduler::getStoppedSleep(-a_msec * 10) >
+            RealTime::zero());
+
+    // DummyDriver never has any.
+    DummyDriver driver(nullptr);
+    RealTime untilNoteOff;
+    QVERIFY(!driver.getTimeToNextNoteOff(untilNoteOff));
+}
+
+void TestSequencerScheduler::testWake()
+{
+    DummyDriver driver(nullptr);
+
+    QElapsedTimer timer;
+
+    // A wake() before the sleep() ends the next one.
+    driver.wake();
+    timer.start();
+    driver.sleep(RealTime(10, 0));
+    QVERIFY(elapsed(timer) < RealTime(5, 0));
+
+    // From another thread, during the sleep().
+    timer.start();
+    std::thread waker([&driver]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        driver.wake();
+    });
+    driver.sleep(RealTime(10, 0));
+    const RealTime slept = elapsed(timer);
+    waker.join();
+
+    QVERIFY(slept < RealTime(5, 0));
+    qInfo() << "Woken after" << slept.toSeconds() * 1000 << "msecs,"
+            << "20 msecs asked for";
+
+    // And then sleep() sleeps again.
+    timer.start();
+    driver.sleep(a_msec * 20);
+    QVERIFY(elapsed(timer) >= a_msec * 19);
+}
+
+void TestSequencerScheduler::benchmarkJitter()
+{
+    // A headless version of SequencerThread::run() while playing, with
+    // the DummyDriver's sleep() and the wall clock for the play position.
+    // Reports how late the wake ups are, how many there are, and whether
+    // the events sent ahead ever ran out.
+
+    DummyDriver driver(nullptr);
+    SequencerScheduler scheduler;
+    scheduler.reset(RealTime::zero());
+
+    const RealTime duration(2, 0);
+
+    QElapsedTimer clock;
+    clock.start();
+
+    // Events have been sent to here.  See keepPlaying().
+    RealTime fetched = scheduler.getReadAhead();
+
+    int wakes = 0;
+    int underruns = 0;
+    RealTime totalLate;
+    RealTime maxLate;
+    RealTime maxReadAhead = fetched;
+
+    while (elapsed(clock) < duration) {
+        const RealTime sleepTime =
+                scheduler.getPlayingSleep(fetched - elapsed(clock));
+
+        const RealTime before = elapsed(clock);
+        driver.sleep(sleepTime);
+        const RealTime now = elapsed(clock);
+
+        scheduler.woke(sleepTime, now - before);
+
+        const RealTime late =
+                std::max(now - before - sleepTime, RealTime::zero());
+        totalLate = totalLate + late;
+        maxLate = std::max(maxLate, late);
+        ++wakes;
+
+        if (now > fetched)
+            ++underruns;
+
+        fetched = now + scheduler.getReadAhead();
+        maxReadAhead = std::max(maxReadAhead, scheduler.getReadAhead());
+    }
+
+    qInfo() << "Wakes per second:" << wakes / duration.toSeconds();
+    qInfo() << "Mean lateness (msecs):"
+            << totalLate.toSeconds() * 1000 / wakes;
+    qInfo() << "Max lateness (msecs):" << maxLate.toSeconds() * 1000;
+    qInfo() << "Max read-ahead (msecs):" << maxReadAhead.toSeconds() * 1000;
+    qInfo() << "Underruns:" << underruns;
+
+    // At the fixed 10 msec polling this replaced, 200.
+    QVERIFY(wakes > 0);
+    QVERIFY(wakes / duration.toSeconds() <= 1000);
+}
+
+QTEST_MAIN(TestSequencerScheduler)
+
+#include "sequencerscheduler.moc"
@@ -0,0 +1,397 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "base/Composition.h"
+#include "base/NotationTypes.h"
+#include "base/TempoMap.h"
+
+#include <QTest>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <vector>
+
+using namespace Rosegarden;
+
+namespace
+{
+
+    /// Real time found by adding up the length of every tick.
+    /**
+     * Works only from the Composition's public tempo list, not from
+     * TempoMap or Composition's own arithmetic.  In a ramp the length
+     * of a tick changes steadily from that of one tempo to that of the
+     * target, so each tick's length is taken at its middle.  A ramp on
+     * the last change with no target given has nothing to go to, so it
+     * is constant, as in Composition.
+     */
+    class ReferenceTempo
+    {
+    public:
+        explicit ReferenceTempo(const Composition &composition);
+
+        /// Seconds from time 0 to t.
+        double seconds(timeT t) const;
+
+    private:
+        struct Change
+        {
+            timeT time;
+            /// Seconds per tick at time.
+            double length;
+            /// Seconds per tick at endTime, for a ramp.
+            double targetLength;
+            /// The next change, if any.
+            timeT endTime;
+            /// Seconds from time 0 to time.
+            double seconds;
+        };
+        std::vector<Change> m_changes;
+
+        double m_defaultLength;
+
+        static double tickLength(tempoT tempo);
+
+        /// Seconds from change.time to t, which is no later than the
+        /// next change.
+        static double secondsInto(const Change &change, timeT t);
+    };
+
+    ReferenceTempo::ReferenceTempo(const Composition &composition) :
+        m_defaultLength(tickLength(composition.getCompositionDefaultTempo()))
+    {
+        const int count = composition.getTempoChangeCount();
+
+        for (int i = 0; i < count; ++i) {
+            const std::pair<timeT, tempoT> change =
+                    composition.getTempoChange(i);
+            const std::pair<bool, tempoT> ramp =
+                    composition.getTempoRamping(i, true);
+
+            Change c;
+            c.time = change.first;
+            c.length = tickLength(change.second);
+            c.targetLength = ramp.first ? tickLength(ramp.second) : c.length;
+            c.endTime = (i + 1 < count) ?
+                    composition.getTempoChange(i + 1).first :
+                    std::numeric_limits<timeT>::max();
+            if (c.endTime == std::numeric_limits<timeT>::max())
+                c.targetLength = c.length;
+
+            if (m_changes.empty()) {
+                c.seconds = double(c.time) * m_defaultLength;
+            } else {
+                const Change &previous = m_changes.back();
+                c.seconds = previous.seconds + secondsInto(previous, c.time);
+            }
+
+            m_changes.push_back(c);
+        }
+    }
+
+    double ReferenceTempo::tickLength(tempoT tempo)
+    {
+        // tempoT is hundred-thousandths of a quarter note per minute.
+        const double qpm = double(tempo) / 100000;
+        return 60.0 / (qpm * Note(Note::Crotchet).getDuration());
+    }
+
+    double ReferenceTempo::secondsInto(const Change &change, timeT t)
+    {
+        double seconds = 0;
+        for (timeT tick = change.time; tick < t; ++tick) {
+            double length = change.length;
+            if (change.targetLength != change.length) {
+                length += (change.targetLength - change.length) *
+                          (double(tick - change.time) + 0.5) /
+                          double(change.endTime - change.time);
+            }
+            seconds += length;
+        }
+        return seconds;
+    }
+
+    double ReferenceTempo::seconds(timeT t) const
+    {
+        if (m_changes.empty()  ||  t < m_changes[0].time)
+            return double(t) * m_defaultLength;
+
+        // The last change at or before t.
+        std::vector<Change>::const_iterator i = std::upper_bound(
+                m_changes.begin(), m_changes.end(), t,
+                [](timeT time, const Change &change) {
+                    return time < change.time;
+                });
+        --i;
+
+        return i->seconds + secondsInto(*i, t);
+    }
+
+    /// Close enough allowing for RealTime's nanoseconds being truncated
+    /// at each tempo change.
+    bool near(const RealTime &rt, double seconds)
+    {
+        return std::fabs(rt.toSeconds() - seconds) < 0.00001;
+    }
+
+}
+
+/// Unit test and benchmark for TempoMap.
+class TestTempoMap : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void testConstantTempo();
+    void testReference();
+    void testReferenceTarget();
+    void testRoundTrip();
+    void testBatch();
+    void testInvalidation();
+
+    void benchmarkElapsedRealTime();
+    void benchmarkBatch();
+    void benchmarkElapsedTimeForRealTime();
+
+private:
+    // A film score: a tempo change every couple of beats, every fifth
+    // one ramped.
+    static const int TempoChanges = 2000;
+    static const timeT ChangeSpacing = 1920;
+
+    Composition m_composition;
+
+    // Every 10 ticks from start to end, as when mapping notes.
+    std::vector<timeT> m_times;
+};
+
+void TestTempoMap::initTestCase()
+{
+    std::mt19937 rng(1627);
+    std::uniform_real_distribution<double> qpm(40.0, 200.0);
+
+    for (int i = 0; i < TempoChanges; ++i) {
+        const tempoT tempo = Composition::getTempoForQpm(qpm(rng));
+        // Ramp to the next tempo.
+        const tempoT target = (i % 5 == 4) ? 0 : -1;
+        m_composition.addTempoAtTime(i * ChangeSpacing, tempo, target);
+    }
+    m_composition.setEndMarker(TempoChanges * ChangeSpacing);
+
+    for (timeT t = 0; t < TempoChanges * ChangeSpacing; t += 10)
+        m_times.push_back(t);
+}
+
+void TestTempoMap::testConstantTempo()
+{
+    Composition composition;
+    composition.setCompositionDefaultTempo(Composition::getTempoForQpm(120));
+    composition.addTempoAtTime(960 * 4, Composition::getTempoForQpm(60));
+
+    // Default tempo before the first change.  One beat is half a second.
+    QCOMPARE(composition.getElapsedRealTime(960), RealTime(0, 500000000));
+    QCOMPARE(composition.getElapsedRealTime(960 * 4), RealTime(2, 0));
+    // One beat is one second after it.
+    QCOMPARE(composition.getElapsedRealTime(960 * 6), RealTime(4, 0));
+
+    QCOMPARE(composition.getElapsedTimeForRealTime(RealTime(4, 0)),
+             timeT(960 * 6));
+    QCOMPARE(composition.getElapsedTimeForRealTime(RealTime(1, 0)),
+             timeT(960 * 2));
+}
+
+void TestTempoMap::testReference()
+{
+    const ReferenceTempo reference(m_composition);
+    std::shared_ptr<const TempoMap> tempoMap = m_composition.getTempoMap();
+
+    // Some beyond the last change too.
+    std::vector<timeT> times;
+    for (size_t i = 0; i < m_times.size(); i += 37)
+        times.push_back(m_times[i]);
+    times.push_back(TempoChanges * ChangeSpacing + 12345);
+    times.push_back(-960);
+
+    for (const timeT t : times) {
+        const double seconds = reference.seconds(t);
+
+        QVERIFY(near(m_composition.getElapsedRealTime(t), seconds));
+        QVERIFY(near(tempoMap->toRealTime(t), seconds));
+
+        if (t < 0)
+            continue;
+
+        // Back again, to within a tick either way.  Ticks are at least
+        // 300 microseconds long at these tempos.
+        const RealTime exact = RealTime::fromSeconds(seconds);
+        QVERIFY(std::abs(tempoMap->toTime(exact) - t) <= 1);
+        QVERIFY(std::abs(m_composition.getElapsedTimeForRealTime(exact) - t)
+                <= 1);
+    }
+}
+
+void TestTempoMap::testReferenceTarget()
+{
+    // Ramps with a target of their own rather than the next tempo, and
+    // a change before which the default applies.
+    Composition composition;
+    composition.setCompositionDefaultTempo(Composition::getTempoForQpm(100));
+    composition.addTempoAtTime(960, Composition::getTempoForQpm(60),
+                               Composition::getTempoForQpm(180));
+    composition.addTempoAtTime(960 * 9, Composition::getTempoForQpm(90));
+    composition.addTempoAtTime(960 * 10, Composition::getTempoForQpm(240),
+                               Composition::getTempoForQpm(30));
+    composition.addTempoAtTime(960 * 17, Composition::getTempoForQpm(120));
+    composition.setEndMarker(960 * 20);
+
+    const ReferenceTempo reference(composition);
+    std::shared_ptr<const TempoMap> tempoMap = composition.getTempoMap();
+
+    for (timeT t = -480; t < 960 * 20; t += 7) {
+        const double seconds = reference.seconds(t);
+        QVERIFY(near(composition.getElapsedRealTime(t), seconds));
+        QVERIFY(near(tempoMap->toRealTime(t), seconds));
+    }
+}
+
+void TestTempoMap::testRoundTrip()
+{
+    std::shared_ptr<const TempoMap> tempoMap = m_composition.getTempoMap();
+    QCOMPARE(tempoMap->size(), size_t(TempoChanges));
+
+    RealTime last = RealTime::zero() - RealTime(1, 0);
+
+    for (size_t i = 0; i < m_times.size(); i += 37) {
+        const timeT t = m_times[i];
+        const RealTime rt = m_composition.getElapsedRealTime(t);
+
+        // Strictly increasing.
+        QVERIFY(rt > last);
+        last = rt;
+
+        QCOMPARE(tempoMap->toRealTime(t), rt);
+
+        // A tick is at least 300 microseconds at these tempos, so
+        // going back is off by at most one tick due to rounding.
+        const timeT back = m_composition.getElapsedTimeForRealTime(rt);
+        QVERIFY(std::abs(back - t) <= 1);
+        QCOMPARE(tempoMap->toTime(rt), back);
+    }
+}
+
+void TestTempoMap::testBatch()
+{
+    std::shared_ptr<const TempoMap> tempoMap = m_composition.getTempoMap();
+
+    // Sorted, as when mapping.
+    std::vector<RealTime> realTimes(m_times.size());
+    tempoMap->toRealTime(m_times.data(), realTimes.data(), m_times.size());
+
+    for (size_t i = 0; i < m_times.size(); i += 13)
+        QCOMPARE(realTimes[i], m_composition.getElapsedRealTime(m_times[i]));
+
+    std::vector<timeT> times(realTimes.size());
+    tempoMap->toTime(realTimes.data(), times.data(), realTimes.size());
+
+    for (size_t i = 0; i < m_times.size(); i += 13) {
+        QCOMPARE(times[i],
+                 m_composition.getElapsedTimeForRealTime(realTimes[i]));
+    }
+
+    // Any order works.
+    std::vector<timeT> shuffled(m_times.begin(), m_times.begin() + 10000);
+    std::shuffle(shuffled.begin(), shuffled.end(), std::mt19937(7));
+    std::vector<RealTime> shuffledRealTimes(shuffled.size());
+    tempoMap->toRealTime(shuffled.data(), shuffledRealTimes.data(),
+                         shuffled.size());
+
+    for (size_t i = 0; i < shuffled.size(); ++i) {
+        QCOMPARE(shuffledRealTimes[i],
+                 m_composition.getElapsedRealTime(shuffled[i]));
+    }
+
+    // Negative time before the first tempo change uses the default.
+    const timeT negative = -960;
+    RealTime negativeRealTime;
+    tempoMap->toRealTime(&negative, &negativeRealTime, 1);
+    QCOMPARE(negativeRealTime, m_composition.getElapsedRealTime(negative));
+}
+
+void TestTempoMap::testInvalidation()
+{
+    Composition composition;
+    composition.addTempoAtTime(0, Composition::getTempoForQpm(120));
+
+    std::shared_ptr<const TempoMap> before = composition.getTempoMap();
+    // Cached until something changes.
+    QCOMPARE(composition.getTempoMap(), before);
+
+    const RealTime rt = composition.getElapsedRealTime(9600);
+    composition.addTempoAtTime(960, Composition::getTempoForQpm(60));
+
+    std::shared_ptr<const TempoMap> after = composition.getTempoMap();
+    QVERIFY(after != before);
+    QVERIFY(composition.getElapsedRealTime(9600) > rt);
+
+    // The old map still gives the old answers.
+    QCOMPARE(before->toRealTime(9600), rt);
+
+    composition.removeTempoChange(1);
+    QCOMPARE(composition.getElapsedRealTime(9600), rt);
+}
+
+void TestTempoMap::benchmarkElapsedRealTime()
+{
+    RealTime sum;
+    QBENCHMARK {
+        sum = RealTime::zero();
+        for (timeT t : m_times)
+            sum = sum + m_composition.getElapsedRealTime(t);
+    }
+    QVERIFY(sum > RealTime::zero());
+}
+
+void TestTempoMap::benchmarkBatch()
+{
+    std::vector<RealTime> realTimes(m_times.size());
+    QBENCHMARK {
+        m_composition.getTempoMap()->toRealTime(
+                m_times.data(), realTimes.data(), m_times.size());
+    }
+    QVERIFY(realTimes.back() > RealTime::zero());
+}
+
+void TestTempoMap::benchmarkElapsedTimeForRealTime()
+{
+    std::vector<RealTime> realTimes;
+    for (size_t i = 0; i < m_times.size(); i += 10)
+        realTimes.push_back(m_composition.getElapsedRealTime(m_times[i]));
+
+    long sum = 0;
+    QBENCHMARK {
+        sum = 0;
+        for (const RealTime &rt : realTimes)
+            sum += m_composition.getElapsedTimeForRealTime(rt);
+    }
+    QVERIFY(sum > 0);
+}
+
+QTEST_MAIN(TestTempoMap)
+
+#include "tempomap.moc"
@@ -0,0 +1,533 @@
+/* -*- c-basic-offset: 4 indent-tabs-mode: nil -*- vi:set ts=8 sts=4 sw=4: */
+
+/*
+    Rosegarden
+    A sequencer and musical notation editor.
+    Copyright 2000-2024 the Rosegarden development team.
+    See the AUTHORS file for more details.
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License as
+    published by the Free Software Foundation; either version 2 of the
+    License, or (at your option) any later version.  See the file
+    COPYING included with this distribution for more information.
+*/
+
+#include "base/BaseProperties.h"
+#include "base/Composition.h"
+#include "base/Event.h"
+#include "base/NotationTypes.h"
+#include "base/Segment.h"
+#include "base/SegmentLinker.h"
+#include "base/TriggerSegment.h"
+#include "document/GzipFile.h"
+#include "document/RosegardenDocument.h"
+#include "document/io/XMLHandler.h"
+#include "document/io/XMLReader.h"
+#include "misc/Strings.h"
+
+#include <QFile>
+#include <QScopedPointer>
+#include <QSettings>
+#include <QTemporaryDir>
+#include <QTest>
+
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace Rosegarden;
+using namespace BaseProperties;
+
+/// Unit test for XMLReader's parsing of gzipped files, and GzipFile.
+/**
+ * Also saves a whole RosegardenDocument, whose segments are written in
+ * parallel, and reads it back.
+ */
+class TestXMLReader : public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+    void initTestCase();
+
+    void testChunked();
+    void testDeferred();
+    void testParseContent();
+    void testTruncated();
+    void testWrite();
+    void testDocumentRoundTrip();
+
+    void benchmarkSave();
+};
+
+namespace
+{
+    /// Writes down what it's given.
+    class RecordingHandler : public XMLHandler
+    {
+    public:
+        bool startElement(const QString &, const QString &,
+                          const QString &qName,
+                          const QXmlStreamAttributes &atts) override
+        {
+            m_log << "<" + qName + " " + atts.value("id").toString() + ">";
+            return true;
+        }
+
+        bool endElement(const QString &, const QString &,
+                        const QString &qName) override
+        {
+            m_log << "</" + qName + ">";
+            return true;
+        }
+
+        bool characters(const QString &chars) override
+        {
+            if (!chars.trimmed().isEmpty())
+                m_log << chars.trimmed();
+            return true;
+        }
+
+        bool fatalError(int, int, const QString &) override
+        {
+            return false;
+        }
+
+        bool progress(double fraction) override
+        {
+            if (fraction < m_progress)
+                m_progressWentBack = true;
+            m_progress = fraction;
+            ++m_progressCount;
+            return true;
+        }
+
+        bool deferredContent(const QByteArray &content) override
+        {
+            m_deferred.push_back(content);
+            return true;
+        }
+
+        QStringList m_log;
+        std::vector<QByteArray> m_deferred;
+
+        double m_progress = 0;
+        int m_progressCount = 0;
+        bool m_progressWentBack = false;
+    };
+
+    /// A <segment> with count <event>s, like an .rg file's.
+    QString makeSegment(int id, int count)
+    {
+        QString segment = QString("<segment id=\"%1\" label=\"a > b\">\n")
+                .arg(id);
+        for (int i = 0; i < count; ++i) {
+            segment += QString("<event type=\"note\" duration=\"240\">"
+                               "<property name=\"pitch\" int=\"%1\"/>"
+                               "</event>\n").arg(60 + i % 12);
+        }
+        segment += "</segment>\n";
+        return segment;
+    }
+
+    /// Long enough to take several chunks.
+    QString makeDocument()
+    {
+        QString xml = "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+                      "<rosegarden-data>\n"
+                      "<segments id=\"notone\"/>\n";
+        for (int i = 0; i < 20; ++i) {
+            xml += makeSegment(i, 2000);
+            xml += QString("<track id=\"%1\">text %1</track>\n").arg(i);
+        }
+        xml += "<segment id=\"empty\"/>\n"
+               "</rosegarden-data>\n";
+        return xml;
+    }
+
+    QString writeFile(const QTemporaryDir &dir, const QString &xml)
+    {
+        const QString fileName = dir.filePath("test.rg");
+        if (!GzipFile::writeToFile(fileName, xml))
+            return QString();
+        return fileName;
+    }
+
+    /// Not ASCII, and needs escaping in XML.
+    const std::string a_label = "Ünïcødé ♪ 日本語 <&> \"quoted\" 'apos'";
+
+    RosegardenDocument *makeRosegardenDocument()
+    {
+        RosegardenDocument *doc = new RosegardenDocument(
+                nullptr,  // parent
+                {},  // audioPluginManager
+                true,  // skipAutoload
+                true,  // clearCommandHistory
+                false);  // useSequencer
+
+        RosegardenDocument::currentDocument = doc;
+
+        // For its tracks and instruments.
+        if (!doc->openDocument(
+                QFINDTESTDATA("../data/examples/aylindaamiga.rg"),
+                false,  // permanent
+                true,  // squelchProgressDialog
+                false)) {  // enableLock
+            delete doc;
+            return nullptr;
+        }
+
+        return doc;
+    }
+
+    /// Adds segmentCount segments of noteCount notes, some of them linked,
+    /// and an ornament that some of the notes trigger.
+    void populate(Composition &composition, int segmentCount, int noteCount)
+    {
+        std::mt19937 random(20240601);
+        auto randomInt = [&random](int min, int max) {
+            return std::uniform_int_distribution<int>(min, max)(random);
+        };
+
+        std::vector<TrackId> tracks;
+        for (const Composition::trackcontainer::value_type &track :
+                 composition.getTracks()) {
+            tracks.push_back(track.first);
+        }
+
+        Segment *ornament = new Segment;
+        ornament->setLabel(a_label + " ornament");
+        ornament->insert(Note(Note::Semiquaver).getAsNoteEvent(0, 60));
+        ornament->insert(Note(Note::Semiquaver).getAsNoteEvent(120, 62));
+        TriggerSegmentRec *rec =
+                composition.addTriggerSegment(ornament, 60, 100);
+
+        for (int s = 0; s < segmentCount; ++s) {
+            const timeT start = randomInt(0, 64) * 960;
+
+            Segment *segment = new Segment(Segment::Internal, start);
+            segment->setTrack(tracks[size_t(s) % tracks.size()]);
+            segment->setLabel(a_label + " " + std::to_string(s));
+
+            segment->insert(Text(a_label + " text", Text::Annotation)
+                            .getAsEvent(start));
+
+            for (int n = 0; n < noteCount; ++n) {
+                Event *note = new Event(Note::EventType,
+                                        start + randomInt(0, 255) * 120,
+                                        randomInt(1, 8) * 120);
+                note->set<Int>(PITCH, randomInt(36, 96));
+                note->set<Int>(VELOCITY, randomInt(1, 127));
+                if (randomInt(0, 19) == 0)
+                    note->set<Int>(TRIGGER_SEGMENT_ID, rec->getId());
+                segment->insert(note);
+            }
+
+            composition.addSegment(segment);
+
+            // Every tenth is linked to a copy later on.
+            if (s % 10 == 0) {
+                Segment *linked = SegmentLinker::createLinkedSegment(segment);
+                linked->setLabel(a_label + " linked " + std::to_string(s));
+                composition.addSegment(linked);
+                composition.setSegmentStartTime(linked, start + 64 * 3840);
+            }
+        }
+    }
+
+    QString describe(const Segment &segment, const QString &linkedTo)
+    {
+        QString description = QString(
+                "%1 track %2 start %3 end %4 marker %5 linked to %6\n")
+                .arg(strtoqstr(segment.getLabel()))
+                .arg(segment.getTrack())
+                .arg(segment.getStartTime())
+                .arg(segment.getEndTime())
+                .arg(segment.getEndMarkerTime(false))
+                .arg(linkedTo);
+
+        for (const Event *event : segment) {
+            description += strtoqstr(event->toXmlString(0));
+        }
+
+        return description;
+    }
+
+    /// All the segments and trigger segments of a Composition, in an
+    /// order that doesn't depend on where they are in memory.
+    QStringList describe(const Composition &composition)
+    {
+        // Which segments each linker links, by where they are, as the
+        // linker IDs may change.
+        std::map<const SegmentLinker *, QStringList> links;
+        for (const Segment *segment : composition) {
+            if (segment->isTrulyLinked()) {
+                links[segment->getLinker()] <<
+                        QString("%1@%2").arg(segment->getTrack())
+                                        .arg(segment->getStartTime());
+            }
+        }
+        for (std::pair<const SegmentLinker *const, QStringList> &linked :
+                 links) {
+            linked.second.sort();
+        }
+
+        QStringList descriptions;
+
+        for (const Segment *segment : composition) {
+            QString linkedTo;
+            if (segment->isTrulyLinked())
+                linkedTo = links[segment->getLinker()].join(" ");
+            descriptions << describe(*segment, linkedTo);
+        }
+
+        for (const TriggerSegmentRec *rec :
+                 composition.getTriggerSegments()) {
+            descriptions << QString("trigger %1 pitch %2 velocity %3 "
+                                    "retune %4 adjust %5\n")
+                            .arg(rec->getId())
+                            .arg(rec->getBasePitch())
+                            .arg(rec->getBaseVelocity())
+                            .arg(int(rec->getDefaultRetune()))
+                            .arg(strtoqstr(rec->getDefaultTimeAdjust())) +
+                            describe(*rec->getSegment(), QString());
+        }
+
+        descriptions.sort();
+        return descriptions;
+    }
+}
+
+void TestXMLReader::initTestCase()
+{
+    // Make sure settings end up in the right place.
+    QCoreApplication::setOrganizationName("rosegardenmusic");
+
+    QSettings settings;
+    settings.beginGroup("Sequencer_Options");
+    // Don't start JACK.
+    settings.setValue("autostartjack", false);
+}
+
+void TestXMLReader::testChunked()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString xml = makeDocument();
+    const QString fileName = writeFile(dir, xml);
+    QVERIFY(!fileName.isEmpty());
+
+    // All at once...
+    RecordingHandler expected;
+    XMLReader reader;
+    reader.setHandler(&expected);
+    QVERIFY(reader.parse(xml));
+
+    // ...and a chunk at a time come out the same.
+    RecordingHandler handler;
+    XMLReader chunkedReader;
+    chunkedReader.setHandler(&handler);
+
+    GzipFile file(fileName);
+    QVERIFY(file.openForReading());
+    QVERIFY(chunkedReader.parse(file));
+    QVERIFY(!file.hasError());
+
+    QCOMPARE(handler.m_log, expected.m_log);
+    QVERIFY(handler.m_deferred.empty());
+
+    QVERIFY(handler.m_progressCount > 1);
+    QVERIFY(!handler.m_progressWentBack);
+    QVERIFY(handler.m_progress <= 1.0);
+}
+
+void TestXMLReader::testDeferred()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString fileName = writeFile(dir, makeDocument());
+    QVERIFY(!fileName.isEmpty());
+
+    RecordingHandler handler;
+    XMLReader reader;
+    reader.setHandler(&handler);
+    reader.setDeferredElement("segment");
+
+    GzipFile file(fileName);
+    QVERIFY(file.openForReading());
+    QVERIFY(reader.parse(file));
+
+    // The content of every non-empty <segment>, exactly.
+    QCOMPARE(handler.m_deferred.size(), size_t(20));
+    for (size_t i = 0; i < handler.m_deferred.size(); ++i) {
+        QString segment = makeSegment(int(i), 2000);
+        const int start = segment.indexOf(">\n") + 1;
+        const int end = segment.indexOf("</segment>");
+        QCOMPARE(QString::fromUtf8(handler.m_deferred[i]),
+                 segment.mid(start, end - start));
+    }
+
+    // Everything else as usual.  None of the events.
+    QVERIFY(!handler.m_log.contains("<event >"));
+    QVERIFY(handler.m_log.contains("<segments notone>"));
+    QVERIFY(handler.m_log.contains("<segment empty>"));
+    QCOMPARE(handler.m_log.count("<segment 7>"), 1);
+    QCOMPARE(handler.m_log.count("</segment>"), 21);
+    QVERIFY(handler.m_log.contains("text 19"));
+    QCOMPARE(handler.m_log.last(), QString("</rosegarden-data>"));
+
+    // A <segment>'s start comes before its content, and its end after.
+    const int start = handler.m_log.indexOf("<segment 3>");
+    QVERIFY(start >= 0);
+    QCOMPARE(handler.m_log.at(start + 1), QString("</segment>"));
+}
+
+void TestXMLReader::testParseContent()
+{
+    const QString segment = makeSegment(0, 3);
+    const int start = segment.indexOf(">\n") + 1;
+    const int end = segment.indexOf("</segment>");
+
+    RecordingHandler handler;
+    XMLReader reader;
+    reader.setHandler(&handler);
+    QVERIFY(reader.parseContent(segment.mid(start, end - start).toUtf8()));
+
+    QCOMPARE(handler.m_log.size(), 12);
+    QCOMPARE(handler.m_log.first(), QString("<event >"));
+    QCOMPARE(handler.m_log.last(), QString("</event>"));
+
+    // Errors are errors.
+    RecordingHandler bad;
+    XMLReader badReader;
+    badReader.setHandler(&bad);
+    QVERIFY(!badReader.parseContent("<event><property></event>"));
+}
+
+void TestXMLReader::testTruncated()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    const QString fileName = writeFile(dir, makeDocument());
+    QVERIFY(!fileName.isEmpty());
+
+    QFile rawFile(fileName);
+    QVERIFY(rawFile.resize(rawFile.size() / 2));
+
+    RecordingHandler handler;
+    XMLReader reader;
+    reader.setHandler(&handler);
+    reader.setDeferredElement("segment");
+
+    GzipFile file(fileName);
+    QVERIFY(file.openForReading());
+    QVERIFY(!reader.parse(file));
+}
+
+void TestXMLReader::testWrite()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+
+    // Written a piece at a time, as RosegardenDocument saves.
+    const QString fileName = dir.filePath("written.rg");
+    GzipFile outFile(fileName);
+    QVERIFY(outFile.openForWriting());
+    QVERIFY(outFile.write(std::string("<?xml version=\"1.0\"?>\n"
+                                      "<rosegarden-data>\n")));
+    for (int i = 0; i < 20; ++i) {
+        QVERIFY(outFile.write(makeSegment(i, 2000).toUtf8()));
+    }
+    QVERIFY(outFile.write(std::string("</rosegarden-data>\n")));
+    QVERIFY(outFile.close());
+
+    RecordingHandler handler;
+    XMLReader reader;
+    reader.setHandler(&handler);
+    reader.setDeferredElement("segment");
+
+    GzipFile inFile(fileName);
+    QVERIFY(inFile.openForReading());
+    QVERIFY(reader.parse(inFile));
+    QVERIFY(inFile.close());
+
+    QCOMPARE(handler.m_deferred.size(), size_t(20));
+    QCOMPARE(handler.m_log.count("</segment>"), 20);
+
+    // Can't write to a directory.
+    GzipFile badFile(dir.path());
+    QVERIFY(!badFile.openForWriting());
+    QVERIFY(!badFile.write(std::string("x")));
+}
+
+void TestXMLReader::testDocumentRoundTrip()
+{
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.filePath("roundtrip.rg");
+
+    // Enough segments for several batches on any machine.
+    QScopedPointer<RosegardenDocument> doc(makeRosegardenDocument());
+    QVERIFY(doc);
+    populate(doc->getComposition(), 300, 100);
+
+    const QStringList expected = describe(doc->getComposition());
+    QVERIFY(expected.size() > 300);
+    QVERIFY(expected.join("").contains(strtoqstr(a_label)));
+
+    QString errMsg;
+    QVERIFY(doc->saveDocument(fileName, errMsg));
+    QCOMPARE(errMsg, QString());
+
+    QScopedPointer<RosegardenDocument> loaded(new RosegardenDocument(
+            nullptr,  // parent
+            {},  // audioPluginManager
+            true,  // skipAutoload
+            true,  // clearCommandHistory
+            false));  // useSequencer
+    RosegardenDocument::currentDocument = loaded.data();
+    QVERIFY(loaded->openDocument(
+            fileName,
+            false,  // permanent
+            true,  // squelchProgressDialog
+            false));  // enableLock
+
+    const QStringList actual = describe(loaded->getComposition());
+    QCOMPARE(actual.size(), expected.size());
+    for (int i = 0; i < expected.size(); ++i) {
+        QCOMPARE(actual[i], expected[i]);
+    }
+
+    RosegardenDocument::currentDocument = nullptr;
+}
+
+void TestXMLReader::benchmarkSave()
+{
+    // How long RosegardenDocument::saveDocument() takes for a large
+    // composition: 200 segments of 4000 notes.  An explicit save holds up
+    // the GUI for all of it.  An autosave only takes the snapshot on the
+    // GUI thread.
+    QTemporaryDir dir;
+    QVERIFY(dir.isValid());
+    const QString fileName = dir.filePath("large.rg");
+
+    QScopedPointer<RosegardenDocument> doc(makeRosegardenDocument());
+    QVERIFY(doc);
+    populate(doc->getComposition(), 200, 4000);
+
+    QBENCHMARK_ONCE {
+        QString errMsg;
+        QVERIFY(doc->saveDocument(fileName, errMsg));
+    }
+
+    RosegardenDocument::currentDocument = nullptr;
+}
+
+QTEST_MAIN(TestXMLReader)
+
+#include "xmlreader.moc"